@@ -0,0 +1,133 @@
+// AdmissionChecks.cpp - Admission checks of AdmissionController that only depend on the network calculus model.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "../common/serializeJSON.hpp"
+#include "../common/metrics.hpp"
+#include "../DNC-Library/DNC.hpp"
+#include "AdmissionChecks.hpp"
+
+static MetricHistogram checkLatencyTime("check_latency_seconds", "Time spent calculating the latencies of added and affected clients");
+
+// Check latency of added clients.
+// If slack is not NULL, it is lowered to the smallest SLO minus latency among the checked clients.
+bool checkLatency(NC* nc, const set<ClientId>& clientIds, double* slack)
+{
+    ScopedTimer timer(checkLatencyTime);
+    bool admitted = true;
+    for (set<ClientId>::const_iterator it = clientIds.begin(); it != clientIds.end(); it++) {
+        ClientId clientId = *it;
+        nc->calcClientLatency(clientId);
+        const Client* c = nc->getClient(clientId);
+        if (slack) {
+            *slack = min(*slack, c->SLO - c->latency);
+        }
+        if (c->latency > c->SLO) {
+            admitted = false;
+            break;
+        }
+    }
+    if (admitted) {
+        // Get clients affected by added clients
+        set<ClientId> affectedClientIds;
+        nc->getAffectedClients(clientIds, affectedClientIds);
+        // Check latency of other affected clients
+        for (set<ClientId>::const_iterator it = affectedClientIds.begin(); it != affectedClientIds.end(); it++) {
+            ClientId clientId = *it;
+            if (clientIds.find(clientId) == clientIds.end()) {
+                nc->calcClientLatency(clientId);
+                const Client* c = nc->getClient(clientId);
+                if (slack) {
+                    *slack = min(*slack, c->SLO - c->latency);
+                }
+                if (c->latency > c->SLO) {
+                    admitted = false;
+                    break;
+                }
+            }
+        }
+    }
+    return admitted;
+}
+
+// Check if we should exit early since server is full
+bool checkOverload(NC* nc, const Json::Value& clientInfos)
+{
+    bool possibleOverload = false;
+    DNC* dnc = dynamic_cast<DNC*>(nc);
+    if (dnc) {
+        for (unsigned int i = 0; i < clientInfos.size(); i++) {
+            const Json::Value& clientInfo = clientInfos[i];
+            if (clientInfo.isMember("admitted") && clientInfo["admitted"].asBool()) {
+                // Must skip checking admitted clients, since they may require shaper curve recomputation
+                continue;
+            }
+            const Json::Value& clientFlows = clientInfo["flows"];
+            for (unsigned int flowIndex = 0; flowIndex < clientFlows.size(); flowIndex++) {
+                const Json::Value& flowInfo = clientFlows[flowIndex];
+                Curve arrivalCurve;
+                deserializeJSON(flowInfo, "arrivalInfo", arrivalCurve);
+                const Json::Value& flowQueues = flowInfo["queues"];
+                for (unsigned int index = 0; index < flowQueues.size(); index++) {
+                    string queueName = flowQueues[index].asString();
+                    QueueId queueId = nc->getQueueIdByName(queueName);
+                    const Queue* queue = nc->getQueue(queueId);
+                    double load = arrivalCurve.back().slope;
+                    for (vector<FlowIndex>::const_iterator it = queue->flows.begin(); it != queue->flows.end(); it++) {
+                        if (dnc) {
+                            SimpleArrivalCurve shaperCurve = dnc->getShaperCurve(it->flowId);
+                            if ((shaperCurve.r == 0) && (shaperCurve.b == 0)) {
+                                // Uninitialized shaper curves require recomputation
+                                return false;
+                            } else {
+                                load += shaperCurve.r;
+                            }
+                        }
+                    }
+                    if (load > 0.999999 * queue->bandwidth) {
+                        possibleOverload = true;
+                    }
+                }
+            }
+        }
+    }
+    return possibleOverload;
+}
+
+// Check if all clients are marked as already admitted, in which case admission control is skipped
+bool checkAdmitOverride(const Json::Value& clientInfos)
+{
+    for (unsigned int i = 0; i < clientInfos.size(); i++) {
+        const Json::Value& clientInfo = clientInfos[i];
+        if (!clientInfo.isMember("admitted") || !clientInfo["admitted"].asBool()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool prefilterClients(NC* nc, const Json::Value& clientInfos, bool fastFirstFit, bool prefilter, PrefilterCheck& prefilterCheck)
+{
+    prefilterCheck = PREFILTER_PASSED;
+    // Check fast first fit
+    if (fastFirstFit) {
+        // Check overload
+        if (checkOverload(nc, clientInfos)) {
+            return false;
+        }
+    }
+    // Check necessary conditions of WorkloadCompactor's LP
+    WorkloadCompactor* wc = dynamic_cast<WorkloadCompactor*>(nc);
+    if (prefilter && wc && !checkAdmitOverride(clientInfos)) {
+        prefilterCheck = wc->prefilterClients(clientInfos);
+        if (prefilterCheck != PREFILTER_PASSED) {
+            return false;
+        }
+    }
+    return true;
+}
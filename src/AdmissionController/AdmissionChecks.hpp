@@ -0,0 +1,30 @@
+// AdmissionChecks.hpp - Admission checks of AdmissionController that only depend on the network calculus model.
+// Shared by AdmissionController and the in-process admission control of PlacementSimulator, so both admit the same workloads.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _ADMISSION_CHECKS_HPP
+#define _ADMISSION_CHECKS_HPP
+
+#include <set>
+#include <json/json.h>
+#include "../DNC-Library/NC.hpp"
+#include "../DNC-Library/WorkloadCompactor.hpp"
+
+using namespace std;
+
+// Check latency of added clients.
+// If slack is not NULL, it is lowered to the smallest SLO minus latency among the checked clients.
+bool checkLatency(NC* nc, const set<ClientId>& clientIds, double* slack);
+// Check if we should exit early since server is full
+bool checkOverload(NC* nc, const Json::Value& clientInfos);
+// Check if all clients are marked as already admitted, in which case admission control is skipped
+bool checkAdmitOverride(const Json::Value& clientInfos);
+// Check clients with quick checks before optimizing rate limit parameters: the fast-first-fit overload check if fastFirstFit is set,
+// and WorkloadCompactor's prefilter if prefilter is set. prefilterCheck is set to the prefilter check that rejected the clients, if any.
+// Returns false if the clients should not be considered further, i.e., they are rejected.
+bool prefilterClients(NC* nc, const Json::Value& clientInfos, bool fastFirstFit, bool prefilter, PrefilterCheck& prefilterCheck);
+
+#endif // _ADMISSION_CHECKS_HPP
@@ -12,6 +12,43 @@
 // "srcAddr" (network) - source address of flow
 // "clientAddr" (storage) - address of the client sending requests
 // Priority is determined with the BySLO policy where the tightest SLO is assigned the highest priority.
+// Enforcer updates are sent in the background over persistent connections, batched per enforcer and retried on failure, so admission does not wait on the enforcers
+// (see EnforcerUpdater.hpp).
+//
+// Before optimizing rate limit parameters, WorkloadCompactor's prefilter rejects workloads that cannot fit based on necessary conditions of the linear program, which are quick to check.
+// The check that rejected a workload is returned in the prefilterCheck of the AddClients/TryAddClients RPC result.
+//
+// Command line parameters:
+// -p (optional) - disables the prefilter
+// -s solver (optional) - solver for WorkloadCompactor's linear program, either "glpk" (default) or "native" for the dedicated ShaperSolver
+// -k numShaperBuckets (optional) - number of (r,b) rate limits per flow; defaults to 1, and more buckets add peak rate limits that let more workloads fit (see WorkloadCompactor::setNumShaperBuckets)
+// -r numReplicas (optional) - number of replicas of the model for running TryAddClients queries concurrently; defaults to 1
+// -m memoCapacity (optional) - number of memoized admission decisions of TryAddClients/EvaluatePlacements queries; 0 disables memoization; defaults to 4096
+// -S snapshotFilename (optional) - file for snapshots of the model, which is restored on startup; modifications after the latest snapshot are logged to snapshotFilename.log
+// -i snapshotInterval (optional) - number of logged modifications after which a new snapshot is written; defaults to 1000
+// -M [metricsAddr:]metricsPort (optional) - TCP port serving the hot path metrics in the Prometheus text format (see common/metrics.hpp); binds to loopback unless metricsAddr is given
+//
+// Each connection is served by its own thread, so a CancelEvaluation RPC is handled while the EvaluatePlacements RPC it cancels is running,
+// and with multiple replicas, a single AdmissionController can serve all of PlacementController's worker connections (see PlacementController's -c option)
+// instead of running one AdmissionController per worker.
+// RPCs that modify the model (AddClients, DelClient, AddQueue, DelQueue) are serialized and applied to every replica,
+// where rate limit parameters are only optimized on the primary replica and copied to the other replicas, while TryAddClients queries run concurrently on replicas that are not in use by other queries.
+//
+// Admission decisions of queries are memoized by the clients and the state of the queues connected to them (see getDecisionKey),
+// so repeating a query, e.g., for a placement that PlacementController tries again, returns the decision without re-optimizing rate limit parameters
+// as long as none of the servers' queues involved have changed in the meantime.
+//
+// An EvaluatePlacements RPC with an evaluationId can be canceled from another connection with a CancelEvaluation RPC, e.g., once PlacementController finds a better fit elsewhere.
+// Cancellation is checked before each candidate and again once the candidate's rate limit parameters are optimized, so a canceled candidate skips its latency calculations.
+//
+// With a snapshot file, the model is restored on startup from the latest snapshot and the log of modifications after it (see AdmissionSnapshot.hpp).
+// Snapshots hold the optimized rate limit parameters of the clients, so only the clients added in the log are re-optimized, and a new snapshot is written once restored.
+//
+// Version 2 of the RPC interface has the same procedures as version 1, with clients encoded in binary instead of JSON text (see prot/AdmissionController_conv.hpp),
+// so that arrival curves are neither printed nor parsed as decimal text. Both versions are served, and AdmissionController_clnt uses version 2 when available.
+//
+// The time spent in RPCs and their hot paths (e.g., LP solves and latency checks) is recorded in histograms that are returned by the GetMetrics RPC (see common/metrics.hpp).
+// AddClients/TryAddClients/EvaluatePlacements RPCs carry the trace ID of the placement they are part of, so slow steps can be matched up with PlacementController's.
 //
 // Copyright (c) 2017 Timothy Zhu.
 // Licensed under the MIT License. See LICENSE file for details.
@@ -22,73 +59,157 @@
 #include <string>
 #include <map>
 #include <set>
+#include <list>
+#include <vector>
+#include <limits>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/poll.h>
+#include <sys/socket.h>
 #include <rpc/rpc.h>
 #include <rpc/pmap_clnt.h>
 #include <json/json.h>
 #include "../prot/AdmissionController_prot.h"
-#include "../prot/net_clnt.hpp"
-#include "../prot/storage_clnt.hpp"
+#include "../prot/AdmissionController_conv.hpp"
 #include "../common/common.hpp"
+#include "../common/metrics.hpp"
 #include "../DNC-Library/NC.hpp"
+#include "../DNC-Library/DNC.hpp"
 #include "../DNC-Library/NCConfig.hpp"
 #include "../DNC-Library/WorkloadCompactor.hpp"
+#include "../DNC-Library/ArrivalCurveCache.hpp"
+#include "AdmissionChecks.hpp"
+#include "EnforcerUpdater.hpp"
+#include "AdmissionSnapshot.hpp"
 
 using namespace std;
 
-// Global network calculus calculator
-NC* nc = NULL;
+// Replicas of the network calculus calculator, which hold the same model.
+// RPCs that modify the model are applied to all replicas, while TryAddClients queries run concurrently on different replicas.
+// The primary replica (g_replicas[0]) determines admission for AddClients and sends updates to the enforcers.
+vector<NC*> g_replicas;
+
+// Held exclusively by RPCs that modify the model and shared by RPCs that query it
+pthread_rwlock_t g_modelLock = PTHREAD_RWLOCK_INITIALIZER;
 
-// Global storage for clientInfos
+// Replicas that are not in use by a query, protected by g_replicaMutex
+pthread_mutex_t g_replicaMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t g_replicaAvailable = PTHREAD_COND_INITIALIZER; // indicates a replica has been released
+vector<NC*> g_freeReplicas;
+
+// Global storage for clientInfos, protected by g_modelLock
 map<ClientId, Json::Value> clientInfoStore;
 
-// Send RPC to NetEnforcer to update workload
-void updateNetEnforcerClient(Json::Value& flowInfo)
+// Enable WorkloadCompactor's prefilter of workloads that cannot fit
+bool g_prefilter = true;
+
+// Default number of memoized admission decisions
+#define ADMISSION_MEMO_CAPACITY 4096
+
+// Admission decision of a TryAddClients query or EvaluatePlacements candidate
+struct AdmissionDecision {
+    bool admitted;
+    AdmissionPrefilterCheck prefilterCheck;
+    double slack;
+};
+
+// Memoized admission decisions by signature of the clients and the state they depend on (see getDecisionKey), protected by g_memoMutex.
+// The front of the list is the most recently used decision.
+typedef list<pair<uint64_t, AdmissionDecision> > DecisionList;
+pthread_mutex_t g_memoMutex = PTHREAD_MUTEX_INITIALIZER;
+DecisionList g_memoList;
+map<uint64_t, DecisionList::iterator> g_memoIndex;
+unsigned int g_memoCapacity = ADMISSION_MEMO_CAPACITY;
+
+// Version of each queue by name, which changes whenever the queue is added or deleted, or its clients are added, deleted, or re-optimized (see getDecisionKey).
+// Versions are taken from a counter of model modifications, so a queue never returns to an earlier version. Both are protected by g_modelLock.
+map<string, uint64_t> g_queueVersions;
+uint64_t g_modelVersion = 0;
+
+// Sends the workload rate limits and priorities to the enforcers in the background
+EnforcerUpdater* g_enforcerUpdater = NULL;
+
+// Time spent handling RPCs, including waiting for the model and replicas
+MetricHistogram g_addClientsTime("admission_add_clients_seconds", "Time spent handling AddClients RPCs");
+MetricHistogram g_tryAddClientsTime("admission_try_add_clients_seconds", "Time spent handling TryAddClients RPCs");
+MetricHistogram g_evaluatePlacementsTime("admission_evaluate_placements_seconds", "Time spent handling EvaluatePlacements RPCs");
+MetricHistogram g_decodeClientsTime("admission_decode_clients_seconds", "Time spent decoding binary clients of version 2 RPCs");
+MetricCounter g_memoHits("admission_memo_hits_total", "Number of admission decisions found in the memo");
+MetricCounter g_memoMisses("admission_memo_misses_total", "Number of admission decisions not found in the memo");
+
+// Default number of logged modifications between snapshots
+#define ADMISSION_SNAPSHOT_INTERVAL 1000
+
+// Snapshot of the model and log of modifications after the snapshot, protected by g_modelLock; disabled if the filename is empty
+string g_snapshotFilename;
+unsigned int g_snapshotInterval = ADMISSION_SNAPSHOT_INTERVAL;
+AdmissionLog g_log;
+
+// Number of canceled evaluations that are kept
+#define ADMISSION_CANCEL_CAPACITY 1024
+
+// Canceled EvaluatePlacements RPCs by evaluationId -> number of candidates that are still evaluated, protected by g_cancelMutex.
+// A cancellation may arrive before or after its evaluation, so the most recent cancellations are kept, with the oldest at the front of g_cancelOrder.
+pthread_mutex_t g_cancelMutex = PTHREAD_MUTEX_INITIALIZER;
+map<uint64_t, unsigned int> g_canceledEvaluations;
+list<uint64_t> g_cancelOrder;
+
+// Latency check of speculatively added clients (see checkLatencyCallback)
+struct LatencyCheck {
+    double slack; // see checkLatency
+    uint64_t evaluationId; // EvaluatePlacements RPC of the clients, or 0 if not canceled
+    unsigned int placementIndex; // index of the clients' candidate placement in the RPC
+    bool canceled; // set if the candidate was canceled, in which case the latency is not checked
+};
+
+// Queue update of workload at NetEnforcer
+void updateNetEnforcerClient(NC* nc, Json::Value& flowInfo)
 {
     if (!flowInfo.isMember("enforcerAddr") || !flowInfo.isMember("dstAddr") || !flowInfo.isMember("srcAddr")) {
         return;
     }
-    net_clnt clnt(flowInfo["enforcerAddr"].asString());
     setFlowParameters(flowInfo, nc);
-    clnt.updateClient(flowInfo);
+    g_enforcerUpdater->updateFlow(flowInfo);
 }
 
-// Send RPC to NetEnforcer to remove workload
+// Queue removal of workload at NetEnforcer
 void removeNetEnforcerClient(Json::Value& flowInfo)
 {
     if (!flowInfo.isMember("enforcerAddr") || !flowInfo.isMember("dstAddr") || !flowInfo.isMember("srcAddr")) {
         return;
     }
-    net_clnt clnt(flowInfo["enforcerAddr"].asString());
-    clnt.removeClient(flowInfo);
+    g_enforcerUpdater->removeFlow(flowInfo);
 }
 
-// Send RPC to NFSEnforcer to update workload
-void updateNFSEnforcerClient(Json::Value& flowInfo)
+// Queue update of workload at NFSEnforcer
+void updateNFSEnforcerClient(NC* nc, Json::Value& flowInfo)
 {
     if (!flowInfo.isMember("enforcerAddr") || !flowInfo.isMember("clientAddr")) {
         return;
     }
-    storage_clnt clnt(flowInfo["enforcerAddr"].asString());
     setFlowParameters(flowInfo, nc);
-    clnt.updateClient(flowInfo);
+    g_enforcerUpdater->updateFlow(flowInfo);
 }
 
-// Send RPC to NFSEnforcer to remove workload
+// Queue removal of workload at NFSEnforcer
 void removeNFSEnforcerClient(Json::Value& flowInfo)
 {
     if (!flowInfo.isMember("enforcerAddr") || !flowInfo.isMember("clientAddr")) {
         return;
     }
-    storage_clnt clnt(flowInfo["enforcerAddr"].asString());
-    flowInfo["priority"] = Json::Value(0);
-    flowInfo.removeMember("rateLimiters");
-    clnt.updateClient(flowInfo);
+    g_enforcerUpdater->removeFlow(flowInfo);
 }
 
 // Check the JSON flowInfo format.
 // Returns error for invalid arguments.
-AdmissionStatus checkFlowInfo(set<string>& flowNames, const Json::Value& flowInfo)
+AdmissionStatus checkFlowInfo(NC* nc, set<string>& flowNames, const Json::Value& flowInfo)
 {
     // Check name
     if (!flowInfo.isMember("name")) {
@@ -125,7 +246,7 @@ AdmissionStatus checkFlowInfo(set<string>& flowNames, const Json::Value& flowInf
 
 // Check the JSON clientInfo format.
 // Returns error for invalid arguments.
-AdmissionStatus checkClientInfo(set<string>& clientNames, set<string>& flowNames, const Json::Value& clientInfo)
+AdmissionStatus checkClientInfo(NC* nc, set<string>& clientNames, set<string>& flowNames, const Json::Value& clientInfo)
 {
     // Check name
     if (!clientInfo.isMember("name")) {
@@ -163,7 +284,7 @@ AdmissionStatus checkClientInfo(set<string>& clientNames, set<string>& flowNames
         return ADMISSION_ERR_INVALID_ARGUMENT;
     }
     for (unsigned int flowIndex = 0; flowIndex < clientFlows.size(); flowIndex++) {
-        AdmissionStatus status = checkFlowInfo(flowNames, clientFlows[flowIndex]);
+        AdmissionStatus status = checkFlowInfo(nc, flowNames, clientFlows[flowIndex]);
         if (status != ADMISSION_SUCCESS) {
             return status;
         }
@@ -173,7 +294,7 @@ AdmissionStatus checkClientInfo(set<string>& clientNames, set<string>& flowNames
 
 // Check list of JSON clientInfo format.
 // Returns error for invalid arguments.
-AdmissionStatus checkClientInfos(const Json::Value& clientInfos)
+AdmissionStatus checkClientInfos(NC* nc, const Json::Value& clientInfos)
 {
     // Check clientInfos is an array
     if (!clientInfos.isArray()) {
@@ -182,7 +303,7 @@ AdmissionStatus checkClientInfos(const Json::Value& clientInfos)
     set<string> clientNames; // ensure no duplicate names
     set<string> flowNames; // ensure no duplicate names
     for (unsigned int i = 0; i < clientInfos.size(); i++) {
-        AdmissionStatus status = checkClientInfo(clientNames, flowNames, clientInfos[i]);
+        AdmissionStatus status = checkClientInfo(nc, clientNames, flowNames, clientInfos[i]);
         if (status != ADMISSION_SUCCESS) {
             return status;
         }
@@ -190,154 +311,420 @@ AdmissionStatus checkClientInfos(const Json::Value& clientInfos)
     return ADMISSION_SUCCESS;
 }
 
-// FlowIndex less-than function
-bool operator< (const FlowIndex& fi1, const FlowIndex& fi2)
+// Check if an EvaluatePlacements candidate has been canceled
+bool evaluationCanceled(uint64_t evaluationId, unsigned int placementIndex)
 {
-    if (fi1.flowId == fi2.flowId) {
-        return (fi1.index < fi2.index);
+    if (evaluationId == 0) {
+        return false;
     }
-    return (fi1.flowId < fi2.flowId);
+    pthread_mutex_lock(&g_cancelMutex);
+    map<uint64_t, unsigned int>::const_iterator it = g_canceledEvaluations.find(evaluationId);
+    bool canceled = (it != g_canceledEvaluations.end()) && (placementIndex >= it->second);
+    pthread_mutex_unlock(&g_cancelMutex);
+    return canceled;
 }
 
-// Mark flows affected at a priority level starting from a flow at a given index.
-void markAffectedFlows(set<FlowIndex>& affectedFlows, const FlowIndex& fi, unsigned int priority)
+// AdmissionCheck callback for checking latency of speculatively added clients; arg is the LatencyCheck.
+// Rate limit parameters are optimized before the latencies are calculated, so a candidate canceled in the meantime skips the latency calculations.
+bool checkLatencyCallback(NC* nc, const set<ClientId>& clientIds, void* arg)
 {
-    const Flow* f = nc->getFlow(fi.flowId);
-    // If f is higher priority, it is unaffected
-    if (f->priority < priority) {
-        return;
+    LatencyCheck* check = static_cast<LatencyCheck*>(arg);
+    WorkloadCompactor* wc = dynamic_cast<WorkloadCompactor*>(nc);
+    if (wc && (check->evaluationId != 0)) {
+        wc->updateShaperParameters();
     }
-    // If we've already marked flow at given index, stop
-    if (affectedFlows.find(fi) != affectedFlows.end()) {
-        return;
+    if (evaluationCanceled(check->evaluationId, check->placementIndex)) {
+        check->canceled = true;
+        return false;
+    }
+    return checkLatency(nc, clientIds, &check->slack);
+}
+
+// Check the valid clients of an AddClients/TryAddClients/EvaluatePlacements RPC with quick checks before optimizing rate limit parameters (see prefilterClients).
+// Returns false if the clients should not be considered further, i.e., they are rejected.
+bool prefilterAddClients(NC* nc, const Json::Value& clientInfos, bool fastFirstFit, AdmissionPrefilterCheck& prefilterCheck)
+{
+    PrefilterCheck check;
+    bool passed = prefilterClients(nc, clientInfos, fastFirstFit, g_prefilter, check);
+    prefilterCheck = static_cast<AdmissionPrefilterCheck>(check);
+    return passed;
+}
+
+// Check the clients of an AddClients/TryAddClients/EvaluatePlacements RPC.
+// Returns false if the clients should not be considered further, i.e., they are rejected; status is set if the clients are invalid.
+bool checkAddClients(NC* nc, const Json::Value& clientInfos, bool fastFirstFit, AdmissionStatus& status, AdmissionPrefilterCheck& prefilterCheck)
+{
+    prefilterCheck = ADMISSION_PREFILTER_PASSED;
+    // Check parameters
+    status = checkClientInfos(nc, clientInfos);
+    if (status != ADMISSION_SUCCESS) {
+        return false;
     }
-    affectedFlows.insert(fi);
-    // Loop through queues affected by flow starting at index
-    for (unsigned int index = fi.index; index < f->queueIds.size(); index++) {
-        const Queue* q = nc->getQueue(f->queueIds[index]);
-        // Try marking other flows sharing queue
-        for (vector<FlowIndex>::const_iterator itFi = q->flows.begin(); itFi != q->flows.end(); itFi++) {
-            markAffectedFlows(affectedFlows, *itFi, f->priority);
+    return prefilterAddClients(nc, clientInfos, fastFirstFit, prefilterCheck);
+}
+
+// Get the signature of a set of clients and the state their admission depends on, which is the state of the queues connected to the clients' queues
+// through shared queues, since admission only re-optimizes and checks the clients sharing queues with the new clients (see WorkloadCompactor's ClientGroups).
+// The state of the connected queues is identified by their versions (see g_queueVersions), so a decision is reused exactly when none of the connected queues has changed.
+// Must be called with g_modelLock held.
+uint64_t getDecisionKey(NC* nc, const Json::Value& clientInfos, bool fastFirstFit)
+{
+    // Find queues connected to the clients' queues
+    vector<QueueId> clientQueueIds;
+    for (unsigned int i = 0; i < clientInfos.size(); i++) {
+        const Json::Value& clientFlows = clientInfos[i]["flows"];
+        for (unsigned int flowIndex = 0; flowIndex < clientFlows.size(); flowIndex++) {
+            const Json::Value& flowQueues = clientFlows[flowIndex]["queues"];
+            for (unsigned int index = 0; index < flowQueues.size(); index++) {
+                clientQueueIds.push_back(nc->getQueueIdByName(flowQueues[index].asString()));
+            }
         }
     }
+    set<QueueId> queueIds;
+    dynamic_cast<WorkloadCompactor*>(nc)->getConnectedQueues(clientQueueIds, queueIds);
+    // Describe the clients and the versions of the connected queues by name, since ids differ between replicas
+    map<string, uint64_t> queueVersions;
+    for (set<QueueId>::const_iterator it = queueIds.begin(); it != queueIds.end(); it++) {
+        const string& name = nc->getQueue(*it)->name;
+        map<string, uint64_t>::const_iterator itV = g_queueVersions.find(name);
+        queueVersions[name] = (itV != g_queueVersions.end()) ? itV->second : 0;
+    }
+    Json::FastWriter writer;
+    ostringstream oss;
+    oss << writer.write(clientInfos) << fastFirstFit;
+    for (map<string, uint64_t>::const_iterator it = queueVersions.begin(); it != queueVersions.end(); it++) {
+        oss << "," << it->first << ":" << it->second;
+    }
+    return hashString(oss.str());
 }
 
-// Check latency of added clients
-bool checkLatency(const set<ClientId>& clientIds)
+// Change the version of a queue; must be called with g_modelLock held exclusively.
+void updateQueueVersion(const string& name)
 {
-    bool admitted = true;
-    set<FlowIndex> affectedFlows;
-    for (set<ClientId>::const_iterator it = clientIds.begin(); it != clientIds.end(); it++) {
-        ClientId clientId = *it;
-        nc->calcClientLatency(clientId);
-        const Client* c = nc->getClient(clientId);
-        if (c->latency > c->SLO) {
-            admitted = false;
-            break;
+    g_modelVersion++;
+    g_queueVersions[name] = g_modelVersion;
+}
+
+// Change the versions of the queues of a client's flows; must be called with g_modelLock held exclusively.
+void updateClientQueueVersions(NC* nc, ClientId clientId)
+{
+    const Client* c = nc->getClient(clientId);
+    for (vector<FlowId>::const_iterator itF = c->flowIds.begin(); itF != c->flowIds.end(); itF++) {
+        const Flow* f = nc->getFlow(*itF);
+        for (vector<QueueId>::const_iterator itQ = f->queueIds.begin(); itQ != f->queueIds.end(); itQ++) {
+            updateQueueVersion(nc->getQueue(*itQ)->name);
         }
-        // Add affected flows
-        for (vector<FlowId>::const_iterator itF = c->flowIds.begin(); itF != c->flowIds.end(); itF++) {
-            FlowIndex fi;
-            fi.flowId = *itF;
-            fi.index = 0;
-            markAffectedFlows(affectedFlows, fi, 0);
+    }
+}
+
+// Get a memoized admission decision; returns false if the decision is not memoized.
+bool getDecision(uint64_t key, AdmissionDecision& decision)
+{
+    pthread_mutex_lock(&g_memoMutex);
+    map<uint64_t, DecisionList::iterator>::iterator it = g_memoIndex.find(key);
+    if (it == g_memoIndex.end()) {
+        pthread_mutex_unlock(&g_memoMutex);
+        g_memoMisses.add();
+        return false;
+    }
+    g_memoList.splice(g_memoList.begin(), g_memoList, it->second);
+    decision = it->second->second;
+    pthread_mutex_unlock(&g_memoMutex);
+    g_memoHits.add();
+    return true;
+}
+
+// Memoize an admission decision, evicting the least recently used decisions beyond capacity.
+void putDecision(uint64_t key, const AdmissionDecision& decision)
+{
+    pthread_mutex_lock(&g_memoMutex);
+    map<uint64_t, DecisionList::iterator>::iterator it = g_memoIndex.find(key);
+    if (it != g_memoIndex.end()) {
+        g_memoList.erase(it->second);
+    }
+    g_memoList.push_front(make_pair(key, decision));
+    g_memoIndex[key] = g_memoList.begin();
+    while (g_memoList.size() > g_memoCapacity) {
+        g_memoIndex.erase(g_memoList.back().first);
+        g_memoList.pop_back();
+    }
+    pthread_mutex_unlock(&g_memoMutex);
+}
+
+// Check if a set of clients would be admitted without adding them, reusing memoized decisions.
+// Returns false if the clients are rejected; status is set if the clients are invalid.
+// If slack is not NULL, it is set to the smallest SLO minus latency among the checked clients (see checkLatency), or 0 if the latency check is skipped.
+// If evaluationId is not 0, the clients are the candidate placementIndex of an EvaluatePlacements RPC, and canceled is set if the candidate is canceled
+// (see CancelEvaluation) before its latency is checked, in which case the decision is not memoized.
+bool decideAddClients(NC* nc, const Json::Value& clientInfos, bool fastFirstFit, AdmissionStatus& status, AdmissionPrefilterCheck& prefilterCheck, double* slack,
+                      uint64_t evaluationId = 0, unsigned int placementIndex = 0, bool* canceled = NULL)
+{
+    AdmissionDecision decision;
+    decision.slack = 0;
+    // Invalid clients depend on all clients' names, so they are not memoized
+    status = checkClientInfos(nc, clientInfos);
+    if (status != ADMISSION_SUCCESS) {
+        prefilterCheck = ADMISSION_PREFILTER_PASSED;
+        return false;
+    }
+    uint64_t key = 0;
+    if (g_memoCapacity > 0) {
+        key = getDecisionKey(nc, clientInfos, fastFirstFit);
+        if (getDecision(key, decision)) {
+            prefilterCheck = decision.prefilterCheck;
+            if (slack) {
+                *slack = decision.slack;
+            }
+            return decision.admitted;
         }
     }
-    if (admitted) {
-        // Get clientIds of affected flows
-        set<ClientId> affectedClientIds;
-        for (set<FlowIndex>::const_iterator it = affectedFlows.begin(); it != affectedFlows.end(); it++) {
-            const Flow* f = nc->getFlow(it->flowId);
-            affectedClientIds.insert(f->clientId);
+    decision.admitted = prefilterAddClients(nc, clientInfos, fastFirstFit, decision.prefilterCheck);
+    if (decision.admitted && !checkAdmitOverride(clientInfos)) {
+        // Check latency of speculatively added clients
+        LatencyCheck check;
+        check.slack = numeric_limits<double>::infinity();
+        check.evaluationId = evaluationId;
+        check.placementIndex = placementIndex;
+        check.canceled = false;
+        decision.admitted = nc->tryAddClients(clientInfos, checkLatencyCallback, &check);
+        decision.slack = check.slack;
+        if (check.canceled) {
+            *canceled = true;
+            prefilterCheck = decision.prefilterCheck;
+            return false;
         }
-        // Check latency of other affected clients
+    }
+    if (g_memoCapacity > 0) {
+        putDecision(key, decision);
+    }
+    prefilterCheck = decision.prefilterCheck;
+    if (slack) {
+        *slack = decision.slack;
+    }
+    return decision.admitted;
+}
+
+// Write a snapshot of the primary replica and start a new log; must be called with g_modelLock held exclusively.
+bool saveSnapshot()
+{
+    WorkloadCompactor* wc = dynamic_cast<WorkloadCompactor*>(g_replicas[0]);
+    ModelSnapshot snapshot;
+    snapshot.logSequence = g_log.getNextSequence();
+    for (QueueIterator it = wc->queuesBegin(); it != wc->queuesEnd(); it++) {
+        Json::Value queueInfo;
+        queueInfo["name"] = Json::Value(it->second->name);
+        queueInfo["bandwidth"] = Json::Value(it->second->bandwidth);
+        snapshot.queueInfos.push_back(queueInfo);
+    }
+    // Clients are saved in the order they were added
+    for (map<ClientId, Json::Value>::const_iterator it = clientInfoStore.begin(); it != clientInfoStore.end(); it++) {
+        const Client* c = wc->getClient(it->first);
+        snapshot.clients.resize(snapshot.clients.size() + 1);
+        SnapshotClient& client = snapshot.clients.back();
+        client.clientInfo = it->second;
+        client.latency = c->latency;
+        wc->getClientState(it->first, client.flows);
+    }
+    if (!writeSnapshot(g_snapshotFilename, snapshot)) {
+        cerr << "Failed to write snapshot " << g_snapshotFilename << endl;
+        return false;
+    }
+    if (!g_log.create(g_snapshotFilename + ".log", snapshot.logSequence)) {
+        cerr << "Failed to create log " << g_snapshotFilename << ".log" << endl;
+        return false;
+    }
+    return true;
+}
+
+// Log a modification of the model, writing a new snapshot once snapshotInterval modifications are logged; must be called with g_modelLock held exclusively.
+void logModification(LogRecord& record)
+{
+    if (g_snapshotFilename.empty()) {
+        return;
+    }
+    // A snapshot includes the modification if it cannot be logged
+    if (!g_log.append(record) || (g_log.getNumRecords() >= g_snapshotInterval)) {
+        saveSnapshot();
+    }
+}
+
+// Re-optimize the rate limit parameters of the primary replica's clients affected by added/deleted clients (see WorkloadCompactor::getAffectedClients),
+// and copy their optimized state to the other replicas, adding the clients that the other replicas do not hold yet.
+// The other replicas do not re-solve the LPs, which could yield different optima when warm started from the bases left by their queries,
+// so that all replicas hold the same rate limit parameters and their memoized decisions share the same keys (see getDecisionKey).
+// The versions of the affected clients' queues are changed.
+// Must be called with g_modelLock held exclusively.
+void updateReplicas(const set<ClientId>& affectedClientIds)
+{
+    WorkloadCompactor* primary = dynamic_cast<WorkloadCompactor*>(g_replicas[0]);
+    primary->updateShaperParameters();
+    for (set<ClientId>::const_iterator it = affectedClientIds.begin(); it != affectedClientIds.end(); it++) {
+        if (primary->getClient(*it) != NULL) {
+            updateClientQueueVersions(primary, *it);
+        }
+    }
+    for (unsigned int replica = 1; replica < g_replicas.size(); replica++) {
+        WorkloadCompactor* wc = dynamic_cast<WorkloadCompactor*>(g_replicas[replica]);
         for (set<ClientId>::const_iterator it = affectedClientIds.begin(); it != affectedClientIds.end(); it++) {
-            ClientId clientId = *it;
-            if (clientIds.find(clientId) == clientIds.end()) {
-                nc->calcClientLatency(clientId);
-                const Client* c = nc->getClient(clientId);
-                if (c->latency > c->SLO) {
-                    admitted = false;
-                    break;
-                }
+            // Skip clients that were deleted from the primary replica
+            const Client* c = primary->getClient(*it);
+            if (c == NULL) {
+                continue;
+            }
+            vector<FlowSnapshot> flows;
+            primary->getClientState(*it, flows);
+            ClientId clientId = wc->getClientIdByName(c->name);
+            if (clientId == InvalidClientId) {
+                wc->restoreClient(clientInfoStore[*it], c->latency, flows);
+            } else {
+                wc->restoreClientState(clientId, c->latency, flows);
             }
         }
+        wc->discardShaperUpdates();
     }
-    return admitted;
 }
 
-// Check if we should exit early since server is full
-bool checkOverload(const Json::Value& clientInfos)
+// Add clients from the log that were admitted before a restart, as AddClients does once clients are admitted.
+// Must be called with g_modelLock held exclusively.
+void replayAddClients(const Json::Value& clientInfos)
 {
-    bool possibleOverload = false;
-    DNC* dnc = dynamic_cast<DNC*>(nc);
-    if (dnc) {
-        for (unsigned int i = 0; i < clientInfos.size(); i++) {
-            const Json::Value& clientInfo = clientInfos[i];
-            if (clientInfo.isMember("admitted") && clientInfo["admitted"].asBool()) {
-                // Must skip checking admitted clients, since they may require shaper curve recomputation
-                continue;
+    WorkloadCompactor* primary = dynamic_cast<WorkloadCompactor*>(g_replicas[0]);
+    set<ClientId> clientIds;
+    for (unsigned int i = 0; i < clientInfos.size(); i++) {
+        ClientId clientId = primary->addClient(clientInfos[i]);
+        clientIds.insert(clientId);
+        clientInfoStore[clientId] = clientInfos[i];
+    }
+    set<ClientId> affectedClientIds;
+    primary->getAffectedClients(affectedClientIds);
+    // Optimize rate limit parameters as when the clients were admitted
+    checkLatency(primary, clientIds, NULL);
+    updateReplicas(affectedClientIds);
+}
+
+// Delete a client from all replicas; ids are looked up by name since they may differ between replicas.
+// The rate limit parameters of the clients sharing its queues are re-optimized on the primary replica and copied to the other replicas.
+// Must be called with g_modelLock held exclusively.
+void deleteClient(const string& name)
+{
+    WorkloadCompactor* primary = dynamic_cast<WorkloadCompactor*>(g_replicas[0]);
+    ClientId clientId = primary->getClientIdByName(name);
+    clientInfoStore.erase(clientId);
+    updateClientQueueVersions(primary, clientId);
+    for (vector<NC*>::const_iterator it = g_replicas.begin(); it != g_replicas.end(); it++) {
+        (*it)->delClient((*it)->getClientIdByName(name));
+    }
+    set<ClientId> affectedClientIds;
+    primary->getAffectedClients(affectedClientIds);
+    updateReplicas(affectedClientIds);
+}
+
+// Restore the model from the snapshot and replay the log of modifications after it, then write a new snapshot.
+// Returns false if the snapshot or log cannot be written; a missing snapshot starts an empty model.
+bool restoreSnapshot()
+{
+    ModelSnapshot snapshot;
+    if (readSnapshot(g_snapshotFilename, snapshot)) {
+        // Restore queues and clients on all replicas without re-optimizing rate limit parameters
+        for (vector<NC*>::const_iterator it = g_replicas.begin(); it != g_replicas.end(); it++) {
+            WorkloadCompactor* wc = dynamic_cast<WorkloadCompactor*>(*it);
+            for (unsigned int i = 0; i < snapshot.queueInfos.size(); i++) {
+                wc->addQueue(snapshot.queueInfos[i]);
             }
-            const Json::Value& clientFlows = clientInfo["flows"];
-            for (unsigned int flowIndex = 0; flowIndex < clientFlows.size(); flowIndex++) {
-                const Json::Value& flowInfo = clientFlows[flowIndex];
-                Curve arrivalCurve;
-                deserializeJSON(flowInfo, "arrivalInfo", arrivalCurve);
-                const Json::Value& flowQueues = flowInfo["queues"];
-                for (unsigned int index = 0; index < flowQueues.size(); index++) {
-                    string queueName = flowQueues[index].asString();
-                    QueueId queueId = nc->getQueueIdByName(queueName);
-                    const Queue* queue = nc->getQueue(queueId);
-                    double load = arrivalCurve.back().slope;
-                    for (vector<FlowIndex>::const_iterator it = queue->flows.begin(); it != queue->flows.end(); it++) {
-                        if (dnc) {
-                            SimpleArrivalCurve shaperCurve = dnc->getShaperCurve(it->flowId);
-                            if ((shaperCurve.r == 0) && (shaperCurve.b == 0)) {
-                                // Uninitialized shaper curves require recomputation
-                                return false;
-                            } else {
-                                load += shaperCurve.r;
-                            }
-                        }
-                    }
-                    if (load > 0.999999 * queue->bandwidth) {
-                        possibleOverload = true;
-                    }
+            for (unsigned int i = 0; i < snapshot.clients.size(); i++) {
+                const SnapshotClient& client = snapshot.clients[i];
+                ClientId clientId = wc->restoreClient(client.clientInfo, client.latency, client.flows);
+                if (wc == g_replicas[0]) {
+                    clientInfoStore[clientId] = client.clientInfo;
                 }
             }
         }
+        cout << "Restored " << snapshot.queueInfos.size() << " queues and " << snapshot.clients.size() << " clients from " << g_snapshotFilename << endl;
+    } else {
+        snapshot.logSequence = 0;
     }
-    return possibleOverload;
+    // Replay modifications after the snapshot
+    vector<LogRecord> records;
+    AdmissionLog::read(g_snapshotFilename + ".log", records);
+    uint64_t nextSequence = snapshot.logSequence;
+    unsigned int numReplayed = 0;
+    for (vector<LogRecord>::const_iterator it = records.begin(); it != records.end(); it++) {
+        const LogRecord& record = *it;
+        if (record.sequence < snapshot.logSequence) {
+            continue;
+        }
+        switch (record.type) {
+            case ADMISSION_LOG_ADD_QUEUE:
+                for (vector<NC*>::const_iterator itR = g_replicas.begin(); itR != g_replicas.end(); itR++) {
+                    (*itR)->addQueue(record.info);
+                }
+                updateQueueVersion(record.info["name"].asString());
+                break;
+            case ADMISSION_LOG_DEL_QUEUE:
+                for (vector<NC*>::const_iterator itR = g_replicas.begin(); itR != g_replicas.end(); itR++) {
+                    (*itR)->delQueue((*itR)->getQueueIdByName(record.name));
+                }
+                updateQueueVersion(record.name);
+                break;
+            case ADMISSION_LOG_ADD_CLIENTS:
+                replayAddClients(record.info);
+                break;
+            case ADMISSION_LOG_DEL_CLIENT:
+                deleteClient(record.name);
+                break;
+        }
+        nextSequence = record.sequence + 1;
+        numReplayed++;
+    }
+    if (numReplayed > 0) {
+        cout << "Replayed " << numReplayed << " modifications from " << g_snapshotFilename << ".log" << endl;
+    }
+    // Start from a new snapshot, which also discards any partially written record at the end of the log
+    g_log.create(g_snapshotFilename + ".log", nextSequence);
+    return saveSnapshot();
 }
 
-// AddClients RPC - performs admission control check on a set of clients and adds clients to system if admitted.
-// Assumes RPCs are not multi-threaded
-AdmissionAddClientsRes* admission_controller_add_clients_svc(AdmissionAddClientsArgs* argp, struct svc_req* rqstp)
+// Get a replica that is not in use by another query, waiting until one is released.
+// Must be called before acquiring g_modelLock, so that queries waiting for a replica do not hold back RPCs that modify the model.
+NC* acquireReplica()
 {
-    static AdmissionAddClientsRes result;
-    // Initialize result
-    result.admitted = true;
-    result.status = ADMISSION_SUCCESS;
-    // Parse input
-    Json::Value clientInfos;
-    if (!stringToJson(argp->clientInfos, clientInfos)) {
-        result.status = ADMISSION_ERR_INVALID_ARGUMENT;
-        result.admitted = false;
-        return &result;
+    pthread_mutex_lock(&g_replicaMutex);
+    while (g_freeReplicas.empty()) {
+        pthread_cond_wait(&g_replicaAvailable, &g_replicaMutex);
     }
-    // Check parameters
-    result.status = checkClientInfos(clientInfos);
-    if (result.status != ADMISSION_SUCCESS) {
-        result.admitted = false;
-        return &result;
-    }
-    // Check fast first fit
-    if (argp->fastFirstFit) {
-        // Check overload
-        if (checkOverload(clientInfos)) {
-            result.admitted = false;
-            return &result;
-        }
+    NC* nc = g_freeReplicas.back();
+    g_freeReplicas.pop_back();
+    pthread_mutex_unlock(&g_replicaMutex);
+    return nc;
+}
+
+// Release a replica acquired with acquireReplica.
+void releaseReplica(NC* nc)
+{
+    pthread_mutex_lock(&g_replicaMutex);
+    g_freeReplicas.push_back(nc);
+    pthread_cond_signal(&g_replicaAvailable);
+    pthread_mutex_unlock(&g_replicaMutex);
+}
+
+// Fill in the result of an AddClients/TryAddClients RPC whose arguments could not be parsed.
+void invalidAddClientsArgs(AdmissionAddClientsRes& result)
+{
+    result.status = ADMISSION_ERR_INVALID_ARGUMENT;
+    result.admitted = false;
+    result.prefilterCheck = ADMISSION_PREFILTER_PASSED;
+}
+
+// Perform admission control check on a set of clients and add clients to system if admitted.
+// Admission is determined by the primary replica, and admitted clients are then added to the other replicas along with the primary replica's rate limit parameters.
+void addClients(Json::Value& clientInfos, bool fastFirstFit, AdmissionAddClientsRes& result)
+{
+    pthread_rwlock_wrlock(&g_modelLock);
+    WorkloadCompactor* nc = dynamic_cast<WorkloadCompactor*>(g_replicas[0]);
+    result.admitted = checkAddClients(nc, clientInfos, fastFirstFit, result.status, result.prefilterCheck);
+    if (!result.admitted) {
+        pthread_rwlock_unlock(&g_modelLock);
+        return;
     }
     // Add clients
     set<ClientId> clientIds;
@@ -347,22 +734,22 @@ AdmissionAddClientsRes* admission_controller_add_clients_svc(AdmissionAddClients
         clientIds.insert(clientId);
         clientInfoStore[clientId] = clientInfo;
     }
-    if (result.status == ADMISSION_SUCCESS) {
-        bool admitOverride = true;
-        for (unsigned int i = 0; i < clientInfos.size(); i++) {
-            const Json::Value& clientInfo = clientInfos[i];
-            if (!clientInfo.isMember("admitted") || !clientInfo["admitted"].asBool()) {
-                admitOverride = false;
-                break;
-            }
-        }
-        if (!admitOverride) {
-            // Check latency of added clients
-            result.admitted = checkLatency(clientIds);
-        }
+    set<ClientId> affectedClientIds;
+    nc->getAffectedClients(affectedClientIds);
+    bool admitOverride = checkAdmitOverride(clientInfos);
+    if (!admitOverride) {
+        // Check latency of added clients
+        result.admitted = checkLatency(nc, clientIds, NULL);
     }
     if (result.admitted) {
-        // Send RPC to NetEnforcer/NFSEnforcer to update client
+        // Add clients to other replicas with the rate limit parameters of the primary replica
+        updateReplicas(affectedClientIds);
+        // Log admitted clients before their flows are updated with enforcer settings
+        LogRecord record;
+        record.type = ADMISSION_LOG_ADD_CLIENTS;
+        record.info = clientInfos;
+        logModification(record);
+        // Queue updates of client at NetEnforcer/NFSEnforcer
         for (unsigned int i = 0; i < clientInfos.size(); i++) {
             Json::Value& clientInfo = clientInfos[i];
             Json::Value& clientFlows = clientInfo["flows"];
@@ -370,9 +757,9 @@ AdmissionAddClientsRes* admission_controller_add_clients_svc(AdmissionAddClients
                 Json::Value& flowInfo = clientFlows[flowIndex];
                 if (flowInfo.isMember("enforcerType")) {
                     if (flowInfo["enforcerType"].asString() == "network") {
-                        updateNetEnforcerClient(flowInfo);
+                        updateNetEnforcerClient(nc, flowInfo);
                     } else if (flowInfo["enforcerType"].asString() == "storage") {
-                        updateNFSEnforcerClient(flowInfo);
+                        updateNFSEnforcerClient(nc, flowInfo);
                     }
                 }
             }
@@ -384,23 +771,228 @@ AdmissionAddClientsRes* admission_controller_add_clients_svc(AdmissionAddClients
             clientInfoStore.erase(clientId);
             nc->delClient(clientId);
         }
+        // Existing clients are re-optimized without the deleted clients, so copy their rate limit parameters to the other replicas
+        updateReplicas(affectedClientIds);
+    }
+    pthread_rwlock_unlock(&g_modelLock);
+}
+
+// Perform admission control check on a set of clients without adding them to the system.
+// Unlike AddClients followed by DelClient, existing clients keep their rate limit parameters, so no re-optimization is needed afterwards.
+// Queries run concurrently, each on a replica that is not in use by another query.
+void tryAddClients(const Json::Value& clientInfos, bool fastFirstFit, AdmissionAddClientsRes& result)
+{
+    NC* nc = acquireReplica();
+    pthread_rwlock_rdlock(&g_modelLock);
+    result.admitted = decideAddClients(nc, clientInfos, fastFirstFit, result.status, result.prefilterCheck, NULL);
+    pthread_rwlock_unlock(&g_modelLock);
+    releaseReplica(nc);
+}
+
+// Perform admission control checks on a client at each candidate placement without adding it to the system.
+// Candidates are evaluated in order on a single replica, which replaces a TryAddClients RPC per candidate.
+// Canceled candidates (see CancelEvaluation) are not evaluated, and a candidate canceled while its rate limit parameters are optimized is left out of the results.
+void evaluatePlacements(const Json::Value& clientInfo, string addrPrefix, const AdmissionPlacement* placements, unsigned int numPlacements,
+                        bool fastFirstFit, bool stopOnFit, uint64_t evaluationId, AdmissionEvaluatePlacementsRes& result)
+{
+    result.status = ADMISSION_SUCCESS;
+    result.results.results_len = 0;
+    result.results.results_val = NULL;
+    if (!clientInfo.isObject()) {
+        result.status = ADMISSION_ERR_INVALID_ARGUMENT;
+        return;
+    }
+    if (!clientInfo.isMember("name")) {
+        result.status = ADMISSION_ERR_MISSING_ARGUMENT;
+        return;
+    }
+    string clientName = clientInfo["name"].asString();
+    // Generate the client's flows and arrival curves once, so only the fields that depend on the placement are updated for each candidate
+    Json::Value clientInfos(Json::arrayValue);
+    clientInfos.append(clientInfo);
+    ClientConfigTemplate config;
+    configGenClientTemplate(clientInfos[0u], clientName, addrPrefix, false, config);
+    // Allocated with malloc since the results are freed with xdr_free after the reply
+    result.results.results_val = static_cast<AdmissionPlacementRes*>(malloc(numPlacements * sizeof(AdmissionPlacementRes)));
+    NC* nc = acquireReplica();
+    pthread_rwlock_rdlock(&g_modelLock);
+    for (unsigned int i = 0; i < numPlacements; i++) {
+        if (evaluationCanceled(evaluationId, i)) {
+            break;
+        }
+        const AdmissionPlacement& placement = placements[i];
+        AdmissionPlacementRes& placementRes = result.results.results_val[i];
+        result.results.results_len++;
+        // Fill in placement of client
+        configGenClientPlacement(clientInfos[0u], config, placement.clientHost, placement.clientVM, placement.serverHost, placement.serverVM);
+        // Check admission
+        AdmissionStatus status;
+        bool canceled = false;
+        placementRes.admitted = decideAddClients(nc, clientInfos, fastFirstFit, status, placementRes.prefilterCheck, &placementRes.slack, evaluationId, i, &canceled);
+        if (status != ADMISSION_SUCCESS) {
+            result.status = status;
+            result.results.results_len = 0;
+            break;
+        }
+        if (canceled) {
+            result.results.results_len--;
+            break;
+        }
+        if (placementRes.admitted && stopOnFit) {
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&g_modelLock);
+    releaseReplica(nc);
+}
+
+// Decode the binary clients of a version 2 RPC, recording the time spent
+bool timedDecodeClientInfos(const AdmissionClientInfo* clientInfos, unsigned int numClientInfos, Json::Value& decodedClientInfos)
+{
+    ScopedTimer timer(g_decodeClientsTime);
+    return decodeClientInfos(clientInfos, numClientInfos, decodedClientInfos);
+}
+
+// AddClients RPC - performs admission control check on a set of clients and adds clients to system if admitted.
+bool_t admission_controller_add_clients_svc(AdmissionAddClientsArgs* argp, AdmissionAddClientsRes* result, struct svc_req* rqstp)
+{
+    ScopedTraceId traceId(argp->traceId);
+    ScopedTimer timer(g_addClientsTime);
+    // Parse input
+    Json::Value clientInfos;
+    if (!stringToJson(argp->clientInfos, clientInfos)) {
+        invalidAddClientsArgs(*result);
+        return TRUE;
+    }
+    addClients(clientInfos, argp->fastFirstFit, *result);
+    return TRUE;
+}
+
+// AddClients RPC (version 2) - same as AddClients with binary clients.
+bool_t admission_controller_add_clients_v2_svc(AdmissionAddClientsArgsV2* argp, AdmissionAddClientsRes* result, struct svc_req* rqstp)
+{
+    ScopedTraceId traceId(argp->traceId);
+    ScopedTimer timer(g_addClientsTime);
+    // Decode input
+    Json::Value clientInfos;
+    if (!timedDecodeClientInfos(argp->clientInfos.clientInfos_val, argp->clientInfos.clientInfos_len, clientInfos)) {
+        invalidAddClientsArgs(*result);
+        return TRUE;
+    }
+    addClients(clientInfos, argp->fastFirstFit, *result);
+    return TRUE;
+}
+
+// TryAddClients RPC - performs admission control check on a set of clients without adding them to the system.
+bool_t admission_controller_try_add_clients_svc(AdmissionAddClientsArgs* argp, AdmissionAddClientsRes* result, struct svc_req* rqstp)
+{
+    ScopedTraceId traceId(argp->traceId);
+    ScopedTimer timer(g_tryAddClientsTime);
+    // Parse input
+    Json::Value clientInfos;
+    if (!stringToJson(argp->clientInfos, clientInfos)) {
+        invalidAddClientsArgs(*result);
+        return TRUE;
+    }
+    tryAddClients(clientInfos, argp->fastFirstFit, *result);
+    return TRUE;
+}
+
+// TryAddClients RPC (version 2) - same as TryAddClients with binary clients.
+bool_t admission_controller_try_add_clients_v2_svc(AdmissionAddClientsArgsV2* argp, AdmissionAddClientsRes* result, struct svc_req* rqstp)
+{
+    ScopedTraceId traceId(argp->traceId);
+    ScopedTimer timer(g_tryAddClientsTime);
+    // Decode input
+    Json::Value clientInfos;
+    if (!timedDecodeClientInfos(argp->clientInfos.clientInfos_val, argp->clientInfos.clientInfos_len, clientInfos)) {
+        invalidAddClientsArgs(*result);
+        return TRUE;
+    }
+    tryAddClients(clientInfos, argp->fastFirstFit, *result);
+    return TRUE;
+}
+
+// EvaluatePlacements RPC - performs admission control checks on a client at each candidate placement without adding it to the system.
+bool_t admission_controller_evaluate_placements_svc(AdmissionEvaluatePlacementsArgs* argp, AdmissionEvaluatePlacementsRes* result, struct svc_req* rqstp)
+{
+    ScopedTraceId traceId(argp->traceId);
+    ScopedTimer timer(g_evaluatePlacementsTime);
+    // Parse input
+    Json::Value clientInfo;
+    if (!stringToJson(argp->clientInfo, clientInfo)) {
+        result->status = ADMISSION_ERR_INVALID_ARGUMENT;
+        result->results.results_len = 0;
+        result->results.results_val = NULL;
+        return TRUE;
+    }
+    evaluatePlacements(clientInfo, string(argp->addrPrefix), argp->placements.placements_val, argp->placements.placements_len,
+                       argp->fastFirstFit, argp->stopOnFit, argp->evaluationId, *result);
+    return TRUE;
+}
+
+// EvaluatePlacements RPC (version 2) - same as EvaluatePlacements with a binary client.
+bool_t admission_controller_evaluate_placements_v2_svc(AdmissionEvaluatePlacementsArgsV2* argp, AdmissionEvaluatePlacementsRes* result, struct svc_req* rqstp)
+{
+    ScopedTraceId traceId(argp->traceId);
+    ScopedTimer timer(g_evaluatePlacementsTime);
+    // Decode input
+    Json::Value clientInfo;
+    bool decoded;
+    {
+        ScopedTimer decodeTimer(g_decodeClientsTime);
+        decoded = decodeClientInfo(argp->clientInfo, clientInfo);
+    }
+    if (!decoded) {
+        result->status = ADMISSION_ERR_INVALID_ARGUMENT;
+        result->results.results_len = 0;
+        result->results.results_val = NULL;
+        return TRUE;
+    }
+    evaluatePlacements(clientInfo, string(argp->addrPrefix), argp->placements.placements_val, argp->placements.placements_len,
+                       argp->fastFirstFit, argp->stopOnFit, argp->evaluationId, *result);
+    return TRUE;
+}
+
+// CancelEvaluation RPC - stop evaluating the candidate placements of an EvaluatePlacements RPC after the given index.
+bool_t admission_controller_cancel_evaluation_svc(AdmissionCancelEvaluationArgs* argp, AdmissionCancelEvaluationRes* result, struct svc_req* rqstp)
+{
+    if (argp->evaluationId == 0) {
+        result->status = ADMISSION_ERR_INVALID_ARGUMENT;
+        return TRUE;
+    }
+    pthread_mutex_lock(&g_cancelMutex);
+    map<uint64_t, unsigned int>::iterator it = g_canceledEvaluations.find(argp->evaluationId);
+    if (it == g_canceledEvaluations.end()) {
+        g_canceledEvaluations[argp->evaluationId] = argp->numPlacements;
+        g_cancelOrder.push_back(argp->evaluationId);
+        // Forget the oldest cancellation
+        if (g_cancelOrder.size() > ADMISSION_CANCEL_CAPACITY) {
+            g_canceledEvaluations.erase(g_cancelOrder.front());
+            g_cancelOrder.pop_front();
+        }
+    } else {
+        it->second = min(it->second, argp->numPlacements);
     }
-    return &result;
+    pthread_mutex_unlock(&g_cancelMutex);
+    result->status = ADMISSION_SUCCESS;
+    return TRUE;
 }
 
 // DelClient RPC - delete a client from system.
-// Assumes RPCs are not multi-threaded
-AdmissionDelClientRes* admission_controller_del_client_svc(AdmissionDelClientArgs* argp, struct svc_req* rqstp)
+bool_t admission_controller_del_client_svc(AdmissionDelClientArgs* argp, AdmissionDelClientRes* result, struct svc_req* rqstp)
 {
-    static AdmissionDelClientRes result;
+    pthread_rwlock_wrlock(&g_modelLock);
+    NC* nc = g_replicas[0];
     string name(argp->name);
     ClientId clientId = nc->getClientIdByName(name);
     // Check that client exists
     if (clientId == InvalidClientId) {
-        result.status = ADMISSION_ERR_CLIENT_NAME_NONEXISTENT;
-        return &result;
+        result->status = ADMISSION_ERR_CLIENT_NAME_NONEXISTENT;
+        pthread_rwlock_unlock(&g_modelLock);
+        return TRUE;
     }
-    // Send RPC to NetEnforcer/NFSEnforcer to remove client
+    // Queue removal of client at NetEnforcer/NFSEnforcer
     assert(clientInfoStore.find(clientId) != clientInfoStore.end());
     Json::Value& clientInfo = clientInfoStore[clientId];
     Json::Value& clientFlows = clientInfo["flows"];
@@ -414,74 +1006,113 @@ AdmissionDelClientRes* admission_controller_del_client_svc(AdmissionDelClientArg
             }
         }
     }
-    // Delete client
-    clientInfoStore.erase(clientId);
-    nc->delClient(clientId);
-    result.status = ADMISSION_SUCCESS;
-    return &result;
+    // Delete client from all replicas
+    deleteClient(name);
+    LogRecord record;
+    record.type = ADMISSION_LOG_DEL_CLIENT;
+    record.name = name;
+    logModification(record);
+    result->status = ADMISSION_SUCCESS;
+    pthread_rwlock_unlock(&g_modelLock);
+    return TRUE;
 }
 
-// AddQueue RPC - add a queue to system.
-// Assumes RPCs are not multi-threaded
-AdmissionAddQueueRes* admission_controller_add_queue_svc(AdmissionAddQueueArgs* argp, struct svc_req* rqstp)
+// Check the queueInfo of an AddQueue RPC.
+// Returns error for invalid arguments.
+AdmissionStatus checkQueueInfo(NC* nc, const Json::Value& queueInfo)
 {
-    static AdmissionAddQueueRes result;
-    // Parse input
-    Json::Value queueInfo;
-    if (!stringToJson(argp->queueInfo, queueInfo)) {
-        result.status = ADMISSION_ERR_INVALID_ARGUMENT;
-        return &result;
-    }
     // Check for valid name
     if (!queueInfo.isMember("name")) {
-        result.status = ADMISSION_ERR_MISSING_ARGUMENT;
-        return &result;
+        return ADMISSION_ERR_MISSING_ARGUMENT;
     }
     if (nc->getQueueIdByName(queueInfo["name"].asString()) != InvalidQueueId) {
-        result.status = ADMISSION_ERR_QUEUE_NAME_IN_USE;
-        return &result;
+        return ADMISSION_ERR_QUEUE_NAME_IN_USE;
     }
     // Check for valid bandwidth
     if (!queueInfo.isMember("bandwidth")) {
-        result.status = ADMISSION_ERR_MISSING_ARGUMENT;
-        return &result;
+        return ADMISSION_ERR_MISSING_ARGUMENT;
     }
     if (queueInfo["bandwidth"].asDouble() <= 0) {
-        result.status = ADMISSION_ERR_INVALID_ARGUMENT;
-        return &result;
+        return ADMISSION_ERR_INVALID_ARGUMENT;
     }
-    // Add queue
-    nc->addQueue(queueInfo);
-    result.status = ADMISSION_SUCCESS;
-    return &result;
+    return ADMISSION_SUCCESS;
+}
+
+// AddQueue RPC - add a queue to system.
+bool_t admission_controller_add_queue_svc(AdmissionAddQueueArgs* argp, AdmissionAddQueueRes* result, struct svc_req* rqstp)
+{
+    // Parse input
+    Json::Value queueInfo;
+    if (!stringToJson(argp->queueInfo, queueInfo)) {
+        result->status = ADMISSION_ERR_INVALID_ARGUMENT;
+        return TRUE;
+    }
+    pthread_rwlock_wrlock(&g_modelLock);
+    result->status = checkQueueInfo(g_replicas[0], queueInfo);
+    if (result->status == ADMISSION_SUCCESS) {
+        // Add queue to all replicas
+        for (vector<NC*>::const_iterator it = g_replicas.begin(); it != g_replicas.end(); it++) {
+            (*it)->addQueue(queueInfo);
+        }
+        updateQueueVersion(queueInfo["name"].asString());
+        LogRecord record;
+        record.type = ADMISSION_LOG_ADD_QUEUE;
+        record.info = queueInfo;
+        logModification(record);
+    }
+    pthread_rwlock_unlock(&g_modelLock);
+    return TRUE;
 }
 
 // DelQueue RPC - delete a queue from system.
-// Assumes RPCs are not multi-threaded
-AdmissionDelQueueRes* admission_controller_del_queue_svc(AdmissionDelQueueArgs* argp, struct svc_req* rqstp)
+bool_t admission_controller_del_queue_svc(AdmissionDelQueueArgs* argp, AdmissionDelQueueRes* result, struct svc_req* rqstp)
 {
-    static AdmissionDelQueueRes result;
+    pthread_rwlock_wrlock(&g_modelLock);
+    NC* nc = g_replicas[0];
     string name(argp->name);
     QueueId queueId = nc->getQueueIdByName(name);
     // Check that queue exists
     if (queueId == InvalidQueueId) {
-        result.status = ADMISSION_ERR_QUEUE_NAME_NONEXISTENT;
-        return &result;
+        result->status = ADMISSION_ERR_QUEUE_NAME_NONEXISTENT;
+        pthread_rwlock_unlock(&g_modelLock);
+        return TRUE;
     }
     // Check that queue is empty
     const Queue* q = nc->getQueue(queueId);
     assert(q != NULL);
     if (!q->flows.empty()) {
-        result.status = ADMISSION_ERR_QUEUE_HAS_ACTIVE_FLOWS;
-        return &result;
+        result->status = ADMISSION_ERR_QUEUE_HAS_ACTIVE_FLOWS;
+        pthread_rwlock_unlock(&g_modelLock);
+        return TRUE;
     }
-    // Delete queue
-    nc->delQueue(queueId);
-    result.status = ADMISSION_SUCCESS;
-    return &result;
+    // Delete queue from all replicas
+    for (vector<NC*>::const_iterator it = g_replicas.begin(); it != g_replicas.end(); it++) {
+        (*it)->delQueue((*it)->getQueueIdByName(name));
+    }
+    updateQueueVersion(name);
+    LogRecord record;
+    record.type = ADMISSION_LOG_DEL_QUEUE;
+    record.name = name;
+    logModification(record);
+    result->status = ADMISSION_SUCCESS;
+    pthread_rwlock_unlock(&g_modelLock);
+    return TRUE;
+}
+
+// GetMetrics RPC - get the hot path metrics.
+bool_t admission_controller_get_metrics_svc(void* argp, AdmissionGetMetricsRes* result, struct svc_req* rqstp)
+{
+    Json::Value metrics;
+    MetricsRegistry::get().toJson(metrics);
+    string metricsStr = jsonToString(metrics);
+    // Freed by xdr_free
+    result->metrics = static_cast<char*>(malloc(metricsStr.length() + 1));
+    strcpy(result->metrics, metricsStr.c_str());
+    return TRUE;
 }
 
-// Main RPC handler
+// Main RPC handler.
+// Arguments and results are local, so requests from different connections can be handled concurrently.
 void admission_controller_program(struct svc_req* rqstp, register SVCXPRT* transp)
 {
     union {
@@ -489,83 +1120,343 @@ void admission_controller_program(struct svc_req* rqstp, register SVCXPRT* trans
         AdmissionDelClientArgs admission_controller_del_client_arg;
         AdmissionAddQueueArgs admission_controller_add_queue_arg;
         AdmissionDelQueueArgs admission_controller_del_queue_arg;
+        AdmissionEvaluatePlacementsArgs admission_controller_evaluate_placements_arg;
+        AdmissionCancelEvaluationArgs admission_controller_cancel_evaluation_arg;
+        AdmissionAddClientsArgsV2 admission_controller_add_clients_v2_arg;
+        AdmissionEvaluatePlacementsArgsV2 admission_controller_evaluate_placements_v2_arg;
     } argument;
-    char* result;
+    union {
+        AdmissionAddClientsRes admission_controller_add_clients_res;
+        AdmissionDelClientRes admission_controller_del_client_res;
+        AdmissionAddQueueRes admission_controller_add_queue_res;
+        AdmissionDelQueueRes admission_controller_del_queue_res;
+        AdmissionEvaluatePlacementsRes admission_controller_evaluate_placements_res;
+        AdmissionCancelEvaluationRes admission_controller_cancel_evaluation_res;
+        AdmissionGetMetricsRes admission_controller_get_metrics_res;
+    } result;
+    bool_t retval;
     xdrproc_t _xdr_argument, _xdr_result;
-    char* (*local)(char*, struct svc_req*);
+    bool_t (*local)(char*, void*, struct svc_req*) = NULL;
 
-    switch (rqstp->rq_proc) {
-        case ADMISSION_CONTROLLER_NULL:
-            svc_sendreply(transp, (xdrproc_t)xdr_void, (caddr_t)NULL);
-            return;
+    // Version 2 procedures with binary clients; the other procedures are the same as version 1
+    if (rqstp->rq_vers == ADMISSION_CONTROLLER_V2) {
+        switch (rqstp->rq_proc) {
+            case ADMISSION_CONTROLLER_ADD_CLIENTS_V2:
+                _xdr_argument = (xdrproc_t)xdr_AdmissionAddClientsArgsV2;
+                _xdr_result = (xdrproc_t)xdr_AdmissionAddClientsRes;
+                local = (bool_t (*)(char*, void*, struct svc_req*))admission_controller_add_clients_v2_svc;
+                break;
 
-        case ADMISSION_CONTROLLER_ADD_CLIENTS:
-            _xdr_argument = (xdrproc_t)xdr_AdmissionAddClientsArgs;
-            _xdr_result = (xdrproc_t)xdr_AdmissionAddClientsRes;
-            local = (char* (*)(char*, struct svc_req*))admission_controller_add_clients_svc;
-            break;
+            case ADMISSION_CONTROLLER_TRY_ADD_CLIENTS_V2:
+                _xdr_argument = (xdrproc_t)xdr_AdmissionAddClientsArgsV2;
+                _xdr_result = (xdrproc_t)xdr_AdmissionAddClientsRes;
+                local = (bool_t (*)(char*, void*, struct svc_req*))admission_controller_try_add_clients_v2_svc;
+                break;
 
-        case ADMISSION_CONTROLLER_DEL_CLIENT:
-            _xdr_argument = (xdrproc_t)xdr_AdmissionDelClientArgs;
-            _xdr_result = (xdrproc_t)xdr_AdmissionDelClientRes;
-            local = (char* (*)(char*, struct svc_req*))admission_controller_del_client_svc;
-            break;
+            case ADMISSION_CONTROLLER_EVALUATE_PLACEMENTS_V2:
+                _xdr_argument = (xdrproc_t)xdr_AdmissionEvaluatePlacementsArgsV2;
+                _xdr_result = (xdrproc_t)xdr_AdmissionEvaluatePlacementsRes;
+                local = (bool_t (*)(char*, void*, struct svc_req*))admission_controller_evaluate_placements_v2_svc;
+                break;
 
-        case ADMISSION_CONTROLLER_ADD_QUEUE:
-            _xdr_argument = (xdrproc_t)xdr_AdmissionAddQueueArgs;
-            _xdr_result = (xdrproc_t)xdr_AdmissionAddQueueRes;
-            local = (char* (*)(char*, struct svc_req*))admission_controller_add_queue_svc;
-            break;
+            default:
+                break;
+        }
+    }
+    if (local == NULL) {
+        switch (rqstp->rq_proc) {
+            case ADMISSION_CONTROLLER_NULL:
+                svc_sendreply(transp, (xdrproc_t)xdr_void, (caddr_t)NULL);
+                return;
 
-        case ADMISSION_CONTROLLER_DEL_QUEUE:
-            _xdr_argument = (xdrproc_t)xdr_AdmissionDelQueueArgs;
-            _xdr_result = (xdrproc_t)xdr_AdmissionDelQueueRes;
-            local = (char* (*)(char*, struct svc_req*))admission_controller_del_queue_svc;
-            break;
+            case ADMISSION_CONTROLLER_ADD_CLIENTS:
+                _xdr_argument = (xdrproc_t)xdr_AdmissionAddClientsArgs;
+                _xdr_result = (xdrproc_t)xdr_AdmissionAddClientsRes;
+                local = (bool_t (*)(char*, void*, struct svc_req*))admission_controller_add_clients_svc;
+                break;
+
+            case ADMISSION_CONTROLLER_DEL_CLIENT:
+                _xdr_argument = (xdrproc_t)xdr_AdmissionDelClientArgs;
+                _xdr_result = (xdrproc_t)xdr_AdmissionDelClientRes;
+                local = (bool_t (*)(char*, void*, struct svc_req*))admission_controller_del_client_svc;
+                break;
+
+            case ADMISSION_CONTROLLER_ADD_QUEUE:
+                _xdr_argument = (xdrproc_t)xdr_AdmissionAddQueueArgs;
+                _xdr_result = (xdrproc_t)xdr_AdmissionAddQueueRes;
+                local = (bool_t (*)(char*, void*, struct svc_req*))admission_controller_add_queue_svc;
+                break;
 
-        default:
-            svcerr_noproc(transp);
-            return;
+            case ADMISSION_CONTROLLER_DEL_QUEUE:
+                _xdr_argument = (xdrproc_t)xdr_AdmissionDelQueueArgs;
+                _xdr_result = (xdrproc_t)xdr_AdmissionDelQueueRes;
+                local = (bool_t (*)(char*, void*, struct svc_req*))admission_controller_del_queue_svc;
+                break;
+
+            case ADMISSION_CONTROLLER_TRY_ADD_CLIENTS:
+                _xdr_argument = (xdrproc_t)xdr_AdmissionAddClientsArgs;
+                _xdr_result = (xdrproc_t)xdr_AdmissionAddClientsRes;
+                local = (bool_t (*)(char*, void*, struct svc_req*))admission_controller_try_add_clients_svc;
+                break;
+
+            case ADMISSION_CONTROLLER_EVALUATE_PLACEMENTS:
+                _xdr_argument = (xdrproc_t)xdr_AdmissionEvaluatePlacementsArgs;
+                _xdr_result = (xdrproc_t)xdr_AdmissionEvaluatePlacementsRes;
+                local = (bool_t (*)(char*, void*, struct svc_req*))admission_controller_evaluate_placements_svc;
+                break;
+
+            case ADMISSION_CONTROLLER_CANCEL_EVALUATION:
+                _xdr_argument = (xdrproc_t)xdr_AdmissionCancelEvaluationArgs;
+                _xdr_result = (xdrproc_t)xdr_AdmissionCancelEvaluationRes;
+                local = (bool_t (*)(char*, void*, struct svc_req*))admission_controller_cancel_evaluation_svc;
+                break;
+
+            case ADMISSION_CONTROLLER_GET_METRICS:
+                _xdr_argument = (xdrproc_t)xdr_void;
+                _xdr_result = (xdrproc_t)xdr_AdmissionGetMetricsRes;
+                local = (bool_t (*)(char*, void*, struct svc_req*))admission_controller_get_metrics_svc;
+                break;
+
+            default:
+                svcerr_noproc(transp);
+                return;
+        }
     }
     memset((char*)&argument, 0, sizeof(argument));
     if (!svc_getargs(transp, (xdrproc_t)_xdr_argument, (caddr_t)&argument)) {
         svcerr_decode(transp);
         return;
     }
-    result = (*local)((char*)&argument, rqstp);
-    if (result != NULL && !svc_sendreply(transp, (xdrproc_t)_xdr_result, result)) {
+    memset((char*)&result, 0, sizeof(result));
+    retval = (*local)((char*)&argument, (void*)&result, rqstp);
+    if (retval && !svc_sendreply(transp, (xdrproc_t)_xdr_result, (char*)&result)) {
         svcerr_systemerr(transp);
     }
+    xdr_free(_xdr_result, (caddr_t)&result);
     if (!svc_freeargs(transp, (xdrproc_t)_xdr_argument, (caddr_t)&argument)) {
         cerr << "Unable to free arguments" << endl;
     }
 }
 
+// Serve the RPCs of a connection until it is closed; run in a thread per connection.
+// Based on svc_getreq_common from glibc-2.19, which is also the basis of NFSEnforcer's custom_svc_run.
+#define RQCRED_SIZE 400 // this size is excessive
+void* connectionThread(void* ptr)
+{
+    SVCXPRT* xprt = static_cast<SVCXPRT*>(ptr);
+    struct rpc_msg msg;
+    char cred_area[2 * MAX_AUTH_BYTES + RQCRED_SIZE];
+    msg.rm_call.cb_cred.oa_base = cred_area;
+    msg.rm_call.cb_verf.oa_base = &(cred_area[MAX_AUTH_BYTES]);
+    while (true) {
+        // Wait for requests; SVC_RECV times out on idle connections, so it is only called once a request has arrived
+        struct pollfd p;
+        p.fd = xprt->xp_sock;
+        p.events = POLLIN;
+        p.revents = 0;
+        if (poll(&p, 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        // Receive messages (supports batch calls)
+        do {
+            if (SVC_RECV(xprt, &msg)) {
+                struct svc_req r;
+                r.rq_clntcred = &(cred_area[2 * MAX_AUTH_BYTES]);
+                r.rq_xprt = xprt;
+                r.rq_prog = msg.rm_call.cb_prog;
+                r.rq_vers = msg.rm_call.cb_vers;
+                r.rq_proc = msg.rm_call.cb_proc;
+                r.rq_cred = msg.rm_call.cb_cred;
+                // Authenticate the message and dispatch it
+                enum auth_stat why = _authenticate(&r, &msg);
+                if (why != AUTH_OK) {
+                    svcerr_auth(xprt, why);
+                } else if ((r.rq_prog == ADMISSION_CONTROLLER_PROGRAM) && ((r.rq_vers == ADMISSION_CONTROLLER_V1) || (r.rq_vers == ADMISSION_CONTROLLER_V2))) {
+                    admission_controller_program(&r, xprt);
+                } else {
+                    svcerr_noprog(xprt);
+                }
+            }
+        } while (SVC_STAT(xprt) == XPRT_MOREREQS);
+        if (SVC_STAT(xprt) == XPRT_DIED) {
+            break;
+        }
+    }
+    SVC_DESTROY(xprt);
+    return NULL;
+}
+
+// Accept connections on a tcp transport, serving each connection's RPCs in its own thread.
+void threadedSvcRun(SVCXPRT* transp)
+{
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    while (true) {
+        int fd = accept(transp->xp_sock, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("accept failed");
+            break;
+        }
+        SVCXPRT* xprt = svcfd_create(fd, 0, 0);
+        if (xprt == NULL) {
+            cerr << "Failed to create connection transport" << endl;
+            close(fd);
+            continue;
+        }
+        pthread_t thread;
+        int rc = pthread_create(&thread, &attr, connectionThread, xprt);
+        if (rc) {
+            cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
+            SVC_DESTROY(xprt);
+        }
+    }
+    pthread_attr_destroy(&attr);
+}
+
+// Delete replicas
+void deleteReplicas()
+{
+    for (vector<NC*>::const_iterator it = g_replicas.begin(); it != g_replicas.end(); it++) {
+        delete *it;
+    }
+    g_replicas.clear();
+    g_freeReplicas.clear();
+}
+
 int main(int argc, char** argv)
 {
-    // Create NC
-    nc = new WorkloadCompactor();
+    int opt = 0;
+    ShaperSolverType solverType = SHAPER_SOLVER_GLPK;
+    long numReplicas = 1;
+    long numShaperBuckets = 1;
+    string metricsAddress;
+    bool validArgs = true;
+    do {
+        opt = getopt(argc, argv, "ps:k:r:m:S:i:M:");
+        switch (opt) {
+            case 'p':
+                g_prefilter = false;
+                break;
+
+            case 's':
+                if (string(optarg) == "glpk") {
+                    solverType = SHAPER_SOLVER_GLPK;
+                } else if (string(optarg) == "native") {
+                    solverType = SHAPER_SOLVER_NATIVE;
+                } else {
+                    validArgs = false;
+                }
+                break;
+
+            case 'k':
+                numShaperBuckets = atol(optarg);
+                if (numShaperBuckets <= 0) {
+                    validArgs = false;
+                }
+                break;
+
+            case 'r':
+                numReplicas = atol(optarg);
+                break;
+
+            case 'm':
+                if (atol(optarg) < 0) {
+                    validArgs = false;
+                } else {
+                    g_memoCapacity = atol(optarg);
+                }
+                break;
+
+            case 'S':
+                g_snapshotFilename = optarg;
+                break;
+
+            case 'i':
+                if (atol(optarg) <= 0) {
+                    validArgs = false;
+                } else {
+                    g_snapshotInterval = atol(optarg);
+                }
+                break;
+
+            case 'M':
+                metricsAddress = optarg;
+                if (!validMetricsAddress(metricsAddress)) {
+                    validArgs = false;
+                }
+                break;
+
+            case -1:
+                break;
+
+            default:
+                break;
+        }
+    } while (opt != -1);
+
+    if (!validArgs || (numReplicas <= 0)) {
+        cout << "Usage: " << argv[0] << " [-p] [-s glpk|native] [-k numShaperBuckets] [-r numReplicas] [-m memoCapacity] [-S snapshotFilename] [-i snapshotInterval] [-M [metricsAddr:]metricsPort]" << endl;
+        return -1;
+    }
+
+    // Create NC replicas
+    for (long i = 0; i < numReplicas; i++) {
+        WorkloadCompactor* wc = new WorkloadCompactor();
+        wc->setSolverType(solverType);
+        wc->setNumShaperBuckets(numShaperBuckets);
+        g_replicas.push_back(wc);
+        g_freeReplicas.push_back(wc);
+    }
+
+    // Restore model from snapshot
+    if (!g_snapshotFilename.empty() && !restoreSnapshot()) {
+        deleteReplicas();
+        return 1;
+    }
 
     // Unregister AdmissionController RPC handlers
     pmap_unset(ADMISSION_CONTROLLER_PROGRAM, ADMISSION_CONTROLLER_V1);
+    pmap_unset(ADMISSION_CONTROLLER_PROGRAM, ADMISSION_CONTROLLER_V2);
 
     // Replace tcp RPC handlers
     register SVCXPRT *transp;
     transp = svctcp_create(RPC_ANYSOCK, 0, 0);
     if (transp == NULL) {
         cerr << "Failed to create tcp service" << endl;
-        delete nc;
+        deleteReplicas();
         return 1;
     }
     if (!svc_register(transp, ADMISSION_CONTROLLER_PROGRAM, ADMISSION_CONTROLLER_V1, admission_controller_program, IPPROTO_TCP)) {
         cerr << "Failed to register tcp AdmissionController" << endl;
-        delete nc;
+        deleteReplicas();
+        return 1;
+    }
+    if (!svc_register(transp, ADMISSION_CONTROLLER_PROGRAM, ADMISSION_CONTROLLER_V2, admission_controller_program, IPPROTO_TCP)) {
+        cerr << "Failed to register tcp AdmissionController version 2" << endl;
+        deleteReplicas();
         return 1;
     }
 
+    // Serve metrics to scrapers
+    if (!metricsAddress.empty() && !startMetricsServer(metricsAddress)) {
+        deleteReplicas();
+        return 1;
+    }
+
+    // Start sending enforcer updates
+    g_enforcerUpdater = new EnforcerUpdater();
+
     // Run proxy
-    svc_run();
-    cerr << "svc_run returned" << endl;
-    delete nc;
+    threadedSvcRun(transp);
+    cerr << "threadedSvcRun returned" << endl;
+    delete g_enforcerUpdater;
+    deleteReplicas();
     return 1;
 }
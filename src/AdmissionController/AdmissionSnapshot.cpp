@@ -0,0 +1,322 @@
+// AdmissionSnapshot.cpp - Code for saving and restoring snapshots of AdmissionController's model and the log of modifications after a snapshot.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <rpc/rpc.h>
+#include <json/json.h>
+#include "../prot/AdmissionController_prot.h"
+#include "../prot/AdmissionController_conv.hpp"
+#include "../DNC-Library/WorkloadCompactor.hpp"
+#include "AdmissionSnapshot.hpp"
+
+using namespace std;
+
+// Copy a string into memory allocated with new[]
+static char* copyString(const string& str)
+{
+    char* c_str = new char[str.length() + 1];
+    strcpy(c_str, str.c_str());
+    return c_str;
+}
+
+// Free the memory allocated by encodeSnapshot
+static void freeSnapshot(AdmissionSnapshot& encoded)
+{
+    for (unsigned int i = 0; i < encoded.queues.queues_len; i++) {
+        delete[] encoded.queues.queues_val[i].name;
+    }
+    delete[] encoded.queues.queues_val;
+    for (unsigned int i = 0; i < encoded.clients.clients_len; i++) {
+        freeClientInfo(encoded.clients.clients_val[i].clientInfo);
+        for (unsigned int flowIndex = 0; flowIndex < encoded.clients.clients_val[i].flows.flows_len; flowIndex++) {
+            delete[] encoded.clients.clients_val[i].flows.flows_val[flowIndex].peakRates.peakRates_val;
+            delete[] encoded.clients.clients_val[i].flows.flows_val[flowIndex].peakBursts.peakBursts_val;
+        }
+        delete[] encoded.clients.clients_val[i].flows.flows_val;
+    }
+    delete[] encoded.clients.clients_val;
+    memset(&encoded, 0, sizeof(encoded));
+}
+
+// Encode a snapshot in binary; returns false if a client cannot be encoded
+static bool encodeSnapshot(const ModelSnapshot& snapshot, AdmissionSnapshot& encoded)
+{
+    memset(&encoded, 0, sizeof(encoded));
+    encoded.logSequence = snapshot.logSequence;
+    encoded.queues.queues_len = snapshot.queueInfos.size();
+    encoded.queues.queues_val = new AdmissionSnapshotQueue[snapshot.queueInfos.size()];
+    for (unsigned int i = 0; i < snapshot.queueInfos.size(); i++) {
+        encoded.queues.queues_val[i].name = copyString(snapshot.queueInfos[i]["name"].asString());
+        encoded.queues.queues_val[i].bandwidth = snapshot.queueInfos[i]["bandwidth"].asDouble();
+    }
+    encoded.clients.clients_val = new AdmissionSnapshotClient[snapshot.clients.size()];
+    memset(encoded.clients.clients_val, 0, snapshot.clients.size() * sizeof(AdmissionSnapshotClient));
+    for (unsigned int i = 0; i < snapshot.clients.size(); i++) {
+        const SnapshotClient& client = snapshot.clients[i];
+        AdmissionSnapshotClient& encodedClient = encoded.clients.clients_val[i];
+        encoded.clients.clients_len++;
+        if (!encodeClientInfo(client.clientInfo, encodedClient.clientInfo)) {
+            freeSnapshot(encoded);
+            return false;
+        }
+        encodedClient.latency = client.latency;
+        encodedClient.flows.flows_len = client.flows.size();
+        encodedClient.flows.flows_val = new AdmissionSnapshotFlow[client.flows.size()];
+        for (unsigned int flowIndex = 0; flowIndex < client.flows.size(); flowIndex++) {
+            const FlowSnapshot& flow = client.flows[flowIndex];
+            AdmissionSnapshotFlow& encodedFlow = encodedClient.flows.flows_val[flowIndex];
+            encodedFlow.r = flow.shaperCurve.r;
+            encodedFlow.b = flow.shaperCurve.b;
+            encodedFlow.peakRates.peakRates_len = flow.peakCurves.size();
+            encodedFlow.peakRates.peakRates_val = new double[flow.peakCurves.size()];
+            encodedFlow.peakBursts.peakBursts_len = flow.peakCurves.size();
+            encodedFlow.peakBursts.peakBursts_val = new double[flow.peakCurves.size()];
+            for (unsigned int peakIndex = 0; peakIndex < flow.peakCurves.size(); peakIndex++) {
+                encodedFlow.peakRates.peakRates_val[peakIndex] = flow.peakCurves[peakIndex].r;
+                encodedFlow.peakBursts.peakBursts_val[peakIndex] = flow.peakCurves[peakIndex].b;
+            }
+            encodedFlow.priority = flow.priority;
+            encodedFlow.latency = flow.latency;
+        }
+    }
+    return true;
+}
+
+// Decode a binary snapshot; returns false if a client cannot be decoded
+static bool decodeSnapshot(const AdmissionSnapshot& encoded, ModelSnapshot& snapshot)
+{
+    snapshot.logSequence = encoded.logSequence;
+    snapshot.queueInfos.resize(encoded.queues.queues_len);
+    for (unsigned int i = 0; i < encoded.queues.queues_len; i++) {
+        Json::Value& queueInfo = snapshot.queueInfos[i];
+        queueInfo["name"] = Json::Value(encoded.queues.queues_val[i].name);
+        queueInfo["bandwidth"] = Json::Value(encoded.queues.queues_val[i].bandwidth);
+    }
+    snapshot.clients.resize(encoded.clients.clients_len);
+    for (unsigned int i = 0; i < encoded.clients.clients_len; i++) {
+        const AdmissionSnapshotClient& encodedClient = encoded.clients.clients_val[i];
+        SnapshotClient& client = snapshot.clients[i];
+        if (!decodeClientInfo(encodedClient.clientInfo, client.clientInfo)) {
+            return false;
+        }
+        client.latency = encodedClient.latency;
+        client.flows.resize(encodedClient.flows.flows_len);
+        for (unsigned int flowIndex = 0; flowIndex < encodedClient.flows.flows_len; flowIndex++) {
+            const AdmissionSnapshotFlow& encodedFlow = encodedClient.flows.flows_val[flowIndex];
+            FlowSnapshot& flow = client.flows[flowIndex];
+            flow.shaperCurve.r = encodedFlow.r;
+            flow.shaperCurve.b = encodedFlow.b;
+            if (encodedFlow.peakRates.peakRates_len != encodedFlow.peakBursts.peakBursts_len) {
+                return false;
+            }
+            flow.peakCurves.resize(encodedFlow.peakRates.peakRates_len);
+            for (unsigned int peakIndex = 0; peakIndex < flow.peakCurves.size(); peakIndex++) {
+                flow.peakCurves[peakIndex].r = encodedFlow.peakRates.peakRates_val[peakIndex];
+                flow.peakCurves[peakIndex].b = encodedFlow.peakBursts.peakBursts_val[peakIndex];
+            }
+            flow.priority = encodedFlow.priority;
+            flow.latency = encodedFlow.latency;
+        }
+    }
+    return true;
+}
+
+bool writeSnapshot(const string& filename, const ModelSnapshot& snapshot)
+{
+    AdmissionSnapshot encoded;
+    if (!encodeSnapshot(snapshot, encoded)) {
+        return false;
+    }
+    // Write to a temporary file
+    string tmpFilename = filename + ".XXXXXX";
+    vector<char> tmpFilenameBuf(tmpFilename.begin(), tmpFilename.end());
+    tmpFilenameBuf.push_back('\0');
+    int fd = mkstemp(&tmpFilenameBuf[0]);
+    if (fd < 0) {
+        freeSnapshot(encoded);
+        return false;
+    }
+    fchmod(fd, 0644);
+    tmpFilename = &tmpFilenameBuf[0];
+    FILE* file = fdopen(fd, "w");
+    if (file == NULL) {
+        close(fd);
+        unlink(tmpFilename.c_str());
+        freeSnapshot(encoded);
+        return false;
+    }
+    XDR xdrs;
+    xdrstdio_create(&xdrs, file, XDR_ENCODE);
+    u_int magic = ADMISSION_SNAPSHOT_MAGIC;
+    bool success = xdr_u_int(&xdrs, &magic) && xdr_AdmissionSnapshot(&xdrs, &encoded);
+    xdr_destroy(&xdrs);
+    freeSnapshot(encoded);
+    // Make the snapshot durable before it replaces the previous one
+    success = (fflush(file) == 0) && (fsync(fileno(file)) == 0) && success;
+    success = (fclose(file) == 0) && success;
+    if (!success || (rename(tmpFilename.c_str(), filename.c_str()) != 0)) {
+        unlink(tmpFilename.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool readSnapshot(const string& filename, ModelSnapshot& snapshot)
+{
+    FILE* file = fopen(filename.c_str(), "r");
+    if (file == NULL) {
+        return false;
+    }
+    XDR xdrs;
+    xdrstdio_create(&xdrs, file, XDR_DECODE);
+    u_int magic = 0;
+    AdmissionSnapshot encoded;
+    memset(&encoded, 0, sizeof(encoded));
+    bool success = xdr_u_int(&xdrs, &magic) && (magic == ADMISSION_SNAPSHOT_MAGIC) && xdr_AdmissionSnapshot(&xdrs, &encoded);
+    success = success && decodeSnapshot(encoded, snapshot);
+    xdr_free((xdrproc_t)xdr_AdmissionSnapshot, (char*)&encoded);
+    xdr_destroy(&xdrs);
+    fclose(file);
+    return success;
+}
+
+AdmissionLog::~AdmissionLog()
+{
+    close();
+}
+
+void AdmissionLog::close()
+{
+    if (_file != NULL) {
+        xdr_destroy(&_xdrs);
+        fclose(_file);
+        _file = NULL;
+    }
+}
+
+bool AdmissionLog::create(const string& filename, uint64_t nextSequence)
+{
+    close();
+    _file = fopen(filename.c_str(), "w");
+    if (_file == NULL) {
+        return false;
+    }
+    xdrstdio_create(&_xdrs, _file, XDR_ENCODE);
+    _nextSequence = nextSequence;
+    _numRecords = 0;
+    u_int magic = ADMISSION_LOG_MAGIC;
+    if (!xdr_u_int(&_xdrs, &magic) || (fflush(_file) != 0)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool AdmissionLog::append(LogRecord& record)
+{
+    if (_file == NULL) {
+        return false;
+    }
+    record.sequence = _nextSequence;
+    // Encode record
+    AdmissionLogEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.sequence = record.sequence;
+    entry.op.type = record.type;
+    bool success = true;
+    switch (record.type) {
+        case ADMISSION_LOG_ADD_QUEUE:
+            entry.op.AdmissionLogOp_u.queue.name = copyString(record.info["name"].asString());
+            entry.op.AdmissionLogOp_u.queue.bandwidth = record.info["bandwidth"].asDouble();
+            break;
+        case ADMISSION_LOG_DEL_QUEUE:
+            entry.op.AdmissionLogOp_u.queueName = copyString(record.name);
+            break;
+        case ADMISSION_LOG_ADD_CLIENTS:
+            success = encodeClientInfos(record.info, entry.op.AdmissionLogOp_u.clientInfos.clientInfos_val, entry.op.AdmissionLogOp_u.clientInfos.clientInfos_len);
+            break;
+        case ADMISSION_LOG_DEL_CLIENT:
+            entry.op.AdmissionLogOp_u.clientName = copyString(record.name);
+            break;
+    }
+    // Write record
+    success = success && xdr_AdmissionLogEntry(&_xdrs, &entry) && (fflush(_file) == 0);
+    // Free memory
+    switch (record.type) {
+        case ADMISSION_LOG_ADD_QUEUE:
+            delete[] entry.op.AdmissionLogOp_u.queue.name;
+            break;
+        case ADMISSION_LOG_DEL_QUEUE:
+            delete[] entry.op.AdmissionLogOp_u.queueName;
+            break;
+        case ADMISSION_LOG_ADD_CLIENTS:
+            freeClientInfos(entry.op.AdmissionLogOp_u.clientInfos.clientInfos_val, entry.op.AdmissionLogOp_u.clientInfos.clientInfos_len);
+            break;
+        case ADMISSION_LOG_DEL_CLIENT:
+            delete[] entry.op.AdmissionLogOp_u.clientName;
+            break;
+    }
+    if (success) {
+        _nextSequence++;
+        _numRecords++;
+    }
+    return success;
+}
+
+bool AdmissionLog::read(const string& filename, vector<LogRecord>& records)
+{
+    FILE* file = fopen(filename.c_str(), "r");
+    if (file == NULL) {
+        return false;
+    }
+    XDR xdrs;
+    xdrstdio_create(&xdrs, file, XDR_DECODE);
+    u_int magic = 0;
+    bool success = xdr_u_int(&xdrs, &magic) && (magic == ADMISSION_LOG_MAGIC);
+    while (success) {
+        AdmissionLogEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        if (!xdr_AdmissionLogEntry(&xdrs, &entry)) {
+            // End of log, or a partially written record
+            xdr_free((xdrproc_t)xdr_AdmissionLogEntry, (char*)&entry);
+            break;
+        }
+        // Decode record
+        LogRecord record;
+        record.sequence = entry.sequence;
+        record.type = entry.op.type;
+        bool decoded = true;
+        switch (entry.op.type) {
+            case ADMISSION_LOG_ADD_QUEUE:
+                record.info["name"] = Json::Value(entry.op.AdmissionLogOp_u.queue.name);
+                record.info["bandwidth"] = Json::Value(entry.op.AdmissionLogOp_u.queue.bandwidth);
+                break;
+            case ADMISSION_LOG_DEL_QUEUE:
+                record.name = entry.op.AdmissionLogOp_u.queueName;
+                break;
+            case ADMISSION_LOG_ADD_CLIENTS:
+                decoded = decodeClientInfos(entry.op.AdmissionLogOp_u.clientInfos.clientInfos_val, entry.op.AdmissionLogOp_u.clientInfos.clientInfos_len, record.info);
+                break;
+            case ADMISSION_LOG_DEL_CLIENT:
+                record.name = entry.op.AdmissionLogOp_u.clientName;
+                break;
+        }
+        xdr_free((xdrproc_t)xdr_AdmissionLogEntry, (char*)&entry);
+        if (!decoded) {
+            break;
+        }
+        records.push_back(record);
+    }
+    xdr_destroy(&xdrs);
+    fclose(file);
+    return success;
+}
@@ -0,0 +1,92 @@
+// AdmissionSnapshot.hpp - Snapshots of AdmissionController's model and the log of modifications after a snapshot, for fast restarts.
+// A snapshot holds the queues and admitted clients together with the optimized rate limit parameters, priorities, and latencies of the clients' flows,
+// so restoring it does not need to re-optimize rate limit parameters (see WorkloadCompactor::restoreClient).
+// Modifications after the snapshot are appended to the log and replayed after restoring the snapshot.
+// Both files are encoded with XDR using the types in prot/AdmissionController_prot.x, with clients encoded in binary as in version 2 of the RPC interface.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _ADMISSION_SNAPSHOT_HPP
+#define _ADMISSION_SNAPSHOT_HPP
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <stdint.h>
+#include <rpc/rpc.h>
+#include <json/json.h>
+#include "../prot/AdmissionController_prot.h"
+#include "../DNC-Library/WorkloadCompactor.hpp"
+
+using namespace std;
+
+// File headers identifying snapshot and log files
+#define ADMISSION_SNAPSHOT_MAGIC 0x41435332 // "ACS2"
+#define ADMISSION_LOG_MAGIC 0x41434c31 // "ACL1"
+
+// Admitted client along with the optimized state of its flows, in flow order.
+struct SnapshotClient {
+    Json::Value clientInfo;
+    double latency;
+    vector<FlowSnapshot> flows;
+};
+
+// Snapshot of the model.
+struct ModelSnapshot {
+    uint64_t logSequence; // log records with a lower sequence number are part of the snapshot
+    vector<Json::Value> queueInfos; // queues, which are restored before the clients
+    vector<SnapshotClient> clients; // clients in the order they are restored
+};
+
+// Modification of the model after a snapshot.
+struct LogRecord {
+    uint64_t sequence;
+    AdmissionLogType type;
+    Json::Value info; // queueInfo (ADMISSION_LOG_ADD_QUEUE) or list of admitted clientInfo (ADMISSION_LOG_ADD_CLIENTS)
+    string name; // name of queue (ADMISSION_LOG_DEL_QUEUE) or client (ADMISSION_LOG_DEL_CLIENT)
+};
+
+// Write a snapshot to a file; the snapshot is written to a temporary file and renamed, so an existing snapshot is only replaced by a complete one.
+bool writeSnapshot(const string& filename, const ModelSnapshot& snapshot);
+// Read a snapshot from a file; returns false if the file does not exist or is not a valid snapshot.
+bool readSnapshot(const string& filename, ModelSnapshot& snapshot);
+
+// Log of modifications, appended as they are made.
+class AdmissionLog
+{
+private:
+    FILE* _file;
+    XDR _xdrs;
+    uint64_t _nextSequence; // sequence number of the next record
+    unsigned int _numRecords; // number of records appended since the log was created
+
+    void close();
+
+    AdmissionLog(const AdmissionLog&); // not implemented
+    AdmissionLog& operator=(const AdmissionLog&); // not implemented
+
+public:
+    AdmissionLog()
+        : _file(NULL),
+          _nextSequence(0),
+          _numRecords(0)
+    {}
+    virtual ~AdmissionLog();
+
+    // Create an empty log, replacing any existing log; records are numbered starting at nextSequence.
+    bool create(const string& filename, uint64_t nextSequence);
+    // Append a record and set its sequence number; the record is flushed before returning so that it survives a crash of the process.
+    bool append(LogRecord& record);
+
+    bool isOpen() const { return _file != NULL; }
+    uint64_t getNextSequence() const { return _nextSequence; }
+    unsigned int getNumRecords() const { return _numRecords; }
+
+    // Read the records of a log file; a record that was only partially written, e.g., due to a crash, ends the log.
+    // Returns false if the file does not exist or is not a log.
+    static bool read(const string& filename, vector<LogRecord>& records);
+};
+
+#endif // _ADMISSION_SNAPSHOT_HPP
@@ -0,0 +1,277 @@
+// EnforcerUpdater.cpp - Code for asynchronously updating the storage (NFSEnforcer) and network (NetEnforcer) enforcers.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <iostream>
+#include <string>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <time.h>
+#include <pthread.h>
+#include <json/json.h>
+#include "../common/time.hpp"
+#include "../common/metrics.hpp"
+#include "../prot/net_clnt.hpp"
+#include "../prot/storage_clnt.hpp"
+#include "EnforcerUpdater.hpp"
+
+using namespace std;
+
+// Get the key identifying a flow at its enforcer
+static string getFlowKey(const Json::Value& flowInfo)
+{
+    if (flowInfo["enforcerType"].asString() == "network") {
+        return flowInfo["dstAddr"].asString() + " " + flowInfo["srcAddr"].asString();
+    } else {
+        return flowInfo["clientAddr"].asString();
+    }
+}
+
+void* EnforcerUpdater::workerThread(void* arg)
+{
+    EnforcerUpdater* updater = reinterpret_cast<EnforcerUpdater*>(arg);
+    pthread_mutex_lock(&updater->_mutex);
+    while (!updater->_shutdown) {
+        // Find an enforcer with updates that are due, and the earliest retry time of the others
+        uint64_t now = GetTime();
+        Enforcer* enforcer = NULL;
+        uint64_t nextRetryTime = 0;
+        for (map<string, Enforcer*>::const_iterator it = updater->_enforcers.begin(); it != updater->_enforcers.end(); it++) {
+            Enforcer* e = it->second;
+            if (e->pending.empty()) {
+                continue;
+            }
+            if (e->retryTime <= now) {
+                enforcer = e;
+                break;
+            }
+            if ((nextRetryTime == 0) || (e->retryTime < nextRetryTime)) {
+                nextRetryTime = e->retryTime;
+            }
+        }
+        if (enforcer == NULL) {
+            // Wait for updates or the next retry
+            if (nextRetryTime == 0) {
+                pthread_cond_wait(&updater->_workAvailable, &updater->_mutex);
+            } else {
+                struct timespec t;
+                ConvertTimeToTimespec(nextRetryTime, &t);
+                pthread_cond_timedwait(&updater->_workAvailable, &updater->_mutex, &t);
+            }
+            continue;
+        }
+        // Send the enforcer's updates without holding the lock so that admission can queue more updates
+        PendingUpdates updates;
+        updates.swap(enforcer->pending);
+        enforcer->sending = true;
+        pthread_mutex_unlock(&updater->_mutex);
+        PendingUpdates failed = sendUpdates(enforcer, updates);
+        pthread_mutex_lock(&updater->_mutex);
+        enforcer->sending = false;
+        updater->_numSent += updates.size() - failed.size();
+        if (failed.empty()) {
+            enforcer->failedAttempts = 0;
+            enforcer->backoff = ENFORCER_UPDATE_INITIAL_BACKOFF;
+        } else {
+            enforcer->failedAttempts++;
+            if (enforcer->failedAttempts >= updater->_maxAttempts) {
+                cerr << "Dropping " << failed.size() << " updates to " << enforcer->addr << " after " << enforcer->failedAttempts << " failed attempts" << endl;
+                updater->_numDropped += failed.size();
+                enforcer->failedAttempts = 0;
+                enforcer->backoff = ENFORCER_UPDATE_INITIAL_BACKOFF;
+            } else {
+                // Requeue the failed updates unless the flows were updated again in the meantime
+                for (PendingUpdates::const_iterator it = failed.begin(); it != failed.end(); it++) {
+                    enforcer->pending.insert(*it);
+                }
+                enforcer->retryTime = GetTime() + enforcer->backoff;
+                enforcer->backoff = min(enforcer->backoff * 2, (uint64_t)ENFORCER_UPDATE_MAX_BACKOFF);
+            }
+        }
+        pthread_cond_broadcast(&updater->_idle);
+    }
+    pthread_mutex_unlock(&updater->_mutex);
+    return NULL;
+}
+
+// Time spent sending the updates of an enforcer, including connecting to it
+static MetricHistogram enforcerUpdateTime("enforcer_update_seconds", "Time spent sending a batch of updates to an enforcer");
+static MetricCounter enforcerUpdateFailures("enforcer_update_failures_total", "Number of batches of updates that failed to be sent to an enforcer");
+
+EnforcerUpdater::PendingUpdates EnforcerUpdater::sendUpdates(Enforcer* enforcer, const PendingUpdates& updates)
+{
+    ScopedTimer timer(enforcerUpdateTime);
+    // Split updates by RPC
+    vector<Json::Value> updateFlowInfos;
+    vector<Json::Value> removeFlowInfos;
+    for (PendingUpdates::const_iterator it = updates.begin(); it != updates.end(); it++) {
+        if (it->second.remove) {
+            removeFlowInfos.push_back(it->second.flowInfo);
+        } else {
+            updateFlowInfos.push_back(it->second.flowInfo);
+        }
+    }
+    bool updated = updateFlowInfos.empty();
+    bool removed = removeFlowInfos.empty();
+    // Connect to enforcer if there is no connection
+    if (enforcer->network) {
+        if (enforcer->netClnt == NULL) {
+            enforcer->netClnt = new net_clnt(enforcer->addr, 5, false);
+        }
+        if (enforcer->netClnt->connected()) {
+            updated = updated || enforcer->netClnt->updateClients(updateFlowInfos);
+            removed = removed || enforcer->netClnt->removeClients(removeFlowInfos);
+        }
+    } else {
+        if (enforcer->storageClnt == NULL) {
+            enforcer->storageClnt = new storage_clnt(enforcer->addr, 5, false);
+        }
+        // Storage flows are removed with updates (see removeFlow)
+        if (enforcer->storageClnt->connected()) {
+            updated = updated || enforcer->storageClnt->updateClients(updateFlowInfos);
+        }
+    }
+    // Drop the connection on failure so that the retry reconnects
+    if (!updated || !removed) {
+        enforcerUpdateFailures.add();
+        delete enforcer->netClnt;
+        enforcer->netClnt = NULL;
+        delete enforcer->storageClnt;
+        enforcer->storageClnt = NULL;
+    }
+    PendingUpdates failed;
+    for (PendingUpdates::const_iterator it = updates.begin(); it != updates.end(); it++) {
+        if (it->second.remove ? !removed : !updated) {
+            failed.insert(*it);
+        }
+    }
+    return failed;
+}
+
+bool EnforcerUpdater::busy() const
+{
+    for (map<string, Enforcer*>::const_iterator it = _enforcers.begin(); it != _enforcers.end(); it++) {
+        if (!it->second->pending.empty() || it->second->sending) {
+            return true;
+        }
+    }
+    return false;
+}
+
+EnforcerUpdater::EnforcerUpdater(unsigned int maxAttempts)
+    : _maxAttempts(max(maxAttempts, 1u)),
+      _numSent(0),
+      _numDropped(0),
+      _shutdown(false)
+{
+    pthread_mutex_init(&_mutex, NULL);
+    // Retry times are monotonic
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&_workAvailable, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&_idle, NULL);
+    int rc = pthread_create(&_thread, NULL, workerThread, reinterpret_cast<void*>(this));
+    if (rc) {
+        cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
+        exit(-1);
+    }
+}
+
+EnforcerUpdater::~EnforcerUpdater()
+{
+    pthread_mutex_lock(&_mutex);
+    _shutdown = true;
+    pthread_cond_broadcast(&_workAvailable);
+    pthread_mutex_unlock(&_mutex);
+    pthread_join(_thread, NULL);
+    for (map<string, Enforcer*>::iterator it = _enforcers.begin(); it != _enforcers.end(); it++) {
+        delete it->second->netClnt;
+        delete it->second->storageClnt;
+        delete it->second;
+    }
+    pthread_cond_destroy(&_idle);
+    pthread_cond_destroy(&_workAvailable);
+    pthread_mutex_destroy(&_mutex);
+}
+
+void EnforcerUpdater::queueUpdate(const Json::Value& flowInfo, bool remove)
+{
+    bool network = (flowInfo["enforcerType"].asString() == "network");
+    string addr = flowInfo["enforcerAddr"].asString();
+    string enforcerKey = (network ? "network " : "storage ") + addr;
+    map<string, Enforcer*>::iterator it = _enforcers.find(enforcerKey);
+    Enforcer* enforcer;
+    if (it == _enforcers.end()) {
+        enforcer = new Enforcer;
+        enforcer->network = network;
+        enforcer->addr = addr;
+        enforcer->netClnt = NULL;
+        enforcer->storageClnt = NULL;
+        enforcer->sending = false;
+        enforcer->failedAttempts = 0;
+        enforcer->backoff = ENFORCER_UPDATE_INITIAL_BACKOFF;
+        enforcer->retryTime = 0;
+        _enforcers[enforcerKey] = enforcer;
+    } else {
+        enforcer = it->second;
+    }
+    // Replace any queued update of the flow
+    PendingUpdate& update = enforcer->pending[getFlowKey(flowInfo)];
+    update.remove = remove;
+    update.flowInfo = flowInfo;
+    pthread_cond_signal(&_workAvailable);
+}
+
+void EnforcerUpdater::updateFlow(const Json::Value& flowInfo)
+{
+    pthread_mutex_lock(&_mutex);
+    queueUpdate(flowInfo, false);
+    pthread_mutex_unlock(&_mutex);
+}
+
+void EnforcerUpdater::removeFlow(const Json::Value& flowInfo)
+{
+    pthread_mutex_lock(&_mutex);
+    if (flowInfo["enforcerType"].asString() == "network") {
+        queueUpdate(flowInfo, true);
+    } else {
+        // NFSEnforcer has no remove RPC, so the flow is reverted to defaults with an update
+        Json::Value defaultFlowInfo = flowInfo;
+        defaultFlowInfo["priority"] = Json::Value(0);
+        defaultFlowInfo.removeMember("rateLimiters");
+        queueUpdate(defaultFlowInfo, false);
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+void EnforcerUpdater::flush()
+{
+    pthread_mutex_lock(&_mutex);
+    while (busy()) {
+        pthread_cond_wait(&_idle, &_mutex);
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+uint64_t EnforcerUpdater::getNumSent()
+{
+    pthread_mutex_lock(&_mutex);
+    uint64_t numSent = _numSent;
+    pthread_mutex_unlock(&_mutex);
+    return numSent;
+}
+
+uint64_t EnforcerUpdater::getNumDropped()
+{
+    pthread_mutex_lock(&_mutex);
+    uint64_t numDropped = _numDropped;
+    pthread_mutex_unlock(&_mutex);
+    return numDropped;
+}
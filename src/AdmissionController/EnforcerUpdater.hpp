@@ -0,0 +1,94 @@
+// EnforcerUpdater.hpp - Asynchronous updates of the storage (NFSEnforcer) and network (NetEnforcer) enforcers.
+// Updates are queued per enforcer and sent by a background thread, so that admission does not wait on enforcer RPCs.
+// Each enforcer has a persistent connection, and the updates queued for an enforcer are sent together in one RPC.
+// Only the latest update of each flow is kept, so a flow that changes again before its update is sent is only sent once.
+// Failed RPCs are retried with exponential backoff over a new connection until maxAttempts consecutive attempts to the enforcer fail,
+// at which point the updates are dropped.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _ENFORCER_UPDATER_HPP
+#define _ENFORCER_UPDATER_HPP
+
+#include <string>
+#include <map>
+#include <stdint.h>
+#include <pthread.h>
+#include <json/json.h>
+#include "../prot/net_clnt.hpp"
+#include "../prot/storage_clnt.hpp"
+
+using namespace std;
+
+// Default number of consecutive failed attempts to send updates to an enforcer before dropping them
+#define ENFORCER_UPDATE_MAX_ATTEMPTS 10
+// Delay before the first retry of a failed attempt, which doubles on each consecutive failure up to the max
+#define ENFORCER_UPDATE_INITIAL_BACKOFF 100000000ull // 100 ms
+#define ENFORCER_UPDATE_MAX_BACKOFF 10000000000ull // 10 s
+
+class EnforcerUpdater
+{
+private:
+    // Latest queued update of a flow
+    struct PendingUpdate {
+        bool remove; // remove the flow from the enforcer rather than update its parameters
+        Json::Value flowInfo;
+    };
+    typedef map<string, PendingUpdate> PendingUpdates; // by flow key (see getFlowKey)
+
+    // State of an enforcer
+    struct Enforcer {
+        bool network; // NetEnforcer or NFSEnforcer
+        string addr;
+        net_clnt* netClnt; // persistent connection to NetEnforcer; NULL if not connected
+        storage_clnt* storageClnt; // persistent connection to NFSEnforcer; NULL if not connected
+        PendingUpdates pending; // updates that have not been sent
+        bool sending; // indicates updates are being sent by the worker thread
+        unsigned int failedAttempts; // number of consecutive failed attempts
+        uint64_t backoff; // delay before the next retry
+        uint64_t retryTime; // time before which updates are not sent
+    };
+
+    pthread_t _thread;
+    pthread_mutex_t _mutex;
+    pthread_cond_t _workAvailable; // indicates updates were queued or the updater is shutting down
+    pthread_cond_t _idle; // indicates the updates of an enforcer were sent or dropped
+    map<string, Enforcer*> _enforcers; // by enforcer type and address
+    unsigned int _maxAttempts;
+    uint64_t _numSent; // number of flow updates sent to enforcers
+    uint64_t _numDropped; // number of flow updates dropped after maxAttempts
+    bool _shutdown;
+
+    static void* workerThread(void* arg);
+    // Queue an update of a flow; must be called with _mutex held
+    void queueUpdate(const Json::Value& flowInfo, bool remove);
+    // Send the updates of an enforcer over its connection; returns the updates that could not be sent
+    static PendingUpdates sendUpdates(Enforcer* enforcer, const PendingUpdates& updates);
+    // Check if there are queued updates or updates being sent; must be called with _mutex held
+    bool busy() const;
+
+    EnforcerUpdater(const EnforcerUpdater&); // not implemented
+    EnforcerUpdater& operator=(const EnforcerUpdater&); // not implemented
+
+public:
+    EnforcerUpdater(unsigned int maxAttempts = ENFORCER_UPDATE_MAX_ATTEMPTS);
+    // Stop the worker thread; updates that have not been sent are dropped
+    virtual ~EnforcerUpdater();
+
+    // Queue an update of a flow's priority and rate limits at the enforcer given by its "enforcerType" and "enforcerAddr".
+    // The flow must have "dstAddr" and "srcAddr" (network) or "clientAddr" (storage) and its "priority" and "rateLimiters" set.
+    void updateFlow(const Json::Value& flowInfo);
+    // Queue removal of a flow from its enforcer; storage flows are reverted to priority 0 without rate limits
+    void removeFlow(const Json::Value& flowInfo);
+    // Wait until there are no queued updates, i.e., all updates have been sent or dropped
+    void flush();
+
+    // Number of flow updates sent to enforcers
+    uint64_t getNumSent();
+    // Number of flow updates dropped after maxAttempts
+    uint64_t getNumDropped();
+};
+
+#endif // _ENFORCER_UPDATER_HPP
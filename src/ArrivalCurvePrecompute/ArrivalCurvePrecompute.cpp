@@ -0,0 +1,183 @@
+// ArrivalCurvePrecompute.cpp - calculates and caches the arrival curves of traces ahead of time.
+// Arrival curves are otherwise calculated the first time a workload is placed, which slows down the first placement of a new workload.
+// The networkIn, networkOut, and storageSSD arrival curves of every trace are calculated in parallel and stored in the arrivalCurves directory.
+// Traces whose arrival curves are already cached are skipped. Should be run from the same directory as PlacementController so that
+// the arrivalCurves directory and profileSSD.txt file are found.
+//
+// Command line parameters:
+// -t topoFilename (optional) - topology file whose client traces are processed; see README for file format
+// -d traceDirectory (optional) - directory whose trace files are processed; can be used instead of, or in addition to, -t
+// -j numThreads (optional) - number of traces to process in parallel; defaults to the number of processors
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <set>
+#include <string>
+#include <cstdlib>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <json/json.h>
+#include "../common/common.hpp"
+#include "../common/time.hpp"
+#include "../DNC-Library/NCConfig.hpp"
+
+using namespace std;
+
+// Directory of cached arrival curve files; see getArrivalCurveFilename
+const string arrivalCurveDirectory = "arrivalCurves";
+
+// Traces to process and the next trace to be claimed by a worker thread
+vector<string> g_traces;
+unsigned int g_nextTrace = 0;
+bool g_failed = false;
+pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Return whether a file exists and is a regular file
+static bool isRegularFile(string filename)
+{
+    struct stat st;
+    return (stat(filename.c_str(), &st) == 0) && S_ISREG(st.st_mode);
+}
+
+// Add the traces of the clients in a topology file
+static bool addTopoTraces(string topoFilename, set<string>& traces)
+{
+    Json::Value rootConfig;
+    if (!readJson(topoFilename, rootConfig)) {
+        return false;
+    }
+    const Json::Value& clients = rootConfig["clients"];
+    for (unsigned int i = 0; i < clients.size(); i++) {
+        if (clients[i].isMember("trace")) {
+            traces.insert(clients[i]["trace"].asString());
+        }
+    }
+    return true;
+}
+
+// Add the trace files in a directory
+static bool addDirectoryTraces(string traceDirectory, set<string>& traces)
+{
+    DIR* dir = opendir(traceDirectory.c_str());
+    if (dir == NULL) {
+        cerr << "Failed to open directory " << traceDirectory << endl;
+        return false;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        string name = entry->d_name;
+        if (startsWith(name, ".")) {
+            continue;
+        }
+        string trace = traceDirectory + "/" + name;
+        if (isRegularFile(trace)) {
+            traces.insert(trace);
+        }
+    }
+    closedir(dir);
+    return true;
+}
+
+// Worker thread that processes traces until none are left
+static void* precomputeThread(void* arg)
+{
+    while (true) {
+        pthread_mutex_lock(&g_mutex);
+        if (g_nextTrace >= g_traces.size()) {
+            pthread_mutex_unlock(&g_mutex);
+            break;
+        }
+        string trace = g_traces[g_nextTrace++];
+        pthread_mutex_unlock(&g_mutex);
+        uint64_t startTime = GetTime();
+        bool exists = isRegularFile(trace);
+        unsigned int numCalculated = exists ? precomputeArrivalCurves(trace, 1) : 0;
+        double duration = ConvertTimeToSeconds(GetTime() - startTime);
+        // Report timing
+        pthread_mutex_lock(&g_mutex);
+        if (!exists) {
+            cout << trace << ": missing" << endl;
+            g_failed = true;
+        } else if (numCalculated == 0) {
+            cout << trace << ": cached" << endl;
+        } else {
+            cout << trace << ": calculated " << numCalculated << " arrival curves in " << fixed << setprecision(3) << duration << " s" << endl;
+        }
+        pthread_mutex_unlock(&g_mutex);
+    }
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    int opt = 0;
+    vector<string> topoFilenames;
+    vector<string> traceDirectories;
+    long numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    do {
+        opt = getopt(argc, argv, "t:d:j:");
+        switch (opt) {
+            case 't':
+                topoFilenames.push_back(string(optarg));
+                break;
+
+            case 'd':
+                traceDirectories.push_back(string(optarg));
+                break;
+
+            case 'j':
+                numThreads = atol(optarg);
+                break;
+
+            case -1:
+                break;
+
+            default:
+                break;
+        }
+    } while (opt != -1);
+
+    if ((topoFilenames.empty() && traceDirectories.empty()) || (numThreads <= 0)) {
+        cout << "Usage: " << argv[0] << " [-t topoFilename] [-d traceDirectory] [-j numThreads]" << endl;
+        return -1;
+    }
+
+    // Collect traces
+    set<string> traces;
+    for (vector<string>::const_iterator it = topoFilenames.begin(); it != topoFilenames.end(); it++) {
+        if (!addTopoTraces(*it, traces)) {
+            return -1;
+        }
+    }
+    for (vector<string>::const_iterator it = traceDirectories.begin(); it != traceDirectories.end(); it++) {
+        if (!addDirectoryTraces(*it, traces)) {
+            return -1;
+        }
+    }
+    g_traces.assign(traces.begin(), traces.end());
+    mkdir(arrivalCurveDirectory.c_str(), 0755);
+
+    // Process traces in parallel
+    uint64_t startTime = GetTime();
+    vector<pthread_t> threads(min(static_cast<size_t>(numThreads), g_traces.size()));
+    vector<bool> threadCreated(threads.size(), false);
+    for (unsigned int i = 1; i < threads.size(); i++) {
+        threadCreated[i] = (pthread_create(&threads[i], NULL, precomputeThread, NULL) == 0);
+    }
+    // Main thread works as well
+    precomputeThread(NULL);
+    for (unsigned int i = 0; i < threads.size(); i++) {
+        if (threadCreated[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    cout << "Processed " << g_traces.size() << " traces in " << fixed << setprecision(3) << ConvertTimeToSeconds(GetTime() - startTime) << " s" << endl;
+    return g_failed ? -1 : 0;
+}
@@ -1,15 +1,21 @@
 // BandwidthTableGen.cpp - tool for building storage profiles for WorkloadCompactor.
 // Calculates read and write bandwidth as a function of request size ranging from 512b to 256kb.
 // Bandwidth tests will perform random I/O to a target file of a given size, and is meant for profiling SSDs.
+// Optionally, a latency profile records the bandwidth and latency percentiles for each request size, queue depth, and read/write mix.
 //
 // Command line parameters:
 // -s sizeMB (required) - size of target file to read/write from
 // -t target (required) - target filename to read/write from
 // -f configFilename (optional) - filename to output results; results will be merged into the json config file
 // -c count (optional) - number of operations to perform for each bandwidth test; defaults to 10000
-// -n numThreads (optional) - number of threads to use; defaults to 32
-// -r numReadThreads (optional) - number of threads to use for read bandwidth tests; defaults to numThreads
-// -w numWriteThreads (optional) - number of threads to use for write bandwidth tests; defaults to numThreads
+// -n numThreads (optional) - number of outstanding I/Os to use; defaults to 32
+// -r numReadThreads (optional) - number of outstanding I/Os to use for read bandwidth tests; defaults to numThreads
+// -w numWriteThreads (optional) - number of outstanding I/Os to use for write bandwidth tests; defaults to numThreads
+// -e engine (optional) - "uring" to submit I/Os asynchronously with io_uring, or "threads" to use one thread per outstanding I/O; defaults to uring, falling back to threads if io_uring is unavailable
+// -p numSubmitters (optional) - number of submitting threads for the uring engine; defaults to the number of cores
+// -l (optional) - also sweep the queue depths and read/write mixes to build the latency profile; disabled by default, since the sweep takes much longer than the bandwidth tests
+// -q queueDepths (optional) - comma separated queue depths for the latency profile; defaults to 1,2,4,8,16,32,64
+// -m readPercents (optional) - comma separated percentages of reads for the latency profile; defaults to 100,50,0
 //
 // Copyright (c) 2017 Timothy Zhu.
 // Licensed under the MIT License. See LICENSE file for details.
@@ -22,27 +28,46 @@
 #include <vector>
 #include <iostream>
 #include <cassert>
+#include <cmath>
 #include <random>
+#include <sstream>
+#include <algorithm>
+#include <pthread.h>
 #include "../common/time.hpp"
 #include "../common/common.hpp"
+#include "IOUring.hpp"
 #include <json/json.h>
 
 using namespace std;
 
-typedef enum {
-    OP_READ,
-    OP_WRITE,
-    OP_MAX
-} disk_op_t;
+// Idle time for the device to settle after each bandwidth test, and after each point of the latency profile's sweep
+#define BANDWIDTH_SETTLE_SECONDS 10
+#define LATENCY_SETTLE_SECONDS 1
 
+// I/Os to perform for a test
 typedef struct {
-    disk_op_t diskOp;
     string filename;
     vector<uint64_t> offset;
+    vector<bool> isRead;
     int* count;
     uint64_t requestSize;
 } bandwidth_test_t;
 
+// Worker performing a share of a test's I/Os
+typedef struct {
+    bandwidth_test_t* test;
+    unsigned int queueDepth; // outstanding I/Os of the worker; always 1 for the threads engine
+    vector<uint64_t> readLatency; // latency of each read in ns
+    vector<uint64_t> writeLatency; // latency of each write in ns
+} worker_t;
+
+// Results of a test
+typedef struct {
+    double duration; // in seconds
+    vector<uint64_t> readLatency; // sorted latency of each read in ns
+    vector<uint64_t> writeLatency; // sorted latency of each write in ns
+} test_result_t;
+
 // Allocate 512 byte aligned buffer
 char* allocBuf(size_t len)
 {
@@ -75,37 +100,47 @@ void getRandomData(char *buf, int size)
     }
     close(randomSource);
 }
-// Performs read/write requests of size requestSize at offsets specified in offset vector
-void* workerThread(void *arg)
+// Open the target for direct I/O
+int openTarget(const string& filename)
 {
-    bandwidth_test_t* args = (bandwidth_test_t*)arg;
-    char* buf = allocBuf(args->requestSize); // O_DIRECT requires 512 byte aligned buffer for local filesystems (but not for NFS)
-
-    if (args->diskOp == OP_WRITE) {
-        getRandomData(buf, args->requestSize);
-    }
-
-    // Open file
-    int fd = open(args->filename.c_str(), O_RDWR | O_DIRECT);
+    int fd = open(filename.c_str(), O_RDWR | O_DIRECT);
     if (fd == -1) {
         cerr << "Failed open errno: " << errno << endl;
         exit(-1);
     }
+    return fd;
+}
+
+// Performs read/write requests of size requestSize at offsets specified in offset vector, one at a time
+void* workerThread(void *arg)
+{
+    worker_t* worker = (worker_t*)arg;
+    bandwidth_test_t* args = worker->test;
+    char* buf = allocBuf(args->requestSize); // O_DIRECT requires 512 byte aligned buffer for local filesystems (but not for NFS)
+    getRandomData(buf, args->requestSize);
+    int fd = openTarget(args->filename);
 
     uint64_t index;
     uint64_t totalCount = static_cast<uint64_t>(args->offset.size());
     while ((index = __sync_fetch_and_add(args->count, 1)) < totalCount) {
         uint64_t offset = args->offset[index];
         uint64_t numb = 0;
-        if (args->diskOp == OP_READ) {
+        uint64_t startTime = GetTime();
+        if (args->isRead[index]) {
             numb = pread(fd, buf, args->requestSize, offset);
-        } else if (args->diskOp == OP_WRITE) {
+        } else {
             numb = pwrite(fd, buf, args->requestSize, offset);
         }
         if (numb != args->requestSize) {
             cerr << "Failed to pread/pwrite " << numb << " errno: " << errno << endl;
             exit(-1);
         }
+        uint64_t latency = GetTime() - startTime;
+        if (args->isRead[index]) {
+            worker->readLatency.push_back(latency);
+        } else {
+            worker->writeLatency.push_back(latency);
+        }
     }
     // Close file
     close(fd);
@@ -114,6 +149,170 @@ void* workerThread(void *arg)
     return NULL;
 }
 
+// Performs read/write requests of size requestSize at offsets specified in offset vector, keeping queueDepth requests outstanding with io_uring
+void* uringWorkerThread(void *arg)
+{
+    worker_t* worker = (worker_t*)arg;
+    bandwidth_test_t* args = worker->test;
+    IOUring ring;
+    if (!ring.init(worker->queueDepth)) {
+        cerr << "Failed io_uring setup errno: " << errno << endl;
+        exit(-1);
+    }
+    int fd = openTarget(args->filename);
+    // Each slot is an outstanding request with its own buffer
+    vector<char*> bufs(worker->queueDepth);
+    vector<uint64_t> slotIndex(worker->queueDepth);
+    vector<uint64_t> slotStartTime(worker->queueDepth);
+    for (unsigned int slot = 0; slot < worker->queueDepth; slot++) {
+        bufs[slot] = allocBuf(args->requestSize);
+        getRandomData(bufs[slot], args->requestSize);
+    }
+
+    uint64_t totalCount = static_cast<uint64_t>(args->offset.size());
+    // Start a request in a slot; returns false if there are no more requests
+    auto startRequest = [&](unsigned int slot) {
+        uint64_t index = __sync_fetch_and_add(args->count, 1);
+        if (index >= totalCount) {
+            return false;
+        }
+        slotIndex[slot] = index;
+        slotStartTime[slot] = GetTime();
+        ring.prepare(args->isRead[index], fd, bufs[slot], args->requestSize, args->offset[index], slot);
+        return true;
+    };
+    unsigned int outstanding = 0;
+    for (unsigned int slot = 0; slot < worker->queueDepth; slot++) {
+        if (startRequest(slot)) {
+            outstanding++;
+        }
+    }
+    while (outstanding > 0) {
+        if (!ring.submitAndWait()) {
+            cerr << "Failed io_uring submit errno: " << errno << endl;
+            exit(-1);
+        }
+        uint64_t slot;
+        int res;
+        while (ring.getCompletion(slot, res)) {
+            uint64_t latency = GetTime() - slotStartTime[slot];
+            if ((res < 0) || ((uint64_t)res != args->requestSize)) {
+                cerr << "Failed to read/write " << res << endl;
+                exit(-1);
+            }
+            if (args->isRead[slotIndex[slot]]) {
+                worker->readLatency.push_back(latency);
+            } else {
+                worker->writeLatency.push_back(latency);
+            }
+            // Reuse the slot for the next request
+            if (!startRequest(slot)) {
+                outstanding--;
+            }
+        }
+    }
+    // Close file
+    close(fd);
+
+    for (unsigned int slot = 0; slot < worker->queueDepth; slot++) {
+        freeBuf(bufs[slot]);
+    }
+    return NULL;
+}
+
+// Check if io_uring is available
+bool uringAvailable()
+{
+    IOUring ring;
+    return ring.init(1);
+}
+
+// Run a test with queueDepth outstanding I/Os
+test_result_t runTest(bandwidth_test_t& args, bool useUring, unsigned int queueDepth, unsigned int numSubmitters)
+{
+    // Split the outstanding I/Os among the workers
+    unsigned int numWorkers = useUring ? min(numSubmitters, queueDepth) : queueDepth;
+    vector<worker_t> workers(numWorkers);
+    for (unsigned int i = 0; i < numWorkers; i++) {
+        workers[i].test = &args;
+        workers[i].queueDepth = useUring ? ((queueDepth / numWorkers) + ((i < (queueDepth % numWorkers)) ? 1 : 0)) : 1;
+    }
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+    vector<pthread_t> threadArray(numWorkers);
+
+    uint64_t startTime = GetTime();
+    // Create worker threads
+    for (unsigned int i = 0; i < numWorkers; i++) {
+        int rc = pthread_create(&threadArray[i],
+                                &attr,
+                                useUring ? uringWorkerThread : workerThread,
+                                (void*)&workers[i]);
+        if (rc) {
+            cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
+            exit(-1);
+        }
+    }
+
+    // Join all threads
+    for (unsigned int i = 0; i < numWorkers; i++) {
+        int rc = pthread_join(threadArray[i], NULL);
+        if (rc) {
+            cerr << "Error joining thread: " << rc << " errno: " << errno << endl;
+            exit(-1);
+        }
+    }
+    uint64_t endTime = GetTime();
+    pthread_attr_destroy(&attr);
+
+    // Merge the workers' latencies
+    test_result_t result;
+    result.duration = ConvertTimeToSeconds(endTime - startTime);
+    for (unsigned int i = 0; i < numWorkers; i++) {
+        result.readLatency.insert(result.readLatency.end(), workers[i].readLatency.begin(), workers[i].readLatency.end());
+        result.writeLatency.insert(result.writeLatency.end(), workers[i].writeLatency.begin(), workers[i].writeLatency.end());
+    }
+    sort(result.readLatency.begin(), result.readLatency.end());
+    sort(result.writeLatency.begin(), result.writeLatency.end());
+    return result;
+}
+
+// Get a percentile of sorted latencies in seconds
+double latencyPercentile(const vector<uint64_t>& latency, double percentile)
+{
+    if (latency.empty()) {
+        return 0;
+    }
+    size_t index = (size_t)ceil(percentile * latency.size());
+    index = (index > 0) ? (index - 1) : 0;
+    return ConvertTimeToSeconds(latency[min(index, latency.size() - 1)]);
+}
+
+// Convert sorted latencies into a json object with the p50, p99, and p99.9 latencies in seconds
+Json::Value latencyPercentiles(const vector<uint64_t>& latency)
+{
+    Json::Value percentiles(Json::objectValue);
+    percentiles["p50"] = latencyPercentile(latency, 0.5);
+    percentiles["p99"] = latencyPercentile(latency, 0.99);
+    percentiles["p999"] = latencyPercentile(latency, 0.999);
+    return percentiles;
+}
+
+// Parse a comma separated list of unsigned ints
+vector<unsigned int> parseList(const char* str)
+{
+    vector<unsigned int> list;
+    stringstream ss(str);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (!item.empty()) {
+            list.push_back(atoi(item.c_str()));
+        }
+    }
+    return list;
+}
+
 int main(int argc, char** argv)
 {
     // Process command line options
@@ -125,11 +324,17 @@ int main(int argc, char** argv)
     int sizeMB = 0;
     string target = "";
     string configFilename;
+    string engine = "uring";
+    bool latencySweep = false;
+    int numSubmitters = sysconf(_SC_NPROCESSORS_ONLN);
+    vector<unsigned int> queueDepths = parseList("1,2,4,8,16,32,64");
+    vector<unsigned int> readPercents = parseList("100,50,0");
     mt19937_64 generator;
     random_device rd;
     generator.seed(rd());
+    const char* usage = " -s sizeMB -t target [-f configFilename] [-c count] [-n numThreads] [-r numReadThreads] [-w numWriteThreads] [-e engine] [-p numSubmitters] [-l] [-q queueDepths] [-m readPercents]";
     do {
-        opt = getopt(argc, argv, "s:t:f:c:n:r:w:");
+        opt = getopt(argc, argv, "s:t:f:c:n:r:w:e:p:lq:m:");
         switch (opt) {
             case 's':
                 sizeMB = atoi(optarg);
@@ -159,11 +364,31 @@ int main(int argc, char** argv)
                 numWriteThreads = atoi(optarg);
                 break;
 
+            case 'e':
+                engine.assign(optarg);
+                break;
+
+            case 'p':
+                numSubmitters = atoi(optarg);
+                break;
+
+            case 'l':
+                latencySweep = true;
+                break;
+
+            case 'q':
+                queueDepths = parseList(optarg);
+                break;
+
+            case 'm':
+                readPercents = parseList(optarg);
+                break;
+
             case -1:
                 break;
 
             default:
-                cerr << "Usage: " << argv[0] << " -s sizeMB -t target [-f configFilename] [-c count] [-n numThreads] [-r numReadThreads] [-w numWriteThreads]" << endl;
+                cerr << "Usage: " << argv[0] << usage << endl;
                 exit(-1);
                 break;
         }
@@ -176,10 +401,23 @@ int main(int argc, char** argv)
     }
 
     // Check arguments
-    if ((sizeMB < 1) || (target == "") || (count < 1) || (numReadThreads < 1) || (numWriteThreads < 1)) {
-        cerr << "Usage: " << argv[0] << " -s sizeMB -t target [-f configFilename] [-c count] [-n numThreads] [-r numReadThreads] [-w numWriteThreads]" << endl;
+    bool validLists = true;
+    for (unsigned int i = 0; i < queueDepths.size(); i++) {
+        validLists = validLists && (queueDepths[i] > 0);
+    }
+    for (unsigned int i = 0; i < readPercents.size(); i++) {
+        validLists = validLists && (readPercents[i] <= 100);
+    }
+    if ((sizeMB < 1) || (target == "") || (count < 1) || (numReadThreads < 1) || (numWriteThreads < 1) ||
+        ((engine != "uring") && (engine != "threads")) || (numSubmitters < 1) || !validLists) {
+        cerr << "Usage: " << argv[0] << usage << endl;
         exit(-1);
     }
+    bool useUring = (engine == "uring");
+    if (useUring && !uringAvailable()) {
+        cerr << "io_uring is unavailable, using one thread per outstanding I/O" << endl;
+        useUring = false;
+    }
 
     // Open base config file
     Json::Value root;
@@ -190,16 +428,6 @@ int main(int argc, char** argv)
         }
     }
 
-    // Profile bandwidth
-    pthread_attr_t attr;
-    pthread_attr_init(&attr);
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-    pthread_t* threadArray = new pthread_t[max(numReadThreads, numWriteThreads)];
-    if (threadArray == NULL) {
-        cerr << "Failed to create thread array" << endl;
-        exit(1);
-    }
-
     vector<unsigned int> requestSizes;
     //for (unsigned int requestSize = 512; requestSize < 65536; requestSize += 512) {
     //    requestSizes.push_back(requestSize);
@@ -211,56 +439,72 @@ int main(int argc, char** argv)
     //requestSizes.push_back(256 * 1024);
     vector<double> bwReadTable;
     vector<double> bwWriteTable;
+    Json::Value latencyProfile(Json::arrayValue);
 
     for (unsigned int j = 0; j < requestSizes.size(); j++) { // for each request size
-        for (int diskOp = OP_READ; diskOp < OP_MAX; diskOp++) { // for each operation type
+        // Tests as (queue depth, read percent); the bandwidth table tests come first, followed by the latency profile's sweep, if enabled
+        vector<pair<unsigned int, unsigned int> > tests;
+        tests.push_back(make_pair((unsigned int)numReadThreads, 100u));
+        tests.push_back(make_pair((unsigned int)numWriteThreads, 0u));
+        for (unsigned int r = 0; latencySweep && (r < readPercents.size()); r++) {
+            for (unsigned int q = 0; q < queueDepths.size(); q++) {
+                pair<unsigned int, unsigned int> test(queueDepths[q], readPercents[r]);
+                if (find(tests.begin(), tests.end(), test) == tests.end()) {
+                    tests.push_back(test);
+                }
+            }
+        }
+        for (unsigned int t = 0; t < tests.size(); t++) { // for each queue depth and read/write mix
+            unsigned int queueDepth = tests[t].first;
+            unsigned int readPercent = tests[t].second;
             int index = 0;
             bandwidth_test_t args;
-            args.diskOp = (disk_op_t)diskOp;
             args.filename = target;
             args.count = &index;
             args.requestSize = requestSizes[j];
             int maxBlock = ((((uint64_t)sizeMB) * 1024ull * 1024ull) / args.requestSize) - 1;
             uniform_int_distribution<uint64_t> distribution(0, maxBlock);
+            uniform_int_distribution<unsigned int> mixDistribution(0, 99);
             for (int i = 0; i < count; i++) {
                 args.offset.push_back(args.requestSize * distribution(generator));
+                args.isRead.push_back(mixDistribution(generator) < readPercent);
             }
 
-            uint64_t startTime = GetTime();
-            // Create worker threads
-            numThreads = (diskOp == OP_READ) ? numReadThreads : numWriteThreads;
-            for (int i = 0; i < numThreads; i++) {
-                int rc = pthread_create(&threadArray[i],
-                                        &attr,
-                                        workerThread,
-                                        (void*)&args);
-                if (rc) {
-                    cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
-                    exit(-1);
-                }
-            }
-
-            // Join all threads
-            for (int i = 0; i < numThreads; i++) {
-                int rc = pthread_join(threadArray[i], NULL);
-                if (rc) {
-                    cerr << "Error joining thread: " << rc << " errno: " << errno << endl;
-                    exit(-1);
-                }
-            }
+            test_result_t result = runTest(args, useUring, queueDepth, numSubmitters);
 
             // Record bandwidth
-            uint64_t endTime = GetTime();
-            double duration = ConvertTimeToSeconds(endTime - startTime);
-            double bw = ((double)args.requestSize * (double)count) / duration;
-            if (diskOp == OP_READ) {
-                bwReadTable.push_back(bw);
-                cout << "Read " << args.requestSize << ": " << (bw / 1024.0 / 1024.0) << " MB/s" << endl;
-            } else if (diskOp == OP_WRITE) {
-                bwWriteTable.push_back(bw);
-                cout << "Write " << args.requestSize << ": " << (bw / 1024.0 / 1024.0) << " MB/s" << endl;
+            double readBW = ((double)args.requestSize * (double)result.readLatency.size()) / result.duration;
+            double writeBW = ((double)args.requestSize * (double)result.writeLatency.size()) / result.duration;
+            if (t == 0) {
+                bwReadTable.push_back(readBW);
+                cout << "Read " << args.requestSize << ": " << (readBW / 1024.0 / 1024.0) << " MB/s" << endl;
+            } else if (t == 1) {
+                bwWriteTable.push_back(writeBW);
+                cout << "Write " << args.requestSize << ": " << (writeBW / 1024.0 / 1024.0) << " MB/s" << endl;
             }
-            RelativeSleepUninterruptible(ConvertSecondsToTime(10));
+            // Record latency profile
+            if (latencySweep &&
+                (find(queueDepths.begin(), queueDepths.end(), queueDepth) != queueDepths.end()) &&
+                (find(readPercents.begin(), readPercents.end(), readPercent) != readPercents.end())) {
+                Json::Value entry;
+                entry["requestSize"] = requestSizes[j]; // in B
+                entry["queueDepth"] = queueDepth;
+                entry["readFraction"] = readPercent / 100.0;
+                entry["bandwidth"] = readBW + writeBW; // bw in B/s
+                entry["readBandwidth"] = readBW; // bw in B/s
+                entry["writeBandwidth"] = writeBW; // bw in B/s
+                if (!result.readLatency.empty()) {
+                    entry["readLatency"] = latencyPercentiles(result.readLatency); // in seconds
+                }
+                if (!result.writeLatency.empty()) {
+                    entry["writeLatency"] = latencyPercentiles(result.writeLatency); // in seconds
+                }
+                latencyProfile.append(entry);
+                cout << "Profile " << args.requestSize << " qd " << queueDepth << " " << readPercent << "% reads: " << ((readBW + writeBW) / 1024.0 / 1024.0) << " MB/s"
+                     << ", p99 read " << (latencyPercentile(result.readLatency, 0.99) * 1000) << " ms"
+                     << ", p99 write " << (latencyPercentile(result.writeLatency, 0.99) * 1000) << " ms" << endl;
+            }
+            RelativeSleepUninterruptible(ConvertSecondsToTime((t < 2) ? BANDWIDTH_SETTLE_SECONDS : LATENCY_SETTLE_SECONDS));
         }
     }
 
@@ -273,6 +517,9 @@ int main(int argc, char** argv)
         bwTableEntry["readBandwidth"] = bwReadTable[j]; // bw in B/s
         bwTableEntry["writeBandwidth"] = bwWriteTable[j];  // bw in B/s
     }
+    if (latencySweep) {
+        root["latencyProfile"] = latencyProfile;
+    }
 
     // Output results
     if (!configFilename.empty()) {
@@ -281,9 +528,5 @@ int main(int argc, char** argv)
         // Print results
         cout << root;
     }
-
-    // Cleanup
-    pthread_attr_destroy(&attr);
-    delete[] threadArray;
     return 0;
 }
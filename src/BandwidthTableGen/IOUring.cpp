@@ -0,0 +1,130 @@
+// IOUring.cpp - Minimal io_uring wrapper for asynchronous reads and writes.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "IOUring.hpp"
+
+IOUring::IOUring()
+    : _fd(-1),
+      _sqRing(MAP_FAILED),
+      _sqRingSize(0),
+      _sqes((struct io_uring_sqe*)MAP_FAILED),
+      _sqesSize(0),
+      _pending(0),
+      _cqRing(MAP_FAILED),
+      _cqRingSize(0)
+{
+}
+
+IOUring::~IOUring()
+{
+    if (_sqes != MAP_FAILED) {
+        munmap(_sqes, _sqesSize);
+    }
+    if ((_cqRing != MAP_FAILED) && (_cqRing != _sqRing)) {
+        munmap(_cqRing, _cqRingSize);
+    }
+    if (_sqRing != MAP_FAILED) {
+        munmap(_sqRing, _sqRingSize);
+    }
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+bool IOUring::init(unsigned int entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    _fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (_fd < 0) {
+        return false;
+    }
+    // Map the rings, which share one mapping on newer kernels
+    _sqRingSize = params.sq_off.array + (params.sq_entries * sizeof(unsigned int));
+    _cqRingSize = params.cq_off.cqes + (params.cq_entries * sizeof(struct io_uring_cqe));
+    bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMap && (_cqRingSize > _sqRingSize)) {
+        _sqRingSize = _cqRingSize;
+    }
+    _sqRing = mmap(NULL, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    if (_sqRing == MAP_FAILED) {
+        return false;
+    }
+    if (singleMap) {
+        _cqRing = _sqRing;
+    } else {
+        _cqRing = mmap(NULL, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+        if (_cqRing == MAP_FAILED) {
+            return false;
+        }
+    }
+    _sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    _sqes = (struct io_uring_sqe*)mmap(NULL, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+    if (_sqes == MAP_FAILED) {
+        return false;
+    }
+    char* sq = (char*)_sqRing;
+    _sqTail = (unsigned int*)(sq + params.sq_off.tail);
+    _sqMask = *(unsigned int*)(sq + params.sq_off.ring_mask);
+    _sqArray = (unsigned int*)(sq + params.sq_off.array);
+    char* cq = (char*)_cqRing;
+    _cqHead = (unsigned int*)(cq + params.cq_off.head);
+    _cqTail = (unsigned int*)(cq + params.cq_off.tail);
+    _cqMask = *(unsigned int*)(cq + params.cq_off.ring_mask);
+    _cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return true;
+}
+
+void IOUring::prepare(bool isRead, int fd, void* buf, unsigned int len, uint64_t offset, uint64_t userData)
+{
+    // Only this thread produces entries, so the tail can be read without synchronization
+    unsigned int tail = *_sqTail;
+    unsigned int index = tail & _sqMask;
+    struct io_uring_sqe* sqe = &_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = isRead ? IORING_OP_READ : IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = userData;
+    _sqArray[index] = index;
+    // Publish the entry to the kernel
+    __atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+    _pending++;
+}
+
+bool IOUring::submitAndWait()
+{
+    while (true) {
+        int rc = syscall(__NR_io_uring_enter, _fd, _pending, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (rc >= 0) {
+            _pending -= rc;
+            return true;
+        }
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+bool IOUring::getCompletion(uint64_t& userData, int& res)
+{
+    unsigned int head = *_cqHead;
+    if (head == __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    struct io_uring_cqe* cqe = &_cqes[head & _cqMask];
+    userData = cqe->user_data;
+    res = cqe->res;
+    __atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
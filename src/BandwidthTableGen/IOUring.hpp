@@ -0,0 +1,57 @@
+// IOUring.hpp - Minimal io_uring wrapper for asynchronous reads and writes.
+// Uses the io_uring system calls directly, so it does not depend on liburing.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _IO_URING_HPP
+#define _IO_URING_HPP
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <linux/io_uring.h>
+
+using namespace std;
+
+// IOUring is not thread-safe; each submitting thread should have its own.
+class IOUring
+{
+private:
+    int _fd;
+    // Submission queue
+    void* _sqRing;
+    size_t _sqRingSize;
+    unsigned int* _sqTail;
+    unsigned int _sqMask;
+    unsigned int* _sqArray;
+    struct io_uring_sqe* _sqes;
+    size_t _sqesSize;
+    unsigned int _pending; // prepared entries that have not been submitted
+    // Completion queue
+    void* _cqRing;
+    size_t _cqRingSize;
+    unsigned int* _cqHead;
+    unsigned int* _cqTail;
+    unsigned int _cqMask;
+    struct io_uring_cqe* _cqes;
+
+    IOUring(const IOUring&); // not implemented
+    IOUring& operator=(const IOUring&); // not implemented
+
+public:
+    IOUring();
+    ~IOUring();
+
+    // Set up a ring with room for the given number of outstanding requests; returns false if io_uring is unavailable
+    bool init(unsigned int entries);
+    // Queue a read or write of len bytes at offset; userData identifies the request when it completes
+    void prepare(bool isRead, int fd, void* buf, unsigned int len, uint64_t offset, uint64_t userData);
+    // Submit the queued requests and wait for at least one completion; returns false on failure
+    bool submitAndWait();
+    // Get a completed request without blocking; returns false if there is none.
+    // res is the number of bytes transferred or a negative errno.
+    bool getCompletion(uint64_t& userData, int& res);
+};
+
+#endif // _IO_URING_HPP
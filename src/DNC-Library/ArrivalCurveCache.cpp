@@ -0,0 +1,182 @@
+// ArrivalCurveCache.cpp - Code for caching arrival curves.
+// See ArrivalCurveCache.hpp for details.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cstdio>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <list>
+#include <map>
+#include <utility>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <json/json.h>
+#include "DNC.hpp"
+#include "ArrivalCurveCache.hpp"
+
+using namespace std;
+
+// In-memory LRU cache state; front of the list is the most recently used
+typedef list<pair<string, Curve> > LRUList;
+static pthread_mutex_t cacheMutex = PTHREAD_MUTEX_INITIALIZER;
+static LRUList lruList;
+static map<string, LRUList::iterator> lruIndex;
+static unsigned int cacheCapacity = ARRIVAL_CURVE_CACHE_CAPACITY;
+
+// Remembered file hashes
+struct FileHash {
+    off_t size;
+    time_t mtime;
+    long mtimeNsec;
+    uint64_t hash;
+};
+static pthread_mutex_t fileHashMutex = PTHREAD_MUTEX_INITIALIZER;
+static map<string, FileHash> fileHashes;
+
+// Evict least recently used arrival curves until within capacity.
+// Assumes cacheMutex is held.
+static void evict()
+{
+    while (lruList.size() > cacheCapacity) {
+        lruIndex.erase(lruList.back().first);
+        lruList.pop_back();
+    }
+}
+
+// Insert or update an arrival curve in memory.
+// Assumes cacheMutex is held.
+static void insert(const string& arrivalCurveFilename, const Curve& arrivalCurve)
+{
+    map<string, LRUList::iterator>::iterator it = lruIndex.find(arrivalCurveFilename);
+    if (it != lruIndex.end()) {
+        lruList.erase(it->second);
+    }
+    lruList.push_front(make_pair(arrivalCurveFilename, arrivalCurve));
+    lruIndex[arrivalCurveFilename] = lruList.begin();
+    evict();
+}
+
+bool ArrivalCurveCache::get(string arrivalCurveFilename, Curve& arrivalCurve)
+{
+    if (arrivalCurveFilename == "") {
+        return false;
+    }
+    // Check memory
+    pthread_mutex_lock(&cacheMutex);
+    map<string, LRUList::iterator>::iterator it = lruIndex.find(arrivalCurveFilename);
+    if (it != lruIndex.end()) {
+        lruList.splice(lruList.begin(), lruList, it->second);
+        arrivalCurve = it->second->second;
+        pthread_mutex_unlock(&cacheMutex);
+        return true;
+    }
+    pthread_mutex_unlock(&cacheMutex);
+    // Check disk
+    if (!readArrivalCurve(arrivalCurve, arrivalCurveFilename)) {
+        return false;
+    }
+    pthread_mutex_lock(&cacheMutex);
+    insert(arrivalCurveFilename, arrivalCurve);
+    pthread_mutex_unlock(&cacheMutex);
+    return true;
+}
+
+void ArrivalCurveCache::put(string arrivalCurveFilename, const Curve& arrivalCurve)
+{
+    if (arrivalCurveFilename == "") {
+        return;
+    }
+    writeArrivalCurve(arrivalCurve, arrivalCurveFilename);
+    pthread_mutex_lock(&cacheMutex);
+    insert(arrivalCurveFilename, arrivalCurve);
+    pthread_mutex_unlock(&cacheMutex);
+}
+
+void ArrivalCurveCache::clear()
+{
+    pthread_mutex_lock(&cacheMutex);
+    lruList.clear();
+    lruIndex.clear();
+    pthread_mutex_unlock(&cacheMutex);
+}
+
+void ArrivalCurveCache::setCapacity(unsigned int capacity)
+{
+    pthread_mutex_lock(&cacheMutex);
+    cacheCapacity = capacity;
+    evict();
+    pthread_mutex_unlock(&cacheMutex);
+}
+
+// FNV-1a hash
+static const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+static const uint64_t FNV_PRIME = 1099511628211ULL;
+
+static uint64_t fnv1a(uint64_t hash, const unsigned char* buf, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        hash ^= buf[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+uint64_t hashString(const string& str)
+{
+    return fnv1a(FNV_OFFSET_BASIS, reinterpret_cast<const unsigned char*>(str.data()), str.size());
+}
+
+uint64_t hashFile(string filename)
+{
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+        return FNV_OFFSET_BASIS;
+    }
+    // Check remembered hashes
+    pthread_mutex_lock(&fileHashMutex);
+    map<string, FileHash>::const_iterator it = fileHashes.find(filename);
+    if ((it != fileHashes.end()) && (it->second.size == st.st_size) && (it->second.mtime == st.st_mtim.tv_sec) && (it->second.mtimeNsec == st.st_mtim.tv_nsec)) {
+        uint64_t hash = it->second.hash;
+        pthread_mutex_unlock(&fileHashMutex);
+        return hash;
+    }
+    pthread_mutex_unlock(&fileHashMutex);
+    // Hash file contents
+    uint64_t hash = FNV_OFFSET_BASIS;
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (file != NULL) {
+        unsigned char buf[65536];
+        size_t bytesRead;
+        while ((bytesRead = fread(buf, 1, sizeof(buf), file)) > 0) {
+            hash = fnv1a(hash, buf, bytesRead);
+        }
+        fclose(file);
+    }
+    FileHash fileHash;
+    fileHash.size = st.st_size;
+    fileHash.mtime = st.st_mtim.tv_sec;
+    fileHash.mtimeNsec = st.st_mtim.tv_nsec;
+    fileHash.hash = hash;
+    pthread_mutex_lock(&fileHashMutex);
+    fileHashes[filename] = fileHash;
+    pthread_mutex_unlock(&fileHashMutex);
+    return hash;
+}
+
+string getArrivalCurveHash(string trace, const Json::Value& estimatorInfo, double maxRate, ArrivalCurveAlgorithm algorithm)
+{
+    // Combine trace hash with the estimator parameters, max rate, and algorithm
+    uint64_t traceHash = hashFile(trace);
+    Json::FastWriter writer;
+    ostringstream oss;
+    oss << hex << traceHash << "," << writer.write(estimatorInfo) << "," << setprecision(17) << maxRate << "," << algorithm;
+    string key = oss.str();
+    uint64_t hash = hashString(key);
+    ostringstream hashStr;
+    hashStr << hex << setw(16) << setfill('0') << hash;
+    return hashStr.str();
+}
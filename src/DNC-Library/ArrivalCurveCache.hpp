@@ -0,0 +1,47 @@
+// ArrivalCurveCache.hpp - Process-wide cache of arrival curves.
+// Arrival curves are expensive to calculate from traces, so they are cached both in memory and in arrival curve files on disk.
+// Arrival curve files are named by a hash of everything the arrival curve depends on (i.e., the trace contents,
+// the estimator parameters, the max rate, and the algorithm; see getArrivalCurveHash), so cached curves never become stale.
+// The in-memory cache holds the most recently used arrival curves in front of the files on disk.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _ARRIVAL_CURVE_CACHE_HPP
+#define _ARRIVAL_CURVE_CACHE_HPP
+
+#include <string>
+#include <stdint.h>
+#include <json/json.h>
+#include "DNC.hpp"
+
+using namespace std;
+
+// Default number of arrival curves held in memory.
+#define ARRIVAL_CURVE_CACHE_CAPACITY 1024
+
+// ArrivalCurveCache is thread-safe.
+class ArrivalCurveCache
+{
+public:
+    // Get an arrival curve from memory, or from the arrival curve file if not in memory.
+    // Returns false if the arrival curve is not cached.
+    static bool get(string arrivalCurveFilename, Curve& arrivalCurve);
+    // Store an arrival curve in memory and atomically write the arrival curve file.
+    static void put(string arrivalCurveFilename, const Curve& arrivalCurve);
+    // Drop all arrival curves from memory; arrival curve files are unaffected.
+    static void clear();
+    // Set the number of arrival curves held in memory.
+    static void setCapacity(unsigned int capacity);
+};
+
+// Return a 64-bit FNV-1a hash of a string.
+uint64_t hashString(const string& str);
+// Return a 64-bit FNV-1a hash of a file's contents.
+// Hashes are remembered by file name, size, and modification time so that a file is only read once.
+uint64_t hashFile(string filename);
+// Return a hex string identifying the arrival curve of a trace for a given estimator, max rate, and algorithm.
+string getArrivalCurveHash(string trace, const Json::Value& estimatorInfo, double maxRate, ArrivalCurveAlgorithm algorithm = ARRIVAL_CURVE_ALGORITHM_RATE_SAMPLED);
+
+#endif // _ARRIVAL_CURVE_CACHE_HPP
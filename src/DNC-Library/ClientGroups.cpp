@@ -0,0 +1,164 @@
+// ClientGroups.cpp - Code for incremental grouping of clients into connected components of shared queues.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <vector>
+#include <set>
+#include <map>
+#include <cassert>
+#include "NC.hpp"
+#include "ClientGroups.hpp"
+
+using namespace std;
+
+QueueId ClientGroups::find(QueueId queueId)
+{
+    if (_parents.find(queueId) == _parents.end()) {
+        return queueId;
+    }
+    // Find root
+    QueueId root = queueId;
+    while (_parents[root] != root) {
+        root = _parents[root];
+    }
+    // Compress path
+    while (queueId != root) {
+        QueueId& parent = _parents[queueId];
+        queueId = parent;
+        parent = root;
+    }
+    return root;
+}
+
+QueueId ClientGroups::findOrAdd(QueueId queueId)
+{
+    if (_parents.find(queueId) == _parents.end()) {
+        _parents[queueId] = queueId;
+        Component& component = _components[queueId];
+        component.queueIds.push_back(queueId);
+        component.split = false;
+        return queueId;
+    }
+    return find(queueId);
+}
+
+QueueId ClientGroups::unite(QueueId root1, QueueId root2)
+{
+    if (root1 == root2) {
+        return root1;
+    }
+    // Merge smaller component into larger component
+    if (_components[root1].queueIds.size() < _components[root2].queueIds.size()) {
+        swap(root1, root2);
+    }
+    Component& component = _components[root1];
+    Component& other = _components[root2];
+    _parents[root2] = root1;
+    component.queueIds.insert(component.queueIds.end(), other.queueIds.begin(), other.queueIds.end());
+    component.clientIds.insert(other.clientIds.begin(), other.clientIds.end());
+    component.split = component.split || other.split;
+    _components.erase(root2);
+    return root1;
+}
+
+void ClientGroups::join(ClientId clientId)
+{
+    const vector<QueueId>& queueIds = _clientQueueIds[clientId];
+    QueueId root = findOrAdd(queueIds.front());
+    for (unsigned int i = 1; i < queueIds.size(); i++) {
+        root = unite(root, findOrAdd(queueIds[i]));
+    }
+    _components[root].clientIds.insert(clientId);
+}
+
+void ClientGroups::split(QueueId root)
+{
+    map<QueueId, Component>::iterator it = _components.find(root);
+    assert(it != _components.end());
+    // Reset component's queues; queues that are still used are re-added by their clients
+    vector<QueueId> queueIds;
+    queueIds.swap(it->second.queueIds);
+    set<ClientId> clientIds;
+    clientIds.swap(it->second.clientIds);
+    _components.erase(it);
+    for (vector<QueueId>::const_iterator itQ = queueIds.begin(); itQ != queueIds.end(); itQ++) {
+        _parents.erase(*itQ);
+    }
+    // Re-join remaining clients
+    for (set<ClientId>::const_iterator itC = clientIds.begin(); itC != clientIds.end(); itC++) {
+        join(*itC);
+    }
+}
+
+void ClientGroups::addClient(ClientId clientId, const vector<QueueId>& queueIds)
+{
+    assert(!queueIds.empty());
+    assert(_clientQueueIds.find(clientId) == _clientQueueIds.end());
+    _clientQueueIds[clientId] = queueIds;
+    join(clientId);
+}
+
+void ClientGroups::delClient(ClientId clientId)
+{
+    map<ClientId, vector<QueueId> >::iterator it = _clientQueueIds.find(clientId);
+    assert(it != _clientQueueIds.end());
+    QueueId root = find(it->second.front());
+    _clientQueueIds.erase(it);
+    Component& component = _components[root];
+    component.clientIds.erase(clientId);
+    if (component.clientIds.empty()) {
+        // Remove component's queues since no clients are left
+        for (vector<QueueId>::const_iterator itQ = component.queueIds.begin(); itQ != component.queueIds.end(); itQ++) {
+            _parents.erase(*itQ);
+        }
+        _components.erase(root);
+    } else if (component.queueIds.size() > 1) {
+        // Defer splitting until the group is needed
+        component.split = true;
+    }
+}
+
+void ClientGroups::delQueue(QueueId queueId)
+{
+    if (_parents.find(queueId) == _parents.end()) {
+        return;
+    }
+    // The queue's clients were deleted, but its component still has other clients; split it to drop the queue
+    QueueId root = find(queueId);
+    assert(_components[root].split);
+    split(root);
+    assert(_parents.find(queueId) == _parents.end());
+}
+
+QueueId ClientGroups::getGroupId(QueueId queueId)
+{
+    QueueId root = find(queueId);
+    map<QueueId, Component>::iterator it = _components.find(root);
+    if ((it != _components.end()) && it->second.split) {
+        split(root);
+        root = find(queueId);
+    }
+    return root;
+}
+
+const set<ClientId>& ClientGroups::getGroupClients(QueueId groupId) const
+{
+    static const set<ClientId> emptyClientIds;
+    map<QueueId, Component>::const_iterator it = _components.find(groupId);
+    if (it == _components.end()) {
+        return emptyClientIds;
+    }
+    return it->second.clientIds;
+}
+
+const vector<QueueId>& ClientGroups::getGroupQueues(QueueId groupId) const
+{
+    static const vector<QueueId> emptyQueueIds;
+    map<QueueId, Component>::const_iterator it = _components.find(groupId);
+    if (it == _components.end()) {
+        return emptyQueueIds;
+    }
+    return it->second.queueIds;
+}
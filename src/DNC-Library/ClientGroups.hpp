@@ -0,0 +1,63 @@
+// ClientGroups.hpp - Incremental grouping of clients into connected components of shared queues.
+// Queues are merged with union-find as clients are added. Deleting a client may split its component,
+// so the component is only marked and lazily rebuilt from its remaining clients the next time it is looked up.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _CLIENT_GROUPS_HPP
+#define _CLIENT_GROUPS_HPP
+
+#include <vector>
+#include <set>
+#include <map>
+#include "NC.hpp"
+
+using namespace std;
+
+class ClientGroups
+{
+private:
+    // Component of queues, identified by its root queue.
+    struct Component {
+        vector<QueueId> queueIds; // queues in the component
+        set<ClientId> clientIds; // clients whose flows use the component's queues
+        bool split; // clients were deleted, so the component may need to be split
+    };
+
+    map<QueueId, QueueId> _parents; // union-find parent of each queue
+    map<QueueId, Component> _components; // components by root queue
+    map<ClientId, vector<QueueId> > _clientQueueIds; // queues used by each client's flows
+
+    // Find the root queue of a queue's component; a queue not used by any client is its own root.
+    QueueId find(QueueId queueId);
+    // Find the root queue of a queue's component, adding the queue as its own component if needed.
+    QueueId findOrAdd(QueueId queueId);
+    // Merge the components of two root queues, returning the new root.
+    QueueId unite(QueueId root1, QueueId root2);
+    // Merge the queues of a client into a single component containing the client.
+    void join(ClientId clientId);
+    // Rebuild a component from its remaining clients, splitting it into connected components.
+    void split(QueueId root);
+
+public:
+    ClientGroups() {}
+    virtual ~ClientGroups() {}
+
+    // Add a client that uses a set of queues.
+    void addClient(ClientId clientId, const vector<QueueId>& queueIds);
+    // Delete a client.
+    void delClient(ClientId clientId);
+    // Delete a queue, which must not be used by any client.
+    void delQueue(QueueId queueId);
+    // Get the group id of a queue, which is shared by all queues connected through clients.
+    // A queue not used by any client is its own group, which has no clients.
+    QueueId getGroupId(QueueId queueId);
+    // Get the clients in a group.
+    const set<ClientId>& getGroupClients(QueueId groupId) const;
+    // Get the queues in a group; a queue not used by any client is its own group, which has no queues.
+    const vector<QueueId>& getGroupQueues(QueueId groupId) const;
+};
+
+#endif // _CLIENT_GROUPS_HPP
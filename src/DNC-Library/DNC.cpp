@@ -15,12 +15,22 @@
 #include <map>
 #include <set>
 #include <limits>
+#include <algorithm>
+#include <cstdio>
+#include <stdint.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #include <json/json.h>
 #include "../TraceCommon/ProcessedTrace.hpp"
 #include "../common/time.hpp"
 #include "../common/serializeJSON.hpp"
+#include "../common/metrics.hpp"
 #include "NC.hpp"
 #include "DNC.hpp"
+#include "ArrivalCurveCache.hpp"
+#include "RbGen.hpp"
 
 using namespace std;
 
@@ -45,37 +55,138 @@ double calcMinRate(ProcessedTrace* pTrace)
     return rate;
 }
 
-// Calculate the r-b curve for a given workload for a given set of rates.
-void rbGen(ProcessedTrace* pTrace, const vector<double>& rates, map<double, double>& bursts)
+// Arguments for a thread that updates a contiguous subset of the token buckets in rbGen.
+struct RbGenThreadArgs {
+    const vector<double>* interarrivals;
+    const vector<double>* works;
+    const double* rates;
+    double* buckets;
+    double* bursts;
+    unsigned int n;
+};
+
+// Run the token buckets of a subset of rates over the entire trace.
+static void* rbGenThread(void* arg)
 {
-    // reset bursts to 0 just in case it has old or uninitialized data
-    map<double, double> virtualBucket;
-    for (unsigned int i = 0; i < rates.size(); i++) {
-        double rate = rates[i];
-        virtualBucket[rate] = 0;
-        bursts[rate] = 0;
+    RbGenThreadArgs* args = static_cast<RbGenThreadArgs*>(arg);
+    const vector<double>& interarrivals = *args->interarrivals;
+    const vector<double>& works = *args->works;
+    for (unsigned int j = 0; j < interarrivals.size(); j++) {
+        rbGenUpdate(args->rates, args->buckets, args->bursts, args->n, interarrivals[j], works[j]);
     }
-    // Calculate bursts
-    pTrace->reset();
+    return NULL;
+}
+
+// Number of trace entries buffered at a time by calcMinRateAndRbGen.
+#define RBGEN_BLOCK_SIZE 65536
+
+// Calculate the minimum rate needed to sustain a workload (i.e., average rate of work)
+// along with the r-b curve for a given set of rates in a single pass over the trace.
+// bursts[i] is the burst corresponding to rates[i].
+double calcMinRateAndRbGen(ProcessedTrace* pTrace, const vector<double>& rates, vector<double>& bursts, unsigned int numThreads)
+{
+    // Pad arrays to a multiple of the vector width; padded entries have rate 0 and are ignored
+    unsigned int n = rates.size();
+    unsigned int paddedN = ((n + RBGEN_VECTOR_WIDTH - 1) / RBGEN_VECTOR_WIDTH) * RBGEN_VECTOR_WIDTH;
+    vector<double> ratesBuffer;
+    vector<double> bucketsBuffer;
+    vector<double> burstsBuffer;
+    double* alignedRates = rbGenAlignedArray(ratesBuffer, paddedN);
+    double* alignedBuckets = rbGenAlignedArray(bucketsBuffer, paddedN);
+    double* alignedBursts = rbGenAlignedArray(burstsBuffer, paddedN);
+    for (unsigned int i = 0; i < n; i++) {
+        alignedRates[i] = rates[i];
+    }
+    // Partition rates into chunks of whole cache lines, one per thread
+    vector<double> interarrivals;
+    vector<double> works;
+    interarrivals.reserve(RBGEN_BLOCK_SIZE);
+    works.reserve(RBGEN_BLOCK_SIZE);
+    const unsigned int chunkGranularity = RBGEN_ALIGNMENT / sizeof(double);
+    if (numThreads < 1) {
+        numThreads = 1;
+    }
+    unsigned int chunkSize = (paddedN + numThreads - 1) / numThreads;
+    chunkSize = ((chunkSize + chunkGranularity - 1) / chunkGranularity) * chunkGranularity;
+    vector<RbGenThreadArgs> threadArgs;
+    for (unsigned int start = 0; start < paddedN; start += chunkSize) {
+        RbGenThreadArgs args;
+        args.interarrivals = &interarrivals;
+        args.works = &works;
+        args.rates = alignedRates + start;
+        args.buckets = alignedBuckets + start;
+        args.bursts = alignedBursts + start;
+        args.n = min(chunkSize, paddedN - start);
+        threadArgs.push_back(args);
+    }
+    vector<pthread_t> threads(threadArgs.size());
+    vector<bool> threadCreated(threadArgs.size());
+    // Read trace in blocks that are shared by the threads
+    double totalWork = 0;
+    uint64_t firstTimestamp = 0;
     uint64_t prevTimestamp = 0;
+    bool empty = true;
+    bool done = false;
+    pTrace->reset();
     ProcessedTraceEntry traceEntry;
-    while (pTrace->nextEntry(traceEntry)) {
-        double interarrival = ConvertTimeToSeconds(traceEntry.arrivalTime - prevTimestamp);
-        for (unsigned int i = 0; i < rates.size(); i++) {
-            double rate = rates[i];
-            // Drain token bucket for time since last request
-            virtualBucket[rate] -= rate * interarrival;
-            if (virtualBucket[rate] < 0) {
-                virtualBucket[rate] = 0;
+    while (!done) {
+        interarrivals.clear();
+        works.clear();
+        while (interarrivals.size() < RBGEN_BLOCK_SIZE) {
+            if (!pTrace->nextEntry(traceEntry)) {
+                done = true;
+                break;
+            }
+            if (empty) {
+                firstTimestamp = traceEntry.arrivalTime;
+                empty = false;
             }
-            // Add tokens for current request
-            virtualBucket[rate] += traceEntry.work;
-            // Record max burst
-            if (virtualBucket[rate] > bursts[rate]) {
-                bursts[rate] = virtualBucket[rate];
+            interarrivals.push_back(ConvertTimeToSeconds(traceEntry.arrivalTime - prevTimestamp));
+            works.push_back(traceEntry.work);
+            totalWork += traceEntry.work;
+            prevTimestamp = traceEntry.arrivalTime;
+        }
+        if (interarrivals.empty()) {
+            break;
+        }
+        // Calculate bursts for block; the first chunk runs on the calling thread
+        for (unsigned int i = 1; i < threadArgs.size(); i++) {
+            threadCreated[i] = (pthread_create(&threads[i], NULL, rbGenThread, &threadArgs[i]) == 0);
+        }
+        for (unsigned int i = 0; i < threadArgs.size(); i++) {
+            if (i == 0 || !threadCreated[i]) {
+                rbGenThread(&threadArgs[i]);
             }
         }
-        prevTimestamp = traceEntry.arrivalTime;
+        for (unsigned int i = 1; i < threadArgs.size(); i++) {
+            if (threadCreated[i]) {
+                pthread_join(threads[i], NULL);
+            }
+        }
+    }
+    bursts.assign(alignedBursts, alignedBursts + n);
+    if (empty) {
+        cerr << "Empty trace file" << endl;
+        return 0;
+    }
+    // Divide by total duration to get average
+    return totalWork / ConvertTimeToSeconds(prevTimestamp - firstTimestamp);
+}
+
+// Calculate the r-b curve for a given workload for a given set of rates.
+// bursts[i] is the burst corresponding to rates[i].
+void rbGen(ProcessedTrace* pTrace, const vector<double>& rates, vector<double>& bursts, unsigned int numThreads)
+{
+    calcMinRateAndRbGen(pTrace, rates, bursts, numThreads);
+}
+
+// Calculate the r-b curve for a given workload for a given set of rates.
+void rbGen(ProcessedTrace* pTrace, const vector<double>& rates, map<double, double>& bursts)
+{
+    vector<double> burstsArray;
+    rbGen(pTrace, rates, burstsArray);
+    for (unsigned int i = 0; i < rates.size(); i++) {
+        bursts[rates[i]] = burstsArray[i];
     }
 }
 
@@ -107,15 +218,14 @@ PointSlope calcPointSlopeIntersection(const PointSlope& p1, const PointSlope& p2
 }
 
 // Generate an arrival curve from an r-b curve.
-// Assumes rates is decreasing
-void rbCurveToArrivalCurve(Curve& arrivalCurve, const vector<double>& rates, map<double, double>& bursts)
+// Assumes rates is decreasing and bursts[i] is the burst corresponding to rates[i]
+void rbCurveToArrivalCurve(Curve& arrivalCurve, const vector<double>& rates, const vector<double>& bursts)
 {
     // Initialize arrival curve
     PointSlope initialPoint(0, 0, numeric_limits<double>::infinity());
     arrivalCurve.assign(1, initialPoint);
     for (unsigned int i = 0; i < rates.size(); i++) {
-        double rate = rates[i];
-        PointSlope point(0, bursts[rate], rate);
+        PointSlope point(0, bursts[i], rates[i]);
         while (arrivalCurve.size() > 1) {
             PointSlope& lastPoint = arrivalCurve.back();
             PointSlope intersectionPoint = calcPointSlopeIntersection(point, lastPoint);
@@ -129,6 +239,17 @@ void rbCurveToArrivalCurve(Curve& arrivalCurve, const vector<double>& rates, map
     }
 }
 
+// Generate an arrival curve from an r-b curve.
+// Assumes rates is decreasing
+void rbCurveToArrivalCurve(Curve& arrivalCurve, const vector<double>& rates, map<double, double>& bursts)
+{
+    vector<double> burstsArray(rates.size());
+    for (unsigned int i = 0; i < rates.size(); i++) {
+        burstsArray[i] = bursts[rates[i]];
+    }
+    rbCurveToArrivalCurve(arrivalCurve, rates, burstsArray);
+}
+
 // Approximate an arrival curve by an arrival curve with n points.
 void pruneArrivalCurve(Curve& arrivalCurve, unsigned int n)
 {
@@ -158,18 +279,222 @@ void pruneArrivalCurve(Curve& arrivalCurve, unsigned int n)
     }
 }
 
+// Append a point to an upper concave hull whose points are in increasing x order, removing the points that are no longer vertices of the hull.
+// Points must be appended in non-decreasing x order; of points with the same x, only the highest is kept.
+static void appendHullPoint(Curve& hull, const PointSlope& p)
+{
+    if (!hull.empty() && (hull.back().x >= p.x)) {
+        if (hull.back().y >= p.y) {
+            return;
+        }
+        hull.pop_back();
+    }
+    // Remove the last vertex while it is on or below the chord from the vertex before it to p
+    while (hull.size() >= 2) {
+        const PointSlope& p1 = hull[hull.size() - 2];
+        const PointSlope& p2 = hull.back();
+        if ((p2.y - p1.y) * (p.x - p1.x) > (p.y - p1.y) * (p2.x - p1.x)) {
+            break;
+        }
+        hull.pop_back();
+    }
+    hull.push_back(p);
+}
+
+// Get the upper concave hull of the points of two upper concave hulls, in linear time.
+static void mergeHulls(const Curve& hull1, const Curve& hull2, Curve& hull)
+{
+    unsigned int i = 0;
+    unsigned int j = 0;
+    while ((i < hull1.size()) || (j < hull2.size())) {
+        if ((j >= hull2.size()) || ((i < hull1.size()) && (hull1[i].x <= hull2[j].x))) {
+            appendHullPoint(hull, hull1[i++]);
+        } else {
+            appendHullPoint(hull, hull2[j++]);
+        }
+    }
+}
+
+// Get the upper concave hull of the pairwise sums (i.e., Minkowski sum) of the points of two upper concave hulls, in linear time.
+// The sum's edges are the edges of both hulls in decreasing slope order.
+static void sumHulls(const Curve& hull1, const Curve& hull2, Curve& hull)
+{
+    unsigned int i = 0;
+    unsigned int j = 0;
+    appendHullPoint(hull, PointSlope(hull1[0].x + hull2[0].x, hull1[0].y + hull2[0].y, 0));
+    while ((i + 1 < hull1.size()) || (j + 1 < hull2.size())) {
+        if ((j + 1 >= hull2.size()) ||
+            ((i + 1 < hull1.size()) && ((hull1[i + 1].y - hull1[i].y) * (hull2[j + 1].x - hull2[j].x) >= (hull2[j + 1].y - hull2[j].y) * (hull1[i + 1].x - hull1[i].x)))) {
+            i++;
+        } else {
+            j++;
+        }
+        appendHullPoint(hull, PointSlope(hull1[i].x + hull2[j].x, hull1[i].y + hull2[j].y, 0));
+    }
+}
+
+// Remove the vertices of an upper concave hull that are not the point of the hull furthest above a line of slope rate for any rate in [minRate, maxRate].
+static void trimHull(Curve& hull, double minRate, double maxRate)
+{
+    unsigned int first = 0;
+    while ((first + 1 < hull.size()) && (hull[first + 1].y - hull[first].y > maxRate * (hull[first + 1].x - hull[first].x))) {
+        first++;
+    }
+    unsigned int last = first;
+    while ((last + 1 < hull.size()) && (hull[last + 1].y - hull[last].y >= minRate * (hull[last + 1].x - hull[last].x))) {
+        last++;
+    }
+    hull.erase(hull.begin() + last + 1, hull.end());
+    hull.erase(hull.begin(), hull.begin() + first);
+}
+
+// Upper concave hulls of a range of requests for calcExactHull, trimmed to the rates between minRate and maxRate (see trimHull).
+struct ExactHulls {
+    Curve intervals; // (interval, work) pairs of the intervals of requests within the range
+    Curve starts; // (-times[i], -cumWork[i]) of the requests i in the range
+    Curve ends; // (times[j], cumWork[j + 1]) of the requests j in the range
+};
+
+// Buffers of calcExactHull at a recursion depth, which are reused across calls to avoid allocations.
+struct ExactHullsBuffers {
+    ExactHulls left;
+    ExactHulls right;
+    Curve crossHull;
+    Curve halvesHull;
+};
+
+// Get the upper concave hulls of the requests begin <= i < end, where the intervals are the intervals [i, j] of requests with begin <= i <= j < end.
+// The interval of requests i to j has length times[j] - times[i] and work cumWork[j + 1] - cumWork[i],
+// where times[j] is the arrival time of the jth request and cumWork[j] is the total work of the requests before j.
+// Divides the requests in halves, where the hull of the intervals crossing the middle is the sum of the hulls of the left half's starts and the right half's ends.
+// Only the vertices tangent to rates between minRate and maxRate are kept, since sums and unions of hulls only have such vertices where their parts do,
+// so the hulls stay small and take linear time to combine. buffers holds the buffers of each recursion depth, i.e., at least log2(end - begin) of them.
+static void calcExactHull(const vector<double>& times, const vector<double>& cumWork, unsigned int begin, unsigned int end, double minRate, double maxRate,
+                          ExactHulls& hulls, vector<ExactHullsBuffers>& buffers, unsigned int depth)
+{
+    hulls.intervals.clear();
+    hulls.starts.clear();
+    hulls.ends.clear();
+    if (end - begin == 1) {
+        hulls.intervals.push_back(PointSlope(0, cumWork[end] - cumWork[begin], 0));
+        hulls.starts.push_back(PointSlope(-times[begin], -cumWork[begin], 0));
+        hulls.ends.push_back(PointSlope(times[begin], cumWork[end], 0));
+        return;
+    }
+    assert(depth < buffers.size());
+    ExactHullsBuffers& b = buffers[depth];
+    unsigned int middle = begin + (end - begin) / 2;
+    calcExactHull(times, cumWork, begin, middle, minRate, maxRate, b.left, buffers, depth + 1);
+    calcExactHull(times, cumWork, middle, end, minRate, maxRate, b.right, buffers, depth + 1);
+    // Intervals crossing the middle
+    b.crossHull.clear();
+    sumHulls(b.left.starts, b.right.ends, b.crossHull);
+    // Merge with the intervals within each half
+    b.halvesHull.clear();
+    mergeHulls(b.left.intervals, b.right.intervals, b.halvesHull);
+    mergeHulls(b.halvesHull, b.crossHull, hulls.intervals);
+    trimHull(hulls.intervals, minRate, maxRate);
+    mergeHulls(b.left.starts, b.right.starts, hulls.starts);
+    trimHull(hulls.starts, minRate, maxRate);
+    mergeHulls(b.left.ends, b.right.ends, hulls.ends);
+    trimHull(hulls.ends, minRate, maxRate);
+}
+
+// Calculate the exact (tightest concave) arrival curve from a trace for rates between the trace's average rate and maxRate.
+// Computes the upper concave hull of the trace's (interval, work) pairs (see calcExactHull), rather than sampling a fixed grid of rates.
+void calcExactArrivalCurve(Curve& arrivalCurve, ProcessedTrace* pTrace, double maxRate)
+{
+    PointSlope initialPoint(0, 0, numeric_limits<double>::infinity());
+    arrivalCurve.assign(1, initialPoint);
+    // Read cumulative work function
+    vector<double> times;
+    vector<double> cumWork(1, 0);
+    pTrace->reset();
+    ProcessedTraceEntry traceEntry;
+    uint64_t firstTimestamp = 0;
+    while (pTrace->nextEntry(traceEntry)) {
+        if (times.empty()) {
+            firstTimestamp = traceEntry.arrivalTime;
+        }
+        times.push_back(ConvertTimeToSeconds(traceEntry.arrivalTime - firstTimestamp));
+        cumWork.push_back(cumWork.back() + traceEntry.work);
+    }
+    if (times.empty()) {
+        cerr << "Empty trace file" << endl;
+        return;
+    }
+    // Average rate of work (see calcMinRate)
+    double minRate = cumWork.back() / times.back();
+    if (!(minRate <= maxRate)) {
+        return;
+    }
+    ExactHulls hulls;
+    unsigned int numLevels = 0;
+    while ((1UL << numLevels) < times.size()) {
+        numLevels++;
+    }
+    vector<ExactHullsBuffers> buffers(numLevels);
+    calcExactHull(times, cumWork, 0, times.size(), minRate, maxRate, hulls, buffers, 0);
+    const Curve& hull = hulls.intervals;
+    // Find the hull vertices tangent to maxRate and minRate, i.e., where the slopes of the hull's edges cross the rates
+    unsigned int first = 0;
+    while ((first + 1 < hull.size()) && (hull[first + 1].y - hull[first].y >= maxRate * (hull[first + 1].x - hull[first].x))) {
+        first++;
+    }
+    unsigned int last = first;
+    while ((last + 1 < hull.size()) && (hull[last + 1].y - hull[last].y > minRate * (hull[last + 1].x - hull[last].x))) {
+        last++;
+    }
+    // Convert hull vertices to an arrival curve
+    if (hull[first].x > 0) {
+        arrivalCurve.push_back(PointSlope(0, yIntercept(hull[first].x, hull[first].y, maxRate), maxRate));
+    }
+    for (unsigned int i = first; i <= last; i++) {
+        PointSlope p = hull[i];
+        if (i < last) {
+            p.slope = (hull[i + 1].y - p.y) / (hull[i + 1].x - p.x);
+        } else {
+            p.slope = minRate;
+        }
+        arrivalCurve.push_back(p);
+    }
+}
+
 // Calculate an arrival curve from a trace.
-void calcArrivalCurve(Curve& arrivalCurve, ProcessedTrace* pTrace, double maxRate)
+void calcArrivalCurve(Curve& arrivalCurve, ProcessedTrace* pTrace, double maxRate, ArrivalCurveAlgorithm algorithm, unsigned int numThreads)
 {
-    double minRate = calcMinRate(pTrace);
-    vector<double> rates;
-    for (double rate = maxRate; rate >= minRate; rate -= 0.001 * maxRate) {
-        rates.push_back(rate);
+    if (algorithm == ARRIVAL_CURVE_ALGORITHM_EXACT) {
+        calcExactArrivalCurve(arrivalCurve, pTrace, maxRate);
+    } else {
+        // Calculate bursts for all rates down to 0 so that the average rate can be found in the same pass,
+        // then only keep the rates that are at least the average rate
+        vector<double> rates;
+        if (maxRate > 0) {
+            for (double rate = maxRate; rate >= 0; rate -= 0.001 * maxRate) {
+                rates.push_back(rate);
+            }
+        }
+        vector<double> bursts;
+        double minRate = calcMinRateAndRbGen(pTrace, rates, bursts, numThreads);
+        unsigned int numRates = 0;
+        while ((numRates < rates.size()) && (rates[numRates] >= minRate)) {
+            numRates++;
+        }
+        rates.resize(numRates);
+        bursts.resize(numRates);
+        rbCurveToArrivalCurve(arrivalCurve, rates, bursts);
     }
-    map<double, double> bursts;
-    rbGen(pTrace, rates, bursts);
+    pruneArrivalCurve(arrivalCurve, ARRIVAL_CURVE_NUM_POINTS);
+}
+
+// Calculate an arrival curve from the requests in the window of a SlidingArrivalCurve ending at time now.
+void calcArrivalCurve(Curve& arrivalCurve, const SlidingArrivalCurve& slidingArrivalCurve, uint64_t now)
+{
+    vector<double> rates;
+    vector<double> bursts;
+    slidingArrivalCurve.getRbCurve(rates, bursts, now);
     rbCurveToArrivalCurve(arrivalCurve, rates, bursts);
-    pruneArrivalCurve(arrivalCurve, 12);
+    pruneArrivalCurve(arrivalCurve, ARRIVAL_CURVE_NUM_POINTS);
 }
 
 // Read an arrival curve from a file.
@@ -198,17 +523,39 @@ bool readArrivalCurve(Curve& arrivalCurve, string arrivalCurveFilename)
 }
 
 // Write an arrival curve to a file.
+// The file is written to a temporary file and renamed so that concurrent readers never see a partially written file.
 void writeArrivalCurve(const Curve& arrivalCurve, string arrivalCurveFilename)
 {
     if (arrivalCurveFilename == "") {
         return;
     }
-    ofstream file(arrivalCurveFilename.c_str(), ofstream::out | ofstream::trunc);
-    // Set output precision
-    file << setprecision(15);
-    for (unsigned int i = 1; i < arrivalCurve.size(); i++) {
-        const PointSlope& p = arrivalCurve[i];
-        file << p.x << "," << p.y << "," << p.slope << endl;
+    string tmpFilename = arrivalCurveFilename + ".XXXXXX";
+    vector<char> tmpFilenameBuf(tmpFilename.begin(), tmpFilename.end());
+    tmpFilenameBuf.push_back('\0');
+    int fd = mkstemp(&tmpFilenameBuf[0]);
+    if (fd < 0) {
+        return;
+    }
+    fchmod(fd, 0644);
+    close(fd);
+    tmpFilename = &tmpFilenameBuf[0];
+    {
+        ofstream file(tmpFilename.c_str(), ofstream::out | ofstream::trunc);
+        // Set output precision
+        file << setprecision(15);
+        for (unsigned int i = 1; i < arrivalCurve.size(); i++) {
+            const PointSlope& p = arrivalCurve[i];
+            file << p.x << "," << p.y << "," << p.slope << "\n";
+        }
+        file.flush();
+        if (!file.good()) {
+            file.close();
+            unlink(tmpFilename.c_str());
+            return;
+        }
+    }
+    if (rename(tmpFilename.c_str(), arrivalCurveFilename.c_str()) != 0) {
+        unlink(tmpFilename.c_str());
     }
 }
 
@@ -268,6 +615,41 @@ double calcShaperLatency(const Curve& arrivalCurve, const SimpleArrivalCurve& sh
     return calcLatency(arrivalCurve, serviceCurve);
 }
 
+// Calculate the latency due to a (r,b) rate limiter along with peak rate limiters.
+// The rate limiters together act as a service curve given by their concave arrival curve.
+double calcShaperLatency(const Curve& arrivalCurve, const SimpleArrivalCurve& shaperCurve, const vector<SimpleArrivalCurve>& peakCurves)
+{
+    if (peakCurves.empty()) {
+        return calcShaperLatency(arrivalCurve, shaperCurve);
+    }
+    Curve serviceCurve;
+    peakCurvesToArrivalCurve(serviceCurve, shaperCurve, peakCurves);
+    return calcLatency(arrivalCurve, serviceCurve);
+}
+
+// Generate the concave arrival curve of a (r,b) rate limiter along with peak rate limiters.
+void peakCurvesToArrivalCurve(Curve& arrivalCurve, const SimpleArrivalCurve& shaperCurve, const vector<SimpleArrivalCurve>& peakCurves)
+{
+    // Get the r-b curve in order of decreasing rate, keeping the smallest burst of equal rates
+    vector<double> rates;
+    vector<double> bursts;
+    for (vector<SimpleArrivalCurve>::const_reverse_iterator it = peakCurves.rbegin(); it != peakCurves.rend(); it++) {
+        if (!rates.empty() && (rates.back() == it->r)) {
+            bursts.back() = min(bursts.back(), it->b);
+        } else {
+            rates.push_back(it->r);
+            bursts.push_back(it->b);
+        }
+    }
+    if (!rates.empty() && (rates.back() == shaperCurve.r)) {
+        bursts.back() = min(bursts.back(), shaperCurve.b);
+    } else {
+        rates.push_back(shaperCurve.r);
+        bursts.push_back(shaperCurve.b);
+    }
+    rbCurveToArrivalCurve(arrivalCurve, rates, bursts);
+}
+
 //
 // Operators on simple arrival and service curves
 //
@@ -336,21 +718,142 @@ double DNCLatencyBound(const SimpleArrivalCurve& A, const SimpleServiceCurve& S)
     }
 }
 
+//
+// Operators on concave arrival curves
+//
+// DNC operator for the aggregation of the peak curves of two concave arrival curves (A, P) and (B, Q).
+vector<SimpleArrivalCurve> AggregatePeakCurves(const SimpleArrivalCurve& A, const vector<SimpleArrivalCurve>& P, const SimpleArrivalCurve& B, const vector<SimpleArrivalCurve>& Q)
+{
+    vector<SimpleArrivalCurve> sum(max(P.size(), Q.size()));
+    for (unsigned int i = 0; i < sum.size(); i++) {
+        const SimpleArrivalCurve& peakA = P.empty() ? A : ((i < P.size()) ? P[i] : P.back());
+        const SimpleArrivalCurve& peakB = Q.empty() ? B : ((i < Q.size()) ? Q[i] : Q.back());
+        sum[i] = AggregateArrivalCurve(peakA, peakB);
+    }
+    return sum;
+}
+
+// DNC operator for the peak curves of the departure of a concave arrival curve (A, P) after leaving a queue with service curve S.
+// The departure is bounded by the departure of each (r,b) curve with r <= S.R, whose burst grows by r * S.T.
+vector<SimpleArrivalCurve> OutputPeakCurves(const vector<SimpleArrivalCurve>& P, const SimpleServiceCurve& S)
+{
+    vector<SimpleArrivalCurve> output;
+    for (vector<SimpleArrivalCurve>::const_iterator it = P.begin(); it != P.end(); it++) {
+        if (it->r <= S.R) {
+            output.push_back(OutputArrivalCurve(*it, S));
+        }
+    }
+    return output;
+}
+
+// Calculates the worst case latency for a concave arrival curve (A, P) experiencing a service curve S.
+// The latency is the largest horizontal distance S.T + a(t) / S.R - t between the concave arrival curve a and S, which is at one of the vertices of a.
+double DNCLatencyBound(const SimpleArrivalCurve& A, const vector<SimpleArrivalCurve>& P, const SimpleServiceCurve& S)
+{
+    if (P.empty()) {
+        return DNCLatencyBound(A, S);
+    }
+    Curve arrivalCurve;
+    peakCurvesToArrivalCurve(arrivalCurve, A, P);
+    if (arrivalCurve.back().slope > S.R) {
+        return numeric_limits<double>::infinity();
+    }
+    double latency = 0;
+    for (unsigned int i = 1; i < arrivalCurve.size(); i++) {
+        latency = max(latency, arrivalCurve[i].y / S.R - arrivalCurve[i].x);
+    }
+    return S.T + latency;
+}
+
+// Return the value of a concave arrival curve at time t.
+static double evalArrivalCurve(const Curve& arrivalCurve, double t)
+{
+    unsigned int i = arrivalCurve.size() - 1;
+    while ((i > 0) && (arrivalCurve[i].x > t)) {
+        i--;
+    }
+    return arrivalCurve[i].y + arrivalCurve[i].slope * (t - arrivalCurve[i].x);
+}
+
+// Calculates the worst case latency for a concave arrival curve (A, P) experiencing the service curve that is leftover once a queue with service curve S has accounted for the behavior of a concave arrival curve (H, Q).
+// The leftover service curve is [S(t) - h(t)]+ for the concave arrival curve h of (H, Q), which is convex and piecewise linear with vertices at S.T and the vertices of h.
+double LeftoverLatencyBound(const SimpleArrivalCurve& A, const vector<SimpleArrivalCurve>& P, const SimpleArrivalCurve& H, const vector<SimpleArrivalCurve>& Q, const SimpleServiceCurve& S)
+{
+    if (P.empty() && Q.empty()) {
+        return DNCLatencyBound(A, LeftoverServiceCurve(H, S));
+    }
+    Curve arrivalCurve;
+    peakCurvesToArrivalCurve(arrivalCurve, A, P);
+    Curve higherCurve;
+    peakCurvesToArrivalCurve(higherCurve, H, Q);
+    double leftoverRate = S.R - higherCurve.back().slope;
+    if ((leftoverRate <= 0) || (arrivalCurve.back().slope > leftoverRate)) {
+        return numeric_limits<double>::infinity();
+    }
+    // Get the vertices of the leftover service curve before taking the positive part
+    vector<double> xs(1, S.T);
+    for (unsigned int i = 1; i < higherCurve.size(); i++) {
+        xs.push_back(higherCurve[i].x);
+    }
+    sort(xs.begin(), xs.end());
+    xs.erase(unique(xs.begin(), xs.end()), xs.end());
+    vector<double> ys;
+    for (vector<double>::const_iterator it = xs.begin(); it != xs.end(); it++) {
+        ys.push_back(S.R * max(0.0, *it - S.T) - evalArrivalCurve(higherCurve, *it));
+    }
+    // Build the leftover service curve, which is 0 until the first time it becomes positive
+    Curve serviceCurve(1, PointSlope(0, 0, 0));
+    for (unsigned int i = 0; i < xs.size(); i++) {
+        double slope = (i + 1 < xs.size()) ? ((ys[i + 1] - ys[i]) / (xs[i + 1] - xs[i])) : leftoverRate;
+        if (serviceCurve.size() > 1) {
+            serviceCurve.push_back(PointSlope(xs[i], ys[i], slope));
+        } else if ((slope > 0) && ((i + 1 == xs.size()) || (ys[i + 1] > 0))) {
+            serviceCurve.push_back(PointSlope(xs[i] - min(0.0, ys[i]) / slope, max(0.0, ys[i]), slope));
+        }
+    }
+    return calcLatency(arrivalCurve, serviceCurve);
+}
+
 // DNC algorithm that analyzes a flow's latency by considering each queue (a.k.a., "hop") one at a time.
+// Initialize a flow's memoized hop-by-hop curves if needed.
+static void initHopCache(const DNCFlow* f)
+{
+    if (f->hopArrivalVersions.size() != f->queueIds.size()) {
+        f->hopArrivalCurves.resize(f->queueIds.size());
+        f->hopArrivalVersions.assign(f->queueIds.size(), 0);
+        f->hopServiceCurves.resize(f->queueIds.size());
+        f->hopServiceVersions.assign(f->queueIds.size(), 0);
+    }
+}
+
 void DNC::calcArrivalCurveAtQueue(const DNCFlow* f, unsigned int index, SimpleArrivalCurve& arrivalCurve)
 {
     if (index == 0) {
         arrivalCurve = f->shaperCurve;
-    } else {
-        SimpleArrivalCurve prevArrivalCurve;
-        SimpleServiceCurve prevServiceCurve;
-        calcArrivalCurveAtQueue(f, index - 1, prevArrivalCurve);
-        calcServiceCurveAtQueue(f, index - 1, prevServiceCurve);
-        arrivalCurve = OutputArrivalCurve(prevArrivalCurve, prevServiceCurve);
+        return;
     }
+    // Check memoized curve
+    initHopCache(f);
+    if (f->hopArrivalVersions[index] == getVersion()) {
+        arrivalCurve = f->hopArrivalCurves[index];
+        return;
+    }
+    SimpleArrivalCurve prevArrivalCurve;
+    SimpleServiceCurve prevServiceCurve;
+    calcArrivalCurveAtQueue(f, index - 1, prevArrivalCurve);
+    calcServiceCurveAtQueue(f, index - 1, prevServiceCurve);
+    arrivalCurve = OutputArrivalCurve(prevArrivalCurve, prevServiceCurve);
+    f->hopArrivalCurves[index] = arrivalCurve;
+    f->hopArrivalVersions[index] = getVersion();
 }
 void DNC::calcServiceCurveAtQueue(const DNCFlow* f, unsigned int index, SimpleServiceCurve& serviceCurve)
 {
+    // Check memoized curve
+    initHopCache(f);
+    if (f->hopServiceVersions[index] == getVersion()) {
+        serviceCurve = f->hopServiceCurves[index];
+        return;
+    }
     const Queue* q = getQueue(f->queueIds[index]);
     // Initialize service curve
     serviceCurve = ConstantServiceCurve(q);
@@ -363,23 +866,158 @@ void DNC::calcServiceCurveAtQueue(const DNCFlow* f, unsigned int index, SimpleSe
             serviceCurve = LeftoverServiceCurve(arrivalCurve, serviceCurve);
         }
     }
+    f->hopServiceCurves[index] = serviceCurve;
+    f->hopServiceVersions[index] = getVersion();
 }
 void DNC::hopByHopAnalysis(DNCFlow* flow)
 {
     // Calculate queue latencies
+    // The flow's own peak curves tighten its latency at each hop, while other flows only use their shaper curves
     SimpleArrivalCurve arrivalCurve = flow->shaperCurve;
+    vector<SimpleArrivalCurve> peakCurves = flow->peakCurves;
     SimpleServiceCurve serviceCurve;
     double latency = 0;
     for (unsigned int index = 0; index < flow->queueIds.size(); index++) {
         calcServiceCurveAtQueue(flow, index, serviceCurve);
-        latency += DNCLatencyBound(arrivalCurve, serviceCurve);
+        latency += DNCLatencyBound(arrivalCurve, peakCurves, serviceCurve);
         arrivalCurve = OutputArrivalCurve(arrivalCurve, serviceCurve);
+        if (!peakCurves.empty()) {
+            peakCurves = OutputPeakCurves(peakCurves, serviceCurve);
+        }
     }
     flow->latency = latency;
 }
 
 // DNC algorithm that takes a similar analysis approach as in the SNC-Meister paper, except using DNC operators.
 // Currently supported for flows with up to two queues, as is the case when modeling end-host network links.
+// Remove the arrival curve B from the aggregate arrival curve A that contains it.
+static SimpleArrivalCurve SubtractArrivalCurve(const SimpleArrivalCurve& A, const SimpleArrivalCurve& B)
+{
+    SimpleArrivalCurve difference;
+    difference.r = max(A.r - B.r, 0.0);
+    difference.b = max(A.b - B.b, 0.0);
+    return difference;
+}
+
+// Add a flow's shaper curve to the sum for its priority.
+// Peak curves are only summed for priorities with flows that have peak curves, where the flows without peak curves use their shaper curve.
+static void addPrioritySum(map<unsigned int, SimpleArrivalCurve>& prioritySums, map<unsigned int, vector<SimpleArrivalCurve> >& priorityPeakSums, const DNCFlow* f)
+{
+    map<unsigned int, SimpleArrivalCurve>::iterator it = prioritySums.find(f->priority);
+    if (it == prioritySums.end()) {
+        prioritySums[f->priority] = f->shaperCurve;
+        if (!f->peakCurves.empty()) {
+            priorityPeakSums[f->priority] = f->peakCurves;
+        }
+    } else {
+        map<unsigned int, vector<SimpleArrivalCurve> >::iterator peakIt = priorityPeakSums.find(f->priority);
+        if (peakIt != priorityPeakSums.end()) {
+            peakIt->second = AggregatePeakCurves(f->shaperCurve, f->peakCurves, it->second, peakIt->second);
+        } else if (!f->peakCurves.empty()) {
+            priorityPeakSums[f->priority] = AggregatePeakCurves(f->shaperCurve, f->peakCurves, it->second, vector<SimpleArrivalCurve>());
+        }
+        it->second = AggregateArrivalCurve(f->shaperCurve, it->second);
+    }
+}
+
+void PrioritySums::build(const map<unsigned int, SimpleArrivalCurve>& prioritySums, const map<unsigned int, vector<SimpleArrivalCurve> >& priorityPeakSums)
+{
+    priorities.clear();
+    sums.clear();
+    prefixSums.clear();
+    peakSums.clear();
+    prefixPeakSums.clear();
+    SimpleArrivalCurve prefixSum = ZeroArrivalCurve();
+    vector<SimpleArrivalCurve> prefixPeakSum;
+    for (map<unsigned int, SimpleArrivalCurve>::const_iterator it = prioritySums.begin(); it != prioritySums.end(); it++) {
+        if (!priorityPeakSums.empty()) {
+            map<unsigned int, vector<SimpleArrivalCurve> >::const_iterator peakIt = priorityPeakSums.find(it->first);
+            peakSums.push_back((peakIt != priorityPeakSums.end()) ? peakIt->second : vector<SimpleArrivalCurve>());
+            prefixPeakSum = AggregatePeakCurves(it->second, peakSums.back(), prefixSum, prefixPeakSum);
+            prefixPeakSums.push_back(prefixPeakSum);
+        }
+        prefixSum = AggregateArrivalCurve(it->second, prefixSum);
+        priorities.push_back(it->first);
+        sums.push_back(it->second);
+        prefixSums.push_back(prefixSum);
+    }
+}
+
+SimpleArrivalCurve PrioritySums::sumEqual(unsigned int p) const
+{
+    vector<unsigned int>::const_iterator it = lower_bound(priorities.begin(), priorities.end(), p);
+    if ((it == priorities.end()) || (*it != p)) {
+        return ZeroArrivalCurve();
+    }
+    return sums[it - priorities.begin()];
+}
+
+const vector<SimpleArrivalCurve>& PrioritySums::peakSumEqual(unsigned int p) const
+{
+    static const vector<SimpleArrivalCurve> noPeakCurves;
+    if (peakSums.empty()) {
+        return noPeakCurves;
+    }
+    vector<unsigned int>::const_iterator it = lower_bound(priorities.begin(), priorities.end(), p);
+    if ((it == priorities.end()) || (*it != p)) {
+        return noPeakCurves;
+    }
+    return peakSums[it - priorities.begin()];
+}
+
+const vector<SimpleArrivalCurve>& PrioritySums::peakSumBelow(unsigned int p) const
+{
+    static const vector<SimpleArrivalCurve> noPeakCurves;
+    unsigned int n = lower_bound(priorities.begin(), priorities.end(), p) - priorities.begin();
+    return (prefixPeakSums.empty() || (n == 0)) ? noPeakCurves : prefixPeakSums[n - 1];
+}
+
+SimpleArrivalCurve PrioritySums::sumAtMost(unsigned int p) const
+{
+    unsigned int n = upper_bound(priorities.begin(), priorities.end(), p) - priorities.begin();
+    return (n == 0) ? ZeroArrivalCurve() : prefixSums[n - 1];
+}
+
+SimpleArrivalCurve PrioritySums::sumBelow(unsigned int p) const
+{
+    unsigned int n = lower_bound(priorities.begin(), priorities.end(), p) - priorities.begin();
+    return (n == 0) ? ZeroArrivalCurve() : prefixSums[n - 1];
+}
+
+const DNCQueue* DNC::getAggregatedQueue(QueueId queueId)
+{
+    const DNCQueue* q = static_cast<const DNCQueue*>(getQueue(queueId));
+    if (q->aggregatesVersion != q->version) {
+        // Rebuild aggregates from the queue's flows
+        map<unsigned int, SimpleArrivalCurve> firstHopSums;
+        map<unsigned int, vector<SimpleArrivalCurve> > firstHopPeakSums;
+        map<QueueId, map<unsigned int, SimpleArrivalCurve> > downstreamSums;
+        map<QueueId, map<unsigned int, vector<SimpleArrivalCurve> > > downstreamPeakSums;
+        map<QueueId, set<unsigned int> > upstreamPriorities;
+        for (unsigned int i = 0; i < q->flows.size(); i++) {
+            const DNCFlow* f = getDNCFlow(q->flows[i].flowId);
+            if (q->flows[i].index == 0) {
+                QueueId downstreamQueueId = (f->queueIds.size() > 1) ? f->queueIds[1] : InvalidQueueId;
+                addPrioritySum(firstHopSums, firstHopPeakSums, f);
+                addPrioritySum(downstreamSums[downstreamQueueId], downstreamPeakSums[downstreamQueueId], f);
+            } else if (q->flows[i].index == 1) {
+                upstreamPriorities[f->queueIds[0]].insert(f->priority);
+            }
+        }
+        q->firstHopSums.build(firstHopSums, firstHopPeakSums);
+        q->downstreamSums.clear();
+        for (map<QueueId, map<unsigned int, SimpleArrivalCurve> >::const_iterator it = downstreamSums.begin(); it != downstreamSums.end(); it++) {
+            q->downstreamSums[it->first].build(it->second, downstreamPeakSums[it->first]);
+        }
+        q->upstreamPriorities.clear();
+        for (map<QueueId, set<unsigned int> >::const_iterator it = upstreamPriorities.begin(); it != upstreamPriorities.end(); it++) {
+            q->upstreamPriorities[it->first].assign(it->second.begin(), it->second.end());
+        }
+        q->aggregatesVersion = q->version;
+    }
+    return q;
+}
+
 void DNC::aggregateAnalysisTwoHop(DNCFlow* flow)
 {
     assert(flow->queueIds.size() <= 2);
@@ -388,111 +1026,64 @@ void DNC::aggregateAnalysisTwoHop(DNCFlow* flow)
         // One hop
         //
         // Calculate leftover service from higher priority flows and arrival of flow at first hop
-        QueueId firstQueueId = flow->queueIds[0];
-        const Queue* firstQueue = getQueue(firstQueueId);
-        SimpleArrivalCurve arrivalCurve = ZeroArrivalCurve();
-        SimpleServiceCurve serviceCurve = ConstantServiceCurve(firstQueue);
-        for (unsigned int i = 0; i < firstQueue->flows.size(); i++) {
-            assert(firstQueue->flows[i].index == 0);
-            const DNCFlow* f = getDNCFlow(firstQueue->flows[i].flowId);
-            assert(f->queueIds[0] == firstQueueId);
-            // Only consider flows of higher (or equal) priority (i.e. <= flow->priority)
-            if (f->priority <= flow->priority) {
-                // Aggregate equal priority flows
-                if (f->priority == flow->priority) {
-                    arrivalCurve = AggregateArrivalCurve(f->shaperCurve, arrivalCurve);
-                } else {
-                    serviceCurve = LeftoverServiceCurve(f->shaperCurve, serviceCurve);
-                }
-            }
-        }
-        // Calculate latency
-        flow->latency = DNCLatencyBound(arrivalCurve, serviceCurve);
+        const DNCQueue* firstQueue = getAggregatedQueue(flow->queueIds[0]);
+        // Aggregate equal priority flows
+        SimpleArrivalCurve arrivalCurve = firstQueue->firstHopSums.sumEqual(flow->priority);
+        // Higher priority flows (i.e. < flow->priority) are subtracted from the service as a single aggregate
+        SimpleArrivalCurve higherArrivalCurve = firstQueue->firstHopSums.sumBelow(flow->priority);
+        // Calculate latency, where the flows' peak curves bound their aggregate arrival curves along with their shaper curves
+        flow->latency = LeftoverLatencyBound(arrivalCurve, firstQueue->firstHopSums.peakSumEqual(flow->priority),
+                                             higherArrivalCurve, firstQueue->firstHopSums.peakSumBelow(flow->priority), ConstantServiceCurve(firstQueue));
     } else if (flow->queueIds.size() == 2) {
         //
         // Two hops
         //
-        // Identify ids of first queues that feed into this particular second queue
         QueueId firstQueueId = flow->queueIds[0];
         QueueId secondQueueId = flow->queueIds[1];
-        const Queue* secondQueue = getQueue(secondQueueId);
-        map<QueueId, unsigned int> firstQueueIds; // first QueueId -> priority
-        for (unsigned int i = 0; i < secondQueue->flows.size(); i++) {
-            assert(secondQueue->flows[i].index == 1);
-            const DNCFlow* f = getDNCFlow(secondQueue->flows[i].flowId);
-            assert(f->queueIds[1] == secondQueueId);
+        const DNCQueue* secondQueue = getAggregatedQueue(secondQueueId);
+        // Loop through first queues that feed into this particular second queue to calculate second queue leftover service
+        SimpleServiceCurve secondQueueServiceCurve = ConstantServiceCurve(secondQueue);
+        for (map<QueueId, vector<unsigned int> >::const_iterator it = secondQueue->upstreamPriorities.begin(); it != secondQueue->upstreamPriorities.end(); it++) {
             // Exclude first queue
-            if (f->queueIds[0] != firstQueueId) {
-                // Only consider flows of higher (or equal) priority (i.e. <= flow->priority)
-                if (f->priority <= flow->priority) {
-                    map<QueueId, unsigned int>::iterator it = firstQueueIds.find(f->queueIds[0]);
-                    if (it == firstQueueIds.end()) {
-                        firstQueueIds[f->queueIds[0]] = f->priority;
-                    // Of the competing high priority flows for a given first queue, identify the lowest priority (i.e., max value)
-                    } else if (f->priority > it->second) {
-                        it->second = f->priority;
-                    }
-                }
+            if (it->first == firstQueueId) {
+                continue;
             }
-        }
-        // Loop through first queues to calculate second queue leftover service and aggregate arrival
-        SimpleServiceCurve secondQueueServiceCurve = ConstantServiceCurve(secondQueue);
-        for (map<QueueId, unsigned int>::const_iterator it = firstQueueIds.begin(); it != firstQueueIds.end(); it++) {
-            const Queue* q = getQueue(it->first);
-            SimpleArrivalCurve firstQueueArrivalCurve = ZeroArrivalCurve();
-            SimpleServiceCurve firstQueueServiceCurve = ConstantServiceCurve(q);
-            for (unsigned int i = 0; i < q->flows.size(); i++) {
-                assert(q->flows[i].index == 0);
-                const DNCFlow* f = getDNCFlow(q->flows[i].flowId);
-                assert(f->queueIds[0] == it->first);
-                // Only consider flows of higher (or equal) priority than the lowest priority competing flow as identified in firstQueueIds
-                if (f->priority <= it->second) {
-                    // Check if sharing second queue
-                    if (f->queueIds[1] == secondQueueId) {
-                        firstQueueArrivalCurve = AggregateArrivalCurve(f->shaperCurve, firstQueueArrivalCurve);
-                    } else {
-                        firstQueueServiceCurve = LeftoverServiceCurve(f->shaperCurve, firstQueueServiceCurve);
-                    }
-                }
+            // Of the competing higher (or equal) priority flows (i.e. <= flow->priority), identify the lowest priority (i.e., max value)
+            vector<unsigned int>::const_iterator prioIt = upper_bound(it->second.begin(), it->second.end(), flow->priority);
+            if (prioIt == it->second.begin()) {
+                continue;
             }
+            unsigned int maxPriority = *(prioIt - 1);
+            // Only consider flows of higher (or equal) priority than the lowest priority competing flow
+            const DNCQueue* q = getAggregatedQueue(it->first);
+            map<QueueId, PrioritySums>::const_iterator shareIt = q->downstreamSums.find(secondQueueId);
+            assert(shareIt != q->downstreamSums.end());
+            SimpleArrivalCurve firstQueueArrivalCurve = shareIt->second.sumAtMost(maxPriority);
+            SimpleArrivalCurve otherArrivalCurve = SubtractArrivalCurve(q->firstHopSums.sumAtMost(maxPriority), firstQueueArrivalCurve);
+            SimpleServiceCurve firstQueueServiceCurve = LeftoverServiceCurve(otherArrivalCurve, ConstantServiceCurve(q));
             // Generate output bound on high priority flows that share second queue
             SimpleArrivalCurve outputArrivalCurve = OutputArrivalCurve(firstQueueArrivalCurve, firstQueueServiceCurve);
             // Subtract output from second queue service
             secondQueueServiceCurve = LeftoverServiceCurve(outputArrivalCurve, secondQueueServiceCurve);
         }
         // Calculate first hop service for convolution
-        const Queue* firstQueue = getQueue(firstQueueId);
-        SimpleArrivalCurve arrivalCurve = ZeroArrivalCurve();
-        SimpleArrivalCurve shareArrivalCurve = ZeroArrivalCurve();
-        SimpleServiceCurve serviceCurveForConvolution = ConstantServiceCurve(firstQueue);
-        for (unsigned int i = 0; i < firstQueue->flows.size(); i++) {
-            assert(firstQueue->flows[i].index == 0);
-            const DNCFlow* f = getDNCFlow(firstQueue->flows[i].flowId);
-            assert(f->queueIds[0] == firstQueueId);
-            // Only consider flows of higher (or equal) priority (i.e. <= flow->priority)
-            if (f->priority <= flow->priority) {
-                // Check if sharing second queue
-                if (f->queueIds[1] == secondQueueId) {
-                    // Aggregate equal priority flows
-                    if (f->priority == flow->priority) {
-                        arrivalCurve = AggregateArrivalCurve(f->shaperCurve, arrivalCurve);
-                    } else {
-                        shareArrivalCurve = AggregateArrivalCurve(f->shaperCurve, shareArrivalCurve);
-                    }
-                } else {
-                    serviceCurveForConvolution = LeftoverServiceCurve(f->shaperCurve, serviceCurveForConvolution);
-                }
-            }
-        }
+        const DNCQueue* firstQueue = getAggregatedQueue(firstQueueId);
+        map<QueueId, PrioritySums>::const_iterator shareIt = firstQueue->downstreamSums.find(secondQueueId);
+        assert(shareIt != firstQueue->downstreamSums.end());
+        // Aggregate equal priority flows and higher priority flows that share second queue
+        SimpleArrivalCurve arrivalCurve = shareIt->second.sumEqual(flow->priority);
+        SimpleArrivalCurve shareArrivalCurve = shareIt->second.sumBelow(flow->priority);
+        // Higher (or equal) priority flows that do not share second queue
+        SimpleArrivalCurve otherArrivalCurve = SubtractArrivalCurve(firstQueue->firstHopSums.sumAtMost(flow->priority), shareIt->second.sumAtMost(flow->priority));
+        SimpleServiceCurve serviceCurveForConvolution = LeftoverServiceCurve(otherArrivalCurve, ConstantServiceCurve(firstQueue));
         // Calculate latency
+        // Higher priority flows that share second queue are subtracted from the convoluted service, and the flows' peak curves bound their aggregate arrival curves along with their shaper curves
         SimpleServiceCurve convolutedServiceCurve = ConvolutionServiceCurve(serviceCurveForConvolution, secondQueueServiceCurve);
-        SimpleServiceCurve finalService = LeftoverServiceCurve(shareArrivalCurve, convolutedServiceCurve);
-        flow->latency = DNCLatencyBound(arrivalCurve, finalService);
+        flow->latency = LeftoverLatencyBound(arrivalCurve, shareIt->second.peakSumEqual(flow->priority),
+                                             shareArrivalCurve, shareIt->second.peakSumBelow(flow->priority), convolutedServiceCurve);
     }
 }
 
-// Calculate the latency for a flow.
-// Assumes priorities are set.
 double DNC::calcFlowLatency(FlowId flowId)
 {
     DNCFlow* f = getDNCFlow(flowId);
@@ -516,7 +1107,7 @@ double DNC::calcFlowLatency(FlowId flowId)
             break;
     }
     // Calculate shaper latency
-    f->latency += calcShaperLatency(f->arrivalCurve, f->shaperCurve);
+    f->latency += calcShaperLatency(f->arrivalCurve, f->shaperCurve, f->peakCurves);
     return f->latency;
 }
 
@@ -536,18 +1127,107 @@ FlowId DNC::initFlow(Flow* f, const Json::Value& flowInfo, ClientId clientId)
     return flowId;
 }
 
-void DNC::setArrivalInfo(Json::Value& flowInfo, string trace, const Json::Value& estimatorInfo, double maxRate, string arrivalCurveFilename)
+QueueId DNC::initQueue(Queue* q, const Json::Value& queueInfo)
+{
+    if (q == NULL) {
+        q = new DNCQueue;
+    }
+    QueueId queueId = NC::initQueue(q, queueInfo);
+    static_cast<DNCQueue*>(q)->aggregatesVersion = 0;
+    return queueId;
+}
+
+// Arrival curves looked up by setArrivalInfo(s) and the time spent calculating the ones that are not cached
+static MetricHistogram arrivalCurveGenTime("arrival_curve_generation_seconds", "Time spent calculating arrival curves that are not cached");
+static MetricCounter arrivalCurveLookups("arrival_curve_lookups_total", "Number of arrival curves looked up");
+static MetricCounter arrivalCurveMisses("arrival_curve_cache_misses_total", "Number of arrival curves calculated since they were not cached");
+
+void DNC::setArrivalInfo(Json::Value& flowInfo, string trace, const Json::Value& estimatorInfo, double maxRate, string arrivalCurveFilename, ArrivalCurveAlgorithm algorithm)
 {
     Curve arrivalCurve;
-    if (!readArrivalCurve(arrivalCurve, arrivalCurveFilename)) {
+    arrivalCurveLookups.add();
+    if (!ArrivalCurveCache::get(arrivalCurveFilename, arrivalCurve)) {
+        ScopedTimer timer(arrivalCurveGenTime);
+        arrivalCurveMisses.add();
         // Init estimator
         Estimator* pEst = Estimator::create(estimatorInfo);
         // Read trace
         ProcessedTrace* pTrace = new ProcessedTrace(trace, pEst);
-        calcArrivalCurve(arrivalCurve, pTrace, maxRate);
+        calcArrivalCurve(arrivalCurve, pTrace, maxRate, algorithm);
         delete pTrace;
-        writeArrivalCurve(arrivalCurve, arrivalCurveFilename);
+        ArrivalCurveCache::put(arrivalCurveFilename, arrivalCurve);
     }
     arrivalCurve.erase(arrivalCurve.begin());
     serializeJSON(flowInfo, "arrivalInfo", arrivalCurve);
 }
+
+// Arguments for a thread that calculates an arrival curve in DNC::setArrivalInfos.
+struct ArrivalCurveThreadArgs {
+    ProcessedTrace* pTrace;
+    double maxRate;
+    ArrivalCurveAlgorithm algorithm;
+    unsigned int numThreads;
+    Curve arrivalCurve;
+};
+
+static void* arrivalCurveThread(void* arg)
+{
+    ArrivalCurveThreadArgs* args = static_cast<ArrivalCurveThreadArgs*>(arg);
+    calcArrivalCurve(args->arrivalCurve, args->pTrace, args->maxRate, args->algorithm, args->numThreads);
+    return NULL;
+}
+
+void DNC::setArrivalInfos(vector<ArrivalInfoRequest>& requests, string trace, ArrivalCurveAlgorithm algorithm, unsigned int numThreads)
+{
+    if (numThreads == 0) {
+        long numProcessors = sysconf(_SC_NPROCESSORS_ONLN);
+        numThreads = (numProcessors > 0) ? numProcessors : 1;
+    }
+    // Read cached arrival curves
+    vector<Curve> arrivalCurves(requests.size());
+    vector<unsigned int> missIndices;
+    for (unsigned int i = 0; i < requests.size(); i++) {
+        if (!ArrivalCurveCache::get(requests[i].arrivalCurveFilename, arrivalCurves[i])) {
+            missIndices.push_back(i);
+        }
+    }
+    arrivalCurveLookups.add(requests.size());
+    if (!missIndices.empty()) {
+        ScopedTimer timer(arrivalCurveGenTime);
+        arrivalCurveMisses.add(missIndices.size());
+        // Read trace once and share it across estimators
+        TraceReader* pTraceReader = TraceReader::create(trace);
+        vector<ArrivalCurveThreadArgs> threadArgs(missIndices.size());
+        for (unsigned int i = 0; i < missIndices.size(); i++) {
+            const ArrivalInfoRequest& request = requests[missIndices[i]];
+            threadArgs[i].pTrace = new ProcessedTrace(*pTraceReader, Estimator::create(request.estimatorInfo));
+            threadArgs[i].maxRate = request.maxRate;
+            threadArgs[i].algorithm = algorithm;
+            threadArgs[i].numThreads = max(numThreads / static_cast<unsigned int>(missIndices.size()), 1u);
+        }
+        // Calculate arrival curves for each estimator in parallel
+        vector<pthread_t> threads(threadArgs.size());
+        vector<bool> threadCreated(threadArgs.size(), false);
+        for (unsigned int i = 1; i < threadArgs.size(); i++) {
+            threadCreated[i] = (pthread_create(&threads[i], NULL, arrivalCurveThread, &threadArgs[i]) == 0);
+        }
+        for (unsigned int i = 0; i < threadArgs.size(); i++) {
+            if (i == 0 || !threadCreated[i]) {
+                arrivalCurveThread(&threadArgs[i]);
+            }
+        }
+        for (unsigned int i = 0; i < threadArgs.size(); i++) {
+            if (threadCreated[i]) {
+                pthread_join(threads[i], NULL);
+            }
+            delete threadArgs[i].pTrace;
+            arrivalCurves[missIndices[i]] = threadArgs[i].arrivalCurve;
+            ArrivalCurveCache::put(requests[missIndices[i]].arrivalCurveFilename, arrivalCurves[missIndices[i]]);
+        }
+        delete pTraceReader;
+    }
+    for (unsigned int i = 0; i < requests.size(); i++) {
+        arrivalCurves[i].erase(arrivalCurves[i].begin());
+        serializeJSON(*requests[i].flowInfo, "arrivalInfo", arrivalCurves[i]);
+    }
+}
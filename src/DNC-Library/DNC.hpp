@@ -9,9 +9,11 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include "../common/serializeJSON.hpp"
 #include "../TraceCommon/ProcessedTrace.hpp"
 #include "NC.hpp"
+#include "SlidingArrivalCurve.hpp"
 
 using namespace std;
 
@@ -67,6 +69,64 @@ struct SimpleServiceCurve {
 struct DNCFlow : Flow {
     Curve arrivalCurve;
     SimpleArrivalCurve shaperCurve;
+    // Peak (r,b) rate limits enforced along with shaperCurve, in order of increasing r and decreasing b.
+    // The flow's shaped arrival curve is then the concave minimum of shaperCurve and its peak curves (see DNCLatencyBound).
+    vector<SimpleArrivalCurve> peakCurves;
+    // Per-hop arrival and leftover service curves memoized by the hop-by-hop analysis.
+    // An entry is valid if its version matches the DNC's version (see NC::getVersion).
+    mutable vector<SimpleArrivalCurve> hopArrivalCurves;
+    mutable vector<uint64_t> hopArrivalVersions;
+    mutable vector<SimpleServiceCurve> hopServiceCurves;
+    mutable vector<uint64_t> hopServiceVersions;
+};
+
+// Sums of shaper curves grouped by priority, along with prefix sums over priorities.
+struct PrioritySums {
+    vector<unsigned int> priorities; // Increasing
+    vector<SimpleArrivalCurve> sums; // sums[i] is the sum of shaper curves with priority priorities[i]
+    vector<SimpleArrivalCurve> prefixSums; // prefixSums[i] is the sum of shaper curves with priority <= priorities[i]
+    vector<vector<SimpleArrivalCurve> > peakSums; // peakSums[i] is the sum of peak curves with priority priorities[i] (see AggregatePeakCurves); empty if no flows have peak curves
+    vector<vector<SimpleArrivalCurve> > prefixPeakSums; // prefixPeakSums[i] is the sum of peak curves with priority <= priorities[i]; empty if no flows have peak curves
+
+    // Build from the sum of shaper curves of each priority and the sum of peak curves of priorities with flows that have peak curves.
+    void build(const map<unsigned int, SimpleArrivalCurve>& prioritySums, const map<unsigned int, vector<SimpleArrivalCurve> >& priorityPeakSums);
+    // Return the sum of shaper curves with priority equal to p.
+    SimpleArrivalCurve sumEqual(unsigned int p) const;
+    // Return the sum of peak curves with priority equal to p.
+    const vector<SimpleArrivalCurve>& peakSumEqual(unsigned int p) const;
+    // Return the sum of peak curves with priority < p.
+    const vector<SimpleArrivalCurve>& peakSumBelow(unsigned int p) const;
+    // Return the sum of shaper curves with priority <= p.
+    SimpleArrivalCurve sumAtMost(unsigned int p) const;
+    // Return the sum of shaper curves with priority < p.
+    SimpleArrivalCurve sumBelow(unsigned int p) const;
+};
+
+// Extends the Queue structure with the aggregates used by DNC_SIMPLE_ALGORITHM_AGGREGATE.
+// Aggregates are rebuilt from the queue's flows when the queue's version changes.
+struct DNCQueue : Queue {
+    mutable uint64_t aggregatesVersion;
+    mutable PrioritySums firstHopSums; // Flows with the queue as their first queue
+    mutable map<QueueId, PrioritySums> downstreamSums; // Flows with the queue as their first queue, by second queue (InvalidQueueId if none)
+    mutable map<QueueId, vector<unsigned int> > upstreamPriorities; // Increasing priorities of flows with the queue as their second queue, by first queue
+};
+
+// Number of points of the arrival curves generated by calcArrivalCurve, which bounds the number of constraints per flow in WorkloadCompactor's LP.
+#define ARRIVAL_CURVE_NUM_POINTS 12
+
+// Algorithms for generating an arrival curve from a trace.
+// Both curves are pruned to ARRIVAL_CURVE_NUM_POINTS points, so the exact curve is only exact before pruning (see calcExactArrivalCurve).
+enum ArrivalCurveAlgorithm {
+    ARRIVAL_CURVE_ALGORITHM_RATE_SAMPLED, // r-b curve for a grid of rates from maxRate down to the average rate
+    ARRIVAL_CURVE_ALGORITHM_EXACT, // concave hull of the trace's cumulative work function
+};
+
+// Describes an arrival curve to generate for a flow with DNC::setArrivalInfos.
+struct ArrivalInfoRequest {
+    Json::Value* flowInfo;
+    Json::Value estimatorInfo;
+    double maxRate;
+    string arrivalCurveFilename;
 };
 
 enum DNCAlgorithm {
@@ -81,15 +141,20 @@ private:
     DNCAlgorithm _algorithm;
 
     // DNC algorithm that analyzes a flow's latency by considering each queue (a.k.a., "hop") one at a time.
+    // Arrival and service curves at each hop are memoized until the system is modified, so each (flow, hop) pair is only analyzed once.
     void calcArrivalCurveAtQueue(const DNCFlow* f, unsigned int index, SimpleArrivalCurve& arrivalCurve);
     void calcServiceCurveAtQueue(const DNCFlow* f, unsigned int index, SimpleServiceCurve& serviceCurve);
     void hopByHopAnalysis(DNCFlow* flow);
     // DNC algorithm that takes a similar analysis approach as in the SNC-Meister paper, except using DNC operators.
     // Currently supported for flows with up to two queues, as is the case when modeling end-host network links.
+    // Shaper curves are summed per queue by priority, so the analysis does not need to iterate over the flows of each queue.
     void aggregateAnalysisTwoHop(DNCFlow* flow);
+    // Return a queue with up-to-date aggregates.
+    const DNCQueue* getAggregatedQueue(QueueId queueId);
 
 protected:
     virtual FlowId initFlow(Flow* f, const Json::Value& flowInfo, ClientId clientId);
+    virtual QueueId initQueue(Queue* q, const Json::Value& queueInfo);
 
     DNCFlow* getDNCFlow(FlowId flowId) { return static_cast<DNCFlow*>(const_cast<Flow*>(getFlow(flowId))); }
 
@@ -108,10 +173,30 @@ public:
     const Curve& getArrivalCurve(FlowId flowId) { return getDNCFlow(flowId)->arrivalCurve; }
 
     // Get/set the shaper curve that representing the flow's (r,b) rate limit parameters.
+    // Setting only the shaper curve removes the flow's peak rate limits.
     const SimpleArrivalCurve& getShaperCurve(FlowId flowId) { return getDNCFlow(flowId)->shaperCurve; }
-    void setShaperCurve(FlowId flowId, const SimpleArrivalCurve& shaperCurve) { getDNCFlow(flowId)->shaperCurve = shaperCurve; }
+    void setShaperCurve(FlowId flowId, const SimpleArrivalCurve& shaperCurve)
+    {
+        DNCFlow* f = getDNCFlow(flowId);
+        f->shaperCurve = shaperCurve;
+        f->peakCurves.clear();
+        modifiedFlow(f);
+    }
+    // Get/set the peak (r,b) rate limits enforced along with the shaper curve, in order of increasing r and decreasing b.
+    const vector<SimpleArrivalCurve>& getPeakCurves(FlowId flowId) { return getDNCFlow(flowId)->peakCurves; }
+    void setShaperCurve(FlowId flowId, const SimpleArrivalCurve& shaperCurve, const vector<SimpleArrivalCurve>& peakCurves)
+    {
+        DNCFlow* f = getDNCFlow(flowId);
+        f->shaperCurve = shaperCurve;
+        f->peakCurves = peakCurves;
+        modifiedFlow(f);
+    }
 
-    static void setArrivalInfo(Json::Value& flowInfo, string trace, const Json::Value& estimatorInfo, double maxRate, string arrivalCurveFilename);
+    static void setArrivalInfo(Json::Value& flowInfo, string trace, const Json::Value& estimatorInfo, double maxRate, string arrivalCurveFilename, ArrivalCurveAlgorithm algorithm = ARRIVAL_CURVE_ALGORITHM_RATE_SAMPLED);
+    // Set the arrivalInfo of several flows that share the same trace, e.g., the network and storage flows of a client.
+    // The trace is read once and arrival curves that are not cached are calculated in parallel with numThreads threads in total.
+    // numThreads = 0 uses one thread per online processor.
+    static void setArrivalInfos(vector<ArrivalInfoRequest>& requests, string trace, ArrivalCurveAlgorithm algorithm = ARRIVAL_CURVE_ALGORITHM_RATE_SAMPLED, unsigned int numThreads = 0);
 };
 
 // Return x-intercept of a line with a given slope passing through (x,y).
@@ -127,7 +212,15 @@ inline double yIntercept(double x, double y, double slope)
 
 // Calculate the minimum rate needed to sustain a workload (i.e., average rate of work).
 double calcMinRate(ProcessedTrace* pTrace);
+// Calculate the minimum rate needed to sustain a workload (i.e., average rate of work)
+// along with the r-b curve for a given set of rates in a single pass over the trace.
+// Only a fixed-size block of the trace is buffered at a time.
+double calcMinRateAndRbGen(ProcessedTrace* pTrace, const vector<double>& rates, vector<double>& bursts, unsigned int numThreads = 1);
 // Calculate the r-b curve for a given workload for a given set of rates.
+// bursts[i] is the burst corresponding to rates[i].
+// Token buckets are kept in flat aligned arrays and updated with AVX/AVX-512 when available.
+// The rates are partitioned across numThreads threads.
+void rbGen(ProcessedTrace* pTrace, const vector<double>& rates, vector<double>& bursts, unsigned int numThreads = 1);
 void rbGen(ProcessedTrace* pTrace, const vector<double>& rates, map<double, double>& bursts);
 // Calculate intersection of two point slopes
 // Output slope is the same as first point p1
@@ -135,11 +228,18 @@ void rbGen(ProcessedTrace* pTrace, const vector<double>& rates, map<double, doub
 PointSlope calcPointSlopeIntersection(const PointSlope& p1, const PointSlope& p2);
 // Generate an arrival curve from an r-b curve.
 // Assumes rates is decreasing
+void rbCurveToArrivalCurve(Curve& arrivalCurve, const vector<double>& rates, const vector<double>& bursts);
 void rbCurveToArrivalCurve(Curve& arrivalCurve, const vector<double>& rates, map<double, double>& bursts);
 // Approximate an arrival curve by an arrival curve with n points.
 void pruneArrivalCurve(Curve& arrivalCurve, unsigned int n);
-// Calculate an arrival curve from a trace.
-void calcArrivalCurve(Curve& arrivalCurve, ProcessedTrace* pTrace, double maxRate);
+// Calculate the exact (tightest concave) arrival curve from a trace for rates between the trace's average rate and maxRate, in O(n log n) time.
+// Unlike calcArrivalCurve, the curve is not pruned, so it has more points the longer the trace.
+void calcExactArrivalCurve(Curve& arrivalCurve, ProcessedTrace* pTrace, double maxRate);
+// Calculate an arrival curve from a trace, pruned to ARRIVAL_CURVE_NUM_POINTS points.
+// The rate sampled algorithm uses numThreads threads.
+void calcArrivalCurve(Curve& arrivalCurve, ProcessedTrace* pTrace, double maxRate, ArrivalCurveAlgorithm algorithm = ARRIVAL_CURVE_ALGORITHM_RATE_SAMPLED, unsigned int numThreads = 1);
+// Calculate an arrival curve from the requests in the window of a SlidingArrivalCurve ending at time now, pruned to ARRIVAL_CURVE_NUM_POINTS points.
+void calcArrivalCurve(Curve& arrivalCurve, const SlidingArrivalCurve& slidingArrivalCurve, uint64_t now);
 // Read an arrival curve from a file.
 bool readArrivalCurve(Curve& arrivalCurve, string arrivalCurveFilename);
 // Write an arrival curve to a file.
@@ -148,6 +248,10 @@ void writeArrivalCurve(const Curve& arrivalCurve, string arrivalCurveFilename);
 double calcLatency(const Curve& arrivalCurve, const Curve& serviceCurve);
 // Calculate the latency due to a (r,b) rate limiter (i.e., shaper).
 double calcShaperLatency(const Curve& arrivalCurve, const SimpleArrivalCurve& shaperCurve);
+// Calculate the latency due to a (r,b) rate limiter along with peak rate limiters.
+double calcShaperLatency(const Curve& arrivalCurve, const SimpleArrivalCurve& shaperCurve, const vector<SimpleArrivalCurve>& peakCurves);
+// Generate the concave arrival curve of a (r,b) rate limiter along with peak rate limiters.
+void peakCurvesToArrivalCurve(Curve& arrivalCurve, const SimpleArrivalCurve& shaperCurve, const vector<SimpleArrivalCurve>& peakCurves);
 
 //
 // Operators on simple arrival and service curves
@@ -168,4 +272,20 @@ SimpleServiceCurve LeftoverServiceCurve(const SimpleArrivalCurve& A, const Simpl
 // Calculates the worst case latency for an arrival curve A experiencing a service curve S.
 double DNCLatencyBound(const SimpleArrivalCurve& A, const SimpleServiceCurve& S);
 
+//
+// Operators on concave arrival curves, i.e., the minimum of a simple arrival curve A and its peak curves P.
+// P is in order of increasing r and decreasing b; a curve without peak curves is the simple arrival curve A.
+//
+// DNC operator for the aggregation of the peak curves of two concave arrival curves (A, P) and (B, Q), where the aggregate's shaper curve is AggregateArrivalCurve(A, B).
+// The i-th peak curve of the aggregate is the sum of the i-th peak curves, where a concave arrival curve with fewer peak curves uses its last curve,
+// so the aggregate bounds the sum since each sum of curves does.
+vector<SimpleArrivalCurve> AggregatePeakCurves(const SimpleArrivalCurve& A, const vector<SimpleArrivalCurve>& P, const SimpleArrivalCurve& B, const vector<SimpleArrivalCurve>& Q);
+// DNC operator for the peak curves of the departure of a concave arrival curve (A, P) after leaving a queue with service curve S, where the shaper curve of the departure is OutputArrivalCurve(A, S).
+// Peak curves with rates above S.R no longer bound the departure and are dropped.
+vector<SimpleArrivalCurve> OutputPeakCurves(const vector<SimpleArrivalCurve>& P, const SimpleServiceCurve& S);
+// Calculates the worst case latency for a concave arrival curve (A, P) experiencing a service curve S.
+double DNCLatencyBound(const SimpleArrivalCurve& A, const vector<SimpleArrivalCurve>& P, const SimpleServiceCurve& S);
+// Calculates the worst case latency for a concave arrival curve (A, P) experiencing the service curve that is leftover once a queue with service curve S has accounted for the behavior of a concave arrival curve (H, Q).
+double LeftoverLatencyBound(const SimpleArrivalCurve& A, const vector<SimpleArrivalCurve>& P, const SimpleArrivalCurve& H, const vector<SimpleArrivalCurve>& Q, const SimpleServiceCurve& S);
+
 #endif // DNC_HPP
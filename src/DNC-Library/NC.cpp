@@ -7,8 +7,10 @@
 
 #include <cassert>
 #include <string>
+#include <algorithm>
 #include <vector>
 #include <map>
+#include <set>
 #include <json/json.h>
 #include "NC.hpp"
 
@@ -23,25 +25,41 @@ bool priorityCompare(const Flow* f1, const Flow* f2)
     return (f1->priority < f2->priority);
 }
 
+// Comparison function for sorting a queue's priorityFlows by priority, then flow id.
+static bool priorityFlowCompare(const PriorityFlowIndex& pfi1, const PriorityFlowIndex& pfi2)
+{
+    if (pfi1.priority == pfi2.priority) {
+        return (pfi1.fi.flowId < pfi2.fi.flowId);
+    }
+    return (pfi1.priority < pfi2.priority);
+}
+
+// Comparison function for finding the first of a queue's priorityFlows with at least a given priority.
+static bool priorityFlowLess(const PriorityFlowIndex& pfi, unsigned int priority)
+{
+    return (pfi.priority < priority);
+}
+
 NC::NC()
     : _nextFlowId(InvalidFlowId + 1),
       _nextClientId(InvalidClientId + 1),
-      _nextQueueId(InvalidQueueId + 1)
+      _nextQueueId(InvalidQueueId + 1),
+      _version(1)
 {
 }
 
 NC::~NC()
 {
     // Delete flows
-    for (map<FlowId, Flow*>::const_iterator it = flowsBegin(); it != flowsEnd(); it++) {
+    for (FlowIterator it = flowsBegin(); it != flowsEnd(); it++) {
         delete it->second;
     }
     // Delete clients
-    for (map<ClientId, Client*>::const_iterator it = clientsBegin(); it != clientsEnd(); it++) {
+    for (ClientIterator it = clientsBegin(); it != clientsEnd(); it++) {
         delete it->second;
     }
     // Delete queues
-    for (map<QueueId, Queue*>::const_iterator it = queuesBegin(); it != queuesEnd(); it++) {
+    for (QueueIterator it = queuesBegin(); it != queuesEnd(); it++) {
         delete it->second;
     }
 }
@@ -53,13 +71,15 @@ FlowId NC::initFlow(Flow* f, const Json::Value& flowInfo, ClientId clientId)
     }
     FlowId flowId = _nextFlowId++;
     f->flowId = flowId;
-    _flows[flowId] = f;
+    modified();
+    _flows.insert(flowId, f);
     f->name = flowInfo["name"].asString();
     _flowIds[f->name] = flowId;
     f->clientId = clientId;
     // Add flow to client flows list
-    Client* c = _clients[clientId];
+    Client* c = _clients.find(clientId);
     c->flowIds.push_back(flowId);
+    f->priority = flowInfo.isMember("priority") ? flowInfo["priority"].asUInt() : 1;
     const Json::Value& flowQueues = flowInfo["queues"];
     f->queueIds.resize(flowQueues.size());
     for (unsigned int index = 0; index < flowQueues.size(); index++) {
@@ -69,9 +89,11 @@ FlowId NC::initFlow(Flow* f, const Json::Value& flowInfo, ClientId clientId)
         FlowIndex fi;
         fi.flowId = flowId;
         fi.index = index;
-        _queues[queueId]->flows.push_back(fi);
+        Queue* q = _queues.find(queueId);
+        q->flows.push_back(fi);
+        insertPriorityFlow(q, f, index);
+        q->version++;
     }
-    f->priority = flowInfo.isMember("priority") ? flowInfo["priority"].asUInt() : 1;
     f->latency = 0;
     f->ignoreLatency = c->ignoreLatency;
     return flowId;
@@ -84,7 +106,8 @@ ClientId NC::initClient(Client* c, const Json::Value& clientInfo)
     }
     ClientId clientId = _nextClientId++;
     c->clientId = clientId;
-    _clients[clientId] = c;
+    modified();
+    _clients.insert(clientId, c);
     c->name = clientInfo["name"].asString();
     _clientIds[c->name] = clientId;
     c->SLO = clientInfo["SLO"].asDouble();
@@ -103,10 +126,12 @@ QueueId NC::initQueue(Queue* q, const Json::Value& queueInfo)
     }
     QueueId queueId = _nextQueueId++;
     q->queueId = queueId;
-    _queues[queueId] = q;
+    modified();
+    _queues.insert(queueId, q);
     q->name = queueInfo["name"].asString();
     _queueIds[q->name] = queueId;
     q->bandwidth = queueInfo["bandwidth"].asDouble();
+    q->version = 1;
     return queueId;
 }
 
@@ -129,20 +154,23 @@ QueueId NC::addQueue(const Json::Value& queueInfo)
 
 void NC::delClient(ClientId clientId)
 {
-    Client* c = _clients[clientId];
+    Client* c = _clients.find(clientId);
+    modified();
     // Delete client's flows
     for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
         FlowId flowId = c->flowIds[flowIndex];
-        Flow* f = _flows[flowId];
+        Flow* f = _flows.find(flowId);
         // Delete flow from queues
         for (unsigned int index = 0; index < f->queueIds.size(); index++) {
-            Queue* q = _queues[f->queueIds[index]];
+            Queue* q = _queues.find(f->queueIds[index]);
+            q->version++;
             for (vector<FlowIndex>::iterator it = q->flows.begin(); it != q->flows.end(); it++) {
                 if (it->flowId == flowId) {
                     q->flows.erase(it);
                     break;
                 }
             }
+            erasePriorityFlow(q, f);
         }
         _flowIds.erase(f->name);
         _flows.erase(flowId);
@@ -154,10 +182,27 @@ void NC::delClient(ClientId clientId)
     delete c;
 }
 
+bool NC::tryAddClients(const Json::Value& clientInfos, AdmissionCheck check, void* arg)
+{
+    // Add clients
+    set<ClientId> clientIds;
+    for (unsigned int i = 0; i < clientInfos.size(); i++) {
+        clientIds.insert(addClient(clientInfos[i]));
+    }
+    // Check admission
+    bool admitted = check(this, clientIds, arg);
+    // Delete clients
+    for (set<ClientId>::const_iterator it = clientIds.begin(); it != clientIds.end(); it++) {
+        delClient(*it);
+    }
+    return admitted;
+}
+
 void NC::delQueue(QueueId queueId)
 {
-    Queue* q = _queues[queueId];
+    Queue* q = _queues.find(queueId);
     assert(q->flows.empty());
+    modified();
     _queueIds.erase(q->name);
     _queues.erase(queueId);
     delete q;
@@ -165,14 +210,99 @@ void NC::delQueue(QueueId queueId)
 
 void NC::setFlowPriority(FlowId flowId, unsigned int priority)
 {
-    Flow* f = _flows[flowId];
-    f->priority = priority;
+    Flow* f = _flows.find(flowId);
+    if (f->priority != priority) {
+        // Move flow within its queues' priorityFlows
+        for (unsigned int index = 0; index < f->queueIds.size(); index++) {
+            erasePriorityFlow(_queues.find(f->queueIds[index]), f);
+        }
+        f->priority = priority;
+        for (unsigned int index = 0; index < f->queueIds.size(); index++) {
+            insertPriorityFlow(_queues.find(f->queueIds[index]), f, index);
+        }
+    }
+    modifiedFlow(f);
+}
+
+void NC::insertPriorityFlow(Queue* q, const Flow* f, unsigned int index)
+{
+    PriorityFlowIndex pfi;
+    pfi.priority = f->priority;
+    pfi.fi.flowId = f->flowId;
+    pfi.fi.index = index;
+    q->priorityFlows.insert(upper_bound(q->priorityFlows.begin(), q->priorityFlows.end(), pfi, priorityFlowCompare), pfi);
+}
+
+void NC::erasePriorityFlow(Queue* q, const Flow* f)
+{
+    PriorityFlowIndex pfi;
+    pfi.priority = f->priority;
+    pfi.fi.flowId = f->flowId;
+    pfi.fi.index = 0;
+    vector<PriorityFlowIndex>::iterator it = lower_bound(q->priorityFlows.begin(), q->priorityFlows.end(), pfi, priorityFlowCompare);
+    assert((it != q->priorityFlows.end()) && (it->fi.flowId == f->flowId));
+    q->priorityFlows.erase(it);
+}
+
+void NC::getAffectedClients(const set<ClientId>& clientIds, set<ClientId>& affectedClientIds) const
+{
+    // Traversal state indexed by id
+    vector<unsigned int> flowStart((_flows.empty() ? 0 : (_flows.end() - 1)->first) + 1); // index of first queue visited in flow's queueIds; size if unvisited
+    vector<unsigned int> queueStart((_queues.empty() ? 0 : (_queues.end() - 1)->first) + 1); // index of first visited entry in queue's priorityFlows; size if unvisited
+    for (FlowIterator it = flowsBegin(); it != flowsEnd(); it++) {
+        flowStart[it->first] = it->second->queueIds.size();
+    }
+    for (QueueIterator it = queuesBegin(); it != queuesEnd(); it++) {
+        queueStart[it->first] = it->second->priorityFlows.size();
+    }
+    // Start from the first queue of the clients' flows
+    vector<FlowIndex> pending;
+    for (set<ClientId>::const_iterator it = clientIds.begin(); it != clientIds.end(); it++) {
+        const Client* c = getClient(*it);
+        affectedClientIds.insert(*it);
+        for (vector<FlowId>::const_iterator itF = c->flowIds.begin(); itF != c->flowIds.end(); itF++) {
+            FlowIndex fi;
+            fi.flowId = *itF;
+            fi.index = 0;
+            pending.push_back(fi);
+        }
+    }
+    while (!pending.empty()) {
+        FlowIndex fi = pending.back();
+        pending.pop_back();
+        // Visit the flow's queues from fi.index that have not been visited yet
+        unsigned int end = flowStart[fi.flowId];
+        if (fi.index >= end) {
+            continue;
+        }
+        flowStart[fi.flowId] = fi.index;
+        const Flow* f = getFlow(fi.flowId);
+        affectedClientIds.insert(f->clientId);
+        for (unsigned int index = fi.index; index < end; index++) {
+            // Flows with equal or lower priority at the queue are affected; skip the entries that have already been visited
+            QueueId queueId = f->queueIds[index];
+            const vector<PriorityFlowIndex>& priorityFlows = getQueue(queueId)->priorityFlows;
+            unsigned int start = lower_bound(priorityFlows.begin(), priorityFlows.end(), f->priority, priorityFlowLess) - priorityFlows.begin();
+            for (unsigned int i = start; i < queueStart[queueId]; i++) {
+                pending.push_back(priorityFlows[i].fi);
+            }
+            queueStart[queueId] = min(start, queueStart[queueId]);
+        }
+    }
+}
+
+void NC::modifiedFlow(const Flow* f)
+{
+    modified();
+    for (unsigned int index = 0; index < f->queueIds.size(); index++) {
+        _queues.find(f->queueIds[index])->version++;
+    }
 }
 
 void NC::calcAllLatency()
 {
     // Loop through clients and calculate latency
-    for (map<ClientId, Client*>::const_iterator it = clientsBegin(); it != clientsEnd(); it++) {
+    for (ClientIterator it = clientsBegin(); it != clientsEnd(); it++) {
         calcClientLatency(it->first);
     }
 }
@@ -180,7 +310,7 @@ void NC::calcAllLatency()
 double NC::calcClientLatency(ClientId clientId)
 {
     // Loop through client's flows and calculate latency
-    Client* c = _clients[clientId];
+    Client* c = _clients.find(clientId);
     c->latency = 0;
     for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
         c->latency += calcFlowLatency(c->flowIds[flowIndex]);
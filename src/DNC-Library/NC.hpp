@@ -31,7 +31,10 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
+#include <stdint.h>
 #include <json/json.h>
+#include "SlotMap.hpp"
 
 using namespace std;
 
@@ -79,6 +82,12 @@ struct FlowIndex {
     unsigned int index; // Index within flow's queueIds vector
 };
 
+// Flow that uses a queue, along with its priority (see Queue::priorityFlows).
+struct PriorityFlowIndex {
+    unsigned int priority; // Priority of flow
+    FlowIndex fi; // Flow and index of queue within flow's queueIds vector
+};
+
 // Base structure for representing a queue.
 // A queue is used to represent congestion points within the system.
 // For a network, this often occurs at the end-host network links, especially in full-bisection bandwidth networks.
@@ -88,13 +97,27 @@ struct Queue {
     QueueId queueId; // Id of queue
     string name; // Name of queue
     vector<FlowIndex> flows; // Unordered list of flows that use queue
+    vector<PriorityFlowIndex> priorityFlows; // Flows that use queue sorted by priority, then flow id; used for finding affected clients (see NC::getAffectedClients)
     double bandwidth; // Bandwidth of queue, in "work" units (see Estimator.hpp)
+    uint64_t version; // Incremented whenever the queue's flows or their parameters change
 };
 
+// Iterators over the flows, clients, and queues of NC, in increasing order of id.
+// it->first is the id and it->second is the flow/client/queue.
+typedef SlotMap<FlowId, Flow>::const_iterator FlowIterator;
+typedef SlotMap<ClientId, Client>::const_iterator ClientIterator;
+typedef SlotMap<QueueId, Queue>::const_iterator QueueIterator;
+
 // Comparison function for sorting flows by priority.
 // Returns true if f1 is higher priority than f2.
 bool priorityCompare(const Flow* f1, const Flow* f2);
 
+class NC;
+
+// Function for checking whether a set of speculatively added clients should be admitted (see NC::tryAddClients).
+// arg is passed through from tryAddClients.
+typedef bool (*AdmissionCheck)(NC* nc, const set<ClientId>& clientIds, void* arg);
+
 // Base class for representing a network calculus analysis toolkit.
 class NC
 {
@@ -102,14 +125,23 @@ private:
     map<string, FlowId> _flowIds; // map flow name -> flow id
     map<string, ClientId> _clientIds; // map client name -> client id
     map<string, QueueId> _queueIds; // map queue name -> queue id
-    map<FlowId, Flow*> _flows; // map flow id -> flow data
-    map<ClientId, Client*> _clients; // map client id -> client data
-    map<QueueId, Queue*> _queues; // map queue id -> queue data
+    SlotMap<FlowId, Flow> _flows; // map flow id -> flow data
+    SlotMap<ClientId, Client> _clients; // map client id -> client data
+    SlotMap<QueueId, Queue> _queues; // map queue id -> queue data
     FlowId _nextFlowId; // next flow id to use for new flow
     ClientId _nextClientId; // next client id to use for new client
     QueueId _nextQueueId; // next queue id to use for new queue
+    uint64_t _version; // incremented whenever flows, clients, queues, or flow parameters change
+
+    // Add/remove a flow to/from a queue's priorityFlows.
+    static void insertPriorityFlow(Queue* q, const Flow* f, unsigned int index);
+    static void erasePriorityFlow(Queue* q, const Flow* f);
 
 protected:
+    // Mark the system as modified so that derived classes can invalidate cached analysis results.
+    void modified() { _version++; }
+    // Mark a flow's parameters (e.g., priority) as modified, which also modifies the queues it visits.
+    void modifiedFlow(const Flow* f);
     // Initialize a flow. Overridden by derived classes with extra flow information/initialization.
     // If f is NULL, f will be created. See file header for flowInfo description.
     virtual FlowId initFlow(Flow* f, const Json::Value& flowInfo, ClientId clientId);
@@ -135,10 +167,20 @@ public:
     virtual void delClient(ClientId clientId);
     // Delete a queue from system.
     virtual void delQueue(QueueId queueId);
+    // Speculatively add a list of clients (see file header for clientInfo description) and evaluate check on them.
+    // The clients are deleted before returning, and derived classes may restore any analysis state the clients affected.
+    // Returns the result of check.
+    virtual bool tryAddClients(const Json::Value& clientInfos, AdmissionCheck check, void* arg);
 
     // Set the priority for a flow.
     void setFlowPriority(FlowId flowId, unsigned int priority);
 
+    // Get the clients affected by a set of clients, including the clients themselves.
+    // A flow affects the flows of equal or lower priority (i.e., >= priority) that share a queue with it at or after the queue where it is affected,
+    // and affected flows in turn affect other flows downstream. Each queue's flows are kept sorted by priority (see Queue::priorityFlows),
+    // so the affected flows are found in a single traversal that visits each flow's queue entries at most once.
+    void getAffectedClients(const set<ClientId>& clientIds, set<ClientId>& affectedClientIds) const;
+
     // Calculate the latency for all clients/flows in the system.
     // Assumes priorities are set.
     virtual void calcAllLatency();
@@ -150,26 +192,20 @@ public:
     virtual double calcFlowLatency(FlowId flowId) = 0;
 
     // Read-only accessors
-    map<FlowId, Flow*>::const_iterator flowsBegin() const { return _flows.begin(); }
-    map<FlowId, Flow*>::const_iterator flowsEnd() const { return _flows.end(); }
-    const Flow* getFlow(FlowId flowId) const {
-        map<FlowId, Flow*>::const_iterator it = _flows.find(flowId);
-        return (it != _flows.end()) ? it->second : NULL;
-    }
+    // Version of the system; changes whenever flows, clients, queues, or flow parameters change.
+    uint64_t getVersion() const { return _version; }
 
-    map<ClientId, Client*>::const_iterator clientsBegin() const { return _clients.begin(); }
-    map<ClientId, Client*>::const_iterator clientsEnd() const { return _clients.end(); }
-    const Client* getClient(ClientId clientId) const {
-        map<ClientId, Client*>::const_iterator it = _clients.find(clientId);
-        return (it != _clients.end()) ? it->second : NULL;
-    }
+    FlowIterator flowsBegin() const { return _flows.begin(); }
+    FlowIterator flowsEnd() const { return _flows.end(); }
+    const Flow* getFlow(FlowId flowId) const { return _flows.find(flowId); }
 
-    map<QueueId, Queue*>::const_iterator queuesBegin() const { return _queues.begin(); }
-    map<QueueId, Queue*>::const_iterator queuesEnd() const { return _queues.end(); }
-    const Queue* getQueue(QueueId queueId) const {
-        map<QueueId, Queue*>::const_iterator it = _queues.find(queueId);
-        return (it != _queues.end()) ? it->second : NULL;
-    }
+    ClientIterator clientsBegin() const { return _clients.begin(); }
+    ClientIterator clientsEnd() const { return _clients.end(); }
+    const Client* getClient(ClientId clientId) const { return _clients.find(clientId); }
+
+    QueueIterator queuesBegin() const { return _queues.begin(); }
+    QueueIterator queuesEnd() const { return _queues.end(); }
+    const Queue* getQueue(QueueId queueId) const { return _queues.find(queueId); }
 
     FlowId getFlowIdByName(string name) const {
         map<string, FlowId>::const_iterator it = _flowIds.find(name);
@@ -12,8 +12,10 @@
 #include <set>
 #include <json/json.h>
 #include "../DNC-Library/DNC.hpp"
+#include "../DNC-Library/ArrivalCurveCache.hpp"
 #include "../DNC-Library/WorkloadCompactor.hpp"
 #include "../common/common.hpp"
+#include "../common/metrics.hpp"
 #include "NCConfig.hpp"
 
 const double NETWORK_BANDWIDTH = 125000000; // bytes/sec
@@ -63,23 +65,88 @@ string getAddr(string prefix, string host, string VM)
 }
 
 // Return the arrival curve file
-string getArrivalCurveFilename(string trace, string estimatorType)
+// The name includes a hash of the trace contents, estimator parameters, and max rate so that cached arrival curves never go stale.
+string getArrivalCurveFilename(string trace, const Json::Value& estimatorInfo, double maxRate)
 {
     ostringstream oss;
-    oss << "arrivalCurves/arrivalCurve" << trace.substr(trace.find_last_of("/\\") + 1) << estimatorType << ".txt";
+    oss << "arrivalCurves/arrivalCurve" << trace.substr(trace.find_last_of("/\\") + 1) << estimatorInfo["type"].asString() << "-" << getArrivalCurveHash(trace, estimatorInfo, maxRate) << ".txt";
     return oss.str();
 }
 
 // Set the arrivalInfo in a flow
 void setArrivalInfo(Json::Value& flowInfo, string trace, const Json::Value& estimatorInfo, double maxRate)
 {
-    string arrivalCurveFilename = getArrivalCurveFilename(trace, estimatorInfo["type"].asString());
+    string arrivalCurveFilename = getArrivalCurveFilename(trace, estimatorInfo, maxRate);
     DNC::setArrivalInfo(flowInfo, trace, estimatorInfo, maxRate, arrivalCurveFilename);
 }
 
+// Add a request to set the arrivalInfo in a flow with setArrivalInfos
+static void addArrivalInfoRequest(vector<ArrivalInfoRequest>& requests, Json::Value& flowInfo, string trace, const Json::Value& estimatorInfo, double maxRate)
+{
+    ArrivalInfoRequest request;
+    request.flowInfo = &flowInfo;
+    request.estimatorInfo = estimatorInfo;
+    request.maxRate = maxRate;
+    request.arrivalCurveFilename = getArrivalCurveFilename(trace, estimatorInfo, maxRate);
+    requests.push_back(request);
+}
+
+// Return the estimator info for network flows
+static Json::Value getNetworkEstimatorInfo(string estimatorType)
+{
+    Json::Value estimatorInfo;
+    estimatorInfo["type"] = Json::Value(estimatorType);
+    estimatorInfo["nonDataConstant"] = Json::Value(200.0);
+    estimatorInfo["nonDataFactor"] = Json::Value(0.025);
+    estimatorInfo["dataConstant"] = Json::Value(200.0);
+    estimatorInfo["dataFactor"] = Json::Value(1.1);
+    return estimatorInfo;
+}
+
+// Return the estimator info for storage flows
+static Json::Value getStorageEstimatorInfo(const Json::Value& profileCfg)
+{
+    Json::Value estimatorInfo;
+    estimatorInfo["type"] = Json::Value("storageSSD");
+    estimatorInfo["bandwidthTable"] = profileCfg["bandwidthTable"];
+    return estimatorInfo;
+}
+
+// Calculate and cache the arrival curves for all flows of a client with the given trace
+unsigned int precomputeArrivalCurves(string trace, unsigned int numThreads)
+{
+    vector<Json::Value> estimatorInfos;
+    vector<double> maxRates;
+    estimatorInfos.push_back(getNetworkEstimatorInfo("networkIn"));
+    maxRates.push_back(NETWORK_BANDWIDTH);
+    estimatorInfos.push_back(getNetworkEstimatorInfo("networkOut"));
+    maxRates.push_back(NETWORK_BANDWIDTH);
+    Json::Value profileCfg;
+    if (readJson(profileFilename, profileCfg)) {
+        estimatorInfos.push_back(getStorageEstimatorInfo(profileCfg));
+        maxRates.push_back(STORAGE_BANDWIDTH);
+    }
+    // Request arrival curves that are not already cached
+    vector<Json::Value> flowInfos(estimatorInfos.size());
+    vector<ArrivalInfoRequest> arrivalInfoRequests;
+    for (unsigned int i = 0; i < estimatorInfos.size(); i++) {
+        Curve arrivalCurve;
+        if (!ArrivalCurveCache::get(getArrivalCurveFilename(trace, estimatorInfos[i], maxRates[i]), arrivalCurve)) {
+            addArrivalInfoRequest(arrivalInfoRequests, flowInfos[i], trace, estimatorInfos[i], maxRates[i]);
+        }
+    }
+    if (!arrivalInfoRequests.empty()) {
+        DNC::setArrivalInfos(arrivalInfoRequests, trace, ARRIVAL_CURVE_ALGORITHM_RATE_SAMPLED, numThreads);
+    }
+    return arrivalInfoRequests.size();
+}
+
+static MetricHistogram configGenTime("config_gen_client_seconds", "Time spent generating client configs, including their arrival curves");
+
 // Generate config for a client
 void configGenClient(Json::Value& clientInfo, string clientName, string prefix, bool enforce)
 {
+    ScopedTimer timer(configGenTime);
     clientInfo["name"] = Json::Value(clientName);
     string clientHost = clientInfo["clientHost"].asString();
     string clientVM = clientInfo["clientVM"].asString();
@@ -97,6 +164,9 @@ void configGenClient(Json::Value& clientInfo, string clientName, string prefix,
     bool storageOnly = (clientInfo.isMember("storageOnly") && clientInfo["storageOnly"].asBool());
     Json::Value& clientFlows = clientInfo["flows"];
     clientFlows = Json::arrayValue;
+    // Arrival curves of all flows are generated together since they share the same trace
+    string trace = clientInfo["trace"].asString();
+    vector<ArrivalInfoRequest> arrivalInfoRequests;
     if (!storageOnly) {
         // Setup flow from client to server
         Json::Value& flowInInfo = clientFlows[clientFlows.size()];
@@ -112,13 +182,7 @@ void configGenClient(Json::Value& clientInfo, string clientName, string prefix,
         flowInQueues.resize(2);
         flowInQueues[0] = Json::Value(getQueueOutName(clientHost));
         flowInQueues[1] = Json::Value(getQueueInName(serverHost));
-        Json::Value networkInEstimatorInfo;
-        networkInEstimatorInfo["type"] = Json::Value("networkIn");
-        networkInEstimatorInfo["nonDataConstant"] = Json::Value(200.0);
-        networkInEstimatorInfo["nonDataFactor"] = Json::Value(0.025);
-        networkInEstimatorInfo["dataConstant"] = Json::Value(200.0);
-        networkInEstimatorInfo["dataFactor"] = Json::Value(1.1);
-        setArrivalInfo(flowInInfo, clientInfo["trace"].asString(), networkInEstimatorInfo, NETWORK_BANDWIDTH);
+        addArrivalInfoRequest(arrivalInfoRequests, flowInInfo, trace, getNetworkEstimatorInfo("networkIn"), NETWORK_BANDWIDTH);
     }
     if (!networkOnly) {
         // Setup storage flow at server
@@ -135,12 +199,10 @@ void configGenClient(Json::Value& clientInfo, string clientName, string prefix,
         flowStorageQueues[0] = Json::Value(getServerName(serverHost, serverVM));
         Json::Value profileCfg;
         if (!readJson(profileFilename, profileCfg)) {
+            DNC::setArrivalInfos(arrivalInfoRequests, trace);
             return;
         }
-        Json::Value storageEstimatorInfo;
-        storageEstimatorInfo["type"] = Json::Value("storageSSD");
-        storageEstimatorInfo["bandwidthTable"] = profileCfg["bandwidthTable"];
-        setArrivalInfo(flowStorageInfo, clientInfo["trace"].asString(), storageEstimatorInfo, STORAGE_BANDWIDTH);
+        addArrivalInfoRequest(arrivalInfoRequests, flowStorageInfo, trace, getStorageEstimatorInfo(profileCfg), STORAGE_BANDWIDTH);
     }
     if (!storageOnly) {
         // Setup flow from server to client
@@ -157,13 +219,79 @@ void configGenClient(Json::Value& clientInfo, string clientName, string prefix,
         flowOutQueues.resize(2);
         flowOutQueues[0] = Json::Value(getQueueOutName(serverHost));
         flowOutQueues[1] = Json::Value(getQueueInName(clientHost));
-        Json::Value networkOutEstimatorInfo;
-        networkOutEstimatorInfo["type"] = Json::Value("networkOut");
-        networkOutEstimatorInfo["nonDataConstant"] = Json::Value(200.0);
-        networkOutEstimatorInfo["nonDataFactor"] = Json::Value(0.025);
-        networkOutEstimatorInfo["dataConstant"] = Json::Value(200.0);
-        networkOutEstimatorInfo["dataFactor"] = Json::Value(1.1);
-        setArrivalInfo(flowOutInfo, clientInfo["trace"].asString(), networkOutEstimatorInfo, NETWORK_BANDWIDTH);
+        addArrivalInfoRequest(arrivalInfoRequests, flowOutInfo, trace, getNetworkEstimatorInfo("networkOut"), NETWORK_BANDWIDTH);
+    }
+    DNC::setArrivalInfos(arrivalInfoRequests, trace);
+}
+
+// Placeholder hosts of configGenClientTemplate
+#define CONFIG_TEMPLATE_HOST "host"
+#define CONFIG_TEMPLATE_VM "VM"
+
+// Return the index of the flow with the given name in a client config, or -1 if the client does not have the flow
+static int getFlowIndex(const Json::Value& clientInfo, string flowName)
+{
+    const Json::Value& clientFlows = clientInfo["flows"];
+    for (unsigned int flowIndex = 0; flowIndex < clientFlows.size(); flowIndex++) {
+        if (clientFlows[flowIndex]["name"].asString() == flowName) {
+            return flowIndex;
+        }
+    }
+    return -1;
+}
+
+// Generate config for a client that is placed at several candidate placements with configGenClientPlacement
+void configGenClientTemplate(Json::Value& clientInfo, string clientName, string prefix, bool enforce, ClientConfigTemplate& config)
+{
+    clientInfo["clientHost"] = Json::Value(CONFIG_TEMPLATE_HOST);
+    clientInfo["clientVM"] = Json::Value(CONFIG_TEMPLATE_VM);
+    clientInfo["serverHost"] = Json::Value(CONFIG_TEMPLATE_HOST);
+    clientInfo["serverVM"] = Json::Value(CONFIG_TEMPLATE_VM);
+    configGenClient(clientInfo, clientName, prefix, enforce);
+    config.prefix = prefix;
+    config.enforce = enforce;
+    config.flowInIndex = getFlowIndex(clientInfo, getFlowNetworkInName(clientName));
+    config.flowStorageIndex = getFlowIndex(clientInfo, getFlowStorageName(clientName));
+    config.flowOutIndex = getFlowIndex(clientInfo, getFlowNetworkOutName(clientName));
+}
+
+// Place a config generated by configGenClientTemplate (see configGenClient for the fields that depend on the placement)
+void configGenClientPlacement(Json::Value& clientInfo, const ClientConfigTemplate& config, string clientHost, string clientVM, string serverHost, string serverVM)
+{
+    string clientAddr = getAddr(config.prefix, clientHost, clientVM);
+    string serverAddr = getAddr(config.prefix, serverHost, serverVM);
+    clientInfo["clientAddr"] = Json::Value(clientAddr);
+    clientInfo["serverAddr"] = Json::Value(serverAddr);
+    Json::Value& clientFlows = clientInfo["flows"];
+    if (config.flowInIndex >= 0) {
+        Json::Value& flowInInfo = clientFlows[config.flowInIndex];
+        if (config.enforce) {
+            flowInInfo["enforcerAddr"] = Json::Value(clientHost);
+            flowInInfo["dstAddr"] = Json::Value(serverAddr);
+            flowInInfo["srcAddr"] = Json::Value(clientAddr);
+        }
+        Json::Value& flowInQueues = flowInInfo["queues"];
+        flowInQueues[0u] = Json::Value(getQueueOutName(clientHost));
+        flowInQueues[1u] = Json::Value(getQueueInName(serverHost));
+    }
+    if (config.flowStorageIndex >= 0) {
+        Json::Value& flowStorageInfo = clientFlows[config.flowStorageIndex];
+        if (config.enforce) {
+            flowStorageInfo["enforcerAddr"] = Json::Value(serverAddr);
+            flowStorageInfo["clientAddr"] = Json::Value(clientAddr);
+        }
+        flowStorageInfo["queues"][0u] = Json::Value(getServerName(serverHost, serverVM));
+    }
+    if (config.flowOutIndex >= 0) {
+        Json::Value& flowOutInfo = clientFlows[config.flowOutIndex];
+        if (config.enforce) {
+            flowOutInfo["enforcerAddr"] = Json::Value(serverHost);
+            flowOutInfo["dstAddr"] = Json::Value(clientAddr);
+            flowOutInfo["srcAddr"] = Json::Value(serverAddr);
+        }
+        Json::Value& flowOutQueues = flowOutInfo["queues"];
+        flowOutQueues[0u] = Json::Value(getQueueOutName(serverHost));
+        flowOutQueues[1u] = Json::Value(getQueueInName(clientHost));
     }
 }
 
@@ -201,7 +329,7 @@ void setFlowParameters(Json::Value& flowInfo, NC* nc)
     // Assign rate limiters
     DNC* dnc = dynamic_cast<DNC*>(nc);
     if (dnc) {
-        setRateLimits(flowInfo, dnc->getShaperCurve(flowId));
+        setRateLimits(flowInfo, dnc->getShaperCurve(flowId), dnc->getPeakCurves(flowId));
         return;
     }
 }
@@ -226,3 +354,12 @@ void setRateLimits(Json::Value& flowInfo, const SimpleArrivalCurve& shaperCurve)
     rateLimit["rate"] = Json::Value(shaperCurve.r);
     rateLimit["burst"] = Json::Value(shaperCurve.b);
 }
+void setRateLimits(Json::Value& flowInfo, const SimpleArrivalCurve& shaperCurve, const vector<SimpleArrivalCurve>& peakCurves)
+{
+    setRateLimits(flowInfo, shaperCurve);
+    for (unsigned int i = 0; i < peakCurves.size(); i++) {
+        Json::Value& rateLimit = flowInfo["rateLimiters"][i + 1];
+        rateLimit["rate"] = Json::Value(peakCurves[i].r);
+        rateLimit["burst"] = Json::Value(peakCurves[i].b);
+    }
+}
@@ -31,11 +31,28 @@ string getServerName(string host, string VM);
 // Return the hostname of a particular VM
 string getAddr(string prefix, string host, string VM);
 // Return the arrival curve file
-string getArrivalCurveFilename(string trace, string estimatorType);
+string getArrivalCurveFilename(string trace, const Json::Value& estimatorInfo, double maxRate);
 // Set the arrivalInfo in a flow
 void setArrivalInfo(Json::Value& flowInfo, string trace, const Json::Value& estimatorInfo, double maxRate);
+// Calculate and cache the arrival curves for all flows of a client with the given trace
+// Returns the number of arrival curves that were not already cached
+unsigned int precomputeArrivalCurves(string trace, unsigned int numThreads = 0);
 // Generate config for a client
 void configGenClient(Json::Value& clientInfo, string clientName, string prefix, bool enforce);
+// Fields of a client config that depend on its placement (see configGenClientTemplate)
+struct ClientConfigTemplate {
+    string prefix;
+    bool enforce;
+    int flowInIndex; // index of the flow from client to server in the config's flows, or -1 if none
+    int flowStorageIndex; // index of the storage flow in the config's flows, or -1 if none
+    int flowOutIndex; // index of the flow from server to client in the config's flows, or -1 if none
+};
+// Generate config for a client that is placed at several candidate placements with configGenClientPlacement.
+// Flows and arrival curves are generated once for placeholder hosts, ignoring the placement in clientInfo.
+void configGenClientTemplate(Json::Value& clientInfo, string clientName, string prefix, bool enforce, ClientConfigTemplate& config);
+// Place a config generated by configGenClientTemplate, updating only the addresses, queues, and enforcers in place,
+// which gives the same config as configGenClient for the placement.
+void configGenClientPlacement(Json::Value& clientInfo, const ClientConfigTemplate& config, string clientHost, string clientVM, string serverHost, string serverVM);
 // Generate network in queue info
 void configGenNetworkInQueue(Json::Value& queueInfo, string host);
 // Generate network out queue info
@@ -48,5 +65,7 @@ void setFlowParameters(Json::Value& flowInfo, NC* nc);
 void setRateLimits(Json::Value& flowInfo, const Curve& arrivalCurve, double maxRate);
 // Set rate limit parameters in flowInfo
 void setRateLimits(Json::Value& flowInfo, const SimpleArrivalCurve& shaperCurve);
+// Set rate limit parameters in flowInfo, with the shaper curve first followed by its peak curves
+void setRateLimits(Json::Value& flowInfo, const SimpleArrivalCurve& shaperCurve, const vector<SimpleArrivalCurve>& peakCurves);
 
 #endif // _NCCONFIG_HPP
@@ -0,0 +1,115 @@
+// RbGen.hpp - Token bucket update used for generating r-b curves.
+// Shared by the trace-based r-b curve generation (see rbGen in DNC.hpp) and SlidingArrivalCurve.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _RBGEN_HPP
+#define _RBGEN_HPP
+
+#include <vector>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#define RBGEN_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Alignment and padding used by the token bucket update in rbGen.
+// Arrays are padded to the widest vector width (8 doubles for AVX-512), so any of the update paths below can be used.
+#define RBGEN_VECTOR_WIDTH 8
+#define RBGEN_ALIGNMENT 64
+
+// Return a pointer to n doubles within buffer that is aligned to RBGEN_ALIGNMENT bytes.
+// The values are initialized to 0.
+inline double* rbGenAlignedArray(vector<double>& buffer, unsigned int n)
+{
+    buffer.assign(n + RBGEN_ALIGNMENT / sizeof(double), 0);
+    uintptr_t addr = reinterpret_cast<uintptr_t>(&buffer[0]);
+    addr = (addr + RBGEN_ALIGNMENT - 1) & ~static_cast<uintptr_t>(RBGEN_ALIGNMENT - 1);
+    return reinterpret_cast<double*>(addr);
+}
+
+// Token bucket update without vector instructions
+inline void rbGenUpdateScalar(const double* rates, double* buckets, double* bursts, unsigned int n, double interarrival, double work)
+{
+    for (unsigned int i = 0; i < n; i++) {
+        // Drain token bucket for time since last request
+        double bucket = buckets[i] - rates[i] * interarrival;
+        if (bucket < 0) {
+            bucket = 0;
+        }
+        // Add tokens for current request
+        bucket += work;
+        buckets[i] = bucket;
+        // Record max burst
+        if (bucket > bursts[i]) {
+            bursts[i] = bucket;
+        }
+    }
+}
+
+#ifdef RBGEN_X86
+// Token bucket update of 8 rates at a time; only called if the CPU supports AVX-512
+// The maxes are masks and blends, since GCC 12's _mm512_max_pd trips -Wmaybe-uninitialized
+__attribute__((target("avx512f"))) inline void rbGenUpdateAVX512(const double* rates, double* buckets, double* bursts, unsigned int n, double interarrival, double work)
+{
+    const __m512d vInterarrival = _mm512_set1_pd(interarrival);
+    const __m512d vWork = _mm512_set1_pd(work);
+    const __m512d vZero = _mm512_setzero_pd();
+    for (unsigned int i = 0; i < n; i += 8) {
+        __m512d bucket = _mm512_load_pd(buckets + i);
+        bucket = _mm512_sub_pd(bucket, _mm512_mul_pd(_mm512_load_pd(rates + i), vInterarrival));
+        bucket = _mm512_maskz_mov_pd(_mm512_cmp_pd_mask(bucket, vZero, _CMP_GT_OQ), bucket);
+        bucket = _mm512_add_pd(bucket, vWork);
+        _mm512_store_pd(buckets + i, bucket);
+        __m512d burst = _mm512_load_pd(bursts + i);
+        _mm512_store_pd(bursts + i, _mm512_mask_blend_pd(_mm512_cmp_pd_mask(bucket, burst, _CMP_GT_OQ), burst, bucket));
+    }
+}
+
+// Token bucket update of 4 rates at a time; only called if the CPU supports AVX
+__attribute__((target("avx"))) inline void rbGenUpdateAVX(const double* rates, double* buckets, double* bursts, unsigned int n, double interarrival, double work)
+{
+    const __m256d vInterarrival = _mm256_set1_pd(interarrival);
+    const __m256d vWork = _mm256_set1_pd(work);
+    const __m256d vZero = _mm256_setzero_pd();
+    for (unsigned int i = 0; i < n; i += 4) {
+        __m256d bucket = _mm256_load_pd(buckets + i);
+        bucket = _mm256_sub_pd(bucket, _mm256_mul_pd(_mm256_load_pd(rates + i), vInterarrival));
+        bucket = _mm256_add_pd(_mm256_max_pd(bucket, vZero), vWork);
+        _mm256_store_pd(buckets + i, bucket);
+        _mm256_store_pd(bursts + i, _mm256_max_pd(_mm256_load_pd(bursts + i), bucket));
+    }
+}
+#endif
+
+typedef void (*RbGenUpdateFunc)(const double* rates, double* buckets, double* bursts, unsigned int n, double interarrival, double work);
+
+// Return the token bucket update for the widest vector instructions supported by the CPU
+inline RbGenUpdateFunc rbGenSelectUpdate()
+{
+#ifdef RBGEN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return rbGenUpdateAVX512;
+    }
+    if (__builtin_cpu_supports("avx")) {
+        return rbGenUpdateAVX;
+    }
+#endif
+    return rbGenUpdateScalar;
+}
+
+// Update the token buckets of all rates for a request of a given work arriving interarrival seconds after the previous request.
+// n must be a multiple of RBGEN_VECTOR_WIDTH and the arrays must be aligned to RBGEN_ALIGNMENT bytes.
+// The update is chosen once at runtime based on the CPU (see rbGenSelectUpdate).
+inline void rbGenUpdate(const double* rates, double* buckets, double* bursts, unsigned int n, double interarrival, double work)
+{
+    static const RbGenUpdateFunc update = rbGenSelectUpdate();
+    update(rates, buckets, bursts, n, interarrival, work);
+}
+
+#endif // _RBGEN_HPP
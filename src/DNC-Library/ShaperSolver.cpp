@@ -0,0 +1,493 @@
+// ShaperSolver.cpp - Code for the dedicated solver of WorkloadCompactor's rate limit parameter LP.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include "ShaperSolver.hpp"
+
+using namespace std;
+
+// Tolerances for the simplex method
+#define SIMPLEX_PIVOT_TOLERANCE 1e-9 // minimum magnitude of a pivot element
+#define SIMPLEX_COST_TOLERANCE 1e-9 // minimum improvement of the reduced cost of an entering column
+#define SIMPLEX_FEASIBILITY_TOLERANCE 1e-7 // maximum sum of artificial variables of a feasible solution
+// Number of consecutive degenerate pivots before switching to Bland's rule to prevent cycling
+#define SIMPLEX_BLAND_THRESHOLD 50
+
+// Sparse column of the LP's constraint matrix as (row, coefficient) pairs.
+typedef vector<pair<unsigned int, double> > SparseColumn;
+
+enum SimplexStatus {
+    SIMPLEX_OPTIMAL,
+    SIMPLEX_UNBOUNDED,
+    SIMPLEX_FAILED
+};
+
+// Dense revised simplex method for min c^T x s.t. A x = rhs, 0 <= x <= upper.
+// Nonbasic columns are at either bound, so each segment's 0 <= x <= 1 bound does not need a row.
+// The basis inverse is stored densely and updated after each pivot, which is efficient for LPs with few rows.
+class BoundedSimplex
+{
+private:
+    unsigned int _m; // number of rows
+    const vector<SparseColumn>& _columns;
+    const vector<double>& _rhs;
+    vector<double> _upper; // upper bound of each column
+    vector<unsigned int> _basis; // basic column of each row
+    vector<bool> _isBasic; // whether each column is basic
+    vector<bool> _atUpper; // whether each nonbasic column is at its upper bound
+    vector<double> _Binv; // basis inverse in row-major order
+    vector<double> _xB; // values of the basic columns
+    unsigned int _pivotsSinceRefactor;
+
+    // Multiply the basis inverse with a column.
+    void multiplyColumn(const SparseColumn& column, vector<double>& w) const
+    {
+        fill(w.begin(), w.end(), 0.0);
+        for (SparseColumn::const_iterator it = column.begin(); it != column.end(); it++) {
+            for (unsigned int i = 0; i < _m; i++) {
+                w[i] += _Binv[i * _m + it->first] * it->second;
+            }
+        }
+    }
+
+    // Compute the basic values from the nonbasic columns at their upper bounds.
+    void computeBasicValues()
+    {
+        vector<double> residual(_rhs);
+        for (unsigned int j = 0; j < _columns.size(); j++) {
+            if (!_isBasic[j] && _atUpper[j]) {
+                for (SparseColumn::const_iterator it = _columns[j].begin(); it != _columns[j].end(); it++) {
+                    residual[it->first] -= it->second * _upper[j];
+                }
+            }
+        }
+        for (unsigned int i = 0; i < _m; i++) {
+            double x = 0;
+            for (unsigned int k = 0; k < _m; k++) {
+                x += _Binv[i * _m + k] * residual[k];
+            }
+            _xB[i] = min(max(x, 0.0), _upper[_basis[i]]);
+        }
+    }
+
+    // Recompute the basis inverse and basic values from the basis to avoid accumulating rounding errors.
+    bool refactor()
+    {
+        vector<double> B(_m * _m, 0.0);
+        for (unsigned int i = 0; i < _m; i++) {
+            const SparseColumn& column = _columns[_basis[i]];
+            for (SparseColumn::const_iterator it = column.begin(); it != column.end(); it++) {
+                B[it->first * _m + i] = it->second;
+            }
+        }
+        // Gauss-Jordan elimination with partial pivoting
+        vector<double> Binv(_m * _m, 0.0);
+        for (unsigned int i = 0; i < _m; i++) {
+            Binv[i * _m + i] = 1;
+        }
+        for (unsigned int col = 0; col < _m; col++) {
+            unsigned int pivotRow = col;
+            for (unsigned int row = col + 1; row < _m; row++) {
+                if (fabs(B[row * _m + col]) > fabs(B[pivotRow * _m + col])) {
+                    pivotRow = row;
+                }
+            }
+            if (fabs(B[pivotRow * _m + col]) < SIMPLEX_PIVOT_TOLERANCE) {
+                return false;
+            }
+            if (pivotRow != col) {
+                swap_ranges(B.begin() + pivotRow * _m, B.begin() + (pivotRow + 1) * _m, B.begin() + col * _m);
+                swap_ranges(Binv.begin() + pivotRow * _m, Binv.begin() + (pivotRow + 1) * _m, Binv.begin() + col * _m);
+            }
+            double scale = 1.0 / B[col * _m + col];
+            for (unsigned int k = 0; k < _m; k++) {
+                B[col * _m + k] *= scale;
+                Binv[col * _m + k] *= scale;
+            }
+            for (unsigned int row = 0; row < _m; row++) {
+                double factor = B[row * _m + col];
+                if ((row != col) && (factor != 0)) {
+                    for (unsigned int k = 0; k < _m; k++) {
+                        B[row * _m + k] -= factor * B[col * _m + k];
+                        Binv[row * _m + k] -= factor * Binv[col * _m + k];
+                    }
+                }
+            }
+        }
+        _Binv.swap(Binv);
+        computeBasicValues();
+        _pivotsSinceRefactor = 0;
+        return true;
+    }
+
+    // Pivot column entering into the basis in place of the basic column of row leaving, where w = B^-1 A_entering,
+    // and set the entering column's value.
+    void pivot(unsigned int leaving, unsigned int entering, const vector<double>& w, double value)
+    {
+        _xB[leaving] = value;
+        double scale = 1.0 / w[leaving];
+        double* pivotRow = &_Binv[leaving * _m];
+        for (unsigned int k = 0; k < _m; k++) {
+            pivotRow[k] *= scale;
+        }
+        for (unsigned int i = 0; i < _m; i++) {
+            if ((i != leaving) && (w[i] != 0)) {
+                double factor = w[i];
+                double* row = &_Binv[i * _m];
+                for (unsigned int k = 0; k < _m; k++) {
+                    row[k] -= factor * pivotRow[k];
+                }
+            }
+        }
+        _isBasic[_basis[leaving]] = false;
+        _basis[leaving] = entering;
+        _isBasic[entering] = true;
+        _pivotsSinceRefactor++;
+        if (_pivotsSinceRefactor >= max(_m, 50u)) {
+            if (!refactor()) {
+                // Keep the updated inverse if the basis is numerically singular
+                _pivotsSinceRefactor = 0;
+            }
+        }
+    }
+
+public:
+    // Start from a basis of slack and artificial columns, whose inverse is diagonal, with the given nonbasic columns at their upper bounds.
+    BoundedSimplex(const vector<SparseColumn>& columns, const vector<double>& rhs, const vector<double>& upper,
+                   const vector<unsigned int>& basis, const vector<double>& basisDiagonal, const vector<bool>& atUpper)
+        : _m(rhs.size()),
+          _columns(columns),
+          _rhs(rhs),
+          _upper(upper),
+          _basis(basis),
+          _isBasic(columns.size(), false),
+          _atUpper(atUpper),
+          _Binv(rhs.size() * rhs.size(), 0.0),
+          _xB(rhs.size(), 0.0),
+          _pivotsSinceRefactor(0)
+    {
+        for (unsigned int i = 0; i < _m; i++) {
+            _isBasic[_basis[i]] = true;
+            _Binv[i * _m + i] = 1.0 / basisDiagonal[i];
+        }
+        computeBasicValues();
+    }
+
+    void setUpper(unsigned int column, double upper) { _upper[column] = upper; }
+
+    // Run the simplex method with costs c.
+    SimplexStatus run(const vector<double>& c)
+    {
+        vector<double> y(_m);
+        vector<double> w(_m);
+        unsigned int degeneratePivots = 0;
+        unsigned int maxIterations = 50 * (_m + _columns.size()) + 1000;
+        for (unsigned int iteration = 0; iteration < maxIterations; iteration++) {
+            // Compute duals y^T = c_B^T B^-1
+            fill(y.begin(), y.end(), 0.0);
+            for (unsigned int i = 0; i < _m; i++) {
+                double cB = c[_basis[i]];
+                if (cB != 0) {
+                    for (unsigned int k = 0; k < _m; k++) {
+                        y[k] += cB * _Binv[i * _m + k];
+                    }
+                }
+            }
+            // Price columns using Dantzig's rule, or Bland's rule after many degenerate pivots
+            // Columns at their lower bound improve by increasing if d < 0, and columns at their upper bound improve by decreasing if d > 0
+            bool bland = (degeneratePivots >= SIMPLEX_BLAND_THRESHOLD);
+            unsigned int entering = _columns.size();
+            double bestImprovement = SIMPLEX_COST_TOLERANCE;
+            for (unsigned int j = 0; j < _columns.size(); j++) {
+                if (_isBasic[j] || (_upper[j] == 0)) {
+                    continue;
+                }
+                double d = c[j];
+                for (SparseColumn::const_iterator it = _columns[j].begin(); it != _columns[j].end(); it++) {
+                    d -= y[it->first] * it->second;
+                }
+                double improvement = _atUpper[j] ? d : -d;
+                if (improvement > bestImprovement) {
+                    entering = j;
+                    bestImprovement = improvement;
+                    if (bland) {
+                        break;
+                    }
+                }
+            }
+            if (entering == _columns.size()) {
+                return SIMPLEX_OPTIMAL;
+            }
+            // Ratio test, where basic value i decreases by direction * w_i per unit change of the entering column
+            double direction = _atUpper[entering] ? -1 : 1;
+            multiplyColumn(_columns[entering], w);
+            unsigned int leaving = _m;
+            bool leavingAtUpper = false;
+            double theta = _upper[entering]; // entering column moves to its other bound
+            for (unsigned int i = 0; i < _m; i++) {
+                double delta = direction * w[i];
+                double t = 0;
+                bool toUpper = false;
+                if (delta > SIMPLEX_PIVOT_TOLERANCE) {
+                    t = _xB[i] / delta;
+                } else if ((delta < -SIMPLEX_PIVOT_TOLERANCE) && (_upper[_basis[i]] < numeric_limits<double>::infinity())) {
+                    t = (_upper[_basis[i]] - _xB[i]) / -delta;
+                    toUpper = true;
+                } else {
+                    continue;
+                }
+                if ((t < theta) || ((t == theta) && bland && (leaving < _m) && (_basis[i] < _basis[leaving]))) {
+                    leaving = i;
+                    leavingAtUpper = toUpper;
+                    theta = t;
+                }
+            }
+            if (theta == numeric_limits<double>::infinity()) {
+                return SIMPLEX_UNBOUNDED;
+            }
+            degeneratePivots = (theta > 0) ? 0 : (degeneratePivots + 1);
+            // Update basic values
+            for (unsigned int i = 0; i < _m; i++) {
+                _xB[i] = min(max(_xB[i] - theta * direction * w[i], 0.0), _upper[_basis[i]]);
+            }
+            if (leaving == _m) {
+                // Entering column moves to its other bound without changing the basis
+                _atUpper[entering] = !_atUpper[entering];
+            } else {
+                unsigned int leavingColumn = _basis[leaving];
+                double value = _atUpper[entering] ? (_upper[entering] - theta) : theta;
+                pivot(leaving, entering, w, value);
+                _atUpper[leavingColumn] = leavingAtUpper;
+            }
+        }
+        return SIMPLEX_FAILED;
+    }
+
+    // Get the value of each column.
+    void getSolution(vector<double>& x) const
+    {
+        x.assign(_columns.size(), 0.0);
+        for (unsigned int j = 0; j < _columns.size(); j++) {
+            if (!_isBasic[j] && _atUpper[j]) {
+                x[j] = _upper[j];
+            }
+        }
+        for (unsigned int i = 0; i < _m; i++) {
+            x[_basis[i]] = _xB[i];
+        }
+    }
+};
+
+unsigned int ShaperSolver::addFlow(const vector<double>& r, const vector<double>& b, double rMax, double bMax)
+{
+    assert(r.size() == b.size());
+    assert(!r.empty());
+    // Clip the frontier to r <= rMax, starting where the frontier crosses r = rMax
+    vector<double> rClipped;
+    vector<double> bClipped;
+    for (unsigned int i = 0; i < r.size(); i++) {
+        if (r[i] <= rMax) {
+            if ((i > 0) && (r[i - 1] > rMax)) {
+                rClipped.push_back(rMax);
+                bClipped.push_back(b[i - 1] + (b[i] - b[i - 1]) * (r[i - 1] - rMax) / (r[i - 1] - r[i]));
+            }
+            rClipped.push_back(r[i]);
+            bClipped.push_back(b[i]);
+        }
+    }
+    // Clip the frontier to b <= bMax, ending where the frontier crosses b = bMax
+    Flow flow;
+    for (unsigned int i = 0; i < rClipped.size(); i++) {
+        if (bClipped[i] <= bMax) {
+            flow.r.push_back(rClipped[i]);
+            flow.b.push_back(bClipped[i]);
+        } else {
+            if (i > 0) {
+                flow.r.push_back(rClipped[i - 1] + (rClipped[i] - rClipped[i - 1]) * (bMax - bClipped[i - 1]) / (bClipped[i] - bClipped[i - 1]));
+                flow.b.push_back(bMax);
+            }
+            break;
+        }
+    }
+    if (flow.r.empty()) {
+        _feasible = false;
+    }
+    flow.firstColumn = 0;
+    flow.startR = -1;
+    _flows.push_back(flow);
+    return _flows.size() - 1;
+}
+
+void ShaperSolver::addConstraint(const vector<ShaperTerm>& terms, double rhs)
+{
+    assert(rhs >= 0);
+    Constraint constraint;
+    constraint.terms = terms;
+    constraint.rhs = rhs;
+    _constraints.push_back(constraint);
+}
+
+bool ShaperSolver::solve()
+{
+    _r.assign(_flows.size(), 0.0);
+    _b.assign(_flows.size(), 0.0);
+    _objective = 0;
+    if (!_feasible) {
+        return false;
+    }
+    // Each flow starts at its first vertex and moves along segment s of its frontier by a fraction x_s in [0, 1]
+    unsigned int numFlows = _flows.size();
+    unsigned int m = _constraints.size();
+    vector<double> rhs(m);
+    vector<vector<pair<unsigned int, const ShaperTerm*> > > flowTerms(numFlows);
+    for (unsigned int c = 0; c < m; c++) {
+        rhs[c] = _constraints[c].rhs;
+        const vector<ShaperTerm>& terms = _constraints[c].terms;
+        for (vector<ShaperTerm>::const_iterator it = terms.begin(); it != terms.end(); it++) {
+            assert(it->flow < numFlows);
+            const Flow& flow = _flows[it->flow];
+            // Subtract the load of the flow's first vertex
+            rhs[c] -= it->rCoeff * flow.r.front() + it->bCoeff * flow.b.front();
+            flowTerms[it->flow].push_back(make_pair(c, &(*it)));
+        }
+    }
+    // Create columns for the segments of each flow's frontier
+    vector<SparseColumn> columns;
+    vector<double> costs;
+    vector<double> upper;
+    for (unsigned int k = 0; k < numFlows; k++) {
+        Flow& flow = _flows[k];
+        flow.firstColumn = columns.size();
+        for (unsigned int s = 0; s + 1 < flow.r.size(); s++) {
+            double dr = flow.r[s + 1] - flow.r[s];
+            double db = flow.b[s + 1] - flow.b[s];
+            SparseColumn column;
+            for (vector<pair<unsigned int, const ShaperTerm*> >::const_iterator it = flowTerms[k].begin(); it != flowTerms[k].end(); it++) {
+                double coeff = it->second->rCoeff * dr + it->second->bCoeff * db;
+                if (!column.empty() && (column.back().first == it->first)) {
+                    column.back().second += coeff;
+                } else {
+                    column.push_back(make_pair(it->first, coeff));
+                }
+            }
+            columns.push_back(column);
+            costs.push_back(dr);
+            upper.push_back(1);
+        }
+    }
+    // Start each flow at the vertex closest to its start, if set, or otherwise the vertex with the least normalized load on its constraints,
+    // i.e., with the preceding segments at their upper bound
+    vector<bool> atUpper(columns.size(), false);
+    vector<double> slacks(rhs);
+    for (unsigned int k = 0; k < numFlows; k++) {
+        const Flow& flow = _flows[k];
+        unsigned int bestVertex = 0;
+        double bestLoad = numeric_limits<double>::infinity();
+        for (unsigned int v = 0; v < flow.r.size(); v++) {
+            double load = 0;
+            if (flow.startR >= 0) {
+                load = fabs(flow.r[v] - flow.startR);
+            } else {
+                for (vector<pair<unsigned int, const ShaperTerm*> >::const_iterator it = flowTerms[k].begin(); it != flowTerms[k].end(); it++) {
+                    double coeff = it->second->rCoeff * flow.r[v] + it->second->bCoeff * flow.b[v];
+                    double rowRhs = _constraints[it->first].rhs;
+                    load += (rowRhs > 0) ? (coeff / rowRhs) : ((coeff > 0) ? numeric_limits<double>::infinity() : 0);
+                }
+            }
+            if (load < bestLoad) {
+                bestVertex = v;
+                bestLoad = load;
+            }
+        }
+        for (unsigned int s = 0; s < bestVertex; s++) {
+            unsigned int j = flow.firstColumn + s;
+            atUpper[j] = true;
+            for (SparseColumn::const_iterator it = columns[j].begin(); it != columns[j].end(); it++) {
+                slacks[it->first] -= it->second;
+            }
+        }
+    }
+    // Rows start with their slack column, or an artificial column if the slack would be negative
+    vector<unsigned int> basis(m);
+    vector<double> basisDiagonal(m);
+    vector<unsigned int> artificials;
+    for (unsigned int c = 0; c < m; c++) {
+        columns.push_back(SparseColumn(1, make_pair(c, 1.0)));
+        costs.push_back(0);
+        upper.push_back(numeric_limits<double>::infinity());
+        atUpper.push_back(false);
+        basisDiagonal[c] = 1;
+        if (slacks[c] < 0) {
+            columns.push_back(SparseColumn(1, make_pair(c, -1.0)));
+            costs.push_back(0);
+            upper.push_back(numeric_limits<double>::infinity());
+            atUpper.push_back(false);
+            artificials.push_back(columns.size() - 1);
+            basisDiagonal[c] = -1;
+        }
+        basis[c] = columns.size() - 1;
+    }
+    BoundedSimplex simplex(columns, rhs, upper, basis, basisDiagonal, atUpper);
+    // Phase 1: minimize the sum of artificial columns
+    if (!artificials.empty()) {
+        vector<double> phase1Costs(columns.size(), 0.0);
+        for (vector<unsigned int>::const_iterator it = artificials.begin(); it != artificials.end(); it++) {
+            phase1Costs[*it] = 1;
+        }
+        if (simplex.run(phase1Costs) != SIMPLEX_OPTIMAL) {
+            return false;
+        }
+        vector<double> x;
+        simplex.getSolution(x);
+        double infeasibility = 0;
+        for (vector<unsigned int>::const_iterator it = artificials.begin(); it != artificials.end(); it++) {
+            infeasibility += x[*it];
+        }
+        if (infeasibility > SIMPLEX_FEASIBILITY_TOLERANCE) {
+            return false;
+        }
+        // Fix artificial columns at zero
+        for (vector<unsigned int>::const_iterator it = artificials.begin(); it != artificials.end(); it++) {
+            simplex.setUpper(*it, 0);
+        }
+    }
+    // Phase 2: minimize sum_k r_k
+    if (simplex.run(costs) != SIMPLEX_OPTIMAL) {
+        return false;
+    }
+    // Extract solution
+    vector<double> x;
+    simplex.getSolution(x);
+    for (unsigned int k = 0; k < numFlows; k++) {
+        const Flow& flow = _flows[k];
+        double r = flow.r.front();
+        double b = flow.b.front();
+        for (unsigned int s = 0; s + 1 < flow.r.size(); s++) {
+            double fraction = min(max(x[flow.firstColumn + s], 0.0), 1.0);
+            r += fraction * (flow.r[s + 1] - flow.r[s]);
+            b += fraction * (flow.b[s + 1] - flow.b[s]);
+        }
+        // Segments that are partially used out of order are above the frontier, so move b down onto the frontier
+        for (unsigned int s = 0; s + 1 < flow.r.size(); s++) {
+            if (r >= flow.r[s + 1]) {
+                double bFrontier = flow.b[s];
+                if (flow.r[s] > flow.r[s + 1]) {
+                    bFrontier += (flow.b[s + 1] - flow.b[s]) * (flow.r[s] - r) / (flow.r[s] - flow.r[s + 1]);
+                }
+                b = min(b, bFrontier);
+                break;
+            }
+        }
+        _r[k] = r;
+        _b[k] = max(b, flow.b.front());
+        _objective += r;
+    }
+    return true;
+}
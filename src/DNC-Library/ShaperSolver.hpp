@@ -0,0 +1,82 @@
+// ShaperSolver.hpp - Dedicated solver for WorkloadCompactor's rate limit parameter linear program (LP).
+// Each flow k has token bucket parameters (r_k, b_k) that must conform to the flow's arrival curve, i.e., lie on or above the
+// convex frontier through the arrival curve's (r, b) pairs, within the bounds r_k <= rMax_k and b_k <= bMax_k.
+// Flows are coupled by constraints sum_k (rCoeff_k * r_k + bCoeff_k * b_k) <= rhs with nonnegative coefficients,
+// and the objective is to minimize sum_k r_k.
+// Since the coefficients are nonnegative, an optimal (r_k, b_k) can always be moved down onto the frontier, so each flow is
+// represented by how far it moves along each segment of its frontier, starting from the vertex with the largest r.
+// Segments are variables bounded by [0, 1] that the simplex method handles without rows, which replaces each flow's arrival curve
+// constraints and leaves only the coupling constraints as rows of a small LP that is solved with a dense bounded revised simplex method.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _SHAPER_SOLVER_HPP
+#define _SHAPER_SOLVER_HPP
+
+#include <vector>
+
+using namespace std;
+
+// Term rCoeff * r_k + bCoeff * b_k of a coupling constraint for flow k.
+struct ShaperTerm {
+    unsigned int flow;
+    double rCoeff;
+    double bCoeff;
+
+    ShaperTerm(unsigned int f, double rC, double bC)
+        : flow(f),
+          rCoeff(rC),
+          bCoeff(bC)
+    {}
+};
+
+class ShaperSolver
+{
+private:
+    // Vertices of a flow's frontier within its bounds, sorted by decreasing r.
+    struct Flow {
+        vector<double> r;
+        vector<double> b;
+        unsigned int firstColumn; // LP column of the first segment
+        double startR; // r of the solution to start from, or negative if not set
+    };
+
+    // Coupling constraint sum_terms (rCoeff * r_k + bCoeff * b_k) <= rhs.
+    struct Constraint {
+        vector<ShaperTerm> terms;
+        double rhs;
+    };
+
+    vector<Flow> _flows;
+    vector<Constraint> _constraints;
+    bool _feasible; // false if a flow's bounds exclude its frontier
+    vector<double> _r; // solution r_k of each flow
+    vector<double> _b; // solution b_k of each flow
+    double _objective;
+
+public:
+    ShaperSolver()
+        : _feasible(true),
+          _objective(0)
+    {}
+    virtual ~ShaperSolver() {}
+
+    // Add a flow whose arrival curve's (r, b) pairs are given in order of decreasing r and increasing b; returns the flow's index.
+    unsigned int addFlow(const vector<double>& r, const vector<double>& b, double rMax, double bMax);
+    // Add a coupling constraint sum_terms (rCoeff * r_k + bCoeff * b_k) <= rhs, where the coefficients and rhs are nonnegative.
+    void addConstraint(const vector<ShaperTerm>& terms, double rhs);
+    // Start the simplex method with a flow at the vertex closest to r, e.g., from a previous solution; otherwise a heuristic start is used.
+    void setStart(unsigned int flow, double r) { _flows[flow].startR = r; }
+    // Solve the LP; returns true if an optimal solution was found.
+    bool solve();
+    // Get the objective value sum_k r_k of the solution.
+    double getSolution() const { return _objective; }
+    // Get the solution's r_k of a flow.
+    double getSolutionR(unsigned int flow) const { return _r[flow]; }
+    // Get the solution's b_k of a flow.
+    double getSolutionB(unsigned int flow) const { return _b[flow]; }
+};
+
+#endif // _SHAPER_SOLVER_HPP
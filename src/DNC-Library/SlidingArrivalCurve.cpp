@@ -0,0 +1,128 @@
+// SlidingArrivalCurve.cpp - Code for incrementally maintaining the r-b curve of a live request stream.
+// See SlidingArrivalCurve.hpp for details.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cassert>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include "../common/time.hpp"
+#include "RbGen.hpp"
+#include "SlidingArrivalCurve.hpp"
+
+using namespace std;
+
+SlidingArrivalCurve::SlidingArrivalCurve(double maxRate, double windowDuration, unsigned int numSubWindows)
+    : _currentSubWindow(0),
+      _firstArrivalTime(0),
+      _prevArrivalTime(0),
+      _empty(true)
+{
+    assert(windowDuration > 0);
+    assert(numSubWindows > 0);
+    // Use the same rates as calcArrivalCurve
+    if (maxRate > 0) {
+        for (double rate = maxRate; rate >= 0; rate -= 0.001 * maxRate) {
+            _rates.push_back(rate);
+        }
+    }
+    // Pad arrays to a multiple of the vector width; padded entries have rate 0 and are ignored
+    unsigned int n = _rates.size();
+    _paddedN = ((n + RBGEN_VECTOR_WIDTH - 1) / RBGEN_VECTOR_WIDTH) * RBGEN_VECTOR_WIDTH;
+    _alignedRates = rbGenAlignedArray(_ratesBuffer, _paddedN);
+    _alignedBuckets = rbGenAlignedArray(_bucketsBuffer, _paddedN);
+    for (unsigned int i = 0; i < n; i++) {
+        _alignedRates[i] = _rates[i];
+    }
+    _burstsBuffers.resize(numSubWindows);
+    _alignedBursts.resize(numSubWindows);
+    for (unsigned int i = 0; i < numSubWindows; i++) {
+        _alignedBursts[i] = rbGenAlignedArray(_burstsBuffers[i], _paddedN);
+    }
+    _works.assign(numSubWindows, 0);
+    _subWindowStarts.assign(numSubWindows, 0);
+    _subWindowDuration = max(ConvertSecondsToTime(windowDuration / numSubWindows), static_cast<uint64_t>(1));
+}
+
+// Start new sub-windows until the current sub-window contains time t.
+void SlidingArrivalCurve::advance(uint64_t t)
+{
+    unsigned int numSubWindows = _works.size();
+    uint64_t currentStart = _subWindowStarts[_currentSubWindow];
+    if (t < currentStart + _subWindowDuration) {
+        return;
+    }
+    uint64_t numAdvance = (t - currentStart) / _subWindowDuration;
+    if (numAdvance > numSubWindows) {
+        // Skip sub-windows that would be cleared anyway
+        currentStart += (numAdvance - numSubWindows) * _subWindowDuration;
+        numAdvance = numSubWindows;
+    }
+    for (uint64_t i = 0; i < numAdvance; i++) {
+        currentStart += _subWindowDuration;
+        _currentSubWindow = (_currentSubWindow + 1) % numSubWindows;
+        fill(_alignedBursts[_currentSubWindow], _alignedBursts[_currentSubWindow] + _paddedN, 0.0);
+        _works[_currentSubWindow] = 0;
+        _subWindowStarts[_currentSubWindow] = currentStart;
+    }
+}
+
+void SlidingArrivalCurve::addArrival(uint64_t arrivalTime, double work)
+{
+    if (_empty) {
+        _firstArrivalTime = arrivalTime;
+        _prevArrivalTime = arrivalTime;
+        _subWindowStarts[_currentSubWindow] = arrivalTime;
+        _empty = false;
+    } else if (arrivalTime < _prevArrivalTime) {
+        // Treat out of order arrivals as arriving with the previous request
+        arrivalTime = _prevArrivalTime;
+    }
+    advance(arrivalTime);
+    double interarrival = ConvertTimeToSeconds(arrivalTime - _prevArrivalTime);
+    rbGenUpdate(_alignedRates, _alignedBuckets, _alignedBursts[_currentSubWindow], _paddedN, interarrival, work);
+    _works[_currentSubWindow] += work;
+    _prevArrivalTime = arrivalTime;
+}
+
+void SlidingArrivalCurve::getRbCurve(vector<double>& rates, vector<double>& bursts, uint64_t now) const
+{
+    rates.clear();
+    bursts.clear();
+    if (_empty) {
+        return;
+    }
+    // Combine sub-windows that overlap the window ending at now
+    unsigned int numSubWindows = _works.size();
+    uint64_t windowDuration = numSubWindows * _subWindowDuration;
+    uint64_t windowStart = (now > windowDuration) ? (now - windowDuration) : 0;
+    uint64_t earliestStart = now;
+    double totalWork = 0;
+    vector<double> maxBursts(_rates.size(), 0);
+    for (unsigned int j = 0; j < numSubWindows; j++) {
+        uint64_t start = _subWindowStarts[j];
+        bool used = (j == _currentSubWindow) || (_works[j] > 0);
+        if (!used || (start + _subWindowDuration <= windowStart) || (start > now)) {
+            continue;
+        }
+        earliestStart = min(earliestStart, start);
+        totalWork += _works[j];
+        for (unsigned int i = 0; i < _rates.size(); i++) {
+            maxBursts[i] = max(maxBursts[i], _alignedBursts[j][i]);
+        }
+    }
+    if (totalWork <= 0) {
+        return;
+    }
+    // Only keep the rates that are at least the average rate
+    earliestStart = max(max(earliestStart, windowStart), _firstArrivalTime);
+    double duration = ConvertTimeToSeconds((now > earliestStart) ? (now - earliestStart) : 0);
+    double minRate = (duration > 0) ? (totalWork / duration) : 0;
+    for (unsigned int i = 0; (i < _rates.size()) && (_rates[i] >= minRate); i++) {
+        rates.push_back(_rates[i]);
+        bursts.push_back(maxBursts[i]);
+    }
+}
@@ -0,0 +1,61 @@
+// SlidingArrivalCurve.hpp - Class definitions for incrementally maintaining the r-b curve of a live request stream.
+// Whereas rbGen analyzes a static trace, SlidingArrivalCurve is updated as each request arrives and describes
+// only the requests within a sliding window of time. The window is divided into sub-windows that each track
+// the largest token bucket level per rate; the oldest sub-window is dropped as the window slides.
+// Token buckets are never reset, so a backlog carried into the window is conservatively included.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _SLIDING_ARRIVAL_CURVE_HPP
+#define _SLIDING_ARRIVAL_CURVE_HPP
+
+#include <vector>
+#include <stdint.h>
+
+using namespace std;
+
+// SlidingArrivalCurve is not thread-safe.
+class SlidingArrivalCurve
+{
+private:
+    // Token bucket rates; decreasing from maxRate to 0
+    vector<double> _rates;
+    unsigned int _paddedN;
+    vector<double> _ratesBuffer;
+    vector<double> _bucketsBuffer;
+    double* _alignedRates;
+    double* _alignedBuckets;
+    // Per sub-window max token bucket levels, total work, and start time
+    vector<vector<double> > _burstsBuffers;
+    vector<double*> _alignedBursts;
+    vector<double> _works;
+    vector<uint64_t> _subWindowStarts;
+    unsigned int _currentSubWindow;
+    uint64_t _subWindowDuration;
+    uint64_t _firstArrivalTime;
+    uint64_t _prevArrivalTime;
+    bool _empty;
+
+    // Start new sub-windows until the current sub-window contains time t.
+    void advance(uint64_t t);
+
+    SlidingArrivalCurve(const SlidingArrivalCurve&); // not implemented
+    SlidingArrivalCurve& operator=(const SlidingArrivalCurve&); // not implemented
+
+public:
+    // windowDuration is in seconds; maxRate should be the bandwidth of the queue the requests are sent to.
+    SlidingArrivalCurve(double maxRate, double windowDuration, unsigned int numSubWindows = 8);
+    ~SlidingArrivalCurve()
+    {}
+
+    // Add a request of a given work arriving at arrivalTime; takes O(number of rates) time.
+    // Arrival times should be non-decreasing.
+    void addArrival(uint64_t arrivalTime, double work);
+    // Get the r-b curve of the requests in the window ending at time now.
+    // Only rates that are at least the average rate of work in the window are returned; rates are decreasing.
+    void getRbCurve(vector<double>& rates, vector<double>& bursts, uint64_t now) const;
+};
+
+#endif // _SLIDING_ARRIVAL_CURVE_HPP
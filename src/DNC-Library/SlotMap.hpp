@@ -0,0 +1,78 @@
+// SlotMap.hpp - Dense map from ids to objects with O(1) lookup.
+// Ids are expected to be small integers that are assigned in increasing order (e.g., FlowId, ClientId, QueueId in NC.hpp).
+// Lookups index directly into a vector of slots, and iteration walks a contiguous vector of (id, object) pairs sorted by id,
+// so iteration visits the same elements in the same order as a map<Id, T*>.
+// Erasing is linear in the number of elements, which is fine since lookups and iteration are far more frequent.
+// SlotMap does not own the objects.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _SLOT_MAP_HPP
+#define _SLOT_MAP_HPP
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+using namespace std;
+
+template <typename Id, typename T>
+class SlotMap
+{
+private:
+    typedef pair<Id, T*> Element;
+
+    vector<T*> _slots; // _slots[id] -> object, or NULL if id is unused
+    vector<Element> _elements; // (id, object) sorted by id
+
+    // Comparison function for finding an id within _elements.
+    static bool elementIdCompare(const Element& e, Id id) { return e.first < id; }
+
+public:
+    typedef typename vector<Element>::const_iterator const_iterator;
+
+    const_iterator begin() const { return _elements.begin(); }
+    const_iterator end() const { return _elements.end(); }
+    size_t size() const { return _elements.size(); }
+    bool empty() const { return _elements.empty(); }
+
+    // Return the object with a given id, or NULL if the id is not in the map.
+    T* find(Id id) const
+    {
+        return (id < _slots.size()) ? _slots[id] : NULL;
+    }
+
+    // Add an object with an id that is not in the map.
+    void insert(Id id, T* value)
+    {
+        if (id >= _slots.size()) {
+            _slots.resize(id + 1, NULL);
+        }
+        _slots[id] = value;
+        Element element(id, value);
+        if (_elements.empty() || (_elements.back().first < id)) {
+            _elements.push_back(element);
+        } else {
+            _elements.insert(lower_bound(_elements.begin(), _elements.end(), id, elementIdCompare), element);
+        }
+    }
+
+    // Remove an object from the map.
+    void erase(Id id)
+    {
+        if (find(id) == NULL) {
+            return;
+        }
+        _slots[id] = NULL;
+        typename vector<Element>::iterator it = lower_bound(_elements.begin(), _elements.end(), id, elementIdCompare);
+        _elements.erase(it);
+        // Release trailing unused slots
+        while (!_slots.empty() && (_slots.back() == NULL)) {
+            _slots.pop_back();
+        }
+    }
+};
+
+#endif // _SLOT_MAP_HPP
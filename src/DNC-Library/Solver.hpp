@@ -9,6 +9,8 @@
 #define SOLVER_HPP
 
 #include <cstring>
+#include <vector>
+#include <algorithm>
 #include "../glpk/glpk.h"
 
 using namespace std;
@@ -17,6 +19,7 @@ typedef int VariableHandle;
 typedef int ConstraintHandle;
 
 const VariableHandle InvalidVariableHandle = -2;
+const ConstraintHandle InvalidConstraintHandle = -2;
 
 enum VarType {
     VAR_CONTINUOUS = 0,
@@ -101,6 +104,86 @@ public:
     }
 };
 
+// Sparse matrix of LP constraint coefficients, built by appending entries to rows in any order.
+// Entries are stored in pooled buffers that keep their capacity across clear(), and compact() groups them by row
+// so that each row can be passed to a Solver without copying.
+class ConstraintMatrix
+{
+private:
+    int _numRows;
+    // Entries in the order they were appended
+    vector<int> _entryRows;
+    vector<double> _entryCoeffs;
+    vector<VariableHandle> _entryVars;
+    // Entries grouped by row after compact(), where row i is at [_rowStarts[i], _rowStarts[i + 1])
+    vector<int> _rowStarts;
+    vector<double> _coeffs;
+    vector<VariableHandle> _vars;
+
+public:
+    ConstraintMatrix()
+        : _numRows(0)
+    {}
+
+    // Remove all rows and entries
+    void clear() {
+        _numRows = 0;
+        _entryRows.clear();
+        _entryCoeffs.clear();
+        _entryVars.clear();
+    }
+    // Add an empty row; returns the index of the row
+    int addRow() {
+        return _numRows++;
+    }
+    // Append an LP variable to a row
+    void append(int row, double coeff, VariableHandle var) {
+        _entryRows.push_back(row);
+        _entryCoeffs.push_back(coeff);
+        _entryVars.push_back(var);
+    }
+    // Group entries by row, keeping the order of the entries within each row
+    void compact() {
+        _rowStarts.assign(_numRows + 2, 0);
+        for (vector<int>::const_iterator it = _entryRows.begin(); it != _entryRows.end(); it++) {
+            _rowStarts[*it + 2]++;
+        }
+        for (int row = 2; row < _numRows + 2; row++) {
+            _rowStarts[row] += _rowStarts[row - 1];
+        }
+        // _rowStarts[row + 1] is the next free position of row while filling
+        _coeffs.resize(_entryRows.size());
+        _vars.resize(_entryRows.size());
+        for (unsigned int i = 0; i < _entryRows.size(); i++) {
+            int pos = _rowStarts[_entryRows[i] + 1]++;
+            _coeffs[pos] = _entryCoeffs[i];
+            _vars[pos] = _entryVars[i];
+        }
+        _rowStarts.pop_back();
+    }
+    // Get the number of rows
+    int getNumRows() const {
+        return _numRows;
+    }
+    // Get the number of entries, coefficients, and variables of a row after compact(); the pointers are NULL if the matrix has no entries
+    int getRowCount(int row) const {
+        return _rowStarts[row + 1] - _rowStarts[row];
+    }
+    const double* getRowCoeffs(int row) const {
+        return _coeffs.empty() ? NULL : &_coeffs[0] + _rowStarts[row];
+    }
+    const VariableHandle* getRowVars(int row) const {
+        return _vars.empty() ? NULL : &_vars[0] + _rowStarts[row];
+    }
+};
+
+// Returns the handle of a variable/constraint after deleting the variables/constraints in deleted (sorted in increasing order).
+// Deleting variables/constraints shifts the handles after them, similar to erasing elements of a vector.
+inline int shiftHandle(int handle, const vector<int>& deleted)
+{
+    return handle - (lower_bound(deleted.begin(), deleted.end(), handle) - deleted.begin());
+}
+
 // Abstract base class
 class Solver
 {
@@ -113,6 +196,18 @@ public:
     ConstraintHandle addConstraintExpression(const ConstraintExpression& expr, enum ConstraintType type, double rhs, const char* name) {
         return addConstraint(expr.count, expr.coeffs, expr.vars, type, rhs, name);
     }
+    // Add LP constraints for the given rows of a compacted ConstraintMatrix with right-hand-side values rhs[i] for rows[i].
+    // The constraints have consecutive handles; returns the handle of the first constraint.
+    virtual ConstraintHandle addConstraints(const ConstraintMatrix& matrix, const vector<int>& rows, enum ConstraintType type, const vector<double>& rhs) {
+        ConstraintHandle first = InvalidConstraintHandle;
+        for (unsigned int i = 0; i < rows.size(); i++) {
+            ConstraintHandle constraint = addConstraint(matrix.getRowCount(rows[i]), matrix.getRowCoeffs(rows[i]), matrix.getRowVars(rows[i]), type, rhs[i], NULL);
+            if (i == 0) {
+                first = constraint;
+            }
+        }
+        return first;
+    }
     // Set a min/max objective direction
     virtual void setObjectiveDirection(enum ObjectiveType type) = 0;
     // Set the coefficient and variable for the objective
@@ -125,27 +220,57 @@ public:
     virtual double getSolutionVariable(VariableHandle var) = 0;
     // Change the right-hand-size value of a constraint
     virtual void changeRHS(ConstraintHandle constraint, double rhs) = 0;
+    // Replace the variables and right-hand-side value of a constraint, keeping its type
+    virtual void changeConstraint(ConstraintHandle constraint, int count, const double* coeffs, const VariableHandle* vars, double rhs) = 0;
+    // Replace a constraint in the form of a ConstraintExpression
+    void changeConstraintExpression(ConstraintHandle constraint, const ConstraintExpression& expr, double rhs) {
+        changeConstraint(constraint, expr.count, expr.coeffs, expr.vars, rhs);
+    }
+    // Delete variables, which are removed from all constraints; see shiftHandle for the handles of the remaining variables
+    virtual void deleteVariables(const vector<VariableHandle>& vars) = 0;
+    // Delete constraints; see shiftHandle for the handles of the remaining constraints
+    virtual void deleteConstraints(const vector<ConstraintHandle>& constraints) = 0;
+    // Solve the LP after modifications, warm-starting from the previous solution unless variables/constraints were deleted.
+    // Changes to constraints should only add variables, since changing the coefficients of existing variables can invalidate the previous solution.
+    virtual bool resolve() = 0;
 };
 
 // GLPK solver
+// Each SolverGLPK has its own GLPK environment, so different solvers can be used concurrently from different threads.
+// A single solver must not be used by multiple threads at the same time.
 class SolverGLPK : public Solver
 {
 private:
+    void* env; // GLPK environment, which owns the memory allocated for prob
     glp_prob* prob;
     bool simplexMethod;
 
+    // Helpers for keeping the basis valid when deleting rows and columns, so that resolve can warm-start from it.
+    // leaveColumn replaces a basic column with a slack, and enterSlack makes a row's slack basic.
+    // Each pivots on the largest element and returns false if the basis is singular.
+    bool factorizeBasis();
+    bool leaveColumn(int col);
+    bool enterSlack(int row);
+    void enterBasis(int k, int row);
+
 public:
     SolverGLPK();
     virtual ~SolverGLPK();
 
     virtual VariableHandle addVariable(double lb, double ub, enum VarType type, const char* name);
     virtual ConstraintHandle addConstraint(int count, const double* coeffs, const VariableHandle* vars, enum ConstraintType type, double rhs, const char* name);
+    // Rows are added at once, and the coefficients are loaded with a single glp_load_matrix call if the LP has no coefficients yet.
+    virtual ConstraintHandle addConstraints(const ConstraintMatrix& matrix, const vector<int>& rows, enum ConstraintType type, const vector<double>& rhs);
     virtual void setObjectiveDirection(enum ObjectiveType type);
     virtual void setObjectiveCoeff(double coeff, VariableHandle var);
     virtual bool solve();
     virtual double getSolution();
     virtual double getSolutionVariable(VariableHandle var);
     virtual void changeRHS(ConstraintHandle constraint, double rhs);
+    virtual void changeConstraint(ConstraintHandle constraint, int count, const double* coeffs, const VariableHandle* vars, double rhs);
+    virtual void deleteVariables(const vector<VariableHandle>& vars);
+    virtual void deleteConstraints(const vector<ConstraintHandle>& constraints);
+    virtual bool resolve();
 };
 
 #endif // SOLVER_HPP
@@ -5,13 +5,83 @@
 //
 
 #include <cmath>
+#include <vector>
+#include <cassert>
+#include <pthread.h>
+#include <sys/time.h>
 #include "../glpk/glpk.h"
+#include "../common/metrics.hpp"
 #include "Solver.hpp"
 
 using namespace std;
 
+// GLPK looks up its environment (e.g., memory allocation lists) through these hooks,
+// which the bundled library implements with a single process-wide pointer.
+// Defining them here with a thread-local pointer lets each solver switch to its own environment.
+static __thread void* currentEnvGLPK = NULL;
+extern "C" {
+void* _glp_tls_get_ptr(void)
+{
+    return currentEnvGLPK;
+}
+void _glp_tls_set_ptr(void* ptr)
+{
+    currentEnvGLPK = ptr;
+}
+
+// The bundled glp_time uses gmtime, which is not thread-safe, so replace it (and glp_difftime, which is defined alongside it)
+// with equivalent versions that compute the milliseconds since the epoch directly.
+double glp_time(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec * 1000.0 + (double)(tv.tv_usec / 1000);
+}
+double glp_difftime(double t1, double t0)
+{
+    return (t1 - t0) / 1000.0;
+}
+}
+
+// Switches the calling thread to a GLPK environment until the end of the scope.
+class EnvScopeGLPK
+{
+private:
+    void* _prevEnv;
+
+    EnvScopeGLPK(const EnvScopeGLPK&); // not implemented
+    EnvScopeGLPK& operator=(const EnvScopeGLPK&); // not implemented
+
+public:
+    EnvScopeGLPK(void* env)
+        : _prevEnv(currentEnvGLPK)
+    {
+        currentEnvGLPK = env;
+    }
+    ~EnvScopeGLPK()
+    {
+        currentEnvGLPK = _prevEnv;
+    }
+};
+
+// The bignum arithmetic used by glp_exact has a process-wide memory pool
+static pthread_mutex_t exactMutexGLPK = PTHREAD_MUTEX_INITIALIZER;
+
+// Time spent in each GLPK method; the exact method includes waiting for exactMutexGLPK
+static MetricHistogram interiorTimeGLPK("glpk_interior_seconds", "Time spent in glp_interior");
+static MetricHistogram simplexTimeGLPK("glpk_simplex_seconds", "Time spent in glp_simplex after glp_interior fails");
+static MetricHistogram exactTimeGLPK("glpk_exact_seconds", "Time spent in glp_exact refining simplex solutions");
+static MetricHistogram resolveTimeGLPK("glpk_resolve_seconds", "Time spent warm-starting dual simplex in resolve");
+
+#define BASIS_PIVOT_TOLERANCE_GLPK 1e-7 // minimum magnitude of a pivot element when replacing basic variables of deleted rows and columns
+
 SolverGLPK::SolverGLPK()
 {
+    // Create environment
+    EnvScopeGLPK scope(NULL);
+    int rc = glp_init_env();
+    assert(rc == 0);
+    env = currentEnvGLPK;
     // Make solver quiet
     glp_term_out(GLP_OFF);
     // Create problem
@@ -20,11 +90,14 @@ SolverGLPK::SolverGLPK()
 
 SolverGLPK::~SolverGLPK()
 {
+    EnvScopeGLPK scope(env);
     glp_delete_prob(prob);
+    glp_free_env();
 }
 
 VariableHandle SolverGLPK::addVariable(double lb, double ub, enum VarType type, const char* name)
 {
+    EnvScopeGLPK scope(env);
     const int typeTranslation[] = {GLP_CV, GLP_BV, GLP_IV};
     VariableHandle var = glp_add_cols(prob, 1);
     if (isfinite(lb)) {
@@ -49,6 +122,7 @@ VariableHandle SolverGLPK::addVariable(double lb, double ub, enum VarType type,
 
 ConstraintHandle SolverGLPK::addConstraint(int count, const double* coeffs, const VariableHandle* vars, enum ConstraintType type, double rhs, const char* name)
 {
+    EnvScopeGLPK scope(env);
     const int typeTranslation[] = {GLP_UP, GLP_FX, GLP_LO};
     ConstraintHandle constraint = glp_add_rows(prob, 1);
     glp_set_mat_row(prob, constraint, count, &vars[-1], &coeffs[-1]); // GLPK is 1-indexed
@@ -59,29 +133,78 @@ ConstraintHandle SolverGLPK::addConstraint(int count, const double* coeffs, cons
     return constraint;
 }
 
+ConstraintHandle SolverGLPK::addConstraints(const ConstraintMatrix& matrix, const vector<int>& rows, enum ConstraintType type, const vector<double>& rhs)
+{
+    EnvScopeGLPK scope(env);
+    if (rows.empty()) {
+        return InvalidConstraintHandle;
+    }
+    const int typeTranslation[] = {GLP_UP, GLP_FX, GLP_LO};
+    bool emptyMatrix = (glp_get_num_nz(prob) == 0);
+    ConstraintHandle first = glp_add_rows(prob, rows.size());
+    if (emptyMatrix) {
+        // Load all coefficients at once, since there are no existing coefficients to keep
+        vector<int> ia(1, 0); // GLPK is 1-indexed
+        vector<int> ja(1, 0);
+        vector<double> ar(1, 0);
+        for (unsigned int i = 0; i < rows.size(); i++) {
+            int count = matrix.getRowCount(rows[i]);
+            const double* coeffs = matrix.getRowCoeffs(rows[i]);
+            const VariableHandle* vars = matrix.getRowVars(rows[i]);
+            for (int k = 0; k < count; k++) {
+                ia.push_back(first + i);
+                ja.push_back(vars[k]);
+                ar.push_back(coeffs[k]);
+            }
+        }
+        glp_load_matrix(prob, ia.size() - 1, &ia[0], &ja[0], &ar[0]);
+    } else {
+        for (unsigned int i = 0; i < rows.size(); i++) {
+            glp_set_mat_row(prob, first + i, matrix.getRowCount(rows[i]), matrix.getRowVars(rows[i]) - 1, matrix.getRowCoeffs(rows[i]) - 1); // GLPK is 1-indexed
+        }
+    }
+    for (unsigned int i = 0; i < rows.size(); i++) {
+        glp_set_row_bnds(prob, first + i, typeTranslation[type], rhs[i], rhs[i]);
+    }
+    return first;
+}
+
 void SolverGLPK::setObjectiveDirection(enum ObjectiveType type)
 {
+    EnvScopeGLPK scope(env);
     const int typeTranslation[] = {GLP_MIN, GLP_MAX};
     glp_set_obj_dir(prob, typeTranslation[type]);
 }
 
 void SolverGLPK::setObjectiveCoeff(double coeff, VariableHandle var)
 {
+    EnvScopeGLPK scope(env);
     glp_set_obj_coef(prob, var, coeff);
 }
 
 bool SolverGLPK::solve()
 {
+    EnvScopeGLPK scope(env);
     simplexMethod = false;
     glp_scale_prob(prob, GLP_SF_AUTO);
-    int status = glp_interior(prob, NULL);
+    int status;
+    {
+        ScopedTimer timer(interiorTimeGLPK);
+        status = glp_interior(prob, NULL);
+    }
     // Fall back to simplex method
     if (status != 0) {
         simplexMethod = true;
-        status = glp_simplex(prob, NULL);
+        {
+            ScopedTimer timer(simplexTimeGLPK);
+            status = glp_simplex(prob, NULL);
+        }
         // Refine solution by solving exact version
         if ((status == 0) && (glp_get_status(prob) == GLP_OPT)) {
+            ScopedTimer timer(exactTimeGLPK);
+            pthread_mutex_lock(&exactMutexGLPK);
             status = glp_exact(prob, NULL);
+            pthread_mutex_unlock(&exactMutexGLPK);
         }
     }
     if (status == 0) {
@@ -97,6 +220,7 @@ bool SolverGLPK::solve()
 
 double SolverGLPK::getSolution()
 {
+    EnvScopeGLPK scope(env);
     if (simplexMethod) {
         return glp_get_obj_val(prob);
     } else {
@@ -106,6 +230,7 @@ double SolverGLPK::getSolution()
 
 double SolverGLPK::getSolutionVariable(VariableHandle var)
 {
+    EnvScopeGLPK scope(env);
     if (simplexMethod) {
         return glp_get_col_prim(prob, var);
     } else {
@@ -115,5 +240,159 @@ double SolverGLPK::getSolutionVariable(VariableHandle var)
 
 void SolverGLPK::changeRHS(ConstraintHandle constraint, double rhs)
 {
+    EnvScopeGLPK scope(env);
     glp_set_row_bnds(prob, constraint, glp_get_row_type(prob, constraint), rhs, rhs);
 }
+
+void SolverGLPK::changeConstraint(ConstraintHandle constraint, int count, const double* coeffs, const VariableHandle* vars, double rhs)
+{
+    EnvScopeGLPK scope(env);
+    glp_set_mat_row(prob, constraint, count, &vars[-1], &coeffs[-1]); // GLPK is 1-indexed
+    changeRHS(constraint, rhs);
+}
+
+// Nonbasic status of a variable at one of its bounds
+static int nonbasicStatGLPK(int type)
+{
+    switch (type) {
+        case GLP_FR:
+            return GLP_NF;
+        case GLP_UP:
+            return GLP_NU;
+        case GLP_FX:
+            return GLP_NS;
+        default:
+            return GLP_NL;
+    }
+}
+
+// Factorizes the basis if needed; returns false if the basis is singular.
+bool SolverGLPK::factorizeBasis()
+{
+    return (glp_bf_exists(prob) || (glp_factorize(prob) == 0));
+}
+
+bool SolverGLPK::leaveColumn(int col)
+{
+    if (!factorizeBasis()) {
+        return false;
+    }
+    // Row k of the basis inverse gives the pivot for each slack that could replace the column at position k
+    int numRows = glp_get_num_rows(prob);
+    int k = glp_get_col_bind(prob, col);
+    vector<double> rho(numRows + 1, 0);
+    rho[k] = 1;
+    glp_btran(prob, &rho[0]);
+    int row = 0;
+    double maxPivot = 0;
+    for (int i = 1; i <= numRows; i++) {
+        if (fabs(rho[i]) > maxPivot) {
+            row = i;
+            maxPivot = fabs(rho[i]);
+        }
+    }
+    if (maxPivot < BASIS_PIVOT_TOLERANCE_GLPK) {
+        return false;
+    }
+    enterBasis(k, row);
+    return true;
+}
+
+bool SolverGLPK::enterSlack(int row)
+{
+    if (!factorizeBasis()) {
+        return false;
+    }
+    // The slack's column in the basis is the unit vector, so its representation gives the pivot for each basic variable
+    int numRows = glp_get_num_rows(prob);
+    vector<double> alpha(numRows + 1, 0);
+    alpha[row] = 1;
+    glp_ftran(prob, &alpha[0]);
+    int k = 0;
+    double maxPivot = 0;
+    for (int i = 1; i <= numRows; i++) {
+        if (fabs(alpha[i]) > maxPivot) {
+            k = i;
+            maxPivot = fabs(alpha[i]);
+        }
+    }
+    if (maxPivot < BASIS_PIVOT_TOLERANCE_GLPK) {
+        return false;
+    }
+    enterBasis(k, row);
+    return true;
+}
+
+void SolverGLPK::enterBasis(int k, int row)
+{
+    int numRows = glp_get_num_rows(prob);
+    int head = glp_get_bhead(prob, k);
+    if (head <= numRows) {
+        glp_set_row_stat(prob, head, nonbasicStatGLPK(glp_get_row_type(prob, head)));
+    } else {
+        glp_set_col_stat(prob, head - numRows, nonbasicStatGLPK(glp_get_col_type(prob, head - numRows)));
+    }
+    glp_set_row_stat(prob, row, GLP_BS);
+}
+
+void SolverGLPK::deleteVariables(const vector<VariableHandle>& vars)
+{
+    EnvScopeGLPK scope(env);
+    if (!vars.empty()) {
+        // Make the deleted columns nonbasic so that the remaining basis stays valid for resolve
+        bool valid = true;
+        for (vector<VariableHandle>::const_iterator it = vars.begin(); valid && (it != vars.end()); it++) {
+            if (glp_get_col_stat(prob, *it) == GLP_BS) {
+                valid = leaveColumn(*it);
+            }
+        }
+        glp_del_cols(prob, vars.size(), &vars[0] - 1); // GLPK is 1-indexed
+        if (!valid) {
+            glp_std_basis(prob);
+        }
+    }
+}
+
+void SolverGLPK::deleteConstraints(const vector<ConstraintHandle>& constraints)
+{
+    EnvScopeGLPK scope(env);
+    if (!constraints.empty()) {
+        // Make the slacks of the deleted rows basic so that the remaining basis stays valid for resolve
+        bool valid = true;
+        for (vector<ConstraintHandle>::const_iterator it = constraints.begin(); valid && (it != constraints.end()); it++) {
+            if (glp_get_row_stat(prob, *it) != GLP_BS) {
+                valid = enterSlack(*it);
+            }
+        }
+        glp_del_rows(prob, constraints.size(), &constraints[0] - 1); // GLPK is 1-indexed
+        if (!valid) {
+            glp_std_basis(prob);
+        }
+    }
+}
+
+bool SolverGLPK::resolve()
+{
+    EnvScopeGLPK scope(env);
+    simplexMethod = true;
+    // Warm-start dual simplex from the previous basis.
+    // Added constraints have basic slack variables and added variables are non-basic, so the basis remains valid.
+    // Rescale so that added constraints are scaled too; otherwise, the feasibility tolerance is too loose for constraints with small coefficients.
+    glp_scale_prob(prob, GLP_SF_AUTO);
+    glp_smcp parm;
+    glp_init_smcp(&parm);
+    parm.meth = GLP_DUALP;
+    int status;
+    {
+        ScopedTimer timer(resolveTimeGLPK);
+        status = glp_simplex(prob, &parm);
+    }
+    if (status == 0) {
+        return (glp_get_status(prob) == GLP_OPT);
+    }
+    // Fall back to solving from scratch, discarding a singular basis
+    if ((status == GLP_EBADB) || (status == GLP_ESING) || (status == GLP_ECOND)) {
+        glp_std_basis(prob);
+    }
+    return solve();
+}
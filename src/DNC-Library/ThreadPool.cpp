@@ -0,0 +1,99 @@
+// ThreadPool.cpp - Code for running batches of independent tasks on a pool of worker threads.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <iostream>
+#include <vector>
+#include <cerrno>
+#include <cstdlib>
+#include <pthread.h>
+#include "ThreadPool.hpp"
+
+using namespace std;
+
+void* ThreadPool::workerThread(void* arg)
+{
+    ThreadPool* pool = reinterpret_cast<ThreadPool*>(arg);
+    pthread_mutex_lock(&pool->_mutex);
+    while (!pool->_shutdown) {
+        if (pool->_next < pool->_count) {
+            pool->runTasks();
+        } else {
+            pthread_cond_wait(&pool->_workAvailable, &pool->_mutex);
+        }
+    }
+    pthread_mutex_unlock(&pool->_mutex);
+    return NULL;
+}
+
+void ThreadPool::runTasks()
+{
+    while (_next < _count) {
+        unsigned int index = _next;
+        _next++;
+        pthread_mutex_unlock(&_mutex);
+        _func(_arg, index);
+        pthread_mutex_lock(&_mutex);
+        _remaining--;
+        if (_remaining == 0) {
+            pthread_cond_signal(&_workComplete);
+        }
+    }
+}
+
+ThreadPool::ThreadPool(unsigned int numThreads)
+    : _func(NULL),
+      _arg(NULL),
+      _count(0),
+      _next(0),
+      _remaining(0),
+      _shutdown(false)
+{
+    pthread_mutex_init(&_mutex, NULL);
+    pthread_cond_init(&_workAvailable, NULL);
+    pthread_cond_init(&_workComplete, NULL);
+    // Create worker threads; the thread calling run also runs tasks
+    for (unsigned int i = 1; i < numThreads; i++) {
+        pthread_t thread;
+        int rc = pthread_create(&thread, NULL, workerThread, reinterpret_cast<void*>(this));
+        if (rc) {
+            cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
+            exit(-1);
+        }
+        _threads.push_back(thread);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    pthread_mutex_lock(&_mutex);
+    _shutdown = true;
+    pthread_cond_broadcast(&_workAvailable);
+    pthread_mutex_unlock(&_mutex);
+    for (vector<pthread_t>::iterator it = _threads.begin(); it != _threads.end(); it++) {
+        pthread_join(*it, NULL);
+    }
+    pthread_cond_destroy(&_workComplete);
+    pthread_cond_destroy(&_workAvailable);
+    pthread_mutex_destroy(&_mutex);
+}
+
+void ThreadPool::run(TaskFunction func, void* arg, unsigned int count)
+{
+    pthread_mutex_lock(&_mutex);
+    _func = func;
+    _arg = arg;
+    _count = count;
+    _next = 0;
+    _remaining = count;
+    pthread_cond_broadcast(&_workAvailable);
+    runTasks();
+    while (_remaining > 0) {
+        pthread_cond_wait(&_workComplete, &_mutex);
+    }
+    _count = 0;
+    _next = 0;
+    pthread_mutex_unlock(&_mutex);
+}
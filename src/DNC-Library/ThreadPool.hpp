@@ -0,0 +1,52 @@
+// ThreadPool.hpp - Fixed-size pool of worker threads for running batches of independent tasks.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _THREAD_POOL_HPP
+#define _THREAD_POOL_HPP
+
+#include <vector>
+#include <pthread.h>
+
+using namespace std;
+
+class ThreadPool
+{
+public:
+    // Task function called with the argument passed to run and the index of the task.
+    typedef void (*TaskFunction)(void* arg, unsigned int index);
+
+private:
+    vector<pthread_t> _threads;
+    pthread_mutex_t _mutex;
+    pthread_cond_t _workAvailable; // indicates there are tasks to run or the pool is shutting down
+    pthread_cond_t _workComplete; // indicates all tasks in the batch are complete
+    TaskFunction _func;
+    void* _arg;
+    unsigned int _count; // number of tasks in the batch
+    unsigned int _next; // index of next task to run
+    unsigned int _remaining; // number of tasks in the batch that are not complete
+    bool _shutdown;
+
+    static void* workerThread(void* arg);
+    // Run tasks from the current batch until none are left to start; must be called with _mutex held.
+    void runTasks();
+
+    ThreadPool(const ThreadPool&); // not implemented
+    ThreadPool& operator=(const ThreadPool&); // not implemented
+
+public:
+    // Create a pool that runs tasks on numThreads threads, including the thread calling run.
+    ThreadPool(unsigned int numThreads);
+    virtual ~ThreadPool();
+
+    // Number of threads that run tasks, including the thread calling run.
+    unsigned int size() const { return _threads.size() + 1; }
+    // Run func(arg, index) for each index in [0, count) and return once all tasks are complete.
+    // Tasks may run concurrently in any order; run must not be called concurrently.
+    void run(TaskFunction func, void* arg, unsigned int count);
+};
+
+#endif // _THREAD_POOL_HPP
@@ -8,248 +8,855 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <algorithm>
 #include <cassert>
 #include "Solver.hpp"
 #include "NC.hpp"
 #include "DNC.hpp"
+#include "ThreadPool.hpp"
+#include "ShaperSolver.hpp"
 #include "WorkloadCompactor.hpp"
+#include "../common/metrics.hpp"
 
 using namespace std;
 
-// WorkloadCompactor's linear program for optimizing rate limit parameters at each queue.
-// See WorkloadCompactor paper for details.
-bool WorkloadCompactor::calcShaperParameters()
+// Time spent building the LPs vs solving them in calcShaperParameters
+static MetricHistogram lpBuildTime("shaper_lp_build_seconds", "Time spent updating the LPs of the affected client groups");
+static MetricHistogram lpSolveTime("shaper_lp_solve_seconds", "Time spent solving the LPs of the affected client groups");
+static MetricCounter lpSolvesCounter("shaper_lp_solves_total", "Number of client group LPs solved");
+
+// Get the vertices (r, b) of the convex frontier that a flow's rate limit parameters must lie on or above,
+// in order of decreasing r and increasing b, normalized by the bandwidth of the flow's first queue.
+static void getFlowFrontier(const Curve& arrivalCurve, double bw, vector<double>& r, vector<double>& b)
 {
-    bool result = true;
-    // Partition clients into groups
-    vector<set<ClientId> > clientGroups;
-    set<QueueId> remainingQueueIds;
-    for (map<QueueId, Queue*>::const_iterator it = queuesBegin(); it != queuesEnd(); it++) {
-        remainingQueueIds.insert(it->first);
-    }
-    while (!_affectedQueueIds.empty()) {
-        QueueId firstQueueId = *(_affectedQueueIds.begin());
-        remainingQueueIds.erase(firstQueueId);
-        _affectedQueueIds.erase(firstQueueId);
-        clientGroups.resize(clientGroups.size() + 1);
-        set<ClientId>& clientGroup = clientGroups[clientGroups.size() - 1];
-        vector<QueueId> pendingQueueIds(1, firstQueueId);
-        while (!pendingQueueIds.empty()) {
-            const Queue* queue = getQueue(pendingQueueIds.back());
-            pendingQueueIds.pop_back();
-            for (vector<FlowIndex>::const_iterator it = queue->flows.begin(); it != queue->flows.end(); it++) {
-                const Client* c = getClient(getFlow(it->flowId)->clientId);
-                clientGroup.insert(c->clientId);
-                for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
-                    const Flow* f = getFlow(c->flowIds[flowIndex]);
-                    for (unsigned int queueIndex = 0; queueIndex < f->queueIds.size(); queueIndex++) {
-                        QueueId queueId = f->queueIds[queueIndex];
-                        if (remainingQueueIds.erase(queueId) == 1) {
-                            _affectedQueueIds.erase(queueId);
-                            pendingQueueIds.push_back(queueId);
+    for (unsigned int i = 1; i < arrivalCurve.size(); i++) {
+        const PointSlope& p = arrivalCurve[i];
+        r.push_back(p.slope / bw);
+        b.push_back(yIntercept(p.x, p.y, p.slope) / bw);
+    }
+}
+
+// Get the minimum r on or above a frontier with b <= bMax, or infinity if the frontier has no such point.
+static double getMinFrontierRate(const vector<double>& r, const vector<double>& b, double bMax)
+{
+    if (b.front() > bMax) {
+        return numeric_limits<double>::infinity();
+    }
+    for (unsigned int i = 1; i < r.size(); i++) {
+        if (b[i] > bMax) {
+            // Interpolate along the segment crossing bMax
+            return r[i - 1] - (r[i - 1] - r[i]) * (bMax - b[i - 1]) / (b[i] - b[i - 1]);
+        }
+    }
+    return r.back();
+}
+
+// Get the minimum b on or above a frontier with r <= rMax, or infinity if the frontier has no such point.
+static double getMinFrontierBurst(const vector<double>& r, const vector<double>& b, double rMax)
+{
+    if (r.back() > rMax) {
+        return numeric_limits<double>::infinity();
+    }
+    for (unsigned int i = 0; i < r.size(); i++) {
+        if (r[i] <= rMax) {
+            if (i == 0) {
+                return b.front();
+            }
+            // Interpolate along the segment crossing rMax
+            return b[i - 1] + (b[i] - b[i - 1]) * (r[i - 1] - rMax) / (r[i - 1] - r[i]);
+        }
+    }
+    return b.back();
+}
+
+// Get up to numPeaks peak rate limits for a flow's (r, b) rate limit parameters, where queueRate is the sum of r of the flows starting at the flow's first queue.
+// The first peak rate is r scaled by bw / queueRate, so the first peak rates of the flows starting at the queue add up to its bandwidth
+// and the peak rates of each priority are within the bandwidth left over by higher priorities.
+// The other peak rate limits are the vertices of the flow's frontier with higher rates, in order of increasing rate, so the rate limits follow the flow's arrival curve.
+// Each peak rate limit is on the flow's frontier, so the peak rate limits do not delay the flow.
+static void getFlowPeakCurves(const Curve& arrivalCurve, const SimpleArrivalCurve& shaperCurve, double bw, double queueRate, unsigned int numPeaks, vector<SimpleArrivalCurve>& peakCurves)
+{
+    vector<double> r;
+    vector<double> b;
+    getFlowFrontier(arrivalCurve, bw, r, b);
+    if (r.empty() || (shaperCurve.r <= 0) || (numPeaks == 0)) {
+        return;
+    }
+    double burst = shaperCurve.b / bw;
+    double peakRate = min(shaperCurve.r / queueRate, r.front()); // b does not decrease above the frontier's largest rate
+    double peakBurst = getMinFrontierBurst(r, b, peakRate);
+    if (peakBurst < burst) {
+        SimpleArrivalCurve peakCurve;
+        peakCurve.r = peakRate * bw;
+        peakCurve.b = peakBurst * bw;
+        peakCurves.push_back(peakCurve);
+        burst = peakBurst;
+    }
+    // Frontier vertices are in order of decreasing rate
+    for (int i = r.size() - 1; (i >= 0) && (peakCurves.size() < numPeaks); i--) {
+        if ((r[i] > peakRate) && (b[i] < burst)) {
+            SimpleArrivalCurve peakCurve;
+            peakCurve.r = r[i] * bw;
+            peakCurve.b = b[i] * bw;
+            peakCurves.push_back(peakCurve);
+            burst = b[i];
+        }
+    }
+}
+
+// Get the path of first queues of a client's flows.
+vector<QueueId> WorkloadCompactor::getClientPath(ClientId clientId) const
+{
+    const Client* c = getClient(clientId);
+    vector<QueueId> clientPath;
+    for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
+        clientPath.push_back(getFlow(c->flowIds[flowIndex])->queueIds.front());
+    }
+    return clientPath;
+}
+
+// Update an LP's SLO, path, and stage counts for adding or removing a client.
+void WorkloadCompactor::updateLPCounts(ShaperLP* lp, ClientId clientId, bool add)
+{
+    double SLO = getClient(clientId)->SLO * 0.999; // avoid rounding errors
+    vector<QueueId> clientPath = getClientPath(clientId);
+    if (add) {
+        lp->SLOCounts[SLO]++;
+        lp->pathCounts[clientPath]++;
+        for (vector<QueueId>::const_iterator it = clientPath.begin(); it != clientPath.end(); it++) {
+            lp->stageCounts[*it]++;
+        }
+    } else {
+        if (--lp->SLOCounts[SLO] == 0) {
+            lp->SLOCounts.erase(SLO);
+        }
+        if (--lp->pathCounts[clientPath] == 0) {
+            lp->pathCounts.erase(clientPath);
+        }
+        for (vector<QueueId>::const_iterator it = clientPath.begin(); it != clientPath.end(); it++) {
+            if (--lp->stageCounts[*it] == 0) {
+                lp->stageCounts.erase(*it);
+            }
+        }
+    }
+}
+
+// Add clients' flows to an LP, creating each flow's variables and arrival curve constraints.
+// The constraints of all the clients are added to the LP at once.
+void WorkloadCompactor::addClientsToLP(ShaperLP* lp, const vector<ClientId>& clientIds)
+{
+    _constraintMatrix.clear();
+    vector<int> rows;
+    vector<double> rhs;
+    for (vector<ClientId>::const_iterator it = clientIds.begin(); it != clientIds.end(); it++) {
+        const Client* c = getClient(*it);
+        double SLO = c->SLO * 0.999; // avoid rounding errors
+        vector<ShaperLPFlow>& lpFlows = lp->clients[*it];
+        lpFlows.resize(c->flowIds.size());
+        for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
+            const DNCFlow* f = getDNCFlow(c->flowIds[flowIndex]);
+            ShaperLPFlow& lpFlow = lpFlows[flowIndex];
+            // Create rVar, bVar variables
+            VariableHandle rVar = lp->solver.addVariable(0, 0.999, VAR_CONTINUOUS, NULL); // avoid rounding errors
+            VariableHandle bVar = lp->solver.addVariable(0, SLO, VAR_CONTINUOUS, NULL);
+            lpFlow.rVar = rVar;
+            lpFlow.bVar = bVar;
+            // Add to objective function (minimize sum_k r_k)
+            lp->solver.setObjectiveCoeff(1, rVar);
+            // Add arrival curve constraints
+            double bw = getQueue(f->queueIds.front())->bandwidth; // Bandwidth of first queue
+            vector<double> r;
+            vector<double> b;
+            getFlowFrontier(f->arrivalCurve, bw, r, b);
+            // bVar >= b_1
+            int row = _constraintMatrix.addRow();
+            _constraintMatrix.append(row, 1, bVar);
+            lpFlow.constraints.push_back(row);
+            rows.push_back(row);
+            rhs.push_back(b.front());
+            for (unsigned int i = 1; i < r.size(); i++) {
+                double r1 = r[i - 1];
+                double b1 = b[i - 1];
+                double r2 = r[i];
+                double b2 = b[i];
+                assert(b2 >= b1);
+                assert(r1 >= r2);
+                // rVar * (b2 - b1) + bVar * (r1 - r2) >= r1 * b2 - r2 * b1
+                row = _constraintMatrix.addRow();
+                _constraintMatrix.append(row, b2 - b1, rVar);
+                _constraintMatrix.append(row, r1 - r2, bVar);
+                lpFlow.constraints.push_back(row);
+                rows.push_back(row);
+                rhs.push_back(r1 * b2 - r2 * b1);
+            }
+            // rVar >= r_n
+            row = _constraintMatrix.addRow();
+            _constraintMatrix.append(row, 1, rVar);
+            lpFlow.constraints.push_back(row);
+            rows.push_back(row);
+            rhs.push_back(r.back());
+        }
+        updateLPCounts(lp, *it, true);
+        _clientLPs[*it] = lp;
+    }
+    // Add the constraints, which have consecutive handles, and convert each flow's rows to constraint handles
+    _constraintMatrix.compact();
+    ConstraintHandle first = lp->solver.addConstraints(_constraintMatrix, rows, CONSTRAINT_GE, rhs);
+    for (vector<ClientId>::const_iterator it = clientIds.begin(); it != clientIds.end(); it++) {
+        vector<ShaperLPFlow>& lpFlows = lp->clients[*it];
+        for (vector<ShaperLPFlow>::iterator itF = lpFlows.begin(); itF != lpFlows.end(); itF++) {
+            for (vector<ConstraintHandle>::iterator itC = itF->constraints.begin(); itC != itF->constraints.end(); itC++) {
+                *itC += first;
+            }
+        }
+    }
+}
+
+// Delete variables and constraints from an LP, and shift the remaining handles accordingly.
+void WorkloadCompactor::deleteFromLP(ShaperLP* lp, vector<VariableHandle> vars, vector<ConstraintHandle> constraints)
+{
+    sort(vars.begin(), vars.end());
+    sort(constraints.begin(), constraints.end());
+    lp->solver.deleteVariables(vars);
+    lp->solver.deleteConstraints(constraints);
+    for (map<ClientId, vector<ShaperLPFlow> >::iterator it = lp->clients.begin(); it != lp->clients.end(); it++) {
+        for (vector<ShaperLPFlow>::iterator itF = it->second.begin(); itF != it->second.end(); itF++) {
+            itF->rVar = shiftHandle(itF->rVar, vars);
+            itF->bVar = shiftHandle(itF->bVar, vars);
+            for (vector<ConstraintHandle>::iterator itC = itF->constraints.begin(); itC != itF->constraints.end(); itC++) {
+                *itC = shiftHandle(*itC, constraints);
+            }
+        }
+    }
+    for (map<SharedConstraintKey, ConstraintHandle>::iterator it = lp->sharedConstraints.begin(); it != lp->sharedConstraints.end(); it++) {
+        it->second = shiftHandle(it->second, constraints);
+    }
+}
+
+// Remove clients' flows from their LP.
+void WorkloadCompactor::removeClientsFromLP(ShaperLP* lp, const vector<ClientId>& clientIds)
+{
+    vector<VariableHandle> vars;
+    vector<ConstraintHandle> constraints;
+    for (vector<ClientId>::const_iterator it = clientIds.begin(); it != clientIds.end(); it++) {
+        map<ClientId, vector<ShaperLPFlow> >::iterator itC = lp->clients.find(*it);
+        assert(itC != lp->clients.end());
+        for (vector<ShaperLPFlow>::const_iterator itF = itC->second.begin(); itF != itC->second.end(); itF++) {
+            vars.push_back(itF->rVar);
+            vars.push_back(itF->bVar);
+            constraints.insert(constraints.end(), itF->constraints.begin(), itF->constraints.end());
+        }
+        updateLPCounts(lp, *it, false);
+        lp->clients.erase(itC);
+        _clientLPs.erase(*it);
+    }
+    deleteFromLP(lp, vars, constraints);
+}
+
+// Remove a client from its LP, if any, deleting the LP once it has no clients.
+void WorkloadCompactor::releaseClientLP(ClientId clientId)
+{
+    map<ClientId, ShaperLP*>::iterator it = _clientLPs.find(clientId);
+    if (it == _clientLPs.end()) {
+        return;
+    }
+    ShaperLP* lp = it->second;
+    removeClientsFromLP(lp, vector<ClientId>(1, clientId));
+    if (lp->clients.empty()) {
+        _lps.erase(lp);
+        delete lp;
+    }
+}
+
+// Get the LP for a group of clients, reusing the LP that already contains the most clients of the group.
+// Clients are moved into the LP from other LPs, and clients that are no longer part of the group are removed.
+ShaperLP* WorkloadCompactor::getGroupLP(const set<ClientId>& clientGroup)
+{
+    map<ShaperLP*, unsigned int> counts;
+    for (set<ClientId>::const_iterator it = clientGroup.begin(); it != clientGroup.end(); it++) {
+        map<ClientId, ShaperLP*>::const_iterator itLP = _clientLPs.find(*it);
+        if (itLP != _clientLPs.end()) {
+            counts[itLP->second]++;
+        }
+    }
+    ShaperLP* lp = NULL;
+    unsigned int maxCount = 0;
+    for (map<ShaperLP*, unsigned int>::const_iterator it = counts.begin(); it != counts.end(); it++) {
+        if (it->second > maxCount) {
+            lp = it->first;
+            maxCount = it->second;
+        }
+    }
+    if (lp == NULL) {
+        lp = new ShaperLP;
+        lp->solver.setObjectiveDirection(OBJECTIVE_MIN);
+        _lps.insert(lp);
+    }
+    // Remove clients that are no longer part of the group
+    vector<ClientId> staleClientIds;
+    for (map<ClientId, vector<ShaperLPFlow> >::const_iterator it = lp->clients.begin(); it != lp->clients.end(); it++) {
+        if (clientGroup.find(it->first) == clientGroup.end()) {
+            staleClientIds.push_back(it->first);
+        }
+    }
+    removeClientsFromLP(lp, staleClientIds);
+    // Add clients that are not yet part of the LP
+    vector<ClientId> newClientIds;
+    for (set<ClientId>::const_iterator it = clientGroup.begin(); it != clientGroup.end(); it++) {
+        if (lp->clients.find(*it) == lp->clients.end()) {
+            releaseClientLP(*it);
+            newClientIds.push_back(*it);
+        }
+    }
+    if (!newClientIds.empty()) {
+        addClientsToLP(lp, newClientIds);
+    }
+    return lp;
+}
+
+// Get the priority of each SLO in an LP, where tighter SLOs have higher priority (i.e., lower value).
+void WorkloadCompactor::getSLOPriorities(const ShaperLP* lp, map<double, unsigned int>& SLOs) const
+{
+    unsigned int priority = 0;
+    for (map<double, unsigned int>::const_iterator it = lp->SLOCounts.begin(); it != lp->SLOCounts.end(); it++) {
+        SLOs[it->first] = priority;
+        priority++;
+    }
+}
+
+// Update the r and b constraints of a group's LP.
+void WorkloadCompactor::updateGroupLP(ShaperLP* lp, const set<ClientId>& clientGroup, double relaxation)
+{
+    // Get SLOs in client group
+    map<double, unsigned int> SLOs;
+    getSLOPriorities(lp, SLOs);
+    // Get paths and queues
+    vector<vector<QueueId> > paths;
+    for (map<vector<QueueId>, unsigned int>::const_iterator it = lp->pathCounts.begin(); it != lp->pathCounts.end(); it++) {
+        paths.push_back(it->first);
+    }
+    // Get rows of r and b constraints, which are built in a single pooled matrix
+    _constraintMatrix.clear();
+    vector<SharedConstraintKey> rowKeys;
+    vector<double> rowRhs;
+    map<QueueId, int> rRows;
+    for (map<QueueId, unsigned int>::const_iterator it = lp->stageCounts.begin(); it != lp->stageCounts.end(); it++) {
+        rRows[it->first] = _constraintMatrix.addRow();
+        rowKeys.push_back(SharedConstraintKey(0, make_pair(vector<QueueId>(1, it->first), 0)));
+        rowRhs.push_back(0.999); // avoid rounding errors
+    }
+    vector<vector<int> > bRows(SLOs.size(), vector<int>(paths.size())); // row of stage 0 of each path for each SLO; stages are consecutive
+    unsigned int i = 0;
+    for (map<double, unsigned int>::reverse_iterator rit = SLOs.rbegin(); rit != SLOs.rend(); rit++) {
+        for (unsigned int pathIndex = 0; pathIndex < paths.size(); pathIndex++) {
+            const vector<QueueId>& path = paths[pathIndex];
+            bRows[i][pathIndex] = _constraintMatrix.getNumRows();
+            for (unsigned int j = 0; j < path.size(); j++) {
+                _constraintMatrix.addRow();
+                rowKeys.push_back(SharedConstraintKey(rit->first, make_pair(path, j)));
+                rowRhs.push_back(relaxation);
+            }
+        }
+        i++;
+    }
+    for (set<ClientId>::iterator it = clientGroup.begin(); it != clientGroup.end(); it++) {
+        const Client* c = getClient(*it);
+        double SLO = c->SLO * 0.999; // avoid rounding errors
+        const vector<ShaperLPFlow>& lpFlows = lp->clients[*it];
+        for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
+            const Flow* f = getFlow(c->flowIds[flowIndex]);
+            QueueId queueId = f->queueIds.front();
+            VariableHandle rVar = lpFlows[flowIndex].rVar;
+            VariableHandle bVar = lpFlows[flowIndex].bVar;
+            // Append to r and  b constraints
+            _constraintMatrix.append(rRows[queueId], 1, rVar);
+            unsigned int i = 0;
+            for (map<double, unsigned int>::reverse_iterator rit = SLOs.rbegin(); rit != SLOs.rend(); rit++) {
+                if (rit->first >= SLO) {
+                    for (unsigned int pathIndex = 0; pathIndex < paths.size(); pathIndex++) {
+                        const vector<QueueId>& path = paths[pathIndex];
+                        for (unsigned int j = 0; j < path.size(); j++) {
+                            if (path[j] == queueId) {
+                                if (rit->first > SLO) {
+                                    _constraintMatrix.append(bRows[i][pathIndex] + j, 1, rVar);
+                                }
+                                for (unsigned int k = 0; k < path.size(); k++) {
+                                    _constraintMatrix.append(bRows[i][pathIndex] + k, 1.0 / rit->first, bVar);
+                                }
+                                break;
+                            }
                         }
                     }
+                    i++;
+                } else {
+                    break;
                 }
             }
         }
     }
-    // Optimize shaper curves
-    for (unsigned int clientGroupIndex = 0; clientGroupIndex < clientGroups.size(); clientGroupIndex++) {
-        set<ClientId>& clientGroup = clientGroups[clientGroupIndex];
-        // Get SLOs in client group
-        map<double, unsigned int> SLOs;
-        for (set<ClientId>::iterator it = clientGroup.begin(); it != clientGroup.end(); it++) {
-            double SLO = getClient(*it)->SLO * 0.999; // avoid rounding errors
-            SLOs[SLO] = 0;
-        }
-        unsigned int priority = 0;
-        for (map<double, unsigned int>::iterator it = SLOs.begin(); it != SLOs.end(); it++) {
-            it->second = priority;
-            priority++;
-        }
-        // Get paths and queues
-        vector<vector<QueueId> > paths;
-        map<QueueId, unsigned int> queueIds;
-        for (set<ClientId>::iterator it = clientGroup.begin(); it != clientGroup.end(); it++) {
-            const Client* c = getClient(*it);
-            vector<QueueId> clientPath;
-            for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
-                const Flow* f = getFlow(c->flowIds[flowIndex]);
-                QueueId queueId = f->queueIds.front();
-                clientPath.push_back(queueId);
-                if (queueIds.find(queueId) == queueIds.end()) {
-                    unsigned int stageIndex = queueIds.size();
-                    queueIds[queueId] = stageIndex;
-                }
+    _constraintMatrix.compact();
+    // Update r constraints for each stage
+    // sum_k r_k <= 1
+    // Update b constraints for each SLO_i, for each path, for each stage in path
+    // [sum_k|SLO_k<=SLO_i,k in path (b_k / SLO_i)] + [sum_k|SLO_k<SLO_i,k==stage (r_k)] <= relaxation
+    // Constraints are identified by key, so the coefficients of existing variables in existing constraints do not change as clients are added.
+    vector<int> newRows;
+    vector<double> newRhs;
+    for (unsigned int row = 0; row < rowKeys.size(); row++) {
+        map<SharedConstraintKey, ConstraintHandle>::const_iterator it = lp->sharedConstraints.find(rowKeys[row]);
+        if (it != lp->sharedConstraints.end()) {
+            lp->solver.changeConstraint(it->second, _constraintMatrix.getRowCount(row), _constraintMatrix.getRowCoeffs(row), _constraintMatrix.getRowVars(row), rowRhs[row]);
+        } else {
+            newRows.push_back(row);
+            newRhs.push_back(rowRhs[row]);
+        }
+    }
+    // Add new constraints at once
+    ConstraintHandle first = lp->solver.addConstraints(_constraintMatrix, newRows, CONSTRAINT_LE, newRhs);
+    for (unsigned int n = 0; n < newRows.size(); n++) {
+        lp->sharedConstraints[rowKeys[newRows[n]]] = first + n;
+    }
+    // Delete shared constraints that are no longer needed
+    set<SharedConstraintKey> sharedConstraintKeys(rowKeys.begin(), rowKeys.end());
+    vector<ConstraintHandle> staleConstraints;
+    for (map<SharedConstraintKey, ConstraintHandle>::iterator it = lp->sharedConstraints.begin(); it != lp->sharedConstraints.end();) {
+        if (sharedConstraintKeys.find(it->first) == sharedConstraintKeys.end()) {
+            staleConstraints.push_back(it->second);
+            lp->sharedConstraints.erase(it++);
+        } else {
+            it++;
+        }
+    }
+    if (!staleConstraints.empty()) {
+        deleteFromLP(lp, vector<VariableHandle>(), staleConstraints);
+    }
+}
+
+// Build a native solver for a group's LP and get the priority of each SLO.
+// The constraints are the same as the GLPK LP's (see updateGroupLP), with each flow's arrival curve constraints given by its frontier.
+void WorkloadCompactor::buildNativeSolver(ShaperSolver* solver, const set<ClientId>& clientGroup, map<double, unsigned int>& SLOs, double relaxation)
+{
+    // Get SLOs and paths in client group
+    set<vector<QueueId> > pathSet;
+    for (set<ClientId>::const_iterator it = clientGroup.begin(); it != clientGroup.end(); it++) {
+        SLOs[getClient(*it)->SLO * 0.999] = 0; // avoid rounding errors
+        pathSet.insert(getClientPath(*it));
+    }
+    unsigned int priority = 0;
+    for (map<double, unsigned int>::iterator it = SLOs.begin(); it != SLOs.end(); it++) {
+        it->second = priority;
+        priority++;
+    }
+    vector<vector<QueueId> > paths(pathSet.begin(), pathSet.end());
+    // Add flows and their terms in the r and b constraints
+    map<QueueId, vector<ShaperTerm> > rConstraints;
+    map<SharedConstraintKey, vector<ShaperTerm> > bConstraints;
+    for (set<ClientId>::const_iterator it = clientGroup.begin(); it != clientGroup.end(); it++) {
+        const Client* c = getClient(*it);
+        double SLO = c->SLO * 0.999; // avoid rounding errors
+        for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
+            const DNCFlow* f = getDNCFlow(c->flowIds[flowIndex]);
+            QueueId queueId = f->queueIds.front();
+            double bw = getQueue(queueId)->bandwidth; // Bandwidth of first queue
+            vector<double> r;
+            vector<double> b;
+            getFlowFrontier(f->arrivalCurve, bw, r, b);
+            unsigned int flow = solver->addFlow(r, b, 0.999, SLO); // avoid rounding errors
+            if (f->shaperCurve.r > 0) {
+                // Start from the current rate limit parameters
+                solver->setStart(flow, f->shaperCurve.r / bw);
             }
-            unsigned int pathIndex;
-            for (pathIndex = 0; pathIndex < paths.size(); pathIndex++) {
-                const vector<QueueId>& path = paths[pathIndex];
-                if (path.size() == clientPath.size()) {
-                    bool found = true;
+            rConstraints[queueId].push_back(ShaperTerm(flow, 1, 0));
+            for (map<double, unsigned int>::reverse_iterator rit = SLOs.rbegin(); (rit != SLOs.rend()) && (rit->first >= SLO); rit++) {
+                for (unsigned int pathIndex = 0; pathIndex < paths.size(); pathIndex++) {
+                    const vector<QueueId>& path = paths[pathIndex];
                     for (unsigned int j = 0; j < path.size(); j++) {
-                        if (path[j] != clientPath[j]) {
-                            found = false;
+                        if (path[j] == queueId) {
+                            for (unsigned int k = 0; k < path.size(); k++) {
+                                double rCoeff = ((k == j) && (rit->first > SLO)) ? 1 : 0;
+                                bConstraints[SharedConstraintKey(rit->first, make_pair(path, k))].push_back(ShaperTerm(flow, rCoeff, 1.0 / rit->first));
+                            }
                             break;
                         }
                     }
-                    if (found) {
-                        break;
-                    }
                 }
             }
-            if (pathIndex == paths.size()) {
-                paths.push_back(clientPath);
-            }
         }
-        // Build LP
-        SolverGLPK s;
-        vector<VariableHandle> rVars;
-        vector<VariableHandle> bVars;
-        vector<ConstraintExpression> rConstraints(queueIds.size());
-        for (unsigned int stageIndex = 0; stageIndex < queueIds.size(); stageIndex++) {
-            rConstraints[stageIndex].init(clientGroup.size());
-        }
-        vector<vector<vector<ConstraintExpression> > > bConstraints(SLOs.size());
-        for (unsigned int i = 0; i < SLOs.size(); i++) {
-            bConstraints[i].resize(paths.size());
-            for (unsigned int pathIndex = 0; pathIndex < paths.size(); pathIndex++) {
-                const vector<QueueId>& path = paths[pathIndex];
-                bConstraints[i][pathIndex].resize(path.size());
-                for (unsigned int j = 0; j < path.size(); j++) {
-                    bConstraints[i][pathIndex][j].init((path.size() + 1) * clientGroup.size());
+    }
+    // Add r constraints for each stage
+    // sum_k r_k <= 1
+    for (map<QueueId, vector<ShaperTerm> >::const_iterator it = rConstraints.begin(); it != rConstraints.end(); it++) {
+        solver->addConstraint(it->second, 0.999); // avoid rounding errors
+    }
+    // Add b constraints for each SLO_i, for each path, for each stage in path
+    // [sum_k|SLO_k<=SLO_i,k in path (b_k / SLO_i)] + [sum_k|SLO_k<SLO_i,k==stage (r_k)] <= relaxation
+    for (map<SharedConstraintKey, vector<ShaperTerm> >::const_iterator it = bConstraints.begin(); it != bConstraints.end(); it++) {
+        solver->addConstraint(it->second, relaxation);
+    }
+}
+
+// Set the shaper curves and priorities of a group's flows from its LP's solution,
+// or set the shaper curves to be uninitialized if the LP could not be solved.
+// In multi-bucket mode, the flows' peak curves are then set from their frontiers (see getFlowPeakCurves).
+void WorkloadCompactor::applyGroupSolution(const ShaperLPSolve& lpSolve)
+{
+    const map<double, unsigned int>& SLOs = lpSolve.SLOs;
+    map<QueueId, double> queueRates; // sum of r of the flows starting at each queue
+    unsigned int flow = 0; // index of flow in native solver
+    for (set<ClientId>::const_iterator it = lpSolve.clientGroup->begin(); it != lpSolve.clientGroup->end(); it++) {
+        const Client* c = getClient(*it);
+        double SLO = c->SLO * 0.999; // avoid rounding errors
+        for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
+            DNCFlow* f = getDNCFlow(c->flowIds[flowIndex]);
+            if (lpSolve.solved) {
+                // Extract solution
+                double bw = getQueue(f->queueIds.front())->bandwidth; // Bandwidth of first queue
+                SimpleArrivalCurve shaperCurve;
+                if (lpSolve.lp) {
+                    const ShaperLPFlow& lpFlow = lpSolve.lp->clients[*it][flowIndex];
+                    shaperCurve.r = lpSolve.lp->solver.getSolutionVariable(lpFlow.rVar) * bw;
+                    shaperCurve.b = lpSolve.lp->solver.getSolutionVariable(lpFlow.bVar) * bw;
+                } else {
+                    shaperCurve.r = lpSolve.nativeSolver->getSolutionR(flow) * bw;
+                    shaperCurve.b = lpSolve.nativeSolver->getSolutionB(flow) * bw;
                 }
+                setShaperCurve(f->flowId, shaperCurve);
+                queueRates[f->queueIds.front()] += shaperCurve.r;
+            } else {
+                // Set shaper curve to be uninitialized
+                setShaperCurve(f->flowId, ZeroArrivalCurve());
             }
+            // Set priority
+            setFlowPriority(f->flowId, SLOs.find(SLO)->second);
+            flow++;
         }
-        for (set<ClientId>::iterator it = clientGroup.begin(); it != clientGroup.end(); it++) {
-            const Client* c = getClient(*it);
-            double SLO = c->SLO * 0.999; // avoid rounding errors
-            for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
-                DNCFlow* f = getDNCFlow(c->flowIds[flowIndex]);
-                QueueId queueId = f->queueIds.front();
-                // Create rVar, bVar variables
-                VariableHandle rVar = s.addVariable(0, 0.999, VAR_CONTINUOUS, NULL); // avoid rounding errors
-                VariableHandle bVar = s.addVariable(0, SLO, VAR_CONTINUOUS, NULL);
-                rVars.push_back(rVar);
-                bVars.push_back(bVar);
-                // Append to r and  b constraints
-                rConstraints[queueIds[queueId]].append(1, rVar);
-                unsigned int i = 0;
-                for (map<double, unsigned int>::reverse_iterator rit = SLOs.rbegin(); rit != SLOs.rend(); rit++) {
-                    if (rit->first >= SLO) {
-                        for (unsigned int pathIndex = 0; pathIndex < paths.size(); pathIndex++) {
-                            const vector<QueueId>& path = paths[pathIndex];
-                            for (unsigned int j = 0; j < path.size(); j++) {
-                                if (path[j] == queueId) {
-                                    if (rit->first > SLO) {
-                                        bConstraints[i][pathIndex][j].append(1, rVar);
-                                    }
-                                    for (unsigned int k = 0; k < path.size(); k++) {
-                                        bConstraints[i][pathIndex][k].append(1.0 / rit->first, bVar);
-                                    }
-                                    break;
-                                }
-                            }
-                        }
-                        i++;
-                    } else {
-                        break;
-                    }
-                }
-                // Add arrival curve constraints
-                double bw = getQueue(queueId)->bandwidth; // Bandwidth of first queue
-                double coeffs[] = {0, 0};
-                VariableHandle vars[] = {rVar, bVar};
-                const Curve& arrivalCurve = f->arrivalCurve;
-                const PointSlope& p1 = arrivalCurve[1];
-                double r1 = p1.slope / bw;
-                double b1 = yIntercept(p1.x, p1.y, p1.slope) / bw;
-                // bVar >= b1
-                coeffs[0] = 0; // rVar
-                coeffs[1] = 1; // bVar
-                s.addConstraint(2, coeffs, vars, CONSTRAINT_GE, b1, NULL);
-                for (unsigned int i = 2; i < arrivalCurve.size(); i++) {
-                    const PointSlope& p2 = arrivalCurve[i];
-                    double r2 = p2.slope / bw;
-                    double b2 = yIntercept(p2.x, p2.y, p2.slope) / bw;
-                    assert(b2 >= b1);
-                    assert(r1 >= r2);
-                    // rVar * (b2 - b1) + bVar * (r1 - r2) >= r1 * b2 - r2 * b1
-                    coeffs[0] = b2 - b1; // rVar
-                    coeffs[1] = r1 - r2; // bVar
-                    s.addConstraint(2, coeffs, vars, CONSTRAINT_GE, r1 * b2 - r2 * b1, NULL);
-                    r1 = r2;
-                    b1 = b2;
-                }
-                // rVar >= r1
-                coeffs[0] = 1; // rVar
-                coeffs[1] = 0; // bVar
-                s.addConstraint(2, coeffs, vars, CONSTRAINT_GE, r1, NULL);
+    }
+    if (!lpSolve.solved || (_numShaperBuckets <= 1)) {
+        return;
+    }
+    // Set peak curves given the rates of the flows starting at each queue
+    for (set<ClientId>::const_iterator it = lpSolve.clientGroup->begin(); it != lpSolve.clientGroup->end(); it++) {
+        const Client* c = getClient(*it);
+        for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
+            DNCFlow* f = getDNCFlow(c->flowIds[flowIndex]);
+            QueueId queueId = f->queueIds.front();
+            vector<SimpleArrivalCurve> peakCurves;
+            getFlowPeakCurves(f->arrivalCurve, f->shaperCurve, getQueue(queueId)->bandwidth, queueRates[queueId], _numShaperBuckets - 1, peakCurves);
+            setShaperCurve(f->flowId, f->shaperCurve, peakCurves);
+        }
+    }
+}
+
+// Check that the latencies of a group's clients are within their SLOs.
+// The group's queues are not re-optimized, since calcShaperParameters has already cleared the affected queues.
+bool WorkloadCompactor::checkGroupLatencies(const set<ClientId>& clientGroup)
+{
+    for (set<ClientId>::const_iterator it = clientGroup.begin(); it != clientGroup.end(); it++) {
+        const Client* c = getClient(*it);
+        double latency = 0;
+        for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
+            latency += DNC::calcFlowLatency(c->flowIds[flowIndex]);
+        }
+        if (latency > c->SLO) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Solve an infeasible group's LP with relaxed b constraints in multi-bucket mode.
+// The b constraints bound the latencies given single (r, b) rate limits, so a relaxed solution may still be within the SLOs once the peak rate limits cap the flows' bursts.
+// Relaxations are tried from WORKLOAD_COMPACTOR_MAX_RELAXATION down, and the first solution whose latencies are within the group's SLOs is kept.
+// Otherwise, the shaper curves are set to be uninitialized as for any infeasible LP.
+void WorkloadCompactor::solveRelaxedGroup(ShaperLPSolve& lpSolve)
+{
+    double relaxation = WORKLOAD_COMPACTOR_MAX_RELAXATION;
+    for (unsigned int step = 0; step < WORKLOAD_COMPACTOR_RELAXATION_STEPS; step++) {
+        uint64_t buildStartTime = GetTime();
+        if (lpSolve.lp) {
+            updateGroupLP(lpSolve.lp, *lpSolve.clientGroup, relaxation);
+        } else {
+            delete lpSolve.nativeSolver;
+            lpSolve.nativeSolver = new ShaperSolver;
+            lpSolve.SLOs.clear();
+            buildNativeSolver(lpSolve.nativeSolver, *lpSolve.clientGroup, lpSolve.SLOs, relaxation);
+        }
+        lpBuildTime.observe(GetTime() - buildStartTime);
+        _numLPSolves++;
+        lpSolvesCounter.add(1);
+        {
+            ScopedTimer timer(lpSolveTime);
+            lpSolve.solved = lpSolve.lp ? lpSolve.lp->solver.resolve() : lpSolve.nativeSolver->solve();
+        }
+        if (lpSolve.solved) {
+            applyGroupSolution(lpSolve);
+            if (checkGroupLatencies(*lpSolve.clientGroup)) {
+                return;
             }
         }
-        // Add r constraints for each stage
-        // sum_k r_k <= 1
-        for (unsigned int stageIndex = 0; stageIndex < queueIds.size(); stageIndex++) {
-            s.addConstraintExpression(rConstraints[stageIndex], CONSTRAINT_LE, 0.999, NULL); // avoid rounding errors
-        }
-        // Add b constraints for each SLO_i, for each path, for each stage in path
-        // [sum_k|SLO_k<=SLO_i,k in path (b_k / SLO_i)] + [sum_k|SLO_k<SLO_i,k==stage (r_k)] <= 1
-        for (unsigned int i = 0; i < SLOs.size(); i++) {
-            for (unsigned int pathIndex = 0; pathIndex < paths.size(); pathIndex++) {
-                const vector<QueueId>& path = paths[pathIndex];
-                for (unsigned int j = 0; j < path.size(); j++) {
-                    s.addConstraintExpression(bConstraints[i][pathIndex][j], CONSTRAINT_LE, 1, NULL);
-                }
+        relaxation = 1 + (relaxation - 1) / 2;
+    }
+    lpSolve.solved = false;
+    applyGroupSolution(lpSolve);
+}
+
+// Solve a group's LP, warm-starting from the previous solution for the GLPK backend.
+void WorkloadCompactor::solveLPTask(void* arg, unsigned int index)
+{
+    ShaperLPSolve& lpSolve = (*reinterpret_cast<vector<ShaperLPSolve>*>(arg))[index];
+    ScopedTraceId traceId(lpSolve.traceId);
+    if (lpSolve.lp) {
+        lpSolve.solved = lpSolve.lp->solver.resolve();
+    } else {
+        lpSolve.solved = lpSolve.nativeSolver->solve();
+    }
+}
+
+// WorkloadCompactor's linear program for optimizing rate limit parameters at each queue.
+// See WorkloadCompactor paper for details.
+bool WorkloadCompactor::calcShaperParameters()
+{
+    // Find groups of clients affected by adding/deleting workloads
+    set<QueueId> groupIds;
+    for (set<QueueId>::const_iterator it = _affectedQueueIds.begin(); it != _affectedQueueIds.end(); it++) {
+        groupIds.insert(_clientGroups.getGroupId(*it));
+    }
+    _affectedQueueIds.clear();
+    // Update the LP of each group
+    vector<ShaperLPSolve> lpSolves;
+    uint64_t buildStartTime = GetTime();
+    for (set<QueueId>::const_iterator it = groupIds.begin(); it != groupIds.end(); it++) {
+        const set<ClientId>& clientGroup = _clientGroups.getGroupClients(*it);
+        if (clientGroup.empty()) {
+            continue;
+        }
+        lpSolves.resize(lpSolves.size() + 1);
+        ShaperLPSolve& lpSolve = lpSolves.back();
+        lpSolve.clientGroup = &clientGroup;
+        lpSolve.lp = NULL;
+        lpSolve.nativeSolver = NULL;
+        lpSolve.solved = false;
+        lpSolve.traceId = currentTraceId();
+        if (_solverType == SHAPER_SOLVER_NATIVE) {
+            lpSolve.nativeSolver = new ShaperSolver;
+            buildNativeSolver(lpSolve.nativeSolver, clientGroup, lpSolve.SLOs, 1);
+        } else {
+            lpSolve.lp = getGroupLP(clientGroup);
+            updateGroupLP(lpSolve.lp, clientGroup, 1);
+            getSLOPriorities(lpSolve.lp, lpSolve.SLOs);
+        }
+    }
+    lpBuildTime.observe(GetTime() - buildStartTime);
+    // Solve LPs, which are independent and can be solved concurrently
+    _numLPSolves += lpSolves.size();
+    lpSolvesCounter.add(lpSolves.size());
+    {
+        ScopedTimer timer(lpSolveTime);
+        if ((lpSolves.size() > 1) && (_numSolverThreads > 1)) {
+            if (_solverPool == NULL) {
+                _solverPool = new ThreadPool(_numSolverThreads);
+            }
+            _solverPool->run(solveLPTask, &lpSolves, lpSolves.size());
+        } else {
+            for (unsigned int i = 0; i < lpSolves.size(); i++) {
+                solveLPTask(&lpSolves, i);
             }
         }
-        // Add objective function (minimize sum_k r_k)
-        s.setObjectiveDirection(OBJECTIVE_MIN);
-        for (unsigned int i = 0; i < rVars.size(); i++) {
-            s.setObjectiveCoeff(1, rVars[i]);
+    }
+    // Optimize shaper curves, applying solutions in group order
+    bool result = true;
+    for (unsigned int i = 0; i < lpSolves.size(); i++) {
+        if (!lpSolves[i].solved && (_numShaperBuckets > 1)) {
+            solveRelaxedGroup(lpSolves[i]);
+        } else {
+            applyGroupSolution(lpSolves[i]);
         }
-        // Solve LP
-        if (s.solve()) {
-            // Extract solution
-            unsigned int i = 0;
-            for (set<ClientId>::iterator it = clientGroup.begin(); it != clientGroup.end(); it++) {
-                const Client* c = getClient(*it);
-                double SLO = c->SLO * 0.999; // avoid rounding errors
-                for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
-                    DNCFlow* f = getDNCFlow(c->flowIds[flowIndex]);
-                    double bw = getQueue(f->queueIds.front())->bandwidth; // Bandwidth of first queue
-                    SimpleArrivalCurve& shaperCurve = f->shaperCurve;
-                    shaperCurve.r = s.getSolutionVariable(rVars[i]) * bw;
-                    shaperCurve.b = s.getSolutionVariable(bVars[i]) * bw;
-                    i++;
-                    // Set priority
-                    setFlowPriority(f->flowId, SLOs[SLO]);
+        result = result && lpSolves[i].solved;
+        if (lpSolves[i].nativeSolver) {
+            delete lpSolves[i].nativeSolver;
+        }
+    }
+    return result;
+}
+
+// Get a flow's frontier and minimum rate for prefilterClients; returns false if no (r, b) on the frontier is within the LP's bounds.
+// The bounds are the same as the LP's (see addClientsToLP), relaxed by WORKLOAD_COMPACTOR_PREFILTER_TOLERANCE.
+bool WorkloadCompactor::getPrefilterFlow(const Curve& arrivalCurve, QueueId queueId, double SLO, PrefilterFlow& pf) const
+{
+    double bw = getQueue(queueId)->bandwidth; // Bandwidth of first queue
+    pf.queueId = queueId;
+    pf.SLO = SLO * (1 + WORKLOAD_COMPACTOR_PREFILTER_TOLERANCE);
+    getFlowFrontier(arrivalCurve, bw, pf.r, pf.b);
+    if (pf.r.empty()) {
+        pf.minR = 0;
+        return true;
+    }
+    pf.minR = getMinFrontierRate(pf.r, pf.b, pf.SLO);
+    return (pf.minR <= 0.999 * (1 + WORKLOAD_COMPACTOR_PREFILTER_TOLERANCE));
+}
+
+// Get the minimum of rCoeff * r + bCoeff * b over a flow's frontier within its bounds, which is at a vertex or where the frontier crosses a bound.
+static double getMinFrontierCost(const vector<double>& r, const vector<double>& b, double rMax, double bMax, double rCoeff, double bCoeff)
+{
+    if (r.empty()) {
+        return 0;
+    }
+    double minCost = numeric_limits<double>::infinity();
+    double bAtRMax = getMinFrontierBurst(r, b, rMax);
+    if (bAtRMax <= bMax) {
+        minCost = min(minCost, rCoeff * min(rMax, r.front()) + bCoeff * bAtRMax);
+    }
+    double rAtBMax = getMinFrontierRate(r, b, bMax);
+    if (rAtBMax <= rMax) {
+        minCost = min(minCost, rCoeff * rAtBMax + bCoeff * min(bMax, b.back()));
+    }
+    for (unsigned int i = 0; i < r.size(); i++) {
+        if ((r[i] <= rMax) && (b[i] <= bMax)) {
+            minCost = min(minCost, rCoeff * r[i] + bCoeff * b[i]);
+        }
+    }
+    return minCost;
+}
+
+// Check necessary conditions for the LP to be feasible once clients are added.
+// Each flow's r is at least its minimum rate within the SLO bound, so the LP is infeasible if
+// (1) the minimum rates of the flows starting at a queue exceed the queue's r constraint.
+// Otherwise, each flow's r is at most the rate left over by the minimum rates of the other flows starting at the same queue,
+// which bounds how small its b can be. The LP is then infeasible if
+// (2) for a new client with SLO_i and its path of first queues, the b constraint of some stage exceeds 1 with each flow's term minimized separately, i.e.,
+// [sum_k|SLO_k<=SLO_i,k starts in path (b_k / SLO_i)] + [sum_k|SLO_k<SLO_i,k starts at stage (r_k)] > 1.
+// In multi-bucket mode, the b constraints are checked against WORKLOAD_COMPACTOR_MAX_RELAXATION instead of 1 (see solveRelaxedGroup).
+// An infeasible LP leaves the clients without rate limits, so they would fail admission control.
+PrefilterCheck WorkloadCompactor::prefilterClients(const Json::Value& clientInfos) const
+{
+    // Get frontiers of new flows
+    map<QueueId, vector<PrefilterFlow> > stageFlows; // flows starting at each queue
+    vector<pair<double, set<QueueId> > > newClientPaths; // SLO and first queues of new clients
+    for (unsigned int i = 0; i < clientInfos.size(); i++) {
+        const Json::Value& clientInfo = clientInfos[i];
+        double SLO = clientInfo["SLO"].asDouble() * 0.999; // avoid rounding errors
+        set<QueueId> path;
+        const Json::Value& clientFlows = clientInfo["flows"];
+        for (unsigned int flowIndex = 0; flowIndex < clientFlows.size(); flowIndex++) {
+            const Json::Value& flowInfo = clientFlows[flowIndex];
+            if (flowInfo["queues"].empty()) {
+                continue;
+            }
+            QueueId queueId = getQueueIdByName(flowInfo["queues"][0u].asString());
+            Curve arrivalCurve;
+            deserializeJSON(flowInfo, "arrivalInfo", arrivalCurve);
+            PointSlope initialPoint(0, 0, numeric_limits<double>::infinity());
+            arrivalCurve.insert(arrivalCurve.begin(), initialPoint);
+            vector<PrefilterFlow>& flows = stageFlows[queueId];
+            flows.resize(flows.size() + 1);
+            if (!getPrefilterFlow(arrivalCurve, queueId, SLO, flows.back())) {
+                return PREFILTER_BOUNDS;
+            }
+            path.insert(queueId);
+        }
+        newClientPaths.push_back(make_pair(SLO * (1 + WORKLOAD_COMPACTOR_PREFILTER_TOLERANCE), path));
+    }
+    // Get frontiers of existing flows starting at the new flows' first queues
+    for (map<QueueId, vector<PrefilterFlow> >::iterator it = stageFlows.begin(); it != stageFlows.end(); it++) {
+        const Queue* q = getQueue(it->first);
+        for (vector<FlowIndex>::const_iterator itFi = q->flows.begin(); itFi != q->flows.end(); itFi++) {
+            if (itFi->index != 0) {
+                continue;
+            }
+            const DNCFlow* f = static_cast<const DNCFlow*>(getFlow(itFi->flowId));
+            it->second.resize(it->second.size() + 1);
+            // Skip flows outside the bounds, which only loosens the conditions
+            if (!getPrefilterFlow(f->arrivalCurve, it->first, getClient(f->clientId)->SLO * 0.999, it->second.back())) {
+                it->second.pop_back();
+            }
+        }
+    }
+    // Check r constraints for each stage and get the maximum rate and minimum burst of each flow
+    // sum_k r_k <= 1
+    double rMax = 0.999 * (1 + WORKLOAD_COMPACTOR_PREFILTER_TOLERANCE); // avoid rounding errors
+    for (map<QueueId, vector<PrefilterFlow> >::iterator it = stageFlows.begin(); it != stageFlows.end(); it++) {
+        double rSum = 0;
+        for (vector<PrefilterFlow>::const_iterator itPf = it->second.begin(); itPf != it->second.end(); itPf++) {
+            rSum += itPf->minR;
+        }
+        if (rSum > rMax) {
+            return PREFILTER_RATE;
+        }
+        for (vector<PrefilterFlow>::iterator itPf = it->second.begin(); itPf != it->second.end(); itPf++) {
+            itPf->maxR = min(rMax, rMax - (rSum - itPf->minR));
+            itPf->minB = itPf->r.empty() ? 0 : getMinFrontierBurst(itPf->r, itPf->b, itPf->maxR);
+            if (itPf->minB > itPf->SLO) {
+                return PREFILTER_BURST;
+            }
+        }
+    }
+    // Check b constraints for each new client's SLO, for each stage in its path
+    // [sum_k|SLO_k<=SLO_i,k in path (b_k / SLO_i)] + [sum_k|SLO_k<SLO_i,k==stage (r_k)] <= relaxation
+    double relaxation = (_numShaperBuckets > 1) ? WORKLOAD_COMPACTOR_MAX_RELAXATION : 1;
+    for (vector<pair<double, set<QueueId> > >::const_iterator it = newClientPaths.begin(); it != newClientPaths.end(); it++) {
+        double SLO = it->first;
+        // Sum the minimum b terms of flows starting in the path, then replace the terms of flows starting at each stage with their minimum b and r terms
+        double bSum = 0;
+        for (set<QueueId>::const_iterator itQ = it->second.begin(); itQ != it->second.end(); itQ++) {
+            const vector<PrefilterFlow>& flows = stageFlows[*itQ];
+            for (vector<PrefilterFlow>::const_iterator itPf = flows.begin(); itPf != flows.end(); itPf++) {
+                if (itPf->SLO <= SLO) {
+                    bSum += itPf->minB / SLO;
                 }
             }
-        } else {
-            result = false;
-            // Set shaper curve to be uninitialized
-            for (set<ClientId>::iterator it = clientGroup.begin(); it != clientGroup.end(); it++) {
-                const Client* c = getClient(*it);
-                double SLO = c->SLO * 0.999; // avoid rounding errors
-                for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
-                    DNCFlow* f = getDNCFlow(c->flowIds[flowIndex]);
-                    f->shaperCurve = ZeroArrivalCurve();
-                    // Set priority
-                    setFlowPriority(f->flowId, SLOs[SLO]);
+        }
+        for (set<QueueId>::const_iterator itQ = it->second.begin(); itQ != it->second.end(); itQ++) {
+            double stageSum = bSum;
+            const vector<PrefilterFlow>& flows = stageFlows[*itQ];
+            for (vector<PrefilterFlow>::const_iterator itPf = flows.begin(); itPf != flows.end(); itPf++) {
+                if (itPf->SLO < SLO) {
+                    stageSum += getMinFrontierCost(itPf->r, itPf->b, itPf->maxR, itPf->SLO, 1, 1 / SLO) - itPf->minB / SLO;
                 }
             }
+            if (stageSum > relaxation * (1 + WORKLOAD_COMPACTOR_PREFILTER_TOLERANCE)) {
+                return PREFILTER_BURST;
+            }
         }
     }
-    return result;
+    return PREFILTER_PASSED;
 }
 
-double WorkloadCompactor::calcFlowLatency(FlowId flowId)
+void WorkloadCompactor::setSolverType(ShaperSolverType solverType)
+{
+    if (solverType == _solverType) {
+        return;
+    }
+    // Release GLPK LPs, which are rebuilt as needed if switching back
+    for (set<ShaperLP*>::iterator it = _lps.begin(); it != _lps.end(); it++) {
+        delete *it;
+    }
+    _lps.clear();
+    _clientLPs.clear();
+    _solverType = solverType;
+}
+
+WorkloadCompactor::~WorkloadCompactor()
+{
+    if (_solverPool) {
+        delete _solverPool;
+    }
+    for (set<ShaperLP*>::iterator it = _lps.begin(); it != _lps.end(); it++) {
+        delete *it;
+    }
+}
+
+void WorkloadCompactor::updateShaperParameters()
 {
-    // Re-optimize rate limit (i.e., shaper) parameters before calculating latency
     if (!_affectedQueueIds.empty()) {
         calcShaperParameters();
         _affectedQueueIds.clear();
     }
+}
+
+double WorkloadCompactor::calcFlowLatency(FlowId flowId)
+{
+    // Re-optimize rate limit (i.e., shaper) parameters before calculating latency
+    updateShaperParameters();
     return DNC::calcFlowLatency(flowId);
 }
 
@@ -259,16 +866,87 @@ ClientId WorkloadCompactor::addClient(const Json::Value& clientInfo)
     ClientId clientId = DNC::addClient(clientInfo);
     // Mark queues affected by workload addition
     const Client* c = getClient(clientId);
+    vector<QueueId> clientQueueIds;
     for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
         const Flow* f = getFlow(c->flowIds[flowIndex]);
         for (unsigned int queueIndex = 0; queueIndex < f->queueIds.size(); queueIndex++) {
             QueueId queueId = f->queueIds[queueIndex];
             _affectedQueueIds.insert(queueId);
+            clientQueueIds.push_back(queueId);
         }
     }
+    // Workloads without flows do not use any queues, so they are not part of a group
+    if (!clientQueueIds.empty()) {
+        _clientGroups.addClient(clientId, clientQueueIds);
+    }
+    return clientId;
+}
+
+ClientId WorkloadCompactor::restoreClient(const Json::Value& clientInfo, double latency, const vector<FlowSnapshot>& flows)
+{
+    // Add workload without marking its queues as affected
+    ClientId clientId = DNC::addClient(clientInfo);
+    Client* c = const_cast<Client*>(getClient(clientId));
+    assert(c->flowIds.size() == flows.size());
+    c->latency = latency;
+    // Restore optimized state of workload's flows
+    vector<QueueId> clientQueueIds;
+    for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
+        DNCFlow* f = getDNCFlow(c->flowIds[flowIndex]);
+        setShaperCurve(f->flowId, flows[flowIndex].shaperCurve, flows[flowIndex].peakCurves);
+        setFlowPriority(f->flowId, flows[flowIndex].priority);
+        f->latency = flows[flowIndex].latency;
+        clientQueueIds.insert(clientQueueIds.end(), f->queueIds.begin(), f->queueIds.end());
+    }
+    if (!clientQueueIds.empty()) {
+        _clientGroups.addClient(clientId, clientQueueIds);
+    }
     return clientId;
 }
 
+void WorkloadCompactor::restoreClientState(ClientId clientId, double latency, const vector<FlowSnapshot>& flows)
+{
+    Client* c = const_cast<Client*>(getClient(clientId));
+    assert(c->flowIds.size() == flows.size());
+    c->latency = latency;
+    for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
+        DNCFlow* f = getDNCFlow(c->flowIds[flowIndex]);
+        setShaperCurve(f->flowId, flows[flowIndex].shaperCurve, flows[flowIndex].peakCurves);
+        setFlowPriority(f->flowId, flows[flowIndex].priority);
+        f->latency = flows[flowIndex].latency;
+    }
+}
+
+void WorkloadCompactor::getClientState(ClientId clientId, vector<FlowSnapshot>& flows)
+{
+    const Client* c = getClient(clientId);
+    flows.resize(c->flowIds.size());
+    for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
+        const Flow* f = getFlow(c->flowIds[flowIndex]);
+        flows[flowIndex].shaperCurve = getShaperCurve(f->flowId);
+        flows[flowIndex].peakCurves = getPeakCurves(f->flowId);
+        flows[flowIndex].priority = f->priority;
+        flows[flowIndex].latency = f->latency;
+    }
+}
+
+void WorkloadCompactor::getAffectedClients(set<ClientId>& clientIds)
+{
+    for (set<QueueId>::const_iterator it = _affectedQueueIds.begin(); it != _affectedQueueIds.end(); it++) {
+        const set<ClientId>& clientGroup = _clientGroups.getGroupClients(_clientGroups.getGroupId(*it));
+        clientIds.insert(clientGroup.begin(), clientGroup.end());
+    }
+}
+
+void WorkloadCompactor::getConnectedQueues(const vector<QueueId>& queueIds, set<QueueId>& connectedQueueIds)
+{
+    for (vector<QueueId>::const_iterator it = queueIds.begin(); it != queueIds.end(); it++) {
+        connectedQueueIds.insert(*it);
+        const vector<QueueId>& groupQueueIds = _clientGroups.getGroupQueues(_clientGroups.getGroupId(*it));
+        connectedQueueIds.insert(groupQueueIds.begin(), groupQueueIds.end());
+    }
+}
+
 void WorkloadCompactor::delClient(ClientId clientId)
 {
     // Mark queues affected by workload deletion
@@ -281,5 +959,78 @@ void WorkloadCompactor::delClient(ClientId clientId)
         }
     }
     // Delete workload
+    if (!c->flowIds.empty()) {
+        _clientGroups.delClient(clientId);
+    }
+    releaseClientLP(clientId);
     DNC::delClient(clientId);
 }
+
+void WorkloadCompactor::delQueue(QueueId queueId)
+{
+    // Remove the queue from its group so that deleted queues do not accumulate in the union-find
+    _clientGroups.delQueue(queueId);
+    _affectedQueueIds.erase(queueId);
+    DNC::delQueue(queueId);
+}
+
+bool WorkloadCompactor::tryAddClients(const Json::Value& clientInfos, AdmissionCheck check, void* arg)
+{
+    // Save queues that are already pending re-optimization
+    set<QueueId> affectedQueueIds = _affectedQueueIds;
+    // Add workloads
+    set<ClientId> clientIds;
+    for (unsigned int i = 0; i < clientInfos.size(); i++) {
+        clientIds.insert(addClient(clientInfos[i]));
+    }
+    // Save state of existing workloads that will be re-optimized along with the new workloads
+    set<ClientId> clientGroup;
+    for (set<ClientId>::const_iterator it = clientIds.begin(); it != clientIds.end(); it++) {
+        const Client* c = getClient(*it);
+        if (c->flowIds.empty()) {
+            continue;
+        }
+        const set<ClientId>& groupClientIds = _clientGroups.getGroupClients(_clientGroups.getGroupId(getFlow(c->flowIds.front())->queueIds.front()));
+        clientGroup.insert(groupClientIds.begin(), groupClientIds.end());
+    }
+    vector<SavedFlowState> savedFlows;
+    vector<pair<ClientId, double> > savedClientLatencies;
+    for (set<ClientId>::const_iterator it = clientGroup.begin(); it != clientGroup.end(); it++) {
+        if (clientIds.find(*it) != clientIds.end()) {
+            continue;
+        }
+        const Client* c = getClient(*it);
+        savedClientLatencies.push_back(make_pair(c->clientId, c->latency));
+        for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
+            const DNCFlow* f = getDNCFlow(c->flowIds[flowIndex]);
+            SavedFlowState state;
+            state.flowId = f->flowId;
+            state.shaperCurve = f->shaperCurve;
+            state.peakCurves = f->peakCurves;
+            state.priority = f->priority;
+            state.latency = f->latency;
+            savedFlows.push_back(state);
+        }
+    }
+    // Check admission
+    bool admitted = check(this, clientIds, arg);
+    // Delete workloads without marking their queues as affected
+    for (set<ClientId>::const_iterator it = clientIds.begin(); it != clientIds.end(); it++) {
+        if (!getClient(*it)->flowIds.empty()) {
+            _clientGroups.delClient(*it);
+        }
+        releaseClientLP(*it);
+        DNC::delClient(*it);
+    }
+    // Restore state of existing workloads
+    for (vector<SavedFlowState>::const_iterator it = savedFlows.begin(); it != savedFlows.end(); it++) {
+        setShaperCurve(it->flowId, it->shaperCurve, it->peakCurves);
+        setFlowPriority(it->flowId, it->priority);
+        getDNCFlow(it->flowId)->latency = it->latency;
+    }
+    for (vector<pair<ClientId, double> >::const_iterator it = savedClientLatencies.begin(); it != savedClientLatencies.end(); it++) {
+        const_cast<Client*>(getClient(it->first))->latency = it->second;
+    }
+    _affectedQueueIds = affectedQueueIds;
+    return admitted;
+}
@@ -9,29 +9,205 @@
 
 #include <vector>
 #include <set>
+#include <map>
+#include <stdint.h>
+#include "Solver.hpp"
 #include "DNC.hpp"
+#include "ClientGroups.hpp"
+#include "ThreadPool.hpp"
+#include "ShaperSolver.hpp"
 
 using namespace std;
 
+// Default number of threads for solving the LPs of independent client groups
+#define WORKLOAD_COMPACTOR_SOLVER_THREADS 4
+
+// Solver backend for the rate limit parameter LP.
+enum ShaperSolverType {
+    SHAPER_SOLVER_GLPK, // persistent, warm-started GLPK LP per client group
+    SHAPER_SOLVER_NATIVE // dedicated ShaperSolver built per client group (see ShaperSolver.hpp)
+};
+
+// Relative tolerance of the prefilter's necessary conditions, so that workloads the LP solver accepts within its own tolerance are not rejected
+#define WORKLOAD_COMPACTOR_PREFILTER_TOLERANCE 1e-6
+
+// Necessary condition of the rate limit parameter LP that rejected workloads in WorkloadCompactor::prefilterClients.
+enum PrefilterCheck {
+    PREFILTER_PASSED, // all checks passed; the workloads may or may not be admitted
+    PREFILTER_BOUNDS, // a new flow's arrival curve has no (r, b) within the rate and SLO bounds
+    PREFILTER_RATE, // the minimum rates of the flows starting at a queue exceed the queue's bandwidth
+    PREFILTER_BURST // the minimum bursts of the flows sharing a new workload's queues exceed what its SLO allows
+};
+
+// Largest relaxation of the LP's b constraints in multi-bucket mode (see WorkloadCompactor::setNumShaperBuckets).
+// Relaxed LPs are retried with the relaxation's excess over 1 halved for WORKLOAD_COMPACTOR_RELAXATION_STEPS steps.
+#define WORKLOAD_COMPACTOR_MAX_RELAXATION 2
+#define WORKLOAD_COMPACTOR_RELAXATION_STEPS 3
+
+// Rate limit parameters, priority, and latency of a flow, as optimized with the other flows sharing its queues (see WorkloadCompactor::restoreClient).
+struct FlowSnapshot {
+    SimpleArrivalCurve shaperCurve;
+    vector<SimpleArrivalCurve> peakCurves;
+    unsigned int priority;
+    double latency;
+};
+
+// Variables and arrival curve constraints of a flow in a ShaperLP.
+struct ShaperLPFlow {
+    VariableHandle rVar;
+    VariableHandle bVar;
+    vector<ConstraintHandle> constraints;
+};
+
+// Identifies a constraint shared across flows in a ShaperLP.
+// The b constraint for (SLO_i, path, stage j in path) is (SLO_i, (path, j)), and the r constraint for a stage's queue is (0, ({queueId}, 0)).
+typedef pair<double, pair<vector<QueueId>, unsigned int> > SharedConstraintKey;
+
+// Persistent LP for a group of clients, which is updated incrementally as clients are added and deleted.
+// Keeping the LP around allows the solver to warm-start from the previous solution.
+struct ShaperLP {
+    SolverGLPK solver;
+    map<ClientId, vector<ShaperLPFlow> > clients; // variables and constraints of each client's flows, in the client's flow order
+    map<SharedConstraintKey, ConstraintHandle> sharedConstraints; // r and b constraints across flows
+    map<double, unsigned int> SLOCounts; // number of clients with each SLO
+    map<vector<QueueId>, unsigned int> pathCounts; // number of clients with each path of first queues
+    map<QueueId, unsigned int> stageCounts; // number of flows starting at each queue
+};
+
 class WorkloadCompactor : public DNC
 {
 private:
     set<QueueId> _affectedQueueIds; // track queues affected by adding/deleting workloads that need to be re-optimized
+    ClientGroups _clientGroups; // clients connected through shared queues, which are optimized together
+
+    // Rate limit parameters and latency of a flow, saved while speculatively adding clients.
+    struct SavedFlowState {
+        FlowId flowId;
+        SimpleArrivalCurve shaperCurve;
+        vector<SimpleArrivalCurve> peakCurves;
+        unsigned int priority;
+        double latency;
+    };
+
+    // Frontier and bounds of a flow's rate limit parameters in the LP, used by prefilterClients.
+    // Rates and bursts are normalized by the bandwidth of the flow's first queue.
+    struct PrefilterFlow {
+        QueueId queueId; // first queue of flow
+        double SLO; // SLO of flow's client, which bounds b in the LP
+        vector<double> r; // frontier r (see getFlowFrontier)
+        vector<double> b; // frontier b (see getFlowFrontier)
+        double minR; // minimum r with b within the SLO bound
+        double maxR; // maximum r, given the minimum rates of the other flows starting at the same queue
+        double minB; // minimum b with r within maxR
+    };
+
+    map<ClientId, ShaperLP*> _clientLPs; // LP containing each client
+    set<ShaperLP*> _lps; // LPs of client groups
+    ConstraintMatrix _constraintMatrix; // pooled buffer for building LP constraints
+    unsigned int _numSolverThreads; // number of threads for solving LPs
+    ThreadPool* _solverPool; // created once multiple LPs need to be solved
+    ShaperSolverType _solverType;
+    unsigned int _numShaperBuckets; // (r,b) rate limits per flow, i.e., the shaper curve and its peak curves
+    unsigned long _numLPSolves; // LPs solved by calcShaperParameters
 
+    // LP of a client group to solve and whether it was solved.
+    // Either lp is set for the GLPK backend, or nativeSolver is set for the native backend.
+    struct ShaperLPSolve {
+        const set<ClientId>* clientGroup;
+        ShaperLP* lp;
+        ShaperSolver* nativeSolver;
+        map<double, unsigned int> SLOs; // priority of each SLO
+        bool solved;
+        uint64_t traceId; // trace ID of the calling thread, for solver threads (see common/metrics.hpp)
+    };
+
+    // Get the path of first queues of a client's flows.
+    vector<QueueId> getClientPath(ClientId clientId) const;
+    // Update an LP's SLO, path, and stage counts for adding or removing a client.
+    void updateLPCounts(ShaperLP* lp, ClientId clientId, bool add);
+    // Add clients' flows to an LP, creating each flow's variables and arrival curve constraints.
+    void addClientsToLP(ShaperLP* lp, const vector<ClientId>& clientIds);
+    // Delete variables and constraints from an LP, and shift the remaining handles accordingly.
+    void deleteFromLP(ShaperLP* lp, vector<VariableHandle> vars, vector<ConstraintHandle> constraints);
+    // Remove clients' flows from their LP.
+    void removeClientsFromLP(ShaperLP* lp, const vector<ClientId>& clientIds);
+    // Remove a client from its LP, if any, deleting the LP once it has no clients.
+    void releaseClientLP(ClientId clientId);
+    // Get the LP for a group of clients, reusing the LP that already contains the most clients of the group.
+    ShaperLP* getGroupLP(const set<ClientId>& clientGroup);
+
+    // Get the priority of each SLO in an LP, where tighter SLOs have higher priority (i.e., lower value).
+    void getSLOPriorities(const ShaperLP* lp, map<double, unsigned int>& SLOs) const;
+    // Update the r and b constraints of a group's LP, where the right-hand side of the b constraints is relaxation.
+    void updateGroupLP(ShaperLP* lp, const set<ClientId>& clientGroup, double relaxation);
+    // Build a native solver for a group's LP and get the priority of each SLO, where the right-hand side of the b constraints is relaxation.
+    void buildNativeSolver(ShaperSolver* solver, const set<ClientId>& clientGroup, map<double, unsigned int>& SLOs, double relaxation);
+    // Set the shaper curves, peak curves, and priorities of a group's flows from its LP's solution.
+    void applyGroupSolution(const ShaperLPSolve& lpSolve);
+    // Check that the latencies of a group's clients are within their SLOs.
+    bool checkGroupLatencies(const set<ClientId>& clientGroup);
+    // Solve an infeasible group's LP with relaxed b constraints in multi-bucket mode, and apply the solution if the group's latencies are within their SLOs.
+    void solveRelaxedGroup(ShaperLPSolve& lpSolve);
+    // Solve a group's LP; thread pool task where arg is a vector<ShaperLPSolve>.
+    static void solveLPTask(void* arg, unsigned int index);
     // WorkloadCompactor's linear program for optimizing rate limit parameters at each queue.
     // See WorkloadCompactor paper for details.
     bool calcShaperParameters();
+    // Get a flow's frontier and minimum rate for prefilterClients; returns false if no (r, b) on the frontier is within the LP's bounds.
+    bool getPrefilterFlow(const Curve& arrivalCurve, QueueId queueId, double SLO, PrefilterFlow& pf) const;
+
+    WorkloadCompactor(const WorkloadCompactor&); // not implemented
+    WorkloadCompactor& operator=(const WorkloadCompactor&); // not implemented
 
 public:
-    WorkloadCompactor()
-    {}
-    virtual ~WorkloadCompactor()
+    // LPs of independent client groups are solved concurrently on numSolverThreads threads.
+    WorkloadCompactor(unsigned int numSolverThreads = WORKLOAD_COMPACTOR_SOLVER_THREADS)
+        : _numSolverThreads(numSolverThreads),
+          _solverPool(NULL),
+          _solverType(SHAPER_SOLVER_GLPK),
+          _numShaperBuckets(1),
+          _numLPSolves(0)
     {}
+    virtual ~WorkloadCompactor();
+
+    ShaperSolverType getSolverType() const { return _solverType; }
+    // Select the solver backend used by subsequent optimizations; switching releases the persistent GLPK LPs.
+    void setSolverType(ShaperSolverType solverType);
+    unsigned int getNumShaperBuckets() const { return _numShaperBuckets; }
+    // Set the number of (r,b) rate limits per flow used by subsequent optimizations, where 1 is a single rate limit from the LP.
+    // With more buckets, each flow gets up to numShaperBuckets - 1 peak rate limits on its frontier that cap its bursts at higher rates,
+    // and groups whose LP is infeasible are retried with relaxed b constraints, keeping the solution if the peak rate limits bring the group's latencies within their SLOs.
+    void setNumShaperBuckets(unsigned int numShaperBuckets) { _numShaperBuckets = (numShaperBuckets > 0) ? numShaperBuckets : 1; }
+    // Number of LPs solved since construction, including those of speculatively added clients.
+    unsigned long getNumLPSolves() const { return _numLPSolves; }
 
+    // Re-optimize the rate limit parameters of the queues affected by added/deleted clients, which is otherwise done when a latency is next calculated.
+    void updateShaperParameters();
     virtual double calcFlowLatency(FlowId flowId);
 
     virtual ClientId addClient(const Json::Value& clientInfo);
+    // Add a client whose flows were already optimized, e.g., when restoring a snapshot of the system, without re-optimizing its queues.
+    // flows holds the state of each of the client's flows, in flow order, and latency is the client's latency.
+    // The clients sharing the client's queues must be restored with their optimized state as well, and the GLPK LPs are rebuilt once the queues are next re-optimized.
+    ClientId restoreClient(const Json::Value& clientInfo, double latency, const vector<FlowSnapshot>& flows);
+    // Set the optimized state of an existing client's flows, e.g., as optimized by another WorkloadCompactor with the same clients, without re-optimizing its queues.
+    void restoreClientState(ClientId clientId, double latency, const vector<FlowSnapshot>& flows);
+    // Get the optimized state of each of a client's flows, in flow order, for restoreClient/restoreClientState.
+    void getClientState(ClientId clientId, vector<FlowSnapshot>& flows);
+    // Get the clients sharing queues with the queues pending re-optimization, i.e., the clients whose state updateShaperParameters may change.
+    void getAffectedClients(set<ClientId>& clientIds);
+    // Get the queues connected to a set of queues through shared clients, i.e., the queues of their groups, including the queues themselves.
+    void getConnectedQueues(const vector<QueueId>& queueIds, set<QueueId>& connectedQueueIds);
+    // Discard the pending re-optimization of queues, once the state of the affected clients has been restored with restoreClientState.
+    void discardShaperUpdates() { _affectedQueueIds.clear(); }
     virtual void delClient(ClientId clientId);
+    virtual void delQueue(QueueId queueId);
+    // Speculatively add clients without disturbing the rate limit parameters of existing workloads.
+    // Existing workloads that are re-optimized with the new clients are restored afterwards, so the LP does not need to be re-solved.
+    virtual bool tryAddClients(const Json::Value& clientInfos, AdmissionCheck check, void* arg);
+    // Check necessary conditions for the LP to be feasible once clients are added, in time linear in the number of flows at the clients' queues.
+    // The conditions relax the LP's constraints, so clients that are rejected (i.e., not PREFILTER_PASSED) would also fail admission control.
+    PrefilterCheck prefilterClients(const Json::Value& clientInfos) const;
 };
 
 #endif // WORKLOAD_COMPACTOR_HPP
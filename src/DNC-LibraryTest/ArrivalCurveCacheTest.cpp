@@ -0,0 +1,99 @@
+// ArrivalCurveCacheTest.cpp - ArrivalCurveCache test code.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <limits>
+#include <json/json.h>
+#include "../DNC-Library/DNC.hpp"
+#include "../DNC-Library/ArrivalCurveCache.hpp"
+#include "DNC-LibraryTest.hpp"
+
+using namespace std;
+
+// Check that two arrival curves are the same.
+static bool sameCurve(const Curve& A, const Curve& B)
+{
+    if (A.size() != B.size()) {
+        return false;
+    }
+    for (unsigned int i = 0; i < A.size(); i++) {
+        if ((A[i].x != B[i].x) || (A[i].y != B[i].y) || (A[i].slope != B[i].slope)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Test that arrival curves are stored in memory and on disk.
+static void testGetPut()
+{
+    const char* tmpFilename = "testArrivalCurveCache.tmp";
+    remove(tmpFilename);
+    ArrivalCurveCache::clear();
+    Curve arrivalCurve;
+    arrivalCurve.push_back(PointSlope(0, 0, numeric_limits<double>::infinity()));
+    arrivalCurve.push_back(PointSlope(0, 10, 5));
+    arrivalCurve.push_back(PointSlope(2, 20, 0.25));
+    Curve curve;
+    assert(ArrivalCurveCache::get(tmpFilename, curve) == false);
+    assert(ArrivalCurveCache::get("", curve) == false);
+    ArrivalCurveCache::put(tmpFilename, arrivalCurve);
+    assert(ArrivalCurveCache::get(tmpFilename, curve) == true);
+    assert(sameCurve(curve, arrivalCurve));
+    // Check file was written and read back from disk
+    ArrivalCurveCache::clear();
+    curve.clear();
+    assert(ArrivalCurveCache::get(tmpFilename, curve) == true);
+    assert(sameCurve(curve, arrivalCurve));
+    // Check memory is in front of disk
+    remove(tmpFilename);
+    curve.clear();
+    assert(ArrivalCurveCache::get(tmpFilename, curve) == true);
+    assert(sameCurve(curve, arrivalCurve));
+    // Check eviction
+    ArrivalCurveCache::setCapacity(0);
+    assert(ArrivalCurveCache::get(tmpFilename, curve) == false);
+    ArrivalCurveCache::setCapacity(ARRIVAL_CURVE_CACHE_CAPACITY);
+}
+
+// Test that arrival curve hashes depend on trace contents, estimator parameters, max rate, and algorithm.
+static void testArrivalCurveHash()
+{
+    const char* tmpFilename = "testArrivalCurveHash.tmp";
+    {
+        ofstream file(tmpFilename);
+        file << "1000,0x200,DiskRead" << endl;
+    }
+    Json::Value estimatorInfo;
+    estimatorInfo["type"] = Json::Value("networkIn");
+    string hash = getArrivalCurveHash(tmpFilename, estimatorInfo, 1);
+    assert(hash.size() == 16);
+    assert(hash == getArrivalCurveHash(tmpFilename, estimatorInfo, 1));
+    assert(hash != getArrivalCurveHash(tmpFilename, estimatorInfo, 2));
+    assert(hash != getArrivalCurveHash(tmpFilename, estimatorInfo, 1, ARRIVAL_CURVE_ALGORITHM_EXACT));
+    assert(hash != getArrivalCurveHash("testTrace.txt", estimatorInfo, 1));
+    Json::Value otherEstimatorInfo;
+    otherEstimatorInfo["type"] = Json::Value("networkOut");
+    assert(hash != getArrivalCurveHash(tmpFilename, otherEstimatorInfo, 1));
+    // Check that changing the trace contents changes the hash
+    {
+        ofstream file(tmpFilename);
+        file << "1000,0x4000,DiskRead" << endl;
+    }
+    assert(hash != getArrivalCurveHash(tmpFilename, estimatorInfo, 1));
+    remove(tmpFilename);
+}
+
+void ArrivalCurveCacheTest()
+{
+    testGetPut();
+    testArrivalCurveHash();
+    cout << "PASS ArrivalCurveCacheTest" << endl;
+}
@@ -0,0 +1,97 @@
+// BinaryTraceReaderTest.cpp - BinaryTraceReader test code.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+#include <json/json.h>
+#include "../Estimator/Estimator.hpp"
+#include "../TraceCommon/TraceReader.hpp"
+#include "../TraceCommon/BinaryTraceReader.hpp"
+#include "../TraceCommon/ProcessedTrace.hpp"
+#include "DNC-LibraryTest.hpp"
+
+using namespace std;
+
+// Convert a CSV trace to a binary trace and check that both contain the same entries.
+static void testConvert(string csvFilename, string binaryFilename)
+{
+    TraceReader csvReader(csvFilename);
+    assert(BinaryTraceReader::write(csvReader, binaryFilename));
+    assert(!BinaryTraceReader::isBinaryTrace(csvFilename));
+    assert(BinaryTraceReader::isBinaryTrace(binaryFilename));
+    TraceReader* pBinaryReader = TraceReader::create(binaryFilename);
+    TraceReader* pClonedReader = pBinaryReader->clone();
+    for (int i = 0; i < 2; i++) {
+        csvReader.reset();
+        TraceEntry csvEntry;
+        TraceEntry binaryEntry;
+        TraceEntry clonedEntry;
+        while (csvReader.nextEntry(csvEntry)) {
+            assert(pBinaryReader->nextEntry(binaryEntry) == true);
+            assert(binaryEntry.arrivalTime == csvEntry.arrivalTime);
+            assert(binaryEntry.requestSize == csvEntry.requestSize);
+            assert(binaryEntry.isRead == csvEntry.isRead);
+            assert(pClonedReader->nextEntry(clonedEntry) == true);
+            assert(clonedEntry.arrivalTime == csvEntry.arrivalTime);
+        }
+        assert(pBinaryReader->nextEntry(binaryEntry) == false);
+        pBinaryReader->reset();
+        pClonedReader->reset();
+    }
+    delete pClonedReader;
+    delete pBinaryReader;
+}
+
+void BinaryTraceReaderTest()
+{
+    const char* binaryFilename = "testTraceBinary.tmp";
+    testConvert("testTrace.txt", binaryFilename);
+    testConvert("testTrace.csv", binaryFilename);
+
+    // Test ProcessedTrace detects the binary format
+    Json::Value estimatorInfo;
+    estimatorInfo["type"] = Json::Value("networkIn");
+    estimatorInfo["nonDataConstant"] = Json::Value(1024);
+    estimatorInfo["nonDataFactor"] = Json::Value(0.5);
+    estimatorInfo["dataConstant"] = Json::Value(512);
+    estimatorInfo["dataFactor"] = Json::Value(2.0);
+    ProcessedTrace csvTrace("testTrace.csv", Estimator::create(estimatorInfo));
+    ProcessedTrace binaryTrace(binaryFilename, Estimator::create(estimatorInfo));
+    ProcessedTraceEntry csvEntry;
+    ProcessedTraceEntry binaryEntry;
+    while (csvTrace.nextEntry(csvEntry)) {
+        assert(binaryTrace.nextEntry(binaryEntry) == true);
+        assert(binaryEntry.arrivalTime == csvEntry.arrivalTime);
+        assert(binaryEntry.work == csvEntry.work);
+        assert(binaryEntry.isRead == csvEntry.isRead);
+    }
+    assert(binaryTrace.nextEntry(binaryEntry) == false);
+
+    // Test decreasing timestamps and large values
+    const char* csvFilename = "testTraceUnsorted.tmp";
+    {
+        ofstream file(csvFilename);
+        file << "18446744073709551615,0xffffffff,DiskRead" << endl;
+        file << "5,0x0,DiskWrite" << endl;
+        file << "3,0x80,DiskRead" << endl;
+    }
+    testConvert(csvFilename, binaryFilename);
+
+    // Test truncated file
+    TraceReader csvReader(csvFilename);
+    assert(BinaryTraceReader::write(csvReader, binaryFilename));
+    assert(truncate(binaryFilename, BINARY_TRACE_HEADER_SIZE + 3) == 0);
+    BinaryTraceReader truncatedReader(binaryFilename);
+    TraceEntry entry;
+    assert(truncatedReader.nextEntry(entry) == false);
+
+    remove(csvFilename);
+    remove(binaryFilename);
+    cout << "PASS BinaryTraceReaderTest" << endl;
+}
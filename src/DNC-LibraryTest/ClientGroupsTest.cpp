@@ -0,0 +1,141 @@
+// ClientGroupsTest.cpp - ClientGroups test code.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cassert>
+#include <iostream>
+#include <vector>
+#include <set>
+#include <map>
+#include <iterator>
+#include <cstdlib>
+#include "../DNC-Library/ClientGroups.hpp"
+#include "DNC-LibraryTest.hpp"
+
+using namespace std;
+
+// Make a vector of queues.
+static vector<QueueId> makeQueueIds(QueueId q1, QueueId q2)
+{
+    vector<QueueId> queueIds;
+    queueIds.push_back(q1);
+    queueIds.push_back(q2);
+    return queueIds;
+}
+
+// Compute the clients connected to a queue by searching through the clients' queues.
+static set<ClientId> referenceGroup(const map<ClientId, vector<QueueId> >& clients, QueueId queueId)
+{
+    set<QueueId> visitedQueueIds;
+    set<ClientId> group;
+    vector<QueueId> pendingQueueIds(1, queueId);
+    visitedQueueIds.insert(queueId);
+    while (!pendingQueueIds.empty()) {
+        QueueId q = pendingQueueIds.back();
+        pendingQueueIds.pop_back();
+        for (map<ClientId, vector<QueueId> >::const_iterator it = clients.begin(); it != clients.end(); it++) {
+            const vector<QueueId>& queueIds = it->second;
+            bool found = false;
+            for (unsigned int i = 0; i < queueIds.size(); i++) {
+                found = found || (queueIds[i] == q);
+            }
+            if (found && group.insert(it->first).second) {
+                for (unsigned int i = 0; i < queueIds.size(); i++) {
+                    if (visitedQueueIds.insert(queueIds[i]).second) {
+                        pendingQueueIds.push_back(queueIds[i]);
+                    }
+                }
+            }
+        }
+    }
+    return group;
+}
+
+void ClientGroupsTest()
+{
+    // Test merging and splitting
+    {
+        ClientGroups groups;
+        groups.addClient(1, makeQueueIds(1, 2));
+        groups.addClient(2, makeQueueIds(3, 4));
+        assert(groups.getGroupId(1) == groups.getGroupId(2));
+        assert(groups.getGroupId(1) != groups.getGroupId(3));
+        assert(groups.getGroupClients(groups.getGroupId(1)).size() == 1);
+        assert(groups.getGroupClients(groups.getGroupId(5)).empty());
+        // Client 3 connects both groups
+        groups.addClient(3, makeQueueIds(2, 3));
+        QueueId groupId = groups.getGroupId(4);
+        assert(groups.getGroupId(1) == groupId);
+        assert(groups.getGroupClients(groupId).size() == 3);
+        assert(groups.getGroupQueues(groupId).size() == 4);
+        // Deleting client 3 splits the group
+        groups.delClient(3);
+        assert(groups.getGroupId(1) != groups.getGroupId(4));
+        assert(groups.getGroupQueues(groups.getGroupId(4)).size() == 2);
+        assert(groups.getGroupQueues(groups.getGroupId(5)).empty());
+        assert(groups.getGroupClients(groups.getGroupId(1)).count(1) == 1);
+        assert(groups.getGroupClients(groups.getGroupId(4)).count(2) == 1);
+        assert(groups.getGroupClients(groups.getGroupId(4)).size() == 1);
+        // Deleting the last client of a group removes the group
+        groups.delClient(1);
+        assert(groups.getGroupClients(groups.getGroupId(1)).empty());
+        assert(groups.getGroupId(1) != groups.getGroupId(2));
+    }
+
+    // Test deleting queues
+    {
+        ClientGroups groups;
+        groups.addClient(1, makeQueueIds(1, 2));
+        groups.addClient(2, makeQueueIds(2, 5));
+        groups.delClient(2);
+        // Queue 5 is no longer used, but is still in the group until it is split
+        groups.delQueue(5);
+        assert(groups.getGroupId(5) == 5);
+        assert(groups.getGroupClients(5).empty());
+        assert(groups.getGroupId(1) == groups.getGroupId(2));
+        assert(groups.getGroupClients(groups.getGroupId(1)).size() == 1);
+        // Unknown queues are not added
+        groups.delQueue(7);
+        assert(groups.getGroupId(7) == 7);
+        assert(groups.getGroupClients(7).empty());
+    }
+
+    // Test random additions and deletions against a search of the clients' queues
+    {
+        srand(1);
+        ClientGroups groups;
+        map<ClientId, vector<QueueId> > clients;
+        ClientId nextClientId = 1;
+        const QueueId numQueues = 30;
+        for (unsigned int iteration = 0; iteration < 1000; iteration++) {
+            if (clients.empty() || (rand() % 3 != 0)) {
+                vector<QueueId> queueIds;
+                unsigned int numClientQueues = 1 + rand() % 3;
+                for (unsigned int i = 0; i < numClientQueues; i++) {
+                    queueIds.push_back(rand() % numQueues);
+                }
+                clients[nextClientId] = queueIds;
+                groups.addClient(nextClientId, queueIds);
+                nextClientId++;
+            } else {
+                map<ClientId, vector<QueueId> >::iterator it = clients.begin();
+                advance(it, rand() % clients.size());
+                groups.delClient(it->first);
+                clients.erase(it);
+            }
+            QueueId queueId = rand() % numQueues;
+            assert(groups.getGroupClients(groups.getGroupId(queueId)) == referenceGroup(clients, queueId));
+        }
+        for (QueueId queueId = 0; queueId < numQueues; queueId++) {
+            set<ClientId> group = referenceGroup(clients, queueId);
+            assert(groups.getGroupClients(groups.getGroupId(queueId)) == group);
+            for (set<ClientId>::const_iterator it = group.begin(); it != group.end(); it++) {
+                assert(groups.getGroupId(clients[*it].front()) == groups.getGroupId(queueId));
+            }
+        }
+    }
+
+    cout << "PASS ClientGroupsTest" << endl;
+}
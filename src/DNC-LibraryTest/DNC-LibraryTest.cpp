@@ -12,13 +12,21 @@ using namespace std;
 int main(int argc, char** argv)
 {
     TraceReaderTest();
+    BinaryTraceReaderTest();
+    StreamingTraceReaderTest();
     NetworkEstimatorTest();
     StorageSSDEstimatorTest();
     ProcessedTraceTest();
     serializeJSONTest();
     SolverGLPKTest();
+    SlotMapTest();
+    ClientGroupsTest();
+    ThreadPoolTest();
+    ShaperSolverTest();
     NCTest();
     DNCTest();
+    ArrivalCurveCacheTest();
+    SlidingArrivalCurveTest();
     WorkloadCompactorTest();
     cout << "PASS" << endl;
     return 0;
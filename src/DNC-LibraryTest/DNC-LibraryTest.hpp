@@ -23,13 +23,21 @@ inline bool approxEqual(double x, double y, double epsilon = 1e-9)
 }
 
 void TraceReaderTest();
+void BinaryTraceReaderTest();
+void StreamingTraceReaderTest();
 void NetworkEstimatorTest();
 void StorageSSDEstimatorTest();
 void ProcessedTraceTest();
 void serializeJSONTest();
 void SolverGLPKTest();
+void SlotMapTest();
+void ClientGroupsTest();
+void ThreadPoolTest();
+void ShaperSolverTest();
 void NCTest();
 void DNCTest();
+void ArrivalCurveCacheTest();
+void SlidingArrivalCurveTest();
 void WorkloadCompactorTest();
 
 #endif // _UNIT_TEST_HPP
@@ -7,9 +7,12 @@
 #include <cassert>
 #include <cstdlib>
 #include <limits>
+#include <cmath>
 #include <iostream>
+#include <sstream>
 #include <vector>
 #include "../common/serializeJSON.hpp"
+#include "../common/time.hpp"
 #include "../Estimator/Estimator.hpp"
 #include "../TraceCommon/ProcessedTrace.hpp"
 #include "../DNC-Library/DNC.hpp"
@@ -40,11 +43,111 @@ protected:
         return flowId;
     }
 
+    // Hop-by-hop analysis without memoization for checking DNC_SIMPLE_ALGORITHM_HOP_BY_HOP.
+    SimpleArrivalCurve referenceArrivalCurveAtQueue(const DNCFlow* f, unsigned int index)
+    {
+        if (index == 0) {
+            return f->shaperCurve;
+        }
+        return OutputArrivalCurve(referenceArrivalCurveAtQueue(f, index - 1), referenceServiceCurveAtQueue(f, index - 1));
+    }
+    SimpleServiceCurve referenceServiceCurveAtQueue(const DNCFlow* f, unsigned int index)
+    {
+        const Queue* q = getQueue(f->queueIds[index]);
+        SimpleServiceCurve serviceCurve = ConstantServiceCurve(q);
+        for (vector<FlowIndex>::const_iterator it = q->flows.begin(); it != q->flows.end(); it++) {
+            const DNCFlow* flow = getDNCFlow(it->flowId);
+            if ((flow->priority <= f->priority) && (flow->flowId != f->flowId)) {
+                serviceCurve = LeftoverServiceCurve(referenceArrivalCurveAtQueue(flow, it->index), serviceCurve);
+            }
+        }
+        return serviceCurve;
+    }
+
 public:
-    TestDNC()
+    TestDNC(DNCAlgorithm algorithm = DNC_SIMPLE_ALGORITHM_AGGREGATE)
+        : DNC(algorithm)
     {}
     virtual ~TestDNC()
     {}
+
+    double referenceHopByHopLatency(FlowId flowId)
+    {
+        const DNCFlow* flow = getDNCFlow(flowId);
+        SimpleArrivalCurve arrivalCurve = flow->shaperCurve;
+        double latency = 0;
+        for (unsigned int index = 0; index < flow->queueIds.size(); index++) {
+            SimpleServiceCurve serviceCurve = referenceServiceCurveAtQueue(flow, index);
+            latency += DNCLatencyBound(arrivalCurve, serviceCurve);
+            arrivalCurve = OutputArrivalCurve(arrivalCurve, serviceCurve);
+        }
+        return latency;
+    }
+
+    // Two hop aggregate analysis that iterates over the flows of each queue for checking DNC_SIMPLE_ALGORITHM_AGGREGATE.
+    double referenceAggregateLatency(FlowId flowId)
+    {
+        const DNCFlow* flow = getDNCFlow(flowId);
+        QueueId firstQueueId = flow->queueIds[0];
+        QueueId secondQueueId = (flow->queueIds.size() > 1) ? flow->queueIds[1] : InvalidQueueId;
+        // Calculate second queue leftover service from first queues that feed into the second queue
+        SimpleServiceCurve secondQueueServiceCurve;
+        if (secondQueueId != InvalidQueueId) {
+            const Queue* secondQueue = getQueue(secondQueueId);
+            map<QueueId, unsigned int> firstQueueIds; // first QueueId -> lowest competing priority
+            for (vector<FlowIndex>::const_iterator it = secondQueue->flows.begin(); it != secondQueue->flows.end(); it++) {
+                const DNCFlow* f = getDNCFlow(it->flowId);
+                if ((f->queueIds[0] != firstQueueId) && (f->priority <= flow->priority)) {
+                    map<QueueId, unsigned int>::iterator firstIt = firstQueueIds.find(f->queueIds[0]);
+                    if ((firstIt == firstQueueIds.end()) || (f->priority > firstIt->second)) {
+                        firstQueueIds[f->queueIds[0]] = f->priority;
+                    }
+                }
+            }
+            secondQueueServiceCurve = ConstantServiceCurve(secondQueue);
+            for (map<QueueId, unsigned int>::const_iterator it = firstQueueIds.begin(); it != firstQueueIds.end(); it++) {
+                const Queue* q = getQueue(it->first);
+                SimpleArrivalCurve firstQueueArrivalCurve = ZeroArrivalCurve();
+                SimpleServiceCurve firstQueueServiceCurve = ConstantServiceCurve(q);
+                for (vector<FlowIndex>::const_iterator flowIt = q->flows.begin(); flowIt != q->flows.end(); flowIt++) {
+                    const DNCFlow* f = getDNCFlow(flowIt->flowId);
+                    if (f->priority <= it->second) {
+                        if ((f->queueIds.size() > 1) && (f->queueIds[1] == secondQueueId)) {
+                            firstQueueArrivalCurve = AggregateArrivalCurve(f->shaperCurve, firstQueueArrivalCurve);
+                        } else {
+                            firstQueueServiceCurve = LeftoverServiceCurve(f->shaperCurve, firstQueueServiceCurve);
+                        }
+                    }
+                }
+                secondQueueServiceCurve = LeftoverServiceCurve(OutputArrivalCurve(firstQueueArrivalCurve, firstQueueServiceCurve), secondQueueServiceCurve);
+            }
+        }
+        // Calculate first hop service
+        const Queue* firstQueue = getQueue(firstQueueId);
+        SimpleArrivalCurve arrivalCurve = ZeroArrivalCurve();
+        SimpleArrivalCurve shareArrivalCurve = ZeroArrivalCurve();
+        SimpleServiceCurve serviceCurve = ConstantServiceCurve(firstQueue);
+        for (vector<FlowIndex>::const_iterator it = firstQueue->flows.begin(); it != firstQueue->flows.end(); it++) {
+            const DNCFlow* f = getDNCFlow(it->flowId);
+            if (f->priority <= flow->priority) {
+                QueueId downstreamQueueId = (f->queueIds.size() > 1) ? f->queueIds[1] : InvalidQueueId;
+                // One hop flows consider all flows of the first queue as sharing its path
+                if ((secondQueueId == InvalidQueueId) || (downstreamQueueId == secondQueueId)) {
+                    if (f->priority == flow->priority) {
+                        arrivalCurve = AggregateArrivalCurve(f->shaperCurve, arrivalCurve);
+                    } else {
+                        shareArrivalCurve = AggregateArrivalCurve(f->shaperCurve, shareArrivalCurve);
+                    }
+                } else {
+                    serviceCurve = LeftoverServiceCurve(f->shaperCurve, serviceCurve);
+                }
+            }
+        }
+        if (secondQueueId != InvalidQueueId) {
+            serviceCurve = ConvolutionServiceCurve(serviceCurve, secondQueueServiceCurve);
+        }
+        return DNCLatencyBound(arrivalCurve, LeftoverServiceCurve(shareArrivalCurve, serviceCurve));
+    }
 };
 
 static void buildArrivalCurve(Curve& arrivalCurve, unsigned int count, double initialY, double xArr[], double slopeArr[])
@@ -120,6 +223,64 @@ void testRbGen(ProcessedTrace* pTrace0, ProcessedTrace* pTrace1)
     assert(bursts1[0.25] == 30); // hand calculated from testTrace.csv
 }
 
+// Reference map-based r-b curve calculation used to check rbGen.
+static void rbGenReference(ProcessedTrace* pTrace, const vector<double>& rates, map<double, double>& bursts)
+{
+    map<double, double> virtualBucket;
+    for (unsigned int i = 0; i < rates.size(); i++) {
+        double rate = rates[i];
+        virtualBucket[rate] = 0;
+        bursts[rate] = 0;
+    }
+    pTrace->reset();
+    uint64_t prevTimestamp = 0;
+    ProcessedTraceEntry traceEntry;
+    while (pTrace->nextEntry(traceEntry)) {
+        double interarrival = ConvertTimeToSeconds(traceEntry.arrivalTime - prevTimestamp);
+        for (unsigned int i = 0; i < rates.size(); i++) {
+            double rate = rates[i];
+            virtualBucket[rate] -= rate * interarrival;
+            if (virtualBucket[rate] < 0) {
+                virtualBucket[rate] = 0;
+            }
+            virtualBucket[rate] += traceEntry.work;
+            if (virtualBucket[rate] > bursts[rate]) {
+                bursts[rate] = virtualBucket[rate];
+            }
+        }
+        prevTimestamp = traceEntry.arrivalTime;
+    }
+}
+
+void testRbGenReference(ProcessedTrace* pTrace)
+{
+    // Use a number of rates that is not a multiple of the vector width
+    double maxRate = 2;
+    vector<double> rates;
+    for (double rate = maxRate; rate >= 0.1; rate -= 0.001 * maxRate) {
+        rates.push_back(rate);
+    }
+    rates.push_back(0);
+    map<double, double> expectedBursts;
+    rbGenReference(pTrace, rates, expectedBursts);
+    vector<double> bursts;
+    rbGen(pTrace, rates, bursts);
+    assert(bursts.size() == rates.size());
+    for (unsigned int i = 0; i < rates.size(); i++) {
+        assert(approxEqual(bursts[i], expectedBursts[rates[i]]));
+    }
+    map<double, double> burstsMap;
+    rbGen(pTrace, rates, burstsMap);
+    assert(burstsMap.size() == expectedBursts.size());
+    for (unsigned int i = 0; i < rates.size(); i++) {
+        assert(approxEqual(burstsMap[rates[i]], expectedBursts[rates[i]]));
+    }
+    // Test empty rates
+    rates.clear();
+    rbGen(pTrace, rates, bursts);
+    assert(bursts.empty());
+}
+
 void testRbCurveToArrivalCurve()
 {
     Curve arrivalCurve0;
@@ -239,6 +400,141 @@ void testRbCurveToArrivalCurve()
     assert(equalCurve(calcArrivalCurve1, arrivalCurve1));
 }
 
+void testCalcMinRateAndRbGen(ProcessedTrace* pTrace)
+{
+    vector<double> rates;
+    for (double rate = 2; rate >= 0; rate -= 0.002) {
+        rates.push_back(rate);
+    }
+    vector<double> expectedBursts;
+    rbGen(pTrace, rates, expectedBursts);
+    vector<double> bursts;
+    assert(calcMinRateAndRbGen(pTrace, rates, bursts) == calcMinRate(pTrace));
+    assert(bursts == expectedBursts);
+    assert(calcMinRateAndRbGen(pTrace, rates, bursts, 4) == calcMinRate(pTrace));
+    assert(bursts == expectedBursts);
+}
+
+void testRbGenThreads(ProcessedTrace* pTrace)
+{
+    double maxRate = 2;
+    vector<double> rates;
+    for (double rate = maxRate; rate >= 0.1; rate -= 0.001 * maxRate) {
+        rates.push_back(rate);
+    }
+    vector<double> expectedBursts;
+    rbGen(pTrace, rates, expectedBursts);
+    for (unsigned int numThreads = 2; numThreads <= 64; numThreads *= 2) {
+        vector<double> bursts;
+        rbGen(pTrace, rates, bursts, numThreads);
+        assert(bursts == expectedBursts);
+    }
+}
+
+void testSetArrivalInfos(Json::Value& estimatorInfo0, Json::Value& estimatorInfo1)
+{
+    double maxRate = 2;
+    Json::Value flowInfo0;
+    Json::Value flowInfo1;
+    vector<ArrivalInfoRequest> requests(2);
+    requests[0].flowInfo = &flowInfo0;
+    requests[0].estimatorInfo = estimatorInfo0;
+    requests[0].maxRate = maxRate;
+    requests[0].arrivalCurveFilename = "";
+    requests[1].flowInfo = &flowInfo1;
+    requests[1].estimatorInfo = estimatorInfo1;
+    requests[1].maxRate = maxRate;
+    requests[1].arrivalCurveFilename = "";
+    DNC::setArrivalInfos(requests, "testTrace.csv", ARRIVAL_CURVE_ALGORITHM_RATE_SAMPLED, 4);
+    // Compare against setting each flow separately
+    Json::Value expectedFlowInfo0;
+    Json::Value expectedFlowInfo1;
+    DNC::setArrivalInfo(expectedFlowInfo0, "testTrace.csv", estimatorInfo0, maxRate, "");
+    DNC::setArrivalInfo(expectedFlowInfo1, "testTrace.csv", estimatorInfo1, maxRate, "");
+    assert(flowInfo0 == expectedFlowInfo0);
+    assert(flowInfo1 == expectedFlowInfo1);
+    assert(flowInfo0 != flowInfo1);
+}
+
+// Evaluate an arrival curve at x >= 0.
+static double evalArrivalCurve(const Curve& arrivalCurve, double x)
+{
+    unsigned int index = 1;
+    while ((index + 1 < arrivalCurve.size()) && (arrivalCurve[index + 1].x <= x)) {
+        index++;
+    }
+    const PointSlope& p = arrivalCurve[index];
+    return p.y + p.slope * (x - p.x);
+}
+
+void testCalcExactArrivalCurve(ProcessedTrace* pTrace)
+{
+    double maxRate = 2;
+    Curve exactArrivalCurve;
+    calcExactArrivalCurve(exactArrivalCurve, pTrace, maxRate);
+    assert(exactArrivalCurve.size() > 2);
+    // Test curve is concave
+    for (unsigned int i = 2; i < exactArrivalCurve.size(); i++) {
+        assert(exactArrivalCurve[i].x > exactArrivalCurve[i - 1].x);
+        assert(exactArrivalCurve[i].slope < exactArrivalCurve[i - 1].slope);
+        assert(approxEqual(exactArrivalCurve[i].y, evalArrivalCurve(exactArrivalCurve, exactArrivalCurve[i].x - 1e-12), 1e-6));
+    }
+    // Read trace
+    vector<double> times;
+    vector<double> works;
+    pTrace->reset();
+    ProcessedTraceEntry traceEntry;
+    while (pTrace->nextEntry(traceEntry)) {
+        times.push_back(ConvertTimeToSeconds(traceEntry.arrivalTime));
+        works.push_back(traceEntry.work);
+    }
+    // Test curve bounds the work of every interval
+    for (unsigned int i = 0; i < times.size(); i++) {
+        double work = 0;
+        for (unsigned int j = i; j < times.size(); j++) {
+            work += works[j];
+            assert(work <= evalArrivalCurve(exactArrivalCurve, times[j] - times[i]) + 1e-9);
+        }
+    }
+    // Test curve is tight at each vertex
+    for (unsigned int index = 2; index < exactArrivalCurve.size(); index++) {
+        const PointSlope& p = exactArrivalCurve[index];
+        double maxWork = 0;
+        for (unsigned int i = 0; i < times.size(); i++) {
+            double work = 0;
+            for (unsigned int j = i; (j < times.size()) && (times[j] - times[i] <= p.x + 1e-9); j++) {
+                work += works[j];
+            }
+            maxWork = max(maxWork, work);
+        }
+        assert(approxEqual(maxWork, p.y));
+    }
+    // Test curve is at least as tight as the rate sampled curve
+    double minRate = calcMinRate(pTrace);
+    vector<double> rates;
+    for (double rate = maxRate; rate >= minRate; rate -= 0.001 * maxRate) {
+        rates.push_back(rate);
+    }
+    vector<double> bursts;
+    rbGen(pTrace, rates, bursts);
+    Curve sampledArrivalCurve;
+    rbCurveToArrivalCurve(sampledArrivalCurve, rates, bursts);
+    for (double x = 0; x < 100; x += 0.25) {
+        double exactY = evalArrivalCurve(exactArrivalCurve, x);
+        double sampledY = evalArrivalCurve(sampledArrivalCurve, x);
+        assert(exactY <= sampledY + 1e-9);
+        assert(exactY >= sampledY - 0.01 * sampledY);
+    }
+    // Test pruning to the same budget as the rate sampled curve
+    Curve arrivalCurve;
+    calcArrivalCurve(arrivalCurve, pTrace, maxRate, ARRIVAL_CURVE_ALGORITHM_EXACT);
+    assert(arrivalCurve.size() <= ARRIVAL_CURVE_NUM_POINTS + 1);
+    assert(arrivalCurve[1].x == 0);
+    for (double x = 0; x < 100; x += 0.25) {
+        assert(evalArrivalCurve(arrivalCurve, x) >= evalArrivalCurve(exactArrivalCurve, x) - 1e-9);
+    }
+}
+
 void testCalcPointSlopeIntersection()
 {
     // Test positive slope
@@ -748,6 +1044,132 @@ void DNCTestTwoHops()
     delete nc;
 }
 
+// Return a name made of a prefix and index.
+static string indexName(string prefix, unsigned int index)
+{
+    ostringstream oss;
+    oss << prefix << index;
+    return oss.str();
+}
+
+// Add numQueues queues and flows that each traverse pathLength consecutive queues.
+static void addChainTopology(NC* nc, unsigned int numQueues, unsigned int pathLength, unsigned int flowsPerQueue)
+{
+    Json::Value queueInfo;
+    queueInfo["bandwidth"] = Json::Value(1);
+    for (unsigned int i = 0; i < numQueues; i++) {
+        queueInfo["name"] = Json::Value(indexName("Q", i));
+        nc->addQueue(queueInfo);
+    }
+    Json::Value clientInfo;
+    clientInfo["flows"] = Json::arrayValue;
+    clientInfo["flows"].resize(1);
+    clientInfo["SLO"] = Json::Value(1);
+    Json::Value& flowInfo = clientInfo["flows"][0];
+    unsigned int n = 0;
+    for (unsigned int start = 0; start + pathLength <= numQueues; start++) {
+        for (unsigned int j = 0; j < flowsPerQueue; j++) {
+            flowInfo["name"] = Json::Value(indexName("F", n));
+            flowInfo["queues"] = Json::arrayValue;
+            for (unsigned int k = start; k < start + pathLength; k++) {
+                flowInfo["queues"].append(Json::Value(indexName("Q", k)));
+            }
+            flowInfo["priority"] = Json::Value(1 + (n % 3));
+            flowInfo["r"] = Json::Value(0.01 * (1 + (n % 5)));
+            flowInfo["b"] = Json::Value(0.1 * (1 + (n % 7)));
+            clientInfo["name"] = Json::Value(indexName("C", n));
+            nc->addClient(clientInfo);
+            n++;
+        }
+    }
+}
+
+void DNCTestHopByHop()
+{
+    TestDNC* nc = new TestDNC(DNC_SIMPLE_ALGORITHM_HOP_BY_HOP);
+    addChainTopology(nc, 6, 3, 2);
+    // Check memoized analysis matches unmemoized analysis, including after changes
+    for (int round = 0; round < 3; round++) {
+        nc->calcAllLatency();
+        for (FlowIterator it = nc->flowsBegin(); it != nc->flowsEnd(); it++) {
+            assert(it->second->latency == nc->referenceHopByHopLatency(it->first));
+            assert(nc->calcFlowLatency(it->first) == it->second->latency);
+        }
+        FlowId flowId = nc->flowsBegin()->first;
+        SimpleArrivalCurve shaperCurve = nc->getShaperCurve(flowId);
+        shaperCurve.b *= 2;
+        nc->setShaperCurve(flowId, shaperCurve);
+        nc->setFlowPriority((nc->flowsEnd() - 1)->first, 1);
+    }
+    delete nc;
+    // Check deep topology can be analyzed
+    nc = new TestDNC(DNC_SIMPLE_ALGORITHM_HOP_BY_HOP);
+    addChainTopology(nc, 40, 20, 3);
+    nc->calcAllLatency();
+    for (FlowIterator it = nc->flowsBegin(); it != nc->flowsEnd(); it++) {
+        assert(it->second->latency > 0);
+    }
+    delete nc;
+}
+
+// Check that a latency matches a reference latency, allowing for differences in the order of floating point operations.
+static bool approxEqualLatency(double latency, double referenceLatency)
+{
+    if (isinf(referenceLatency)) {
+        return isinf(latency);
+    }
+    return approxEqual(latency, referenceLatency);
+}
+
+void DNCTestAggregate()
+{
+    TestDNC* nc = new TestDNC();
+    // Setup first hop queues (e.g., network out) and second hop queues (e.g., network in)
+    Json::Value queueInfo;
+    queueInfo["bandwidth"] = Json::Value(1);
+    unsigned int numQueues = 4;
+    for (unsigned int i = 0; i < numQueues; i++) {
+        queueInfo["name"] = Json::Value(indexName("Out", i));
+        nc->addQueue(queueInfo);
+        queueInfo["name"] = Json::Value(indexName("In", i));
+        nc->addQueue(queueInfo);
+    }
+    // Setup one and two hop flows with a mix of priorities
+    Json::Value clientInfo;
+    clientInfo["flows"] = Json::arrayValue;
+    clientInfo["flows"].resize(1);
+    clientInfo["SLO"] = Json::Value(1);
+    Json::Value& flowInfo = clientInfo["flows"][0];
+    for (unsigned int n = 0; n < 48; n++) {
+        flowInfo["name"] = Json::Value(indexName("F", n));
+        flowInfo["queues"] = Json::arrayValue;
+        flowInfo["queues"].append(Json::Value(indexName("Out", n % numQueues)));
+        if (n % 5 != 0) {
+            flowInfo["queues"].append(Json::Value(indexName("In", (n * 7 / numQueues) % numQueues)));
+        }
+        flowInfo["priority"] = Json::Value(1 + ((n * 3) % 4));
+        flowInfo["r"] = Json::Value(0.002 * (1 + (n % 5)));
+        flowInfo["b"] = Json::Value(0.1 * (1 + (n % 7)));
+        clientInfo["name"] = Json::Value(indexName("C", n));
+        nc->addClient(clientInfo);
+    }
+    // Check aggregated analysis matches per-flow analysis, including after changes
+    for (int round = 0; round < 4; round++) {
+        nc->calcAllLatency();
+        for (FlowIterator it = nc->flowsBegin(); it != nc->flowsEnd(); it++) {
+            assert(approxEqualLatency(it->second->latency, nc->referenceAggregateLatency(it->first)));
+        }
+        FlowId flowId = (nc->flowsBegin() + round)->first;
+        SimpleArrivalCurve shaperCurve = nc->getShaperCurve(flowId);
+        shaperCurve.r *= 2;
+        shaperCurve.b *= 3;
+        nc->setShaperCurve(flowId, shaperCurve);
+        nc->setFlowPriority((nc->flowsEnd() - 1 - round)->first, 1 + (round % 4));
+        nc->delClient(nc->getClientIdByName(indexName("C", 10 + round)));
+    }
+    delete nc;
+}
+
 void DNCTest()
 {
     // Test helper functions
@@ -794,6 +1216,18 @@ void DNCTest()
     // Test input functions
     testCalcMinRate(pTrace0, pTrace1);
     testRbGen(pTrace0, pTrace1);
+    testRbGenReference(pTrace0);
+    testRbGenReference(pTrace1);
+    testCalcExactArrivalCurve(pTrace0);
+    testCalcExactArrivalCurve(pTrace1);
+    testRbGenThreads(pTrace0);
+    testRbGenThreads(pTrace1);
+    testCalcMinRateAndRbGen(pTrace0);
+    testCalcMinRateAndRbGen(pTrace1);
+    Json::Value networkInEstimatorInfo = networkOutEstimatorInfo;
+    networkInEstimatorInfo["type"] = Json::Value("networkIn");
+    networkInEstimatorInfo["dataFactor"] = Json::Value(2.0);
+    testSetArrivalInfos(networkOutEstimatorInfo, networkInEstimatorInfo);
     testRbCurveToArrivalCurve();
 
     delete pTrace0;
@@ -801,5 +1235,7 @@ void DNCTest()
 
     DNCTestOneHop();
     DNCTestTwoHops();
+    DNCTestHopByHop();
+    DNCTestAggregate();
     cout << "PASS DNCTest" << endl;
 }
@@ -7,6 +7,8 @@
 #include <cassert>
 #include <cstdlib>
 #include <iostream>
+#include <set>
+#include <string>
 #include "../DNC-Library/NC.hpp"
 #include "DNC-LibraryTest.hpp"
 
@@ -28,7 +30,7 @@ private:
         assert(q->name == "Q0");
         assert(q->flows.empty());
         assert(q->bandwidth == 1);
-        map<QueueId, Queue*>::const_iterator it = queuesBegin();
+        QueueIterator it = queuesBegin();
         assert(it->first == queueId);
         assert(it->second == q);
         it++;
@@ -65,7 +67,7 @@ private:
         assert(q->name == "Q1");
         assert(q->flows.empty());
         assert(q->bandwidth == 1);
-        map<QueueId, Queue*>::const_iterator it = queuesBegin();
+        QueueIterator it = queuesBegin();
         assert(it->first == queueId);
         assert(it->second == q);
         it++;
@@ -112,12 +114,12 @@ private:
         assert(f->queueIds[0] == queueId0);
         assert(f->queueIds[1] == queueId1);
         assert(f->priority == 5);
-        map<ClientId, Client*>::const_iterator itC = clientsBegin();
+        ClientIterator itC = clientsBegin();
         assert(itC->first == clientId);
         assert(itC->second == c);
         itC++;
         assert(itC == clientsEnd());
-        map<FlowId, Flow*>::const_iterator itF = flowsBegin();
+        FlowIterator itF = flowsBegin();
         assert(itF->first == flowId);
         assert(itF->second == f);
         itF++;
@@ -197,12 +199,12 @@ private:
         assert(f->queueIds[0] == queueId0);
         assert(f->queueIds[1] == queueId1);
         assert(f->priority == 6);
-        map<ClientId, Client*>::const_iterator itC = clientsBegin();
+        ClientIterator itC = clientsBegin();
         assert(itC->first == clientId);
         assert(itC->second == c);
         itC++;
         assert(itC == clientsEnd());
-        map<FlowId, Flow*>::const_iterator itF = flowsBegin();
+        FlowIterator itF = flowsBegin();
         assert(itF->first == flowId);
         assert(itF->second == f);
         itF++;
@@ -212,6 +214,76 @@ private:
         assert(clientsBegin() == clientsEnd());
         assert(flowsBegin() == flowsEnd());
     }
+    // Add a client with a single flow
+    ClientId addTestClient(string name, string flowName, const char* const* queues, unsigned int numQueues, unsigned int priority)
+    {
+        Json::Value clientInfo;
+        clientInfo["name"] = Json::Value(name);
+        clientInfo["SLO"] = Json::Value(1);
+        clientInfo["flows"] = Json::arrayValue;
+        clientInfo["flows"].resize(1);
+        Json::Value& flowInfo = clientInfo["flows"][0];
+        flowInfo["name"] = Json::Value(flowName);
+        flowInfo["queues"] = Json::arrayValue;
+        for (unsigned int index = 0; index < numQueues; index++) {
+            flowInfo["queues"].append(Json::Value(queues[index]));
+        }
+        flowInfo["priority"] = Json::Value(priority);
+        return addClient(clientInfo);
+    }
+    // Get the clients affected by a single client
+    set<ClientId> affectedClients(ClientId clientId)
+    {
+        set<ClientId> affectedClientIds;
+        getAffectedClients(set<ClientId>(&clientId, &clientId + 1), affectedClientIds);
+        return affectedClientIds;
+    }
+    void testAffectedClients()
+    {
+        // F0 (priority 4) and F1 (priority 7) visit Q0 -> Q1
+        Json::Value queueInfo;
+        queueInfo["name"] = Json::Value("Q2");
+        queueInfo["bandwidth"] = Json::Value(1);
+        addQueue(queueInfo);
+        const char* queues2[] = {"Q1", "Q2"};
+        const char* queues3[] = {"Q2"};
+        ClientId clientId0 = getClientIdByName("C0");
+        ClientId clientId1 = getClientIdByName("C1");
+        ClientId clientId2 = addTestClient("C2", "F2", queues2, 2, 5);
+        ClientId clientId3 = addTestClient("C3", "F3", queues3, 1, 3);
+        ClientId clientId4 = addTestClient("C4", "F4", queues3, 1, 9);
+        const Queue* q = getQueue(getQueueIdByName("Q2"));
+        assert(q->priorityFlows.size() == 3);
+        assert(q->priorityFlows[0].fi.flowId == getFlowIdByName("F3"));
+        assert(q->priorityFlows[1].fi.flowId == getFlowIdByName("F2"));
+        assert(q->priorityFlows[1].fi.index == 1);
+        assert(q->priorityFlows[2].fi.flowId == getFlowIdByName("F4"));
+        // Lower priority flows downstream are affected
+        set<ClientId> affected = affectedClients(clientId0);
+        assert(affected.size() == 4);
+        assert(affected.count(clientId0) && affected.count(clientId1) && affected.count(clientId2) && affected.count(clientId4));
+        // Higher priority flows are unaffected
+        affected = affectedClients(clientId1);
+        assert((affected.size() == 1) && affected.count(clientId1));
+        // Flows are only affected at and after the queue where they are affected, so F2 does not affect F1 at Q1
+        affected = affectedClients(clientId3);
+        assert(affected.size() == 3);
+        assert(affected.count(clientId2) && affected.count(clientId3) && affected.count(clientId4));
+        // Priority changes are reflected
+        setFlowPriority(getFlowIdByName("F2"), 2);
+        assert(q->priorityFlows[0].fi.flowId == getFlowIdByName("F2"));
+        affected = affectedClients(clientId0);
+        assert(affected.size() == 2);
+        assert(affected.count(clientId0) && affected.count(clientId1));
+        // Deleted clients are no longer affected
+        delClient(clientId4);
+        assert(q->priorityFlows.size() == 2);
+        affected = affectedClients(clientId3);
+        assert(affected.size() == 1);
+        delClient(clientId2);
+        delClient(clientId3);
+        delQueue(getQueueIdByName("Q2"));
+    }
 
 public:
     TestNC() {}
@@ -277,6 +349,8 @@ public:
         assert(c1->latency == 1);
         assert(f0->latency == 1);
         assert(f1->latency == 1);
+        // Test getAffectedClients
+        testAffectedClients();
     }
 };
 
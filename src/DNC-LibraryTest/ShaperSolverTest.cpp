@@ -0,0 +1,216 @@
+// ShaperSolverTest.cpp - ShaperSolver test code.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cassert>
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include "../DNC-Library/ShaperSolver.hpp"
+#include "../DNC-Library/Solver.hpp"
+#include "DNC-LibraryTest.hpp"
+
+using namespace std;
+
+// Random problem with a frontier and bounds for each flow and coupling constraints across flows.
+struct ShaperProblem {
+    vector<vector<double> > r;
+    vector<vector<double> > b;
+    vector<double> rMax;
+    vector<double> bMax;
+    vector<vector<ShaperTerm> > constraints;
+    vector<double> rhs;
+};
+
+// Generate a random convex frontier with decreasing r and increasing b.
+static void randomFrontier(vector<double>& r, vector<double>& b)
+{
+    unsigned int count = 1 + rand() % 4;
+    double rValue = 0.05 + 0.5 * rand() / RAND_MAX;
+    double bValue = 0.1 * rand() / RAND_MAX;
+    double slope = 0.5 + 2.0 * rand() / RAND_MAX; // decrease in r per increase in b, which shrinks along the frontier
+    for (unsigned int i = 0; i < count; i++) {
+        r.push_back(rValue);
+        b.push_back(bValue);
+        double db = 0.05 + 0.5 * rand() / RAND_MAX;
+        if (rValue - slope * db < 0.01) {
+            break;
+        }
+        rValue -= slope * db;
+        bValue += db;
+        slope *= 0.2 + 0.6 * rand() / RAND_MAX;
+    }
+}
+
+// Solve the problem with GLPK using the arrival curve constraints of WorkloadCompactor's LP.
+static bool solveGLPK(const ShaperProblem& problem, double& objective)
+{
+    SolverGLPK solver;
+    solver.setObjectiveDirection(OBJECTIVE_MIN);
+    vector<VariableHandle> rVars;
+    vector<VariableHandle> bVars;
+    for (unsigned int k = 0; k < problem.r.size(); k++) {
+        const vector<double>& r = problem.r[k];
+        const vector<double>& b = problem.b[k];
+        VariableHandle vars[] = {solver.addVariable(0, problem.rMax[k], VAR_CONTINUOUS, NULL), solver.addVariable(0, problem.bMax[k], VAR_CONTINUOUS, NULL)};
+        rVars.push_back(vars[0]);
+        bVars.push_back(vars[1]);
+        solver.setObjectiveCoeff(1, vars[0]);
+        double bCoeffs[] = {0, 1};
+        solver.addConstraint(2, bCoeffs, vars, CONSTRAINT_GE, b.front(), NULL);
+        for (unsigned int i = 1; i < r.size(); i++) {
+            double coeffs[] = {b[i] - b[i - 1], r[i - 1] - r[i]};
+            solver.addConstraint(2, coeffs, vars, CONSTRAINT_GE, r[i - 1] * b[i] - r[i] * b[i - 1], NULL);
+        }
+        double rCoeffs[] = {1, 0};
+        solver.addConstraint(2, rCoeffs, vars, CONSTRAINT_GE, r.back(), NULL);
+    }
+    for (unsigned int c = 0; c < problem.constraints.size(); c++) {
+        vector<double> coeffs;
+        vector<VariableHandle> vars;
+        for (vector<ShaperTerm>::const_iterator it = problem.constraints[c].begin(); it != problem.constraints[c].end(); it++) {
+            coeffs.push_back(it->rCoeff);
+            vars.push_back(rVars[it->flow]);
+            coeffs.push_back(it->bCoeff);
+            vars.push_back(bVars[it->flow]);
+        }
+        solver.addConstraint(coeffs.size(), &coeffs[0], &vars[0], CONSTRAINT_LE, problem.rhs[c], NULL);
+    }
+    if (!solver.solve()) {
+        return false;
+    }
+    objective = solver.getSolution();
+    return true;
+}
+
+// Check that a flow's solution is within its bounds and on or above its frontier.
+static bool onOrAboveFrontier(const vector<double>& r, const vector<double>& b, double rMax, double bMax, double rk, double bk)
+{
+    const double epsilon = 1e-7;
+    if ((rk > rMax + epsilon) || (bk > bMax + epsilon) || (bk < b.front() - epsilon) || (rk < r.back() - epsilon)) {
+        return false;
+    }
+    for (unsigned int i = 1; i < r.size(); i++) {
+        if ((b[i] - b[i - 1]) * rk + (r[i - 1] - r[i]) * bk < r[i - 1] * b[i] - r[i] * b[i - 1] - epsilon) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ShaperSolverTest()
+{
+    const double epsilon = 1e-6;
+
+    // Test a single flow, where the optimal solution is on the frontier's last vertex within the bounds
+    {
+        double r[] = {0.5, 0.2, 0.1};
+        double b[] = {1, 2, 5};
+        vector<double> rs(r, r + 3);
+        vector<double> bs(b, b + 3);
+        ShaperSolver solver;
+        solver.addFlow(rs, bs, 0.999, 3);
+        assert(solver.solve());
+        // Frontier crosses b = 3 between (0.2, 2) and (0.1, 5)
+        assert(approxEqual(solver.getSolution(), 0.2 - 0.1 / 3, epsilon));
+        assert(approxEqual(solver.getSolutionR(0), 0.2 - 0.1 / 3, epsilon));
+        assert(approxEqual(solver.getSolutionB(0), 3, epsilon));
+    }
+
+    // Test two flows sharing a constraint on their bursts
+    {
+        double r[] = {0.5, 0.1};
+        double b[] = {1, 2};
+        vector<double> rs(r, r + 2);
+        vector<double> bs(b, b + 2);
+        ShaperSolver solver;
+        solver.addFlow(rs, bs, 0.999, 10);
+        solver.addFlow(rs, bs, 0.999, 10);
+        vector<ShaperTerm> terms;
+        terms.push_back(ShaperTerm(0, 0, 1));
+        terms.push_back(ShaperTerm(1, 0, 1));
+        solver.addConstraint(terms, 3);
+        assert(solver.solve());
+        // Sum of bursts is 3, and r decreases by 0.4 per unit of b
+        assert(approxEqual(solver.getSolution(), 0.6, epsilon));
+        assert(approxEqual(solver.getSolutionB(0) + solver.getSolutionB(1), 3, epsilon));
+    }
+
+    // Test infeasible bounds and constraints
+    {
+        double r[] = {0.5, 0.1};
+        double b[] = {1, 2};
+        vector<double> rs(r, r + 2);
+        vector<double> bs(b, b + 2);
+        ShaperSolver boundsSolver;
+        boundsSolver.addFlow(rs, bs, 0.999, 0.5);
+        assert(!boundsSolver.solve());
+        ShaperSolver rateSolver;
+        rateSolver.addFlow(rs, bs, 0.05, 10);
+        assert(!rateSolver.solve());
+        ShaperSolver constraintSolver;
+        constraintSolver.addFlow(rs, bs, 0.999, 10);
+        constraintSolver.addFlow(rs, bs, 0.999, 10);
+        vector<ShaperTerm> terms;
+        terms.push_back(ShaperTerm(0, 1, 0));
+        terms.push_back(ShaperTerm(1, 1, 0.1));
+        constraintSolver.addConstraint(terms, 0.2);
+        assert(!constraintSolver.solve());
+    }
+
+    // Test random problems against GLPK
+    {
+        srand(1);
+        unsigned int numFeasible = 0;
+        for (unsigned int iteration = 0; iteration < 200; iteration++) {
+            ShaperProblem problem;
+            unsigned int numFlows = 1 + rand() % 12;
+            ShaperSolver solver;
+            for (unsigned int k = 0; k < numFlows; k++) {
+                problem.r.resize(k + 1);
+                problem.b.resize(k + 1);
+                randomFrontier(problem.r[k], problem.b[k]);
+                problem.rMax.push_back((rand() % 4 == 0) ? (0.1 + 0.5 * rand() / RAND_MAX) : 0.999);
+                problem.bMax.push_back(0.5 + 2.0 * rand() / RAND_MAX);
+                solver.addFlow(problem.r[k], problem.b[k], problem.rMax[k], problem.bMax[k]);
+            }
+            unsigned int numConstraints = rand() % 10;
+            for (unsigned int c = 0; c < numConstraints; c++) {
+                vector<ShaperTerm> terms;
+                for (unsigned int k = 0; k < numFlows; k++) {
+                    if (rand() % 2 == 0) {
+                        terms.push_back(ShaperTerm(k, (rand() % 2 == 0) ? 1 : 0, 1.0 / (1 + rand() % 5)));
+                    }
+                }
+                double rhs = 0.5 + 2.0 * rand() / RAND_MAX;
+                problem.constraints.push_back(terms);
+                problem.rhs.push_back(rhs);
+                solver.addConstraint(terms, rhs);
+            }
+            double objective = 0;
+            bool feasible = solveGLPK(problem, objective);
+            assert(solver.solve() == feasible);
+            if (feasible) {
+                numFeasible++;
+                assert(approxEqual(solver.getSolution(), objective, epsilon));
+                // Check the solution is feasible
+                for (unsigned int k = 0; k < numFlows; k++) {
+                    assert(onOrAboveFrontier(problem.r[k], problem.b[k], problem.rMax[k], problem.bMax[k], solver.getSolutionR(k), solver.getSolutionB(k)));
+                }
+                for (unsigned int c = 0; c < numConstraints; c++) {
+                    double lhs = 0;
+                    for (vector<ShaperTerm>::const_iterator it = problem.constraints[c].begin(); it != problem.constraints[c].end(); it++) {
+                        lhs += it->rCoeff * solver.getSolutionR(it->flow) + it->bCoeff * solver.getSolutionB(it->flow);
+                    }
+                    assert(lhs <= problem.rhs[c] + epsilon);
+                }
+            }
+        }
+        assert(numFeasible > 50);
+        assert(numFeasible < 200);
+    }
+
+    cout << "PASS ShaperSolverTest" << endl;
+}
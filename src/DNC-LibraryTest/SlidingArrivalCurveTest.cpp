@@ -0,0 +1,103 @@
+// SlidingArrivalCurveTest.cpp - SlidingArrivalCurve test code.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cassert>
+#include <iostream>
+#include <vector>
+#include <json/json.h>
+#include "../common/time.hpp"
+#include "../Estimator/Estimator.hpp"
+#include "../TraceCommon/ProcessedTrace.hpp"
+#include "../DNC-Library/DNC.hpp"
+#include "../DNC-Library/SlidingArrivalCurve.hpp"
+#include "DNC-LibraryTest.hpp"
+
+using namespace std;
+
+// Test that a window covering the whole trace matches the r-b curve of the trace.
+static void testWholeTrace(string filename)
+{
+    Json::Value estimatorInfo;
+    estimatorInfo["type"] = Json::Value("networkIn");
+    estimatorInfo["dataFactor"] = Json::Value(2.0);
+    double maxRate = 2;
+    ProcessedTrace trace(filename, Estimator::create(estimatorInfo));
+    SlidingArrivalCurve slidingArrivalCurve(maxRate, 1e6);
+    ProcessedTraceEntry traceEntry;
+    uint64_t lastArrivalTime = 0;
+    while (trace.nextEntry(traceEntry)) {
+        slidingArrivalCurve.addArrival(traceEntry.arrivalTime, traceEntry.work);
+        lastArrivalTime = traceEntry.arrivalTime;
+    }
+    vector<double> expectedRates;
+    for (double rate = maxRate; rate >= 0; rate -= 0.001 * maxRate) {
+        expectedRates.push_back(rate);
+    }
+    vector<double> expectedBursts;
+    double minRate = calcMinRateAndRbGen(&trace, expectedRates, expectedBursts);
+    vector<double> rates;
+    vector<double> bursts;
+    slidingArrivalCurve.getRbCurve(rates, bursts, lastArrivalTime);
+    assert(rates.empty() || (rates.back() >= minRate));
+    for (unsigned int i = 0; i < rates.size(); i++) {
+        assert(rates[i] == expectedRates[i]);
+        assert(bursts[i] == expectedBursts[i]);
+    }
+    assert((rates.size() == expectedRates.size()) || (expectedRates[rates.size()] < minRate));
+    // Check arrival curve matches trace based arrival curve
+    Curve expectedArrivalCurve;
+    Curve arrivalCurve;
+    calcArrivalCurve(expectedArrivalCurve, &trace, maxRate);
+    calcArrivalCurve(arrivalCurve, slidingArrivalCurve, lastArrivalTime);
+    assert(arrivalCurve.size() == expectedArrivalCurve.size());
+    for (unsigned int i = 0; i < arrivalCurve.size(); i++) {
+        assert(arrivalCurve[i].x == expectedArrivalCurve[i].x);
+        assert(arrivalCurve[i].y == expectedArrivalCurve[i].y);
+        assert(arrivalCurve[i].slope == expectedArrivalCurve[i].slope);
+    }
+}
+
+// Test that bursts leave the window as it slides.
+static void testSlidingWindow()
+{
+    double windowDuration = 10;
+    SlidingArrivalCurve slidingArrivalCurve(20, windowDuration, 10);
+    vector<double> rates;
+    vector<double> bursts;
+    slidingArrivalCurve.getRbCurve(rates, bursts, 0);
+    assert(rates.empty());
+    // Large burst at the start, then a steady stream of small requests
+    uint64_t t = ConvertSecondsToTime(1);
+    slidingArrivalCurve.addArrival(t, 5);
+    for (unsigned int i = 0; i < 100; i++) {
+        t += ConvertSecondsToTime(0.5);
+        slidingArrivalCurve.addArrival(t, 0.1);
+        slidingArrivalCurve.getRbCurve(rates, bursts, t);
+        assert(!rates.empty());
+        double burst = bursts[0];
+        if (t <= ConvertSecondsToTime(1 + windowDuration - 1)) {
+            // Burst is still in the window
+            assert(burst >= 5);
+        } else if (t >= ConvertSecondsToTime(1 + windowDuration + 10)) {
+            // Only the steady stream remains once the backlog has drained
+            assert(between(burst, 0.1, 0.1));
+        }
+    }
+    // Average rate is 0.1 / 0.5 = 0.2 once the burst is out of the window,
+    // up to the rate granularity and the work of the partially expired sub-window
+    assert(between(rates.back(), 0.2, 0.24));
+    // Nothing in the window long after the last request
+    slidingArrivalCurve.getRbCurve(rates, bursts, t + ConvertSecondsToTime(2 * windowDuration));
+    assert(rates.empty());
+}
+
+void SlidingArrivalCurveTest()
+{
+    testWholeTrace("testTrace.txt");
+    testWholeTrace("testTrace.csv");
+    testSlidingWindow();
+    cout << "PASS SlidingArrivalCurveTest" << endl;
+}
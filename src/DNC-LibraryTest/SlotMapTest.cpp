@@ -0,0 +1,68 @@
+// SlotMapTest.cpp - SlotMap test code.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cassert>
+#include <iostream>
+#include <map>
+#include <cstdlib>
+#include "../DNC-Library/SlotMap.hpp"
+#include "DNC-LibraryTest.hpp"
+
+using namespace std;
+
+// Check that a SlotMap has the same contents and iteration order as a map.
+static void checkSame(const SlotMap<unsigned int, int>& slotMap, const map<unsigned int, int*>& expected)
+{
+    assert(slotMap.size() == expected.size());
+    assert(slotMap.empty() == expected.empty());
+    SlotMap<unsigned int, int>::const_iterator it = slotMap.begin();
+    for (map<unsigned int, int*>::const_iterator expectedIt = expected.begin(); expectedIt != expected.end(); expectedIt++) {
+        assert(it != slotMap.end());
+        assert(it->first == expectedIt->first);
+        assert(it->second == expectedIt->second);
+        assert(slotMap.find(expectedIt->first) == expectedIt->second);
+        it++;
+    }
+    assert(it == slotMap.end());
+}
+
+void SlotMapTest()
+{
+    int values[100];
+    SlotMap<unsigned int, int> slotMap;
+    map<unsigned int, int*> expected;
+    assert(slotMap.find(0) == NULL);
+    assert(slotMap.find(1000) == NULL);
+    checkSame(slotMap, expected);
+    // Insert in increasing order
+    for (unsigned int id = 1; id <= 50; id++) {
+        slotMap.insert(id, &values[id]);
+        expected[id] = &values[id];
+    }
+    checkSame(slotMap, expected);
+    // Insert out of order
+    for (unsigned int id = 99; id > 50; id -= 2) {
+        slotMap.insert(id, &values[id]);
+        expected[id] = &values[id];
+    }
+    checkSame(slotMap, expected);
+    // Erase randomly
+    srand(1);
+    for (unsigned int i = 0; i < 100; i++) {
+        unsigned int id = rand() % 100;
+        slotMap.erase(id);
+        expected.erase(id);
+        assert(slotMap.find(id) == NULL);
+        checkSame(slotMap, expected);
+    }
+    // Erase everything
+    for (unsigned int id = 0; id < 100; id++) {
+        slotMap.erase(id);
+        expected.erase(id);
+    }
+    checkSame(slotMap, expected);
+    cout << "PASS SlotMapTest" << endl;
+}
@@ -6,6 +6,7 @@
 
 #include <cassert>
 #include <iostream>
+#include <vector>
 #include <json/json.h>
 #include "../DNC-Library/Solver.hpp"
 #include "DNC-LibraryTest.hpp"
@@ -73,5 +74,87 @@ void SolverGLPKTest()
     assert(approxEqual(s.getSolutionVariable(x), 8.0, epsilon));
     assert(approxEqual(s.getSolutionVariable(y), 0.0, epsilon));
     assert(approxEqual(s.getSolutionVariable(z), 8.0, epsilon));
+
+    // Test incremental modifications with warm-started resolve
+    s.setObjectiveDirection(OBJECTIVE_MIN);
+    {
+        double coeffs[] = {1, 2};
+        VariableHandle vars[] = {x, y};
+        s.changeConstraint(c, 2, coeffs, vars, 5); // x + 2*y <= 5
+    }
+    assert(s.resolve());
+    assert(approxEqual(s.getSolution(), 14.0, epsilon));
+    assert(approxEqual(s.getSolutionVariable(x), 3.0, epsilon));
+    assert(approxEqual(s.getSolutionVariable(y), 1.0, epsilon));
+    assert(approxEqual(s.getSolutionVariable(z), 2.0, epsilon));
+
+    VariableHandle w = s.addVariable(0, 10, VAR_CONTINUOUS, NULL);
+    ConstraintHandle d;
+    {
+        double coeffs[] = {1, -1};
+        VariableHandle vars[] = {w, x};
+        d = s.addConstraint(2, coeffs, vars, CONSTRAINT_GE, 0, NULL); // w - x >= 0
+    }
+    s.setObjectiveCoeff(1, w);
+    assert(s.resolve());
+    assert(approxEqual(s.getSolution(), 17.0, epsilon));
+    assert(approxEqual(s.getSolutionVariable(w), 3.0, epsilon));
+
+    s.deleteConstraints(vector<ConstraintHandle>(1, d));
+    s.deleteVariables(vector<VariableHandle>(1, w));
+    s.deleteConstraints(vector<ConstraintHandle>(1, c));
+    assert(s.resolve());
+    assert(approxEqual(s.getSolution(), 4.0, epsilon));
+    assert(approxEqual(s.getSolutionVariable(x), 2.0, epsilon));
+    assert(approxEqual(s.getSolutionVariable(y), 2.0, epsilon));
+
+    // Test adding constraints from a matrix, both into an empty LP and into an LP with existing coefficients
+    {
+        SolverGLPK bulk;
+        bulk.setObjectiveDirection(OBJECTIVE_MIN);
+        VariableHandle u = bulk.addVariable(0, 10, VAR_CONTINUOUS, NULL);
+        VariableHandle v = bulk.addVariable(0, 10, VAR_CONTINUOUS, NULL);
+        bulk.setObjectiveCoeff(1, u);
+        bulk.setObjectiveCoeff(2, v);
+        ConstraintMatrix m;
+        int row0 = m.addRow();
+        int row1 = m.addRow();
+        int row2 = m.addRow();
+        m.append(row1, 1, v); // entries may be appended out of row order
+        m.append(row0, 1, u);
+        m.append(row0, 1, v);
+        m.append(row1, -1, u);
+        m.compact();
+        assert(m.getNumRows() == 3);
+        assert(m.getRowCount(row0) == 2);
+        assert(m.getRowCount(row2) == 0);
+        vector<int> rows;
+        rows.push_back(row0);
+        rows.push_back(row1);
+        vector<double> rhs;
+        rhs.push_back(6); // u + v >= 6
+        rhs.push_back(2); // v - u >= 2
+        ConstraintHandle first = bulk.addConstraints(m, rows, CONSTRAINT_GE, rhs);
+        assert(bulk.solve());
+        assert(approxEqual(bulk.getSolution(), 10.0, epsilon));
+        assert(approxEqual(bulk.getSolutionVariable(u), 2.0, epsilon));
+        m.clear();
+        row0 = m.addRow();
+        m.append(row0, 1, u);
+        m.compact();
+        ConstraintHandle second = bulk.addConstraints(m, vector<int>(1, row0), CONSTRAINT_GE, vector<double>(1, 3)); // u >= 3
+        assert(second == first + 2);
+        assert(bulk.resolve());
+        assert(approxEqual(bulk.getSolution(), 13.0, epsilon));
+        assert(approxEqual(bulk.getSolutionVariable(v), 5.0, epsilon));
+    }
+
+    // Test handles after deletion
+    vector<int> deleted;
+    deleted.push_back(2);
+    deleted.push_back(4);
+    assert(shiftHandle(1, deleted) == 1);
+    assert(shiftHandle(3, deleted) == 2);
+    assert(shiftHandle(5, deleted) == 3);
     cout << "PASS SolverGLPKTest" << endl;
 }
@@ -6,12 +6,55 @@
 
 #include <cassert>
 #include <iostream>
+#include <vector>
 #include <json/json.h>
 #include "../Estimator/Estimator.hpp"
 #include "DNC-LibraryTest.hpp"
 
 using namespace std;
 
+// Reference linear scan calculation of work from a bandwidth table.
+static double referenceWork(const vector<StorageBandwidth>& bandwidthTable, int requestSize)
+{
+    double bandwidth = bandwidthTable.back().bandwidth;
+    for (unsigned int i = 1; i < bandwidthTable.size(); i++) {
+        if (requestSize < bandwidthTable[i].requestSize) {
+            bandwidth = linearInterpolate(static_cast<double>(requestSize),
+                                          static_cast<double>(bandwidthTable[i-1].requestSize), static_cast<double>(bandwidthTable[i].requestSize),
+                                          bandwidthTable[i-1].bandwidth, bandwidthTable[i].bandwidth);
+            break;
+        }
+    }
+    return static_cast<double>(requestSize) / bandwidth;
+}
+
+// Test work lookup tables against the reference calculation with a realistic profile.
+static void StorageSSDEstimatorWorkTableTest()
+{
+    vector<StorageBandwidth> readBandwidthTable;
+    vector<StorageBandwidth> writeBandwidthTable;
+    for (int requestSize = 512; requestSize <= 262144; requestSize *= 2) {
+        StorageBandwidth entry;
+        entry.requestSize = requestSize;
+        entry.bandwidth = 2e8 * requestSize / (requestSize + 16384.0);
+        readBandwidthTable.push_back(entry);
+        entry.bandwidth = 1e8 * requestSize / (requestSize + 32768.0);
+        writeBandwidthTable.push_back(entry);
+    }
+    StorageSSDEstimator estimator(readBandwidthTable, writeBandwidthTable);
+    for (int requestSize = 1; requestSize <= 4 * WORK_TABLE_MAX_SIZE; requestSize = requestSize * 3 / 2 + 1) {
+        int requestSizes[] = {requestSize, requestSize & ~(WORK_TABLE_GRANULARITY - 1)};
+        for (unsigned int i = 0; i < sizeof(requestSizes) / sizeof(requestSizes[0]); i++) {
+            if (requestSizes[i] > 0) {
+                assert(estimator.estimateWork(requestSizes[i], true) == referenceWork(readBandwidthTable, requestSizes[i]));
+                assert(estimator.estimateWork(requestSizes[i], false) == referenceWork(writeBandwidthTable, requestSizes[i]));
+            }
+        }
+    }
+    assert(estimator.estimateWork(WORK_TABLE_MAX_SIZE, true) == referenceWork(readBandwidthTable, WORK_TABLE_MAX_SIZE));
+    assert(estimator.estimateWork(WORK_TABLE_MAX_SIZE + WORK_TABLE_GRANULARITY, false) == referenceWork(writeBandwidthTable, WORK_TABLE_MAX_SIZE + WORK_TABLE_GRANULARITY));
+}
+
 void StorageSSDEstimatorTest()
 {
     Json::Value estimatorInfo;
@@ -48,5 +91,6 @@ void StorageSSDEstimatorTest()
     assert(pEst->estimateWork(5, false) == 4);
     assert(pEst->estimateWork(6, false) == 4);
     delete pEst;
+    StorageSSDEstimatorWorkTableTest();
     cout << "PASS StorageSSDEstimatorTest" << endl;
 }
@@ -0,0 +1,76 @@
+// StreamingTraceReaderTest.cpp - StreamingTraceReader test code.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include "../TraceCommon/TraceReader.hpp"
+#include "../TraceCommon/StreamingTraceReader.hpp"
+#include "DNC-LibraryTest.hpp"
+
+using namespace std;
+
+// Check that a streaming trace reader with a given chunk size reads the same entries as TraceReader.
+static void testStreaming(string filename, size_t chunkSize)
+{
+    TraceReader traceReader(filename);
+    StreamingTraceReader streamingReader(filename, chunkSize);
+    TraceReader* pClonedReader = streamingReader.clone();
+    for (int i = 0; i < 2; i++) {
+        TraceEntry expectedEntry;
+        TraceEntry entry;
+        while (traceReader.nextEntry(expectedEntry)) {
+            assert(streamingReader.nextEntry(entry) == true);
+            assert(entry.arrivalTime == expectedEntry.arrivalTime);
+            assert(entry.requestSize == expectedEntry.requestSize);
+            assert(entry.isRead == expectedEntry.isRead);
+            assert(pClonedReader->nextEntry(entry) == true);
+            assert(entry.arrivalTime == expectedEntry.arrivalTime);
+        }
+        assert(streamingReader.nextEntry(entry) == false);
+        assert(streamingReader.nextEntry(entry) == false);
+        assert(pClonedReader->nextEntry(entry) == false);
+        traceReader.reset();
+        streamingReader.reset();
+        pClonedReader->reset();
+    }
+    delete pClonedReader;
+}
+
+void StreamingTraceReaderTest()
+{
+    // Test chunk sizes smaller than a line, not aligned to lines, and larger than the file
+    size_t chunkSizes[] = {1, 7, 32, 1000, STREAMING_TRACE_CHUNK_SIZE};
+    const char* tmpFilename = "testTraceStreaming.tmp";
+    {
+        // Trace without a trailing newline and with an invalid line
+        ofstream file(tmpFilename);
+        file << "1000,0x200,DiskRead" << endl;
+        file << "invalid line" << endl;
+        file << endl;
+        file << "2000,0x400,DiskWrite";
+    }
+    for (unsigned int i = 0; i < sizeof(chunkSizes) / sizeof(chunkSizes[0]); i++) {
+        testStreaming("testTrace.txt", chunkSizes[i]);
+        testStreaming("testTrace.csv", chunkSizes[i]);
+        testStreaming(tmpFilename, chunkSizes[i]);
+    }
+    // Test factory
+    TraceReader* pTraceReader = TraceReader::create(tmpFilename, true);
+    assert(dynamic_cast<StreamingTraceReader*>(pTraceReader) != NULL);
+    TraceEntry entry;
+    assert(pTraceReader->nextEntry(entry) == true);
+    assert(entry.arrivalTime == 1000);
+    assert(pTraceReader->nextEntry(entry) == true);
+    assert(entry.arrivalTime == 2000);
+    assert(entry.requestSize == 1024);
+    assert(entry.isRead == false);
+    assert(pTraceReader->nextEntry(entry) == false);
+    delete pTraceReader;
+    remove(tmpFilename);
+    cout << "PASS StreamingTraceReaderTest" << endl;
+}
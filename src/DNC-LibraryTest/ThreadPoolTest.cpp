@@ -0,0 +1,83 @@
+// ThreadPoolTest.cpp - ThreadPool test code.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cassert>
+#include <iostream>
+#include <vector>
+#include "../DNC-Library/ThreadPool.hpp"
+#include "../DNC-Library/Solver.hpp"
+#include "DNC-LibraryTest.hpp"
+
+using namespace std;
+
+// Task that counts the number of times each index is run.
+static void countTask(void* arg, unsigned int index)
+{
+    (*reinterpret_cast<vector<unsigned int>*>(arg))[index]++;
+}
+
+// Task that solves an LP: max x + y s.t. x + 2y <= index + 1, 2x + y <= index + 1.
+static void solveTask(void* arg, unsigned int index)
+{
+    vector<double>& solutions = *reinterpret_cast<vector<double>*>(arg);
+    SolverGLPK solver;
+    solver.setObjectiveDirection(OBJECTIVE_MAX);
+    VariableHandle x = solver.addVariable(0, 100, VAR_CONTINUOUS, NULL);
+    VariableHandle y = solver.addVariable(0, 100, VAR_CONTINUOUS, NULL);
+    solver.setObjectiveCoeff(1, x);
+    solver.setObjectiveCoeff(1, y);
+    VariableHandle vars[] = {x, y};
+    double coeffs1[] = {1, 2};
+    double coeffs2[] = {2, 1};
+    solver.addConstraint(2, coeffs1, vars, CONSTRAINT_LE, index + 1, NULL);
+    solver.addConstraint(2, coeffs2, vars, CONSTRAINT_LE, index + 1, NULL);
+    if (solver.solve()) {
+        solutions[index] = solver.getSolution();
+    }
+}
+
+void ThreadPoolTest()
+{
+    // Test each task runs exactly once per batch
+    {
+        ThreadPool pool(4);
+        assert(pool.size() == 4);
+        vector<unsigned int> counts(100, 0);
+        for (unsigned int batch = 0; batch < 10; batch++) {
+            pool.run(countTask, &counts, counts.size() - batch);
+        }
+        for (unsigned int i = 0; i < counts.size(); i++) {
+            unsigned int expected = (i < counts.size() - 9) ? 10 : (counts.size() - i);
+            assert(counts[i] == expected);
+        }
+        pool.run(countTask, &counts, 0);
+    }
+
+    // Test a pool without worker threads runs tasks in the calling thread
+    {
+        ThreadPool pool(1);
+        assert(pool.size() == 1);
+        vector<unsigned int> counts(10, 0);
+        pool.run(countTask, &counts, counts.size());
+        for (unsigned int i = 0; i < counts.size(); i++) {
+            assert(counts[i] == 1);
+        }
+    }
+
+    // Test solvers can be used concurrently
+    {
+        ThreadPool pool(4);
+        vector<double> solutions(64, 0);
+        for (unsigned int batch = 0; batch < 4; batch++) {
+            pool.run(solveTask, &solutions, solutions.size());
+            for (unsigned int i = 0; i < solutions.size(); i++) {
+                assert(approxEqual(solutions[i], 2.0 * (i + 1) / 3.0, 1e-6));
+            }
+        }
+    }
+
+    cout << "PASS ThreadPoolTest" << endl;
+}
@@ -8,7 +8,11 @@
 #include <cstdlib>
 #include <limits>
 #include <iostream>
+#include <sstream>
+#include <string>
 #include <vector>
+#include <set>
+#include <map>
 #include <json/json.h>
 #include "../common/serializeJSON.hpp"
 #include "../DNC-Library/DNC.hpp"
@@ -17,6 +21,55 @@
 
 using namespace std;
 
+// AdmissionCheck for WorkloadCompactorTest that checks the SLOs of the speculatively added clients.
+// Saves the shaper curve of the last added client's first flow in arg.
+static bool tryAddClientsCheck(NC* nc, const set<ClientId>& clientIds, void* arg)
+{
+    WorkloadCompactor* wc = static_cast<WorkloadCompactor*>(nc);
+    bool admitted = true;
+    for (set<ClientId>::const_iterator it = clientIds.begin(); it != clientIds.end(); it++) {
+        if (wc->calcClientLatency(*it) > wc->getClient(*it)->SLO) {
+            admitted = false;
+        }
+    }
+    *static_cast<SimpleArrivalCurve*>(arg) = wc->getShaperCurve(wc->getClient(*clientIds.rbegin())->flowIds.front());
+    return admitted;
+}
+
+// Get the clientInfo of a client with a single flow on a queue.
+static Json::Value getTestClientInfo(const string& name, const string& queueName, double SLO, double r2, double b2)
+{
+    Json::Value clientInfo;
+    clientInfo["name"] = Json::Value(name);
+    clientInfo["SLO"] = Json::Value(SLO);
+    clientInfo["flows"] = Json::arrayValue;
+    clientInfo["flows"].resize(1);
+    Json::Value& flowInfo = clientInfo["flows"][0];
+    flowInfo["name"] = Json::Value(name);
+    flowInfo["queues"] = Json::arrayValue;
+    flowInfo["queues"].append(Json::Value(queueName));
+    double r[] = {1, 2 * r2, r2};
+    double b[] = {0.1, b2 / 2, b2};
+    unsigned int count = sizeof(r) / sizeof(r[0]);
+    vector<double> rates;
+    map<double, double> bursts;
+    for (unsigned int i = 0; i < count; i++) {
+        rates.push_back(r[i]);
+        bursts[r[i]] = b[i];
+    }
+    Curve arrivalCurve;
+    rbCurveToArrivalCurve(arrivalCurve, rates, bursts);
+    arrivalCurve.erase(arrivalCurve.begin());
+    serializeJSON(flowInfo, "arrivalInfo", arrivalCurve);
+    return clientInfo;
+}
+
+// Add a client with a single flow on a queue to a WorkloadCompactor.
+static ClientId addTestClient(WorkloadCompactor* wc, const string& name, const string& queueName, double SLO, double r2, double b2)
+{
+    return wc->addClient(getTestClientInfo(name, queueName, SLO, r2, b2));
+}
+
 void WorkloadCompactorTest()
 {
     const double epsilon = 1e-6;
@@ -60,6 +113,14 @@ void WorkloadCompactorTest()
     clientInfo["name"] = Json::Value("C0");
     ClientId c0 = wc->addClient(clientInfo);
 
+    // Test shaperCurves are optimized before latency is calculated
+    wc->updateShaperParameters();
+    {
+        const SimpleArrivalCurve& shaperCurve = wc->getShaperCurve(wc->getClient(c0)->flowIds.front());
+        assert(between(shaperCurve.r, 0.1, 0.11, epsilon));
+        assert(between(shaperCurve.b, 5, 5.1, epsilon));
+    }
+
     // Test shaperCurves and latency
     wc->calcAllLatency();
     {
@@ -259,6 +320,345 @@ void WorkloadCompactorTest()
         assert(between(c->latency, 119.0/0.4, 300, epsilon));
     }
 
+    // Test speculative admission leaves existing clients unchanged
+    {
+        vector<SimpleArrivalCurve> shaperCurves;
+        vector<double> latencies;
+        for (FlowIterator it = wc->flowsBegin(); it != wc->flowsEnd(); it++) {
+            shaperCurves.push_back(wc->getShaperCurve(it->first));
+            latencies.push_back(it->second->latency);
+        }
+        Json::Value clientInfos(Json::arrayValue);
+        clientInfos.append(clientInfo);
+        clientInfos[0]["name"] = Json::Value("C5");
+        clientInfos[0]["SLO"] = Json::Value(10);
+        clientInfos[0]["flows"][0]["name"] = Json::Value("F5");
+        {
+            double r[] = {1, 0.05, 0.01};
+            double b[] = {0.1, 0.2, 0.5};
+            unsigned int count = sizeof(r) / sizeof(r[0]);
+            vector<double> rates;
+            map<double, double> bursts;
+            for (unsigned int i = 0; i < count; i++) {
+                rates.push_back(r[i]);
+                bursts[r[i]] = b[i];
+            }
+            Curve arrivalCurve;
+            rbCurveToArrivalCurve(arrivalCurve, rates, bursts);
+            arrivalCurve.erase(arrivalCurve.begin());
+            serializeJSON(clientInfos[0]["flows"][0], "arrivalInfo", arrivalCurve);
+        }
+        // A small client fits
+        SimpleArrivalCurve speculativeShaperCurve = ZeroArrivalCurve();
+        assert(wc->tryAddClients(clientInfos, tryAddClientsCheck, &speculativeShaperCurve));
+        assert(speculativeShaperCurve.r > 0);
+        // A client with an SLO that cannot be met does not fit
+        clientInfos[0]["SLO"] = Json::Value(0.01);
+        assert(!wc->tryAddClients(clientInfos, tryAddClientsCheck, &speculativeShaperCurve));
+        // Check clients were not added and existing clients are unchanged
+        assert(wc->getClientIdByName("C5") == InvalidClientId);
+        assert(wc->getFlowIdByName("F5") == InvalidFlowId);
+        unsigned int i = 0;
+        for (FlowIterator it = wc->flowsBegin(); it != wc->flowsEnd(); it++) {
+            const SimpleArrivalCurve& shaperCurve = wc->getShaperCurve(it->first);
+            assert((shaperCurve.r == shaperCurves[i].r) && (shaperCurve.b == shaperCurves[i].b));
+            assert(it->second->latency == latencies[i]);
+            assert(wc->calcFlowLatency(it->first) == latencies[i]);
+            i++;
+        }
+    }
+
     delete wc;
+
+    // Test solving independent groups concurrently matches solving them sequentially
+    {
+        WorkloadCompactor* sequentialWC = new WorkloadCompactor(1);
+        WorkloadCompactor* concurrentWC = new WorkloadCompactor(4);
+        WorkloadCompactor* wcs[] = {sequentialWC, concurrentWC};
+        for (unsigned int w = 0; w < 2; w++) {
+            for (unsigned int q = 0; q < 8; q++) {
+                ostringstream queueName;
+                queueName << "Q" << q;
+                queueInfo["name"] = Json::Value(queueName.str());
+                wcs[w]->addQueue(queueInfo);
+                for (unsigned int n = 0; n < 3; n++) {
+                    ostringstream name;
+                    name << "C" << q << "_" << n;
+                    addTestClient(wcs[w], name.str(), queueName.str(), 10 + 10 * n, 0.02 * (n + 1), 0.5 + 0.1 * q);
+                }
+            }
+        }
+        for (unsigned int iteration = 0; iteration < 2; iteration++) {
+            sequentialWC->calcAllLatency();
+            concurrentWC->calcAllLatency();
+            FlowIterator itS = sequentialWC->flowsBegin();
+            FlowIterator itC = concurrentWC->flowsBegin();
+            for (; itS != sequentialWC->flowsEnd(); itS++, itC++) {
+                assert(itC != concurrentWC->flowsEnd());
+                const SimpleArrivalCurve& sequentialCurve = sequentialWC->getShaperCurve(itS->first);
+                const SimpleArrivalCurve& concurrentCurve = concurrentWC->getShaperCurve(itC->first);
+                assert(sequentialCurve.r > 0);
+                assert((sequentialCurve.r == concurrentCurve.r) && (sequentialCurve.b == concurrentCurve.b));
+                assert(itS->second->priority == itC->second->priority);
+                assert(itS->second->latency == itC->second->latency);
+            }
+            assert(itC == concurrentWC->flowsEnd());
+            // Re-optimize every group after deleting a client from each queue
+            for (unsigned int q = 0; q < 8; q++) {
+                ostringstream name;
+                name << "C" << q << "_" << iteration;
+                sequentialWC->delClient(sequentialWC->getClientIdByName(name.str()));
+                concurrentWC->delClient(concurrentWC->getClientIdByName(name.str()));
+            }
+        }
+        delete sequentialWC;
+        delete concurrentWC;
+    }
+
+    // Test the native solver finds the same objective as GLPK
+    {
+        WorkloadCompactor* glpkWC = new WorkloadCompactor(1);
+        WorkloadCompactor* nativeWC = new WorkloadCompactor(1);
+        nativeWC->setSolverType(SHAPER_SOLVER_NATIVE);
+        assert(nativeWC->getSolverType() == SHAPER_SOLVER_NATIVE);
+        WorkloadCompactor* wcs[] = {glpkWC, nativeWC};
+        for (unsigned int w = 0; w < 2; w++) {
+            for (unsigned int q = 0; q < 3; q++) {
+                ostringstream queueName;
+                queueName << "Q" << q;
+                queueInfo["name"] = Json::Value(queueName.str());
+                wcs[w]->addQueue(queueInfo);
+                for (unsigned int n = 0; n < 4; n++) {
+                    ostringstream name;
+                    name << "C" << q << "_" << n;
+                    addTestClient(wcs[w], name.str(), queueName.str(), 5 + 5 * (n % 3), 0.03 * (n + 1), 0.4 + 0.2 * q);
+                }
+            }
+        }
+        for (unsigned int iteration = 0; iteration < 3; iteration++) {
+            glpkWC->calcAllLatency();
+            nativeWC->calcAllLatency();
+            map<QueueId, double> glpkObjectives;
+            map<QueueId, double> nativeObjectives;
+            FlowIterator itG = glpkWC->flowsBegin();
+            FlowIterator itN = nativeWC->flowsBegin();
+            for (; itG != glpkWC->flowsEnd(); itG++, itN++) {
+                assert(itN != nativeWC->flowsEnd());
+                QueueId queueId = itG->second->queueIds.front();
+                glpkObjectives[queueId] += glpkWC->getShaperCurve(itG->first).r;
+                nativeObjectives[queueId] += nativeWC->getShaperCurve(itN->first).r;
+                assert(itG->second->priority == itN->second->priority);
+                assert(itN->second->latency <= nativeWC->getClient(itN->second->clientId)->SLO);
+            }
+            assert(itN == nativeWC->flowsEnd());
+            assert(glpkObjectives.size() == 3);
+            for (map<QueueId, double>::const_iterator it = glpkObjectives.begin(); it != glpkObjectives.end(); it++) {
+                assert(it->second > 0);
+                assert(approxEqual(it->second, nativeObjectives[it->first], epsilon));
+            }
+            // Switch backends midway, and re-optimize each queue after deleting a client
+            if (iteration == 1) {
+                glpkWC->setSolverType(SHAPER_SOLVER_NATIVE);
+                nativeWC->setSolverType(SHAPER_SOLVER_GLPK);
+            }
+            for (unsigned int q = 0; q < 3; q++) {
+                ostringstream name;
+                name << "C" << q << "_" << iteration;
+                glpkWC->delClient(glpkWC->getClientIdByName(name.str()));
+                nativeWC->delClient(nativeWC->getClientIdByName(name.str()));
+            }
+        }
+        delete glpkWC;
+        delete nativeWC;
+    }
+
+    // Test the prefilter only rejects clients that are not admitted
+    {
+        WorkloadCompactor* prefilterWC = new WorkloadCompactor(1);
+        for (unsigned int q = 0; q < 2; q++) {
+            ostringstream queueName;
+            queueName << "Q" << q;
+            queueInfo["name"] = Json::Value(queueName.str());
+            prefilterWC->addQueue(queueInfo);
+        }
+        srand(1);
+        map<PrefilterCheck, unsigned int> checkCounts;
+        unsigned int numAdmitted = 0;
+        for (unsigned int n = 0; n < 200; n++) {
+            ostringstream name;
+            name << "C" << n;
+            ostringstream queueName;
+            queueName << "Q" << (n % 2);
+            double SLO = 0.2 + 20.0 * rand() / RAND_MAX;
+            double r2 = 0.01 + 0.3 * rand() / RAND_MAX;
+            double b2 = 0.3 + 3.0 * rand() / RAND_MAX;
+            Json::Value clientInfos(Json::arrayValue);
+            clientInfos.append(getTestClientInfo(name.str(), queueName.str(), SLO, r2, b2));
+            PrefilterCheck check = prefilterWC->prefilterClients(clientInfos);
+            checkCounts[check]++;
+            SimpleArrivalCurve speculativeShaperCurve;
+            bool admitted = prefilterWC->tryAddClients(clientInfos, tryAddClientsCheck, &speculativeShaperCurve);
+            if (check != PREFILTER_PASSED) {
+                assert(!admitted);
+            }
+            if (admitted) {
+                prefilterWC->addClient(clientInfos[0]);
+                numAdmitted++;
+            }
+        }
+        assert(numAdmitted > 0);
+        assert(checkCounts[PREFILTER_PASSED] > numAdmitted);
+        assert(checkCounts[PREFILTER_RATE] > 0);
+        assert(checkCounts[PREFILTER_BURST] > 0);
+        // A client whose burst at the maximum rate exceeds its SLO cannot fit
+        Json::Value clientInfos(Json::arrayValue);
+        clientInfos.append(getTestClientInfo("CBounds", "Q0", 0.05, 0.01, 1));
+        assert(prefilterWC->prefilterClients(clientInfos) == PREFILTER_BOUNDS);
+        delete prefilterWC;
+    }
+
+    // Test restoring clients with their optimized state matches the original, including once their queues are re-optimized
+    {
+        WorkloadCompactor* originalWC = new WorkloadCompactor(1);
+        WorkloadCompactor* restoredWC = new WorkloadCompactor(1);
+        for (unsigned int q = 0; q < 2; q++) {
+            ostringstream queueName;
+            queueName << "Q" << q;
+            queueInfo["name"] = Json::Value(queueName.str());
+            originalWC->addQueue(queueInfo);
+            restoredWC->addQueue(queueInfo);
+        }
+        vector<Json::Value> clientInfos;
+        for (unsigned int n = 0; n < 6; n++) {
+            ostringstream name;
+            name << "C" << n;
+            ostringstream queueName;
+            queueName << "Q" << (n % 2);
+            clientInfos.push_back(getTestClientInfo(name.str(), queueName.str(), 2 + n, 0.05 + 0.01 * n, 0.5 + 0.1 * n));
+            originalWC->addClient(clientInfos.back());
+        }
+        originalWC->calcAllLatency();
+        for (unsigned int n = 0; n < clientInfos.size(); n++) {
+            const Client* c = originalWC->getClient(originalWC->getClientIdByName(clientInfos[n]["name"].asString()));
+            vector<FlowSnapshot> flows;
+            for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
+                FlowSnapshot flow;
+                flow.shaperCurve = originalWC->getShaperCurve(c->flowIds[flowIndex]);
+                flow.priority = originalWC->getFlow(c->flowIds[flowIndex])->priority;
+                flow.latency = originalWC->getFlow(c->flowIds[flowIndex])->latency;
+                flows.push_back(flow);
+            }
+            restoredWC->restoreClient(clientInfos[n], c->latency, flows);
+        }
+        for (unsigned int iteration = 0; iteration < 2; iteration++) {
+            for (FlowIterator itO = originalWC->flowsBegin(), itR = restoredWC->flowsBegin(); itO != originalWC->flowsEnd(); itO++, itR++) {
+                assert(itR != restoredWC->flowsEnd());
+                assert(itO->second->name == itR->second->name);
+                assert(approxEqual(originalWC->getShaperCurve(itO->first).r, restoredWC->getShaperCurve(itR->first).r, epsilon));
+                assert(approxEqual(originalWC->getShaperCurve(itO->first).b, restoredWC->getShaperCurve(itR->first).b, epsilon));
+                assert(itO->second->priority == itR->second->priority);
+                assert(approxEqual(itO->second->latency, itR->second->latency, epsilon));
+            }
+            // Re-optimize a queue of restored clients, which rebuilds its LP
+            addTestClient(originalWC, "CNew", "Q0", 4.5, 0.05, 0.6);
+            addTestClient(restoredWC, "CNew", "Q0", 4.5, 0.05, 0.6);
+            originalWC->calcAllLatency();
+            restoredWC->calcAllLatency();
+            if (iteration == 0) {
+                originalWC->delClient(originalWC->getClientIdByName("CNew"));
+                restoredWC->delClient(restoredWC->getClientIdByName("CNew"));
+                originalWC->calcAllLatency();
+                restoredWC->calcAllLatency();
+            }
+        }
+        delete originalWC;
+        delete restoredWC;
+    }
+
+    // Test copying the optimized state of a primary's affected clients to a replica, as AdmissionController does,
+    // keeps the replica's rate limit parameters the same as the primary's with queries running on the replica in between
+    {
+        WorkloadCompactor* primaryWC = new WorkloadCompactor(1);
+        WorkloadCompactor* replicaWC = new WorkloadCompactor(1);
+        primaryWC->setNumShaperBuckets(3);
+        replicaWC->setNumShaperBuckets(3);
+        for (unsigned int q = 0; q < 2; q++) {
+            ostringstream queueName;
+            queueName << "Q" << q;
+            queueInfo["name"] = Json::Value(queueName.str());
+            primaryWC->addQueue(queueInfo);
+            replicaWC->addQueue(queueInfo);
+        }
+        map<string, Json::Value> clientInfoStore;
+        for (unsigned int n = 0; n < 10; n++) {
+            ostringstream name;
+            name << "C" << n;
+            ostringstream queueName;
+            queueName << "Q" << (n % 2);
+            // Query the replica before modifying the model
+            Json::Value probeInfos(Json::arrayValue);
+            probeInfos.append(getTestClientInfo("CProbe", queueName.str(), 3 + 0.5 * n, 0.06, 0.4 + 0.05 * n));
+            SimpleArrivalCurve speculativeShaperCurve;
+            replicaWC->tryAddClients(probeInfos, tryAddClientsCheck, &speculativeShaperCurve);
+            // Add a client, or delete an earlier one, and re-optimize the affected clients on the primary
+            if ((n % 4) == 3) {
+                ostringstream deletedName;
+                deletedName << "C" << (n - 3);
+                primaryWC->delClient(primaryWC->getClientIdByName(deletedName.str()));
+                replicaWC->delClient(replicaWC->getClientIdByName(deletedName.str()));
+                clientInfoStore.erase(deletedName.str());
+            } else {
+                clientInfoStore[name.str()] = getTestClientInfo(name.str(), queueName.str(), 2 + n, 0.05 + 0.01 * n, 0.5 + 0.1 * n);
+                primaryWC->addClient(clientInfoStore[name.str()]);
+            }
+            set<ClientId> affectedClientIds;
+            primaryWC->getAffectedClients(affectedClientIds);
+            primaryWC->calcAllLatency();
+            // Copy the state of the affected clients to the replica
+            for (set<ClientId>::const_iterator it = affectedClientIds.begin(); it != affectedClientIds.end(); it++) {
+                const Client* c = primaryWC->getClient(*it);
+                vector<FlowSnapshot> flows;
+                primaryWC->getClientState(*it, flows);
+                ClientId clientId = replicaWC->getClientIdByName(c->name);
+                if (clientId == InvalidClientId) {
+                    replicaWC->restoreClient(clientInfoStore[c->name], c->latency, flows);
+                } else {
+                    replicaWC->restoreClientState(clientId, c->latency, flows);
+                }
+            }
+            replicaWC->discardShaperUpdates();
+            // Replica holds the primary's state without re-solving
+            unsigned long numLPSolves = replicaWC->getNumLPSolves();
+            replicaWC->calcAllLatency();
+            assert(replicaWC->getNumLPSolves() == numLPSolves);
+            assert(replicaWC->getClientIdByName("CProbe") == InvalidClientId);
+            for (ClientIterator itP = primaryWC->clientsBegin(); itP != primaryWC->clientsEnd(); itP++) {
+                const Client* cR = replicaWC->getClient(replicaWC->getClientIdByName(itP->second->name));
+                assert(cR != NULL);
+                assert(approxEqual(itP->second->latency, cR->latency, epsilon));
+                for (unsigned int flowIndex = 0; flowIndex < cR->flowIds.size(); flowIndex++) {
+                    FlowId flowIdP = itP->second->flowIds[flowIndex];
+                    FlowId flowIdR = cR->flowIds[flowIndex];
+                    assert(primaryWC->getShaperCurve(flowIdP).r == replicaWC->getShaperCurve(flowIdR).r);
+                    assert(primaryWC->getShaperCurve(flowIdP).b == replicaWC->getShaperCurve(flowIdR).b);
+                    assert(primaryWC->getPeakCurves(flowIdP).size() == replicaWC->getPeakCurves(flowIdR).size());
+                    for (unsigned int i = 0; i < replicaWC->getPeakCurves(flowIdR).size(); i++) {
+                        assert(primaryWC->getPeakCurves(flowIdP)[i].r == replicaWC->getPeakCurves(flowIdR)[i].r);
+                        assert(primaryWC->getPeakCurves(flowIdP)[i].b == replicaWC->getPeakCurves(flowIdR)[i].b);
+                    }
+                    assert(primaryWC->getFlow(flowIdP)->priority == replicaWC->getFlow(flowIdR)->priority);
+                    assert(approxEqual(primaryWC->getFlow(flowIdP)->latency, replicaWC->getFlow(flowIdR)->latency, epsilon));
+                }
+            }
+        }
+        unsigned int numReplicaClients = 0;
+        for (ClientIterator it = replicaWC->clientsBegin(); it != replicaWC->clientsEnd(); it++) {
+            numReplicaClients++;
+        }
+        assert(numReplicaClients == clientInfoStore.size());
+        delete primaryWC;
+        delete replicaWC;
+    }
+
     cout << "PASS WorkloadCompactorTest" << endl;
 }
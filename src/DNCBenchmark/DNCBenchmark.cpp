@@ -0,0 +1,702 @@
+// DNCBenchmark.cpp - microbenchmarks for the hot paths of DNC-Library.
+// Trace-based operations (rbGen, calcArrivalCurve, pruneArrivalCurve, and calcLatency) are timed on traces of increasing length that are built by
+// concatenating the traces of a trace directory (e.g., examples/traces). Placement operations (NC::addClient/delClient, DNC's aggregate two hop
+// analysis, and WorkloadCompactor's rate limit parameter optimization with each solver) are timed on synthetic topologies with an increasing
+// number of tenants, where each tenant has a network flow to and from a server on another host with the arrival curves of a corpus trace.
+// Each operation is repeated until at least minSeconds have been spent timing it, and the time and number of memory allocations per
+// operation are reported as JSON, with one entry per trace length and tenant count so that the results form scaling curves.
+// Work that only prepares an operation (e.g., building the system being modified) is excluded from its time and allocations.
+//
+// Command line parameters:
+// -d traceDirectory (optional) - directory whose trace files are used; defaults to traces, as when run from the examples directory
+// -l traceLengths (optional) - comma separated numbers of trace entries; defaults to 1000,4000,16000,64000
+// -n tenantCounts (optional) - comma separated numbers of tenants; defaults to 4,16,64
+// -k tenantsPerHost (optional) - number of tenants per host in the synthetic topologies; defaults to 4
+// -m minSeconds (optional) - minimum time spent timing each operation; defaults to 0.5
+// -j numThreads (optional) - number of threads for solving the LPs of independent client groups; defaults to WORKLOAD_COMPACTOR_SOLVER_THREADS
+// -o outputFilename (optional) - file for the JSON results; defaults to stdout
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cstdlib>
+#include <new>
+#include <limits>
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <unistd.h>
+#include <dirent.h>
+#include <json/json.h>
+#include "../common/common.hpp"
+#include "../common/time.hpp"
+#include "../common/serializeJSON.hpp"
+#include "../Estimator/Estimator.hpp"
+#include "../TraceCommon/TraceReader.hpp"
+#include "../TraceCommon/ProcessedTrace.hpp"
+#include "../DNC-Library/DNC.hpp"
+#include "../DNC-Library/WorkloadCompactor.hpp"
+
+using namespace std;
+
+// Bandwidth of the network links, as in NCConfig
+const double NETWORK_BANDWIDTH = 125000000; // bytes/sec
+// Number of rates in the r-b curves, as in calcArrivalCurve
+const unsigned int NUM_RATES = 1000;
+// Number of calls to calcLatency per timed run, since a single call is too short to time accurately
+const unsigned int CALC_LATENCY_BATCH = 1000;
+
+// Allocation counters updated by the global operator new; atomic since the solver threads allocate too
+static unsigned long g_numAllocs = 0;
+static unsigned long g_allocBytes = 0;
+
+void* operator new(size_t size)
+{
+    __sync_fetch_and_add(&g_numAllocs, 1);
+    __sync_fetch_and_add(&g_allocBytes, size);
+    void* p = malloc((size > 0) ? size : 1);
+    if (p == NULL) {
+        throw bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p)
+{
+    free(p);
+}
+
+void operator delete[](void* p)
+{
+    free(p);
+}
+
+// Keeps the results of benchmarked calls alive so that they are not optimized away
+static volatile double g_sink = 0;
+
+// An operation to benchmark.
+// setup is called before each timed run to prepare the operation's input, and run performs the operation and returns the number of operations performed.
+class Benchmark
+{
+public:
+    virtual ~Benchmark() {}
+
+    virtual void setup() {}
+    virtual unsigned int run() = 0;
+};
+
+// Time a benchmark and append its results, labeled by name, to results
+static void runBenchmark(Benchmark& benchmark, const string& name, double minSeconds, Json::Value& results)
+{
+    uint64_t duration = 0;
+    uint64_t minDuration = ConvertSecondsToTime(minSeconds);
+    unsigned long numRuns = 0;
+    unsigned long numOps = 0;
+    unsigned long numAllocs = 0;
+    unsigned long allocBytes = 0;
+    while ((numRuns == 0) || (duration < minDuration)) {
+        benchmark.setup();
+        unsigned long startAllocs = __sync_fetch_and_add(&g_numAllocs, 0);
+        unsigned long startAllocBytes = __sync_fetch_and_add(&g_allocBytes, 0);
+        uint64_t startTime = GetTime();
+        numOps += benchmark.run();
+        duration += GetTime() - startTime;
+        numAllocs += __sync_fetch_and_add(&g_numAllocs, 0) - startAllocs;
+        allocBytes += __sync_fetch_and_add(&g_allocBytes, 0) - startAllocBytes;
+        numRuns++;
+    }
+    double ops = (numOps > 0) ? numOps : 1;
+    Json::Value result;
+    result["name"] = Json::Value(name);
+    result["runs"] = Json::Value((Json::UInt64)numRuns);
+    result["ops"] = Json::Value((Json::UInt64)numOps);
+    result["nsPerOp"] = Json::Value(duration / ops);
+    result["allocsPerOp"] = Json::Value(numAllocs / ops);
+    result["allocBytesPerOp"] = Json::Value(allocBytes / ops);
+    results.append(result);
+    cerr << "  " << name << ": " << (duration / ops) << " ns/op, " << (numAllocs / ops) << " allocs/op" << endl;
+}
+
+// TraceReader over trace entries held in memory
+class MemoryTraceReader : public TraceReader
+{
+private:
+    vector<TraceEntry> _entries;
+    unsigned int _index;
+
+public:
+    MemoryTraceReader(const vector<TraceEntry>& entries)
+        : _entries(entries),
+          _index(0)
+    {}
+    virtual ~MemoryTraceReader()
+    {}
+
+    virtual TraceReader* clone() const { return new MemoryTraceReader(_entries); }
+    virtual bool nextEntry(TraceEntry& entry)
+    {
+        if (_index >= _entries.size()) {
+            return false;
+        }
+        entry = _entries[_index++];
+        return true;
+    }
+    virtual void reset() { _index = 0; }
+};
+
+// Return the estimator info of a network estimator, as in NCConfig
+static Json::Value getNetworkEstimatorInfo(string estimatorType)
+{
+    Json::Value estimatorInfo;
+    estimatorInfo["type"] = Json::Value(estimatorType);
+    estimatorInfo["nonDataConstant"] = Json::Value(200.0);
+    estimatorInfo["nonDataFactor"] = Json::Value(0.025);
+    estimatorInfo["dataConstant"] = Json::Value(200.0);
+    estimatorInfo["dataFactor"] = Json::Value(1.1);
+    return estimatorInfo;
+}
+
+// Read the entries of the trace files in a directory, in order of file name
+static bool readTraces(const string& traceDirectory, vector<vector<TraceEntry> >& traces)
+{
+    DIR* dir = opendir(traceDirectory.c_str());
+    if (dir == NULL) {
+        cerr << "Failed to open directory " << traceDirectory << endl;
+        return false;
+    }
+    vector<string> names;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        string name = entry->d_name;
+        if (!startsWith(name, ".")) {
+            names.push_back(name);
+        }
+    }
+    closedir(dir);
+    sort(names.begin(), names.end());
+    for (vector<string>::const_iterator it = names.begin(); it != names.end(); it++) {
+        TraceReader* pTraceReader = TraceReader::create(traceDirectory + "/" + *it);
+        vector<TraceEntry> trace;
+        TraceEntry traceEntry;
+        while (pTraceReader->nextEntry(traceEntry)) {
+            trace.push_back(traceEntry);
+        }
+        delete pTraceReader;
+        if (!trace.empty()) {
+            traces.push_back(trace);
+        }
+    }
+    if (traces.empty()) {
+        cerr << "No traces found in " << traceDirectory << endl;
+        return false;
+    }
+    return true;
+}
+
+// Build a trace with a given number of entries by concatenating the corpus traces, wrapping around as needed.
+// Each trace is shifted to start 1 ms after the end of the previous one.
+static void concatTraces(const vector<vector<TraceEntry> >& traces, unsigned int length, vector<TraceEntry>& trace)
+{
+    trace.clear();
+    uint64_t offset = 0;
+    for (unsigned int i = 0; trace.size() < length; i = (i + 1) % traces.size()) {
+        const vector<TraceEntry>& t = traces[i];
+        uint64_t start = t.front().arrivalTime;
+        for (unsigned int j = 0; (j < t.size()) && (trace.size() < length); j++) {
+            TraceEntry entry = t[j];
+            entry.arrivalTime = entry.arrivalTime - start + offset;
+            trace.push_back(entry);
+        }
+        offset = trace.back().arrivalTime + 1000000;
+    }
+}
+
+//
+// Trace-based benchmarks
+//
+
+// Benchmark of rbGen for a grid of rates from the max rate down to 0, as in calcArrivalCurve
+class RbGenBenchmark : public Benchmark
+{
+private:
+    ProcessedTrace* _pTrace;
+    vector<double> _rates;
+    vector<double> _bursts;
+
+public:
+    RbGenBenchmark(ProcessedTrace* pTrace, double maxRate)
+        : _pTrace(pTrace)
+    {
+        for (unsigned int i = 0; i < NUM_RATES; i++) {
+            _rates.push_back(maxRate * (NUM_RATES - i) / NUM_RATES);
+        }
+    }
+
+    virtual unsigned int run()
+    {
+        rbGen(_pTrace, _rates, _bursts);
+        g_sink = _bursts.front();
+        return 1;
+    }
+};
+
+// Benchmark of calcArrivalCurve
+class CalcArrivalCurveBenchmark : public Benchmark
+{
+private:
+    ProcessedTrace* _pTrace;
+    double _maxRate;
+    ArrivalCurveAlgorithm _algorithm;
+
+public:
+    CalcArrivalCurveBenchmark(ProcessedTrace* pTrace, double maxRate, ArrivalCurveAlgorithm algorithm)
+        : _pTrace(pTrace),
+          _maxRate(maxRate),
+          _algorithm(algorithm)
+    {}
+
+    virtual unsigned int run()
+    {
+        Curve arrivalCurve;
+        calcArrivalCurve(arrivalCurve, _pTrace, _maxRate, _algorithm);
+        g_sink = arrivalCurve.back().slope;
+        return 1;
+    }
+};
+
+// Benchmark of pruneArrivalCurve on an unpruned arrival curve; the curve is copied during setup
+class PruneArrivalCurveBenchmark : public Benchmark
+{
+private:
+    const Curve& _fullArrivalCurve;
+    Curve _arrivalCurve;
+
+public:
+    PruneArrivalCurveBenchmark(const Curve& fullArrivalCurve)
+        : _fullArrivalCurve(fullArrivalCurve)
+    {}
+
+    virtual void setup() { _arrivalCurve = _fullArrivalCurve; }
+    virtual unsigned int run()
+    {
+        pruneArrivalCurve(_arrivalCurve, ARRIVAL_CURVE_NUM_POINTS);
+        g_sink = _arrivalCurve.back().slope;
+        return 1;
+    }
+};
+
+// Benchmark of calcLatency of an arrival curve at a network link with a 1 ms delay
+class CalcLatencyBenchmark : public Benchmark
+{
+private:
+    const Curve& _arrivalCurve;
+    Curve _serviceCurve;
+
+public:
+    CalcLatencyBenchmark(const Curve& arrivalCurve)
+        : _arrivalCurve(arrivalCurve)
+    {
+        _serviceCurve.push_back(PointSlope(0, 0, 0));
+        _serviceCurve.push_back(PointSlope(0.001, 0, NETWORK_BANDWIDTH));
+    }
+
+    virtual unsigned int run()
+    {
+        double latency = 0;
+        for (unsigned int i = 0; i < CALC_LATENCY_BATCH; i++) {
+            latency += calcLatency(_arrivalCurve, _serviceCurve);
+        }
+        g_sink = latency;
+        return CALC_LATENCY_BATCH;
+    }
+};
+
+// Run the trace-based benchmarks on a trace with a given number of entries
+static void benchmarkTrace(const vector<vector<TraceEntry> >& traces, unsigned int length, double minSeconds, Json::Value& results)
+{
+    vector<TraceEntry> entries;
+    concatTraces(traces, length, entries);
+    MemoryTraceReader traceReader(entries);
+    ProcessedTrace trace(traceReader, Estimator::create(getNetworkEstimatorInfo("networkIn")));
+    cerr << "Trace length " << length << endl;
+    Json::Value& benchmarks = results["benchmarks"];
+    benchmarks = Json::arrayValue;
+    results["traceLength"] = Json::Value(length);
+    RbGenBenchmark rbGenBenchmark(&trace, NETWORK_BANDWIDTH);
+    runBenchmark(rbGenBenchmark, "rbGen", minSeconds, benchmarks);
+    CalcArrivalCurveBenchmark rateSampledBenchmark(&trace, NETWORK_BANDWIDTH, ARRIVAL_CURVE_ALGORITHM_RATE_SAMPLED);
+    runBenchmark(rateSampledBenchmark, "calcArrivalCurve(rateSampled)", minSeconds, benchmarks);
+    CalcArrivalCurveBenchmark exactBenchmark(&trace, NETWORK_BANDWIDTH, ARRIVAL_CURVE_ALGORITHM_EXACT);
+    runBenchmark(exactBenchmark, "calcArrivalCurve(exact)", minSeconds, benchmarks);
+    // The exact arrival curve has more points the longer the trace
+    Curve fullArrivalCurve;
+    calcExactArrivalCurve(fullArrivalCurve, &trace, NETWORK_BANDWIDTH);
+    results["exactArrivalCurvePoints"] = Json::Value((unsigned int)fullArrivalCurve.size());
+    PruneArrivalCurveBenchmark pruneBenchmark(fullArrivalCurve);
+    runBenchmark(pruneBenchmark, "pruneArrivalCurve", minSeconds, benchmarks);
+    Curve arrivalCurve = fullArrivalCurve;
+    pruneArrivalCurve(arrivalCurve, ARRIVAL_CURVE_NUM_POINTS);
+    CalcLatencyBenchmark calcLatencyBenchmark(arrivalCurve);
+    runBenchmark(calcLatencyBenchmark, "calcLatency", minSeconds, benchmarks);
+}
+
+//
+// Placement benchmarks
+//
+
+// Arrival curves of a tenant's flows to and from its server
+struct TenantCurves {
+    Curve in;
+    Curve out;
+};
+
+// Calculate the network arrival curves of a trace
+static void calcTenantCurves(const vector<TraceEntry>& entries, TenantCurves& curves)
+{
+    MemoryTraceReader traceReader(entries);
+    ProcessedTrace traceIn(traceReader, Estimator::create(getNetworkEstimatorInfo("networkIn")));
+    calcArrivalCurve(curves.in, &traceIn, NETWORK_BANDWIDTH);
+    ProcessedTrace traceOut(traceReader, Estimator::create(getNetworkEstimatorInfo("networkOut")));
+    calcArrivalCurve(curves.out, &traceOut, NETWORK_BANDWIDTH);
+}
+
+// Synthetic topology with numTenants tenants spread over hosts with tenantsPerHost tenants each.
+// Tenant i has its client on host i and its server on host i + 1 (modulo the number of hosts), and uses the arrival curves of corpus trace i.
+struct Topology {
+    vector<Json::Value> queueInfos;
+    vector<Json::Value> clientInfos;
+    unsigned int numFlows;
+};
+
+static string getHostName(unsigned int host)
+{
+    ostringstream oss;
+    oss << "host" << host;
+    return oss.str();
+}
+
+static void addFlowInfo(Json::Value& clientInfo, const string& name, unsigned int srcHost, unsigned int dstHost, const Curve& arrivalCurve)
+{
+    Json::Value& flowInfo = clientInfo["flows"][clientInfo["flows"].size()];
+    flowInfo["name"] = Json::Value(name);
+    flowInfo["queues"] = Json::arrayValue;
+    flowInfo["queues"].append(Json::Value(getHostName(srcHost) + "-out"));
+    flowInfo["queues"].append(Json::Value(getHostName(dstHost) + "-in"));
+    Curve curve(arrivalCurve.begin() + 1, arrivalCurve.end());
+    serializeJSON(flowInfo, "arrivalInfo", curve);
+}
+
+static void buildTopology(const vector<TenantCurves>& tenantCurves, unsigned int numTenants, unsigned int tenantsPerHost, Topology& topology)
+{
+    static const double SLOs[] = {0.1, 0.2, 0.45, 0.95};
+    unsigned int numHosts = max(2u, (numTenants + tenantsPerHost - 1) / tenantsPerHost);
+    topology.queueInfos.clear();
+    topology.clientInfos.clear();
+    for (unsigned int host = 0; host < numHosts; host++) {
+        Json::Value queueInfo;
+        queueInfo["bandwidth"] = Json::Value(NETWORK_BANDWIDTH);
+        queueInfo["name"] = Json::Value(getHostName(host) + "-in");
+        topology.queueInfos.push_back(queueInfo);
+        queueInfo["name"] = Json::Value(getHostName(host) + "-out");
+        topology.queueInfos.push_back(queueInfo);
+    }
+    for (unsigned int i = 0; i < numTenants; i++) {
+        ostringstream oss;
+        oss << "C" << i;
+        string name = oss.str();
+        const TenantCurves& curves = tenantCurves[i % tenantCurves.size()];
+        unsigned int clientHost = i % numHosts;
+        unsigned int serverHost = (i + 1) % numHosts;
+        Json::Value clientInfo;
+        clientInfo["name"] = Json::Value(name);
+        clientInfo["SLO"] = Json::Value(SLOs[i % (sizeof(SLOs) / sizeof(SLOs[0]))]);
+        clientInfo["flows"] = Json::arrayValue;
+        addFlowInfo(clientInfo, name + "-in", clientHost, serverHost, curves.in);
+        addFlowInfo(clientInfo, name + "-out", serverHost, clientHost, curves.out);
+        topology.clientInfos.push_back(clientInfo);
+    }
+    topology.numFlows = 2 * numTenants;
+}
+
+// Add the queues and, if addClients is set, the tenants of a topology
+static void populate(NC* nc, const Topology& topology, bool addClients)
+{
+    for (vector<Json::Value>::const_iterator it = topology.queueInfos.begin(); it != topology.queueInfos.end(); it++) {
+        nc->addQueue(*it);
+    }
+    if (addClients) {
+        for (vector<Json::Value>::const_iterator it = topology.clientInfos.begin(); it != topology.clientInfos.end(); it++) {
+            nc->addClient(*it);
+        }
+    }
+}
+
+// Benchmark of NC::addClient for all the tenants of a topology
+class AddClientBenchmark : public Benchmark
+{
+private:
+    const Topology& _topology;
+    DNC* _dnc;
+
+public:
+    AddClientBenchmark(const Topology& topology)
+        : _topology(topology),
+          _dnc(NULL)
+    {}
+    virtual ~AddClientBenchmark() { delete _dnc; }
+
+    virtual void setup()
+    {
+        delete _dnc;
+        _dnc = new DNC();
+        populate(_dnc, _topology, false);
+    }
+    virtual unsigned int run()
+    {
+        for (vector<Json::Value>::const_iterator it = _topology.clientInfos.begin(); it != _topology.clientInfos.end(); it++) {
+            _dnc->addClient(*it);
+        }
+        return _topology.clientInfos.size();
+    }
+};
+
+// Benchmark of NC::delClient for all the tenants of a topology
+class DelClientBenchmark : public Benchmark
+{
+private:
+    const Topology& _topology;
+    DNC* _dnc;
+
+public:
+    DelClientBenchmark(const Topology& topology)
+        : _topology(topology),
+          _dnc(NULL)
+    {}
+    virtual ~DelClientBenchmark() { delete _dnc; }
+
+    virtual void setup()
+    {
+        delete _dnc;
+        _dnc = new DNC();
+        populate(_dnc, _topology, true);
+    }
+    virtual unsigned int run()
+    {
+        vector<ClientId> clientIds;
+        for (ClientIterator it = _dnc->clientsBegin(); it != _dnc->clientsEnd(); it++) {
+            clientIds.push_back(it->first);
+        }
+        for (vector<ClientId>::const_iterator it = clientIds.begin(); it != clientIds.end(); it++) {
+            _dnc->delClient(*it);
+        }
+        return clientIds.size();
+    }
+};
+
+// Benchmark of the latency of all flows with DNC_SIMPLE_ALGORITHM_AGGREGATE (i.e., aggregateAnalysisTwoHop).
+// Each run first modifies a flow, so the queues' aggregates are rebuilt as after any change to the system.
+class AggregateAnalysisBenchmark : public Benchmark
+{
+private:
+    DNC _dnc;
+    FlowId _modifiedFlowId;
+
+public:
+    AggregateAnalysisBenchmark(const Topology& topology)
+        : _dnc(DNC_SIMPLE_ALGORITHM_AGGREGATE)
+    {
+        populate(&_dnc, topology, true);
+        // Rate limit each flow with the middle (r,b) of its arrival curve
+        for (FlowIterator it = _dnc.flowsBegin(); it != _dnc.flowsEnd(); it++) {
+            const Curve& arrivalCurve = _dnc.getArrivalCurve(it->first);
+            const PointSlope& p = arrivalCurve[arrivalCurve.size() / 2];
+            SimpleArrivalCurve shaperCurve;
+            shaperCurve.r = p.slope;
+            shaperCurve.b = yIntercept(p.x, p.y, p.slope);
+            _dnc.setShaperCurve(it->first, shaperCurve);
+        }
+        _modifiedFlowId = _dnc.flowsBegin()->first;
+    }
+
+    virtual unsigned int run()
+    {
+        _dnc.setShaperCurve(_modifiedFlowId, _dnc.getShaperCurve(_modifiedFlowId));
+        double latency = 0;
+        unsigned int numFlows = 0;
+        for (FlowIterator it = _dnc.flowsBegin(); it != _dnc.flowsEnd(); it++) {
+            latency += _dnc.calcFlowLatency(it->first);
+            numFlows++;
+        }
+        g_sink = latency;
+        return numFlows;
+    }
+};
+
+// Benchmark of WorkloadCompactor's optimization of the rate limit parameters (i.e., calcShaperParameters) of all the tenants of a topology
+class CalcShaperParametersBenchmark : public Benchmark
+{
+private:
+    const Topology& _topology;
+    ShaperSolverType _solverType;
+    unsigned int _numThreads;
+    WorkloadCompactor* _wc;
+
+public:
+    CalcShaperParametersBenchmark(const Topology& topology, ShaperSolverType solverType, unsigned int numThreads)
+        : _topology(topology),
+          _solverType(solverType),
+          _numThreads(numThreads),
+          _wc(NULL)
+    {}
+    virtual ~CalcShaperParametersBenchmark() { delete _wc; }
+
+    virtual void setup()
+    {
+        delete _wc;
+        _wc = new WorkloadCompactor(_numThreads);
+        _wc->setSolverType(_solverType);
+        populate(_wc, _topology, true);
+    }
+    virtual unsigned int run()
+    {
+        _wc->updateShaperParameters();
+        return 1;
+    }
+};
+
+// Run the placement benchmarks on a synthetic topology with a given number of tenants
+static void benchmarkTopology(const vector<TenantCurves>& tenantCurves, unsigned int numTenants, unsigned int tenantsPerHost, unsigned int numThreads, double minSeconds, Json::Value& results)
+{
+    Topology topology;
+    buildTopology(tenantCurves, numTenants, tenantsPerHost, topology);
+    cerr << "Tenants " << numTenants << endl;
+    results["numTenants"] = Json::Value(numTenants);
+    results["numQueues"] = Json::Value((unsigned int)topology.queueInfos.size());
+    results["numFlows"] = Json::Value(topology.numFlows);
+    Json::Value& benchmarks = results["benchmarks"];
+    benchmarks = Json::arrayValue;
+    AddClientBenchmark addClientBenchmark(topology);
+    runBenchmark(addClientBenchmark, "NC::addClient", minSeconds, benchmarks);
+    DelClientBenchmark delClientBenchmark(topology);
+    runBenchmark(delClientBenchmark, "NC::delClient", minSeconds, benchmarks);
+    AggregateAnalysisBenchmark aggregateAnalysisBenchmark(topology);
+    runBenchmark(aggregateAnalysisBenchmark, "DNC::aggregateAnalysisTwoHop", minSeconds, benchmarks);
+    CalcShaperParametersBenchmark glpkBenchmark(topology, SHAPER_SOLVER_GLPK, numThreads);
+    runBenchmark(glpkBenchmark, "WorkloadCompactor::calcShaperParameters(glpk)", minSeconds, benchmarks);
+    CalcShaperParametersBenchmark nativeBenchmark(topology, SHAPER_SOLVER_NATIVE, numThreads);
+    runBenchmark(nativeBenchmark, "WorkloadCompactor::calcShaperParameters(native)", minSeconds, benchmarks);
+}
+
+// Parse a comma separated list of positive numbers; returns false if any is invalid
+static bool parseList(const char* str, vector<unsigned int>& list)
+{
+    list.clear();
+    stringstream ss(str);
+    string item;
+    while (getline(ss, item, ',')) {
+        int value = atoi(item.c_str());
+        if (value <= 0) {
+            return false;
+        }
+        list.push_back(value);
+    }
+    return !list.empty();
+}
+
+int main(int argc, char** argv)
+{
+    int opt = 0;
+    string traceDirectory = "traces";
+    vector<unsigned int> traceLengths;
+    vector<unsigned int> tenantCounts;
+    long tenantsPerHost = 4;
+    double minSeconds = 0.5;
+    long numThreads = WORKLOAD_COMPACTOR_SOLVER_THREADS;
+    string outputFilename;
+    bool valid = parseList("1000,4000,16000,64000", traceLengths) && parseList("4,16,64", tenantCounts);
+    do {
+        opt = getopt(argc, argv, "d:l:n:k:m:j:o:");
+        switch (opt) {
+            case 'd':
+                traceDirectory = string(optarg);
+                break;
+
+            case 'l':
+                valid = valid && parseList(optarg, traceLengths);
+                break;
+
+            case 'n':
+                valid = valid && parseList(optarg, tenantCounts);
+                break;
+
+            case 'k':
+                tenantsPerHost = atol(optarg);
+                break;
+
+            case 'm':
+                minSeconds = atof(optarg);
+                break;
+
+            case 'j':
+                numThreads = atol(optarg);
+                break;
+
+            case 'o':
+                outputFilename = string(optarg);
+                break;
+
+            case -1:
+                break;
+
+            default:
+                valid = false;
+                break;
+        }
+    } while (opt != -1);
+
+    if (!valid || (tenantsPerHost <= 0) || (minSeconds < 0) || (numThreads <= 0)) {
+        cout << "Usage: " << argv[0] << " [-d traceDirectory] [-l traceLengths] [-n tenantCounts] [-k tenantsPerHost] [-m minSeconds] [-j numThreads] [-o outputFilename]" << endl;
+        return -1;
+    }
+
+    vector<vector<TraceEntry> > traces;
+    if (!readTraces(traceDirectory, traces)) {
+        return -1;
+    }
+
+    Json::Value root;
+    root["minSeconds"] = Json::Value(minSeconds);
+    root["numTraces"] = Json::Value((unsigned int)traces.size());
+    // Trace-based benchmarks, for scaling over trace length
+    Json::Value& traceResults = root["traceLength"];
+    traceResults = Json::arrayValue;
+    for (vector<unsigned int>::const_iterator it = traceLengths.begin(); it != traceLengths.end(); it++) {
+        benchmarkTrace(traces, *it, minSeconds, traceResults[traceResults.size()]);
+    }
+    // Placement benchmarks, for scaling over tenant count; tenant arrival curves are calculated once for all topologies
+    unsigned int maxTenants = *max_element(tenantCounts.begin(), tenantCounts.end());
+    vector<TenantCurves> tenantCurves(min((size_t)maxTenants, traces.size()));
+    for (unsigned int i = 0; i < tenantCurves.size(); i++) {
+        calcTenantCurves(traces[i], tenantCurves[i]);
+    }
+    Json::Value& topologyResults = root["tenants"];
+    topologyResults = Json::arrayValue;
+    for (vector<unsigned int>::const_iterator it = tenantCounts.begin(); it != tenantCounts.end(); it++) {
+        benchmarkTopology(tenantCurves, *it, tenantsPerHost, numThreads, minSeconds, topologyResults[topologyResults.size()]);
+    }
+
+    if (outputFilename.empty()) {
+        cout << jsonToString(root);
+    } else if (!writeJson(outputFilename, root)) {
+        return -1;
+    }
+    return 0;
+}
@@ -119,20 +119,42 @@ typedef struct {
     double bandwidth; // B/s
 } StorageBandwidth;
 
+// Work is precomputed for request sizes that are multiples of WORK_TABLE_GRANULARITY up to WORK_TABLE_MAX_SIZE bytes.
+#define WORK_TABLE_GRANULARITY_SHIFT 9
+#define WORK_TABLE_GRANULARITY (1 << WORK_TABLE_GRANULARITY_SHIFT)
+#define WORK_TABLE_MAX_SIZE (1024 * 1024)
+
+// Precomputed work for request sizes from startIndex * WORK_TABLE_GRANULARITY to WORK_TABLE_MAX_SIZE in steps of WORK_TABLE_GRANULARITY.
+struct WorkTable {
+    unsigned int startIndex;
+    vector<double> works;
+};
+
 // Estimator for SSD storage traffic at server.
 // Read and write characteristics are different, so they are each profiled separately.
 // Storage profiles look at bandwidth over a range of request sizes and interpolate to calculate the bandwidth of a request.
+// The work of common request sizes (multiples of WORK_TABLE_GRANULARITY up to WORK_TABLE_MAX_SIZE) is looked up from precomputed tables;
+// other request sizes binary search the bandwidth table.
 class StorageSSDEstimator : public Estimator
 {
 protected:
     vector<StorageBandwidth> _readBandwidthTable;
     vector<StorageBandwidth> _writeBandwidthTable;
+    WorkTable _readWorkTable;
+    WorkTable _writeWorkTable;
+
+    // Calculate work from a bandwidth table.
+    static double calcWork(const vector<StorageBandwidth>& bandwidthTable, int requestSize);
+    // Precompute _readWorkTable and _writeWorkTable.
+    void buildWorkTables();
 
 public:
     StorageSSDEstimator(const vector<StorageBandwidth>& readBandwidthTable, const vector<StorageBandwidth>& writeBandwidthTable)
         : _readBandwidthTable(readBandwidthTable),
           _writeBandwidthTable(writeBandwidthTable)
-    {}
+    {
+        buildWorkTables();
+    }
     StorageSSDEstimator(const Json::Value& estimatorInfo);
     virtual ~StorageSSDEstimator() {}
 
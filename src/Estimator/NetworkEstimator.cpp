@@ -9,18 +9,18 @@
 
 double NetworkInEstimator::estimateWork(int requestSize, bool isReadRequest)
 {
-    if (isReadRequest) {
-        return _nonDataConstant + _nonDataFactor * (double)requestSize;
-    } else {
-        return _dataConstant + _dataFactor * (double)requestSize;
-    }
+    // Select parameters by indexing rather than branching
+    const double constants[2] = {_dataConstant, _nonDataConstant};
+    const double factors[2] = {_dataFactor, _nonDataFactor};
+    int isRead = isReadRequest ? 1 : 0;
+    return constants[isRead] + factors[isRead] * (double)requestSize;
 }
 
 double NetworkOutEstimator::estimateWork(int requestSize, bool isReadRequest)
 {
-    if (!isReadRequest) {
-        return _nonDataConstant + _nonDataFactor * (double)requestSize;
-    } else {
-        return _dataConstant + _dataFactor * (double)requestSize;
-    }
+    // Select parameters by indexing rather than branching
+    const double constants[2] = {_nonDataConstant, _dataConstant};
+    const double factors[2] = {_nonDataFactor, _dataFactor};
+    int isRead = isReadRequest ? 1 : 0;
+    return constants[isRead] + factors[isRead] * (double)requestSize;
 }
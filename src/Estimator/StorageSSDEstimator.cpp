@@ -8,6 +8,7 @@
 #include "Estimator.hpp"
 
 #include <assert.h>
+#include <algorithm>
 #include <json/json.h>
 
 StorageSSDEstimator::StorageSSDEstimator(const Json::Value& estimatorInfo)
@@ -22,21 +23,60 @@ StorageSSDEstimator::StorageSSDEstimator(const Json::Value& estimatorInfo)
         _writeBandwidthTable[entry].requestSize = bwTableEntry["requestSize"].asInt();
         _writeBandwidthTable[entry].bandwidth = bwTableEntry["writeBandwidth"].asDouble();
     }
+    buildWorkTables();
 }
 
-double StorageSSDEstimator::estimateWork(int requestSize, bool isReadRequest)
+// Compare request size against the request size of a bandwidth table entry.
+static bool requestSizeLess(int requestSize, const StorageBandwidth& entry)
 {
-    const vector<StorageBandwidth>& bandwidthTable = isReadRequest ? _readBandwidthTable : _writeBandwidthTable;
+    return requestSize < entry.requestSize;
+}
+
+double StorageSSDEstimator::calcWork(const vector<StorageBandwidth>& bandwidthTable, int requestSize)
+{
+    assert(!bandwidthTable.empty());
     double bandwidth = bandwidthTable.back().bandwidth; // max bw
-    for (unsigned int i = 1; i < bandwidthTable.size(); i++) {
-        if (requestSize < bandwidthTable[i].requestSize) {
-            bandwidth = linearInterpolate(static_cast<double>(requestSize),
-                                          static_cast<double>(bandwidthTable[i-1].requestSize), static_cast<double>(bandwidthTable[i].requestSize),
-                                          bandwidthTable[i-1].bandwidth, bandwidthTable[i].bandwidth);
-
-            break;
-        }
+    // Find first entry after the first with a larger request size and interpolate with the previous entry
+    vector<StorageBandwidth>::const_iterator it = upper_bound(bandwidthTable.begin() + 1, bandwidthTable.end(), requestSize, requestSizeLess);
+    if (it != bandwidthTable.end()) {
+        vector<StorageBandwidth>::const_iterator prevIt = it - 1;
+        bandwidth = linearInterpolate(static_cast<double>(requestSize),
+                                      static_cast<double>(prevIt->requestSize), static_cast<double>(it->requestSize),
+                                      prevIt->bandwidth, it->bandwidth);
     }
     assert(bandwidth > 0);
     return static_cast<double>(requestSize) / bandwidth;
 }
+
+// Precompute the work of request sizes that are multiples of WORK_TABLE_GRANULARITY up to WORK_TABLE_MAX_SIZE.
+// Request sizes smaller than the first bandwidth table entry are extrapolated and are not precomputed.
+static void buildWorkTable(WorkTable& workTable, const vector<StorageBandwidth>& bandwidthTable, double (*calcWork)(const vector<StorageBandwidth>&, int))
+{
+    workTable.works.clear();
+    if (bandwidthTable.empty()) {
+        workTable.startIndex = 0;
+        return;
+    }
+    int minRequestSize = max(bandwidthTable.front().requestSize, 0);
+    workTable.startIndex = (minRequestSize + WORK_TABLE_GRANULARITY - 1) >> WORK_TABLE_GRANULARITY_SHIFT;
+    for (unsigned int index = workTable.startIndex; index <= (WORK_TABLE_MAX_SIZE >> WORK_TABLE_GRANULARITY_SHIFT); index++) {
+        workTable.works.push_back(calcWork(bandwidthTable, index << WORK_TABLE_GRANULARITY_SHIFT));
+    }
+}
+
+void StorageSSDEstimator::buildWorkTables()
+{
+    buildWorkTable(_readWorkTable, _readBandwidthTable, calcWork);
+    buildWorkTable(_writeWorkTable, _writeBandwidthTable, calcWork);
+}
+
+double StorageSSDEstimator::estimateWork(int requestSize, bool isReadRequest)
+{
+    const WorkTable& workTable = isReadRequest ? _readWorkTable : _writeWorkTable;
+    // Negative request sizes and sizes outside the table wrap around to a large offset
+    unsigned int offset = (static_cast<unsigned int>(requestSize) >> WORK_TABLE_GRANULARITY_SHIFT) - workTable.startIndex;
+    if (((requestSize & (WORK_TABLE_GRANULARITY - 1)) == 0) && (offset < workTable.works.size())) {
+        return workTable.works[offset];
+    }
+    return calcWork(isReadRequest ? _readBandwidthTable : _writeBandwidthTable, requestSize);
+}
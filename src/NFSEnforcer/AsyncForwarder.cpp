@@ -0,0 +1,387 @@
+// AsyncForwarder.cpp - Asynchronous forwarding of NFS requests to the backend NFS server.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <map>
+#include <utility>
+#include <cstring>
+#include <cstdlib>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/uio.h>
+#include <rpc/rpc.h>
+#include <rpc/pmap_clnt.h>
+#include "../prot/nfs3_prot.h"
+#include "../common/time.hpp"
+#include "NFSPayload.hpp"
+#include "AsyncForwarder.hpp"
+
+using namespace std;
+
+// Size of an RPC call header (xid through proc) excluding the credentials and verifier
+#define CALL_HEADER_SIZE (6 * BYTES_PER_XDR_UNIT)
+
+// Longest time between checks for expired deadlines
+#define MAX_SWEEP_INTERVAL 1.0
+
+bool AsyncForwarder::readAll(BackendConnection& connection, char* buf, size_t len)
+{
+    // Only the receiver thread changes fd, so it is read without the lock
+    int fd = connection.fd;
+    while (len > 0) {
+        // Wait until readable or the next sweep
+        uint64_t now = GetTime();
+        if (now >= connection.nextSweep) {
+            sweepExpiredJobs(connection);
+            connection.nextSweep = now + _sweepInterval;
+        }
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        int timeoutMs = (int)((connection.nextSweep - now + 999999) / 1000000);
+        int rc = poll(&pfd, 1, timeoutMs);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        } else if (rc == 0) {
+            continue;
+        }
+        ssize_t n = read(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        } else if (n == 0) {
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+AsyncForwarder::AsyncForwarder(int numConnections, double timeout)
+    : _timeout(ConvertSecondsToTime(timeout)),
+      _sweepInterval(ConvertSecondsToTime(min(timeout / 10, MAX_SWEEP_INTERVAL))),
+      _nextXid((uint32_t)GetTime()),
+      _nextConnection(0)
+{
+    pthread_mutex_init(&_completionMutex, NULL);
+    pthread_cond_init(&_completionCV, NULL);
+    // Use NFS enforcer's user as authentication
+    _auth = authunix_create_default();
+    for (int i = 0; i < numConnections; i++) {
+        BackendConnection* connection = new BackendConnection();
+        connection->fd = connectBackend();
+        if (connection->fd < 0) {
+            cerr << "Failed to connect to NFS server" << endl;
+            exit(2);
+        }
+        pthread_mutex_init(&connection->sendMutex, NULL);
+        pthread_mutex_init(&connection->pendingMutex, NULL);
+        connection->nextSweep = 0;
+        connection->forwarder = this;
+        _connections.push_back(connection);
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        int rc = pthread_create(&thread,
+                                &attr,
+                                receiverThread,
+                                (void*)connection);
+        if (rc) {
+            cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
+            exit(-1);
+        }
+    }
+}
+
+int AsyncForwarder::connectBackend()
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    u_short port = pmap_getport(&addr, NFS_PROGRAM, NFS_V3, IPPROTO_TCP);
+    if (port == 0) {
+        return -1;
+    }
+    addr.sin_port = htons(port);
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    // Requests are sent as soon as they are scheduled
+    int flag = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    return fd;
+}
+
+void AsyncForwarder::forward(Job* pJob)
+{
+    BackendConnection& connection = *_connections[__sync_fetch_and_add(&_nextConnection, 1) % _connections.size()];
+    uint32_t xid = __sync_fetch_and_add(&_nextXid, 1);
+    // Encode record mark, call header, and arguments
+    // WRITE data is sent from the job's buffer rather than copied into the request
+    bool writeRequest = pJob->IsWriteRequest();
+    xdrproc_t xdrArgument = writeRequest ? (xdrproc_t)xdr_write3args_header : pJob->XdrArgument();
+    struct rpc_msg call;
+    call.rm_xid = xid;
+    call.rm_direction = CALL;
+    call.rm_call.cb_rpcvers = RPC_MSG_VERSION;
+    call.rm_call.cb_prog = NFS_PROGRAM;
+    call.rm_call.cb_vers = NFS_V3;
+    call.rm_call.cb_proc = pJob->Proc();
+    call.rm_call.cb_cred = _auth->ah_cred;
+    call.rm_call.cb_verf = _auth->ah_verf;
+    size_t bufferSize = RECORD_MARK_SIZE + CALL_HEADER_SIZE + 2 * (2 * BYTES_PER_XDR_UNIT + MAX_AUTH_BYTES) + xdr_sizeof(xdrArgument, pJob->Argument());
+    char* buffer = (char*)_bufferPool.alloc(bufferSize);
+    XDR xdrs;
+    xdrmem_create(&xdrs, buffer + RECORD_MARK_SIZE, bufferSize - RECORD_MARK_SIZE, XDR_ENCODE);
+    bool encoded = xdr_callmsg(&xdrs, &call) && (*xdrArgument)(&xdrs, pJob->Argument());
+    uint32_t len = XDR_GETPOS(&xdrs);
+    struct iovec iov[3];
+    int iovcnt = 1;
+    iov[0].iov_base = buffer;
+    iov[0].iov_len = RECORD_MARK_SIZE + len;
+    if (writeRequest) {
+        write3args* args = (write3args*)pJob->Argument();
+        iov[1].iov_base = args->data.data_val;
+        iov[1].iov_len = args->data.data_len;
+        iov[2].iov_base = (char*)xdrPadding();
+        iov[2].iov_len = RNDUP(args->data.data_len) - args->data.data_len;
+        iovcnt = 3;
+        len += RNDUP(args->data.data_len);
+    }
+    xdr_destroy(&xdrs);
+    if (!encoded) {
+        _bufferPool.free(buffer, bufferSize);
+        complete(pJob, RPC_CANTENCODEARGS);
+        return;
+    }
+    uint32_t mark = htonl(LAST_FRAGMENT | len);
+    memcpy(buffer, &mark, RECORD_MARK_SIZE);
+    // Send request
+    pthread_mutex_lock(&connection.sendMutex);
+    bool sent = false;
+    if (connection.fd >= 0) {
+        // Register job before sending, since the reply can be received before the send returns
+        PendingJob pending;
+        pending.pJob = pJob;
+        pending.deadline = GetTime() + _timeout;
+        pthread_mutex_lock(&connection.pendingMutex);
+        connection.pendingJobs[xid] = pending;
+        pthread_mutex_unlock(&connection.pendingMutex);
+        sent = writevAll(connection.fd, iov, iovcnt);
+        if (!sent) {
+            // Only fail the job if the receiver thread has not already done so (e.g., it expired)
+            pthread_mutex_lock(&connection.pendingMutex);
+            sent = (connection.pendingJobs.erase(xid) == 0);
+            pthread_mutex_unlock(&connection.pendingMutex);
+        }
+    }
+    pthread_mutex_unlock(&connection.sendMutex);
+    _bufferPool.free(buffer, bufferSize);
+    if (!sent) {
+        complete(pJob, RPC_CANTSEND);
+    }
+}
+
+void AsyncForwarder::sweepExpiredJobs(BackendConnection& connection)
+{
+    // Remove expired jobs, so their late replies are ignored
+    vector<Job*> expiredJobs;
+    uint64_t now = GetTime();
+    pthread_mutex_lock(&connection.pendingMutex);
+    for (map<uint32_t, PendingJob>::iterator it = connection.pendingJobs.begin(); it != connection.pendingJobs.end();) {
+        if (it->second.deadline <= now) {
+            expiredJobs.push_back(it->second.pJob);
+            connection.pendingJobs.erase(it++);
+        } else {
+            it++;
+        }
+    }
+    pthread_mutex_unlock(&connection.pendingMutex);
+    for (vector<Job*>::const_iterator it = expiredJobs.begin(); it != expiredJobs.end(); it++) {
+        complete(*it, RPC_TIMEDOUT);
+    }
+}
+
+void AsyncForwarder::receiveReplies(BackendConnection& connection, char*& buffer, size_t& bufferSize)
+{
+    while (true) {
+        // Read record
+        size_t len = 0;
+        bool last = false;
+        while (!last) {
+            uint32_t mark;
+            if (!readAll(connection, (char*)&mark, RECORD_MARK_SIZE)) {
+                return;
+            }
+            mark = ntohl(mark);
+            last = (mark & LAST_FRAGMENT) != 0;
+            size_t fragmentLen = mark & ~LAST_FRAGMENT;
+            if (bufferSize < (len + fragmentLen)) {
+                size_t newSize = max(2 * bufferSize, len + fragmentLen);
+                char* newBuffer = (char*)_bufferPool.alloc(newSize);
+                memcpy(newBuffer, buffer, len);
+                _bufferPool.free(buffer, bufferSize);
+                buffer = newBuffer;
+                bufferSize = newSize;
+            }
+            if ((fragmentLen > 0) && !readAll(connection, &buffer[len], fragmentLen)) {
+                return;
+            }
+            len += fragmentLen;
+        }
+        if (len < BYTES_PER_XDR_UNIT) {
+            continue;
+        }
+        // Match reply to job by XID
+        uint32_t xid;
+        memcpy(&xid, &buffer[0], sizeof(xid));
+        xid = ntohl(xid);
+        Job* pJob = NULL;
+        pthread_mutex_lock(&connection.pendingMutex);
+        map<uint32_t, PendingJob>::iterator it = connection.pendingJobs.find(xid);
+        if (it != connection.pendingJobs.end()) {
+            pJob = it->second.pJob;
+            connection.pendingJobs.erase(it);
+        }
+        pthread_mutex_unlock(&connection.pendingMutex);
+        if (pJob == NULL) {
+            continue;
+        }
+        // Decode reply into job
+        // READ data is decoded in place rather than copied, and the buffer is handed to the job
+        bool readRequest = pJob->IsReadRequest();
+        struct rpc_msg reply;
+        memset(&reply, 0, sizeof(reply));
+        reply.acpted_rply.ar_verf = _null_auth;
+        reply.acpted_rply.ar_results.where = pJob->Result();
+        reply.acpted_rply.ar_results.proc = readRequest ? (xdrproc_t)xdr_inline_read3res : pJob->XdrResult();
+        XDR xdrs;
+        xdrmem_create(&xdrs, &buffer[0], len, XDR_DECODE);
+        enum clnt_stat rpcStatus = RPC_CANTDECODERES;
+        if (xdr_replymsg(&xdrs, &reply)) {
+            struct rpc_err err;
+            _seterr_reply(&reply, &err);
+            rpcStatus = err.re_status;
+        }
+        if ((reply.rm_reply.rp_stat == MSG_ACCEPTED) && (reply.acpted_rply.ar_verf.oa_base != NULL)) {
+            xdrs.x_op = XDR_FREE;
+            xdr_opaque_auth(&xdrs, &reply.acpted_rply.ar_verf);
+        }
+        if (readRequest) {
+            read3res* res = (read3res*)pJob->Result();
+            if (res->status == NFS3_OK) {
+                if ((rpcStatus == RPC_SUCCESS) && (res->read3res_u.resok.data.data_val != NULL)) {
+                    pJob->replyBuffer = buffer;
+                    pJob->replyBufferSize = bufferSize;
+                    buffer = (char*)_bufferPool.alloc(bufferSize);
+                } else {
+                    res->read3res_u.resok.data.data_val = NULL;
+                    res->read3res_u.resok.data.data_len = 0;
+                }
+            }
+        }
+        if (rpcStatus != RPC_SUCCESS) {
+            // Free partially decoded results, since the results of failed jobs are not freed
+            xdrs.x_op = XDR_FREE;
+            (*pJob->XdrResult())(&xdrs, pJob->Result());
+            memset((char*)pJob->Result(), 0, sizeof(pJob->result));
+        }
+        xdr_destroy(&xdrs);
+        complete(pJob, rpcStatus);
+    }
+}
+
+void AsyncForwarder::releaseReplyBuffer(Job* pJob)
+{
+    if (pJob->replyBuffer != NULL) {
+        _bufferPool.free(pJob->replyBuffer, pJob->replyBufferSize);
+        pJob->replyBuffer = NULL;
+    }
+}
+
+void AsyncForwarder::resetConnection(BackendConnection& connection)
+{
+    // Close connection first, so no more jobs are sent on it
+    pthread_mutex_lock(&connection.sendMutex);
+    close(connection.fd);
+    connection.fd = -1;
+    pthread_mutex_unlock(&connection.sendMutex);
+    // Fail pending jobs
+    map<uint32_t, PendingJob> pendingJobs;
+    pthread_mutex_lock(&connection.pendingMutex);
+    pendingJobs.swap(connection.pendingJobs);
+    pthread_mutex_unlock(&connection.pendingMutex);
+    for (map<uint32_t, PendingJob>::const_iterator it = pendingJobs.begin(); it != pendingJobs.end(); it++) {
+        complete(it->second.pJob, RPC_CANTRECV);
+    }
+    // Reconnect
+    int fd;
+    while ((fd = connectBackend()) < 0) {
+        cerr << "Failed to reconnect to NFS server" << endl;
+        RelativeSleep(ConvertSecondsToTime(1));
+    }
+    pthread_mutex_lock(&connection.sendMutex);
+    connection.fd = fd;
+    pthread_mutex_unlock(&connection.sendMutex);
+}
+
+void* AsyncForwarder::receiverThread(void* ptr)
+{
+    BackendConnection& connection = *(BackendConnection*)ptr;
+    // Buffer for received replies, which grows to the largest reply
+    size_t bufferSize = 64 * 1024;
+    char* buffer = (char*)connection.forwarder->_bufferPool.alloc(bufferSize);
+    while (true) {
+        connection.forwarder->receiveReplies(connection, buffer, bufferSize);
+        cerr << "Lost connection to NFS server" << endl;
+        connection.forwarder->resetConnection(connection);
+    }
+    return NULL;
+}
+
+void AsyncForwarder::complete(Job* pJob, enum clnt_stat rpcStatus)
+{
+    pJob->serviceEndTime = GetTime();
+    pthread_mutex_lock(&_completionMutex);
+    _completedJobs.push_back(make_pair(pJob, rpcStatus));
+    pthread_cond_signal(&_completionCV);
+    pthread_mutex_unlock(&_completionMutex);
+}
+
+Job* AsyncForwarder::getCompletedJob(enum clnt_stat& rpcStatus)
+{
+    pthread_mutex_lock(&_completionMutex);
+    while (_completedJobs.empty()) {
+        pthread_cond_wait(&_completionCV, &_completionMutex);
+    }
+    Job* pJob = _completedJobs.front().first;
+    rpcStatus = _completedJobs.front().second;
+    _completedJobs.pop_front();
+    pthread_mutex_unlock(&_completionMutex);
+    return pJob;
+}
@@ -0,0 +1,93 @@
+// AsyncForwarder.hpp - Asynchronous forwarding of NFS requests to the backend NFS server.
+// Requests are sent over a few TCP connections to the NFS server without waiting for their replies, so many requests can be outstanding per connection.
+// Each connection has a receiver thread that matches replies to jobs by XID and decodes the results into the jobs.
+// The receiver thread also fails jobs whose replies have not been received by their deadline with RPC_TIMEDOUT.
+// Completed jobs are put in a completion queue, from which they are taken to reply to the NFS clients.
+// WRITE data is sent from the jobs' buffers, and READ data is left in the reply buffers, which are handed to the jobs, so payloads are not copied.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _ASYNC_FORWARDER_HPP
+#define _ASYNC_FORWARDER_HPP
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <utility>
+#include <pthread.h>
+#include <stdint.h>
+#include <rpc/rpc.h>
+#include "scheduler.hpp"
+#include "BufferPool.hpp"
+
+using namespace std;
+
+class AsyncForwarder;
+
+// Job sent to the backend NFS server that is waiting for its reply
+struct PendingJob {
+    Job* pJob;
+    uint64_t deadline; // time by which the reply must be received
+};
+
+// TCP connection to the backend NFS server
+struct BackendConnection {
+    int fd; // -1 while reconnecting
+    pthread_mutex_t sendMutex; // protects fd and sending requests
+    pthread_mutex_t pendingMutex; // protects pendingJobs
+    map<uint32_t, PendingJob> pendingJobs; // jobs sent on the connection by XID
+    uint64_t nextSweep; // time to next check pendingJobs for expired deadlines; only used by the receiver thread
+    AsyncForwarder* forwarder;
+};
+
+// AsyncForwarder is thread-safe.
+// Receiver threads run until the process exits, so an AsyncForwarder is never destroyed.
+class AsyncForwarder
+{
+private:
+    vector<BackendConnection*> _connections;
+    AUTH* _auth; // credentials used for forwarded requests
+    uint64_t _timeout; // time to wait for a reply before failing a job
+    uint64_t _sweepInterval; // time between checks for expired deadlines
+    volatile uint32_t _nextXid;
+    volatile unsigned int _nextConnection; // connections are used round robin
+    BufferPool _bufferPool; // buffers for encoding requests and receiving replies
+    // Completion queue
+    pthread_mutex_t _completionMutex;
+    pthread_cond_t _completionCV;
+    deque<pair<Job*, enum clnt_stat> > _completedJobs;
+
+    // Connect to the backend NFS server; returns -1 on failure.
+    static int connectBackend();
+    // Read a buffer from a connection, failing expired jobs while waiting; returns false if the connection failed or was closed.
+    bool readAll(BackendConnection& connection, char* buf, size_t len);
+    // Fail the jobs on a connection whose deadlines have passed.
+    void sweepExpiredJobs(BackendConnection& connection);
+    // Receive replies on a connection until it fails.
+    // The buffer is replaced when it is handed to a job.
+    void receiveReplies(BackendConnection& connection, char*& buffer, size_t& bufferSize);
+    // Fail the jobs pending on a connection and reconnect it.
+    void resetConnection(BackendConnection& connection);
+    // Put a completed job in the completion queue.
+    void complete(Job* pJob, enum clnt_stat rpcStatus);
+    static void* receiverThread(void* ptr);
+
+    AsyncForwarder(const AsyncForwarder&); // not implemented
+    AsyncForwarder& operator=(const AsyncForwarder&); // not implemented
+
+public:
+    // Connect to the backend NFS server and start the receiver threads; exits if the server cannot be reached.
+    // Jobs whose replies are not received within timeout seconds are failed.
+    AsyncForwarder(int numConnections, double timeout);
+
+    // Send a job's request to the backend NFS server; the job is put in the completion queue once its reply is received or forwarding fails.
+    void forward(Job* pJob);
+    // Wait for a completed job; rpcStatus is RPC_SUCCESS if the job's result has been decoded.
+    Job* getCompletedJob(enum clnt_stat& rpcStatus);
+    // Release the reply buffer holding a READ job's data, if any; the job's data must no longer be used.
+    void releaseReplyBuffer(Job* pJob);
+};
+
+#endif // _ASYNC_FORWARDER_HPP
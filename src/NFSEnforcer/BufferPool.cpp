@@ -0,0 +1,131 @@
+// BufferPool.cpp - Pools of memory blocks for the NFS proxy hot path.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cassert>
+#include <pthread.h>
+#include "BufferPool.hpp"
+
+using namespace std;
+
+BlockPool::BlockPool(size_t blockSize)
+    : _blockSize(blockSize)
+{
+    pthread_mutex_init(&_mutex, NULL);
+    pthread_key_create(&_cacheKey, destroyCache);
+}
+
+BlockPool::~BlockPool()
+{
+    for (vector<void*>::const_iterator it = _freeBlocks.begin(); it != _freeBlocks.end(); it++) {
+        ::free(*it);
+    }
+    pthread_key_delete(_cacheKey);
+    pthread_mutex_destroy(&_mutex);
+}
+
+// Get the calling thread's cache, creating it on first use.
+vector<void*>& BlockPool::getCache()
+{
+    vector<void*>* pCache = (vector<void*>*)pthread_getspecific(_cacheKey);
+    if (pCache == NULL) {
+        pCache = new vector<void*>();
+        pCache->reserve(2 * BLOCK_POOL_BATCH_SIZE);
+        pthread_setspecific(_cacheKey, pCache);
+    }
+    return *pCache;
+}
+
+// Blocks in the cache of an exiting thread are not reused.
+void BlockPool::destroyCache(void* ptr)
+{
+    vector<void*>* pCache = (vector<void*>*)ptr;
+    for (vector<void*>::const_iterator it = pCache->begin(); it != pCache->end(); it++) {
+        ::free(*it);
+    }
+    delete pCache;
+}
+
+void* BlockPool::alloc()
+{
+    vector<void*>& cache = getCache();
+    if (cache.empty()) {
+        // Refill cache from the shared free list
+        pthread_mutex_lock(&_mutex);
+        size_t count = min(_freeBlocks.size(), (size_t)BLOCK_POOL_BATCH_SIZE);
+        cache.insert(cache.end(), _freeBlocks.end() - count, _freeBlocks.end());
+        _freeBlocks.resize(_freeBlocks.size() - count);
+        pthread_mutex_unlock(&_mutex);
+        if (cache.empty()) {
+            void* ptr = malloc(_blockSize);
+            assert(ptr != NULL);
+            return ptr;
+        }
+    }
+    void* ptr = cache.back();
+    cache.pop_back();
+    return ptr;
+}
+
+void BlockPool::free(void* ptr)
+{
+    vector<void*>& cache = getCache();
+    cache.push_back(ptr);
+    if (cache.size() >= 2 * BLOCK_POOL_BATCH_SIZE) {
+        // Move a batch to the shared free list for other threads
+        pthread_mutex_lock(&_mutex);
+        _freeBlocks.insert(_freeBlocks.end(), cache.end() - BLOCK_POOL_BATCH_SIZE, cache.end());
+        pthread_mutex_unlock(&_mutex);
+        cache.resize(cache.size() - BLOCK_POOL_BATCH_SIZE);
+    }
+}
+
+BufferPool::BufferPool()
+{
+    for (size_t size = BUFFER_POOL_MIN_SIZE; size <= BUFFER_POOL_MAX_SIZE; size *= 2) {
+        _pools.push_back(new BlockPool(size));
+    }
+}
+
+BufferPool::~BufferPool()
+{
+    for (vector<BlockPool*>::const_iterator it = _pools.begin(); it != _pools.end(); it++) {
+        delete *it;
+    }
+}
+
+BlockPool* BufferPool::getPool(size_t size)
+{
+    for (vector<BlockPool*>::const_iterator it = _pools.begin(); it != _pools.end(); it++) {
+        if (size <= (*it)->getBlockSize()) {
+            return *it;
+        }
+    }
+    return NULL;
+}
+
+void* BufferPool::alloc(size_t size)
+{
+    BlockPool* pPool = getPool(size);
+    if (pPool == NULL) {
+        void* ptr = malloc(size);
+        assert(ptr != NULL);
+        return ptr;
+    }
+    return pPool->alloc();
+}
+
+void BufferPool::free(void* ptr, size_t size)
+{
+    BlockPool* pPool = getPool(size);
+    if (pPool == NULL) {
+        ::free(ptr);
+    } else {
+        pPool->free(ptr);
+    }
+}
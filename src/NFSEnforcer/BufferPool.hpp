@@ -0,0 +1,72 @@
+// BufferPool.hpp - Pools of memory blocks for the NFS proxy hot path.
+// Blocks freed by a thread are kept in a per-thread cache and reused by its next allocations.
+// Caches exchange batches of blocks with a shared free list, so blocks allocated by one thread (e.g., jobs received by intake reader threads)
+// and freed by another (e.g., worker threads) are still reused, and the shared free list is only locked once per batch.
+// Blocks are never returned to the system, so once the pools have grown to the peak number of requests, requests are handled without malloc/free.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _BUFFER_POOL_HPP
+#define _BUFFER_POOL_HPP
+
+#include <vector>
+#include <cstddef>
+#include <pthread.h>
+
+using namespace std;
+
+// Number of blocks moved between a per-thread cache and the shared free list at a time.
+#define BLOCK_POOL_BATCH_SIZE 32
+// Buffer size classes are powers of two between these sizes; larger buffers are allocated with malloc.
+#define BUFFER_POOL_MIN_SIZE 4096
+#define BUFFER_POOL_MAX_SIZE (1024 * 1024)
+
+// Pool of fixed size blocks; BlockPool is thread-safe.
+class BlockPool
+{
+private:
+    size_t _blockSize;
+    pthread_mutex_t _mutex; // protects _freeBlocks
+    vector<void*> _freeBlocks;
+    pthread_key_t _cacheKey; // per-thread vector<void*> cache of free blocks
+
+    vector<void*>& getCache();
+    static void destroyCache(void* ptr);
+
+    BlockPool(const BlockPool&); // not implemented
+    BlockPool& operator=(const BlockPool&); // not implemented
+
+public:
+    BlockPool(size_t blockSize);
+    virtual ~BlockPool();
+
+    void* alloc();
+    void free(void* ptr);
+    size_t getBlockSize() const { return _blockSize; }
+};
+
+// Pool of buffers in power of two size classes; BufferPool is thread-safe.
+class BufferPool
+{
+private:
+    vector<BlockPool*> _pools; // by size class
+
+    // Get the pool for a size, or NULL if it is larger than BUFFER_POOL_MAX_SIZE.
+    BlockPool* getPool(size_t size);
+
+    BufferPool(const BufferPool&); // not implemented
+    BufferPool& operator=(const BufferPool&); // not implemented
+
+public:
+    BufferPool();
+    virtual ~BufferPool();
+
+    // Allocate a buffer of at least size bytes.
+    void* alloc(size_t size);
+    // Free a buffer; size must be the size it was allocated with.
+    void free(void* ptr, size_t size);
+};
+
+#endif // _BUFFER_POOL_HPP
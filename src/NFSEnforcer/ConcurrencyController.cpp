@@ -0,0 +1,76 @@
+// ConcurrencyController.cpp - Online adjustment of the max number of concurrent jobs at the storage device (i.e., the MPL).
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <algorithm>
+#include <stdint.h>
+#include "../common/time.hpp"
+#include "ConcurrencyController.hpp"
+
+using namespace std;
+
+ConcurrencyController::ConcurrencyController(const ConcurrencyControllerParams& params, int initialMPL, uint64_t now)
+    : _params(params),
+      _mpl(max(params.minMPL, min(initialMPL, params.maxMPL))),
+      _direction(1),
+      _hasPrevPower(false),
+      _prevPower(0)
+{
+    resetMeasurement(now);
+}
+
+void ConcurrencyController::resetMeasurement(uint64_t now)
+{
+    _measurementStart = now;
+    _samples = 0;
+    _bytes = 0;
+    _serviceTime = 0;
+    _limited = false;
+}
+
+void ConcurrencyController::complete(uint64_t requestSize, uint64_t serviceTime)
+{
+    _samples++;
+    _bytes += requestSize;
+    _serviceTime += serviceTime;
+}
+
+int ConcurrencyController::update(uint64_t now)
+{
+    // Wait for enough samples
+    if ((_samples < _params.minSamples) || (_serviceTime == 0) || (now <= _measurementStart)) {
+        return _mpl;
+    }
+    // Measurements where the MPL was not the bottleneck say nothing about the MPL, and invalidate the previous power since the workload changed
+    if (!_limited) {
+        _hasPrevPower = false;
+        resetMeasurement(now);
+        return _mpl;
+    }
+    double throughput = (double)_bytes / ConvertTimeToSeconds(now - _measurementStart);
+    double latency = ConvertTimeToSeconds(_serviceTime) / _samples;
+    double power = throughput / latency;
+    if (_hasPrevPower) {
+        if (power < (_prevPower * (1 - _params.tolerance))) {
+            // Stepped away from the knee, so step back
+            _direction = -_direction;
+        } else if (power <= (_prevPower * (1 + _params.tolerance))) {
+            // Near the knee; prefer the lower MPL for better priority isolation
+            _direction = -1;
+        }
+    }
+    // Step by 1/8 of the MPL so large MPLs converge quickly
+    int step = max(1, _mpl / 8);
+    int mpl = max(_params.minMPL, min(_mpl + (_direction * step), _params.maxMPL));
+    if (mpl == _mpl) {
+        // At a bound, so probe the other direction next time
+        _direction = -_direction;
+    }
+    _mpl = mpl;
+    _prevPower = power;
+    _hasPrevPower = true;
+    resetMeasurement(now);
+    return _mpl;
+}
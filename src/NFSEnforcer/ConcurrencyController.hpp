@@ -0,0 +1,57 @@
+// ConcurrencyController.hpp - Online adjustment of the max number of concurrent jobs at the storage device (i.e., the MPL).
+// The controller measures the throughput and mean service time of completed jobs over intervals where the MPL limited dispatching,
+// and hill climbs on their ratio (i.e., Kleinrock's power), which peaks at the knee where throughput stops rising and latency starts to climb.
+// When the power does not change significantly, the MPL is lowered, since lower concurrency improves priority isolation.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _CONCURRENCY_CONTROLLER_HPP
+#define _CONCURRENCY_CONTROLLER_HPP
+
+#include <stdint.h>
+
+using namespace std;
+
+struct ConcurrencyControllerParams {
+    int minMPL; // lowest MPL; should be at least the MPL the bandwidth table was profiled with, so the estimator's bandwidths remain achievable
+    int maxMPL; // highest MPL
+    double tolerance; // relative change in power that is considered significant
+    unsigned int minSamples; // min number of completed jobs per measurement
+};
+
+// ConcurrencyController is not thread-safe; the scheduler calls it with its mutex held.
+class ConcurrencyController
+{
+private:
+    ConcurrencyControllerParams _params;
+    int _mpl;
+    int _direction; // +1 if the MPL is being raised, -1 if it is being lowered
+    // Measurement since _measurementStart
+    uint64_t _measurementStart;
+    unsigned int _samples;
+    uint64_t _bytes;
+    uint64_t _serviceTime;
+    bool _limited; // the MPL or bytes limit held back a job
+    // Power measured at the previous MPL
+    bool _hasPrevPower;
+    double _prevPower;
+
+    // Start a new measurement
+    void resetMeasurement(uint64_t now);
+
+public:
+    ConcurrencyController(const ConcurrencyControllerParams& params, int initialMPL, uint64_t now);
+
+    // Current MPL
+    int mpl() const { return _mpl; }
+    // Record a completed job
+    void complete(uint64_t requestSize, uint64_t serviceTime);
+    // Record that a job was held back by the MPL or bytes limit
+    void limited() { _limited = true; }
+    // Adjust the MPL once enough jobs have completed; returns the current MPL
+    int update(uint64_t now);
+};
+
+#endif // _CONCURRENCY_CONTROLLER_HPP
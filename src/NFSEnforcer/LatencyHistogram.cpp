@@ -0,0 +1,83 @@
+// LatencyHistogram.cpp - Histogram of latencies with logarithmic buckets, in the style of HDR histograms.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <vector>
+#include <utility>
+#include <stdint.h>
+#include "LatencyHistogram.hpp"
+
+using namespace std;
+
+LatencyHistogram::LatencyHistogram()
+    : _count(0),
+      _sum(0),
+      _max(0)
+{
+    for (unsigned int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        _counts[i] = 0;
+    }
+}
+
+void LatencyHistogram::record(uint64_t latency)
+{
+    __sync_fetch_and_add(&_counts[getBucket(latency)], 1);
+    __sync_fetch_and_add(&_count, 1);
+    __sync_fetch_and_add(&_sum, latency);
+    uint64_t max = _max;
+    while (latency > max) {
+        uint64_t previous = __sync_val_compare_and_swap(&_max, max, latency);
+        if (previous == max) {
+            break;
+        }
+        max = previous;
+    }
+}
+
+void LatencyHistogram::sample(LatencyHistogramSnapshot& snapshot, bool reset)
+{
+    snapshot.buckets.clear();
+    for (unsigned int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        uint64_t count = reset ? __sync_lock_test_and_set(&_counts[i], 0) : __sync_fetch_and_add(&_counts[i], 0);
+        if (count > 0) {
+            snapshot.buckets.push_back(make_pair(getBucketLowerBound(i), count));
+        }
+    }
+    if (reset) {
+        snapshot.count = __sync_lock_test_and_set(&_count, 0);
+        snapshot.sum = __sync_lock_test_and_set(&_sum, 0);
+        snapshot.max = __sync_lock_test_and_set(&_max, 0);
+    } else {
+        snapshot.count = __sync_fetch_and_add(&_count, 0);
+        snapshot.sum = __sync_fetch_and_add(&_sum, 0);
+        snapshot.max = __sync_fetch_and_add(&_max, 0);
+    }
+}
+
+unsigned int LatencyHistogram::getBucket(uint64_t latency)
+{
+    // Latencies below LATENCY_HISTOGRAM_SUB_BUCKETS have a bucket each
+    if (latency < LATENCY_HISTOGRAM_SUB_BUCKETS) {
+        return latency;
+    }
+    // Find the power of two range, then the linear sub-bucket within the range
+    unsigned int bits = 64 - __builtin_clzll(latency);
+    if (bits > LATENCY_HISTOGRAM_MAX_BITS) {
+        return LATENCY_HISTOGRAM_BUCKETS - 1;
+    }
+    unsigned int shift = bits - LATENCY_HISTOGRAM_SUB_BUCKET_BITS - 1;
+    unsigned int subBucket = (latency >> shift) & (LATENCY_HISTOGRAM_SUB_BUCKETS - 1);
+    return (shift + 1) * LATENCY_HISTOGRAM_SUB_BUCKETS + subBucket;
+}
+
+uint64_t LatencyHistogram::getBucketLowerBound(unsigned int bucket)
+{
+    if (bucket < LATENCY_HISTOGRAM_SUB_BUCKETS) {
+        return bucket;
+    }
+    unsigned int shift = bucket / LATENCY_HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t subBucket = bucket % LATENCY_HISTOGRAM_SUB_BUCKETS;
+    return (LATENCY_HISTOGRAM_SUB_BUCKETS + subBucket) << shift;
+}
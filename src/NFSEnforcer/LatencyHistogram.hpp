@@ -0,0 +1,55 @@
+// LatencyHistogram.hpp - Histogram of latencies with logarithmic buckets, in the style of HDR histograms.
+// Each power of two range of latencies is split into LATENCY_HISTOGRAM_SUB_BUCKETS linear buckets,
+// so a bucket's lower bound is within 1/LATENCY_HISTOGRAM_SUB_BUCKETS of the latencies it counts.
+// Latencies are recorded and sampled with atomic operations, so recording does not need a lock.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _LATENCY_HISTOGRAM_HPP
+#define _LATENCY_HISTOGRAM_HPP
+
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+using namespace std;
+
+#define LATENCY_HISTOGRAM_SUB_BUCKET_BITS 3
+#define LATENCY_HISTOGRAM_SUB_BUCKETS (1 << LATENCY_HISTOGRAM_SUB_BUCKET_BITS)
+// Latencies up to 2^LATENCY_HISTOGRAM_MAX_BITS time units are counted in separate buckets (i.e., ~18 min in ns); larger latencies are counted in the last bucket
+#define LATENCY_HISTOGRAM_MAX_BITS 40
+#define LATENCY_HISTOGRAM_BUCKETS ((LATENCY_HISTOGRAM_MAX_BITS - LATENCY_HISTOGRAM_SUB_BUCKET_BITS + 1) * LATENCY_HISTOGRAM_SUB_BUCKETS)
+
+// Sampled contents of a histogram
+struct LatencyHistogramSnapshot {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    vector<pair<uint64_t, uint64_t> > buckets; // lower bound and count of each non-empty bucket in increasing order
+};
+
+class LatencyHistogram
+{
+private:
+    volatile uint64_t _counts[LATENCY_HISTOGRAM_BUCKETS];
+    volatile uint64_t _count;
+    volatile uint64_t _sum;
+    volatile uint64_t _max;
+
+public:
+    LatencyHistogram();
+
+    // Record a latency.
+    void record(uint64_t latency);
+    // Sample the histogram, and optionally reset it; latencies recorded concurrently are either in this sample or the next.
+    void sample(LatencyHistogramSnapshot& snapshot, bool reset);
+
+    // Get the bucket counting a latency.
+    static unsigned int getBucket(uint64_t latency);
+    // Get the lowest latency counted by a bucket.
+    static uint64_t getBucketLowerBound(unsigned int bucket);
+};
+
+#endif // _LATENCY_HISTOGRAM_HPP
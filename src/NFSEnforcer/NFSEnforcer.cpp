@@ -6,6 +6,9 @@
 //
 // Command line parameters:
 // -c configFile (required) - config file that specifies some global NFSEnforcer parameters such as the storage profile; see profile file description in README
+// -M [metricsAddr:]metricsPort (optional) - TCP port serving the hot path metrics in the Prometheus text format (see common/metrics.hpp); binds to loopback unless metricsAddr is given; the metrics are also returned by the GetMetrics RPC
+//
+// NFS requests are received by a fixed pool of intake reader threads (see custom_svc_run.cpp), and forwarded to NFS by worker threads in the order chosen by the scheduler.
 //
 // Copyright (c) 2017 Timothy Zhu.
 // Licensed under the MIT License. See LICENSE file for details.
@@ -17,15 +20,16 @@
 #include <cstdlib>
 #include <cstring>
 #include <cassert>
+#include <algorithm>
 #include <pthread.h>
 #include <unistd.h>
 #include <signal.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/uio.h>
 #include <rpc/rpc.h>
 #include <rpc/pmap_clnt.h>
-#include <sys/poll.h>
 #include <errno.h>
 #include <stdarg.h>
 #include <json/json.h>
@@ -33,19 +37,25 @@
 #include "../prot/storage_prot.h"
 #include "../common/time.hpp"
 #include "../common/common.hpp"
+#include "../common/metrics.hpp"
 #include "scheduler.hpp"
+#include "BufferPool.hpp"
+#include "AsyncForwarder.hpp"
+#include "NFSPayload.hpp"
 #include "NFSEnforcer.hpp"
 
 using namespace std;
 
-pid_t pid;
 // Scheduler
 Scheduler* sched;
 uint64_t startTime;
 int maxPendingJobsPerClient = 8;
 // xprt cache
-pthread_mutex_t xprt_mutex = PTHREAD_MUTEX_INITIALIZER; // used in addition to xprt_cache->mutex to protect ignore flag; must not lock xprt_cache->mutex while holding xprt_mutex
 xprt_cache_t* xprt_cache;
+// Pool of READ/WRITE payload buffers
+BufferPool payloadPool;
+// Asynchronous forwarding to NFS, or NULL if each job is forwarded by a worker thread using its own RPC client
+AsyncForwarder* forwarder = NULL;
 
 // Default timeout can be changed using clnt_control()
 static struct timeval TIMEOUT = { 25, 0 };
@@ -99,6 +109,15 @@ void custom_xp_set_xid(SVCXPRT* xprt, u_long xid)
     }
 }
 
+// Assumes xprt mutex is held
+void custom_xp_set_died(SVCXPRT* xprt)
+{
+    // Assume TCP
+    assert(xprt->xp_p2 == NULL);
+    struct tcp_conn* cd = (struct tcp_conn*) (xprt->xp_p1);
+    cd->strm_stat = XPRT_DIED;
+}
+
 void print_debug(unsigned long s_addr, string fmt, ...)
 {
     char str[INET_ADDRSTRLEN];
@@ -114,6 +133,60 @@ void print_debug(unsigned long s_addr, string fmt, ...)
     cout << buf << endl;
 }
 
+// Like xdr_bytes, except that decoded buffers are allocated from payloadPool, so they must also be freed with XDR_FREE.
+bool_t xdr_pooled_bytes(XDR* xdrs, char** cpp, u_int* sizep)
+{
+    switch (xdrs->x_op) {
+        case XDR_DECODE:
+            if (!xdr_u_int(xdrs, sizep)) {
+                return FALSE;
+            }
+            if (*sizep == 0) {
+                return TRUE;
+            }
+            if (*cpp == NULL) {
+                *cpp = (char*)payloadPool.alloc(*sizep);
+            }
+            return xdr_opaque(xdrs, *cpp, *sizep);
+
+        case XDR_FREE:
+            if (*cpp != NULL) {
+                payloadPool.free(*cpp, *sizep);
+                *cpp = NULL;
+            }
+            return TRUE;
+
+        default:
+            return xdr_bytes(xdrs, cpp, sizep, ~0);
+    }
+}
+
+// xdr_read3res with the data buffer allocated from payloadPool.
+bool_t xdr_pooled_read3res(XDR* xdrs, read3res* objp)
+{
+    if (!xdr_nfsstat3(xdrs, &objp->status)) {
+        return FALSE;
+    }
+    if (objp->status != NFS3_OK) {
+        return xdr_post_op_attr(xdrs, &objp->read3res_u.resfail);
+    }
+    read3resok* resok = &objp->read3res_u.resok;
+    return xdr_post_op_attr(xdrs, &resok->file_attributes) &&
+           xdr_uint32(xdrs, &resok->count) &&
+           xdr_bool(xdrs, &resok->eof) &&
+           xdr_pooled_bytes(xdrs, &resok->data.data_val, &resok->data.data_len);
+}
+
+// xdr_write3args with the data buffer allocated from payloadPool.
+bool_t xdr_pooled_write3args(XDR* xdrs, write3args* objp)
+{
+    return xdr_nfs_fh3(xdrs, &objp->file) &&
+           xdr_uint64(xdrs, &objp->offset) &&
+           xdr_uint32(xdrs, &objp->count) &&
+           xdr_stable_how(xdrs, &objp->stable) &&
+           xdr_pooled_bytes(xdrs, &objp->data.data_val, &objp->data.data_len);
+}
+
 // Assumes xprt mutex is held
 bool InitJob(Job* pJob, rpcproc_t rq_proc, register SVCXPRT* transp)
 {
@@ -153,11 +226,11 @@ bool InitJob(Job* pJob, rpcproc_t rq_proc, register SVCXPRT* transp)
 
         case NFSPROC3_READ:
             _xdr_argument = (xdrproc_t)xdr_read3args;
-            _xdr_result = (xdrproc_t)xdr_read3res;
+            _xdr_result = (xdrproc_t)xdr_pooled_read3res;
             break;
 
         case NFSPROC3_WRITE:
-            _xdr_argument = (xdrproc_t)xdr_write3args;
+            _xdr_argument = (xdrproc_t)xdr_pooled_write3args;
             _xdr_result = (xdrproc_t)xdr_write3res;
             break;
 
@@ -247,6 +320,7 @@ bool InitJob(Job* pJob, rpcproc_t rq_proc, register SVCXPRT* transp)
         pJob->fd = transp->xp_sock;
         pJob->xid = custom_xp_get_xid(transp);
         pJob->s_addr = svc_getcaller(transp)->sin_addr.s_addr;
+        pJob->replyBuffer = NULL;
         // Get arguments
         if (svc_getargs(transp, pJob->XdrArgument(), pJob->Argument())) {
             if (pJob->IsReadRequest()) {
@@ -273,35 +347,178 @@ bool InitJob(Job* pJob, rpcproc_t rq_proc, register SVCXPRT* transp)
     return success;
 }
 
-void RunJob(Job* pJob)
+// Free the results of a job.
+void FreeResults(Job* pJob)
+{
+    // READ data decoded in place is released with the forwarder's reply buffer
+    if (pJob->replyBuffer != NULL) {
+        read3resok& resok = pJob->result.nfsproc3_read_3_res.read3res_u.resok;
+        resok.data.data_val = NULL;
+        resok.data.data_len = 0;
+        forwarder->releaseReplyBuffer(pJob);
+    }
+    xdr_free(pJob->XdrResult(), pJob->Result());
+}
+
+// Reply to a successful READ on a TCP connection with scatter-gather I/O, so the data is not copied into the connection's XDR buffer.
+// Assumes xprt mutex is held
+bool SendReadReply(SVCXPRT* transp, Job* pJob)
+{
+    struct rpc_msg reply;
+    reply.rm_xid = pJob->Xid();
+    reply.rm_direction = REPLY;
+    reply.rm_reply.rp_stat = MSG_ACCEPTED;
+    reply.acpted_rply.ar_verf = transp->xp_verf;
+    reply.acpted_rply.ar_stat = SUCCESS;
+    reply.acpted_rply.ar_results.where = pJob->Result();
+    reply.acpted_rply.ar_results.proc = (xdrproc_t)xdr_read3res_header;
+    // Encode record mark, reply header, and READ result header
+    char header[RECORD_MARK_SIZE + 1024];
+    XDR xdrs;
+    xdrmem_create(&xdrs, header + RECORD_MARK_SIZE, sizeof(header) - RECORD_MARK_SIZE, XDR_ENCODE);
+    bool encoded = xdr_replymsg(&xdrs, &reply);
+    uint32_t len = XDR_GETPOS(&xdrs);
+    xdr_destroy(&xdrs);
+    if (!encoded) {
+        return false;
+    }
+    read3res* res = (read3res*)pJob->Result();
+    u_int dataLen = (res->status == NFS3_OK) ? res->read3res_u.resok.data.data_len : 0;
+    struct iovec iov[3];
+    iov[0].iov_base = header;
+    iov[0].iov_len = RECORD_MARK_SIZE + len;
+    iov[1].iov_base = (dataLen > 0) ? res->read3res_u.resok.data.data_val : NULL;
+    iov[1].iov_len = dataLen;
+    iov[2].iov_base = (char*)xdrPadding();
+    iov[2].iov_len = RNDUP(dataLen) - dataLen;
+    uint32_t mark = htonl(LAST_FRAGMENT | (len + RNDUP(dataLen)));
+    memcpy(header, &mark, RECORD_MARK_SIZE);
+    return writevAll(transp->xp_sock, iov, 3);
+}
+
+// Merge a job and the jobs coalesced with it into one request for their contiguous range.
+Job* MergeCoalescedJobs(Job* pJob)
+{
+    Job* pRequest = new Job();
+    memset((char*)pRequest->Argument(), 0, sizeof(pRequest->argument));
+    memset((char*)pRequest->Result(), 0, sizeof(pRequest->result));
+    pRequest->xdr_argument = pJob->xdr_argument;
+    pRequest->xdr_result = pJob->xdr_result;
+    pRequest->rq_proc = pJob->rq_proc;
+    pRequest->s_addr = pJob->s_addr;
+    pRequest->serviceEndTime = 0;
+    pRequest->coalescedNext = NULL;
+    pRequest->coalescedJobs = pJob;
+    pRequest->replyBuffer = NULL;
+    pRequest->cl = pJob->cl;
+    if (pJob->IsReadRequest()) {
+        read3args& args = pRequest->argument.nfsproc3_read_3_arg;
+        args = pJob->argument.nfsproc3_read_3_arg;
+        args.count = pJob->CoalescedSize();
+    } else {
+        // Copy the data of the writes into one buffer, and use the most stable of their requested stabilities
+        write3args& args = pRequest->argument.nfsproc3_write_3_arg;
+        args = pJob->argument.nfsproc3_write_3_arg;
+        args.count = pJob->CoalescedSize();
+        args.data.data_len = pJob->CoalescedSize();
+        args.data.data_val = (char*)payloadPool.alloc(args.data.data_len);
+        u_int offset = 0;
+        for (Job* pCoalesced = pJob; pCoalesced != NULL; pCoalesced = pCoalesced->coalescedNext) {
+            write3args& coalescedArgs = pCoalesced->argument.nfsproc3_write_3_arg;
+            memcpy(args.data.data_val + offset, coalescedArgs.data.data_val, min(coalescedArgs.data.data_len, (u_int)pCoalesced->RequestSize()));
+            offset += pCoalesced->RequestSize();
+            args.stable = max(args.stable, coalescedArgs.stable);
+        }
+    }
+    return pRequest;
+}
+
+// Split the reply to a request merged from coalesced jobs into the jobs' results, and free the request.
+// Returns the first of the coalesced jobs.
+Job* SplitCoalescedJobs(Job* pRequest, enum clnt_stat rpcStatus)
+{
+    Job* pJob = pRequest->coalescedJobs;
+    pJob->serviceEndTime = pRequest->serviceEndTime;
+    if (rpcStatus == RPC_SUCCESS) {
+        u_int offset = 0;
+        for (Job* pCoalesced = pJob; pCoalesced != NULL; pCoalesced = pCoalesced->coalescedNext) {
+            if (pJob->IsReadRequest()) {
+                read3res& merged = pRequest->result.nfsproc3_read_3_res;
+                read3res& res = pCoalesced->result.nfsproc3_read_3_res;
+                res.status = merged.status;
+                if (merged.status != NFS3_OK) {
+                    res.read3res_u.resfail = merged.read3res_u.resfail;
+                } else {
+                    // Each job gets its part of the data; jobs past a short read get no data
+                    read3resok& mergedOk = merged.read3res_u.resok;
+                    read3resok& resok = res.read3res_u.resok;
+                    u_int available = (mergedOk.data.data_len > offset) ? (mergedOk.data.data_len - offset) : 0;
+                    u_int count = min((u_int)pCoalesced->RequestSize(), available);
+                    resok.file_attributes = mergedOk.file_attributes;
+                    resok.count = count;
+                    resok.eof = mergedOk.eof && ((offset + count) >= mergedOk.data.data_len);
+                    resok.data.data_len = count;
+                    if (count > 0) {
+                        resok.data.data_val = (char*)payloadPool.alloc(count);
+                        memcpy(resok.data.data_val, mergedOk.data.data_val + offset, count);
+                    }
+                }
+            } else {
+                write3res& merged = pRequest->result.nfsproc3_write_3_res;
+                write3res& res = pCoalesced->result.nfsproc3_write_3_res;
+                res = merged;
+                if (merged.status == NFS3_OK) {
+                    // Each job gets its part of a short write
+                    u_int written = merged.write3res_u.resok.count;
+                    res.write3res_u.resok.count = min((u_int)pCoalesced->RequestSize(), (written > offset) ? (written - offset) : 0);
+                }
+            }
+            offset += pCoalesced->RequestSize();
+        }
+    }
+    // Free the request
+    FreeResults(pRequest);
+    if (pRequest->IsWriteRequest()) {
+        write3args& args = pRequest->argument.nfsproc3_write_3_arg;
+        payloadPool.free(args.data.data_val, args.data.data_len);
+    }
+    delete pRequest;
+    return pJob;
+}
+
+// Reply to the NFS client of a job; returns false if forwarding the job failed.
+bool ReplyJob(Job* pJob, enum clnt_stat rpcStatus)
 {
-    // Forward to NFS
-    enum clnt_stat rpcStatus = clnt_call(pJob->RPCClient(), pJob->Proc(),
-                                         pJob->XdrArgument(), pJob->Argument(),
-                                         pJob->XdrResult(), pJob->Result(),
-                                         TIMEOUT);
     xprt_cache_t& xprt_cache_data = xprt_cache[pJob->Fd()];
     pthread_mutex_lock(&xprt_cache_data.mutex);
-    // Wake up thread reading requests
+    // Resume reading requests
     if (sched->GetNumPendingJobs(pJob->Addr()) < maxPendingJobsPerClient) {
-        pthread_cond_signal(&xprt_cache_data.recvJobCV);
+        custom_svc_resume(pJob->Fd());
     }
     // Only reply if xprt is matching
     register SVCXPRT* transp = pJob->Xprt();
     if (xprt_cache_data.xprt == transp) {
         custom_xp_set_xid(transp, pJob->Xid());
         if (rpcStatus == RPC_SUCCESS) {
-            // Reply to client
-            if (!svc_sendreply(transp, pJob->XdrResult(), pJob->Result())) {
+            // Reply to client; READ data is sent directly on TCP connections (i.e., xp_p2 is NULL, as in custom_xp_get_xid)
+            bool sent;
+            if (pJob->IsReadRequest() && (transp->xp_p2 == NULL)) {
+                sent = SendReadReply(transp, pJob);
+            } else {
+                sent = svc_sendreply(transp, pJob->XdrResult(), pJob->Result());
+            }
+            if (!sent) {
                 svcerr_systemerr(transp);
             }
         } else {
-            clnt_perror(pJob->RPCClient(), "Failed RPC");
+            if (pJob->RPCClient() != NULL) {
+                clnt_perror(pJob->RPCClient(), "Failed RPC");
+            } else {
+                cerr << "Failed RPC: " << clnt_sperrno(rpcStatus) << endl;
+            }
             svcerr_systemerr(transp);
             pthread_mutex_unlock(&xprt_cache_data.mutex);
-            // Indicate that job has finished forwarding to NFS
-            sched->CompleteJob(pJob);
-            return;
+            return false;
         }
         // Free arguments
         if (!svc_freeargs(transp, pJob->XdrArgument(), pJob->Argument())) {
@@ -309,17 +526,54 @@ void RunJob(Job* pJob)
         }
     }
     pthread_mutex_unlock(&xprt_cache_data.mutex);
+    return true;
+}
+
+// Reply to the NFS clients once a job and the jobs coalesced with it have been forwarded to NFS.
+void FinishJob(Job* pJob, enum clnt_stat rpcStatus)
+{
+    for (Job* pCoalesced = pJob->coalescedNext; pCoalesced != NULL; pCoalesced = pCoalesced->coalescedNext) {
+        ReplyJob(pCoalesced, rpcStatus);
+    }
+    bool success = ReplyJob(pJob, rpcStatus);
 
     // Indicate that job has finished forwarding to NFS
     sched->CompleteJob(pJob);
 
-    // Free results
-    if (!clnt_freeres(pJob->RPCClient(), pJob->XdrResult(), pJob->Result())) {
-        cerr << "Unable to free results" << endl;
+    // Delete the jobs coalesced with the job; their results are only filled in if forwarding succeeded
+    while (pJob->coalescedNext != NULL) {
+        Job* pCoalesced = pJob->coalescedNext;
+        pJob->coalescedNext = pCoalesced->coalescedNext;
+        FreeResults(pCoalesced);
+        delete pCoalesced;
     }
+    if (!success) {
+        return;
+    }
+
+    // Free results
+    FreeResults(pJob);
 
     // Return RPC client to scheduler
-    sched->ReturnClient(pJob);
+    if (pJob->RPCClient() != NULL) {
+        sched->ReturnClient(pJob);
+    }
+}
+
+// Forward a job to NFS using its RPC client.
+void RunJob(Job* pJob)
+{
+    // Coalesced jobs are forwarded as one request
+    Job* pRequest = (pJob->coalescedNext != NULL) ? MergeCoalescedJobs(pJob) : pJob;
+    enum clnt_stat rpcStatus = clnt_call(pRequest->RPCClient(), pRequest->Proc(),
+                                         pRequest->XdrArgument(), pRequest->Argument(),
+                                         pRequest->XdrResult(), pRequest->Result(),
+                                         TIMEOUT);
+    pRequest->serviceEndTime = GetTime();
+    if (pRequest != pJob) {
+        SplitCoalescedJobs(pRequest, rpcStatus);
+    }
+    FinishJob(pJob, rpcStatus);
 }
 
 bool_t custom_xp_recv (SVCXPRT* xprt, struct rpc_msg* msg)
@@ -352,7 +606,12 @@ bool_t custom_xp_getargs (SVCXPRT* xprt, xdrproc_t xdr_args, caddr_t args_ptr)
     xprt_cache_t& xprt_cache_data = xprt_cache[xprt->xp_sock];
     pthread_mutex_lock(&xprt_cache_data.mutex);
     if (xprt_cache_data.xprt == xprt) {
-        result = xprt_cache_data.xp_ops->xp_getargs(xprt, xdr_args, args_ptr);
+        if (xprt_cache_data.recvBuffered) {
+            // Decode from the buffered request (see custom_svc_run.cpp)
+            result = (*xdr_args)(&xprt_cache_data.recvXdrs, args_ptr);
+        } else {
+            result = xprt_cache_data.xp_ops->xp_getargs(xprt, xdr_args, args_ptr);
+        }
     }
     pthread_mutex_unlock(&xprt_cache_data.mutex);
     return result;
@@ -386,24 +645,19 @@ void custom_xp_destroy(SVCXPRT* xprt)
 {
     xprt_cache_t& xprt_cache_data = xprt_cache[xprt->xp_sock];
     pthread_mutex_lock(&xprt_cache_data.mutex);
-    pthread_mutex_lock(&xprt_mutex);
     if (xprt_cache_data.xprt == xprt) {
         assert(xprt_cache_data.xp_ops != NULL);
-        if (xprt_cache_data.threadDestroy != NULL) {
-            // Signal RPC thread to terminate
-            *xprt_cache_data.threadDestroy = true;
-            pthread_cond_signal(&xprt_cache_data.CV);
-        }
         // Destroy xprt
         xprt->xp_ops = xprt_cache_data.xp_ops;
         xprt_cache_data.xprt = NULL;
         xprt_cache_data.xp_ops = NULL;
-        xprt_cache_data.threadDestroy = NULL;
-        xprt_cache_data.ignore = false;
-        pthread_mutex_unlock(&xprt_mutex);
+        xprt_cache_data.owner = -1;
+        xprt_cache_data.throttled = false;
+        xprt_cache_data.died = false;
+        xprt_cache_data.recvBuffered = false;
+        vector<char>().swap(xprt_cache_data.recvBuffer);
+        vector<char>().swap(xprt_cache_data.recvRecord);
         SVC_DESTROY(xprt);
-    } else {
-        pthread_mutex_unlock(&xprt_mutex);
     }
     pthread_mutex_unlock(&xprt_cache_data.mutex);
 }
@@ -414,25 +668,36 @@ void proxy_dispatch(struct svc_req* rqstp, register SVCXPRT* transp)
     Job* pJob = new Job();
     if (InitJob(pJob, rqstp->rq_proc, transp)) {
         sched->SubmitJob(pJob);
+    } else {
+        delete pJob;
     }
 }
 
+// Assumes xprt mutex is held
+void cache_xprt(SVCXPRT* transp)
+{
+    xprt_cache_t& xprt_cache_data = xprt_cache[transp->xp_sock];
+    xprt_cache_data.xprt = transp;
+    xprt_cache_data.xp_ops = transp->xp_ops;
+    xprt_cache_data.xp_ops_modified = *(transp->xp_ops);
+    xprt_cache_data.xp_ops_modified.xp_recv = custom_xp_recv;
+    xprt_cache_data.xp_ops_modified.xp_stat = custom_xp_stat;
+    xprt_cache_data.xp_ops_modified.xp_getargs = custom_xp_getargs;
+    xprt_cache_data.xp_ops_modified.xp_reply = custom_xp_reply;
+    xprt_cache_data.xp_ops_modified.xp_freeargs = custom_xp_freeargs;
+    xprt_cache_data.xp_ops_modified.xp_destroy = custom_xp_destroy;
+    xprt_cache_data.died = false;
+    xprt_cache_data.recvBuffered = false;
+    xprt_cache_data.recvBuffer.clear();
+    transp->xp_ops = &(xprt_cache_data.xp_ops_modified);
+}
+
 // Assumes xprt mutex is held
 void proxy_dispatch_main(struct svc_req* rqstp, register SVCXPRT* transp)
 {
     // Cache xprt pointer
-    xprt_cache_t& xprt_cache_data = xprt_cache[transp->xp_sock];
-    if (xprt_cache_data.xprt == NULL) {
-        xprt_cache_data.xprt = transp;
-        xprt_cache_data.xp_ops = transp->xp_ops;
-        xprt_cache_data.xp_ops_modified = *(transp->xp_ops);
-        xprt_cache_data.xp_ops_modified.xp_recv = custom_xp_recv;
-        xprt_cache_data.xp_ops_modified.xp_stat = custom_xp_stat;
-        xprt_cache_data.xp_ops_modified.xp_getargs = custom_xp_getargs;
-        xprt_cache_data.xp_ops_modified.xp_reply = custom_xp_reply;
-        xprt_cache_data.xp_ops_modified.xp_freeargs = custom_xp_freeargs;
-        xprt_cache_data.xp_ops_modified.xp_destroy = custom_xp_destroy;
-        transp->xp_ops = &(xprt_cache_data.xp_ops_modified);
+    if (xprt_cache[transp->xp_sock].xprt == NULL) {
+        cache_xprt(transp);
     }
 
     proxy_dispatch(rqstp, transp);
@@ -450,9 +715,50 @@ void* worker_thread(void* ptr)
     return NULL;
 }
 
-// Dummy signal handler to wake up poll
-void dummy_signal(int signum)
+// Sends scheduled jobs to NFS without waiting for their replies when forwarding asynchronously.
+void* dispatch_thread(void* ptr)
+{
+    while (true) {
+        Job* pJob = sched->GetNextJob();
+        // Coalesced jobs are forwarded as one request
+        forwarder->forward((pJob->coalescedNext != NULL) ? MergeCoalescedJobs(pJob) : pJob);
+    }
+    return NULL;
+}
+
+// Replies to NFS clients as jobs complete when forwarding asynchronously.
+void* completion_thread(void* ptr)
+{
+    while (true) {
+        enum clnt_stat rpcStatus;
+        Job* pJob = forwarder->getCompletedJob(rpcStatus);
+        if (pJob->coalescedJobs != NULL) {
+            pJob = SplitCoalescedJobs(pJob, rpcStatus);
+        }
+        FinishJob(pJob, rpcStatus);
+        // Delete job
+        delete pJob;
+    }
+    return NULL;
+}
+
+// Create detached threads.
+void create_threads(int numThreads, void* (*start_routine)(void*))
 {
+    for (int i = 0; i < numThreads; i++) {
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        int rc = pthread_create(&thread,
+                                &attr,
+                                start_routine,
+                                (void*)NULL);
+        if (rc) {
+            cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
+            exit(-1);
+        }
+    }
 }
 
 // SIGTERM/SIGINT signal for cleanup
@@ -465,9 +771,15 @@ void term_signal(int signum)
     exit(0);
 }
 
+// Time spent applying Update RPCs and the number of clients they update
+static MetricHistogram updateTime("storage_update_seconds", "Time spent applying the client updates of an Update RPC");
+static MetricCounter updatedClients("storage_updated_clients_total", "Number of clients updated by Update RPCs");
+
 void* storage_enforcer_update_svc(StorageUpdateArgs* argp, struct svc_req* rqstp)
 {
     static char* result;
+    ScopedTimer timer(updateTime);
+    updatedClients.add(argp->StorageUpdateArgs_len);
     for (unsigned int i = 0; i < argp->StorageUpdateArgs_len; i++) {
         StorageClient* client = &argp->StorageUpdateArgs_val[i];
         assert(client->rateLimitRates.rateLimitRates_len == client->rateLimitBursts.rateLimitBursts_len);
@@ -487,11 +799,89 @@ StorageGetOccupancyRes* storage_enforcer_get_occupancy_svc(StorageGetOccupancyAr
     return &result;
 }
 
+StorageGetRbCurveRes* storage_enforcer_get_rb_curve_svc(StorageGetRbCurveArgs* argp, struct svc_req* rqstp)
+{
+    static StorageGetRbCurveRes result;
+    static vector<double> rates;
+    static vector<double> bursts;
+    sched->GetRbCurve(argp->s_addr, rates, bursts);
+    result.rates.rates_len = rates.size();
+    result.rates.rates_val = rates.empty() ? NULL : &rates[0];
+    result.bursts.bursts_len = bursts.size();
+    result.bursts.bursts_val = bursts.empty() ? NULL : &bursts[0];
+    return &result;
+}
+
+// Convert a latency histogram to seconds for the RPC result; the buffers hold the buckets until the next call
+static void ConvertLatencyHistogram(const LatencyHistogramSnapshot& snapshot, StorageLatencyHistogram& histogram,
+                                    vector<double>& bucketLatencies, vector<u_quad_t>& bucketCounts)
+{
+    histogram.count = snapshot.count;
+    histogram.sum = ConvertTimeToSeconds(snapshot.sum);
+    histogram.max = ConvertTimeToSeconds(snapshot.max);
+    bucketLatencies.clear();
+    bucketCounts.clear();
+    for (vector<pair<uint64_t, uint64_t> >::const_iterator it = snapshot.buckets.begin(); it != snapshot.buckets.end(); it++) {
+        bucketLatencies.push_back(ConvertTimeToSeconds(it->first));
+        bucketCounts.push_back(it->second);
+    }
+    histogram.bucketLatencies.bucketLatencies_len = bucketLatencies.size();
+    histogram.bucketLatencies.bucketLatencies_val = bucketLatencies.empty() ? NULL : &bucketLatencies[0];
+    histogram.bucketCounts.bucketCounts_len = bucketCounts.size();
+    histogram.bucketCounts.bucketCounts_val = bucketCounts.empty() ? NULL : &bucketCounts[0];
+}
+
+StorageGetStatsRes* storage_enforcer_get_stats_svc(StorageGetStatsArgs* argp, struct svc_req* rqstp)
+{
+    static StorageGetStatsRes result;
+    static ClientStatsSnapshot snapshot;
+    static vector<double> bucketLatencies[6];
+    static vector<u_quad_t> bucketCounts[6];
+    if (!sched->GetStats(argp->s_addr, argp->reset, snapshot)) {
+        snapshot = ClientStatsSnapshot();
+        snapshot.interval = 0;
+        snapshot.rateLimitExceededJobs = 0;
+        snapshot.immediateJobs = 0;
+    }
+    result.interval = snapshot.interval;
+    ConvertLatencyHistogram(snapshot.readQueueTime, result.readQueueTime, bucketLatencies[0], bucketCounts[0]);
+    ConvertLatencyHistogram(snapshot.readServiceTime, result.readServiceTime, bucketLatencies[1], bucketCounts[1]);
+    ConvertLatencyHistogram(snapshot.readTotalTime, result.readTotalTime, bucketLatencies[2], bucketCounts[2]);
+    ConvertLatencyHistogram(snapshot.writeQueueTime, result.writeQueueTime, bucketLatencies[3], bucketCounts[3]);
+    ConvertLatencyHistogram(snapshot.writeServiceTime, result.writeServiceTime, bucketLatencies[4], bucketCounts[4]);
+    ConvertLatencyHistogram(snapshot.writeTotalTime, result.writeTotalTime, bucketLatencies[5], bucketCounts[5]);
+    result.rateLimitExceededJobs = snapshot.rateLimitExceededJobs;
+    result.immediateJobs = snapshot.immediateJobs;
+    return &result;
+}
+
+StorageGetConcurrencyRes* storage_enforcer_get_concurrency_svc(void* argp, struct svc_req* rqstp)
+{
+    static StorageGetConcurrencyRes result;
+    bool adaptive;
+    sched->GetConcurrency(adaptive, result.readMPL, result.writeMPL, result.maxOutstandingReadBytes, result.maxOutstandingWriteBytes);
+    result.adaptive = adaptive;
+    return &result;
+}
+
+StorageGetMetricsRes* storage_enforcer_get_metrics_svc(void* argp, struct svc_req* rqstp)
+{
+    static StorageGetMetricsRes result;
+    static string metricsStr;
+    Json::Value metrics;
+    MetricsRegistry::get().toJson(metrics);
+    metricsStr = jsonToString(metrics);
+    result.metrics = const_cast<char*>(metricsStr.c_str());
+    return &result;
+}
+
 void storage_enforcer_program(struct svc_req* rqstp, register SVCXPRT* transp)
 {
     union {
         StorageUpdateArgs storage_enforcer_update_arg;
         StorageGetOccupancyArgs storage_get_occupancy_arg;
+        StorageGetRbCurveArgs storage_get_rb_curve_arg;
+        StorageGetStatsArgs storage_get_stats_arg;
     } argument;
     char* result;
     xdrproc_t _xdr_argument, _xdr_result;
@@ -514,6 +904,30 @@ void storage_enforcer_program(struct svc_req* rqstp, register SVCXPRT* transp)
             local = (char* (*)(char*, struct svc_req*))storage_enforcer_get_occupancy_svc;
             break;
 
+        case STORAGE_ENFORCER_GET_RB_CURVE:
+            _xdr_argument = (xdrproc_t)xdr_StorageGetRbCurveArgs;
+            _xdr_result = (xdrproc_t)xdr_StorageGetRbCurveRes;
+            local = (char* (*)(char*, struct svc_req*))storage_enforcer_get_rb_curve_svc;
+            break;
+
+        case STORAGE_ENFORCER_GET_STATS:
+            _xdr_argument = (xdrproc_t)xdr_StorageGetStatsArgs;
+            _xdr_result = (xdrproc_t)xdr_StorageGetStatsRes;
+            local = (char* (*)(char*, struct svc_req*))storage_enforcer_get_stats_svc;
+            break;
+
+        case STORAGE_ENFORCER_GET_CONCURRENCY:
+            _xdr_argument = (xdrproc_t)xdr_void;
+            _xdr_result = (xdrproc_t)xdr_StorageGetConcurrencyRes;
+            local = (char* (*)(char*, struct svc_req*))storage_enforcer_get_concurrency_svc;
+            break;
+
+        case STORAGE_ENFORCER_GET_METRICS:
+            _xdr_argument = (xdrproc_t)xdr_void;
+            _xdr_result = (xdrproc_t)xdr_StorageGetMetricsRes;
+            local = (char* (*)(char*, struct svc_req*))storage_enforcer_get_metrics_svc;
+            break;
+
         default:
             svcerr_noproc(transp);
             return;
@@ -536,13 +950,18 @@ int main(int argc, char** argv)
 {
     int opt = 0;
     char* configFile = NULL;
+    string metricsAddress;
     do {
-        opt = getopt(argc, argv, "c:");
+        opt = getopt(argc, argv, "c:M:");
         switch (opt) {
             case 'c':
                 configFile = optarg;
                 break;
 
+            case 'M':
+                metricsAddress = optarg;
+                break;
+
             case -1:
                 break;
 
@@ -551,8 +970,8 @@ int main(int argc, char** argv)
         }
     } while (opt != -1);
 
-    if (configFile == NULL) {
-        cerr << "Usage: " << argv[0] << " -c configFile" << endl;
+    if ((configFile == NULL) || (!metricsAddress.empty() && !validMetricsAddress(metricsAddress))) {
+        cerr << "Usage: " << argv[0] << " -c configFile [-M [metricsAddr:]metricsPort]" << endl;
         // Unregister NFS RPC handlers before quitting
         pmap_unset(NFS_PROGRAM, NFS_V3);
         // Unregister storage RPC handlers
@@ -560,8 +979,6 @@ int main(int argc, char** argv)
         exit(1);
     }
 
-    // Get pid
-    pid = getpid();
     // Read config file
     Json::Value root;
     if (!readJson(configFile, root)) {
@@ -572,6 +989,9 @@ int main(int argc, char** argv)
     int NFS_write_MPL = root.isMember("writeMPL") ? root["writeMPL"].asInt() : root["MPL"].asInt();
     int maxOutstandingReadBytes;
     int maxOutstandingWriteBytes;
+    int intakeThreads = root.isMember("intakeThreads") ? root["intakeThreads"].asInt() : 4;
+    int asyncConnections = root.isMember("asyncConnections") ? root["asyncConnections"].asInt() : 0;
+    double asyncTimeout = root.isMember("asyncTimeout") ? root["asyncTimeout"].asDouble() : TIMEOUT.tv_sec;
     startTime = GetTime();
     if (root.isMember("maxOutstandingReadBytes")) {
         maxOutstandingReadBytes = root["maxOutstandingReadBytes"].asInt();
@@ -586,11 +1006,9 @@ int main(int argc, char** argv)
 
     // Setup signal handler
     struct sigaction action;
-    action.sa_handler = dummy_signal;
+    action.sa_handler = term_signal;
     sigemptyset(&action.sa_mask);
     action.sa_flags = 0;
-    sigaction(SIGUSR1, &action, NULL);
-    action.sa_handler = term_signal;
     sigaction(SIGTERM, &action, NULL);
     sigaction(SIGINT, &action, NULL);
     // Ignore SIGPIPE
@@ -610,17 +1028,51 @@ int main(int argc, char** argv)
         pthread_mutexattr_init(&attr);
         pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
         pthread_mutex_init(&xprt_cache[i].mutex, &attr);
-        pthread_cond_init(&xprt_cache[i].CV, NULL);
-        pthread_cond_init(&xprt_cache[i].recvJobCV, NULL);
         xprt_cache[i].xprt = NULL;
         xprt_cache[i].xp_ops = NULL;
-        xprt_cache[i].ignore = false;
-        xprt_cache[i].threadDestroy = NULL;
+        xprt_cache[i].owner = -1;
+        xprt_cache[i].throttled = false;
+        xprt_cache[i].died = false;
+        xprt_cache[i].recvBuffered = false;
+    }
+
+    // Bounds of the MPLs if they are adjusted online
+    bool adaptiveMPL = root.isMember("adaptiveMPL");
+    ConcurrencyControllerParams readMPLParams;
+    ConcurrencyControllerParams writeMPLParams;
+    double adaptiveMPLInterval = 1;
+    if (adaptiveMPL) {
+        const Json::Value& adaptive = root["adaptiveMPL"];
+        // By default, the MPLs are not lowered below the configured MPLs, since the bandwidth table was profiled with them
+        readMPLParams.minMPL = adaptive.isMember("minReadMPL") ? adaptive["minReadMPL"].asInt() : NFS_read_MPL;
+        readMPLParams.maxMPL = adaptive.isMember("maxReadMPL") ? adaptive["maxReadMPL"].asInt() : (4 * NFS_read_MPL);
+        writeMPLParams.minMPL = adaptive.isMember("minWriteMPL") ? adaptive["minWriteMPL"].asInt() : NFS_write_MPL;
+        writeMPLParams.maxMPL = adaptive.isMember("maxWriteMPL") ? adaptive["maxWriteMPL"].asInt() : (4 * NFS_write_MPL);
+        readMPLParams.tolerance = writeMPLParams.tolerance = adaptive.isMember("tolerance") ? adaptive["tolerance"].asDouble() : 0.05;
+        readMPLParams.minSamples = writeMPLParams.minSamples = adaptive.isMember("minSamples") ? adaptive["minSamples"].asUInt() : 100;
+        adaptiveMPLInterval = adaptive.isMember("interval") ? adaptive["interval"].asDouble() : 1;
+        if ((readMPLParams.minMPL < 1) || (readMPLParams.maxMPL < readMPLParams.minMPL) ||
+            (writeMPLParams.minMPL < 1) || (writeMPLParams.maxMPL < writeMPLParams.minMPL)) {
+            cerr << "Invalid adaptiveMPL bounds" << endl;
+            exit(1);
+        }
     }
 
-    // Create NFS RPC clients
+    // Create NFS RPC clients, unless forwarding asynchronously
     vector<CLIENT*> RPCClients;
     int numClients = NFS_read_MPL + NFS_write_MPL + 7; // 7 for backup and non-read/write requests
+    if (adaptiveMPL) {
+        // Enough clients for the highest MPLs
+        numClients = max(NFS_read_MPL, readMPLParams.maxMPL) + max(NFS_write_MPL, writeMPLParams.maxMPL) + 7;
+    }
+    if (asyncConnections > 0) {
+        if (asyncTimeout <= 0) {
+            cerr << "Invalid asyncTimeout" << endl;
+            exit(1);
+        }
+        forwarder = new AsyncForwarder(asyncConnections, asyncTimeout);
+        numClients = 0;
+    }
     for (int i = 0; i < numClients; i++) {
         // Connect to NFS server
         CLIENT* cl; // NFS RPC handle
@@ -635,28 +1087,30 @@ int main(int argc, char** argv)
 
     // Create storage estimator
     Estimator* pEst = Estimator::create(root);
+    // Window in seconds over which client r-b curves are tracked
+    double arrivalCurveWindow = root.isMember("arrivalCurveWindow") ? root["arrivalCurveWindow"].asDouble() : 60;
 
     // Create scheduler
-    sched = new Scheduler(RPCClients, maxOutstandingReadBytes, maxOutstandingWriteBytes, NFS_read_MPL, NFS_write_MPL, pEst);
+    sched = new Scheduler(RPCClients, maxOutstandingReadBytes, maxOutstandingWriteBytes, NFS_read_MPL, NFS_write_MPL, pEst, arrivalCurveWindow);
     if (sched == NULL) {
         cerr << "Failed to create scheduler" << endl;
         exit(1);
     }
+    if (adaptiveMPL) {
+        sched->EnableAdaptiveConcurrency(readMPLParams, writeMPLParams, adaptiveMPLInterval);
+    }
+    if (root.isMember("coalesceWindow")) {
+        int maxCoalescedBytes = root.isMember("maxCoalescedBytes") ? root["maxCoalescedBytes"].asInt() : (1024 * 1024);
+        sched->EnableCoalescing(root["coalesceWindow"].asDouble(), maxCoalescedBytes);
+    }
 
     // Create worker threads
-    for (int i = 0; i < numClients; i++) {
-        pthread_t thread;
-        pthread_attr_t attr;
-        pthread_attr_init(&attr);
-        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-        int rc = pthread_create(&thread,
-                                &attr,
-                                worker_thread,
-                                (void*)NULL);
-        if (rc) {
-            cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
-            exit(-1);
-        }
+    if (forwarder != NULL) {
+        // Each dispatch thread can have any number of jobs outstanding, so the MPL does not need a thread per outstanding job
+        create_threads(asyncConnections, dispatch_thread);
+        create_threads(asyncConnections, completion_thread);
+    } else {
+        create_threads(numClients, worker_thread);
     }
 
     // Unregister NFS RPC handlers
@@ -684,6 +1138,7 @@ int main(int argc, char** argv)
         cerr << "Failed to register tcp NFSEnforcer" << endl;
         exit(1);
     }
+    custom_svc_take_connections(transp);
 
     // Unregister storage RPC handlers
     pmap_unset(STORAGE_ENFORCER_PROGRAM, STORAGE_ENFORCER_V1);
@@ -699,8 +1154,13 @@ int main(int argc, char** argv)
         exit(1);
     }
 
+    // Serve metrics to scrapers
+    if (!metricsAddress.empty() && !startMetricsServer(metricsAddress)) {
+        exit(1);
+    }
+
     // Run proxy
-    custom_svc_run();
+    custom_svc_run(intakeThreads);
     cerr << "custom_svc_run returned" << endl;
 
     delete sched;
@@ -7,6 +7,7 @@
 #ifndef _NFSENFORCER_HPP
 #define _NFSENFORCER_HPP
 
+#include <vector>
 #include <pthread.h>
 #include <unistd.h>
 #include <rpc/rpc.h>
@@ -15,7 +16,6 @@
 
 using namespace std;
 
-extern pid_t pid;
 // Scheduler
 extern Scheduler* sched;
 extern uint64_t startTime;
@@ -24,18 +24,35 @@ extern int maxPendingJobsPerClient;
 struct xprt_cache_t {
     SVCXPRT* xprt; // xprt handle
     pthread_mutex_t mutex;
-    pthread_cond_t CV;
-    pthread_cond_t recvJobCV;
     const struct SVCXPRT::xp_ops* xp_ops; // original xp_ops
     struct SVCXPRT::xp_ops xp_ops_modified; // modified xp_ops with our interposition
-    bool ignore; // ignore fd in poll
-    volatile bool* threadDestroy; // destroy signal to RPC thread
+    int owner; // index of the intake reader thread receiving the connection's requests, or -1 if handled by the main thread
+    bool throttled; // requests are not received until custom_svc_resume, since the client had maxPendingJobsPerClient pending jobs
+    bool died; // handed back to the main thread to be destroyed
+    // Requests of TCP connections accepted by custom_svc_take_connections are read from the socket by their intake reader without holding mutex,
+    // and only complete requests are decoded from recvRecord (see custom_svc_run.cpp)
+    bool recvBuffered;
+    vector<char> recvBuffer; // bytes received that do not form a complete request yet, which are only accessed by the owner
+    vector<char> recvRecord; // request being dispatched
+    XDR recvXdrs; // decodes the arguments of the request being dispatched from recvRecord
 };
-extern pthread_mutex_t xprt_mutex; // used in addition to xprt_cache->mutex to protect ignore flag; must not lock xprt_cache->mutex while holding xprt_mutex
 extern xprt_cache_t* xprt_cache;
 
-// Custom svc_run function.
-void custom_svc_run();
+// Custom svc_run function; requests of cached connections are received by numReaders intake reader threads.
+void custom_svc_run(int numReaders);
+// Hand the connections accepted by a TCP listener to the intake reader threads as they are accepted, so their requests are never read by the RPC library.
+void custom_svc_take_connections(SVCXPRT* listener);
+// Resume receiving requests from a throttled connection.
+// Assumes xprt_cache[fd].mutex is held
+void custom_svc_resume(int fd);
+
+// Cache xprt pointer and interpose on its operations.
+// Assumes xprt_cache[transp->xp_sock].mutex is held
+void cache_xprt(SVCXPRT* transp);
+// Set the transaction id of the request being replied to on a connection, or mark a TCP connection as having died.
+// Assumes xprt_cache[xprt->xp_sock].mutex is held
+void custom_xp_set_xid(SVCXPRT* xprt, u_long xid);
+void custom_xp_set_died(SVCXPRT* xprt);
 
 // RPC dispatch functions.
 void proxy_dispatch(struct svc_req* rqstp, register SVCXPRT* transp);
@@ -0,0 +1,94 @@
+// NFSPayload.cpp - Forwarding of READ/WRITE payloads without copying them through XDR buffers.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <rpc/rpc.h>
+#include "../prot/nfs3_prot.h"
+#include "NFSPayload.hpp"
+
+bool_t xdr_write3args_header(XDR* xdrs, write3args* objp)
+{
+    return xdr_nfs_fh3(xdrs, &objp->file) &&
+           xdr_uint64(xdrs, &objp->offset) &&
+           xdr_uint32(xdrs, &objp->count) &&
+           xdr_stable_how(xdrs, &objp->stable) &&
+           xdr_u_int(xdrs, &objp->data.data_len);
+}
+
+bool_t xdr_read3res_header(XDR* xdrs, read3res* objp)
+{
+    if (!xdr_nfsstat3(xdrs, &objp->status)) {
+        return FALSE;
+    }
+    if (objp->status != NFS3_OK) {
+        return xdr_post_op_attr(xdrs, &objp->read3res_u.resfail);
+    }
+    read3resok* resok = &objp->read3res_u.resok;
+    return xdr_post_op_attr(xdrs, &resok->file_attributes) &&
+           xdr_uint32(xdrs, &resok->count) &&
+           xdr_bool(xdrs, &resok->eof) &&
+           xdr_u_int(xdrs, &resok->data.data_len);
+}
+
+bool_t xdr_inline_read3res(XDR* xdrs, read3res* objp)
+{
+    switch (xdrs->x_op) {
+        case XDR_DECODE:
+            break;
+
+        case XDR_FREE:
+            // Data is owned by the buffer it was decoded from
+            return TRUE;
+
+        default:
+            return xdr_read3res(xdrs, objp);
+    }
+    if (!xdr_read3res_header(xdrs, objp)) {
+        return FALSE;
+    }
+    if (objp->status != NFS3_OK) {
+        return TRUE;
+    }
+    read3resok* resok = &objp->read3res_u.resok;
+    if (resok->data.data_len == 0) {
+        resok->data.data_val = NULL;
+        return TRUE;
+    }
+    resok->data.data_val = (char*)XDR_INLINE(xdrs, RNDUP(resok->data.data_len));
+    return resok->data.data_val != NULL;
+}
+
+bool writevAll(int fd, struct iovec* iov, int iovcnt)
+{
+    while (iovcnt > 0) {
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        // Skip written buffers
+        while ((iovcnt > 0) && ((size_t)n >= iov->iov_len)) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return true;
+}
+
+const char* xdrPadding()
+{
+    static const char padding[BYTES_PER_XDR_UNIT] = { 0 };
+    return padding;
+}
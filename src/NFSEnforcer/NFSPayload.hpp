@@ -0,0 +1,31 @@
+// NFSPayload.hpp - Forwarding of READ/WRITE payloads without copying them through XDR buffers.
+// The headers of WRITE arguments and READ results are encoded/decoded separately from their data,
+// so the data can be sent from and received into the buffers it is already in with scatter-gather I/O.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _NFS_PAYLOAD_HPP
+#define _NFS_PAYLOAD_HPP
+
+#include <sys/uio.h>
+#include <rpc/rpc.h>
+#include "../prot/nfs3_prot.h"
+
+// Size of the record mark preceding each RPC message on a TCP connection
+#define RECORD_MARK_SIZE 4
+#define LAST_FRAGMENT 0x80000000
+
+// Like xdr_write3args, except that the data is not encoded/decoded; the data length is.
+bool_t xdr_write3args_header(XDR* xdrs, write3args* objp);
+// Like xdr_read3res, except that the data is not encoded/decoded; the data length is.
+bool_t xdr_read3res_header(XDR* xdrs, read3res* objp);
+// Like xdr_read3res, except that decoded data points into the buffer of the XDR memory stream rather than being copied, so nothing needs to be freed.
+bool_t xdr_inline_read3res(XDR* xdrs, read3res* objp);
+// Write buffers to a socket with scatter-gather I/O; returns false if the connection failed.
+bool writevAll(int fd, struct iovec* iov, int iovcnt);
+// Get padding of the data to a multiple of the XDR unit size.
+const char* xdrPadding();
+
+#endif // _NFS_PAYLOAD_HPP
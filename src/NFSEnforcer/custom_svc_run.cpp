@@ -1,208 +1,523 @@
 // custom_svc_run.cpp - custom svc_run function to add threading support.
-// Based on glibc-2.19 with minor modifications to add threading and integrate with NFSEnforcer.cpp.
+// Based on glibc-2.19 with modifications to add threading and integrate with NFSEnforcer.cpp.
+// The main thread uses epoll to handle the sockets registered with the RPC library (listening sockets, storage enforcer connections, new NFS connections).
+// Once a connection has been cached in xprt_cache by proxy_dispatch_main, it is owned by one of a fixed pool of intake reader threads,
+// which receives its requests using edge-triggered one-shot epoll notifications that are re-armed after the requests are drained.
+// NFS TCP connections are owned by a reader as soon as they are accepted (see custom_svc_take_connections).
+// Their reader reads the socket without blocking and without holding the connection's xprt_cache mutex, buffering partial requests,
+// so a client that sends part of a request neither holds up the reader's other connections nor the replies on its own connection.
+// Only complete requests are decoded while holding the mutex.
+// A connection whose client has maxPendingJobsPerClient pending jobs is not re-armed until RunJob resumes it.
+// Threads are woken using eventfds, and connections that died are handed back to the main thread to be destroyed.
 //
 
 #include <iostream>
+#include <vector>
+#include <set>
 #include <cassert>
+#include <cstdio>
+#include <cstdlib>
 #include <pthread.h>
 #include <unistd.h>
-#include <signal.h>
+#include <stdint.h>
 #include <rpc/rpc.h>
 #include <rpc/pmap_clnt.h>
+#include <cstring>
 #include <sys/poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <errno.h>
 #include "NFSEnforcer.hpp"
 
-// From glibc-2.19 with minor modifications to compile and run in a thread
+using namespace std;
+
 #define RQCRED_SIZE 400/* this size is excessive */
-void* custom_svc_getreq_common_thread(void* ptr)
+#define MAX_EPOLL_EVENTS 64
+#define RECV_CHUNK_SIZE 65536 // bytes read from a socket at a time
+#define MAX_RECORD_SIZE (16 * 1024 * 1024) // largest request accepted on a TCP connection, which bounds the buffered bytes
+#define LAST_FRAGMENT 0x80000000 // RPC record marking flag of the last fragment of a record
+
+// Intake reader thread and the connections it owns
+struct IntakeReader {
+    int epollFd;
+    int eventFd; // wakes the reader to resume connections
+    pthread_mutex_t mutex; // protects resumeFds
+    vector<int> resumeFds; // connections to resume receiving requests from
+};
+
+static vector<IntakeReader*> intakeReaders;
+// Main thread
+static int mainEpollFd = -1;
+static int mainEventFd = -1; // wakes the main thread to destroy connections
+static pthread_mutex_t mainMutex = PTHREAD_MUTEX_INITIALIZER; // protects diedFds
+static vector<int> diedFds; // connections that died and need to be destroyed by the main thread
+static set<int> watchedFds; // fds in the main thread's epoll
+
+// Create an epoll instance along with an eventfd registered with it.
+static void create_epoll(int& epollFd, int& eventFd)
+{
+    epollFd = epoll_create1(0);
+    if (epollFd < 0) {
+        perror("svc_run: - epoll_create1 failed");
+        exit(1);
+    }
+    eventFd = eventfd(0, EFD_NONBLOCK);
+    if (eventFd < 0) {
+        perror("svc_run: - eventfd failed");
+        exit(1);
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = eventFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, eventFd, &event) < 0) {
+        perror("svc_run: - epoll_ctl failed");
+        exit(1);
+    }
+}
+
+// Wake a thread waiting on an eventfd.
+static void wake(int eventFd)
+{
+    uint64_t value = 1;
+    if (write(eventFd, &value, sizeof(value)) < 0) {
+        assert(errno == EAGAIN); // counter is saturated, so the thread will wake anyways
+    }
+}
+
+// Clear an eventfd after waking.
+static void clear_wake(int eventFd)
+{
+    uint64_t value;
+    if (read(eventFd, &value, sizeof(value)) < 0) {
+        assert(errno == EAGAIN);
+    }
+}
+
+// Arm a connection's one-shot notification, which fires if the socket is already readable.
+static void arm(IntakeReader& reader, int fd, int op)
+{
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLET | EPOLLONESHOT;
+    event.data.fd = fd;
+    if (epoll_ctl(reader.epollFd, op, fd, &event) < 0) {
+        perror("svc_run: - epoll_ctl failed");
+    }
+}
+
+// Read the bytes available on a socket without blocking; returns false if the connection was closed or failed.
+static bool read_available(int fd, vector<char>& buffer)
+{
+    while (true) {
+        size_t size = buffer.size();
+        buffer.resize(size + RECV_CHUNK_SIZE);
+        ssize_t length = recv(fd, &buffer[size], RECV_CHUNK_SIZE, MSG_DONTWAIT);
+        if (length > 0) {
+            buffer.resize(size + length);
+            if (length < RECV_CHUNK_SIZE) {
+                // Drained; the connection is re-armed after its requests are received, which fires if more bytes arrived
+                return true;
+            }
+            continue;
+        }
+        buffer.resize(size);
+        if (length == 0) {
+            return false;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        return ((errno == EAGAIN) || (errno == EWOULDBLOCK));
+    }
+}
+
+// Move the first complete request buffered for a connection, i.e., the fragments of the first record, into recvRecord.
+// Returns false if no complete request is buffered; invalid is set if the request is larger than MAX_RECORD_SIZE.
+static bool next_record(xprt_cache_t& xprt_cache_data, bool& invalid)
+{
+    const vector<char>& buffer = xprt_cache_data.recvBuffer;
+    // Find the end of the record
+    size_t end = 0;
+    size_t recordSize = 0;
+    while (true) {
+        if (buffer.size() < end + sizeof(uint32_t)) {
+            return false;
+        }
+        uint32_t header;
+        memcpy(&header, &buffer[end], sizeof(header));
+        header = ntohl(header);
+        recordSize += header & ~LAST_FRAGMENT;
+        if (recordSize > MAX_RECORD_SIZE) {
+            invalid = true;
+            return false;
+        }
+        end += sizeof(header) + (header & ~LAST_FRAGMENT);
+        if (buffer.size() < end) {
+            return false;
+        }
+        if (header & LAST_FRAGMENT) {
+            break;
+        }
+    }
+    // Join the fragments
+    vector<char>& record = xprt_cache_data.recvRecord;
+    record.resize(recordSize);
+    size_t pos = 0;
+    size_t recordPos = 0;
+    while (pos < end) {
+        uint32_t header;
+        memcpy(&header, &buffer[pos], sizeof(header));
+        size_t fragmentSize = ntohl(header) & ~LAST_FRAGMENT;
+        memcpy(&record[recordPos], &buffer[pos + sizeof(header)], fragmentSize);
+        pos += sizeof(header) + fragmentSize;
+        recordPos += fragmentSize;
+    }
+    xprt_cache_data.recvBuffer.erase(xprt_cache_data.recvBuffer.begin(), xprt_cache_data.recvBuffer.begin() + end);
+    return true;
+}
+
+// Decode the call header of the request in recvRecord, leaving recvXdrs at its arguments; returns false if the request is malformed.
+// Assumes xprt_cache[fd].mutex is held
+static bool decode_record(xprt_cache_t& xprt_cache_data, SVCXPRT* xprt, struct rpc_msg* msg)
+{
+    vector<char>& record = xprt_cache_data.recvRecord;
+    xdrmem_create(&xprt_cache_data.recvXdrs, record.empty() ? NULL : &record[0], record.size(), XDR_DECODE);
+    if (!xdr_callmsg(&xprt_cache_data.recvXdrs, msg)) {
+        return false;
+    }
+    // Replies are sent by the xprt, which takes the transaction id from the last received request
+    custom_xp_set_xid(xprt, msg->rm_xid);
+    return true;
+}
+
+// Receive requests from a connection owned by a reader until its buffered requests are drained.
+// Requests are received from the socket only if it is readable; otherwise only requests already buffered are received.
+// From glibc-2.19 with modifications to compile and run in a reader thread.
+static void receive_requests(IntakeReader& reader, int readerIndex, int fd, bool readable)
 {
-    volatile bool destroy = false;
     struct rpc_msg msg;
-    int fd = (long)ptr;
     char cred_area[2 * MAX_AUTH_BYTES + RQCRED_SIZE];
     msg.rm_call.cb_cred.oa_base = cred_area;
     msg.rm_call.cb_verf.oa_base = &(cred_area[MAX_AUTH_BYTES]);
 
-    /* now receive msgs from xprtprt (support batch calls) */
     xprt_cache_t& xprt_cache_data = xprt_cache[fd];
     pthread_mutex_lock(&xprt_cache_data.mutex);
     register SVCXPRT* xprt = xprt_cache_data.xprt;
-    if ((xprt != NULL) && (xprt_cache_data.threadDestroy == NULL)) {
-        xprt_cache_data.threadDestroy = &destroy;
-        while (!destroy) {
-            do
-            {
-                if (SVC_RECV (xprt, &msg))
-                {
-                    /* now find the exported program and call it */
-                    struct svc_req r;
-                    enum auth_stat why;
-
-                    r.rq_clntcred = &(cred_area[2 * MAX_AUTH_BYTES]);
-                    r.rq_xprt = xprt;
-                    r.rq_prog = msg.rm_call.cb_prog;
-                    r.rq_vers = msg.rm_call.cb_vers;
-                    r.rq_proc = msg.rm_call.cb_proc;
-                    r.rq_cred = msg.rm_call.cb_cred;
-
-                    /* first authenticate the message */
-                    /* Check for null flavor and bypass these calls if possible */
-
-                    if (msg.rm_call.cb_cred.oa_flavor == AUTH_NULL)
-                    {
-                        r.rq_xprt->xp_verf.oa_flavor = _null_auth.oa_flavor;
-                        r.rq_xprt->xp_verf.oa_length = 0;
-                    }
-                    else if ((why = _authenticate (&r, &msg)) != AUTH_OK)
-                    {
-                        svcerr_auth (xprt, why);
-                        continue;
-                    }
-
-                    if (r.rq_prog == NFS_PROGRAM) {
-                        assert(r.rq_vers == NFS_V3);
-                        proxy_dispatch(&r, xprt);
-                    } else {
-                        svcerr_noprog(xprt);
-                    }
+    // Ignore stale notifications for connections that have since been destroyed or handed back
+    if ((xprt == NULL) || (xprt_cache_data.owner != readerIndex) || xprt_cache_data.died) {
+        pthread_mutex_unlock(&xprt_cache_data.mutex);
+        return;
+    }
+    xprt_cache_data.throttled = false;
+    /* now receive msgs from xprtprt (support batch calls) */
+    while (true) {
+        // Stop receiving until RunJob resumes the connection
+        if (sched->GetNumPendingJobs(svc_getcaller(xprt)->sin_addr.s_addr) >= maxPendingJobsPerClient) {
+            xprt_cache_data.throttled = true;
+            pthread_mutex_unlock(&xprt_cache_data.mutex);
+            return;
+        }
+        bool received;
+        if (xprt_cache_data.recvBuffered) {
+            bool invalid = false;
+            if (!next_record(xprt_cache_data, invalid)) {
+                if (invalid) {
+                    custom_xp_set_died(xprt);
+                    break;
                 }
-                if (sched->GetNumPendingJobs(svc_getcaller(xprt)->sin_addr.s_addr) >= maxPendingJobsPerClient) {
-                    pthread_cond_wait(&xprt_cache_data.recvJobCV, &xprt_cache_data.mutex);
+                if (!readable) {
+                    break;
+                }
+                readable = false;
+                // Read without holding the mutex, which replies to the connection's requests also use; only the owner reads the buffer
+                pthread_mutex_unlock(&xprt_cache_data.mutex);
+                bool open = read_available(fd, xprt_cache_data.recvBuffer);
+                pthread_mutex_lock(&xprt_cache_data.mutex);
+                assert((xprt_cache_data.xprt == xprt) && (xprt_cache_data.owner == readerIndex));
+                if (!open) {
+                    custom_xp_set_died(xprt);
+                    break;
                 }
-            } while (SVC_STAT(xprt) == XPRT_MOREREQS);
+                continue;
+            }
+            received = decode_record(xprt_cache_data, xprt, &msg);
+            if (!received) {
+                custom_xp_set_died(xprt);
+                break;
+            }
+        } else {
+            if (!readable && (SVC_STAT(xprt) != XPRT_MOREREQS)) {
+                break;
+            }
+            readable = false;
+            received = SVC_RECV (xprt, &msg);
+        }
+        if (received)
+        {
+            /* now find the exported program and call it */
+            struct svc_req r;
+            enum auth_stat why;
+
+            r.rq_clntcred = &(cred_area[2 * MAX_AUTH_BYTES]);
+            r.rq_xprt = xprt;
+            r.rq_prog = msg.rm_call.cb_prog;
+            r.rq_vers = msg.rm_call.cb_vers;
+            r.rq_proc = msg.rm_call.cb_proc;
+            r.rq_cred = msg.rm_call.cb_cred;
 
-            // Wake main poll so it'll take this socket into account
-            pthread_mutex_lock(&xprt_mutex);
-            xprt_cache_data.ignore = false;
-            pthread_mutex_unlock(&xprt_mutex);
-            kill(pid, SIGUSR1);
+            /* first authenticate the message */
+            /* Check for null flavor and bypass these calls if possible */
 
-            // Wait on cond var
-            pthread_cond_wait(&xprt_cache_data.CV, &xprt_cache_data.mutex);
+            if (msg.rm_call.cb_cred.oa_flavor == AUTH_NULL)
+            {
+                r.rq_xprt->xp_verf.oa_flavor = _null_auth.oa_flavor;
+                r.rq_xprt->xp_verf.oa_length = 0;
+            }
+            else if ((why = _authenticate (&r, &msg)) != AUTH_OK)
+            {
+                svcerr_auth (xprt, why);
+                continue;
+            }
+
+            if (r.rq_prog == NFS_PROGRAM) {
+                assert(r.rq_vers == NFS_V3);
+                proxy_dispatch(&r, xprt);
+            } else {
+                svcerr_noprog(xprt);
+            }
         }
     }
+    if (SVC_STAT(xprt) == XPRT_DIED) {
+        // Hand connection back to the main thread to destroy it
+        xprt_cache_data.died = true;
+        pthread_mutex_lock(&mainMutex);
+        diedFds.push_back(fd);
+        pthread_mutex_unlock(&mainMutex);
+        wake(mainEventFd);
+    } else {
+        // Wait for more requests
+        arm(reader, fd, EPOLL_CTL_MOD);
+    }
     pthread_mutex_unlock(&xprt_cache_data.mutex);
-    return NULL;
 }
 
-// From glibc-2.19 with minor modifications to compile and add threading
-void custom_svc_getreq_poll (struct pollfd *pfdp, int pollretval, int max_pollfd)
+// Intake reader thread receiving requests from the connections it owns.
+static void* intake_reader_thread(void* ptr)
 {
-    if (pollretval == 0)
-        return;
-
-    register int fds_found;
-    for (int i = fds_found = 0; i < max_pollfd; ++i)
-    {
-        register struct pollfd *p = &pfdp[i];
-
-        if (p->fd != -1 && p->revents)
-        {
-            /* fd has input waiting */
-            // Check if we've cached the xprt so that we can run our custom svc_getreq_common in a thread
-            xprt_cache_t& xprt_cache_data = xprt_cache[p->fd];
-            pthread_mutex_lock(&xprt_cache_data.mutex);
-            SVCXPRT* xprt = xprt_cache_data.xprt;
-            if (xprt != NULL) {
-                if (p->revents & POLLNVAL) {
-                    xprt_unregister(xprt);
-                    pthread_mutex_unlock(&xprt_cache_data.mutex);
-                } else if (SVC_STAT(xprt) == XPRT_DIED) {
-                    SVC_DESTROY(xprt);
-                    pthread_mutex_unlock(&xprt_cache_data.mutex);
-                } else {
-                    pthread_mutex_lock(&xprt_mutex);
-                    assert(p->fd == xprt->xp_sock);
-                    // Ignore this fd in poll until thread completes
-                    assert(xprt_cache[p->fd].ignore == false);
-                    xprt_cache[p->fd].ignore = true;
-                    pthread_mutex_unlock(&xprt_mutex);
-                    if (xprt_cache_data.threadDestroy != NULL) {
-                        pthread_cond_signal(&xprt_cache_data.CV);
-                    } else {
-                        pthread_t thread;
-                        pthread_attr_t attr;
-                        pthread_attr_init(&attr);
-                        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-                        int rc = pthread_create(&thread,
-                                                &attr,
-                                                custom_svc_getreq_common_thread,
-                                                (void*)(long)(p->fd));
-                        if (rc) {
-                            cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
-                            exit(-1);
-                        }
-                    }
-                    pthread_mutex_unlock(&xprt_cache_data.mutex);
+    int readerIndex = (long)ptr;
+    IntakeReader& reader = *intakeReaders[readerIndex];
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    vector<int> resumeFds;
+    while (true) {
+        int numEvents = epoll_wait(reader.epollFd, events, MAX_EPOLL_EVENTS, -1);
+        if (numEvents < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("svc_run: - epoll_wait failed");
+            exit(1);
+        }
+        for (int i = 0; i < numEvents; i++) {
+            int fd = events[i].data.fd;
+            if (fd == reader.eventFd) {
+                clear_wake(reader.eventFd);
+                pthread_mutex_lock(&reader.mutex);
+                resumeFds.swap(reader.resumeFds);
+                pthread_mutex_unlock(&reader.mutex);
+                for (vector<int>::const_iterator it = resumeFds.begin(); it != resumeFds.end(); it++) {
+                    receive_requests(reader, readerIndex, *it, false);
                 }
+                resumeFds.clear();
             } else {
-                svc_getreq_common(p->fd);
-                pthread_mutex_unlock(&xprt_cache_data.mutex);
+                receive_requests(reader, readerIndex, fd, true);
             }
-
-            if (++fds_found >= pollretval)
-                break;
         }
     }
+    return NULL;
 }
 
-// From glibc-2.19 with minor modifications to compile and add threading
-void custom_svc_run (void)
+// Resume receiving requests from a connection that was throttled since its client had too many pending jobs.
+// Assumes xprt_cache[fd].mutex is held
+void custom_svc_resume(int fd)
 {
-    int i;
-    struct pollfd *my_pollfd = NULL;
-    int last_max_pollfd = 0;
+    xprt_cache_t& xprt_cache_data = xprt_cache[fd];
+    if (xprt_cache_data.throttled && (xprt_cache_data.owner >= 0)) {
+        xprt_cache_data.throttled = false;
+        IntakeReader& reader = *intakeReaders[xprt_cache_data.owner];
+        pthread_mutex_lock(&reader.mutex);
+        reader.resumeFds.push_back(fd);
+        pthread_mutex_unlock(&reader.mutex);
+        wake(reader.eventFd);
+    }
+}
 
-    for (;;)
-    {
-        int max_pollfd = svc_max_pollfd;
-        if (max_pollfd == 0 && svc_pollfd == NULL)
-            break;
+// Operations of the listener given to custom_svc_take_connections, which accept connections for the intake readers
+static struct SVCXPRT::xp_ops listenerOps;
 
-        if (last_max_pollfd != max_pollfd)
-        {
-            struct pollfd *new_pollfd
-                = (struct pollfd*)realloc (my_pollfd, sizeof (struct pollfd) * max_pollfd);
+// Accept a connection and hand it to an intake reader; replaces the rendezvous request of the RPC library's TCP listener.
+// From glibc-2.19 with modifications to cache the connection before any of its requests are read.
+static bool_t custom_rendezvous_request(SVCXPRT* listener, struct rpc_msg* msg)
+{
+    int sock;
+    struct sockaddr_in addr;
+    socklen_t len;
+again:
+    len = sizeof(struct sockaddr_in);
+    if ((sock = accept(listener->xp_sock, (struct sockaddr*)&addr, &len)) < 0) {
+        if (errno == EINTR) {
+            goto again;
+        }
+        perror("svc_run: - accept failed");
+        return FALSE;
+    }
+    // The listener is created with the default buffer sizes
+    SVCXPRT* xprt = svcfd_create(sock, 0, 0);
+    if (xprt == NULL) {
+        close(sock);
+        return FALSE;
+    }
+    memcpy(&xprt->xp_raddr, &addr, sizeof(addr));
+    xprt->xp_addrlen = len;
+    // Hand connection to a reader
+    xprt_cache_t& xprt_cache_data = xprt_cache[sock];
+    pthread_mutex_lock(&xprt_cache_data.mutex);
+    cache_xprt(xprt);
+    xprt_cache_data.recvBuffered = true;
+    xprt_cache_data.owner = sock % intakeReaders.size();
+    xprt_cache_data.throttled = false;
+    arm(*intakeReaders[xprt_cache_data.owner], sock, EPOLL_CTL_ADD);
+    pthread_mutex_unlock(&xprt_cache_data.mutex);
+    return FALSE; /* there is never an rpc msg to be processed */
+}
 
-            if (new_pollfd == NULL)
-            {
-                perror ("svc_run: - out of memory");
-                break;
+void custom_svc_take_connections(SVCXPRT* listener)
+{
+    listenerOps = *(listener->xp_ops);
+    listenerOps.xp_recv = custom_rendezvous_request;
+    listener->xp_ops = &listenerOps;
+}
+
+// Update the main thread's epoll to match the fds registered with the RPC library that are not owned by a reader.
+// The fds are only rescanned after the main thread handles an fd, which does not happen for the requests of cached connections.
+// Assumes watchedFds matches the main thread's epoll, i.e., no watched fd has been closed and reused since the last update
+static void update_watched_fds()
+{
+    set<int> fds;
+    for (int i = 0; i < svc_max_pollfd; i++) {
+        int fd = svc_pollfd[i].fd;
+        if ((fd >= 0) && (xprt_cache[fd].owner < 0)) {
+            fds.insert(fd);
+        }
+    }
+    for (set<int>::const_iterator it = watchedFds.begin(); it != watchedFds.end(); it++) {
+        if (fds.find(*it) == fds.end()) {
+            // Closed fds are removed from epoll automatically
+            epoll_ctl(mainEpollFd, EPOLL_CTL_DEL, *it, NULL);
+        }
+    }
+    for (set<int>::const_iterator it = fds.begin(); it != fds.end(); it++) {
+        if (watchedFds.find(*it) == watchedFds.end()) {
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.fd = *it;
+            if (epoll_ctl(mainEpollFd, EPOLL_CTL_ADD, *it, &event) < 0) {
+                perror("svc_run: - epoll_ctl failed");
             }
+        }
+    }
+    watchedFds.swap(fds);
+}
 
-            my_pollfd = new_pollfd;
-            last_max_pollfd = max_pollfd;
+// Handle an fd registered with the RPC library, and hand the connection to a reader once it has been cached.
+static void handle_svc_fd(int fd)
+{
+    xprt_cache_t& xprt_cache_data = xprt_cache[fd];
+    pthread_mutex_lock(&xprt_cache_data.mutex);
+    svc_getreq_common(fd);
+    SVCXPRT* xprt = xprt_cache_data.xprt;
+    if ((xprt != NULL) && (xprt_cache_data.owner < 0)) {
+        assert(fd == xprt->xp_sock);
+        epoll_ctl(mainEpollFd, EPOLL_CTL_DEL, fd, NULL);
+        watchedFds.erase(fd);
+        xprt_cache_data.owner = fd % intakeReaders.size();
+        xprt_cache_data.throttled = false;
+        arm(*intakeReaders[xprt_cache_data.owner], fd, EPOLL_CTL_ADD);
+    }
+    pthread_mutex_unlock(&xprt_cache_data.mutex);
+}
+
+// Destroy connections that died while owned by a reader.
+static void destroy_died_fds()
+{
+    vector<int> fds;
+    pthread_mutex_lock(&mainMutex);
+    fds.swap(diedFds);
+    pthread_mutex_unlock(&mainMutex);
+    for (vector<int>::const_iterator it = fds.begin(); it != fds.end(); it++) {
+        xprt_cache_t& xprt_cache_data = xprt_cache[*it];
+        pthread_mutex_lock(&xprt_cache_data.mutex);
+        SVCXPRT* xprt = xprt_cache_data.xprt;
+        if ((xprt != NULL) && (xprt_cache_data.owner >= 0) && (SVC_STAT(xprt) == XPRT_DIED)) {
+            SVC_DESTROY(xprt);
         }
+        pthread_mutex_unlock(&xprt_cache_data.mutex);
+    }
+}
 
-        pthread_mutex_lock(&xprt_mutex);
-        for (i = 0; i < max_pollfd; ++i)
-        {
-            if (xprt_cache[svc_pollfd[i].fd].ignore) {
-                my_pollfd[i].fd = -1;
-            } else {
-                my_pollfd[i].fd = svc_pollfd[i].fd;
-            }
-            my_pollfd[i].events = svc_pollfd[i].events;
-            my_pollfd[i].revents = 0;
+// Based on glibc-2.19 with modifications to use epoll and intake reader threads
+void custom_svc_run (int numReaders)
+{
+    assert(numReaders > 0);
+    create_epoll(mainEpollFd, mainEventFd);
+    for (int i = 0; i < numReaders; i++) {
+        IntakeReader* reader = new IntakeReader();
+        create_epoll(reader->epollFd, reader->eventFd);
+        pthread_mutex_init(&reader->mutex, NULL);
+        intakeReaders.push_back(reader);
+    }
+    for (int i = 0; i < numReaders; i++) {
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        int rc = pthread_create(&thread,
+                                &attr,
+                                intake_reader_thread,
+                                (void*)(long)i);
+        if (rc) {
+            cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
+            exit(-1);
         }
-        pthread_mutex_unlock(&xprt_mutex);
+    }
 
-        switch (i = poll (my_pollfd, max_pollfd, 1))
-        {
-            case -1:
-                if (errno == EINTR)
-                    continue;
-                perror ("svc_run: - poll failed");
-                break;
-            case 0:
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    update_watched_fds();
+    for (;;)
+    {
+        if (svc_max_pollfd == 0 && svc_pollfd == NULL)
+            break;
+
+        int numEvents = epoll_wait(mainEpollFd, events, MAX_EPOLL_EVENTS, -1);
+        if (numEvents < 0) {
+            if (errno == EINTR)
                 continue;
-            default:
-                custom_svc_getreq_poll (my_pollfd, i, max_pollfd);
+            perror ("svc_run: - epoll_wait failed");
+            break;
+        }
+        for (int i = 0; i < numEvents; i++) {
+            int fd = events[i].data.fd;
+            if (fd == mainEventFd) {
+                clear_wake(mainEventFd);
+                destroy_died_fds();
+            } else if (watchedFds.find(fd) != watchedFds.end()) {
+                handle_svc_fd(fd);
+            } else {
                 continue;
+            }
+            // Update before another fd is handled, since a closed fd can be reused by an accepted connection
+            update_watched_fds();
         }
-        break;
     }
-
-    free (my_pollfd);
 }
@@ -6,6 +6,8 @@
 
 #include <iostream>
 #include <limits>
+#include <climits>
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <stdint.h>
@@ -18,6 +20,26 @@
 
 using namespace std;
 
+// Pool of jobs
+static BlockPool& GetJobPool()
+{
+    static BlockPool jobPool(sizeof(Job));
+    return jobPool;
+}
+
+void* Job::operator new(size_t size)
+{
+    assert(size == sizeof(Job));
+    return GetJobPool().alloc();
+}
+
+void Job::operator delete(void* ptr)
+{
+    if (ptr != NULL) {
+        GetJobPool().free(ptr);
+    }
+}
+
 // Get a client, possibly creating a new client.
 // Assumes mutex held
 Client& Scheduler::GetClient(unsigned long s_addr)
@@ -28,7 +50,10 @@ Client& Scheduler::GetClient(unsigned long s_addr)
         return it->second;
     }
     // If new client, create one
+    // Holds the lock until the client is initialized, since clients are looked up without the mutex
+    pthread_rwlock_wrlock(&_clientsLock);
     Client& c = _clients[s_addr];
+    c.s_addr = s_addr;
     c.priority = 0;
     c.rateLimitLength = 0; // no rate-limiting by default for the purposes of profiling
     c.rateLimitRates = new double[c.rateLimitLength];
@@ -40,15 +65,42 @@ Client& Scheduler::GetClient(unsigned long s_addr)
     uint64_t now = GetTime();
     c.lastOccupancyTime = now;
     c.getOccupancyTime = now;
+    // Storage work is in seconds, so the max rate is 1 work sec/sec
+    c.arrivalCurve = new SlidingArrivalCurve(1, _arrivalCurveWindow);
+    pthread_mutex_init(&c.arrivalCurveLock, NULL);
+    pthread_mutex_init(&c.arrivalsLock, NULL);
+    c.waitingForTokens = false;
+    c.readyTime = 0;
+    c.numPendingJobs = 0;
+    c.stats = new ClientStats();
+    c.stats->rateLimitExceededJobs = 0;
+    c.stats->immediateJobs = 0;
+    c.stats->resetTime = now;
+    pthread_rwlock_unlock(&_clientsLock);
     return c;
 }
 
+// Look up a client without the mutex, or NULL if the client does not exist.
+// The client's fields other than numPendingJobs may only be accessed with the mutex held.
+Client* Scheduler::LookupClient(unsigned long s_addr)
+{
+    Client* pClient = NULL;
+    pthread_rwlock_rdlock(&_clientsLock);
+    map<unsigned long, Client>::iterator it = _clients.find(s_addr);
+    if (it != _clients.end()) {
+        pClient = &it->second;
+    }
+    pthread_rwlock_unlock(&_clientsLock);
+    return pClient;
+}
+
 // Update client parameters.
 void Scheduler::UpdateClient(unsigned long s_addr, unsigned int priority, int rateLimitLength, double* rateLimitRates, double* rateLimitBursts)
 {
     // Request ownership of the mutex
     pthread_mutex_lock(&_schedulerMutex);
     Client& c = GetClient(s_addr);
+    Unschedule(c);
     c.priority = priority;
     delete[] c.rateLimitRates;
     delete[] c.rateLimitBursts;
@@ -63,6 +115,7 @@ void Scheduler::UpdateClient(unsigned long s_addr, unsigned int priority, int ra
         c.rateLimitTokens[i] = rateLimitBursts[i];
     }
     c.rateLimitObeyed = false;
+    Schedule(c, 0);
     // Release ownership of the mutex
     pthread_mutex_unlock(&_schedulerMutex);
 }
@@ -89,26 +142,133 @@ double Scheduler::GetOccupancy(unsigned long s_addr)
 }
 
 // Return number of pending jobs for a client.
+// Does not need the mutex, since it is called while receiving requests and when each job completes.
 int Scheduler::GetNumPendingJobs(unsigned long s_addr)
 {
-    // Request ownership of the mutex
-    pthread_mutex_lock(&_schedulerMutex);
-    Client& c = GetClient(s_addr);
-    int numPending = c.pendingJobs.size();
-    // Release ownership of the mutex
-    pthread_mutex_unlock(&_schedulerMutex);
-    return numPending;
+    Client* pClient = LookupClient(s_addr);
+    return (pClient == NULL) ? 0 : __sync_fetch_and_add(&pClient->numPendingJobs, 0);
+}
+
+// Get the r-b curve of a client's requests over the recent window.
+// Does not need the mutex, and does not create a client for an unknown address.
+void Scheduler::GetRbCurve(unsigned long s_addr, vector<double>& rates, vector<double>& bursts)
+{
+    rates.clear();
+    bursts.clear();
+    Client* pClient = LookupClient(s_addr);
+    if (pClient == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pClient->arrivalCurveLock);
+    UpdateArrivalCurve(*pClient);
+    pClient->arrivalCurve->getRbCurve(rates, bursts, GetTime());
+    pthread_mutex_unlock(&pClient->arrivalCurveLock);
+}
+
+// Update a client's r-b curve with the jobs added since the last update.
+// The token bucket update is O(#rates) per job, so it is done without the mutex, and AddJob only records the job.
+// Assumes arrivalCurveLock held, which keeps the jobs in arrival order across updates.
+void Scheduler::UpdateArrivalCurve(Client& c)
+{
+    vector<pair<uint64_t, double> > arrivals;
+    pthread_mutex_lock(&c.arrivalsLock);
+    arrivals.swap(c.arrivals);
+    pthread_mutex_unlock(&c.arrivalsLock);
+    for (vector<pair<uint64_t, double> >::const_iterator it = arrivals.begin(); it != arrivals.end(); it++) {
+        c.arrivalCurve->addArrival(it->first, it->second);
+    }
+}
+
+// Sample the telemetry of a client's jobs, and optionally reset it.
+// Does not need the mutex, so sampling does not delay scheduling.
+bool Scheduler::GetStats(unsigned long s_addr, bool reset, ClientStatsSnapshot& snapshot)
+{
+    Client* pClient = LookupClient(s_addr);
+    if (pClient == NULL) {
+        return false;
+    }
+    ClientStats& stats = *pClient->stats;
+    uint64_t now = GetTime();
+    uint64_t resetTime = reset ? __sync_lock_test_and_set(&stats.resetTime, now) : __sync_fetch_and_add(&stats.resetTime, 0);
+    snapshot.interval = ConvertTimeToSeconds(now - resetTime);
+    stats.readQueueTime.sample(snapshot.readQueueTime, reset);
+    stats.readServiceTime.sample(snapshot.readServiceTime, reset);
+    stats.readTotalTime.sample(snapshot.readTotalTime, reset);
+    stats.writeQueueTime.sample(snapshot.writeQueueTime, reset);
+    stats.writeServiceTime.sample(snapshot.writeServiceTime, reset);
+    stats.writeTotalTime.sample(snapshot.writeTotalTime, reset);
+    if (reset) {
+        snapshot.rateLimitExceededJobs = __sync_lock_test_and_set(&stats.rateLimitExceededJobs, 0);
+        snapshot.immediateJobs = __sync_lock_test_and_set(&stats.immediateJobs, 0);
+    } else {
+        snapshot.rateLimitExceededJobs = __sync_fetch_and_add(&stats.rateLimitExceededJobs, 0);
+        snapshot.immediateJobs = __sync_fetch_and_add(&stats.immediateJobs, 0);
+    }
+    return true;
 }
 
 // Submit job to scheduler queue.
+// The job is pushed onto the submitted jobs without the mutex, and is added to its client's queue by the next worker scheduling a job.
 void Scheduler::SubmitJob(Job* pJob)
 {
-    // Request ownership of the mutex
-    pthread_mutex_lock(&_schedulerMutex);
-    // Add job
-    AddJob(pJob);
-    // Release ownership of the mutex
-    pthread_mutex_unlock(&_schedulerMutex);
+    Client* pClient = LookupClient(pJob->Addr());
+    if (pClient == NULL) {
+        // Request ownership of the mutex to create client
+        pthread_mutex_lock(&_schedulerMutex);
+        pClient = &GetClient(pJob->Addr());
+        // Release ownership of the mutex
+        pthread_mutex_unlock(&_schedulerMutex);
+    }
+    __sync_fetch_and_add(&pClient->numPendingJobs, 1);
+    // Push job onto submitted jobs
+    Job* pNext;
+    do {
+        pNext = _submittedJobs;
+        pJob->submittedNext = pNext;
+    } while (!__sync_bool_compare_and_swap(&_submittedJobs, pNext, pJob));
+    // Wake a worker if the submitted jobs were empty, since otherwise a worker has been woken or will see them before waiting
+    // The atomic operations order the push before checking for waiting workers, and a waiting worker checks for submitted jobs after announcing it is waiting
+    if ((pNext == NULL) && (__sync_fetch_and_add(&_numWaitingWorkers, 0) > 0)) {
+        // Request ownership of the mutex
+        pthread_mutex_lock(&_schedulerMutex);
+        pthread_cond_signal(&_availableJobsCV);
+        // Release ownership of the mutex
+        pthread_mutex_unlock(&_schedulerMutex);
+    }
+}
+
+// Add submitted jobs to the client queues in the order they were submitted.
+// Assumes mutex held
+void Scheduler::AddSubmittedJobs()
+{
+    if (_submittedJobs == NULL) {
+        return;
+    }
+    // Take all submitted jobs
+    Job* pJob = __sync_lock_test_and_set(&_submittedJobs, (Job*)NULL);
+    __sync_synchronize();
+    // Reverse to submission order
+    Job* pFirst = NULL;
+    while (pJob != NULL) {
+        Job* pNext = pJob->submittedNext;
+        pJob->submittedNext = pFirst;
+        pFirst = pJob;
+        pJob = pNext;
+    }
+    for (pJob = pFirst; pJob != NULL;) {
+        Job* pNext = pJob->submittedNext;
+        AddJob(pJob);
+        pJob = pNext;
+    }
+}
+
+// Wake a worker waiting for jobs, if any.
+// Assumes mutex held
+void Scheduler::WakeWorker()
+{
+    if (_numWaitingWorkers > 0) {
+        pthread_cond_signal(&_availableJobsCV);
+    }
 }
 
 // Get the next job to send to storage.
@@ -118,17 +278,51 @@ Job* Scheduler::GetNextJob()
     pthread_mutex_lock(&_schedulerMutex);
     Job* pJob = ScheduleJob();
     while (pJob == NULL) {
-      pthread_cond_wait(&_availableJobsCV, &_schedulerMutex);
-      pJob = ScheduleJob();
+        __sync_fetch_and_add(&_numWaitingWorkers, 1);
+        // Only wait if no jobs were submitted, since submitters do not wake workers that have not announced they are waiting
+        if (__sync_fetch_and_add(&_submittedJobs, 0) == NULL) {
+            pthread_cond_wait(&_availableJobsCV, &_schedulerMutex);
+        }
+        __sync_fetch_and_sub(&_numWaitingWorkers, 1);
+        pJob = ScheduleJob();
+    }
+    // Wake another worker if there may be more jobs to schedule, instead of waking all workers
+    if ((_pendingJobCount > 0) || (_submittedJobs != NULL)) {
+        WakeWorker();
     }
     // Release ownership of the mutex
     pthread_mutex_unlock(&_schedulerMutex);
+    // Update the client's r-b curve without the mutex; a client's recorded arrivals are applied whenever one of its jobs is dispatched, so they are bounded by its pending jobs
+    Client* pClient = LookupClient(pJob->Addr());
+    if (pClient != NULL) {
+        pthread_mutex_lock(&pClient->arrivalCurveLock);
+        UpdateArrivalCurve(*pClient);
+        pthread_mutex_unlock(&pClient->arrivalCurveLock);
+    }
     return pJob;
 }
 
 // Indicate job is completed.
 void Scheduler::CompleteJob(Job* pJob)
 {
+    // Record latencies before taking the mutex
+    uint64_t now = GetTime();
+    uint64_t serviceEndTime = (pJob->serviceEndTime != 0) ? pJob->serviceEndTime : now;
+    uint64_t serviceTime = serviceEndTime - pJob->dispatchTime;
+    Client* pClient = LookupClient(pJob->Addr());
+    if ((pClient != NULL) && (pJob->IsReadRequest() || pJob->IsWriteRequest())) {
+        ClientStats& stats = *pClient->stats;
+        // Jobs coalesced with the job completed with it
+        for (Job* pCoalesced = pJob; pCoalesced != NULL; pCoalesced = pCoalesced->coalescedNext) {
+            if (pJob->IsReadRequest()) {
+                stats.readServiceTime.record(serviceTime);
+                stats.readTotalTime.record(now - pCoalesced->ArrivalTime());
+            } else {
+                stats.writeServiceTime.record(serviceTime);
+                stats.writeTotalTime.record(now - pCoalesced->ArrivalTime());
+            }
+        }
+    }
     // Request ownership of the mutex
     pthread_mutex_lock(&_schedulerMutex);
     // Readjust maximum number of outstanding jobs for immediate jobs
@@ -139,18 +333,29 @@ void Scheduler::CompleteJob(Job* pJob)
     _outstandingJobs--;
     if (pJob->IsReadRequest()) {
         _outstandingReadJobs--;
-        _outstandingReadBytes -= pJob->RequestSize();
+        _outstandingReadBytes -= pJob->CoalescedSize();
     } else if (pJob->IsWriteRequest()) {
         _outstandingWriteJobs--;
-        _outstandingWriteBytes -= pJob->RequestSize();
+        _outstandingWriteBytes -= pJob->CoalescedSize();
+    }
+    // Feed the MPL controllers; immediate jobs bypass the MPL, so they are not measured
+    if ((_readController != NULL) && !pJob->Immediate()) {
+        if (pJob->IsReadRequest()) {
+            _readController->complete(pJob->CoalescedSize(), serviceTime);
+        } else if (pJob->IsWriteRequest()) {
+            _writeController->complete(pJob->CoalescedSize(), serviceTime);
+        }
+        if (now >= _nextControlTime) {
+            UpdateConcurrency(now);
+        }
     }
     // Track outstanding priority
     if (pJob->rateLimitObeyed) {
         RemoveOutstandingPriority(pJob);
     }
-    // Broadcast new jobs may be able to run
-    if (_pendingJobCount > 0) {
-        pthread_cond_broadcast(&_availableJobsCV);
+    // Wake a worker since new jobs may be able to run; if it schedules a job, it wakes the next worker
+    if ((_pendingJobCount > 0) || (_submittedJobs != NULL)) {
+        WakeWorker();
     }
     // Release ownership of the mutex
     pthread_mutex_unlock(&_schedulerMutex);
@@ -162,6 +367,10 @@ void Scheduler::ReturnClient(Job* pJob)
     // Request ownership of the mutex
     pthread_mutex_lock(&_schedulerMutex);
     _RPCAvailableClients.push_back(pJob->RPCClient());
+    // Wake a worker if jobs may have been waiting for an RPC client
+    if ((_RPCAvailableClients.size() == 1) && ((_pendingJobCount > 0) || (_submittedJobs != NULL))) {
+        WakeWorker();
+    }
     // Release ownership of the mutex
     pthread_mutex_unlock(&_schedulerMutex);
 }
@@ -176,61 +385,55 @@ double Scheduler::EstimateJobSize(Client& c, Job* pJob)
     return _pEst->estimateWork(pJob->RequestSize(), pJob->IsReadRequest());
 }
 
-// Compares two clients to see which should be scheduled.
-// Assumes mutex held
-// Assumes UpdateTokens has been called to update rateLimitObeyed flags
-#define PREFER_1 1
-#define PREFER_EQUAL 0
-#define PREFER_2 -1
-int Scheduler::CompareClient(const Client& c1, const Client& c2)
-{
-    // Check for pending job
-    if (c1.pendingJobs.empty()) {
-        if (c2.pendingJobs.empty()) {
-            return PREFER_EQUAL;
-        } else {
-            return PREFER_2;
-        }
-    } else if (c2.pendingJobs.empty()) {
-        return PREFER_1;
-    }
-
+// Check if a client should be scheduled before another.
+bool ScheduleKey::operator<(const ScheduleKey& other) const
+{
     // Check immediate flag
-    Job* pJob1 = c1.pendingJobs.front();
-    Job* pJob2 = c2.pendingJobs.front();
-    if (pJob1->Immediate()) {
-        if (!pJob2->Immediate()) {
-            return PREFER_1;
-        }
-    } else if (pJob2->Immediate()) {
-        return PREFER_2;
+    if (immediate != other.immediate) {
+        return immediate;
     }
-
     // Check if within rate limit
-    if (c1.rateLimitObeyed) {
-        if (c2.rateLimitObeyed) {
-            // Check priority
-            // Priority only applies when both clients are within rate limits
-            if (c1.priority < c2.priority) {
-                return PREFER_1;
-            } else if (c1.priority > c2.priority) {
-                return PREFER_2;
-            }
-        } else {
-            return PREFER_1;
-        }
-    } else if (c2.rateLimitObeyed) {
-        return PREFER_2;
+    if (rateLimitObeyed != other.rateLimitObeyed) {
+        return rateLimitObeyed;
+    }
+    // Check priority
+    // Priority only applies when both clients are within rate limits
+    if (priority != other.priority) {
+        return priority < other.priority;
     }
-
     // When rate limits/priority have not determined which client is better,
     // then switch to using FCFS
-    if (pJob1->ArrivalTime() < pJob2->ArrivalTime()) {
-        return PREFER_1;
-    } else if (pJob1->ArrivalTime() > pJob2->ArrivalTime()) {
-        return PREFER_2;
+    if (arrivalTime != other.arrivalTime) {
+        return arrivalTime < other.arrivalTime;
+    }
+    return s_addr < other.s_addr;
+}
+
+// Add the tokens earned since the last update to token buckets
+// Assumes mutex held
+// Assumes the client's queue is non empty
+void Scheduler::AccumulateTokens(Client& c, uint64_t now)
+{
+    // Update token buckets with burst limits when the queue was empty
+    if (c.rateLimitUpdateTime < c.lastOccupancyTime) {
+        double elapsedTime = ConvertTimeToSeconds(c.lastOccupancyTime - c.rateLimitUpdateTime);
+        for (int i = 0; i < c.rateLimitLength; i++) {
+            c.rateLimitTokens[i] += elapsedTime * c.rateLimitRates[i];
+            if (c.rateLimitTokens[i] > c.rateLimitBursts[i]) {
+                c.rateLimitTokens[i] = c.rateLimitBursts[i];
+            }
+        }
+        c.rateLimitUpdateTime = c.lastOccupancyTime;
+    }
+    // Update token buckets without burst limits for the time that queue is non empty
+    assert(c.rateLimitUpdateTime >= c.lastOccupancyTime);
+    if (now > c.rateLimitUpdateTime) {
+        double elapsedTime = ConvertTimeToSeconds(now - c.rateLimitUpdateTime);
+        c.rateLimitUpdateTime = now;
+        for (int i = 0; i < c.rateLimitLength; i++) {
+            c.rateLimitTokens[i] += elapsedTime * c.rateLimitRates[i];
+        }
     }
-    return PREFER_EQUAL;
 }
 
 // Update token buckets in order to check rate limits
@@ -242,24 +445,9 @@ void Scheduler::UpdateTokens(Client& c, uint64_t now)
         Job* pJob = c.pendingJobs.front();
         // Only update if we're may not be within rate limits
         if (!c.rateLimitObeyed) {
+            AccumulateTokens(c, now);
             c.rateLimitObeyed = true;
-            // Update token buckets with burst limits when the queue was empty
-            if (c.rateLimitUpdateTime < c.lastOccupancyTime) {
-                double elapsedTime = ConvertTimeToSeconds(c.lastOccupancyTime - c.rateLimitUpdateTime);
-                for (int i = 0; i < c.rateLimitLength; i++) {
-                    c.rateLimitTokens[i] += elapsedTime * c.rateLimitRates[i];
-                    if (c.rateLimitTokens[i] > c.rateLimitBursts[i]) {
-                        c.rateLimitTokens[i] = c.rateLimitBursts[i];
-                    }
-                }
-                c.rateLimitUpdateTime = c.lastOccupancyTime;
-            }
-            // Update token buckets without burst limits for the time that queue is non empty
-            assert(c.rateLimitUpdateTime >= c.lastOccupancyTime);
-            double elapsedTime = ConvertTimeToSeconds(now - c.rateLimitUpdateTime);
-            c.rateLimitUpdateTime = now;
             for (int i = 0; i < c.rateLimitLength; i++) {
-                c.rateLimitTokens[i] += elapsedTime * c.rateLimitRates[i];
                 // Check if not enough tokens for meeting rate limit
                 if (pJob->JobSize() > c.rateLimitTokens[i]) {
                     c.rateLimitObeyed = false;
@@ -269,6 +457,77 @@ void Scheduler::UpdateTokens(Client& c, uint64_t now)
     }
 }
 
+// Get the time when a backlogged client's tokens suffice for its next job, i.e., when UpdateTokens would find it within rate limits, without updating token buckets.
+// Returns false if the tokens never suffice, i.e., a rate limit without enough tokens has no rate.
+// Assumes mutex held
+// Assumes the client's queue is non empty
+bool Scheduler::GetReadyTime(const Client& c, uint64_t& readyTime)
+{
+    double jobSize = c.pendingJobs.front()->JobSize();
+    uint64_t updateTime = c.rateLimitUpdateTime;
+    double idleTime = 0;
+    if (c.rateLimitUpdateTime < c.lastOccupancyTime) {
+        updateTime = c.lastOccupancyTime;
+        idleTime = ConvertTimeToSeconds(c.lastOccupancyTime - c.rateLimitUpdateTime);
+    }
+    double waitTime = 0;
+    for (int i = 0; i < c.rateLimitLength; i++) {
+        double tokens = c.rateLimitTokens[i];
+        // Tokens earned when the queue was empty are limited by the burst
+        if (idleTime > 0) {
+            tokens += idleTime * c.rateLimitRates[i];
+            if (tokens > c.rateLimitBursts[i]) {
+                tokens = c.rateLimitBursts[i];
+            }
+        }
+        if (jobSize > tokens) {
+            if (c.rateLimitRates[i] <= 0) {
+                return false;
+            }
+            waitTime = max(waitTime, (jobSize - tokens) / c.rateLimitRates[i]);
+        }
+    }
+    // Round up, so the tokens suffice by then
+    readyTime = updateTime + ((waitTime > 0) ? (ConvertSecondsToTime(waitTime) + 1) : 0);
+    return true;
+}
+
+// Add a backlogged client to the ready clients and, if not within rate limits, the rate limit timers.
+// Its rate limits are checked no earlier than minReadyTime, which is after the current time if they were just checked.
+// Assumes mutex held
+void Scheduler::Schedule(Client& c, uint64_t minReadyTime)
+{
+    if (c.pendingJobs.empty()) {
+        return;
+    }
+    Job* pJob = c.pendingJobs.front();
+    c.scheduleKey.immediate = pJob->Immediate();
+    c.scheduleKey.rateLimitObeyed = c.rateLimitObeyed;
+    c.scheduleKey.priority = c.rateLimitObeyed ? c.priority : 0;
+    c.scheduleKey.arrivalTime = pJob->ArrivalTime();
+    c.scheduleKey.s_addr = c.s_addr;
+    _readyClients.insert(c.scheduleKey);
+    if (!c.rateLimitObeyed && GetReadyTime(c, c.readyTime)) {
+        c.readyTime = max(c.readyTime, minReadyTime);
+        c.waitingForTokens = true;
+        _rateLimitTimers.insert(pair<uint64_t, unsigned long>(c.readyTime, c.s_addr));
+    }
+}
+
+// Remove a backlogged client from the ready clients and rate limit timers before its position changes.
+// Assumes mutex held
+void Scheduler::Unschedule(Client& c)
+{
+    if (c.pendingJobs.empty()) {
+        return;
+    }
+    _readyClients.erase(c.scheduleKey);
+    if (c.waitingForTokens) {
+        _rateLimitTimers.erase(pair<uint64_t, unsigned long>(c.readyTime, c.s_addr));
+        c.waitingForTokens = false;
+    }
+}
+
 // Add a job to the scheduler queue.
 // Assumes mutex held
 void Scheduler::AddJob(Job* pJob)
@@ -279,28 +538,78 @@ void Scheduler::AddJob(Job* pJob)
     pJob->arrivalTime = now;
     // Initialize job size
     pJob->jobSize = EstimateJobSize(c, pJob);
+    // Track arrivals for the client's r-b curve, which is updated once the mutex is released (see UpdateArrivalCurve)
+    pthread_mutex_lock(&c.arrivalsLock);
+    c.arrivals.push_back(make_pair(now, pJob->jobSize));
+    pthread_mutex_unlock(&c.arrivalsLock);
     // Initialize RPC client
     pJob->cl = NULL;
     // Update occupancy time
     if (c.pendingJobs.empty()) {
         c.lastOccupancyTime = now;
-        // Signal new job might be available
-        pthread_cond_signal(&_availableJobsCV);
     }
     // Add job to queue
     c.pendingJobs.push_back(pJob);
     _pendingJobCount++;
+    // Schedule client once it has a job
+    if (c.pendingJobs.size() == 1) {
+        Schedule(c, 0);
+    }
+}
+
+// Check if a pending job can be coalesced with a job being removed from the scheduler queue, i.e., if it continues the same file where the coalesced jobs end.
+// Assumes mutex held
+bool Scheduler::CanCoalesce(Job* pJob, Job* pNext)
+{
+    if ((pNext->Proc() != pJob->Proc()) || (pNext->Offset() != (pJob->Offset() + pJob->CoalescedSize()))) {
+        return false;
+    }
+    if ((pNext->ArrivalTime() - pJob->ArrivalTime()) > _coalesceWindow) {
+        return false;
+    }
+    const nfs_fh3& file = pJob->file;
+    const nfs_fh3& nextFile = pNext->file;
+    return (nextFile.data.data_len == file.data.data_len) && (memcmp(nextFile.data.data_val, file.data.data_val, file.data.data_len) == 0);
 }
 
-// Remove a job from the scheduler queue to submit it to storage.
+// Remove a job from the scheduler queue to submit it to storage, coalescing the client's contiguous jobs with it up to maxCoalescedBytes in total.
+// Jobs are only coalesced while the client's tokens suffice for the coalesced request, so rate limits are charged for the coalesced request.
 // Assumes mutex held
-Job* Scheduler::RemoveJob(Client& c)
+Job* Scheduler::RemoveJob(Client& c, int maxCoalescedBytes)
 {
     // Remove job from queue
     assert(!c.pendingJobs.empty());
+    Unschedule(c);
     Job* pJob = c.pendingJobs.front();
     c.pendingJobs.pop_front();
-    _pendingJobCount--;
+    pJob->coalescedNext = NULL;
+    pJob->coalescedSize = pJob->RequestSize();
+    pJob->coalescedJobs = NULL;
+    // Coalesce the following jobs
+    if (pJob->IsReadRequest() || pJob->IsWriteRequest()) {
+        Job* pLast = pJob;
+        while (!c.pendingJobs.empty() &&
+               ((pJob->CoalescedSize() + c.pendingJobs.front()->RequestSize()) <= maxCoalescedBytes) &&
+               CanCoalesce(pJob, c.pendingJobs.front())) {
+            Job* pNext = c.pendingJobs.front();
+            double jobSize = _pEst->estimateWork(pJob->CoalescedSize() + pNext->RequestSize(), pJob->IsReadRequest());
+            bool tokensSuffice = true;
+            for (int i = 0; (i < c.rateLimitLength) && c.rateLimitObeyed; i++) {
+                if (jobSize > c.rateLimitTokens[i]) {
+                    tokensSuffice = false;
+                }
+            }
+            if (!tokensSuffice) {
+                break;
+            }
+            c.pendingJobs.pop_front();
+            pNext->coalescedNext = NULL;
+            pLast->coalescedNext = pNext;
+            pLast = pNext;
+            pJob->coalescedSize += pNext->RequestSize();
+            pJob->jobSize = jobSize;
+        }
+    }
     uint64_t now = GetTime();
     // Update occupancy
     if (c.pendingJobs.empty()) {
@@ -308,7 +617,24 @@ Job* Scheduler::RemoveJob(Client& c)
     }
     // Update estimator history
     assert(pJob->jobSize >= 0);
-    pJob->rateLimitObeyed = c.rateLimitObeyed;
+    for (Job* pCoalesced = pJob; pCoalesced != NULL; pCoalesced = pCoalesced->coalescedNext) {
+        _pendingJobCount--;
+        __sync_fetch_and_sub(&c.numPendingJobs, 1);
+        pCoalesced->rateLimitObeyed = c.rateLimitObeyed;
+        // Record queueing delay and how the job was dispatched
+        pCoalesced->dispatchTime = now;
+        pCoalesced->serviceEndTime = 0;
+        if (pCoalesced->IsReadRequest()) {
+            c.stats->readQueueTime.record(now - pCoalesced->ArrivalTime());
+        } else if (pCoalesced->IsWriteRequest()) {
+            c.stats->writeQueueTime.record(now - pCoalesced->ArrivalTime());
+        }
+        if (pCoalesced->Immediate()) {
+            __sync_fetch_and_add(&c.stats->immediateJobs, 1);
+        } else if (!c.rateLimitObeyed) {
+            __sync_fetch_and_add(&c.stats->rateLimitExceededJobs, 1);
+        }
+    }
     // Decrement token buckets by usage
     for (int i = 0; i < c.rateLimitLength; i++) {
         c.rateLimitTokens[i] -= pJob->JobSize();
@@ -319,40 +645,60 @@ Job* Scheduler::RemoveJob(Client& c)
     }
     // Clear rate limit flag (will be rechecked next UpdateTokens)
     c.rateLimitObeyed = false;
+    // Schedule client's next job
+    Schedule(c, 0);
     return pJob;
 }
 
 // Find the best client to schedule next.
+// Only the rate limits of the clients whose tokens may suffice by now are checked, so finding the client takes O(log n) time for n backlogged clients,
+// and the order is the same as checking the rate limits of all clients.
 // Assumes mutex held
+// Assumes there are pending jobs
 Client& Scheduler::FindBestClient()
 {
     uint64_t now = GetTime();
-    // Loop through clients and find the best client
-    map<unsigned long, Client>::iterator bestClientIt = _clients.begin();
-    for (map<unsigned long, Client>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
-        // Update token buckets
-        UpdateTokens(it->second, now);
-        // Compare against best client
-        if (CompareClient(it->second, bestClientIt->second) > 0) {
-            bestClientIt = it;
-        }
+    // Check rate limits of clients whose tokens suffice by now
+    while (!_rateLimitTimers.empty() && (_rateLimitTimers.begin()->first <= now)) {
+        Client& c = _clients[_rateLimitTimers.begin()->second];
+        Unschedule(c);
+        UpdateTokens(c, now);
+        Schedule(c, now + 1);
+    }
+    assert(!_readyClients.empty());
+    Client& c = _clients[_readyClients.begin()->s_addr];
+    // Bring the token buckets of a client that is not within rate limits up to date, since RemoveJob limits its tokens at 0
+    if (!c.rateLimitObeyed) {
+        AccumulateTokens(c, now);
     }
-    return bestClientIt->second;
+    return c;
+}
+
+// Get the max bytes of a coalesced request that the bytes limits leave room for.
+static int CoalescingBudget(int maxCoalescedBytes, int outstandingBytes, int maxOutstandingBytes, uint64_t seqNumBytes, uint64_t oldestHigherPrioritySeqNumBytes)
+{
+    // Jobs are only dispatched if they stay below the limits
+    int64_t budget = min((int64_t)maxOutstandingBytes - outstandingBytes, (int64_t)(oldestHigherPrioritySeqNumBytes - seqNumBytes) + maxOutstandingBytes) - 1;
+    return (int)max((int64_t)0, min((int64_t)maxCoalescedBytes, budget));
 }
 
 // Try to schedule next job.
 // Assumes mutex held
 Job* Scheduler::ScheduleJob()
 {
+    // Add jobs submitted since the last time
+    AddSubmittedJobs();
     // Check if there are pending jobs
     if (_pendingJobCount > 0) {
         // Check if we are out of clients
-        if (_RPCAvailableClients.empty()) {
+        if (_requireRPCClients && _RPCAvailableClients.empty()) {
             return NULL;
         }
         Client& c = FindBestClient();
         Job* pJob = c.pendingJobs.front();
-        assert(_outstandingJobs <= _maxOutstandingJobs);
+        int maxCoalescedBytes = 0;
+        // Lowering the MPLs may leave more jobs outstanding than the maximum until they complete
+        assert((_outstandingJobs <= _maxOutstandingJobs) || (_readController != NULL));
         // Immediate jobs get to increase the maximum number of outstanding jobs
         if (pJob->Immediate()) {
             _maxOutstandingJobs++;
@@ -363,53 +709,53 @@ Job* Scheduler::ScheduleJob()
             }
             if (pJob->IsReadRequest()) {
                 // Check if too many outstanding read jobs/bytes
-                if (_outstandingReadJobs >= _maxOutstandingReadJobs) {
-                    return NULL;
-                } else if ((_outstandingReadBytes + pJob->RequestSize()) >= _maxOutstandingReadBytes) {
+                if ((_outstandingReadJobs >= _maxOutstandingReadJobs) ||
+                    ((_outstandingReadBytes + pJob->RequestSize()) >= _maxOutstandingReadBytes)) {
+                    if (_readController != NULL) {
+                        _readController->limited();
+                    }
                     return NULL;
                 }
                 // Ensure that higher priority jobs are not being starved by low priority jobs
                 uint64_t oldestHigherPrioritySeqNumRead = _seqNumRead;
                 uint64_t oldestHigherPrioritySeqNumReadBytes = _seqNumReadBytes;
-                // Assumes list is sorted by oldest request
-                for (list<Job*>::iterator it = _outstandingPriorityList.begin(); it != _outstandingPriorityList.end(); it++) {
-                    if ((*it)->priority < c.priority) {
-                        oldestHigherPrioritySeqNumRead = (*it)->seqNumRead;
-                        oldestHigherPrioritySeqNumReadBytes = (*it)->seqNumReadBytes;
-                        break;
-                    }
+                Job* pOldestHigherPriority = FindOldestHigherPriority(c.priority);
+                if (pOldestHigherPriority != NULL) {
+                    oldestHigherPrioritySeqNumRead = pOldestHigherPriority->seqNumRead;
+                    oldestHigherPrioritySeqNumReadBytes = pOldestHigherPriority->seqNumReadBytes;
                 }
                 if (_seqNumRead > (oldestHigherPrioritySeqNumRead + _maxOutstandingReadJobs)) {
                     return NULL;
                 } else if ((_seqNumReadBytes + pJob->RequestSize()) >= (oldestHigherPrioritySeqNumReadBytes + _maxOutstandingReadBytes)) {
                     return NULL;
                 }
+                maxCoalescedBytes = CoalescingBudget(_maxCoalescedBytes, _outstandingReadBytes, _maxOutstandingReadBytes, _seqNumReadBytes, oldestHigherPrioritySeqNumReadBytes);
             } else if (pJob->IsWriteRequest()) {
                 // Check if too many outstanding write jobs/bytes
-                if (_outstandingWriteJobs >= _maxOutstandingWriteJobs) {
-                    return NULL;
-                } else if ((_outstandingWriteBytes + pJob->RequestSize()) >= _maxOutstandingWriteBytes) {
+                if ((_outstandingWriteJobs >= _maxOutstandingWriteJobs) ||
+                    ((_outstandingWriteBytes + pJob->RequestSize()) >= _maxOutstandingWriteBytes)) {
+                    if (_writeController != NULL) {
+                        _writeController->limited();
+                    }
                     return NULL;
                 }
                 // Ensure that higher priority jobs are not being starved by low priority jobs
                 uint64_t oldestHigherPrioritySeqNumWrite = _seqNumWrite;
                 uint64_t oldestHigherPrioritySeqNumWriteBytes = _seqNumWriteBytes;
-                // Assumes list is sorted by oldest request
-                for (list<Job*>::iterator it = _outstandingPriorityList.begin(); it != _outstandingPriorityList.end(); it++) {
-                    if ((*it)->priority < c.priority) {
-                        oldestHigherPrioritySeqNumWrite = (*it)->seqNumWrite;
-                        oldestHigherPrioritySeqNumWriteBytes = (*it)->seqNumWriteBytes;
-                        break;
-                    }
+                Job* pOldestHigherPriority = FindOldestHigherPriority(c.priority);
+                if (pOldestHigherPriority != NULL) {
+                    oldestHigherPrioritySeqNumWrite = pOldestHigherPriority->seqNumWrite;
+                    oldestHigherPrioritySeqNumWriteBytes = pOldestHigherPriority->seqNumWriteBytes;
                 }
                 if (_seqNumWrite > (oldestHigherPrioritySeqNumWrite + _maxOutstandingWriteJobs)) {
                     return NULL;
                 } else if ((_seqNumWriteBytes + pJob->RequestSize()) >= (oldestHigherPrioritySeqNumWriteBytes + _maxOutstandingWriteBytes)) {
                     return NULL;
                 }
+                maxCoalescedBytes = CoalescingBudget(_maxCoalescedBytes, _outstandingWriteBytes, _maxOutstandingWriteBytes, _seqNumWriteBytes, oldestHigherPrioritySeqNumWriteBytes);
             }
         }
-        pJob = RemoveJob(c);
+        pJob = RemoveJob(c, maxCoalescedBytes);
         // Track outstanding priority (only for requests that obey rate limit)
         pJob->priority = c.priority;
         pJob->seqNumRead = _seqNumRead;
@@ -418,39 +764,156 @@ Job* Scheduler::ScheduleJob()
         pJob->seqNumWriteBytes = _seqNumWriteBytes;
         if (pJob->IsReadRequest()) {
             _seqNumRead++;
-            _seqNumReadBytes += pJob->RequestSize();
+            _seqNumReadBytes += pJob->CoalescedSize();
         } else if (pJob->IsWriteRequest()) {
             _seqNumWrite++;
-            _seqNumWriteBytes += pJob->RequestSize();
+            _seqNumWriteBytes += pJob->CoalescedSize();
         }
         if (pJob->rateLimitObeyed) {
-            _outstandingPriorityList.push_back(pJob);
+            AddOutstandingPriority(pJob);
         }
         // Release job for execution
-        pJob->cl = _RPCAvailableClients.back();
-        _RPCAvailableClients.pop_back();
+        if (_requireRPCClients) {
+            pJob->cl = _RPCAvailableClients.back();
+            _RPCAvailableClients.pop_back();
+        }
         _outstandingJobs++;
         if (pJob->IsReadRequest()) {
             _outstandingReadJobs++;
-            _outstandingReadBytes += pJob->RequestSize();
+            _outstandingReadBytes += pJob->CoalescedSize();
         } else if (pJob->IsWriteRequest()) {
             _outstandingWriteJobs++;
-            _outstandingWriteBytes += pJob->RequestSize();
+            _outstandingWriteBytes += pJob->CoalescedSize();
         }
 	return pJob;
     }
     return NULL;
 }
 
+// Add job to outstanding priority list.
+// Assumes mutex held
+void Scheduler::AddOutstandingPriority(Job* pJob)
+{
+    map<unsigned int, OutstandingJobList>::iterator it = _outstandingPriorities.find(pJob->priority);
+    pJob->outstandingNext = NULL;
+    if (it == _outstandingPriorities.end()) {
+        OutstandingJobList& jobs = _outstandingPriorities[pJob->priority];
+        pJob->outstandingPrev = NULL;
+        jobs.head = pJob;
+        jobs.tail = pJob;
+    } else {
+        OutstandingJobList& jobs = it->second;
+        pJob->outstandingPrev = jobs.tail;
+        jobs.tail->outstandingNext = pJob;
+        jobs.tail = pJob;
+    }
+}
+
 // Remove job from outstanding priority list.
+// Assumes mutex held
 void Scheduler::RemoveOutstandingPriority(Job* pJob)
 {
-    for (list<Job*>::iterator it = _outstandingPriorityList.begin(); it != _outstandingPriorityList.end(); it++) {
-        if (*it == pJob) {
-            _outstandingPriorityList.erase(it);
-            break;
+    map<unsigned int, OutstandingJobList>::iterator it = _outstandingPriorities.find(pJob->priority);
+    assert(it != _outstandingPriorities.end());
+    OutstandingJobList& jobs = it->second;
+    if (pJob->outstandingPrev == NULL) {
+        assert(jobs.head == pJob);
+        jobs.head = pJob->outstandingNext;
+    } else {
+        pJob->outstandingPrev->outstandingNext = pJob->outstandingNext;
+    }
+    if (pJob->outstandingNext == NULL) {
+        assert(jobs.tail == pJob);
+        jobs.tail = pJob->outstandingPrev;
+    } else {
+        pJob->outstandingNext->outstandingPrev = pJob->outstandingPrev;
+    }
+    // Only keep priorities with outstanding jobs
+    if (jobs.head == NULL) {
+        _outstandingPriorities.erase(it);
+    }
+}
+
+// Find the oldest outstanding job with higher priority (i.e., lower priority number), or NULL if there is none.
+// Jobs are scheduled in order of their read and write sequence numbers, so the oldest job is the list head with the lowest sequence numbers.
+// Jobs with the same read and write sequence numbers also have the same byte sequence numbers, so any of them gives the same result.
+// Assumes mutex held
+Job* Scheduler::FindOldestHigherPriority(unsigned int priority)
+{
+    Job* pOldest = NULL;
+    for (map<unsigned int, OutstandingJobList>::const_iterator it = _outstandingPriorities.begin(); (it != _outstandingPriorities.end()) && (it->first < priority); it++) {
+        Job* pJob = it->second.head;
+        if ((pOldest == NULL) ||
+            (pJob->seqNumRead < pOldest->seqNumRead) ||
+            ((pJob->seqNumRead == pOldest->seqNumRead) && (pJob->seqNumWrite < pOldest->seqNumWrite))) {
+            pOldest = pJob;
         }
     }
+    return pOldest;
+}
+
+// Scale a bytes limit with the MPL, so the bytes per concurrent job stay as configured.
+static int ScaleBytesLimit(int configuredBytes, int configuredMPL, int mpl)
+{
+    int64_t bytes = (configuredMPL > 0) ? ((int64_t)configuredBytes * mpl / configuredMPL) : configuredBytes;
+    return (int)min(bytes, (int64_t)INT_MAX);
+}
+
+// Apply the MPLs from the MPL controllers.
+// Assumes mutex held
+void Scheduler::UpdateConcurrency(uint64_t now)
+{
+    int readMPL = _readController->update(now);
+    int writeMPL = _writeController->update(now);
+    // The total includes the extra slots of outstanding immediate jobs, so only adjust it by the change
+    _maxOutstandingJobs += (readMPL - _maxOutstandingReadJobs) + (writeMPL - _maxOutstandingWriteJobs);
+    _maxOutstandingReadJobs = readMPL;
+    _maxOutstandingWriteJobs = writeMPL;
+    _maxOutstandingReadBytes = ScaleBytesLimit(_configuredReadBytes, _configuredReadMPL, readMPL);
+    _maxOutstandingWriteBytes = ScaleBytesLimit(_configuredWriteBytes, _configuredWriteMPL, writeMPL);
+    _nextControlTime = now + _controlInterval;
+}
+
+// Adjust the read/write MPLs online, between the bounds in the parameters, every interval seconds.
+void Scheduler::EnableAdaptiveConcurrency(const ConcurrencyControllerParams& readParams, const ConcurrencyControllerParams& writeParams, double interval)
+{
+    // Request ownership of the mutex
+    pthread_mutex_lock(&_schedulerMutex);
+    uint64_t now = GetTime();
+    delete _readController;
+    delete _writeController;
+    _readController = new ConcurrencyController(readParams, _configuredReadMPL, now);
+    _writeController = new ConcurrencyController(writeParams, _configuredWriteMPL, now);
+    _controlInterval = ConvertSecondsToTime(interval);
+    // Apply the initial MPLs, which are the configured MPLs within the bounds
+    UpdateConcurrency(now);
+    // Release ownership of the mutex
+    pthread_mutex_unlock(&_schedulerMutex);
+}
+
+// Coalesce a client's contiguous READ/WRITE jobs that arrived within window seconds of each other, up to maxBytes in total.
+void Scheduler::EnableCoalescing(double window, int maxBytes)
+{
+    // Request ownership of the mutex
+    pthread_mutex_lock(&_schedulerMutex);
+    _coalesceWindow = ConvertSecondsToTime(window);
+    _maxCoalescedBytes = maxBytes;
+    // Release ownership of the mutex
+    pthread_mutex_unlock(&_schedulerMutex);
+}
+
+// Get the current read/write MPLs and bytes limits.
+void Scheduler::GetConcurrency(bool& adaptive, int& readMPL, int& writeMPL, int& maxOutstandingReadBytes, int& maxOutstandingWriteBytes)
+{
+    // Request ownership of the mutex
+    pthread_mutex_lock(&_schedulerMutex);
+    adaptive = (_readController != NULL);
+    readMPL = _maxOutstandingReadJobs;
+    writeMPL = _maxOutstandingWriteJobs;
+    maxOutstandingReadBytes = _maxOutstandingReadBytes;
+    maxOutstandingWriteBytes = _maxOutstandingWriteBytes;
+    // Release ownership of the mutex
+    pthread_mutex_unlock(&_schedulerMutex);
 }
 
 // Keep NFS RPC clients alive via periodic NULL requests.
@@ -486,8 +949,11 @@ void* KeepAliveThread(void* ptr)
     return NULL;
 }
 
-Scheduler::Scheduler(vector<CLIENT*> RPCClients, int maxOutstandingReadBytes, int maxOutstandingWriteBytes, int maxReadJobs, int maxWriteJobs, Estimator* pEst)
-    : _RPCAvailableClients(RPCClients),
+Scheduler::Scheduler(vector<CLIENT*> RPCClients, int maxOutstandingReadBytes, int maxOutstandingWriteBytes, int maxReadJobs, int maxWriteJobs, Estimator* pEst, double arrivalCurveWindow)
+    : _numWaitingWorkers(0),
+      _submittedJobs(NULL),
+      _RPCAvailableClients(RPCClients),
+      _requireRPCClients(!RPCClients.empty()),
       _seqNumRead(0),
       _seqNumWrite(0),
       _seqNumReadBytes(0),
@@ -502,12 +968,24 @@ Scheduler::Scheduler(vector<CLIENT*> RPCClients, int maxOutstandingReadBytes, in
       _maxOutstandingReadJobs(maxReadJobs),
       _outstandingWriteJobs(0),
       _maxOutstandingWriteJobs(maxWriteJobs),
+      _configuredReadMPL(maxReadJobs),
+      _configuredWriteMPL(maxWriteJobs),
+      _configuredReadBytes(maxOutstandingReadBytes),
+      _configuredWriteBytes(maxOutstandingWriteBytes),
+      _readController(NULL),
+      _writeController(NULL),
+      _controlInterval(0),
+      _nextControlTime(0),
+      _coalesceWindow(0),
+      _maxCoalescedBytes(0),
       _pendingJobCount(0),
       _pEst(pEst),
+      _arrivalCurveWindow(arrivalCurveWindow),
       _keepAlive(true)
 {
     pthread_mutex_init(&_schedulerMutex, NULL);
     pthread_cond_init(&_availableJobsCV, NULL);
+    pthread_rwlock_init(&_clientsLock, NULL);
     // Create keepalive thread
     pthread_attr_t attr;
     pthread_attr_init(&attr);
@@ -530,6 +1008,20 @@ Scheduler::~Scheduler()
         cerr << "Error joining thread: " << rc << " errno: " << errno << endl;
         exit(-1);
     }
+    delete _readController;
+    delete _writeController;
+    // Free clients
+    for (map<unsigned long, Client>::iterator it = _clients.begin(); it != _clients.end(); it++) {
+        Client& c = it->second;
+        delete[] c.rateLimitRates;
+        delete[] c.rateLimitBursts;
+        delete[] c.rateLimitTokens;
+        delete c.arrivalCurve;
+        delete c.stats;
+        pthread_mutex_destroy(&c.arrivalCurveLock);
+        pthread_mutex_destroy(&c.arrivalsLock);
+    }
+    pthread_rwlock_destroy(&_clientsLock);
     pthread_cond_destroy(&_availableJobsCV);
     pthread_mutex_destroy(&_schedulerMutex);
 }
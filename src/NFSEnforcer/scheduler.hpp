@@ -9,11 +9,17 @@
 
 #include <list>
 #include <map>
+#include <set>
 #include <vector>
+#include <utility>
 #include <stdint.h>
 #include <rpc/rpc.h>
 #include <json/json.h>
 #include "../Estimator/Estimator.hpp"
+#include "../DNC-Library/SlidingArrivalCurve.hpp"
+#include "BufferPool.hpp"
+#include "LatencyHistogram.hpp"
+#include "ConcurrencyController.hpp"
 #include "../prot/nfs3_prot.h"
 
 using namespace std;
@@ -83,6 +89,8 @@ public:
     nfs_fh3 file;
     // Scheduler parameters
     uint64_t arrivalTime;
+    uint64_t dispatchTime; // time the job was removed from the scheduler queue
+    uint64_t serviceEndTime; // time NFS replied, or 0 if not known
     double jobSize;
     bool rateLimitObeyed;
     unsigned int priority;
@@ -90,6 +98,16 @@ public:
     uint64_t seqNumWrite;
     uint64_t seqNumReadBytes;
     uint64_t seqNumWriteBytes;
+    Job* outstandingPrev; // links in the scheduler's list of outstanding jobs with the same priority
+    Job* outstandingNext;
+    Job* submittedNext; // link in the scheduler's list of submitted jobs
+    // Coalescing of contiguous READ/WRITE jobs, which are forwarded to NFS as one request
+    Job* coalescedNext; // next job coalesced with this job, in offset order
+    int coalescedSize; // total bytes of this job and the jobs coalesced with it
+    Job* coalescedJobs; // for the request merged from coalesced jobs, the first of the jobs
+    // Reply buffer of the AsyncForwarder that READ data was decoded into in place, or NULL
+    char* replyBuffer;
+    size_t replyBufferSize;
     CLIENT* cl;
 
     inline rpcproc_t Proc() { return rq_proc; }
@@ -105,16 +123,69 @@ public:
     inline bool IsReadRequest() { return (Proc() == NFSPROC3_READ); }
     inline bool IsWriteRequest() { return (Proc() == NFSPROC3_WRITE); }
     inline int RequestSize() { return requestSize; }
+    inline int CoalescedSize() { return coalescedSize; }
     inline uint64_t Offset() { return offset; }
     inline nfs_fh3 File() { return file; }
     inline uint64_t ArrivalTime() { return arrivalTime; }
     inline double JobSize() { return jobSize; }
     inline CLIENT* RPCClient() { return cl; }
+
+    // Jobs are allocated from a pool, since a job is allocated for every request
+    static void* operator new(size_t size);
+    static void operator delete(void* ptr);
+};
+
+// Position of a backlogged client in the order clients are scheduled.
+// Clients with an immediate job come first, then clients within their rate limits by priority, then the rest; ties are scheduled FCFS by their next job's arrival.
+struct ScheduleKey {
+    bool immediate; // next job is immediate
+    bool rateLimitObeyed;
+    unsigned int priority; // only applies when within rate limits, so it is 0 otherwise
+    uint64_t arrivalTime; // next job's arrival time
+    unsigned long s_addr; // ties are broken by client address
+
+    // Check if a client should be scheduled before another
+    bool operator<(const ScheduleKey& other) const;
+};
+
+// Telemetry of a client's jobs, which is updated atomically so that it is recorded and sampled without the mutex.
+// Latencies are in time units (see common/time.hpp).
+struct ClientStats {
+    LatencyHistogram readQueueTime; // from arrival in the scheduler queue until dispatch to NFS
+    LatencyHistogram readServiceTime; // from dispatch until NFS replies
+    LatencyHistogram readTotalTime; // from arrival until the job completes
+    LatencyHistogram writeQueueTime;
+    LatencyHistogram writeServiceTime;
+    LatencyHistogram writeTotalTime;
+    volatile uint64_t rateLimitExceededJobs; // jobs dispatched without enough tokens, i.e., best effort
+    volatile uint64_t immediateJobs; // jobs dispatched bypassing the MPL and rate limits
+    volatile uint64_t resetTime; // time of the last reset
+};
+
+// Sampled telemetry of a client's jobs
+struct ClientStatsSnapshot {
+    double interval; // seconds since the last reset
+    LatencyHistogramSnapshot readQueueTime;
+    LatencyHistogramSnapshot readServiceTime;
+    LatencyHistogramSnapshot readTotalTime;
+    LatencyHistogramSnapshot writeQueueTime;
+    LatencyHistogramSnapshot writeServiceTime;
+    LatencyHistogramSnapshot writeTotalTime;
+    uint64_t rateLimitExceededJobs;
+    uint64_t immediateJobs;
+};
+
+// Outstanding jobs with the same priority in the order they were scheduled, linked through the jobs.
+struct OutstandingJobList {
+    Job* head; // oldest job
+    Job* tail;
 };
 
 // A workload's (a.k.a. client) parameters.
 typedef struct {
+    unsigned long s_addr;
     list<Job*> pendingJobs;
+    volatile int numPendingJobs; // pending jobs including submitted jobs that have not been added to pendingJobs; updated atomically
     unsigned int priority;
     int rateLimitLength;
     double* rateLimitRates;
@@ -125,6 +196,14 @@ typedef struct {
     uint64_t occupancy;
     uint64_t lastOccupancyTime;
     uint64_t getOccupancyTime;
+    SlidingArrivalCurve* arrivalCurve; // protected by arrivalCurveLock instead of the mutex
+    pthread_mutex_t arrivalCurveLock; // serializes updates and queries of arrivalCurve
+    pthread_mutex_t arrivalsLock; // protects arrivals
+    vector<pair<uint64_t, double> > arrivals; // arrival times and sizes of the jobs added since arrivalCurve was last updated
+    ScheduleKey scheduleKey; // position in the scheduler's ready clients while pendingJobs is non-empty
+    bool waitingForTokens; // whether the client is in the scheduler's rate limit timers
+    uint64_t readyTime; // time in the rate limit timers when the client's tokens suffice for its next job
+    ClientStats* stats;
 } Client;
 
 // Scheduler for NFS requests that queues each workload separately and prioritizes and rate limits workloads.
@@ -135,10 +214,20 @@ private:
     pthread_mutex_t _schedulerMutex;
     // Available jobs condition variable
     pthread_cond_t _availableJobsCV;
+    // Number of workers waiting on _availableJobsCV; updated atomically so submitters only lock the mutex if a worker needs to be woken
+    volatile int _numWaitingWorkers;
+    // Jobs submitted since the last time the dispatch side added them to the client queues, most recent first
+    // Submitters push onto the list without the mutex, and the list is drained all at once with the mutex held
+    Job* volatile _submittedJobs;
+    // Protects the structure of _clients, so clients can be looked up without the mutex
+    // Clients are only inserted with both held, and are never removed
+    pthread_rwlock_t _clientsLock;
     // RPC client pool
     vector<CLIENT*> _RPCAvailableClients;
-    // Track outstanding jobs
-    list<Job*> _outstandingPriorityList;
+    // Jobs are only assigned RPC clients if the scheduler was created with RPC clients; otherwise jobs are forwarded without them (see AsyncForwarder)
+    bool _requireRPCClients;
+    // Track outstanding jobs that obey rate limits by priority, so the oldest higher priority job is found without scanning all outstanding jobs
+    map<unsigned int, OutstandingJobList> _outstandingPriorities;
     uint64_t _seqNumRead;
     uint64_t _seqNumWrite;
     uint64_t _seqNumReadBytes;
@@ -153,38 +242,78 @@ private:
     int _maxOutstandingReadJobs;
     int _outstandingWriteJobs;
     int _maxOutstandingWriteJobs;
+    // Configured limits; if the MPLs are adjusted, the bytes limits are scaled with them
+    int _configuredReadMPL;
+    int _configuredWriteMPL;
+    int _configuredReadBytes;
+    int _configuredWriteBytes;
+    // MPL controllers, or NULL if the MPLs are static
+    ConcurrencyController* _readController;
+    ConcurrencyController* _writeController;
+    uint64_t _controlInterval;
+    uint64_t _nextControlTime;
+    // Coalescing of a client's contiguous READ/WRITE jobs that arrived within _coalesceWindow of each other, up to _maxCoalescedBytes; disabled if 0
+    uint64_t _coalesceWindow;
+    int _maxCoalescedBytes;
     // Total number of pending jobs
     int _pendingJobCount;
     // Array of clients
     map<unsigned long, Client> _clients;
+    // Backlogged clients in the order they are scheduled, so idle clients are not considered
+    set<ScheduleKey> _readyClients;
+    // Backlogged clients that are not within rate limits by the time their tokens suffice for their next job, so their rate limits are only checked once they may be obeyed
+    set<pair<uint64_t, unsigned long> > _rateLimitTimers;
     // Storage estimator
     Estimator* _pEst;
+    // Duration in seconds of the window over which client r-b curves are tracked
+    double _arrivalCurveWindow;
     // Keep Alive
     pthread_t _keepAliveThread;
     bool _keepAlive;
 
     // Returns job size estimate.
     double EstimateJobSize(Client& c, Job* job);
-    // Compares two clients to see which should be scheduled.
-    // Assumes UpdateTokens has been called to update rateLimitObeyed flags.
-    int CompareClient(const Client& c1, const Client& c2);
     // Get a client, possibly creating a new client.
     Client& GetClient(unsigned long s_addr);
+    // Look up a client without the mutex, or NULL if the client does not exist.
+    Client* LookupClient(unsigned long s_addr);
+    // Add submitted jobs to the client queues.
+    void AddSubmittedJobs();
+    // Wake a worker waiting for jobs, if any.
+    void WakeWorker();
+    // Add the tokens earned since the last update to token buckets.
+    void AccumulateTokens(Client& c, uint64_t now);
     // Update token buckets in order to check rate limits.
     void UpdateTokens(Client& c, uint64_t now);
+    // Get the time when a backlogged client's tokens suffice for its next job without updating token buckets; returns false if they never do.
+    bool GetReadyTime(const Client& c, uint64_t& readyTime);
+    // Add a backlogged client to the ready clients and, if not within rate limits, the rate limit timers, checking its rate limits no earlier than minReadyTime.
+    void Schedule(Client& c, uint64_t minReadyTime);
+    // Remove a backlogged client from the ready clients and rate limit timers before its position changes.
+    void Unschedule(Client& c);
+    // Update a client's r-b curve with the jobs added since the last update, without the mutex.
+    void UpdateArrivalCurve(Client& c);
     // Add a job to the scheduler queue.
     void AddJob(Job* pJob);
-    // Remove a job from the scheduler queue to submit it to storage.
-    Job* RemoveJob(Client& c);
+    // Remove a job from the scheduler queue to submit it to storage, coalescing the client's contiguous jobs with it up to maxCoalescedBytes in total.
+    Job* RemoveJob(Client& c, int maxCoalescedBytes);
+    // Check if a pending job can be coalesced with a job being removed from the scheduler queue.
+    bool CanCoalesce(Job* pJob, Job* pNext);
     // Find the best client to schedule next.
     Client& FindBestClient();
     // Try to schedule next job.
     Job* ScheduleJob();
+    // Add job to outstanding priority list.
+    void AddOutstandingPriority(Job* pJob);
     // Remove job from outstanding priority list.
     void RemoveOutstandingPriority(Job* pJob);
+    // Find the oldest outstanding job with higher priority (i.e., lower priority number), or NULL if there is none.
+    Job* FindOldestHigherPriority(unsigned int priority);
+    // Apply the MPLs from the MPL controllers.
+    void UpdateConcurrency(uint64_t now);
 
 public:
-    Scheduler(vector<CLIENT*> RPCClients, int maxOutstandingReadBytes, int maxOutstandingWriteBytes, int maxReadJobs, int maxWriteJobs, Estimator* pEst);
+    Scheduler(vector<CLIENT*> RPCClients, int maxOutstandingReadBytes, int maxOutstandingWriteBytes, int maxReadJobs, int maxWriteJobs, Estimator* pEst, double arrivalCurveWindow = 60);
     ~Scheduler();
     // Update client parameters.
     void UpdateClient(unsigned long s_addr, unsigned int priority, int rateLimitLength, double* rateLimitRates, double* rateLimitBursts);
@@ -192,13 +321,23 @@ public:
     double GetOccupancy(unsigned long s_addr);
     // Return number of pending jobs for a client.
     int GetNumPendingJobs(unsigned long s_addr);
+    // Get the r-b curve of a client's requests over the recent window; rates are decreasing, and empty if the client has not sent requests or been updated.
+    void GetRbCurve(unsigned long s_addr, vector<double>& rates, vector<double>& bursts);
+    // Sample the telemetry of a client's jobs, and optionally reset it; returns false if the client has not sent requests or been updated.
+    bool GetStats(unsigned long s_addr, bool reset, ClientStatsSnapshot& snapshot);
     // Submit job to scheduler queue.
     void SubmitJob(Job* pJob);
     // Get the next job to send to storage.
     Job* GetNextJob();
     // Indicate job is completed.
     void CompleteJob(Job* pJob);
-    // Return NFS RPC client resources once a job completes.
+    // Adjust the read/write MPLs online, between the bounds in the parameters, every interval seconds.
+    void EnableAdaptiveConcurrency(const ConcurrencyControllerParams& readParams, const ConcurrencyControllerParams& writeParams, double interval);
+    // Coalesce a client's contiguous READ/WRITE jobs that arrived within window seconds of each other, up to maxBytes in total.
+    void EnableCoalescing(double window, int maxBytes);
+    // Get the current read/write MPLs and bytes limits; adaptive is true if they are adjusted online.
+    void GetConcurrency(bool& adaptive, int& readMPL, int& writeMPL, int& maxOutstandingReadBytes, int& maxOutstandingWriteBytes);
+    // Return NFS RPC client resources once a job completes; only needed if the job was assigned an RPC client.
     void ReturnClient(Job* pJob);
     // Keep NFS RPC clients alive via periodic NULL requests.
     bool KeepAlive();
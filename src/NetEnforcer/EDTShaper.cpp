@@ -0,0 +1,518 @@
+// EDTShaper.cpp - eBPF/EDT (earliest departure time) network traffic shaping.
+// The BPF program is assembled here rather than compiled from C so NetEnforcer does not depend on a BPF toolchain.
+// For the same reason, the BTF describing the flow map, which the kernel requires for the bpf_spin_lock in its values, is built here.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <map>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <arpa/inet.h>
+#include <linux/bpf.h>
+#include <linux/btf.h>
+#include <linux/pkt_cls.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include "EDTShaper.hpp"
+
+using namespace std;
+
+#define NS_PER_SEC 1000000000
+
+// Key of the flow map
+struct EDTFlowKey {
+    uint32_t dstAddr;
+    uint32_t srcAddr;
+};
+
+// GCRA token bucket
+struct EDTBucket {
+    uint64_t rate; // bytes per sec
+    uint64_t tolerance; // burst in ns at rate
+    uint64_t arrivalTime; // theoretical arrival time (TAT) of the next packet
+};
+
+// Value of the flow map; fields after the lock are 64 bits so the program accesses them uniformly
+struct EDTFlowState {
+    struct bpf_spin_lock lock; // protects the buckets' TATs and sentBytes while the program updates them
+    uint32_t skbPriority; // skb->priority of the packets, which selects their band in the prio qdiscs
+    uint64_t numBuckets;
+    // Mask and value for the first 16 bits of the IP header, which hold the TOS byte after the version/IHL byte, in memory order
+    uint64_t headerMask;
+    uint64_t headerValue;
+    uint64_t sentBytes;
+    EDTBucket buckets[EDT_MAX_BUCKETS];
+};
+
+// Minimal BPF assembler with labels for forward jumps
+class BPFAssembler
+{
+private:
+    vector<struct bpf_insn> _insns;
+    map<int, size_t> _labels;
+    vector<pair<size_t, int> > _jumps; // instruction index and target label
+
+    void emit(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm)
+    {
+        struct bpf_insn insn;
+        memset(&insn, 0, sizeof(insn));
+        insn.code = code;
+        insn.dst_reg = dst;
+        insn.src_reg = src;
+        insn.off = off;
+        insn.imm = imm;
+        _insns.push_back(insn);
+    }
+
+public:
+    void movImm(uint8_t dst, int32_t imm) { emit(BPF_ALU64 | BPF_MOV | BPF_K, dst, 0, 0, imm); }
+    void movReg(uint8_t dst, uint8_t src) { emit(BPF_ALU64 | BPF_MOV | BPF_X, dst, src, 0, 0); }
+    void aluImm(uint8_t op, uint8_t dst, int32_t imm) { emit(BPF_ALU64 | op | BPF_K, dst, 0, 0, imm); }
+    void aluReg(uint8_t op, uint8_t dst, uint8_t src) { emit(BPF_ALU64 | op | BPF_X, dst, src, 0, 0); }
+    void load(uint8_t size, uint8_t dst, uint8_t src, int16_t off) { emit(BPF_LDX | BPF_MEM | size, dst, src, off, 0); }
+    void store(uint8_t size, uint8_t dst, int16_t off, uint8_t src) { emit(BPF_STX | BPF_MEM | size, dst, src, off, 0); }
+    void loadMapFd(uint8_t dst, int fd)
+    {
+        emit(BPF_LD | BPF_DW | BPF_IMM, dst, BPF_PSEUDO_MAP_FD, 0, fd);
+        emit(0, 0, 0, 0, 0);
+    }
+    void call(int32_t func) { emit(BPF_JMP | BPF_CALL, 0, 0, 0, func); }
+    void exit() { emit(BPF_JMP | BPF_EXIT, 0, 0, 0, 0); }
+    void jumpImm(uint8_t op, uint8_t dst, int32_t imm, int label)
+    {
+        _jumps.push_back(make_pair(_insns.size(), label));
+        emit(BPF_JMP | op | BPF_K, dst, 0, 0, imm);
+    }
+    void jumpReg(uint8_t op, uint8_t dst, uint8_t src, int label)
+    {
+        _jumps.push_back(make_pair(_insns.size(), label));
+        emit(BPF_JMP | op | BPF_X, dst, src, 0, 0);
+    }
+    void setLabel(int label) { _labels[label] = _insns.size(); }
+
+    // Resolve jumps and return the program
+    const vector<struct bpf_insn>& finish()
+    {
+        for (vector<pair<size_t, int> >::const_iterator it = _jumps.begin(); it != _jumps.end(); ++it) {
+            _insns[it->first].off = _labels[it->second] - it->first - 1;
+        }
+        _jumps.clear();
+        return _insns;
+    }
+};
+
+// Minimal BTF encoder for the integer, struct, and array types of the flow map
+class BTFBuilder
+{
+private:
+    vector<uint32_t> _types; // encoded types, in words
+    string _strings;
+    uint32_t _numTypes;
+
+    uint32_t addString(const char* str)
+    {
+        uint32_t offset = _strings.size();
+        _strings.append(str, strlen(str) + 1);
+        return offset;
+    }
+
+    uint32_t addType(const char* name, uint32_t kind, uint32_t vlen, uint32_t sizeOrType)
+    {
+        _types.push_back((name != NULL) ? addString(name) : 0);
+        _types.push_back((kind << 24) | vlen);
+        _types.push_back(sizeOrType);
+        return ++_numTypes;
+    }
+
+public:
+    BTFBuilder() : _strings(1, '\0'), _numTypes(0) {}
+
+    // Each add returns the type's id
+    uint32_t addInt(const char* name, uint32_t size)
+    {
+        uint32_t id = addType(name, BTF_KIND_INT, 0, size);
+        _types.push_back(size * 8); // unsigned, at bit offset 0
+        return id;
+    }
+    uint32_t addArray(uint32_t type, uint32_t indexType, uint32_t numElems)
+    {
+        uint32_t id = addType(NULL, BTF_KIND_ARRAY, 0, 0);
+        _types.push_back(type);
+        _types.push_back(indexType);
+        _types.push_back(numElems);
+        return id;
+    }
+    // The struct's members must be added right after it
+    uint32_t addStruct(const char* name, uint32_t size, uint32_t numMembers) { return addType(name, BTF_KIND_STRUCT, numMembers, size); }
+    void addMember(const char* name, uint32_t type, size_t offset)
+    {
+        _types.push_back(addString(name));
+        _types.push_back(type);
+        _types.push_back(offset * 8); // in bits
+    }
+
+    // Load the BTF into the kernel, putting the kernel's log in log on failure; returns its fd, or -1 on failure
+    int load(char* log, size_t logSize) const
+    {
+        struct btf_header header;
+        memset(&header, 0, sizeof(header));
+        header.magic = BTF_MAGIC;
+        header.version = BTF_VERSION;
+        header.hdr_len = sizeof(header);
+        header.type_off = 0;
+        header.type_len = _types.size() * sizeof(uint32_t);
+        header.str_off = header.type_len;
+        header.str_len = _strings.size();
+        vector<char> data(sizeof(header) + header.type_len + header.str_len);
+        memcpy(&data[0], &header, sizeof(header));
+        memcpy(&data[sizeof(header)], &_types[0], header.type_len);
+        memcpy(&data[sizeof(header) + header.type_len], _strings.data(), header.str_len);
+        union bpf_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.btf = (uint64_t)(unsigned long)&data[0];
+        attr.btf_size = data.size();
+        attr.btf_log_buf = (uint64_t)(unsigned long)log;
+        attr.btf_log_size = logSize;
+        attr.btf_log_level = 1;
+        return syscall(__NR_bpf, BPF_BTF_LOAD, &attr, sizeof(attr));
+    }
+};
+
+static long bpf(int cmd, union bpf_attr* attr)
+{
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+#define BTF_MEMBER(btf, type, field, fieldType) btf.addMember(#field, fieldType, offsetof(type, field))
+
+EDTShaper::EDTShaper()
+{
+    // Describe the key and value of the flow map
+    BTFBuilder btf;
+    uint32_t u32 = btf.addInt("u32", sizeof(uint32_t));
+    uint32_t u64 = btf.addInt("u64", sizeof(uint64_t));
+    uint32_t lock = btf.addStruct("bpf_spin_lock", sizeof(struct bpf_spin_lock), 1);
+    BTF_MEMBER(btf, struct bpf_spin_lock, val, u32);
+    uint32_t key = btf.addStruct("edt_flow_key", sizeof(EDTFlowKey), 2);
+    BTF_MEMBER(btf, EDTFlowKey, dstAddr, u32);
+    BTF_MEMBER(btf, EDTFlowKey, srcAddr, u32);
+    uint32_t bucket = btf.addStruct("edt_bucket", sizeof(EDTBucket), 3);
+    BTF_MEMBER(btf, EDTBucket, rate, u64);
+    BTF_MEMBER(btf, EDTBucket, tolerance, u64);
+    BTF_MEMBER(btf, EDTBucket, arrivalTime, u64);
+    uint32_t buckets = btf.addArray(bucket, u32, EDT_MAX_BUCKETS);
+    uint32_t value = btf.addStruct("edt_flow_state", sizeof(EDTFlowState), 7);
+    BTF_MEMBER(btf, EDTFlowState, lock, lock);
+    BTF_MEMBER(btf, EDTFlowState, skbPriority, u32);
+    BTF_MEMBER(btf, EDTFlowState, numBuckets, u64);
+    BTF_MEMBER(btf, EDTFlowState, headerMask, u64);
+    BTF_MEMBER(btf, EDTFlowState, headerValue, u64);
+    BTF_MEMBER(btf, EDTFlowState, sentBytes, u64);
+    BTF_MEMBER(btf, EDTFlowState, buckets, buckets);
+    static char log[4096];
+    int btfFd = btf.load(log, sizeof(log));
+    if (btfFd < 0) {
+        cerr << "Failed to load BTF of BPF flow map: " << strerror(errno) << endl << log << endl;
+        exit(1);
+    }
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_HASH;
+    attr.key_size = sizeof(EDTFlowKey);
+    attr.value_size = sizeof(EDTFlowState);
+    attr.max_entries = EDT_MAX_FLOWS;
+    attr.map_flags = BPF_F_NO_PREALLOC;
+    attr.btf_fd = btfFd;
+    attr.btf_key_type_id = key;
+    attr.btf_value_type_id = value;
+    strncpy(attr.map_name, "edt_flows", sizeof(attr.map_name) - 1);
+    _mapFd = bpf(BPF_MAP_CREATE, &attr);
+    if (_mapFd < 0) {
+        cerr << "Failed to create BPF flow map: " << strerror(errno) << endl;
+        exit(1);
+    }
+    // The map keeps the BTF
+    close(btfFd);
+    loadProgram();
+}
+
+EDTShaper::~EDTShaper()
+{
+    close(_progFd);
+    close(_mapFd);
+}
+
+// Registers used by the program
+#define R0 BPF_REG_0 // return values
+#define R1 BPF_REG_1 // helper arguments and scratch after the last helper call
+#define R2 BPF_REG_2
+#define R3 BPF_REG_3
+#define R4 BPF_REG_4
+#define R5 BPF_REG_5
+#define R_SKB BPF_REG_6
+#define R_FLOW BPF_REG_7
+#define R_LEN BPF_REG_8
+#define R_NOW BPF_REG_9
+#define FP BPF_REG_10
+
+// Stack slots
+#define STACK_KEY -8 // EDTFlowKey
+#define STACK_HEADER -16 // first 16 bits of the IP header
+
+// Packet offsets, assuming an Ethernet header
+#define IP_HEADER_OFFSET ETH_HLEN
+#define IP_CHECK_OFFSET (ETH_HLEN + offsetof(struct iphdr, check))
+#define IP_SADDR_OFFSET (ETH_HLEN + offsetof(struct iphdr, saddr))
+#define IP_DADDR_OFFSET (ETH_HLEN + offsetof(struct iphdr, daddr))
+
+#define SKB_FIELD(field) ((int16_t)offsetof(struct __sk_buff, field))
+#define FLOW_FIELD(field) ((int16_t)offsetof(EDTFlowState, field))
+#define BUCKET_FIELD(i, field) ((int16_t)(offsetof(EDTFlowState, buckets) + ((i) * sizeof(EDTBucket)) + offsetof(EDTBucket, field)))
+
+enum {
+    LABEL_PASS,
+    LABEL_DROP,
+    LABEL_SHAPE,
+    LABEL_DEPARTURE_DONE,
+    LABEL_UPDATE_DONE,
+    LABEL_NEXT_BUCKET // one per bucket and pass
+};
+
+void EDTShaper::loadProgram()
+{
+    BPFAssembler as;
+    as.movReg(R_SKB, R1);
+    // Packets of other flows go to the best effort band
+    as.movImm(R2, 0);
+    as.store(BPF_W, R_SKB, SKB_FIELD(priority), R2);
+    // Only IPv4 packets are shaped
+    as.load(BPF_W, R2, R_SKB, SKB_FIELD(protocol));
+    as.jumpImm(BPF_JNE, R2, htons(ETH_P_IP), LABEL_PASS);
+    // Look up the flow by its dst/src addresses
+    as.movReg(R1, R_SKB);
+    as.movImm(R2, IP_DADDR_OFFSET);
+    as.movReg(R3, FP);
+    as.aluImm(BPF_ADD, R3, STACK_KEY + (int32_t)offsetof(EDTFlowKey, dstAddr));
+    as.movImm(R4, sizeof(uint32_t));
+    as.call(BPF_FUNC_skb_load_bytes);
+    as.jumpImm(BPF_JNE, R0, 0, LABEL_PASS);
+    as.movReg(R1, R_SKB);
+    as.movImm(R2, IP_SADDR_OFFSET);
+    as.movReg(R3, FP);
+    as.aluImm(BPF_ADD, R3, STACK_KEY + (int32_t)offsetof(EDTFlowKey, srcAddr));
+    as.movImm(R4, sizeof(uint32_t));
+    as.call(BPF_FUNC_skb_load_bytes);
+    as.jumpImm(BPF_JNE, R0, 0, LABEL_PASS);
+    as.loadMapFd(R1, _mapFd);
+    as.movReg(R2, FP);
+    as.aluImm(BPF_ADD, R2, STACK_KEY);
+    as.call(BPF_FUNC_map_lookup_elem);
+    as.jumpImm(BPF_JEQ, R0, 0, LABEL_PASS);
+    as.movReg(R_FLOW, R0);
+    as.load(BPF_W, R_LEN, R_SKB, SKB_FIELD(len));
+    as.load(BPF_W, R2, R_FLOW, FLOW_FIELD(skbPriority));
+    as.store(BPF_W, R_SKB, SKB_FIELD(priority), R2);
+    // Mark the DSCP flags, updating the IP checksum; R_NOW holds the original header bits until the marking is done
+    as.movReg(R1, R_SKB);
+    as.movImm(R2, IP_HEADER_OFFSET);
+    as.movReg(R3, FP);
+    as.aluImm(BPF_ADD, R3, STACK_HEADER);
+    as.movImm(R4, sizeof(uint16_t));
+    as.call(BPF_FUNC_skb_load_bytes);
+    as.jumpImm(BPF_JNE, R0, 0, LABEL_SHAPE);
+    as.load(BPF_H, R_NOW, FP, STACK_HEADER);
+    as.load(BPF_DW, R1, R_FLOW, FLOW_FIELD(headerMask));
+    as.aluReg(BPF_AND, R1, R_NOW);
+    as.load(BPF_DW, R2, R_FLOW, FLOW_FIELD(headerValue));
+    as.aluReg(BPF_OR, R1, R2);
+    as.jumpReg(BPF_JEQ, R1, R_NOW, LABEL_SHAPE);
+    as.store(BPF_H, FP, STACK_HEADER, R1);
+    as.movReg(R1, R_SKB);
+    as.movImm(R2, IP_HEADER_OFFSET);
+    as.movReg(R3, FP);
+    as.aluImm(BPF_ADD, R3, STACK_HEADER);
+    as.movImm(R4, sizeof(uint16_t));
+    as.movImm(R5, 0);
+    as.call(BPF_FUNC_skb_store_bytes);
+    as.jumpImm(BPF_JNE, R0, 0, LABEL_SHAPE);
+    as.movReg(R1, R_SKB);
+    as.movImm(R2, IP_CHECK_OFFSET);
+    as.movReg(R3, R_NOW);
+    as.load(BPF_H, R4, FP, STACK_HEADER);
+    as.movImm(R5, sizeof(uint16_t));
+    as.call(BPF_FUNC_l3_csum_replace);
+    // Compute the departure time in R0 as the latest time any bucket allows (i.e., TAT - tolerance), and at least now
+    // The TATs are read and advanced under the flow's lock, so packets of the flow on other CPUs see each other's transmission times
+    // No helpers other than the unlock may be called while the lock is held, so R1-R5 are scratch registers until then
+    as.setLabel(LABEL_SHAPE);
+    as.call(BPF_FUNC_ktime_get_ns);
+    as.movReg(R_NOW, R0);
+    as.movReg(R1, R_FLOW);
+    as.aluImm(BPF_ADD, R1, FLOW_FIELD(lock));
+    as.call(BPF_FUNC_spin_lock);
+    as.movReg(R0, R_NOW);
+    as.load(BPF_DW, R5, R_FLOW, FLOW_FIELD(numBuckets));
+    int nextLabel = LABEL_NEXT_BUCKET;
+    for (int i = 0; i < EDT_MAX_BUCKETS; i++) {
+        as.jumpImm(BPF_JLE, R5, i, LABEL_DEPARTURE_DONE);
+        as.load(BPF_DW, R1, R_FLOW, BUCKET_FIELD(i, arrivalTime));
+        as.load(BPF_DW, R2, R_FLOW, BUCKET_FIELD(i, tolerance));
+        as.jumpReg(BPF_JLE, R1, R2, nextLabel);
+        as.aluReg(BPF_SUB, R1, R2);
+        as.jumpReg(BPF_JLE, R1, R0, nextLabel);
+        as.movReg(R0, R1);
+        as.setLabel(nextLabel++);
+    }
+    as.setLabel(LABEL_DEPARTURE_DONE);
+    // Drop packets that would wait beyond the horizon
+    as.movReg(R1, R0);
+    as.aluReg(BPF_SUB, R1, R_NOW);
+    as.jumpImm(BPF_JGT, R1, EDT_DROP_HORIZON, LABEL_DROP);
+    // Advance each bucket's TAT from the departure time by the packet's transmission time at the bucket's rate
+    for (int i = 0; i < EDT_MAX_BUCKETS; i++) {
+        as.jumpImm(BPF_JLE, R5, i, LABEL_UPDATE_DONE);
+        as.load(BPF_DW, R1, R_FLOW, BUCKET_FIELD(i, arrivalTime));
+        as.jumpReg(BPF_JGE, R1, R0, nextLabel);
+        as.movReg(R1, R0);
+        as.setLabel(nextLabel++);
+        as.movReg(R2, R_LEN);
+        as.aluImm(BPF_MUL, R2, NS_PER_SEC);
+        as.load(BPF_DW, R3, R_FLOW, BUCKET_FIELD(i, rate));
+        as.aluReg(BPF_DIV, R2, R3);
+        as.aluReg(BPF_ADD, R1, R2);
+        as.store(BPF_DW, R_FLOW, BUCKET_FIELD(i, arrivalTime), R1);
+    }
+    as.setLabel(LABEL_UPDATE_DONE);
+    as.load(BPF_DW, R1, R_FLOW, FLOW_FIELD(sentBytes));
+    as.aluReg(BPF_ADD, R1, R_LEN);
+    as.store(BPF_DW, R_FLOW, FLOW_FIELD(sentBytes), R1);
+    // Keep the departure time in R_LEN across the unlock
+    as.movReg(R_LEN, R0);
+    as.movReg(R1, R_FLOW);
+    as.aluImm(BPF_ADD, R1, FLOW_FIELD(lock));
+    as.call(BPF_FUNC_spin_unlock);
+    // Delay the packet if it cannot depart now
+    as.jumpReg(BPF_JLE, R_LEN, R_NOW, LABEL_PASS);
+    as.store(BPF_DW, R_SKB, SKB_FIELD(tstamp), R_LEN);
+    as.setLabel(LABEL_PASS);
+    as.movImm(R0, TC_ACT_OK);
+    as.exit();
+    as.setLabel(LABEL_DROP);
+    as.movReg(R1, R_FLOW);
+    as.aluImm(BPF_ADD, R1, FLOW_FIELD(lock));
+    as.call(BPF_FUNC_spin_unlock);
+    as.movImm(R0, TC_ACT_SHOT);
+    as.exit();
+    const vector<struct bpf_insn>& insns = as.finish();
+
+    // Load the program, printing the verifier's log on failure
+    static char log[64 * 1024];
+    const char* license = "Dual MIT/GPL";
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_SCHED_CLS;
+    attr.insns = (uint64_t)(unsigned long)&insns[0];
+    attr.insn_cnt = insns.size();
+    attr.license = (uint64_t)(unsigned long)license;
+    attr.log_buf = (uint64_t)(unsigned long)log;
+    attr.log_size = sizeof(log);
+    attr.log_level = 1;
+    strncpy(attr.prog_name, "edt_shaper", sizeof(attr.prog_name) - 1);
+    _progFd = bpf(BPF_PROG_LOAD, &attr);
+    if (_progFd < 0) {
+        cerr << "Failed to load BPF program: " << strerror(errno) << endl << log << endl;
+        exit(1);
+    }
+}
+
+bool EDTShaper::updateFlow(uint32_t dstAddr, uint32_t srcAddr, uint32_t skbPriority, uint8_t dscpMask, uint8_t dscpValue, unsigned int numBuckets, const double* rates, const double* bursts)
+{
+    EDTFlowKey key;
+    key.dstAddr = dstAddr;
+    key.srcAddr = srcAddr;
+    // Keep the existing state, if any
+    EDTFlowState oldState;
+    memset(&oldState, 0, sizeof(oldState));
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = _mapFd;
+    attr.key = (uint64_t)(unsigned long)&key;
+    attr.value = (uint64_t)(unsigned long)&oldState;
+    attr.flags = BPF_F_LOCK;
+    bool exists = (bpf(BPF_MAP_LOOKUP_ELEM, &attr) == 0);
+    EDTFlowState state;
+    memset(&state, 0, sizeof(state));
+    state.skbPriority = skbPriority;
+    uint8_t headerMask[sizeof(uint16_t)] = {0xff, dscpMask};
+    uint8_t headerValue[sizeof(uint16_t)] = {0, dscpValue};
+    uint16_t word;
+    memcpy(&word, headerMask, sizeof(word));
+    state.headerMask = word;
+    memcpy(&word, headerValue, sizeof(word));
+    state.headerValue = word;
+    state.sentBytes = oldState.sentBytes;
+    for (unsigned int i = 0; i < numBuckets; i++) {
+        if ((state.numBuckets == EDT_MAX_BUCKETS) || (rates[i] <= 0)) {
+            cerr << "Ignoring rate limit " << rates[i] << " with burst " << bursts[i] << endl;
+            continue;
+        }
+        EDTBucket& bucket = state.buckets[state.numBuckets];
+        bucket.rate = (uint64_t)rates[i];
+        if (bucket.rate == 0) {
+            bucket.rate = 1;
+        }
+        bucket.tolerance = (uint64_t)(bursts[i] / rates[i] * NS_PER_SEC);
+        // Buckets keep their TATs if they are in the same position, so a rate change does not grant a fresh burst
+        bucket.arrivalTime = (exists && (state.numBuckets < oldState.numBuckets)) ? oldState.buckets[state.numBuckets].arrivalTime : 0;
+        state.numBuckets++;
+    }
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = _mapFd;
+    attr.key = (uint64_t)(unsigned long)&key;
+    attr.value = (uint64_t)(unsigned long)&state;
+    attr.flags = BPF_ANY | BPF_F_LOCK;
+    if (bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+        cerr << "Failed to update BPF flow map: " << strerror(errno) << endl;
+        return false;
+    }
+    return true;
+}
+
+void EDTShaper::removeFlow(uint32_t dstAddr, uint32_t srcAddr)
+{
+    EDTFlowKey key;
+    key.dstAddr = dstAddr;
+    key.srcAddr = srcAddr;
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = _mapFd;
+    attr.key = (uint64_t)(unsigned long)&key;
+    bpf(BPF_MAP_DELETE_ELEM, &attr);
+}
+
+uint64_t EDTShaper::getSentBytes(uint32_t dstAddr, uint32_t srcAddr) const
+{
+    EDTFlowKey key;
+    key.dstAddr = dstAddr;
+    key.srcAddr = srcAddr;
+    EDTFlowState state;
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = _mapFd;
+    attr.key = (uint64_t)(unsigned long)&key;
+    attr.value = (uint64_t)(unsigned long)&state;
+    attr.flags = BPF_F_LOCK;
+    if (bpf(BPF_MAP_LOOKUP_ELEM, &attr) < 0) {
+        return 0;
+    }
+    return state.sentBytes;
+}
@@ -0,0 +1,56 @@
+// EDTShaper.hpp - eBPF/EDT (earliest departure time) network traffic shaping.
+// EDTShaper loads a BPF program, to be attached at the clsact egress hook, that shapes and marks IPv4 packets by their dst/src addresses.
+// The shaping parameters and state of each flow live in a BPF hash map, which is updated from user space without touching the qdiscs.
+// Each flow's rate limits are token buckets enforced with GCRA: a packet departs once each bucket has room for it, and its departure time
+// is set in skb->tstamp, which the fq qdiscs on the device's transmit queues honor. Packets that would depart beyond a drop horizon are dropped.
+// The program also sets each flow's skb->priority, which selects the band of the prio qdiscs above the fq qdiscs, so priorities are strict.
+// A flow's buckets are updated under a bpf_spin_lock in its map entry, so its packets are shaped consistently across CPUs,
+// while different flows are shaped in parallel, so enforcement scales across NIC queues.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _EDT_SHAPER_HPP
+#define _EDT_SHAPER_HPP
+
+#include <stdint.h>
+
+using namespace std;
+
+#define EDT_MAX_BUCKETS 12 // max rate limits per flow
+#define EDT_MAX_FLOWS 65536
+#define EDT_DROP_HORIZON 2000000000 // ns
+
+class EDTShaper
+{
+private:
+    int _mapFd;
+    int _progFd;
+
+    // Load the BPF program; exits on failure
+    void loadProgram();
+
+    EDTShaper(const EDTShaper&); // not implemented
+    EDTShaper& operator=(const EDTShaper&); // not implemented
+
+public:
+    // Create the flow map and load the BPF program; exits on failure
+    EDTShaper();
+    ~EDTShaper();
+
+    // File descriptor of the BPF program for attaching it as a TC filter
+    int programFd() const { return _progFd; }
+
+    // Addresses are in network order
+    // Set a flow's skb->priority, DSCP marking (i.e., (tos & dscpMask) | dscpValue), and token buckets (rates in bytes per sec, bursts in bytes);
+    // keeps its shaping state and sent bytes. Packets of other flows get skb->priority 0.
+    // Returns false on failure.
+    bool updateFlow(uint32_t dstAddr, uint32_t srcAddr, uint32_t skbPriority, uint8_t dscpMask, uint8_t dscpValue, unsigned int numBuckets, const double* rates, const double* bursts);
+    // Stop shaping and marking a flow
+    void removeFlow(uint32_t dstAddr, uint32_t srcAddr);
+    // Get the bytes sent by a flow since it was added
+    uint64_t getSentBytes(uint32_t dstAddr, uint32_t srcAddr) const;
+};
+
+#endif // _EDT_SHAPER_HPP
@@ -35,6 +35,16 @@
 //
 // Lastly, as clients are added, src/dst filters are setup to send packets to the corresponding queue for its priority level.
 //
+// The hot path metrics (e.g., time spent in UpdateClients RPCs and TC commits) are returned by the GetMetrics RPC, and with -M [metricsAddr:]metricsPort,
+// they are also served in the Prometheus text format on a TCP port (see common/metrics.hpp).
+//
+// Alternatively, with -e, NetEnforcer uses an eBPF/EDT backend (see EDTShaper.hpp), which avoids HTB's root lock and per-class overhead at high rates and tenant counts.
+// The root qdisc is mq with a prio qdisc per transmit queue (or just prio for single queue devices), [EDTPrioHandle(queue):], whose bands are served in strict priority order.
+// Each band, [EDTPrioHandle(queue):EDTPrioBand(priority) + 1], has a fq qdisc, which paces packets by the departure times set by a BPF program at the clsact egress hook.
+// The BPF program selects the band of each client's packets by setting their skb->priority to EDTSkbPriority(priority), which the prio qdiscs map to the band;
+// other packets get skb->priority 0 and go to the best effort band, [EDTPrioHandle(queue):EDTPrioBand(g_numPriorities) + 1], like the HTB default class.
+// The BPF program also tags the DSCP flags of each client's packets like the DSMARK qdiscs, and enforces its rate limits with per-client token bucket state in a BPF map.
+//
 // Copyright (c) 2017 Timothy Zhu.
 // Licensed under the MIT License. See LICENSE file for details.
 //
@@ -45,19 +55,27 @@
 #include <string>
 #include <map>
 #include <unistd.h>
+#include <dirent.h>
 #include <stdio.h>
 #include <signal.h>
 #include <arpa/inet.h>
+#include <linux/pkt_sched.h>
 #include <rpc/rpc.h>
 #include <rpc/pmap_clnt.h>
 #include "../prot/net_prot.h"
 #include "../common/time.hpp"
+#include "../common/common.hpp"
+#include "../common/metrics.hpp"
+#include "TCNetlink.hpp"
+#include "EDTShaper.hpp"
 
 #define MAX_CMD_SIZE 256
 
 using namespace std;
 
 struct Client {
+    unsigned long s_dstAddr;
+    unsigned long s_srcAddr;
     unsigned int id;
     unsigned int priority;
     unsigned int rateLimitLength;
@@ -75,6 +93,16 @@ string g_dev = "eth0";
 unsigned int g_maxRate = 125000000; // bytes per second
 unsigned int g_numPriorities = 7;
 unsigned int g_numLevels = 5;
+TCNetlink* g_tc = NULL; // TC changes are batched and sent at the end of each RPC
+EDTShaper* g_edt = NULL; // eBPF/EDT backend; HTB is used if NULL
+uint64_t g_statsTTL = ConvertSecondsToTime(0.1); // how long sampled TC stats are reused
+
+// Sampled sent bytes of the classes within a HTB qdisc
+struct ClassStats {
+    uint64_t time; // when the stats were sampled
+    map<uint32_t, uint64_t> sentBytes; // by class handle
+};
+map<unsigned int, ClassStats> g_classStats; // by HTB qdisc handle
 
 // Handle for root HTB qdisc
 unsigned int rootHTBHandle()
@@ -106,6 +134,42 @@ unsigned int DSMARKHandle(unsigned int priority)
     return priority + rootHTBMinorDefault() + 1;
 }
 
+// DSCP flags for a given priority level; highest priority (0) is cs7 (0b11100000)
+unsigned char DSCPValue(unsigned int priority)
+{
+    return (7 - priority) << 5;
+}
+
+// Mask of the TOS bits kept when tagging the DSCP flags (i.e., the ECN bits)
+unsigned char DSCPMask()
+{
+    return 0x3;
+}
+
+// Handle for root mq qdisc of the eBPF/EDT backend
+unsigned int rootMQHandle()
+{
+    return 1;
+}
+
+// Handle for the prio qdisc of a transmit queue of the eBPF/EDT backend; queues start at 1, and 0 is the root prio qdisc of single queue devices
+unsigned int EDTPrioHandle(unsigned int queue)
+{
+    return rootMQHandle() + queue;
+}
+
+// Band of the eBPF/EDT backend's prio qdiscs for a given priority level; the best effort band is EDTPrioBand(g_numPriorities)
+unsigned int EDTPrioBand(unsigned int priority)
+{
+    return priority;
+}
+
+// skb->priority set by the eBPF/EDT backend's BPF program for a given priority level; 0 is used for best effort
+uint32_t EDTSkbPriority(unsigned int priority)
+{
+    return priority + 1;
+}
+
 // Handle for HTB rate limiters; starts after DSMARKHandle
 unsigned int HTBBaseHandle(unsigned int priority)
 {
@@ -145,39 +209,34 @@ string runCmd(char* cmd)
     return result;
 }
 
+// Handle of a TC class
+uint32_t classHandle(unsigned int handle, unsigned int minor)
+{
+    return TC_H_MAKE(handle << 16, minor);
+}
+
 // Remove the root qdisc in TC
 void removeRoot()
 {
-    char cmd[MAX_CMD_SIZE];
-    snprintf(cmd, MAX_CMD_SIZE,
-             "tc qdisc del dev %s root",
-             g_dev.c_str());
-    runCmd(cmd);
+    g_tc->deleteQdisc(TC_H_ROOT, 0);
+}
+
+// Remove the clsact qdisc in TC, which holds the eBPF/EDT backend's BPF program
+void removeClsact()
+{
+    g_tc->deleteQdisc(TC_H_CLSACT, TC_H_MAKE(TC_H_CLSACT, 0));
 }
 
 // Remove a qdisc in TC
 void removeQdisc(unsigned int parentHandle, unsigned int parentMinor, unsigned int childHandle)
 {
-    char cmd[MAX_CMD_SIZE];
-    snprintf(cmd, MAX_CMD_SIZE,
-             "tc qdisc del dev %s parent %d:%d handle %d:",
-             g_dev.c_str(),
-             parentHandle,
-             parentMinor,
-             childHandle);
-    runCmd(cmd);
+    g_tc->deleteQdisc(classHandle(parentHandle, parentMinor), classHandle(childHandle, 0));
 }
 
 // Remove a class in TC
 void removeClass(unsigned int parentHandle, unsigned int minor)
 {
-    char cmd[MAX_CMD_SIZE];
-    snprintf(cmd, MAX_CMD_SIZE,
-             "tc class del dev %s classid %d:%d",
-             g_dev.c_str(),
-             parentHandle,
-             minor);
-    runCmd(cmd);
+    g_tc->deleteClass(classHandle(parentHandle, minor));
 }
 
 // Remove a filter in TC from qdisc [parentHandle:] for a client with given id
@@ -185,191 +244,173 @@ void removeFilter(unsigned int parentHandle, unsigned int id)
 {
     // We overload prio to be the client id + 1 to make the filter easy to identify when removing it.
     // Since only one filter should target a client, setting prio should not have any effect.
-    char cmd[MAX_CMD_SIZE];
-    snprintf(cmd, MAX_CMD_SIZE,
-             "tc filter del dev %s parent %d: prio %d u32",
-             g_dev.c_str(),
-             parentHandle,
-             id + 1);
-    runCmd(cmd);
+    g_tc->deleteFilters(classHandle(parentHandle, 0), id + 1);
 }
 
 // Add a HTB qdisc in TC
 void addHTBQdisc(unsigned int parentHandle, unsigned int parentMinor, unsigned int childHandle)
 {
-    char cmd[MAX_CMD_SIZE];
-    snprintf(cmd, MAX_CMD_SIZE,
-             "tc qdisc add dev %s parent %d:%d handle %d: htb default 1",
-             g_dev.c_str(),
-             parentHandle,
-             parentMinor,
-             childHandle);
-    runCmd(cmd);
+    g_tc->addHTBQdisc(classHandle(parentHandle, parentMinor), classHandle(childHandle, 0), 1);
 }
 
 // Add a HTB class in TC
 void addHTBClass(unsigned int parentHandle, unsigned int minor, unsigned int rate, unsigned int ceil, unsigned int burst, unsigned int cburst)
 {
-    char burstStr[MAX_CMD_SIZE] = "";
-    if (burst > 0) {
-        snprintf(burstStr, MAX_CMD_SIZE,
-                 " burst %db",
-                 burst);
-    }
-    char cburstStr[MAX_CMD_SIZE] = "";
-    if (cburst > 0) {
-        snprintf(cburstStr, MAX_CMD_SIZE,
-                 " cburst %db",
-                 cburst);
-    }
-    char cmd[MAX_CMD_SIZE];
-    snprintf(cmd, MAX_CMD_SIZE,
-             "tc class replace dev %s parent %d: classid %d:%d htb rate %dbps ceil %dbps%s%s",
-             g_dev.c_str(),
-             parentHandle,
-             parentHandle,
-             minor,
-             rate,
-             ceil,
-             burstStr,
-             cburstStr);
-    runCmd(cmd);
+    g_tc->addHTBClass(classHandle(parentHandle, 0), classHandle(parentHandle, minor), rate, ceil, burst, cburst, 0, true);
 }
 
 // Add a filter in TC to qdisc [parentHandle:] for a client with given id
 // Causes packets with given src/dst to use class [parentHandle:minor]
 void addFilter(unsigned int parentHandle, unsigned int id, unsigned long s_dstAddr, unsigned long s_srcAddr, unsigned int minor)
 {
-    // Convert address to string
-    char dstAddrStr[INET_ADDRSTRLEN];
-    char srcAddrStr[INET_ADDRSTRLEN];
-    struct in_addr dstAddr;
-    struct in_addr srcAddr;
-    dstAddr.s_addr = s_dstAddr;
-    inet_ntop(AF_INET, &dstAddr, dstAddrStr, INET_ADDRSTRLEN);
-    srcAddr.s_addr = s_srcAddr;
-    inet_ntop(AF_INET, &srcAddr, srcAddrStr, INET_ADDRSTRLEN);
-
     // We overload prio to be the client id + 1 to make the filter easy to identify when removing it.
     // Since only one filter should target a client, setting prio should not have any effect.
-    char cmd[MAX_CMD_SIZE];
-    snprintf(cmd, MAX_CMD_SIZE,
-             "tc filter add dev %s parent %d: protocol ip prio %d u32 match ip dst %s match ip src %s flowid %d:%d",
-             g_dev.c_str(),
-             parentHandle,
-             id + 1,
-             dstAddrStr,
-             srcAddrStr,
-             parentHandle,
-             minor);
-    runCmd(cmd);
+    g_tc->addU32Filter(classHandle(parentHandle, 0), id + 1, s_dstAddr, s_srcAddr, classHandle(parentHandle, minor));
 }
 
 // Initialize TC with our basic qdisc/class structure (see file header)
 void initTC()
 {
-    // Remove root to start at a clean slate
+    // Remove root to start at a clean slate; this fails if there is no root qdisc yet
     removeRoot();
+    g_tc->commit();
     // Reserve 1% of bandwidth for each priority level, and assign remaining bandwidth to highest priority
     const unsigned int minRate = g_maxRate / 100; // bps
     unsigned int rate = minRate * (g_numPriorities + 1);
     unsigned int ceil = g_maxRate;
-    char cmd[MAX_CMD_SIZE];
     // Create root HTB qdisc [1:]
-    snprintf(cmd, MAX_CMD_SIZE,
-             "tc qdisc add dev %s root handle 1: htb default %d",
-             g_dev.c_str(),
-             rootHTBMinorDefault());
-    runCmd(cmd);
+    g_tc->addHTBQdisc(TC_H_ROOT, classHandle(rootHTBHandle(), 0), rootHTBMinorDefault());
     // Create root HTB class [1:rootHTBMinorHelper(0)]
-    snprintf(cmd, MAX_CMD_SIZE,
-             "tc class add dev %s parent 1: classid 1:%d htb rate %dbps prio %d",
-             g_dev.c_str(),
-             rootHTBMinorHelper(0),
-             g_maxRate,
-             0);
-    runCmd(cmd);
+    g_tc->addHTBClass(classHandle(rootHTBHandle(), 0), classHandle(rootHTBHandle(), rootHTBMinorHelper(0)), g_maxRate, g_maxRate, 0, 0, 0, false);
     for (unsigned int priority = 0; priority < g_numPriorities; priority++) {
         // Create root HTB class [1:rootHTBMinor(priority)]
-        snprintf(cmd, MAX_CMD_SIZE,
-                 "tc class add dev %s parent 1:%d classid 1:%d htb rate %dbps ceil %dbps prio %d",
-                 g_dev.c_str(),
-                 rootHTBMinorHelper(priority),
-                 rootHTBMinor(priority),
-                 minRate,
-                 ceil,
-                 priority);
-        runCmd(cmd);
+        g_tc->addHTBClass(classHandle(rootHTBHandle(), rootHTBMinorHelper(priority)), classHandle(rootHTBHandle(), rootHTBMinor(priority)), minRate, ceil, 0, 0, priority, false);
         // Add DSMARK qdisc [DSMARKHandle(priority):]
-        snprintf(cmd, MAX_CMD_SIZE,
-                 "tc qdisc add dev %s parent 1:%d handle %d: dsmark indices 2 default_index 1",
-                 g_dev.c_str(),
-                 rootHTBMinor(priority),
-                 DSMARKHandle(priority));
-        runCmd(cmd);
+        g_tc->addDSMARKQdisc(classHandle(rootHTBHandle(), rootHTBMinor(priority)), classHandle(DSMARKHandle(priority), 0), 2, 1);
         // Set DSCP flag for DSMARK class [DSMARKHandle(priority):1]
-        // Highest priority (0) is cs7 (0b11100000)
-        unsigned char value = (7 - priority) << 5;
-        snprintf(cmd, MAX_CMD_SIZE,
-                 "tc class change dev %s classid %d:1 dsmark mask 0x3 value 0x%x", // must be change, not add
-                 g_dev.c_str(),
-                 DSMARKHandle(priority),
-                 value);
-        runCmd(cmd);
+        g_tc->changeDSMARKClass(classHandle(DSMARKHandle(priority), 1), DSCPMask(), DSCPValue(priority)); // must be change, not add
         // Create base HTB qdisc [HTBBaseHandle(priority):] for handling rate limits
         addHTBQdisc(DSMARKHandle(priority), 1, HTBBaseHandle(priority));
         // Create root HTB class [1:rootHTBMinorHelper(priority + 1)]
         rate -= minRate;
         ceil -= minRate;
-        snprintf(cmd, MAX_CMD_SIZE,
-                 "tc class add dev %s parent 1:%d classid 1:%d htb rate %dbps ceil %dbps prio %d",
-                 g_dev.c_str(),
-                 rootHTBMinorHelper(priority),
-                 rootHTBMinorHelper(priority + 1),
-                 rate,
-                 ceil,
-                 priority + 1);
-        runCmd(cmd);
-    }
-}
-
-// Get TC stats on the sent bytes
-uint64_t getSentBytes(unsigned int parentHandle, unsigned int minor)
-{
-    char cmd[MAX_CMD_SIZE];
-    snprintf(cmd, MAX_CMD_SIZE,
-             "tc -s class show dev %s parent %d:",
-             g_dev.c_str(),
-             parentHandle);
-    string stats = runCmd(cmd);
-    char find[64];
-    snprintf(find, 64,
-             "class htb %d:%d",
-             parentHandle,
-             minor);
-    size_t location = stats.find(find);
-    if (location == string::npos) {
+        g_tc->addHTBClass(classHandle(rootHTBHandle(), rootHTBMinorHelper(priority)), classHandle(rootHTBHandle(), rootHTBMinorHelper(priority + 1)), rate, ceil, 0, 0, priority + 1, false);
+    }
+    // Send the whole structure at once
+    unsigned int failures = g_tc->commit();
+    if (failures > 0) {
+        cerr << "Failed " << failures << " TC changes while initializing TC" << endl;
+    }
+}
+
+// Get the number of transmit queues of the device
+unsigned int numTxQueues()
+{
+    string path = "/sys/class/net/" + g_dev + "/queues";
+    DIR* dir = opendir(path.c_str());
+    if (dir == NULL) {
+        return 1;
+    }
+    unsigned int numQueues = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "tx-", 3) == 0) {
+            numQueues++;
+        }
+    }
+    closedir(dir);
+    return (numQueues > 0) ? numQueues : 1;
+}
+
+// Add the prio qdisc [EDTPrioHandle(queue):] of the eBPF/EDT backend, with a fq qdisc per band to pace packets by their departure times
+void addEDTPrioQdisc(unsigned int parent, unsigned int queue, bool replace)
+{
+    // Map each level's skb->priority to its band, and everything else to the best effort band
+    assert(g_numPriorities < TCQ_PRIO_BANDS);
+    uint8_t priomap[TC_PRIO_MAX + 1];
+    for (unsigned int skbPriority = 0; skbPriority <= TC_PRIO_MAX; skbPriority++) {
+        priomap[skbPriority] = EDTPrioBand(g_numPriorities);
+    }
+    for (unsigned int priority = 0; priority < g_numPriorities; priority++) {
+        priomap[EDTSkbPriority(priority)] = EDTPrioBand(priority);
+    }
+    unsigned int numBands = g_numPriorities + 1;
+    g_tc->addPrioQdisc(parent, classHandle(EDTPrioHandle(queue), 0), numBands, priomap, replace);
+    for (unsigned int band = 0; band < numBands; band++) {
+        g_tc->addQdisc(classHandle(EDTPrioHandle(queue), band + 1), 0, "fq", true);
+    }
+}
+
+// Initialize TC for the eBPF/EDT backend (see file header)
+void initEDT()
+{
+    // Remove root and clsact to start at a clean slate; these fail if they do not exist yet
+    removeRoot();
+    removeClsact();
+    g_tc->commit();
+    // Serve priority levels strictly with a prio qdisc per transmit queue
+    unsigned int numQueues = numTxQueues();
+    if (numQueues > 1) {
+        g_tc->addQdisc(TC_H_ROOT, classHandle(rootMQHandle(), 0), "mq", false);
+        for (unsigned int queue = 1; queue <= numQueues; queue++) {
+            addEDTPrioQdisc(classHandle(rootMQHandle(), queue), queue, true);
+        }
+    } else {
+        addEDTPrioQdisc(TC_H_ROOT, 0, false);
+    }
+    // Attach the BPF program at the egress hook
+    g_tc->addQdisc(TC_H_CLSACT, TC_H_MAKE(TC_H_CLSACT, 0), "clsact", false);
+    g_tc->addBPFFilter(TC_H_MAKE(TC_H_CLSACT, TC_H_MIN_EGRESS), 1, g_edt->programFd(), "edt_shaper");
+    unsigned int failures = g_tc->commit();
+    if (failures > 0) {
+        cerr << "Failed " << failures << " TC changes while initializing TC" << endl;
+    }
+}
+
+// Get TC stats on the sent bytes, and when they were sampled
+// Each qdisc's classes are dumped at once, and the dump is reused for g_statsTTL so polling many clients costs one dump per qdisc
+uint64_t getSentBytes(unsigned int parentHandle, unsigned int minor, uint64_t& sampleTime)
+{
+    uint64_t now = GetTime();
+    map<unsigned int, ClassStats>::iterator it = g_classStats.find(parentHandle);
+    if ((it == g_classStats.end()) || ((now - it->second.time) > g_statsTTL)) {
+        ClassStats& stats = g_classStats[parentHandle];
+        if (!g_tc->getClassSentBytes(classHandle(parentHandle, 0), stats.sentBytes)) {
+            g_classStats.erase(parentHandle);
+            sampleTime = now;
+            return 0;
+        }
+        stats.time = now;
+        it = g_classStats.find(parentHandle);
+    }
+    sampleTime = it->second.time;
+    map<uint32_t, uint64_t>::const_iterator classIt = it->second.sentBytes.find(classHandle(parentHandle, minor));
+    if (classIt == it->second.sentBytes.end()) {
         return 0;
     }
-    size_t begin = stats.find("Sent", location + 1);
-    assert(location != string::npos);
-    size_t end = stats.find('\n', begin);
-    string statsLine = stats.substr(begin, end - begin);
-    unsigned long long sentBytes;
-    sscanf(statsLine.c_str(), "Sent %lld", &sentBytes);
-    return sentBytes;
+    return classIt->second;
 }
 
 // Update sent bytes stats
 void updateSentBytes(Client& c)
 {
     if (c.rateLimitLength > 0) {
-        uint64_t currSentBytes = getSentBytes(HTBBaseHandle(c.priority), HTBMinor(c.id, 0));
+        uint64_t sampleTime;
+        uint64_t currSentBytes;
+        if (g_edt != NULL) {
+            // The BPF program counts the bytes in the client's map entry
+            sampleTime = GetTime();
+            currSentBytes = g_edt->getSentBytes(c.s_dstAddr, c.s_srcAddr);
+        } else {
+            currSentBytes = getSentBytes(HTBBaseHandle(c.priority), HTBMinor(c.id, 0), sampleTime);
+        }
         c.sentBytes += currSentBytes - c.prevSentBytes;
         c.prevSentBytes = currSentBytes;
-        uint64_t now = GetTime();
-        c.maxSentBytes += c.rate * ConvertTimeToSeconds(now - c.lastSentBytesTime);
-        c.lastSentBytesTime = now;
+        // Account for the max sent bytes up to when the stats were sampled
+        if (sampleTime > c.lastSentBytesTime) {
+            c.maxSentBytes += c.rate * ConvertTimeToSeconds(sampleTime - c.lastSentBytesTime);
+            c.lastSentBytesTime = sampleTime;
+        }
     }
 }
 
@@ -386,6 +427,8 @@ void updateClient(unsigned long s_dstAddr, unsigned long s_srcAddr, unsigned int
     unsigned int oldPriority;
     unsigned int oldRateLimitLength;
     if (newClient) {
+        c.s_dstAddr = s_dstAddr;
+        c.s_srcAddr = s_srcAddr;
         c.id = g_nextId++;
         c.lastSentBytesTime = GetTime();
         c.maxSentBytes = 0;
@@ -401,6 +444,16 @@ void updateClient(unsigned long s_dstAddr, unsigned long s_srcAddr, unsigned int
     c.priority = priority;
     c.rateLimitLength = rateLimitLength;
     c.rate = (rateLimitLength > 0) ? rateLimitRates[0] : g_maxRate; // Occupancy calculation assumes just a single rate
+    if (g_edt != NULL) {
+        // The eBPF/EDT backend enforces every rate limit as a token bucket in the client's map entry, which keeps its sent bytes across updates
+        if (priority == g_numPriorities) {
+            g_edt->removeFlow(s_dstAddr, s_srcAddr);
+            g_clients.erase(addr);
+        } else {
+            g_edt->updateFlow(s_dstAddr, s_srcAddr, EDTSkbPriority(priority), DSCPMask(), DSCPValue(priority), rateLimitLength, rateLimitRates, rateLimitBursts);
+        }
+        return;
+    }
     // Add/update HTB rate limiters
     unsigned int id = c.id;
     unsigned int level = 0;
@@ -470,12 +523,10 @@ void updateClient(unsigned long s_dstAddr, unsigned long s_srcAddr, unsigned int
     }
 }
 
-// Get occupancy of (dst/src) since last call
-double getOccupancy(unsigned long s_dstAddr, unsigned long s_srcAddr)
+// Get occupancy of a client since last call
+double getOccupancy(Client& c)
 {
     double occupancy = 0;
-    pair<unsigned long, unsigned long> addr(s_dstAddr, s_srcAddr);
-    Client& c = g_clients[addr];
     // Ignore clients we don't know anything about
     if (c.priority != 0) {
         updateSentBytes(c);
@@ -493,10 +544,28 @@ double getOccupancy(unsigned long s_dstAddr, unsigned long s_srcAddr)
     return occupancy;
 }
 
+// Get occupancy of (dst/src) since last call
+double getOccupancy(unsigned long s_dstAddr, unsigned long s_srcAddr)
+{
+    pair<unsigned long, unsigned long> addr(s_dstAddr, s_srcAddr);
+    map<pair<unsigned long, unsigned long>, Client>::iterator it = g_clients.find(addr);
+    if (it == g_clients.end()) {
+        return 0;
+    }
+    return getOccupancy(it->second);
+}
+
+// Time spent handling UpdateClients/RemoveClients RPCs, including committing the TC changes
+static MetricHistogram updateClientsTime("net_update_clients_seconds", "Time spent handling UpdateClients RPCs");
+static MetricHistogram removeClientsTime("net_remove_clients_seconds", "Time spent handling RemoveClients RPCs");
+static MetricCounter updatedClients("net_updated_clients_total", "Number of clients updated by UpdateClients RPCs");
+
 // UpdateClients RPC - update/add client configurations
 void* net_enforcer_update_clients_svc(NetUpdateClientsArgs* argp, struct svc_req* rqstp)
 {
     static char* result;
+    ScopedTimer timer(updateClientsTime);
+    updatedClients.add(argp->NetUpdateClientsArgs_len);
     for (unsigned int i = 0; i < argp->NetUpdateClientsArgs_len; i++) {
         const NetClientUpdate& clientUpdate = argp->NetUpdateClientsArgs_val[i];
         unsigned int priority = clientUpdate.priority;
@@ -516,6 +585,12 @@ void* net_enforcer_update_clients_svc(NetUpdateClientsArgs* argp, struct svc_req
                      clientUpdate.rateLimitRates.rateLimitRates_val,
                      clientUpdate.rateLimitBursts.rateLimitBursts_val);
     }
+    // Apply all the updates in one netlink transaction
+    unsigned int failures = g_tc->commit();
+    g_classStats.clear(); // classes may have been replaced
+    if (failures > 0) {
+        cerr << "Failed " << failures << " TC changes while updating clients" << endl;
+    }
     return (void*)&result;
 }
 
@@ -523,11 +598,18 @@ void* net_enforcer_update_clients_svc(NetUpdateClientsArgs* argp, struct svc_req
 void* net_enforcer_remove_clients_svc(NetRemoveClientsArgs* argp, struct svc_req* rqstp)
 {
     static char* result;
+    ScopedTimer timer(removeClientsTime);
     for (unsigned int i = 0; i < argp->NetRemoveClientsArgs_len; i++) {
         const NetClient& client = argp->NetRemoveClientsArgs_val[i];
         // Special call to updateClient to cleanup client settings
         updateClient(client.s_dstAddr, client.s_srcAddr, g_numPriorities, 0, NULL, NULL);
     }
+    // Apply all the removals in one netlink transaction
+    unsigned int failures = g_tc->commit();
+    g_classStats.clear(); // classes may have been removed
+    if (failures > 0) {
+        cerr << "Failed " << failures << " TC changes while removing clients" << endl;
+    }
     return (void*)&result;
 }
 
@@ -539,6 +621,36 @@ NetGetOccupancyRes* net_enforcer_get_occupancy_svc(NetGetOccupancyArgs* argp, st
     return &result;
 }
 
+// GetAllOccupancy RPC - get occupancy statistics of all clients
+NetGetAllOccupancyRes* net_enforcer_get_all_occupancy_svc(void* argp, struct svc_req* rqstp)
+{
+    static NetGetAllOccupancyRes result;
+    delete[] result.NetGetAllOccupancyRes_val;
+    result.NetGetAllOccupancyRes_len = g_clients.size();
+    result.NetGetAllOccupancyRes_val = new NetClientOccupancy[g_clients.size()];
+    // Clients sharing a priority level share a stats dump
+    unsigned int index = 0;
+    for (map<pair<unsigned long, unsigned long>, Client>::iterator it = g_clients.begin(); it != g_clients.end(); ++it) {
+        NetClientOccupancy& clientOccupancy = result.NetGetAllOccupancyRes_val[index++];
+        clientOccupancy.client.s_dstAddr = it->first.first;
+        clientOccupancy.client.s_srcAddr = it->first.second;
+        clientOccupancy.occupancy = getOccupancy(it->second);
+    }
+    return &result;
+}
+
+// GetMetrics RPC - get the hot path metrics
+NetGetMetricsRes* net_enforcer_get_metrics_svc(void* argp, struct svc_req* rqstp)
+{
+    static NetGetMetricsRes result;
+    static string metricsStr;
+    Json::Value metrics;
+    MetricsRegistry::get().toJson(metrics);
+    metricsStr = jsonToString(metrics);
+    result.metrics = const_cast<char*>(metricsStr.c_str());
+    return &result;
+}
+
 // Main RPC handler
 void net_enforcer_program(struct svc_req* rqstp, register SVCXPRT* transp)
 {
@@ -574,6 +686,18 @@ void net_enforcer_program(struct svc_req* rqstp, register SVCXPRT* transp)
             local = (char* (*)(char*, struct svc_req*))net_enforcer_get_occupancy_svc;
             break;
 
+        case NET_ENFORCER_GET_ALL_OCCUPANCY:
+            _xdr_argument = (xdrproc_t)xdr_void;
+            _xdr_result = (xdrproc_t)xdr_NetGetAllOccupancyRes;
+            local = (char* (*)(char*, struct svc_req*))net_enforcer_get_all_occupancy_svc;
+            break;
+
+        case NET_ENFORCER_GET_METRICS:
+            _xdr_argument = (xdrproc_t)xdr_void;
+            _xdr_result = (xdrproc_t)xdr_NetGetMetricsRes;
+            local = (char* (*)(char*, struct svc_req*))net_enforcer_get_metrics_svc;
+            break;
+
         default:
             svcerr_noproc(transp);
             return;
@@ -599,16 +723,22 @@ void term_signal(int signum)
     pmap_unset(NET_ENFORCER_PROGRAM, NET_ENFORCER_V1);
     // Remove TC root
     removeRoot();
+    if (g_edt != NULL) {
+        removeClsact();
+    }
+    g_tc->commit();
     exit(0);
 }
 
-// Usage: ./NetEnforcer [-d dev] [-b maxBandwidth (in bytes per sec)] [-n numPriorities]
+// Usage: ./NetEnforcer [-d dev] [-b maxBandwidth (in bytes per sec)] [-n numPriorities] [-t statsTTL (in ms)] [-e] [-M [metricsAddr:]metricsPort]
 int main(int argc, char** argv)
 {
     // Initialize globals
+    bool useEDT = false;
+    string metricsAddress;
     int opt = 0;
     do {
-        opt = getopt(argc, argv, "d:b:n:");
+        opt = getopt(argc, argv, "d:b:n:t:eM:");
         switch (opt) {
             case 'd':
                 g_dev.assign(optarg);
@@ -622,6 +752,18 @@ int main(int argc, char** argv)
                 g_numPriorities = atoi(optarg);
                 break;
 
+            case 't':
+                g_statsTTL = ConvertSecondsToTime(atof(optarg) / 1000);
+                break;
+
+            case 'e':
+                useEDT = true;
+                break;
+
+            case 'M':
+                metricsAddress = optarg;
+                break;
+
             case -1:
                 break;
 
@@ -630,6 +772,12 @@ int main(int argc, char** argv)
         }
     } while (opt != -1);
 
+    // Open the netlink socket for configuring TC
+    g_tc = new TCNetlink(g_dev);
+    if (useEDT) {
+        g_edt = new EDTShaper();
+    }
+
     // Setup signal handler
     struct sigaction action;
     action.sa_handler = term_signal;
@@ -639,7 +787,11 @@ int main(int argc, char** argv)
     sigaction(SIGINT, &action, NULL);
 
     // Initialize TC
-    initTC();
+    if (g_edt != NULL) {
+        initEDT();
+    } else {
+        initTC();
+    }
 
     // Unregister NetEnforcer RPC handlers
     pmap_unset(NET_ENFORCER_PROGRAM, NET_ENFORCER_V1);
@@ -656,6 +808,11 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    // Serve metrics to scrapers
+    if (!metricsAddress.empty() && !startMetricsServer(metricsAddress)) {
+        return 1;
+    }
+
     // Run proxy
     svc_run();
     cerr << "svc_run returned" << endl;
@@ -0,0 +1,426 @@
+// TCNetlink.cpp - Programming Linux Traffic Control (TC) through rtnetlink.
+// The messages mirror those sent by iproute2's tc for the equivalent commands, including the timing conversions of its tc_core.c.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/pkt_sched.h>
+#include <linux/pkt_cls.h>
+#include <linux/gen_stats.h>
+#include <linux/if_ether.h>
+#include "../common/metrics.hpp"
+#include "TCNetlink.hpp"
+
+#define TIME_UNITS_PER_SEC 1000000
+#define HTB_MTU 1600 // tc's default mtu for HTB rate tables and bursts
+#define RECV_BUFFER_SIZE (64 * 1024)
+#define SOCKET_BUFFER_SIZE (1024 * 1024)
+#define ACK_TIMEOUT_SEC 5
+
+TCNetlink::TCNetlink(const string& dev)
+    : _seq(1),
+      _firstUnackedSeq(1),
+      _dumpSeq(0x80000000),
+      _message(0),
+      _failures(0),
+      _tickInUsec(1),
+      _hz(100)
+{
+    _ifindex = if_nametoindex(dev.c_str());
+    if (_ifindex == 0) {
+        cerr << "Unknown device " << dev << endl;
+        exit(1);
+    }
+    _fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (_fd < 0) {
+        cerr << "Failed to open rtnetlink socket: " << strerror(errno) << endl;
+        exit(1);
+    }
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if (bind(_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        cerr << "Failed to bind rtnetlink socket: " << strerror(errno) << endl;
+        exit(1);
+    }
+    // Size the socket buffers for a full batch and its acks
+    int bufferSize = SOCKET_BUFFER_SIZE;
+    setsockopt(_fd, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+    setsockopt(_fd, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+#ifdef NETLINK_CAP_ACK
+    // Acks of failed messages do not need to echo the message
+    int one = 1;
+    setsockopt(_fd, SOL_NETLINK, NETLINK_CAP_ACK, &one, sizeof(one));
+#endif
+    // Don't hang if the kernel never acks
+    struct timeval timeout;
+    timeout.tv_sec = ACK_TIMEOUT_SEC;
+    timeout.tv_usec = 0;
+    setsockopt(_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    // Read the packet scheduler's clock parameters the same way tc does
+    FILE* fp = fopen("/proc/net/psched", "r");
+    if (fp != NULL) {
+        unsigned int t2us;
+        unsigned int us2t;
+        unsigned int clockRes;
+        unsigned int hz;
+        if (fscanf(fp, "%08x%08x%08x%08x", &t2us, &us2t, &clockRes, &hz) == 4) {
+            if (clockRes == 1000000000) {
+                t2us = us2t;
+            }
+            double clockFactor = (double)clockRes / TIME_UNITS_PER_SEC;
+            _tickInUsec = (double)t2us / us2t * clockFactor;
+            if (clockRes == 1000000) {
+                _hz = hz;
+            }
+        }
+        fclose(fp);
+    }
+}
+
+TCNetlink::~TCNetlink()
+{
+    close(_fd);
+}
+
+void TCNetlink::startMessage(uint16_t type, uint16_t flags, uint32_t parent, uint32_t handle, uint32_t info)
+{
+    if (_batch.size() >= TC_NETLINK_BATCH_SIZE) {
+        flush();
+    }
+    _message = _batch.size();
+    _batch.resize(_message + NLMSG_SPACE(sizeof(struct tcmsg)), 0);
+    struct nlmsghdr* nlh = (struct nlmsghdr*)&_batch[_message];
+    nlh->nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg));
+    nlh->nlmsg_type = type;
+    nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+    nlh->nlmsg_seq = _seq++;
+    struct tcmsg* tcm = (struct tcmsg*)NLMSG_DATA(nlh);
+    tcm->tcm_family = AF_UNSPEC;
+    tcm->tcm_ifindex = _ifindex;
+    tcm->tcm_parent = parent;
+    tcm->tcm_handle = handle;
+    tcm->tcm_info = info;
+}
+
+size_t TCNetlink::addAttr(uint16_t type, const void* data, size_t len)
+{
+    size_t offset = _batch.size();
+    _batch.resize(offset + RTA_SPACE(len), 0);
+    struct rtattr* rta = (struct rtattr*)&_batch[offset];
+    rta->rta_type = type;
+    rta->rta_len = RTA_LENGTH(len);
+    if (len > 0) {
+        memcpy(RTA_DATA(rta), data, len);
+    }
+    struct nlmsghdr* nlh = (struct nlmsghdr*)&_batch[_message];
+    nlh->nlmsg_len = _batch.size() - _message;
+    return offset;
+}
+
+void TCNetlink::endNested(size_t offset)
+{
+    struct rtattr* rta = (struct rtattr*)&_batch[offset];
+    rta->rta_len = _batch.size() - offset;
+}
+
+uint32_t TCNetlink::xmitTime(uint32_t rate, uint32_t size) const
+{
+    // Like tc, truncate to whole time units before converting to ticks
+    uint32_t time = (uint32_t)(TIME_UNITS_PER_SEC * ((double)size / rate));
+    return (uint32_t)(time * _tickInUsec);
+}
+
+void TCNetlink::addHTBQdisc(uint32_t parent, uint32_t handle, uint32_t defaultMinor)
+{
+    struct tc_htb_glob glob;
+    memset(&glob, 0, sizeof(glob));
+    glob.version = 3;
+    glob.rate2quantum = 10;
+    glob.defcls = defaultMinor;
+    startMessage(RTM_NEWQDISC, NLM_F_CREATE | NLM_F_EXCL, parent, handle, 0);
+    addAttr(TCA_KIND, string("htb"));
+    size_t options = addAttr(TCA_OPTIONS, NULL, 0);
+    addAttr(TCA_HTB_INIT, &glob, sizeof(glob));
+    endNested(options);
+}
+
+void TCNetlink::addDSMARKQdisc(uint32_t parent, uint32_t handle, uint16_t indices, uint16_t defaultIndex)
+{
+    startMessage(RTM_NEWQDISC, NLM_F_CREATE | NLM_F_EXCL, parent, handle, 0);
+    addAttr(TCA_KIND, string("dsmark"));
+    size_t options = addAttr(TCA_OPTIONS, NULL, 0);
+    addAttr(TCA_DSMARK_INDICES, &indices, sizeof(indices));
+    addAttr(TCA_DSMARK_DEFAULT_INDEX, &defaultIndex, sizeof(defaultIndex));
+    endNested(options);
+}
+
+void TCNetlink::addPrioQdisc(uint32_t parent, uint32_t handle, int bands, const uint8_t* priomap, bool replace)
+{
+    struct tc_prio_qopt opt;
+    memset(&opt, 0, sizeof(opt));
+    opt.bands = bands;
+    memcpy(opt.priomap, priomap, sizeof(opt.priomap));
+    startMessage(RTM_NEWQDISC, replace ? (NLM_F_CREATE | NLM_F_REPLACE) : (NLM_F_CREATE | NLM_F_EXCL), parent, handle, 0);
+    addAttr(TCA_KIND, string("prio"));
+    // Unlike most qdiscs, the options are the struct itself rather than nested attributes
+    addAttr(TCA_OPTIONS, &opt, sizeof(opt));
+}
+
+void TCNetlink::addQdisc(uint32_t parent, uint32_t handle, const string& kind, bool replace)
+{
+    startMessage(RTM_NEWQDISC, replace ? (NLM_F_CREATE | NLM_F_REPLACE) : (NLM_F_CREATE | NLM_F_EXCL), parent, handle, 0);
+    addAttr(TCA_KIND, kind);
+}
+
+void TCNetlink::deleteQdisc(uint32_t parent, uint32_t handle)
+{
+    startMessage(RTM_DELQDISC, 0, parent, handle, 0);
+}
+
+void TCNetlink::addHTBClass(uint32_t parent, uint32_t classid, uint32_t rate, uint32_t ceil, uint32_t burst, uint32_t cburst, uint32_t prio, bool replace)
+{
+    struct tc_htb_opt opt;
+    memset(&opt, 0, sizeof(opt));
+    opt.rate.rate = rate;
+    opt.ceil.rate = ceil;
+    opt.prio = prio;
+    // Default bursts allow one MTU on top of a tick's worth of data
+    if (burst == 0) {
+        burst = (uint32_t)(rate / _hz) + HTB_MTU;
+    }
+    if (cburst == 0) {
+        cburst = (uint32_t)(ceil / _hz) + HTB_MTU;
+    }
+    opt.buffer = xmitTime(rate, burst);
+    opt.cbuffer = xmitTime(ceil, cburst);
+    // Rate tables are only used by kernels that do not understand the link layer, but tc always sends them
+    int cellLog = 0;
+    while ((HTB_MTU >> cellLog) > 255) {
+        cellLog++;
+    }
+    uint32_t rtab[256];
+    uint32_t ctab[256];
+    for (int i = 0; i < 256; i++) {
+        uint32_t size = (i + 1) << cellLog;
+        rtab[i] = xmitTime(rate, size);
+        ctab[i] = xmitTime(ceil, size);
+    }
+    opt.rate.cell_log = cellLog;
+    opt.rate.cell_align = -1;
+    opt.rate.linklayer = TC_LINKLAYER_ETHERNET;
+    opt.ceil.cell_log = cellLog;
+    opt.ceil.cell_align = -1;
+    opt.ceil.linklayer = TC_LINKLAYER_ETHERNET;
+    startMessage(RTM_NEWTCLASS, replace ? (NLM_F_CREATE | NLM_F_REPLACE) : (NLM_F_CREATE | NLM_F_EXCL), parent, classid, 0);
+    addAttr(TCA_KIND, string("htb"));
+    size_t options = addAttr(TCA_OPTIONS, NULL, 0);
+    addAttr(TCA_HTB_PARMS, &opt, sizeof(opt));
+    addAttr(TCA_HTB_RTAB, rtab, sizeof(rtab));
+    addAttr(TCA_HTB_CTAB, ctab, sizeof(ctab));
+    endNested(options);
+}
+
+void TCNetlink::changeDSMARKClass(uint32_t classid, uint8_t mask, uint8_t value)
+{
+    startMessage(RTM_NEWTCLASS, 0, 0, classid, 0);
+    addAttr(TCA_KIND, string("dsmark"));
+    size_t options = addAttr(TCA_OPTIONS, NULL, 0);
+    addAttr(TCA_DSMARK_MASK, &mask, sizeof(mask));
+    addAttr(TCA_DSMARK_VALUE, &value, sizeof(value));
+    endNested(options);
+}
+
+void TCNetlink::deleteClass(uint32_t classid)
+{
+    startMessage(RTM_DELTCLASS, 0, 0, classid, 0);
+}
+
+void TCNetlink::addU32Filter(uint32_t parent, uint32_t prio, uint32_t dstAddr, uint32_t srcAddr, uint32_t classid)
+{
+    // Selector matching the IP header's dst and src addresses
+    char selBuf[sizeof(struct tc_u32_sel) + (2 * sizeof(struct tc_u32_key))];
+    memset(selBuf, 0, sizeof(selBuf));
+    struct tc_u32_sel* sel = (struct tc_u32_sel*)selBuf;
+    sel->flags = TC_U32_TERMINAL;
+    sel->nkeys = 2;
+    sel->keys[0].mask = 0xffffffff;
+    sel->keys[0].val = dstAddr;
+    sel->keys[0].off = 16;
+    sel->keys[1].mask = 0xffffffff;
+    sel->keys[1].val = srcAddr;
+    sel->keys[1].off = 12;
+    startMessage(RTM_NEWTFILTER, NLM_F_CREATE | NLM_F_EXCL, parent, 0, TC_H_MAKE(prio << 16, htons(ETH_P_IP)));
+    addAttr(TCA_KIND, string("u32"));
+    size_t options = addAttr(TCA_OPTIONS, NULL, 0);
+    addAttr(TCA_U32_CLASSID, &classid, sizeof(classid));
+    addAttr(TCA_U32_SEL, selBuf, sizeof(selBuf));
+    endNested(options);
+}
+
+void TCNetlink::addBPFFilter(uint32_t parent, uint32_t prio, int progFd, const string& name)
+{
+    uint32_t fd = progFd;
+    uint32_t flags = TCA_BPF_FLAG_ACT_DIRECT;
+    startMessage(RTM_NEWTFILTER, NLM_F_CREATE | NLM_F_EXCL, parent, 0, TC_H_MAKE(prio << 16, htons(ETH_P_ALL)));
+    addAttr(TCA_KIND, string("bpf"));
+    size_t options = addAttr(TCA_OPTIONS, NULL, 0);
+    addAttr(TCA_BPF_FD, &fd, sizeof(fd));
+    addAttr(TCA_BPF_NAME, name);
+    addAttr(TCA_BPF_FLAGS, &flags, sizeof(flags));
+    endNested(options);
+}
+
+void TCNetlink::deleteFilters(uint32_t parent, uint32_t prio)
+{
+    startMessage(RTM_DELTFILTER, 0, parent, 0, TC_H_MAKE(prio << 16, 0));
+    addAttr(TCA_KIND, string("u32"));
+}
+
+void TCNetlink::flush()
+{
+    if (_batch.empty()) {
+        return;
+    }
+    // Send the batch; the kernel processes the messages in order
+    unsigned int numMessages = _seq - _firstUnackedSeq;
+    ssize_t sent;
+    do {
+        sent = send(_fd, &_batch[0], _batch.size(), 0);
+    } while ((sent < 0) && (errno == EINTR));
+    _batch.clear();
+    if (sent < 0) {
+        cerr << "Failed to send TC netlink messages: " << strerror(errno) << endl;
+        _failures += numMessages;
+        _firstUnackedSeq = _seq;
+        return;
+    }
+    // Wait for an ack of each message
+    char buf[RECV_BUFFER_SIZE];
+    while (_firstUnackedSeq != _seq) {
+        ssize_t len = recv(_fd, buf, sizeof(buf), 0);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            cerr << "Failed to receive TC netlink acks: " << strerror(errno) << endl;
+            _failures += _seq - _firstUnackedSeq;
+            _firstUnackedSeq = _seq;
+            return;
+        }
+        for (struct nlmsghdr* nlh = (struct nlmsghdr*)buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+            // Skip acks of messages from earlier failed batches
+            if ((nlh->nlmsg_type != NLMSG_ERROR) || ((int32_t)(nlh->nlmsg_seq - _firstUnackedSeq) < 0) || ((int32_t)(nlh->nlmsg_seq - _seq) >= 0)) {
+                continue;
+            }
+            struct nlmsgerr* err = (struct nlmsgerr*)NLMSG_DATA(nlh);
+            if (err->error != 0) {
+                cerr << "TC netlink message " << err->msg.nlmsg_type << " failed: " << strerror(-err->error) << endl;
+                _failures++;
+            }
+            // Acks arrive in order
+            _firstUnackedSeq = nlh->nlmsg_seq + 1;
+        }
+    }
+}
+
+// Time spent sending the queued messages and waiting for the kernel's acknowledgements
+static MetricHistogram commitTime("tc_commit_seconds", "Time spent committing TC netlink messages");
+static MetricCounter commitFailures("tc_commit_failures_total", "Number of TC netlink messages the kernel failed");
+
+unsigned int TCNetlink::commit()
+{
+    ScopedTimer timer(commitTime);
+    flush();
+    unsigned int failures = _failures;
+    commitFailures.add(failures);
+    _failures = 0;
+    return failures;
+}
+
+bool TCNetlink::getClassSentBytes(uint32_t parent, map<uint32_t, uint64_t>& sentBytes)
+{
+    // Send the dump request on its own, leaving the queued messages alone
+    struct {
+        struct nlmsghdr nlh;
+        struct tcmsg tcm;
+    } req;
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg));
+    req.nlh.nlmsg_type = RTM_GETTCLASS;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nlh.nlmsg_seq = ++_dumpSeq;
+    req.tcm.tcm_family = AF_UNSPEC;
+    req.tcm.tcm_ifindex = _ifindex;
+    req.tcm.tcm_parent = parent;
+    ssize_t sent;
+    do {
+        sent = send(_fd, &req, req.nlh.nlmsg_len, 0);
+    } while ((sent < 0) && (errno == EINTR));
+    if (sent < 0) {
+        cerr << "Failed to send TC netlink dump request: " << strerror(errno) << endl;
+        return false;
+    }
+    // Parse the classes until the end of the dump
+    sentBytes.clear();
+    char buf[RECV_BUFFER_SIZE];
+    while (true) {
+        ssize_t len = recv(_fd, buf, sizeof(buf), 0);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            cerr << "Failed to receive TC netlink dump: " << strerror(errno) << endl;
+            return false;
+        }
+        for (struct nlmsghdr* nlh = (struct nlmsghdr*)buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+            // Skip replies to earlier failed requests
+            if (nlh->nlmsg_seq != _dumpSeq) {
+                continue;
+            }
+            if (nlh->nlmsg_type == NLMSG_DONE) {
+                return true;
+            }
+            if (nlh->nlmsg_type == NLMSG_ERROR) {
+                struct nlmsgerr* err = (struct nlmsgerr*)NLMSG_DATA(nlh);
+                cerr << "TC netlink dump failed: " << strerror(-err->error) << endl;
+                return false;
+            }
+            if (nlh->nlmsg_type != RTM_NEWTCLASS) {
+                continue;
+            }
+            struct tcmsg* tcm = (struct tcmsg*)NLMSG_DATA(nlh);
+            int attrLen = TCA_PAYLOAD(nlh);
+            for (struct rtattr* rta = TCA_RTA(tcm); RTA_OK(rta, attrLen); rta = RTA_NEXT(rta, attrLen)) {
+                if (rta->rta_type == TCA_STATS2) {
+                    int statsLen = RTA_PAYLOAD(rta);
+                    for (struct rtattr* stats = (struct rtattr*)RTA_DATA(rta); RTA_OK(stats, statsLen); stats = RTA_NEXT(stats, statsLen)) {
+                        if ((stats->rta_type == TCA_STATS_BASIC) && (RTA_PAYLOAD(stats) >= sizeof(uint64_t))) {
+                            uint64_t bytes;
+                            memcpy(&bytes, RTA_DATA(stats), sizeof(bytes));
+                            sentBytes[tcm->tcm_handle] = bytes;
+                        }
+                    }
+                } else if ((rta->rta_type == TCA_STATS) && (RTA_PAYLOAD(rta) >= sizeof(uint64_t)) && (sentBytes.find(tcm->tcm_handle) == sentBytes.end())) {
+                    // Older stats, which count bytes in the same way
+                    uint64_t bytes;
+                    memcpy(&bytes, RTA_DATA(rta), sizeof(bytes));
+                    sentBytes[tcm->tcm_handle] = bytes;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,91 @@
+// TCNetlink.hpp - Programming Linux Traffic Control (TC) through rtnetlink.
+// TCNetlink builds the rtnetlink messages that the tc command would send for the qdiscs, classes, and filters used by NetEnforcer,
+// and queues them so that a batch of changes is sent to the kernel with few system calls and without forking tc for each change.
+// Messages are processed by the kernel in the order they are queued.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _TC_NETLINK_HPP
+#define _TC_NETLINK_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+using namespace std;
+
+// Queued messages are sent once they exceed this size, so the kernel's acks fit in the socket's receive buffer
+#define TC_NETLINK_BATCH_SIZE (64 * 1024)
+
+// TCNetlink is not thread-safe.
+class TCNetlink
+{
+private:
+    int _fd;
+    int _ifindex;
+    uint32_t _seq; // sequence number of the next message
+    uint32_t _firstUnackedSeq; // sequence number of the first sent message that has not been acked
+    uint32_t _dumpSeq; // sequence number of the last dump request; kept apart from the queued messages' sequence numbers
+    vector<char> _batch; // queued messages
+    size_t _message; // offset of the message being built
+    unsigned int _failures; // failed messages since the last commit
+    // Timing parameters of the kernel's packet scheduler, as read by tc from /proc/net/psched
+    double _tickInUsec;
+    double _hz;
+
+    // Queue a new TC message
+    void startMessage(uint16_t type, uint16_t flags, uint32_t parent, uint32_t handle, uint32_t info);
+    // Add an attribute to the message being built; returns its offset in the batch
+    size_t addAttr(uint16_t type, const void* data, size_t len);
+    size_t addAttr(uint16_t type, const string& str) { return addAttr(type, str.c_str(), str.size() + 1); }
+    // Set the length of a nested attribute once its contents have been added
+    void endNested(size_t offset);
+    // Compute the transmission time in ticks of size bytes at rate bytes per second
+    uint32_t xmitTime(uint32_t rate, uint32_t size) const;
+    // Send the queued messages and wait for their acks
+    void flush();
+
+    TCNetlink(const TCNetlink&); // not implemented
+    TCNetlink& operator=(const TCNetlink&); // not implemented
+
+public:
+    // Open an rtnetlink socket for configuring dev; exits on failure
+    TCNetlink(const string& dev);
+    ~TCNetlink();
+
+    // Handles are given as major:minor numbers (i.e., TC_H_MAKE(major << 16, minor)); parent is TC_H_ROOT for root qdiscs
+    // Add a HTB qdisc, whose unclassified traffic goes to class [handle:defaultMinor]
+    void addHTBQdisc(uint32_t parent, uint32_t handle, uint32_t defaultMinor);
+    // Add a DSMARK qdisc
+    void addDSMARKQdisc(uint32_t parent, uint32_t handle, uint16_t indices, uint16_t defaultIndex);
+    // Add a prio qdisc, or replace the qdisc at parent if replace is true; packets whose priority (mod 16) is p go to band priomap[p]
+    void addPrioQdisc(uint32_t parent, uint32_t handle, int bands, const uint8_t* priomap, bool replace);
+    // Add a qdisc without options (e.g., clsact, mq, or fq), or replace the qdisc at parent if replace is true
+    void addQdisc(uint32_t parent, uint32_t handle, const string& kind, bool replace);
+    // Delete a qdisc; handle is 0 for the root qdisc
+    void deleteQdisc(uint32_t parent, uint32_t handle);
+    // Add a HTB class, or replace it if replace is true; bursts are in bytes, and 0 uses tc's default
+    void addHTBClass(uint32_t parent, uint32_t classid, uint32_t rate, uint32_t ceil, uint32_t burst, uint32_t cburst, uint32_t prio, bool replace);
+    // Change the marking of a DSMARK class
+    void changeDSMARKClass(uint32_t classid, uint8_t mask, uint8_t value);
+    // Delete a class
+    void deleteClass(uint32_t classid);
+    // Add a u32 filter to qdisc parent sending IP packets with the given dst/src addresses (in network order) to classid
+    void addU32Filter(uint32_t parent, uint32_t prio, uint32_t dstAddr, uint32_t srcAddr, uint32_t classid);
+    // Add a direct-action BPF filter for all packets to qdisc parent
+    void addBPFFilter(uint32_t parent, uint32_t prio, int progFd, const string& name);
+    // Delete the filters with a given prio from qdisc parent
+    void deleteFilters(uint32_t parent, uint32_t prio);
+
+    // Send the queued messages; returns the number of messages the kernel failed since the last commit
+    unsigned int commit();
+
+    // Dump the classes of qdisc parent and get the sent bytes of each class by handle; returns false on failure.
+    // Queued messages are not sent, so the stats reflect the committed configuration.
+    bool getClassSentBytes(uint32_t parent, map<uint32_t, uint64_t>& sentBytes);
+};
+
+#endif // _TC_NETLINK_HPP
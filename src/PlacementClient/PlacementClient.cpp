@@ -6,10 +6,19 @@
 // -o outputFilename (required) - output file to store the results of the workload placement
 // -s serverAddr (required) - the address of the PlacementController server
 // -e eventFilename (optional) - a file for experimentation purposes to add and remove instances of a workload from the system; see below for format; if not specified, by default each workload in the topology file will be added to the system.
+// -w windowSize (optional) - maximum number of outstanding addClient/delClient RPCs while replaying the events, each on its own connection to PlacementController; defaults to 1 (i.e., one blocking RPC at a time)
 //
 // Events file format: CSV file with 2 columns. 
 // The first column corresponds to the index of the workload in the topology file.
 // The second column is either addClient or delClient to indicate whether to add or remove the workload from the system.
+// The second column can also be consolidate to apply PlacementController's consolidation plan, in which case the first column is the maximum number of server hosts to empty (0 for no limit).
+// Each move of the plan is applied by deleting the workload and adding it back as admitted on its new server.
+//
+// With a window larger than 1, events are dispatched in order as long as fewer than windowSize events are outstanding.
+// An event waits for the outstanding events of the same workload, and a consolidate event waits for all outstanding events,
+// so events of unrelated workloads overlap and PlacementController may place workloads in a different order than the events file.
+//
+// The latency of each event and the overall throughput of the replay are written as JSON to outputFilename.timing.
 //
 // Copyright (c) 2017 Timothy Zhu.
 // Licensed under the MIT License. See LICENSE file for details.
@@ -18,8 +27,14 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <algorithm>
 #include <cstdlib>
+#include <cerrno>
 #include <unistd.h>
+#include <pthread.h>
 #include "../prot/PlacementController_clnt.hpp"
 #include <json/json.h>
 #include "../common/time.hpp"
@@ -27,13 +42,44 @@
 
 using namespace std;
 
+enum EventType {
+    EVENT_ADD_CLIENT,
+    EVENT_DEL_CLIENT,
+    EVENT_CONSOLIDATE
+};
+
 struct EventInfo {
-    unsigned int clientInfoIndex;
-    bool addClient;
+    unsigned int clientInfoIndex; // maximum number of server hosts to empty for EVENT_CONSOLIDATE
+    EventType type;
+};
+
+// Time spent on an event
+struct EventTiming {
+    EventTiming()
+        : startTime(0),
+          endTime(0),
+          admitted(false)
+    {}
+    uint64_t startTime;
+    uint64_t endTime;
+    bool admitted; // whether the workload was placed for EVENT_ADD_CLIENT
 };
 
 Json::Value rootConfig;
 char* outputFilename = NULL;
+string serverAddr = "";
+string addrPrefix;
+bool enforce = false;
+vector<EventInfo> events;
+vector<EventTiming> eventTimings; // by event index
+
+// Replay state shared by the main thread and the replay threads, protected by g_mutex
+pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t g_eventDispatched = PTHREAD_COND_INITIALIZER; // indicates an event was dispatched or the replay is done
+pthread_cond_t g_eventComplete = PTHREAD_COND_INITIALIZER; // indicates an outstanding event is complete
+deque<unsigned int> g_dispatchedEvents; // indexes of the events waiting for a replay thread
+set<unsigned int> g_outstandingClients; // clientInfoIndexes of the outstanding events
+bool g_replayDone = false;
 
 // SIGTERM/SIGINT signal for cleanup
 void term_signal(int signum)
@@ -42,14 +88,199 @@ void term_signal(int signum)
     exit(0);
 }
 
+// Apply PlacementController's consolidation plan
+void consolidate(PlacementController_clnt& clnt, unsigned int maxServerHosts)
+{
+    Json::Value& clientInfos = rootConfig["clients"];
+    vector<ConsolidationMove> moves;
+    vector<string> serverHosts;
+    if (clnt.planConsolidation(maxServerHosts, moves, serverHosts)) {
+        for (vector<ConsolidationMove>::const_iterator it = moves.begin(); it != moves.end(); it++) {
+            // Find the moved workload
+            unsigned int clientInfoIndex = 0;
+            while ((clientInfoIndex < clientInfos.size()) && (clientInfos[clientInfoIndex]["name"].asString() != it->name)) {
+                clientInfoIndex++;
+            }
+            if (clientInfoIndex >= clientInfos.size()) {
+                cerr << "Unknown workload " << it->name << " in consolidation plan" << endl;
+                continue;
+            }
+            Json::Value& clientInfo = clientInfos[clientInfoIndex];
+            Json::Value movedInfo = clientInfo;
+            movedInfo["admitted"] = Json::Value(true);
+            movedInfo["serverHost"] = Json::Value(it->serverHost);
+            movedInfo["serverVM"] = Json::Value(it->serverVM);
+            clnt.delClient(it->name);
+            if (clnt.addClient(movedInfo, addrPrefix, enforce)) {
+                movedInfo.removeMember("admitted");
+                clientInfo = movedInfo;
+                cout << "Moved " << clientInfo["name"].asString() << " (" << clientInfo["clientHost"].asString() << ", " << clientInfo["clientVM"].asString() << ") -> (" << clientInfo["serverHost"].asString() << ", " << clientInfo["serverVM"].asString() << ")" << endl;
+            } else {
+                cout << "Failed to move " << it->name << endl;
+            }
+        }
+        for (vector<string>::const_iterator it = serverHosts.begin(); it != serverHosts.end(); it++) {
+            cout << "Emptied " << *it << endl;
+        }
+    }
+}
+
+// Process an event and record its timing.
+// Events of the same workload are not processed concurrently, so each thread only updates its event's clientInfo.
+void processEvent(PlacementController_clnt& clnt, unsigned int eventIndex)
+{
+    const EventInfo& event = events[eventIndex];
+    EventTiming& timing = eventTimings[eventIndex];
+    timing.startTime = GetTime();
+    if (event.type == EVENT_CONSOLIDATE) {
+        consolidate(clnt, event.clientInfoIndex);
+        timing.endTime = GetTime();
+        return;
+    }
+    Json::Value& clientInfo = rootConfig["clients"][event.clientInfoIndex];
+    if (event.type == EVENT_ADD_CLIENT) {
+        timing.admitted = clnt.addClient(clientInfo, addrPrefix, enforce);
+        timing.endTime = GetTime();
+        pthread_mutex_lock(&g_mutex);
+        if (timing.admitted) {
+            cout << "Placed " << clientInfo["name"].asString() << " (" << clientInfo["clientHost"].asString() << ", " << clientInfo["clientVM"].asString() << ") -> (" << clientInfo["serverHost"].asString() << ", " << clientInfo["serverVM"].asString() << ")" << endl;
+        } else {
+            cout << "Rejected " << clientInfo["name"].asString() << endl;
+        }
+        pthread_mutex_unlock(&g_mutex);
+    } else {
+        clnt.delClient(clientInfo["name"].asString());
+        timing.endTime = GetTime();
+    }
+}
+
+// Replay thread, which processes dispatched events on its own connection to PlacementController
+void* replayThread(void* arg)
+{
+    PlacementController_clnt clnt(serverAddr);
+    pthread_mutex_lock(&g_mutex);
+    while (true) {
+        while (g_dispatchedEvents.empty() && !g_replayDone) {
+            pthread_cond_wait(&g_eventDispatched, &g_mutex);
+        }
+        if (g_dispatchedEvents.empty()) {
+            break;
+        }
+        unsigned int eventIndex = g_dispatchedEvents.front();
+        g_dispatchedEvents.pop_front();
+        pthread_mutex_unlock(&g_mutex);
+        processEvent(clnt, eventIndex);
+        pthread_mutex_lock(&g_mutex);
+        g_outstandingClients.erase(events[eventIndex].clientInfoIndex);
+        pthread_cond_signal(&g_eventComplete);
+    }
+    pthread_mutex_unlock(&g_mutex);
+    return NULL;
+}
+
+// Replay the events with up to windowSize outstanding events.
+// Events are dispatched in order, so an event that has to wait holds back the events after it.
+void replayEvents(PlacementController_clnt& clnt, unsigned int windowSize)
+{
+    // Create replay threads
+    vector<pthread_t> threadArray(windowSize);
+    for (unsigned int i = 0; i < windowSize; i++) {
+        int rc = pthread_create(&threadArray[i], NULL, replayThread, NULL);
+        if (rc) {
+            cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
+            exit(-1);
+        }
+    }
+    // Dispatch events
+    pthread_mutex_lock(&g_mutex);
+    for (unsigned int eventIndex = 0; eventIndex < events.size(); eventIndex++) {
+        const EventInfo& event = events[eventIndex];
+        if (event.type == EVENT_CONSOLIDATE) {
+            // Consolidate once all outstanding events are complete
+            while (!g_outstandingClients.empty()) {
+                pthread_cond_wait(&g_eventComplete, &g_mutex);
+            }
+            pthread_mutex_unlock(&g_mutex);
+            processEvent(clnt, eventIndex);
+            pthread_mutex_lock(&g_mutex);
+        } else {
+            // Each outstanding event is of a different workload, so the number of outstanding events is the number of outstanding workloads
+            while ((g_outstandingClients.size() >= windowSize) || (g_outstandingClients.find(event.clientInfoIndex) != g_outstandingClients.end())) {
+                pthread_cond_wait(&g_eventComplete, &g_mutex);
+            }
+            g_outstandingClients.insert(event.clientInfoIndex);
+            g_dispatchedEvents.push_back(eventIndex);
+            pthread_cond_signal(&g_eventDispatched);
+        }
+    }
+    // Wait for the replay threads to finish
+    g_replayDone = true;
+    pthread_cond_broadcast(&g_eventDispatched);
+    pthread_mutex_unlock(&g_mutex);
+    for (unsigned int i = 0; i < windowSize; i++) {
+        int rc = pthread_join(threadArray[i], NULL);
+        if (rc) {
+            cerr << "Error joining thread: " << rc << " errno: " << errno << endl;
+            exit(-1);
+        }
+    }
+}
+
+// Get the latency of each event and the throughput of a replay from replayStartTime to replayEndTime
+Json::Value getTimingResults(unsigned int windowSize, uint64_t replayStartTime, uint64_t replayEndTime)
+{
+    const char* typeNames[] = {"addClient", "delClient", "consolidate"};
+    Json::Value& clientInfos = rootConfig["clients"];
+    Json::Value timingInfo;
+    Json::Value& eventInfos = timingInfo["events"];
+    eventInfos = Json::Value(Json::arrayValue);
+    vector<double> latencies;
+    for (unsigned int eventIndex = 0; eventIndex < events.size(); eventIndex++) {
+        const EventInfo& event = events[eventIndex];
+        const EventTiming& timing = eventTimings[eventIndex];
+        double latency = ConvertTimeToSeconds(timing.endTime - timing.startTime);
+        latencies.push_back(latency);
+        Json::Value eventInfo;
+        eventInfo["type"] = Json::Value(typeNames[event.type]);
+        if (event.type == EVENT_CONSOLIDATE) {
+            eventInfo["maxServerHosts"] = Json::Value(event.clientInfoIndex);
+        } else {
+            eventInfo["name"] = clientInfos[event.clientInfoIndex]["name"];
+        }
+        if (event.type == EVENT_ADD_CLIENT) {
+            eventInfo["admitted"] = Json::Value(timing.admitted);
+        }
+        eventInfo["start"] = Json::Value(ConvertTimeToSeconds(timing.startTime - replayStartTime));
+        eventInfo["latency"] = Json::Value(latency);
+        eventInfos.append(eventInfo);
+    }
+    // Summarize the replay
+    double replaySeconds = ConvertTimeToSeconds(replayEndTime - replayStartTime);
+    timingInfo["windowSize"] = Json::Value(windowSize);
+    timingInfo["replaySeconds"] = Json::Value(replaySeconds);
+    timingInfo["eventsPerSecond"] = Json::Value((replaySeconds > 0) ? events.size() / replaySeconds : 0.0);
+    sort(latencies.begin(), latencies.end());
+    if (!latencies.empty()) {
+        double sum = 0;
+        for (vector<double>::const_iterator it = latencies.begin(); it != latencies.end(); it++) {
+            sum += *it;
+        }
+        timingInfo["meanLatency"] = Json::Value(sum / latencies.size());
+        timingInfo["medianLatency"] = Json::Value(latencies[latencies.size() / 2]);
+        timingInfo["p99Latency"] = Json::Value(latencies[(latencies.size() * 99) / 100]);
+        timingInfo["maxLatency"] = Json::Value(latencies.back());
+    }
+    return timingInfo;
+}
+
 int main(int argc, char** argv)
 {
     int opt = 0;
     char* topoFilename = NULL;
     char* eventFilename = NULL;
-    string serverAddr = "";
+    unsigned int windowSize = 1;
     do {
-        opt = getopt(argc, argv, "t:o:s:e:");
+        opt = getopt(argc, argv, "t:o:s:e:w:");
         switch (opt) {
             case 't':
                 topoFilename = optarg;
@@ -67,6 +298,10 @@ int main(int argc, char** argv)
                 eventFilename = optarg;
                 break;
 
+            case 'w':
+                windowSize = atoi(optarg);
+                break;
+
             case -1:
                 break;
 
@@ -75,8 +310,8 @@ int main(int argc, char** argv)
         }
     } while (opt != -1);
 
-    if ((topoFilename == NULL) || (outputFilename == NULL) || (serverAddr == "")) {
-        cout << "Usage: " << argv[0] << " -t topoFilename -o outputFilename -s serverAddr [-e eventFilename]" << endl;
+    if ((topoFilename == NULL) || (outputFilename == NULL) || (serverAddr == "") || (windowSize == 0)) {
+        cout << "Usage: " << argv[0] << " -t topoFilename -o outputFilename -s serverAddr [-e eventFilename] [-w windowSize]" << endl;
         return -1;
     }
 
@@ -107,48 +342,57 @@ int main(int argc, char** argv)
     }
     // Process events file, or by default add one of every client in order in topology file
     Json::Value& clientInfos = rootConfig["clients"];
-    vector<EventInfo> events;
     if (eventFilename) {
         ifstream file(eventFilename);
         if (file.is_open()) {
             string line;
             EventInfo event;
-            char isAdd[32];
+            char type[32];
             while (getline(file, line)) {
                 // Parse line
-                if (sscanf(line.c_str(), "%d,%[^,]", &event.clientInfoIndex, isAdd) == 2) {
-                    event.addClient = (strcmp(isAdd, "addClient") == 0);
+                if (sscanf(line.c_str(), "%d,%[^,]", &event.clientInfoIndex, type) == 2) {
+                    if (strcmp(type, "addClient") == 0) {
+                        event.type = EVENT_ADD_CLIENT;
+                    } else if (strcmp(type, "consolidate") == 0) {
+                        event.type = EVENT_CONSOLIDATE;
+                    } else {
+                        event.type = EVENT_DEL_CLIENT;
+                    }
+                    if ((event.type != EVENT_CONSOLIDATE) && (event.clientInfoIndex >= clientInfos.size())) {
+                        cerr << "Skipping event for unknown workload index " << event.clientInfoIndex << endl;
+                        continue;
+                    }
                     events.push_back(event);
                 }
             }
         }
     } else {
         EventInfo event;
-        event.addClient = true;
+        event.type = EVENT_ADD_CLIENT;
         for (event.clientInfoIndex = 0; event.clientInfoIndex < clientInfos.size(); event.clientInfoIndex++) {
             events.push_back(event);
         }
     }
+    eventTimings.resize(events.size());
+    addrPrefix = rootConfig["addrPrefix"].asString();
+    enforce = rootConfig.isMember("enforce") && rootConfig["enforce"].asBool();
     // Add/remove clients according to events
-    string addrPrefix = rootConfig["addrPrefix"].asString();
-    bool enforce = rootConfig.isMember("enforce") && rootConfig["enforce"].asBool();
-    for (unsigned int eventIndex = 0; eventIndex < events.size(); eventIndex++) {
-        const EventInfo& event = events[eventIndex];
-        Json::Value& clientInfo = clientInfos[event.clientInfoIndex];
-        if (event.addClient) {
-            bool admitted = clnt.addClient(clientInfo, addrPrefix, enforce);
-            if (admitted) {
-                cout << "Placed " << clientInfo["name"].asString() << " (" << clientInfo["clientHost"].asString() << ", " << clientInfo["clientVM"].asString() << ") -> (" << clientInfo["serverHost"].asString() << ", " << clientInfo["serverVM"].asString() << ")" << endl;
-            } else {
-                cout << "Rejected " << clientInfo["name"].asString() << endl;
-            }
-        } else {
-            clnt.delClient(clientInfo["name"].asString());
+    uint64_t replayStartTime = GetTime();
+    if (windowSize > 1) {
+        replayEvents(clnt, windowSize);
+    } else {
+        for (unsigned int eventIndex = 0; eventIndex < events.size(); eventIndex++) {
+            processEvent(clnt, eventIndex);
         }
     }
+    uint64_t replayEndTime = GetTime();
     // Write config
     if (!writeJson(outputFilename, rootConfig)) {
         return -1;
     }
+    // Write timing
+    if (!writeJson(string(outputFilename) + ".timing", getTimingResults(windowSize, replayStartTime, replayEndTime))) {
+        return -1;
+    }
     return 0;
 }
@@ -1,13 +1,39 @@
 // PlacementController.cpp - code for placing workloads on client/server machines.
 // Communicates with AdmissionController admission control servers to add workloads (a.k.a. clients) to the system.
-// Workloads are placed one by one onto servers in a first-fit fashion.
+// Workloads are placed one by one onto servers, which are tested in the order given by the placement policy (first-fit by default).
+// A headroom index tracks the rate and burst used by the admitted workloads at each queue along with the tightest SLO of the workloads using it,
+// as well as the slack and recent rejections reported by admission control at each server.
+// Servers where the long-term rate of the workload's flows would exceed a queue's bandwidth cannot fit the workload and are not tested,
+// and the policy uses the index to order the rest, e.g., so that the likely fits are tested first and a placement takes a handful of probes even at high utilization.
 // To improve the placement performance, multiple admission control servers can be used to run the computation in parallel.
 // Each admission control server is used to speculatively test the ability to place a workload onto a server.
-// This is done until a fit is found, at which point, the work to test the rest of the servers is canceled.
+// This is done until a fit is found, at which point, the work to test the rest of the servers is canceled,
+// including the servers being tested by other connections, whose EvaluatePlacements RPCs are canceled through a separate connection (see CancelEvaluation).
+// The servers are split evenly across the admission control connections, and each connection tests its servers in order with a single
+// EvaluatePlacements RPC that stops at the first fit, so each placement takes one round trip per connection rather than one per server.
 //
 // Command line parameters:
 // -a AdmissionControllerAddr (required) - the address of the AdmissionController server that determines if a workload can fit on a server; this command line option can be used multiple times to use multiple AdmissionController servers for performing the placement computation in parallel
 // -f (optional) - enables the fast-first-fit computation optimization, which tells the AdmissionController server to return early if a placement is unlikely to fit
+// -c numConnections (optional) - number of connections to each AdmissionController server, which should be at most the server's number of replicas (see AdmissionController's -r option); defaults to 1
+// -s (optional) - shards the cluster model across the AdmissionController servers rather than replicating it on each; each server host, along with its queues and workloads, is assigned to the AdmissionController server with the fewest server hosts, which tests all placements on it
+// -d pipelineDepth (optional) - number of workloads of an AddClients batch that are tested concurrently; outcomes are committed in batch order and workloads are tested again if a placement committed in the meantime is connected to their candidates, so the placements are the same as placing the workloads one by one; defaults to 1
+// -o policy (optional) - order in which servers are tested: firstfit (servers in order), bestfit (least residual rate first), worstfit (most residual rate first), or likely (most likely to fit first); defaults to firstfit
+// -b maxReorders (optional) - places the workloads of an AddClients batch in decreasing order of their estimated load (see getPlacementLoad), i.e., first-fit-decreasing with the firstfit policy;
+//                             if a workload does not fit, the batch is placed again with the workload moved to the front, up to maxReorders times, before the batch is rejected
+// -M [metricsAddr:]metricsPort (optional) - TCP port serving the hot path metrics in the Prometheus text format (see common/metrics.hpp); binds to loopback unless metricsAddr is given
+//
+// Each connection has a worker thread that speculatively tests placements, while the model of each AdmissionController server is updated once through an additional connection.
+// Workers test the candidates of the earliest pending workload of a batch first, so later workloads (see -d) use workers that would otherwise wait for the slowest candidates.
+// When sharded (-s), the network queues of client hosts are added to every AdmissionController server, but a client host is only given to workloads of one shard at a time
+// (see clientServerPlacement), so all flows of each queue are in the same shard and admission decisions are the same as with the whole model.
+//
+// Placements are never revisited as workloads come and go, so the PlanConsolidation RPC computes the moves of workloads that would empty the least loaded server hosts onto the
+// server hosts that stay in use. Each move is tested like a placement and tentatively added with the earlier moves, with the workloads still at their sources,
+// so operators can apply the moves in order and in batches (e.g., by deleting each workload and adding it back as admitted on its new server) while the workloads keep meeting their SLOs.
+//
+// Each placement has a trace ID that is sent with its EvaluatePlacements and AddClient RPCs, so the slow spans recorded by the AdmissionController servers
+// (see common/metrics.hpp) can be matched up with the placement's. The metrics of the placements, e.g., their latency and number of probes, are returned by the GetMetrics RPC.
 //
 // Copyright (c) 2017 Timothy Zhu.
 // Licensed under the MIT License. See LICENSE file for details.
@@ -21,6 +47,8 @@
 #include <set>
 #include <map>
 #include <string>
+#include <algorithm>
+#include <limits>
 #include <cstdlib>
 #include <unistd.h>
 #include <cerrno>
@@ -32,242 +60,743 @@
 #include <json/json.h>
 #include "../common/time.hpp"
 #include "../common/common.hpp"
+#include "../common/metrics.hpp"
 #include "../DNC-Library/NCConfig.hpp"
+#include "PlacementModel.hpp"
 
 using namespace std;
 
-struct WorkloadInfo {
-    string name;
-    string clientHost;
-    string clientVM;
-    string serverHost;
-    string serverVM;
+// Shard of the cluster model, i.e., a set of server hosts along with their queues, whose placements are tested by the shard's own connections.
+// Without sharding, a single shard holds all servers and its model is replicated on all AdmissionController servers.
+struct Shard {
+    vector<AdmissionController_clnt*> clnts; // connections used by the shard's worker threads
+    vector<AdmissionController_clnt*> modelClnts; // one connection to each AdmissionController server holding the shard's model
+    unsigned int numServerHosts; // number of server hosts in the shard
+};
+
+// Candidates of a pending placement in a shard.
+// Workers claim consecutive entries of the work queue, and canceling lowers the end of the work queue.
+struct ShardWork {
+    vector<unsigned int> workQueue; // indexes of the candidates in the shard in increasing order, which are fixed once the candidates are chosen
+    unsigned int nextWorkQueueIndex; // next index in workQueue to test, which may be past the end
+    unsigned int workQueueEnd; // entries from this index on are canceled
+    unsigned int workBatchSize; // number of consecutive work queue entries tested by a worker with a single RPC
+};
+
+// Batch of candidates being tested by a worker with an EvaluatePlacements RPC
+struct InFlightWork {
+    uint64_t evaluationId; // identifies the RPC for canceling the rest of the batch
+    unsigned int addrIndex; // index of the AdmissionController server testing the batch
+    unsigned int shardIndex;
+    unsigned int workQueueIndex; // first entry of the batch in the shard's work queue
+    unsigned int count; // number of entries of the batch that have not been canceled
+};
+
+// Cancellation of the rest of an in-flight batch, which is sent once g_mutex is released (see sendCancellations)
+struct Cancellation {
+    unsigned int addrIndex;
+    uint64_t evaluationId;
+    unsigned int numPlacements; // number of candidates of the batch that are still tested
+};
+
+// Workload whose candidate servers are being tested.
+// Several workloads of a batch are tested concurrently, and their outcomes are committed in order (see placement_controller_add_clients_svc).
+struct PendingPlacement {
+    Json::Value* clientInfo;
+    string addrPrefix;
+    uint64_t traceId; // see ScopedTraceId
+    uint64_t startTime; // time the workload started being tested
+    vector<TemplateFlow> flows;
+    double SLO;
+    unsigned int numCommitted; // number of placements of the batch committed when the candidates were chosen
+    vector<PlacementCandidate> candidates; // candidates in the policy's order
+    vector<ShardWork> shardWork; // candidates split by shard
+    list<InFlightWork> inFlight; // batches of candidates being tested
+    unsigned int bestIndex; // index of best candidate (i.e., lowest index, since candidates are in the policy's order)
+    double bestSlack; // slack reported for the best candidate
+    vector<unsigned int> rejections; // candidates that rejected the workload, which are recorded in the headroom index once committed
+};
+
+// Groups of connected queues, i.e., queues connected through the workloads using them
+struct QueueGroups {
+    map<string, string> parents; // union-find forest by queue name
+
+    // Return the name of the queue representing a queue's group
+    string find(const string& queueName)
+    {
+        map<string, string>::iterator it = parents.find(queueName);
+        if (it == parents.end()) {
+            return queueName;
+        }
+        string root = find(it->second);
+        it->second = root;
+        return root;
+    }
+    // Merge the groups of two queues
+    void merge(const string& queueName1, const string& queueName2)
+    {
+        string root1 = find(queueName1);
+        string root2 = find(queueName2);
+        if (root1 != root2) {
+            parents[root1] = root2;
+        }
+    }
+};
+
+// Worker thread's connection
+struct Worker {
+    AdmissionController_clnt* clnt;
+    unsigned int addrIndex; // index of the AdmissionController server (see g_cancelClnts)
+    unsigned int shardIndex;
 };
 
 //
 // Globals fixed at init
 //
 vector<AdmissionController_clnt*> g_clnts; // connections to AdmissionController servers that perform most of the computation; many are used for computation parallelism
+vector<AdmissionController_clnt*> g_modelClnts; // one connection to each AdmissionController server for updating its model
+vector<AdmissionController_clnt*> g_cancelClnts; // one connection to each AdmissionController server for canceling the rest of in-flight batches, protected by g_cancelMutex
 bool g_fastFirstFit = false; // enable fast-first-fit computation optimization
+unsigned int g_pipelineDepth = 1; // number of workloads of a batch tested concurrently
+bool g_batchOrder = false; // place the workloads of a batch in decreasing order of their estimated load
+unsigned int g_maxReorders = 0; // number of times a batch is placed again with a workload that did not fit moved to the front
 
 //
 // Globals protected by g_mutex
 //
 pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
-map<string, set<string> > g_servers; // map serverHost -> serverVMs
-map<string, set<string> > g_clients; // map clientHost -> clientVMs
-map<string, string> g_serverClientGrouping; // map serverHost -> clientHost to group workloads that share the same server onto the same client
-list<WorkloadInfo> g_workloads; // list of workloads in system
+PlacementModel g_model; // hosts, workloads, and headroom index; also holds the sharding and placement policy, which are fixed at init
+vector<Shard> g_shards; // shards of the model; the set of shards and their connections are fixed at init
 // manage placement work queue
 pthread_cond_t g_workAvailable = PTHREAD_COND_INITIALIZER; // indicates there is work to do
-pthread_cond_t g_workComplete = PTHREAD_COND_INITIALIZER; // indicates current placement is complete
-Json::Value* g_currentClientInfo = NULL; // current workload to place
-string g_currentAddrPrefix = ""; // current addrPrefix
-vector<pair<string, string> > g_workQueue; // work queue consists of a list of serverHost/serverVM pairs to try placing the current workload onto
-unsigned int g_outstandingWork = 0; // number of placements being tested concurrently
-unsigned int g_nextWorkQueueIndex = 0; // next index in work queue to test
-unsigned int g_bestWorkQueueIndex; // index of best server (i.e., lowest index for first-fit)
-
-// Decides which client VM to place a workload on.
-// The current algorithm groups workloads that share a server onto the same client machine.
-// This is because their performance is already correlated by sharing a server, so it's better
-// to continue sharing so as not to introduce additional correlations with other workloads.
+pthread_cond_t g_workComplete = PTHREAD_COND_INITIALIZER; // indicates a pending placement is complete
+list<PendingPlacement*> g_pendingPlacements; // workloads being tested in batch order, which workers test earliest first
+uint64_t g_nextEvaluationId = 0; // evaluationId of the next batch of candidates, which is unique across PlacementController processes (see main)
+uint64_t g_nextTraceId = 0; // trace ID of the next placement, which is unique across PlacementController processes (see main)
+QueueGroups g_queueGroups; // groups of the queues connected through the placed workloads, which are merged as workloads are added (see getQueueGroups)
+bool g_queueGroupsStale = true; // workloads were removed since g_queueGroups was built, so groups may need to be split
+
+pthread_mutex_t g_cancelMutex = PTHREAD_MUTEX_INITIALIZER; // serializes the CancelEvaluation RPCs on g_cancelClnts; acquired after g_mutex if both are held
+
+//
+// Metrics
+//
+MetricHistogram g_placementTime("placement_seconds", "Time from when a workload starts being tested until its placement is committed");
+MetricHistogram g_evaluateTime("placement_evaluate_rpc_seconds", "Time spent in EvaluatePlacements RPCs of worker threads");
+MetricHistogram g_commitTime("placement_commit_seconds", "Time spent committing placements, including adding admitted workloads to the AdmissionController servers");
+MetricHistogram g_addClientsTime("placement_add_clients_seconds", "Time spent handling AddClients RPCs");
+MetricCounter g_probes("placement_probes_total", "Number of candidate servers tested");
+MetricCounter g_retests("placement_retests_total", "Number of times a workload is tested again since a placement committed in the meantime may change its outcome");
+MetricCounter g_admitted("placement_admitted_total", "Number of placements committed with the workload admitted");
+MetricCounter g_rejected("placement_rejected_total", "Number of placements committed with the workload rejected");
+
+//
+// Manage shards
+//
+// Assign a new server host to the shard with the fewest server hosts and return its index
 // Assumes g_mutex is held
-pair<string, string> clientServerPlacement(string serverHost)
+unsigned int assignShard(string serverHost)
 {
-    string clientHost;
-    map<string, string>::const_iterator it = g_serverClientGrouping.find(serverHost);
-    if (it != g_serverClientGrouping.end()) {
-        clientHost = it->second;
-        const set<string>& clientVMs = g_clients[clientHost];
-        if (!clientVMs.empty()) {
-            return pair<string, string>(clientHost, *(clientVMs.begin()));
-        }
-    }
-    // Check for other workloads using server
-    for (list<WorkloadInfo>::iterator it2 = g_workloads.begin(); it2 != g_workloads.end(); it2++) {
-        if (it2->serverHost == serverHost) {
-            clientHost = it2->clientHost;
-            const set<string>& clientVMs = g_clients[clientHost];
-            if (!clientVMs.empty()) {
-                return pair<string, string>(clientHost, *(clientVMs.begin()));
-            }
-        }
-    }
-    // Look for a client to use
-    unsigned int maxAvailableClients = 0;
-    for (map<string, set<string> >::const_iterator it3 = g_clients.begin(); it3 != g_clients.end(); it3++) {
-        if (it3->second.size() > maxAvailableClients) {
-            maxAvailableClients = it3->second.size();
-            clientHost = it3->first;
+    unsigned int shardIndex = 0;
+    for (unsigned int i = 1; i < g_shards.size(); i++) {
+        if (g_shards[i].numServerHosts < g_shards[shardIndex].numServerHosts) {
+            shardIndex = i;
         }
     }
-    if (maxAvailableClients <= 0) {
-        cerr << "Out of client machines" << endl;
-        exit(-1);
-    }
-    return pair<string, string>(clientHost, *(g_clients[clientHost].begin()));
+    g_shards[shardIndex].numServerHosts++;
+    g_model.serverShards[serverHost] = shardIndex;
+    return shardIndex;
 }
 
 //
 // Manage placement work queue
 //
+// Check if a pending placement has candidates that have not been given to a worker.
+// Assumes g_mutex is held
+bool workRemaining(const PendingPlacement& placement)
+{
+    for (vector<ShardWork>::const_iterator it = placement.shardWork.begin(); it != placement.shardWork.end(); it++) {
+        if (it->nextWorkQueueIndex < it->workQueueEnd) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Check if all candidates of a pending placement have been tested or canceled.
+// Assumes g_mutex is held
+bool placementDone(const PendingPlacement& placement)
+{
+    return placement.inFlight.empty() && !workRemaining(placement);
+}
+
+// Claim up to workBatchSize consecutive entries of a shard's work queue, returning the index of the first of count entries; returns false if none are left.
+// Assumes g_mutex is held
+bool claimWork(ShardWork& work, unsigned int& workQueueIndex, unsigned int& count)
+{
+    if (work.nextWorkQueueIndex >= work.workQueueEnd) {
+        return false;
+    }
+    workQueueIndex = work.nextWorkQueueIndex;
+    count = min(work.workBatchSize, work.workQueueEnd - workQueueIndex);
+    work.nextWorkQueueIndex += count;
+    return true;
+}
+
+// Cancel the entries of a shard's work queue from workQueueEnd on that have not been claimed
+// Assumes g_mutex is held
+void cancelWorkQueue(ShardWork& work, unsigned int workQueueEnd)
+{
+    work.workQueueEnd = min(work.workQueueEnd, workQueueEnd);
+}
+
+// Returns the earliest pending placement with candidates in the worker's shard to test, along with the index in its shard work queue of the first of count consecutive entries.
+// The entries are tracked as an in-flight batch with the given evaluationId until workComplete.
 // Assumes g_mutex is held
-unsigned int nextWork()
+PendingPlacement* nextWork(const Worker& worker, unsigned int& workQueueIndex, unsigned int& count, uint64_t& evaluationId)
 {
-    while (g_nextWorkQueueIndex >= g_workQueue.size()) {
+    while (true) {
+        for (list<PendingPlacement*>::const_iterator it = g_pendingPlacements.begin(); it != g_pendingPlacements.end(); it++) {
+            if (claimWork((*it)->shardWork[worker.shardIndex], workQueueIndex, count)) {
+                InFlightWork inFlight;
+                inFlight.evaluationId = g_nextEvaluationId++;
+                inFlight.addrIndex = worker.addrIndex;
+                inFlight.shardIndex = worker.shardIndex;
+                inFlight.workQueueIndex = workQueueIndex;
+                inFlight.count = count;
+                (*it)->inFlight.push_back(inFlight);
+                evaluationId = inFlight.evaluationId;
+                return *it;
+            }
+        }
         pthread_cond_wait(&g_workAvailable, &g_mutex);
     }
-    unsigned int workQueueIndex = g_nextWorkQueueIndex;
-    g_nextWorkQueueIndex++;
-    g_outstandingWork++;
-    return workQueueIndex;
 }
 
+// Cancel the candidates of a pending placement from numCandidates on, adding the cancellations of in-flight batches to cancellations.
+// Candidates before it are still tested, since each shard's candidates are given to workers separately.
+// Assumes g_mutex is held
+void cancelWork(PendingPlacement& placement, unsigned int numCandidates, vector<Cancellation>& cancellations)
+{
+    for (vector<ShardWork>::iterator it = placement.shardWork.begin(); it != placement.shardWork.end(); it++) {
+        cancelWorkQueue(*it, lower_bound(it->workQueue.begin(), it->workQueue.end(), numCandidates) - it->workQueue.begin());
+    }
+    for (list<InFlightWork>::iterator it = placement.inFlight.begin(); it != placement.inFlight.end(); it++) {
+        vector<unsigned int>::const_iterator first = placement.shardWork[it->shardIndex].workQueue.begin() + it->workQueueIndex;
+        unsigned int numPlacements = lower_bound(first, first + it->count, numCandidates) - first;
+        if (numPlacements < it->count) {
+            it->count = numPlacements;
+            Cancellation cancellation;
+            cancellation.addrIndex = it->addrIndex;
+            cancellation.evaluationId = it->evaluationId;
+            cancellation.numPlacements = numPlacements;
+            cancellations.push_back(cancellation);
+        }
+    }
+}
+
+// Send the cancellations of in-flight batches
+void sendCancellations(const vector<Cancellation>& cancellations)
+{
+    pthread_mutex_lock(&g_cancelMutex);
+    for (vector<Cancellation>::const_iterator it = cancellations.begin(); it != cancellations.end(); it++) {
+        g_cancelClnts[it->addrIndex]->cancelEvaluation(it->evaluationId, it->numPlacements);
+    }
+    pthread_mutex_unlock(&g_cancelMutex);
+}
+
+// Complete the in-flight batch evaluationId from nextWork; candidateIndex is the candidate where the workload was admitted, if admitted, with the given slack.
+// Candidates after the fit are canceled, and the cancellations of other in-flight batches are added to cancellations.
 // Assumes g_mutex is held
-void workComplete(unsigned int workQueueIndex, bool admitted)
+void workComplete(PendingPlacement& placement, uint64_t evaluationId, unsigned int candidateIndex, bool admitted, double slack, vector<Cancellation>& cancellations)
 {
-    g_outstandingWork--;
+    list<InFlightWork>::iterator it = placement.inFlight.begin();
+    while (it->evaluationId != evaluationId) {
+        it++;
+    }
+    placement.inFlight.erase(it);
     if (admitted) {
-        // Cancel remaining global work (optimization)
-        g_nextWorkQueueIndex = g_workQueue.size();
+        // Cancel remaining work of the placement after the fit (optimization)
+        cancelWork(placement, candidateIndex + 1, cancellations);
         // Track best placement
-        if (workQueueIndex < g_bestWorkQueueIndex) {
-            g_bestWorkQueueIndex = workQueueIndex;
+        if (candidateIndex < placement.bestIndex) {
+            placement.bestIndex = candidateIndex;
+            placement.bestSlack = slack;
         }
     }
     // Check if done with client
-    if ((g_outstandingWork == 0) && (g_nextWorkQueueIndex >= g_workQueue.size())) {
-        pthread_cond_signal(&g_workComplete);
+    if (placementDone(placement)) {
+        pthread_cond_broadcast(&g_workComplete);
     }
 }
 
 void* workerThread(void* ptr)
 {
-    AdmissionController_clnt* clnt = static_cast<AdmissionController_clnt*>(ptr);
+    Worker* worker = static_cast<Worker*>(ptr);
+    AdmissionController_clnt* clnt = worker->clnt;
     pthread_mutex_lock(&g_mutex);
     while (true) {
-        unsigned int workQueueIndex = nextWork();
-        pair<string, string> server = g_workQueue[workQueueIndex];
-        pair<string, string> client = clientServerPlacement(server.first);
+        unsigned int workQueueIndex = 0;
+        unsigned int count = 0;
+        uint64_t evaluationId = 0;
+        PendingPlacement* placement = nextWork(*worker, workQueueIndex, count, evaluationId);
+        const vector<unsigned int>& workQueue = placement->shardWork[worker->shardIndex].workQueue;
+        // Get candidate client/server placements
+        Json::Value placements(Json::arrayValue);
+        for (unsigned int i = 0; i < count; i++) {
+            const PlacementCandidate& candidate = placement->candidates[workQueue[workQueueIndex + i]];
+            Json::Value placementInfo;
+            placementInfo["clientHost"] = Json::Value(candidate.client.first);
+            placementInfo["clientVM"] = Json::Value(candidate.client.second);
+            placementInfo["serverHost"] = Json::Value(candidate.server.first);
+            placementInfo["serverVM"] = Json::Value(candidate.server.second);
+            placements.append(placementInfo);
+        }
         // Make a copy of clientInfo
-        Json::Value clientInfo = *g_currentClientInfo;
+        Json::Value clientInfo = *placement->clientInfo;
+        string addrPrefix = placement->addrPrefix;
+        ScopedTraceId traceId(placement->traceId);
         pthread_mutex_unlock(&g_mutex);
 
-        // Update client/server
-        clientInfo["clientHost"] = Json::Value(client.first);
-        clientInfo["clientVM"] = Json::Value(client.second);
-        clientInfo["serverHost"] = Json::Value(server.first);
-        clientInfo["serverVM"] = Json::Value(server.second);
-        // Convert clientInfo using NC-ConfigGen
-        configGenClient(clientInfo, clientInfo["name"].asString(), g_currentAddrPrefix, false);
-        bool admitted = clnt->addClient(clientInfo, g_fastFirstFit);
-        if (admitted) {
-            clnt->delClient(clientInfo["name"].asString());
+        // Test placements in order until the workload fits or the rest are canceled; AdmissionController converts clientInfo using NC-ConfigGen once and fills in each placement
+        vector<PlacementEvaluation> evaluations;
+        {
+            ScopedTimer timer(g_evaluateTime);
+            evaluations = clnt->evaluatePlacements(clientInfo, addrPrefix, placements, g_fastFirstFit, true, evaluationId);
         }
+        g_probes.add(evaluations.size());
+        bool admitted = !evaluations.empty() && evaluations.back().admitted;
 
         pthread_mutex_lock(&g_mutex);
-        workComplete(workQueueIndex, admitted);
+        // Keep rejections for the headroom index, which is updated once the placement is committed
+        for (unsigned int i = 0; i < evaluations.size(); i++) {
+            if (!evaluations[i].admitted) {
+                placement->rejections.push_back(workQueue[workQueueIndex + i]);
+            }
+        }
+        vector<Cancellation> cancellations;
+        if (admitted) {
+            workComplete(*placement, evaluationId, workQueue[workQueueIndex + evaluations.size() - 1], true, evaluations.back().slack, cancellations);
+        } else {
+            workComplete(*placement, evaluationId, 0, false, 0, cancellations);
+        }
+        // Stop the other workers testing candidates after the fit
+        if (!cancellations.empty()) {
+            pthread_mutex_unlock(&g_mutex);
+            sendCancellations(cancellations);
+            pthread_mutex_lock(&g_mutex);
+        }
     }
     pthread_mutex_unlock(&g_mutex);
     return NULL;
 }
 
-// Decides which server VM to place a workload on.
-// Assumes called from single thread
+// Choose the candidate servers of a pending placement based on the committed placements and give them to the workers.
+// numCommitted is the number of placements of the batch committed so far.
 // Assumes g_mutex is held
-bool placeClient(Json::Value& clientInfo, string addrPrefix, bool enforce)
+void startPlacement(PendingPlacement& placement, unsigned int numCommitted)
 {
-    assert(g_currentClientInfo == NULL);
-    assert(g_currentAddrPrefix == "");
-    assert(g_workQueue.empty());
-    assert(g_nextWorkQueueIndex == 0);
-    g_currentClientInfo = &clientInfo;
-    g_currentAddrPrefix = addrPrefix;
+    Json::Value& clientInfo = *placement.clientInfo;
+    placement.numCommitted = numCommitted;
+    placement.rejections.clear();
+    placement.shardWork.clear();
+    placement.shardWork.resize(g_shards.size());
+    for (vector<ShardWork>::iterator it = placement.shardWork.begin(); it != placement.shardWork.end(); it++) {
+        it->nextWorkQueueIndex = 0;
+        it->workQueueEnd = 0;
+        it->workBatchSize = 1;
+    }
     // Check if admitted already
     if (clientInfo.isMember("admitted") && clientInfo["admitted"].asBool()) {
-        g_workQueue.push_back(pair<string, string>(clientInfo["serverHost"].asString(), clientInfo["serverVM"].asString()));
-        g_bestWorkQueueIndex = 0;
-    } else {
-        // Add work in first fit order
-        for (map<string, set<string> >::const_iterator it = g_servers.begin(); it != g_servers.end(); it++) {
-            string serverHost = it->first;
-            const set<string>& serverVMs = it->second;
-            for (set<string>::const_iterator it2 = serverVMs.begin(); it2 != serverVMs.end(); it2++) {
-                string serverVM = *it2;
-                g_workQueue.push_back(pair<string, string>(serverHost, serverVM));
-            }
+        placement.candidates.resize(1);
+        PlacementCandidate& candidate = placement.candidates.back();
+        candidate.server = pair<string, string>(clientInfo["serverHost"].asString(), clientInfo["serverVM"].asString());
+        candidate.client = g_model.clientServerPlacement(candidate.server.first);
+        placement.bestIndex = 0;
+        placement.bestSlack = numeric_limits<double>::infinity();
+        return;
+    }
+    placement.candidates = g_model.getCandidates(placement.flows, placement.SLO);
+    placement.bestIndex = placement.candidates.size();
+    // Split work by shard and evenly across each shard's workers, so each worker tests its share of the servers with a single RPC
+    for (unsigned int i = 0; i < placement.candidates.size(); i++) {
+        placement.shardWork[g_model.getShard(placement.candidates[i].server.first)].workQueue.push_back(i);
+    }
+    for (unsigned int shardIndex = 0; shardIndex < g_shards.size(); shardIndex++) {
+        ShardWork& work = placement.shardWork[shardIndex];
+        work.workQueueEnd = work.workQueue.size();
+        work.workBatchSize = (work.workQueue.size() + g_shards[shardIndex].clnts.size() - 1) / g_shards[shardIndex].clnts.size();
+    }
+    pthread_cond_broadcast(&g_workAvailable);
+}
+
+// Merge the groups of the queues used by a workload
+void mergeQueueGroups(QueueGroups& groups, const WorkloadInfo& workloadInfo)
+{
+    vector<string> queues = getPlacementQueues(workloadInfo.clientHost, workloadInfo.serverHost, workloadInfo.serverVM);
+    for (unsigned int i = 1; i < queues.size(); i++) {
+        groups.merge(queues[0], queues[i]);
+    }
+}
+
+// Get the groups of the queues connected through the placed workloads.
+// The groups are only rebuilt from all workloads after workloads were removed, since removing workloads may split groups.
+// Assumes g_mutex is held
+QueueGroups& getQueueGroups()
+{
+    if (g_queueGroupsStale) {
+        g_queueGroups = QueueGroups();
+        for (WorkloadRegistry::const_iterator it = g_model.workloads.begin(); it != g_model.workloads.end(); it++) {
+            mergeQueueGroups(g_queueGroups, *it);
         }
-        g_bestWorkQueueIndex = g_workQueue.size();
-        pthread_cond_broadcast(&g_workAvailable);
-        // Wait for work to complete
-        while ((g_outstandingWork > 0) || (g_nextWorkQueueIndex < g_workQueue.size())) {
-            pthread_cond_wait(&g_workComplete, &g_mutex);
+        g_queueGroupsStale = false;
+    }
+    return g_queueGroups;
+}
+
+// Check if the outcome of a pending placement is the same as if its candidates were tested after the placements committed since they were chosen,
+// i.e., the candidates up to the first fit would be the same, with the same clients, and none of the committed workloads are connected to them.
+// Workloads are connected through the queues they use, and the admission decisions at a candidate only depend on the workloads connected to it.
+// committedQueues are the queues used by each placement of the batch committed so far.
+// Assumes g_mutex is held
+bool placementValid(const PendingPlacement& placement, const vector<vector<string> >& committedQueues)
+{
+    if (placement.numCommitted == committedQueues.size()) {
+        return true;
+    }
+    // Check if admitted already, in which case only the client may change
+    const Json::Value& clientInfo = *placement.clientInfo;
+    if (clientInfo.isMember("admitted") && clientInfo["admitted"].asBool()) {
+        const PlacementCandidate& candidate = placement.candidates.front();
+        return (candidate.client == g_model.clientServerPlacement(candidate.server.first));
+    }
+    // Check the candidates up to the first fit
+    unsigned int numTested = min(placement.bestIndex + 1, (unsigned int)placement.candidates.size());
+    vector<PlacementCandidate> candidates = g_model.getCandidates(placement.flows, placement.SLO);
+    if ((candidates.size() < numTested) || ((numTested == placement.candidates.size()) && (candidates.size() != numTested))) {
+        return false;
+    }
+    for (unsigned int i = 0; i < numTested; i++) {
+        if ((candidates[i].server != placement.candidates[i].server) || (candidates[i].client != placement.candidates[i].client)) {
+            return false;
+        }
+    }
+    // Get the groups of connected queues
+    QueueGroups& groups = getQueueGroups();
+    set<string> testedGroups;
+    for (unsigned int i = 0; i < numTested; i++) {
+        const PlacementCandidate& candidate = placement.candidates[i];
+        vector<string> queues = getPlacementQueues(candidate.client.first, candidate.server.first, candidate.server.second);
+        for (vector<string>::const_iterator it = queues.begin(); it != queues.end(); it++) {
+            testedGroups.insert(groups.find(*it));
         }
     }
+    for (unsigned int commit = placement.numCommitted; commit < committedQueues.size(); commit++) {
+        for (vector<string>::const_iterator it = committedQueues[commit].begin(); it != committedQueues[commit].end(); it++) {
+            if (testedGroups.find(groups.find(*it)) != testedGroups.end()) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Commit the outcome of a pending placement, adding the workload to the system if admitted; returns whether the workload was admitted.
+// Assumes g_mutex is held
+bool commitPlacement(PendingPlacement& placement, bool enforce)
+{
+    ScopedTimer timer(g_commitTime);
+    Json::Value& clientInfo = *placement.clientInfo;
+    string addrPrefix = placement.addrPrefix;
+    Json::Value originalInfo = clientInfo;
+    // Record rejections in the headroom index
+    for (vector<unsigned int>::const_iterator it = placement.rejections.begin(); it != placement.rejections.end(); it++) {
+        g_model.serverHeadroom[placement.candidates[*it].server].rejections++;
+    }
     // Get results
-    bool admitted = (g_bestWorkQueueIndex < g_workQueue.size());
+    bool admitted = (placement.bestIndex < placement.candidates.size());
     if (admitted) {
         // Mark admitted
         clientInfo["admitted"] = Json::Value(true);
-        pair<string, string> server = g_workQueue[g_bestWorkQueueIndex];
-        pair<string, string> client = clientServerPlacement(server.first);
+        pair<string, string> server = placement.candidates[placement.bestIndex].server;
+        pair<string, string> client = placement.candidates[placement.bestIndex].client;
         clientInfo["clientHost"] = Json::Value(client.first);
         clientInfo["clientVM"] = Json::Value(client.second);
         clientInfo["serverHost"] = Json::Value(server.first);
         clientInfo["serverVM"] = Json::Value(server.second);
         // Convert clientInfo using NC-ConfigGen
         string clientName = clientInfo["name"].asString();
+        unsigned int shardIndex = g_model.getShard(server.first);
+        const vector<AdmissionController_clnt*>& modelClnts = g_shards[shardIndex].modelClnts;
         if (enforce) {
             Json::Value clientInfoCopy = clientInfo;
             configGenClient(clientInfoCopy, clientName, addrPrefix, true);
             configGenClient(clientInfo, clientName, addrPrefix, false);
-            g_clnts[0]->addClient(clientInfoCopy, g_fastFirstFit);
+            modelClnts[0]->addClient(clientInfoCopy, g_fastFirstFit);
         } else {
             configGenClient(clientInfo, clientName, addrPrefix, false);
-            g_clnts[0]->addClient(clientInfo, g_fastFirstFit);
+            modelClnts[0]->addClient(clientInfo, g_fastFirstFit);
         }
-        // Update all remaining clnts
-        for (unsigned int index = 1; index < g_clnts.size(); index++) {
-            g_clnts[index]->addClient(clientInfo, g_fastFirstFit);
+        // Update all remaining clnts of the shard
+        for (unsigned int index = 1; index < modelClnts.size(); index++) {
+            modelClnts[index]->addClient(clientInfo, g_fastFirstFit);
         }
-        // Mark client as used
-        g_serverClientGrouping[server.first] = client.first;
-        g_clients[client.first].erase(client.second);
-        // Add workload info
+        // Add workload info, marking client as used and updating headroom index
         WorkloadInfo workloadInfo;
         workloadInfo.name = clientName;
         workloadInfo.clientHost = client.first;
         workloadInfo.clientVM = client.second;
         workloadInfo.serverHost = server.first;
         workloadInfo.serverVM = server.second;
-        g_workloads.push_back(workloadInfo);
+        workloadInfo.SLO = placement.SLO;
+        workloadInfo.demands = g_model.getDemands(placement.flows, getPlacementQueues(client.first, server.first, server.second));
+        workloadInfo.clientInfo = originalInfo;
+        workloadInfo.addrPrefix = addrPrefix;
+        g_model.addWorkload(workloadInfo, placement.bestSlack);
+        if (!g_queueGroupsStale) {
+            mergeQueueGroups(g_queueGroups, workloadInfo);
+        }
     }
-    g_currentClientInfo = NULL;
-    g_currentAddrPrefix = "";
-    g_workQueue.clear();
-    g_nextWorkQueueIndex = 0;
     return admitted;
 }
 
+// Decides which server VM to place the workload clientInfos[index] of a batch on; workloads are placed in batch order.
+// The workloads after it, up to g_pipelineDepth in total, are tested concurrently based on the placements committed so far.
+// If placements committed after a workload's candidates were chosen may change its outcome (see placementValid), it is tested again,
+// so the outcome is the same as placing the workloads one by one.
+// committedQueues are the queues used by the placements of the batch committed so far.
+// Assumes called from single thread
+// Assumes g_mutex is held
+bool placeClient(Json::Value& clientInfos, unsigned int index, string addrPrefix, bool enforce, vector<vector<string> >& committedQueues)
+{
+    // Start testing the next workloads
+    for (unsigned int i = index + g_pendingPlacements.size(); (i < clientInfos.size()) && (i < index + g_pipelineDepth); i++) {
+        PendingPlacement* placement = new PendingPlacement;
+        placement->clientInfo = &clientInfos[i];
+        placement->addrPrefix = addrPrefix;
+        placement->flows = getTemplateFlows(clientInfos[i], addrPrefix);
+        placement->SLO = clientInfos[i]["SLO"].asDouble();
+        placement->traceId = g_nextTraceId++;
+        placement->startTime = GetTime();
+        g_pendingPlacements.push_back(placement);
+        startPlacement(*placement, committedQueues.size());
+    }
+    // Wait for the workload to be tested until its outcome is valid
+    PendingPlacement* placement = g_pendingPlacements.front();
+    assert(placement->clientInfo == &clientInfos[index]);
+    while (true) {
+        while (!placementDone(*placement)) {
+            pthread_cond_wait(&g_workComplete, &g_mutex);
+        }
+        if (placementValid(*placement, committedQueues)) {
+            break;
+        }
+        g_retests.add();
+        startPlacement(*placement, committedQueues.size());
+    }
+    g_pendingPlacements.pop_front();
+    ScopedTraceId traceId(placement->traceId);
+    bool admitted = commitPlacement(*placement, enforce);
+    recordSpan(g_placementTime, placement->startTime);
+    (admitted ? g_admitted : g_rejected).add();
+    if (admitted) {
+        const WorkloadInfo& workloadInfo = g_model.workloads.back();
+        committedQueues.push_back(getPlacementQueues(workloadInfo.clientHost, workloadInfo.serverHost, workloadInfo.serverVM));
+    }
+    delete placement;
+    return admitted;
+}
+
+// Estimated load of a workload of a batch, which orders the batch (see getBatchOrder)
+struct BatchLoad {
+    double load; // see getPlacementLoad
+    double SLO;
+    unsigned int index; // index of the workload in the batch
+};
+
+// Order workloads by decreasing load, then by increasing SLO, since workloads with tighter SLOs leave less room for the bursts of others
+bool batchLoadBefore(const BatchLoad& l1, const BatchLoad& l2)
+{
+    if (l1.load != l2.load) {
+        return l1.load > l2.load;
+    }
+    return l1.SLO < l2.SLO;
+}
+
+// Return the order in which the workloads of a batch are placed, i.e., the indexes of the workloads in the batch.
+// Workloads are placed in the given order or, if g_batchOrder is set, in decreasing order of their estimated load.
+// Assumes g_mutex is held
+vector<unsigned int> getBatchOrder(const Json::Value& clientInfos, string addrPrefix)
+{
+    vector<BatchLoad> loads;
+    for (unsigned int i = 0; i < clientInfos.size(); i++) {
+        BatchLoad load;
+        load.load = g_batchOrder ? getPlacementLoad(getTemplateFlows(clientInfos[i], addrPrefix), clientInfos[i]["SLO"].asDouble()) : 0;
+        load.SLO = g_batchOrder ? clientInfos[i]["SLO"].asDouble() : 0;
+        load.index = i;
+        loads.push_back(load);
+    }
+    stable_sort(loads.begin(), loads.end(), batchLoadBefore);
+    vector<unsigned int> order;
+    for (vector<BatchLoad>::const_iterator it = loads.begin(); it != loads.end(); it++) {
+        order.push_back(it->index);
+    }
+    return order;
+}
+
+// Cancel the pending placements of a batch, waiting for the candidates being tested.
+// The in-flight batches are canceled while holding g_mutex, like the model updates of commits.
+// Assumes g_mutex is held
+void cancelPlacements()
+{
+    vector<Cancellation> cancellations;
+    for (list<PendingPlacement*>::const_iterator it = g_pendingPlacements.begin(); it != g_pendingPlacements.end(); it++) {
+        cancelWork(**it, 0, cancellations);
+    }
+    sendCancellations(cancellations);
+    while (!g_pendingPlacements.empty()) {
+        PendingPlacement* placement = g_pendingPlacements.front();
+        while (!placementDone(*placement)) {
+            pthread_cond_wait(&g_workComplete, &g_mutex);
+        }
+        g_pendingPlacements.pop_front();
+        delete placement;
+    }
+}
+
 // Remove a workload from the system.
 // Assumes g_mutex is held
 void removeClient(string clientName)
 {
-    for (list<WorkloadInfo>::iterator it = g_workloads.begin(); it != g_workloads.end(); it++) {
-        if (it->name == clientName) {
-            // Update clnts
-            for (unsigned int index = 0; index < g_clnts.size(); index++) {
-                g_clnts[index]->delClient(clientName);
-            }
-            // Mark client as unused
-            g_serverClientGrouping.erase(it->serverHost);
-            g_clients[it->clientHost].insert(it->clientVM);
-            // Remove workload info
-            g_workloads.erase(it);
+    const WorkloadInfo* workloadInfo = g_model.workloads.find(clientName);
+    if (workloadInfo != NULL) {
+        // Update clnts of the workload's shard
+        const vector<AdmissionController_clnt*>& modelClnts = g_shards[g_model.getShard(workloadInfo->serverHost)].modelClnts;
+        for (unsigned int index = 0; index < modelClnts.size(); index++) {
+            modelClnts[index]->delClient(clientName);
+        }
+        // Remove workload info, marking client as unused and updating headroom index
+        g_model.removeWorkload(clientName);
+        g_queueGroupsStale = true;
+    }
+}
+
+//
+// Consolidation planner
+//
+// Suffix of the names of the tentative copies of moved workloads, which are in the system along with the workloads while planning
+#define PLACEMENT_MOVE_SUFFIX "@move"
+
+// Move of a workload in a consolidation plan
+struct PlannedMove {
+    string name;
+    string clientHost;
+    string clientVM;
+    string serverHost;
+    string serverVM;
+};
+
+// Plan the moves that would empty up to maxServerHosts server hosts (0 for no limit), adding the emptied server hosts to serverHosts.
+// Server hosts are emptied from the least loaded onto the other server hosts in use, and a server host is only emptied if all of its workloads fit elsewhere.
+// Each workload is moved at most once and workloads are not moved onto server hosts being emptied, so the plan only moves the workloads of the emptied server hosts.
+// Each move is placed like a workload of AddClients, which tests its candidates speculatively with EvaluatePlacements, and is then tentatively added to the system
+// under a different name (see PLACEMENT_MOVE_SUFFIX) while the later moves are tested. The workload's own client VM is considered free, as it is once the workload is deleted.
+// The tentative moves are deleted once the plan is done, and the headroom index is restored.
+// Assumes called from single thread
+// Assumes g_mutex is held
+void planConsolidation(unsigned int maxServerHosts, vector<PlannedMove>& moves, vector<string>& serverHosts)
+{
+    // Save the parts of the state that deleting the tentative moves does not restore
+    map<string, QueueHeadroom> queueHeadroom = g_model.queueHeadroom;
+    map<pair<string, string>, ServerHeadroom> serverHeadroom = g_model.serverHeadroom;
+    map<string, string> serverClientGrouping = g_model.serverClientGrouping;
+    // Order server hosts in use from the least loaded; server hosts without workloads are not candidates, since moving workloads onto them does not empty servers
+    vector<pair<double, string> > sources;
+    for (map<string, set<string> >::const_iterator it = g_model.servers.begin(); it != g_model.servers.end(); it++) {
+        if (g_model.workloads.getServerHostWorkloads(it->first).empty()) {
+            g_model.excludedServerHosts.insert(it->first);
+        } else {
+            sources.push_back(pair<double, string>(g_model.getServerHostLoad(it->first, it->second), it->first));
+        }
+    }
+    stable_sort(sources.begin(), sources.end());
+    // Empty server hosts in order
+    vector<string> tentativeNames; // names of the tentative moves in the system
+    vector<pair<string, string> > freedClients; // client VMs of the moved workloads, which are freed while planning
+    set<string> targets; // server hosts that workloads were moved onto, which are not emptied
+    for (vector<pair<double, string> >::const_iterator itSource = sources.begin(); itSource != sources.end(); itSource++) {
+        if ((maxServerHosts > 0) && (serverHosts.size() >= maxServerHosts)) {
             break;
         }
+        const string& serverHost = itSource->second;
+        if (targets.find(serverHost) != targets.end()) {
+            continue;
+        }
+        // Copy the workloads, since the registry's pointers are only valid until it is changed
+        vector<WorkloadInfo> workloads;
+        vector<const WorkloadInfo*> serverWorkloads = g_model.workloads.getServerHostWorkloads(serverHost);
+        for (vector<const WorkloadInfo*>::const_iterator it = serverWorkloads.begin(); it != serverWorkloads.end(); it++) {
+            workloads.push_back(**it);
+        }
+        g_model.excludedServerHosts.insert(serverHost);
+        unsigned int numTentative = tentativeNames.size();
+        unsigned int numFreed = freedClients.size();
+        vector<PlannedMove> sourceMoves;
+        bool emptied = true;
+        for (vector<WorkloadInfo>::const_iterator it = workloads.begin(); it != workloads.end(); it++) {
+            // Free the workload's client VM
+            g_model.clients[it->clientHost].insert(it->clientVM);
+            freedClients.push_back(pair<string, string>(it->clientHost, it->clientVM));
+            // Place a copy of the workload on the other server hosts
+            Json::Value clientInfos(Json::arrayValue);
+            clientInfos.append(it->clientInfo);
+            clientInfos[0u].removeMember("admitted");
+            clientInfos[0u]["name"] = Json::Value(it->name + PLACEMENT_MOVE_SUFFIX);
+            vector<vector<string> > committedQueues;
+            if (!placeClient(clientInfos, 0, it->addrPrefix, false, committedQueues)) {
+                emptied = false;
+                break;
+            }
+            const WorkloadInfo& moved = g_model.workloads.back();
+            tentativeNames.push_back(moved.name);
+            PlannedMove move;
+            move.name = it->name;
+            move.clientHost = moved.clientHost;
+            move.clientVM = moved.clientVM;
+            move.serverHost = moved.serverHost;
+            move.serverVM = moved.serverVM;
+            sourceMoves.push_back(move);
+        }
+        if (emptied) {
+            serverHosts.push_back(serverHost);
+            for (vector<PlannedMove>::const_iterator it = sourceMoves.begin(); it != sourceMoves.end(); it++) {
+                targets.insert(it->serverHost);
+                moves.push_back(*it);
+            }
+        } else {
+            // Delete the server host's tentative moves, and keep the server host as a candidate for the other moves
+            for (unsigned int i = numTentative; i < tentativeNames.size(); i++) {
+                removeClient(tentativeNames[i]);
+            }
+            tentativeNames.resize(numTentative);
+            for (unsigned int i = numFreed; i < freedClients.size(); i++) {
+                g_model.clients[freedClients[i].first].erase(freedClients[i].second);
+            }
+            freedClients.resize(numFreed);
+            g_model.excludedServerHosts.erase(serverHost);
+        }
     }
+    // Delete the tentative moves and restore the state
+    for (vector<string>::const_iterator it = tentativeNames.begin(); it != tentativeNames.end(); it++) {
+        removeClient(*it);
+    }
+    for (vector<pair<string, string> >::const_iterator it = freedClients.begin(); it != freedClients.end(); it++) {
+        g_model.clients[it->first].erase(it->second);
+    }
+    g_model.excludedServerHosts.clear();
+    g_model.queueHeadroom = queueHeadroom;
+    g_model.serverHeadroom = serverHeadroom;
+    g_model.serverClientGrouping = serverClientGrouping;
 }
 
 // AddClients RPC - performs placement on a set of workloads and adds workloads to system.
@@ -275,6 +804,7 @@ void removeClient(string clientName)
 PlacementAddClientsRes* placement_controller_add_clients_svc(PlacementAddClientsArgs* argp, struct svc_req* rqstp)
 {
     static PlacementAddClientsRes result = {PLACEMENT_SUCCESS, false, {0, NULL}, {0, NULL}, {0, NULL}, {0, NULL}};
+    ScopedTimer timer(g_addClientsTime);
     // Parse input
     Json::Value clientInfos;
     if (!stringToJson(argp->clientInfos, clientInfos)) {
@@ -313,10 +843,19 @@ PlacementAddClientsRes* placement_controller_add_clients_svc(PlacementAddClients
     // Make placements
     result.admitted = true;
     pthread_mutex_lock(&g_mutex);
-    for (unsigned int i = 0; i < clientInfos.size(); i++) {
-        Json::Value& clientInfo = clientInfos[i];
-        if (placeClient(clientInfo, addrPrefix, enforce)) {
-            WorkloadInfo& workloadInfo = g_workloads.back();
+    vector<unsigned int> order = getBatchOrder(clientInfos, addrPrefix);
+    unsigned int numReorders = 0;
+    while (true) {
+        // Place copies of the workloads in order, since placing converts them
+        Json::Value orderedInfos(Json::arrayValue);
+        for (vector<unsigned int>::const_iterator it = order.begin(); it != order.end(); it++) {
+            orderedInfos.append(clientInfos[*it]);
+        }
+        vector<vector<string> > committedQueues;
+        unsigned int numPlaced = 0;
+        while ((numPlaced < order.size()) && placeClient(orderedInfos, numPlaced, addrPrefix, enforce, committedQueues)) {
+            const WorkloadInfo& workloadInfo = g_model.workloads.back();
+            unsigned int i = order[numPlaced];
             result.clientHosts.clientHosts_val[i] = new char[workloadInfo.clientHost.length() + 1];
             strcpy(result.clientHosts.clientHosts_val[i], workloadInfo.clientHost.c_str());
             result.clientVMs.clientVMs_val[i] = new char[workloadInfo.clientVM.length() + 1];
@@ -325,30 +864,42 @@ PlacementAddClientsRes* placement_controller_add_clients_svc(PlacementAddClients
             strcpy(result.serverHosts.serverHosts_val[i], workloadInfo.serverHost.c_str());
             result.serverVMs.serverVMs_val[i] = new char[workloadInfo.serverVM.length() + 1];
             strcpy(result.serverVMs.serverVMs_val[i], workloadInfo.serverVM.c_str());
-        } else {
-            result.admitted = false;
-            // Revert prior placements
-            for (unsigned int j = 0; j < i; j++) {
-                removeClient(clientInfos[j]["name"].asString());
-                delete[] result.clientHosts.clientHosts_val[j];
-                delete[] result.clientVMs.clientVMs_val[j];
-                delete[] result.serverHosts.serverHosts_val[j];
-                delete[] result.serverVMs.serverVMs_val[j];
-            }
-            delete[] result.clientHosts.clientHosts_val;
-            result.clientHosts.clientHosts_val = NULL;
-            result.clientHosts.clientHosts_len = 0;
-            delete[] result.clientVMs.clientVMs_val;
-            result.clientVMs.clientVMs_val = NULL;
-            result.clientVMs.clientVMs_len = 0;
-            delete[] result.serverHosts.serverHosts_val;
-            result.serverHosts.serverHosts_val = NULL;
-            result.serverHosts.serverHosts_len = 0;
-            delete[] result.serverVMs.serverVMs_val;
-            result.serverVMs.serverVMs_val = NULL;
-            result.serverVMs.serverVMs_len = 0;
+            numPlaced++;
+        }
+        if (numPlaced == order.size()) {
             break;
         }
+        cancelPlacements();
+        // Revert prior placements
+        for (unsigned int j = 0; j < numPlaced; j++) {
+            removeClient(orderedInfos[j]["name"].asString());
+            delete[] result.clientHosts.clientHosts_val[order[j]];
+            delete[] result.clientVMs.clientVMs_val[order[j]];
+            delete[] result.serverHosts.serverHosts_val[order[j]];
+            delete[] result.serverVMs.serverVMs_val[order[j]];
+        }
+        // Place the batch again with the workload that did not fit first, since the workloads placed before it may have taken its room
+        if (g_batchOrder && (numPlaced > 0) && (numReorders < g_maxReorders)) {
+            numReorders++;
+            unsigned int index = order[numPlaced];
+            order.erase(order.begin() + numPlaced);
+            order.insert(order.begin(), index);
+            continue;
+        }
+        result.admitted = false;
+        delete[] result.clientHosts.clientHosts_val;
+        result.clientHosts.clientHosts_val = NULL;
+        result.clientHosts.clientHosts_len = 0;
+        delete[] result.clientVMs.clientVMs_val;
+        result.clientVMs.clientVMs_val = NULL;
+        result.clientVMs.clientVMs_len = 0;
+        delete[] result.serverHosts.serverHosts_val;
+        result.serverHosts.serverHosts_val = NULL;
+        result.serverHosts.serverHosts_len = 0;
+        delete[] result.serverVMs.serverVMs_val;
+        result.serverVMs.serverVMs_val = NULL;
+        result.serverVMs.serverVMs_len = 0;
+        break;
     }
     pthread_mutex_unlock(&g_mutex);
     result.status = PLACEMENT_SUCCESS;
@@ -381,31 +932,26 @@ PlacementAddClientVMRes* placement_controller_add_client_vm_svc(PlacementAddClie
 
     pthread_mutex_lock(&g_mutex);
     // Check if clientHost does not exist
-    map<string, set<string> >::iterator it = g_clients.find(clientHost);
-    if (it == g_clients.end()) {
-        // Add network queues to AdmissionController
-        for (unsigned int index = 0; index < g_clnts.size(); index++) {
-            Json::Value queueInInfo;
-            configGenNetworkInQueue(queueInInfo, clientHost);
-            g_clnts[index]->addQueue(queueInInfo);
-            Json::Value queueOutInfo;
-            configGenNetworkOutQueue(queueOutInfo, clientHost);
-            g_clnts[index]->addQueue(queueOutInfo);
+    map<string, set<string> >::iterator it = g_model.clients.find(clientHost);
+    if (it == g_model.clients.end()) {
+        // Add network queues to all AdmissionController servers and the headroom index, since workloads of any shard may use the client
+        Json::Value queueInInfo;
+        configGenNetworkInQueue(queueInInfo, clientHost);
+        Json::Value queueOutInfo;
+        configGenNetworkOutQueue(queueOutInfo, clientHost);
+        for (unsigned int index = 0; index < g_modelClnts.size(); index++) {
+            g_modelClnts[index]->addQueue(queueInInfo);
+            g_modelClnts[index]->addQueue(queueOutInfo);
         }
+        g_model.addQueueHeadroom(queueInInfo);
+        g_model.addQueueHeadroom(queueOutInfo);
     }
     // Check if clientVM does not exist (unused)
-    set<string>& clientVMs = g_clients[clientHost];
+    set<string>& clientVMs = g_model.clients[clientHost];
     set<string>::const_iterator it2 = clientVMs.find(clientVM);
     if (it2 == clientVMs.end()) {
         // Check if clientVM does not exist (in use)
-        list<WorkloadInfo>::const_iterator it3 = g_workloads.begin();
-        while (it3 != g_workloads.end()) {
-            if ((it3->clientHost == clientHost) && (it3->clientVM == clientVM)) {
-                break;
-            }
-            it3++;
-        }
-        if (it3 == g_workloads.end()) {
+        if (!g_model.workloads.clientVMInUse(clientHost, clientVM)) {
             clientVMs.insert(clientVM);
             result.status = PLACEMENT_SUCCESS;
         } else {
@@ -428,8 +974,8 @@ PlacementDelClientVMRes* placement_controller_del_client_vm_svc(PlacementDelClie
 
     pthread_mutex_lock(&g_mutex);
     // Check if clientHost exists
-    map<string, set<string> >::iterator it = g_clients.find(clientHost);
-    if (it != g_clients.end()) {
+    map<string, set<string> >::iterator it = g_model.clients.find(clientHost);
+    if (it != g_model.clients.end()) {
         // Check if clientVM exists
         set<string>& clientVMs = it->second;
         set<string>::const_iterator it2 = clientVMs.find(clientVM);
@@ -437,20 +983,15 @@ PlacementDelClientVMRes* placement_controller_del_client_vm_svc(PlacementDelClie
             clientVMs.erase(it2);
             // Check if clientHost has no VMs and is not in use
             if (clientVMs.empty()) {
-                list<WorkloadInfo>::const_iterator it3 = g_workloads.begin();
-                while (it3 != g_workloads.end()) {
-                    if (it3->clientHost == clientHost) {
-                        break;
-                    }
-                    it3++;
-                }
-                if (it3 == g_workloads.end()) {
+                if (!g_model.workloads.clientHostInUse(clientHost)) {
                     // Remove network queues from AdmissionController
-                    for (unsigned int index = 0; index < g_clnts.size(); index++) {
-                        g_clnts[index]->delQueue(getQueueInName(clientHost));
-                        g_clnts[index]->delQueue(getQueueOutName(clientHost));
+                    for (unsigned int index = 0; index < g_modelClnts.size(); index++) {
+                        g_modelClnts[index]->delQueue(getQueueInName(clientHost));
+                        g_modelClnts[index]->delQueue(getQueueOutName(clientHost));
                     }
-                    g_clients.erase(it);
+                    g_model.queueHeadroom.erase(getQueueInName(clientHost));
+                    g_model.queueHeadroom.erase(getQueueOutName(clientHost));
+                    g_model.clients.erase(it);
                 }
             }
             result.status = PLACEMENT_SUCCESS;
@@ -474,28 +1015,33 @@ PlacementAddServerVMRes* placement_controller_add_server_vm_svc(PlacementAddServ
 
     pthread_mutex_lock(&g_mutex);
     // Check if serverHost does not exist
-    map<string, set<string> >::iterator it = g_servers.find(serverHost);
-    if (it == g_servers.end()) {
-        // Add network queues to AdmissionController
-        for (unsigned int index = 0; index < g_clnts.size(); index++) {
-            Json::Value queueInInfo;
-            configGenNetworkInQueue(queueInInfo, serverHost);
-            g_clnts[index]->addQueue(queueInInfo);
-            Json::Value queueOutInfo;
-            configGenNetworkOutQueue(queueOutInfo, serverHost);
-            g_clnts[index]->addQueue(queueOutInfo);
+    map<string, set<string> >::iterator it = g_model.servers.find(serverHost);
+    if (it == g_model.servers.end()) {
+        // Add network queues to the AdmissionController servers of the server's shard and the headroom index
+        const vector<AdmissionController_clnt*>& modelClnts = g_shards[assignShard(serverHost)].modelClnts;
+        Json::Value queueInInfo;
+        configGenNetworkInQueue(queueInInfo, serverHost);
+        Json::Value queueOutInfo;
+        configGenNetworkOutQueue(queueOutInfo, serverHost);
+        for (unsigned int index = 0; index < modelClnts.size(); index++) {
+            modelClnts[index]->addQueue(queueInInfo);
+            modelClnts[index]->addQueue(queueOutInfo);
         }
+        g_model.addQueueHeadroom(queueInInfo);
+        g_model.addQueueHeadroom(queueOutInfo);
     }
     // Check if serverVM does not exist
-    set<string>& serverVMs = g_servers[serverHost];
+    set<string>& serverVMs = g_model.servers[serverHost];
     set<string>::const_iterator it2 = serverVMs.find(serverVM);
     if (it2 == serverVMs.end()) {
-        // Add storage queue to AdmissionController
-        for (unsigned int index = 0; index < g_clnts.size(); index++) {
-            Json::Value queueStorageInfo;
-            configGenStorageQueue(queueStorageInfo, getServerName(serverHost, serverVM));
-            g_clnts[index]->addQueue(queueStorageInfo);
+        // Add storage queue to the AdmissionController servers of the server's shard and the headroom index
+        const vector<AdmissionController_clnt*>& modelClnts = g_shards[g_model.getShard(serverHost)].modelClnts;
+        Json::Value queueStorageInfo;
+        configGenStorageQueue(queueStorageInfo, getServerName(serverHost, serverVM));
+        for (unsigned int index = 0; index < modelClnts.size(); index++) {
+            modelClnts[index]->addQueue(queueStorageInfo);
         }
+        g_model.addQueueHeadroom(queueStorageInfo);
         serverVMs.insert(serverVM);
         result.status = PLACEMENT_SUCCESS;
     } else {
@@ -515,33 +1061,34 @@ PlacementDelServerVMRes* placement_controller_del_server_vm_svc(PlacementDelServ
 
     pthread_mutex_lock(&g_mutex);
     // Check if serverHost exists
-    map<string, set<string> >::iterator it = g_servers.find(serverHost);
-    if (it != g_servers.end()) {
+    map<string, set<string> >::iterator it = g_model.servers.find(serverHost);
+    if (it != g_model.servers.end()) {
         // Check if serverVM exists
         set<string>& serverVMs = it->second;
         set<string>::const_iterator it2 = serverVMs.find(serverVM);
         if (it2 != serverVMs.end()) {
             // Check if server is not in use
-            list<WorkloadInfo>::const_iterator it3 = g_workloads.begin();
-            while (it3 != g_workloads.end()) {
-                if ((it3->serverHost == serverHost) && (it3->serverVM == serverVM)) {
-                    break;
-                }
-                it3++;
-            }
-            if (it3 == g_workloads.end()) {
-                // Remove storage queue from AdmissionController
-                for (unsigned int index = 0; index < g_clnts.size(); index++) {
-                    g_clnts[index]->delQueue(getServerName(serverHost, serverVM));
+            if (!g_model.workloads.serverVMInUse(serverHost, serverVM)) {
+                // Remove storage queue from the AdmissionController servers of the server's shard
+                unsigned int shardIndex = g_model.getShard(serverHost);
+                const vector<AdmissionController_clnt*>& modelClnts = g_shards[shardIndex].modelClnts;
+                for (unsigned int index = 0; index < modelClnts.size(); index++) {
+                    modelClnts[index]->delQueue(getServerName(serverHost, serverVM));
                 }
+                g_model.queueHeadroom.erase(getServerName(serverHost, serverVM));
+                g_model.serverHeadroom.erase(pair<string, string>(serverHost, serverVM));
                 serverVMs.erase(it2);
                 if (serverVMs.empty()) {
-                    // Remove network queues from AdmissionController
-                    for (unsigned int index = 0; index < g_clnts.size(); index++) {
-                        g_clnts[index]->delQueue(getQueueInName(serverHost));
-                        g_clnts[index]->delQueue(getQueueOutName(serverHost));
+                    // Remove network queues from the AdmissionController servers of the server's shard
+                    for (unsigned int index = 0; index < modelClnts.size(); index++) {
+                        modelClnts[index]->delQueue(getQueueInName(serverHost));
+                        modelClnts[index]->delQueue(getQueueOutName(serverHost));
                     }
-                    g_servers.erase(it);
+                    g_model.queueHeadroom.erase(getQueueInName(serverHost));
+                    g_model.queueHeadroom.erase(getQueueOutName(serverHost));
+                    g_model.servers.erase(it);
+                    g_shards[shardIndex].numServerHosts--;
+                    g_model.serverShards.erase(serverHost);
                 }
                 result.status = PLACEMENT_SUCCESS;
             } else {
@@ -557,6 +1104,70 @@ PlacementDelServerVMRes* placement_controller_del_server_vm_svc(PlacementDelServ
     return &result;
 }
 
+// PlanConsolidation RPC - plan the moves of workloads that would empty the least loaded server hosts; the placements are not changed.
+// Assumes RPCs are not multi-threaded
+PlacementPlanConsolidationRes* placement_controller_plan_consolidation_svc(PlacementPlanConsolidationArgs* argp, struct svc_req* rqstp)
+{
+    static PlacementPlanConsolidationRes result = {PLACEMENT_SUCCESS, {0, NULL}, {0, NULL}};
+    // Delete old arrays
+    for (unsigned int i = 0; i < result.serverHosts.serverHosts_len; i++) {
+        delete[] result.serverHosts.serverHosts_val[i];
+    }
+    delete[] result.serverHosts.serverHosts_val;
+    for (unsigned int i = 0; i < result.moves.moves_len; i++) {
+        PlacementMove& move = result.moves.moves_val[i];
+        delete[] move.name;
+        delete[] move.clientHost;
+        delete[] move.clientVM;
+        delete[] move.serverHost;
+        delete[] move.serverVM;
+    }
+    delete[] result.moves.moves_val;
+    // Plan moves
+    vector<PlannedMove> moves;
+    vector<string> serverHosts;
+    pthread_mutex_lock(&g_mutex);
+    planConsolidation(argp->maxServerHosts, moves, serverHosts);
+    pthread_mutex_unlock(&g_mutex);
+    // Create new result arrays
+    result.serverHosts.serverHosts_val = new char*[serverHosts.size()];
+    result.serverHosts.serverHosts_len = serverHosts.size();
+    for (unsigned int i = 0; i < serverHosts.size(); i++) {
+        result.serverHosts.serverHosts_val[i] = new char[serverHosts[i].length() + 1];
+        strcpy(result.serverHosts.serverHosts_val[i], serverHosts[i].c_str());
+    }
+    result.moves.moves_val = new PlacementMove[moves.size()];
+    result.moves.moves_len = moves.size();
+    for (unsigned int i = 0; i < moves.size(); i++) {
+        PlacementMove& move = result.moves.moves_val[i];
+        move.name = new char[moves[i].name.length() + 1];
+        strcpy(move.name, moves[i].name.c_str());
+        move.clientHost = new char[moves[i].clientHost.length() + 1];
+        strcpy(move.clientHost, moves[i].clientHost.c_str());
+        move.clientVM = new char[moves[i].clientVM.length() + 1];
+        strcpy(move.clientVM, moves[i].clientVM.c_str());
+        move.serverHost = new char[moves[i].serverHost.length() + 1];
+        strcpy(move.serverHost, moves[i].serverHost.c_str());
+        move.serverVM = new char[moves[i].serverVM.length() + 1];
+        strcpy(move.serverVM, moves[i].serverVM.c_str());
+    }
+    result.status = PLACEMENT_SUCCESS;
+    return &result;
+}
+
+// GetMetrics RPC - get the hot path metrics.
+// Assumes RPCs are not multi-threaded
+PlacementGetMetricsRes* placement_controller_get_metrics_svc(void* argp, struct svc_req* rqstp)
+{
+    static PlacementGetMetricsRes result;
+    static string metricsStr;
+    Json::Value metrics;
+    MetricsRegistry::get().toJson(metrics);
+    metricsStr = jsonToString(metrics);
+    result.metrics = const_cast<char*>(metricsStr.c_str());
+    return &result;
+}
+
 // Main RPC handler
 void placement_controller_program(struct svc_req* rqstp, register SVCXPRT* transp)
 {
@@ -567,6 +1178,7 @@ void placement_controller_program(struct svc_req* rqstp, register SVCXPRT* trans
         PlacementDelClientVMArgs placement_controller_del_client_vm_arg;
         PlacementAddServerVMArgs placement_controller_add_server_vm_arg;
         PlacementDelServerVMArgs placement_controller_del_server_vm_arg;
+        PlacementPlanConsolidationArgs placement_controller_plan_consolidation_arg;
     } argument;
     char* result;
     xdrproc_t _xdr_argument, _xdr_result;
@@ -613,6 +1225,18 @@ void placement_controller_program(struct svc_req* rqstp, register SVCXPRT* trans
             local = (char* (*)(char*, struct svc_req*))placement_controller_del_server_vm_svc;
             break;
 
+        case PLACEMENT_CONTROLLER_PLAN_CONSOLIDATION:
+            _xdr_argument = (xdrproc_t)xdr_PlacementPlanConsolidationArgs;
+            _xdr_result = (xdrproc_t)xdr_PlacementPlanConsolidationRes;
+            local = (char* (*)(char*, struct svc_req*))placement_controller_plan_consolidation_svc;
+            break;
+
+        case PLACEMENT_CONTROLLER_GET_METRICS:
+            _xdr_argument = (xdrproc_t)xdr_void;
+            _xdr_result = (xdrproc_t)xdr_PlacementGetMetricsRes;
+            local = (char* (*)(char*, struct svc_req*))placement_controller_get_metrics_svc;
+            break;
+
         default:
             svcerr_noproc(transp);
             return;
@@ -634,17 +1258,58 @@ void placement_controller_program(struct svc_req* rqstp, register SVCXPRT* trans
 int main(int argc, char** argv)
 {
     int opt = 0;
+    vector<string> admissionControllerAddrs;
+    long numConnections = 1;
+    bool validPolicy = true;
+    long pipelineDepth = 1;
+    long maxReorders = 0;
+    string metricsAddress;
     do {
-        opt = getopt(argc, argv, "a:f");
+        opt = getopt(argc, argv, "a:fc:o:sd:b:M:");
         switch (opt) {
             case 'a':
-                g_clnts.push_back(new AdmissionController_clnt(optarg));
+                admissionControllerAddrs.push_back(string(optarg));
+                break;
+
+            case 'c':
+                numConnections = atol(optarg);
                 break;
 
             case 'f':
                 g_fastFirstFit = true;
                 break;
 
+            case 's':
+                g_model.sharded = true;
+                break;
+
+            case 'd':
+                pipelineDepth = atol(optarg);
+                break;
+
+            case 'b':
+                g_batchOrder = true;
+                maxReorders = atol(optarg);
+                break;
+
+            case 'M':
+                metricsAddress = optarg;
+                break;
+
+            case 'o':
+                if (strcmp(optarg, "firstfit") == 0) {
+                    g_model.policy = PLACEMENT_FIRST_FIT;
+                } else if (strcmp(optarg, "bestfit") == 0) {
+                    g_model.policy = PLACEMENT_BEST_FIT;
+                } else if (strcmp(optarg, "worstfit") == 0) {
+                    g_model.policy = PLACEMENT_WORST_FIT;
+                } else if (strcmp(optarg, "likely") == 0) {
+                    g_model.policy = PLACEMENT_LIKELY_FIT;
+                } else {
+                    validPolicy = false;
+                }
+                break;
+
             case -1:
                 break;
 
@@ -653,10 +1318,44 @@ int main(int argc, char** argv)
         }
     } while (opt != -1);
 
-    if (g_clnts.empty()) {
-        cout << "Usage: " << argv[0] << " -a AdmissionControllerAddr [-a AdmissionControllerAddr ...] [-f]" << endl;
+    if (admissionControllerAddrs.empty() || (numConnections <= 0) || !validPolicy || (pipelineDepth <= 0) || (maxReorders < 0) || (!metricsAddress.empty() && !validMetricsAddress(metricsAddress))) {
+        cout << "Usage: " << argv[0] << " -a AdmissionControllerAddr [-a AdmissionControllerAddr ...] [-f] [-c numConnections] [-o firstfit|bestfit|worstfit|likely] [-s] [-d pipelineDepth] [-b maxReorders] [-M [metricsAddr:]metricsPort]" << endl;
         return -1;
     }
+    g_pipelineDepth = pipelineDepth;
+    g_maxReorders = maxReorders;
+
+    // Connect to AdmissionController servers; if sharded, each server holds its own shard, and otherwise, all servers hold a single shard
+    g_shards.resize(g_model.sharded ? admissionControllerAddrs.size() : 1);
+    vector<Worker> workers;
+    for (unsigned int shardIndex = 0; shardIndex < g_shards.size(); shardIndex++) {
+        g_shards[shardIndex].numServerHosts = 0;
+    }
+    for (unsigned int addrIndex = 0; addrIndex < admissionControllerAddrs.size(); addrIndex++) {
+        unsigned int shardIndex = g_model.sharded ? addrIndex : 0;
+        Shard& shard = g_shards[shardIndex];
+        for (long i = 0; i < numConnections; i++) {
+            g_clnts.push_back(new AdmissionController_clnt(admissionControllerAddrs[addrIndex]));
+            shard.clnts.push_back(g_clnts.back());
+            Worker worker;
+            worker.clnt = g_clnts.back();
+            worker.addrIndex = addrIndex;
+            worker.shardIndex = shardIndex;
+            workers.push_back(worker);
+        }
+        // Updates of the model have their own connection, since workers may test placements while a placement is committed
+        g_modelClnts.push_back(new AdmissionController_clnt(admissionControllerAddrs[addrIndex]));
+        shard.modelClnts.push_back(g_modelClnts.back());
+        g_cancelClnts.push_back(new AdmissionController_clnt(admissionControllerAddrs[addrIndex]));
+    }
+    // Number evaluations and traces from the process id, so those of different PlacementControllers sharing an AdmissionController server differ
+    g_nextEvaluationId = (static_cast<uint64_t>(getpid()) << 32) + 1;
+    g_nextTraceId = (static_cast<uint64_t>(getpid()) << 32) + 1;
+
+    // Serve metrics to scrapers
+    if (!metricsAddress.empty() && !startMetricsServer(metricsAddress)) {
+        return 1;
+    }
 
     // Unregister PlacementController RPC handlers
     pmap_unset(PLACEMENT_CONTROLLER_PROGRAM, PLACEMENT_CONTROLLER_V1);
@@ -682,7 +1381,7 @@ int main(int argc, char** argv)
         int rc = pthread_create(&threadArray[i],
                                 &attr,
                                 workerThread,
-                                reinterpret_cast<void*>(g_clnts[i]));
+                                reinterpret_cast<void*>(&workers[i]));
         if (rc) {
             cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
             exit(-1);
@@ -696,5 +1395,11 @@ int main(int argc, char** argv)
     for (unsigned int i = 0; i < g_clnts.size(); i++) {
         delete g_clnts[i];
     }
+    for (unsigned int i = 0; i < g_modelClnts.size(); i++) {
+        delete g_modelClnts[i];
+    }
+    for (unsigned int i = 0; i < g_cancelClnts.size(); i++) {
+        delete g_cancelClnts[i];
+    }
     return 1;
 }
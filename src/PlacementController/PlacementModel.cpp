@@ -0,0 +1,365 @@
+// PlacementModel.cpp - PlacementController's model of the cluster.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <algorithm>
+#include <limits>
+#include <cstdlib>
+#include "../common/serializeJSON.hpp"
+#include "../DNC-Library/NCConfig.hpp"
+#include "PlacementModel.hpp"
+
+using namespace std;
+
+//
+// Placement queues
+//
+// Return the queues that a workload's flows may use in a placement.
+// Flows of a workload placed on different hosts use the queues with the same indexes.
+vector<string> getPlacementQueues(string clientHost, string serverHost, string serverVM)
+{
+    vector<string> queues;
+    queues.push_back(getQueueOutName(clientHost));
+    queues.push_back(getQueueInName(clientHost));
+    queues.push_back(getQueueOutName(serverHost));
+    queues.push_back(getQueueInName(serverHost));
+    queues.push_back(getServerName(serverHost, serverVM));
+    return queues;
+}
+
+// Get the flows of a workload placed on placeholder hosts; flows without an arrival curve are skipped.
+vector<TemplateFlow> getTemplateFlows(const Json::Value& clientInfo, string addrPrefix)
+{
+    Json::Value templateInfo = clientInfo;
+    templateInfo["clientHost"] = Json::Value(PLACEMENT_TEMPLATE_CLIENT_HOST);
+    templateInfo["clientVM"] = Json::Value(PLACEMENT_TEMPLATE_CLIENT_VM);
+    templateInfo["serverHost"] = Json::Value(PLACEMENT_TEMPLATE_SERVER_HOST);
+    templateInfo["serverVM"] = Json::Value(PLACEMENT_TEMPLATE_SERVER_VM);
+    configGenClient(templateInfo, clientInfo["name"].asString(), addrPrefix, false);
+    vector<string> queues = getPlacementQueues(PLACEMENT_TEMPLATE_CLIENT_HOST, PLACEMENT_TEMPLATE_SERVER_HOST, PLACEMENT_TEMPLATE_SERVER_VM);
+    vector<TemplateFlow> flows;
+    const Json::Value& clientFlows = templateInfo["flows"];
+    for (unsigned int flowIndex = 0; flowIndex < clientFlows.size(); flowIndex++) {
+        const Json::Value& flowInfo = clientFlows[flowIndex];
+        if (!flowInfo.isMember("arrivalInfo")) {
+            continue;
+        }
+        flows.resize(flows.size() + 1);
+        TemplateFlow& flow = flows.back();
+        deserializeJSON(flowInfo, "arrivalInfo", flow.arrivalCurve);
+        const Json::Value& flowQueues = flowInfo["queues"];
+        for (unsigned int i = 0; i < flowQueues.size(); i++) {
+            vector<string>::const_iterator it = find(queues.begin(), queues.end(), flowQueues[i].asString());
+            if (it != queues.end()) {
+                flow.queueIndexes.push_back(it - queues.begin());
+            }
+        }
+    }
+    return flows;
+}
+
+// Return the burst of an arrival curve when rate limited at the given bandwidth.
+// The arrival curve is concave, so the burst is set by one of its points.
+double getBurst(const Curve& arrivalCurve, double bandwidth)
+{
+    double burst = 0;
+    for (Curve::const_iterator it = arrivalCurve.begin(); it != arrivalCurve.end(); it++) {
+        burst = max(burst, yIntercept(it->x, it->y, bandwidth));
+    }
+    return burst;
+}
+
+// Return the estimated load of a workload with the given flows and SLO, i.e., the largest fraction of bandwidth needed at one of its queues in any placement,
+// counting both the long-term rate of the flows and the rate that drains their bursts within the SLO.
+// The bandwidth of each of the placement queues (see getPlacementQueues) only depends on the type of queue.
+double getPlacementLoad(const vector<TemplateFlow>& flows, double SLO)
+{
+    vector<Json::Value> queueInfos(5);
+    configGenNetworkOutQueue(queueInfos[0], PLACEMENT_TEMPLATE_CLIENT_HOST);
+    configGenNetworkInQueue(queueInfos[1], PLACEMENT_TEMPLATE_CLIENT_HOST);
+    configGenNetworkOutQueue(queueInfos[2], PLACEMENT_TEMPLATE_SERVER_HOST);
+    configGenNetworkInQueue(queueInfos[3], PLACEMENT_TEMPLATE_SERVER_HOST);
+    configGenStorageQueue(queueInfos[4], getServerName(PLACEMENT_TEMPLATE_SERVER_HOST, PLACEMENT_TEMPLATE_SERVER_VM));
+    vector<double> rates(queueInfos.size(), 0);
+    for (vector<TemplateFlow>::const_iterator it = flows.begin(); it != flows.end(); it++) {
+        for (vector<unsigned int>::const_iterator itIndex = it->queueIndexes.begin(); itIndex != it->queueIndexes.end(); itIndex++) {
+            double rate = it->arrivalCurve.empty() ? 0 : it->arrivalCurve.back().slope;
+            rates[*itIndex] += rate + getBurst(it->arrivalCurve, queueInfos[*itIndex]["bandwidth"].asDouble()) / SLO;
+        }
+    }
+    double load = 0;
+    for (unsigned int i = 0; i < queueInfos.size(); i++) {
+        load = max(load, rates[i] / queueInfos[i]["bandwidth"].asDouble());
+    }
+    return load;
+}
+
+//
+// Shards and clients
+//
+// Return the index of a server host's shard
+unsigned int PlacementModel::getShard(const string& serverHost) const
+{
+    map<string, unsigned int>::const_iterator it = serverShards.find(serverHost);
+    return (it == serverShards.end()) ? 0 : it->second;
+}
+
+// Decides which client VM to place a workload on.
+// The current algorithm groups workloads that share a server onto the same client machine.
+// This is because their performance is already correlated by sharing a server, so it's better
+// to continue sharing so as not to introduce additional correlations with other workloads.
+// If sharded, only client machines that are not used by workloads of other shards are considered.
+pair<string, string> PlacementModel::clientServerPlacement(const string& serverHost)
+{
+    string clientHost;
+    map<string, string>::const_iterator it = serverClientGrouping.find(serverHost);
+    if (it != serverClientGrouping.end()) {
+        clientHost = it->second;
+        const set<string>& clientVMs = clients[clientHost];
+        if (!clientVMs.empty()) {
+            return pair<string, string>(clientHost, *(clientVMs.begin()));
+        }
+    }
+    // Check for other workloads using server
+    vector<const WorkloadInfo*> serverWorkloads = workloads.getServerHostWorkloads(serverHost);
+    for (vector<const WorkloadInfo*>::const_iterator it2 = serverWorkloads.begin(); it2 != serverWorkloads.end(); it2++) {
+        clientHost = (*it2)->clientHost;
+        const set<string>& clientVMs = clients[clientHost];
+        if (!clientVMs.empty()) {
+            return pair<string, string>(clientHost, *(clientVMs.begin()));
+        }
+    }
+    // Look for a client to use
+    unsigned int maxAvailableClients = 0;
+    unsigned int shardIndex = getShard(serverHost);
+    for (map<string, set<string> >::const_iterator it3 = clients.begin(); it3 != clients.end(); it3++) {
+        map<string, unsigned int>::const_iterator itShard = clientShards.find(it3->first);
+        if ((itShard != clientShards.end()) && (itShard->second != shardIndex)) {
+            continue;
+        }
+        if (it3->second.size() > maxAvailableClients) {
+            maxAvailableClients = it3->second.size();
+            clientHost = it3->first;
+        }
+    }
+    if (maxAvailableClients <= 0) {
+        cerr << "Out of client machines" << endl;
+        exit(-1);
+    }
+    return pair<string, string>(clientHost, *(clients[clientHost].begin()));
+}
+
+//
+// Headroom index
+//
+// Get the demands of a workload's flows at the given placement queues (see getPlacementQueues); queues that are not in the index are skipped.
+vector<QueueDemand> PlacementModel::getDemands(const vector<TemplateFlow>& flows, const vector<string>& queues) const
+{
+    vector<QueueDemand> demands;
+    for (vector<TemplateFlow>::const_iterator it = flows.begin(); it != flows.end(); it++) {
+        for (vector<unsigned int>::const_iterator itIndex = it->queueIndexes.begin(); itIndex != it->queueIndexes.end(); itIndex++) {
+            const string& queueName = queues[*itIndex];
+            map<string, QueueHeadroom>::const_iterator itHeadroom = queueHeadroom.find(queueName);
+            if (itHeadroom == queueHeadroom.end()) {
+                continue;
+            }
+            // Find the demand at the queue
+            vector<QueueDemand>::iterator itDemand = demands.begin();
+            while ((itDemand != demands.end()) && (itDemand->queueName != queueName)) {
+                itDemand++;
+            }
+            if (itDemand == demands.end()) {
+                QueueDemand demand;
+                demand.queueName = queueName;
+                demand.rate = 0;
+                demand.burst = 0;
+                itDemand = demands.insert(demands.end(), demand);
+            }
+            itDemand->rate += it->arrivalCurve.empty() ? 0 : it->arrivalCurve.back().slope;
+            itDemand->burst += getBurst(it->arrivalCurve, itHeadroom->second.bandwidth);
+        }
+    }
+    return demands;
+}
+
+// Add a queue to the headroom index
+void PlacementModel::addQueueHeadroom(const Json::Value& queueInfo)
+{
+    queueHeadroom[queueInfo["name"].asString()].bandwidth = queueInfo["bandwidth"].asDouble();
+}
+
+// Add or remove the demands of an admitted workload in the headroom index.
+void PlacementModel::updateHeadroom(const WorkloadInfo& workloadInfo, bool add)
+{
+    for (vector<QueueDemand>::const_iterator it = workloadInfo.demands.begin(); it != workloadInfo.demands.end(); it++) {
+        map<string, QueueHeadroom>::iterator itHeadroom = queueHeadroom.find(it->queueName);
+        if (itHeadroom == queueHeadroom.end()) {
+            continue;
+        }
+        QueueHeadroom& headroom = itHeadroom->second;
+        if (add) {
+            headroom.rate += it->rate;
+            headroom.burst += it->burst;
+            headroom.SLOs.insert(workloadInfo.SLO);
+        } else {
+            headroom.rate -= it->rate;
+            headroom.burst -= it->burst;
+            headroom.SLOs.erase(headroom.SLOs.find(workloadInfo.SLO));
+        }
+    }
+    // Earlier admission results do not apply to the servers sharing the workload's server host
+    map<string, set<string> >::const_iterator itServer = servers.find(workloadInfo.serverHost);
+    if (itServer != servers.end()) {
+        for (set<string>::const_iterator it = itServer->second.begin(); it != itServer->second.end(); it++) {
+            ServerHeadroom& headroom = serverHeadroom[pair<string, string>(workloadInfo.serverHost, *it)];
+            headroom.rejections = 0;
+            if (!add) {
+                headroom.slack = numeric_limits<double>::infinity();
+            }
+        }
+    }
+}
+
+// Get the headroom of a candidate server for a workload with the given flows and SLO.
+// Returns false if the long-term rate of the flows at one of the workload's queues would exceed its bandwidth, in which case the workload cannot fit
+// since its rate limits would leave the queue without a latency bound.
+bool PlacementModel::getCandidate(const vector<TemplateFlow>& flows, double SLO, const pair<string, string>& server, PlacementCandidate& candidate)
+{
+    pair<string, string> client = clientServerPlacement(server.first);
+    vector<QueueDemand> demands = getDemands(flows, getPlacementQueues(client.first, server.first, server.second));
+    candidate.server = server;
+    candidate.client = client;
+    candidate.residualRate = 1;
+    candidate.residualBurst = 1;
+    for (vector<QueueDemand>::const_iterator it = demands.begin(); it != demands.end(); it++) {
+        const QueueHeadroom& headroom = queueHeadroom[it->queueName];
+        double rate = headroom.rate + it->rate;
+        if (rate > headroom.bandwidth) {
+            return false;
+        }
+        candidate.residualRate = min(candidate.residualRate, 1 - rate / headroom.bandwidth);
+        double tightestSLO = headroom.SLOs.empty() ? SLO : min(SLO, *headroom.SLOs.begin());
+        candidate.residualBurst = min(candidate.residualBurst, 1 - (headroom.burst + it->burst) / headroom.bandwidth / tightestSLO);
+    }
+    const ServerHeadroom& headroom = serverHeadroom[server];
+    candidate.slack = headroom.slack / SLO;
+    candidate.rejections = headroom.rejections;
+    return true;
+}
+
+// Compare candidates in the order of the placement policy (see PlacementPolicy)
+static bool candidateBefore(PlacementPolicy policy, const PlacementCandidate& c1, const PlacementCandidate& c2)
+{
+    switch (policy) {
+        case PLACEMENT_BEST_FIT:
+            return c1.residualRate < c2.residualRate;
+
+        case PLACEMENT_WORST_FIT:
+            return c1.residualRate > c2.residualRate;
+
+        case PLACEMENT_LIKELY_FIT:
+            if (c1.rejections != c2.rejections) {
+                return c1.rejections < c2.rejections;
+            }
+            // Prefer the candidate whose tightest resource has the most headroom
+            return min(c1.residualRate, min(c1.residualBurst, c1.slack)) > min(c2.residualRate, min(c2.residualBurst, c2.slack));
+
+        default:
+            return false;
+    }
+}
+
+// Order of candidates for stable_sort
+struct CandidateOrder {
+    PlacementPolicy policy;
+    bool operator()(const PlacementCandidate& c1, const PlacementCandidate& c2) const { return candidateBefore(policy, c1, c2); }
+};
+
+// Get the candidate servers that have the rate for a workload in the policy's order.
+vector<PlacementCandidate> PlacementModel::getCandidates(const vector<TemplateFlow>& flows, double SLO)
+{
+    vector<PlacementCandidate> candidates;
+    for (map<string, set<string> >::const_iterator it = servers.begin(); it != servers.end(); it++) {
+        string serverHost = it->first;
+        if (excludedServerHosts.find(serverHost) != excludedServerHosts.end()) {
+            continue;
+        }
+        const set<string>& serverVMs = it->second;
+        for (set<string>::const_iterator it2 = serverVMs.begin(); it2 != serverVMs.end(); it2++) {
+            string serverVM = *it2;
+            PlacementCandidate candidate;
+            if (getCandidate(flows, SLO, pair<string, string>(serverHost, serverVM), candidate)) {
+                candidates.push_back(candidate);
+            }
+        }
+    }
+    CandidateOrder order;
+    order.policy = policy;
+    stable_sort(candidates.begin(), candidates.end(), order);
+    return candidates;
+}
+
+// Return the load of a server host, i.e., the largest fraction of bandwidth used by the admitted workloads at its queues.
+double PlacementModel::getServerHostLoad(const string& serverHost, const set<string>& serverVMs) const
+{
+    vector<string> queues;
+    queues.push_back(getQueueOutName(serverHost));
+    queues.push_back(getQueueInName(serverHost));
+    for (set<string>::const_iterator it = serverVMs.begin(); it != serverVMs.end(); it++) {
+        queues.push_back(getServerName(serverHost, *it));
+    }
+    double load = 0;
+    for (vector<string>::const_iterator it = queues.begin(); it != queues.end(); it++) {
+        map<string, QueueHeadroom>::const_iterator itHeadroom = queueHeadroom.find(*it);
+        if ((itHeadroom != queueHeadroom.end()) && (itHeadroom->second.bandwidth > 0)) {
+            load = max(load, itHeadroom->second.rate / itHeadroom->second.bandwidth);
+        }
+    }
+    return load;
+}
+
+//
+// Manage workloads
+//
+void PlacementModel::addWorkload(const WorkloadInfo& workloadInfo, double slack)
+{
+    // Mark client as used
+    serverClientGrouping[workloadInfo.serverHost] = workloadInfo.clientHost;
+    clients[workloadInfo.clientHost].erase(workloadInfo.clientVM);
+    if (sharded) {
+        clientShards[workloadInfo.clientHost] = getShard(workloadInfo.serverHost);
+    }
+    // Add workload info
+    workloads.add(workloadInfo);
+    // Update headroom index
+    updateHeadroom(workloadInfo, true);
+    serverHeadroom[pair<string, string>(workloadInfo.serverHost, workloadInfo.serverVM)].slack = slack;
+}
+
+bool PlacementModel::removeWorkload(const string& name)
+{
+    const WorkloadInfo* workloadInfo = workloads.find(name);
+    if (workloadInfo == NULL) {
+        return false;
+    }
+    // Update headroom index
+    updateHeadroom(*workloadInfo, false);
+    // Mark client as unused
+    serverClientGrouping.erase(workloadInfo->serverHost);
+    clients[workloadInfo->clientHost].insert(workloadInfo->clientVM);
+    // Remove workload info
+    string clientHost = workloadInfo->clientHost;
+    workloads.remove(name);
+    // Release client machine from its shard once no workloads use it
+    if (!workloads.clientHostInUse(clientHost)) {
+        clientShards.erase(clientHost);
+    }
+    return true;
+}
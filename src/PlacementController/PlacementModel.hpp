@@ -0,0 +1,131 @@
+// PlacementModel.hpp - PlacementController's model of the cluster, i.e., the hosts, the placed workloads, and the headroom index used to order candidate servers.
+// The model only decides where a workload may go; testing whether it fits is left to admission control,
+// so the model is shared by PlacementController and the in-process admission control of PlacementSimulator.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _PLACEMENT_MODEL_HPP
+#define _PLACEMENT_MODEL_HPP
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <utility>
+#include <limits>
+#include <json/json.h>
+#include "../DNC-Library/DNC.hpp"
+#include "WorkloadRegistry.hpp"
+
+using namespace std;
+
+// Placeholder hosts used to get the flows of a workload before it is placed
+#define PLACEMENT_TEMPLATE_CLIENT_HOST "client"
+#define PLACEMENT_TEMPLATE_CLIENT_VM "clientVM"
+#define PLACEMENT_TEMPLATE_SERVER_HOST "server"
+#define PLACEMENT_TEMPLATE_SERVER_VM "serverVM"
+
+// Headroom of a queue, i.e., resources left over by the admitted workloads
+struct QueueHeadroom {
+    QueueHeadroom()
+        : bandwidth(0),
+          rate(0),
+          burst(0)
+    {}
+    double bandwidth;
+    double rate; // rate used by the admitted workloads
+    double burst; // burst used by the admitted workloads
+    multiset<double> SLOs; // SLOs of the admitted workloads
+};
+
+// Admission results at a server
+struct ServerHeadroom {
+    ServerHeadroom()
+        : slack(numeric_limits<double>::infinity()),
+          rejections(0)
+    {}
+    double slack; // slack of the last workload admitted on the server (see PlacementEvaluation), or infinity if unknown
+    unsigned int rejections; // number of workloads rejected by the server since the workloads using its queues last changed
+};
+
+// Flow of a workload placed on placeholder hosts, whose queues are mapped onto each candidate placement (see getPlacementQueues)
+struct TemplateFlow {
+    Curve arrivalCurve;
+    vector<unsigned int> queueIndexes; // indexes of the flow's queues in getPlacementQueues
+};
+
+// Candidate server for the current workload
+struct PlacementCandidate {
+    pair<string, string> server;
+    pair<string, string> client; // client VM chosen for the server (see clientServerPlacement)
+    double residualRate; // smallest fraction of bandwidth left over at the workload's queues after adding the workload
+    double residualBurst; // smallest fraction of the tightest SLO left over by the bursts at the workload's queues after adding the workload
+    double slack; // slack at the server as a fraction of the workload's SLO
+    unsigned int rejections; // see ServerHeadroom
+};
+
+// Order in which servers are tested
+enum PlacementPolicy {
+    PLACEMENT_FIRST_FIT, // servers in order
+    PLACEMENT_BEST_FIT, // least residual rate first
+    PLACEMENT_WORST_FIT, // most residual rate first
+    PLACEMENT_LIKELY_FIT // servers without recent rejections first, then most residual rate, burst, and slack first
+};
+
+// Return the queues that a workload's flows may use in a placement.
+// Flows of a workload placed on different hosts use the queues with the same indexes.
+vector<string> getPlacementQueues(string clientHost, string serverHost, string serverVM);
+// Get the flows of a workload placed on placeholder hosts; flows without an arrival curve are skipped.
+vector<TemplateFlow> getTemplateFlows(const Json::Value& clientInfo, string addrPrefix);
+// Return the burst of an arrival curve when rate limited at the given bandwidth.
+double getBurst(const Curve& arrivalCurve, double bandwidth);
+// Return the estimated load of a workload with the given flows and SLO, i.e., the largest fraction of bandwidth needed at one of its queues in any placement.
+double getPlacementLoad(const vector<TemplateFlow>& flows, double SLO);
+
+// Model of the cluster; the members are updated directly when hosts are added or deleted.
+// PlacementModel is not thread-safe.
+struct PlacementModel {
+    map<string, set<string> > servers; // map serverHost -> serverVMs
+    map<string, set<string> > clients; // map clientHost -> unused clientVMs
+    map<string, string> serverClientGrouping; // map serverHost -> clientHost to group workloads that share the same server onto the same client
+    WorkloadRegistry workloads; // workloads in system
+    map<string, QueueHeadroom> queueHeadroom; // by queue name
+    map<pair<string, string>, ServerHeadroom> serverHeadroom; // by serverHost/serverVM
+    map<string, unsigned int> serverShards; // map serverHost -> index of its shard
+    map<string, unsigned int> clientShards; // map clientHost -> index of the shard of the workloads using it, if sharded
+    set<string> excludedServerHosts; // server hosts that are not candidates for placements
+    PlacementPolicy policy; // order in which servers are tested
+    bool sharded; // servers are partitioned into shards, so client hosts are only given to workloads of one shard at a time
+
+    PlacementModel()
+        : policy(PLACEMENT_FIRST_FIT),
+          sharded(false)
+    {}
+
+    // Return the index of a server host's shard
+    unsigned int getShard(const string& serverHost) const;
+    // Decides which client VM to place a workload on, given the server host it is placed on
+    pair<string, string> clientServerPlacement(const string& serverHost);
+
+    // Get the demands of a workload's flows at the given placement queues (see getPlacementQueues); queues that are not in the index are skipped.
+    vector<QueueDemand> getDemands(const vector<TemplateFlow>& flows, const vector<string>& queues) const;
+    // Add a queue to the headroom index
+    void addQueueHeadroom(const Json::Value& queueInfo);
+    // Add or remove the demands of an admitted workload in the headroom index.
+    void updateHeadroom(const WorkloadInfo& workloadInfo, bool add);
+    // Get the headroom of a candidate server for a workload with the given flows and SLO; returns false if the workload cannot fit.
+    bool getCandidate(const vector<TemplateFlow>& flows, double SLO, const pair<string, string>& server, PlacementCandidate& candidate);
+    // Get the candidate servers that have the rate for a workload in the policy's order.
+    vector<PlacementCandidate> getCandidates(const vector<TemplateFlow>& flows, double SLO);
+    // Return the load of a server host, i.e., the largest fraction of bandwidth used by the admitted workloads at its queues.
+    double getServerHostLoad(const string& serverHost, const set<string>& serverVMs) const;
+
+    // Add an admitted workload, marking its client VM as used and adding its demands to the headroom index along with the slack reported by admission control.
+    void addWorkload(const WorkloadInfo& workloadInfo, double slack);
+    // Remove a workload, freeing its client VM; returns false if there is no workload with the name
+    bool removeWorkload(const string& name);
+};
+
+#endif // _PLACEMENT_MODEL_HPP
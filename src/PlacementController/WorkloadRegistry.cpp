@@ -0,0 +1,96 @@
+// WorkloadRegistry.cpp - Registry of the workloads placed by PlacementController.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cassert>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <utility>
+#include "WorkloadRegistry.hpp"
+
+using namespace std;
+
+template <class Key>
+void WorkloadRegistry::updateUsage(map<Key, unsigned int>& usage, const Key& key, bool add)
+{
+    if (add) {
+        usage[key]++;
+    } else {
+        typename map<Key, unsigned int>::iterator it = usage.find(key);
+        assert(it != usage.end());
+        if (--it->second == 0) {
+            usage.erase(it);
+        }
+    }
+}
+
+const WorkloadInfo& WorkloadRegistry::add(const WorkloadInfo& workloadInfo)
+{
+    WorkloadList::iterator it = _workloads.insert(_workloads.end(), workloadInfo);
+    unsigned long sequence = _nextSequence++;
+    _byName.insert(_byName.upper_bound(workloadInfo.name), make_pair(workloadInfo.name, make_pair(sequence, it)));
+    _byServerHost[workloadInfo.serverHost][sequence] = it;
+    updateUsage(_serverVMUsage, HostVM(workloadInfo.serverHost, workloadInfo.serverVM), true);
+    updateUsage(_clientVMUsage, HostVM(workloadInfo.clientHost, workloadInfo.clientVM), true);
+    updateUsage(_clientHostUsage, workloadInfo.clientHost, true);
+    return *it;
+}
+
+bool WorkloadRegistry::remove(const string& name)
+{
+    multimap<string, pair<unsigned long, WorkloadList::iterator> >::iterator itName = _byName.lower_bound(name);
+    if ((itName == _byName.end()) || (itName->first != name)) {
+        return false;
+    }
+    unsigned long sequence = itName->second.first;
+    WorkloadList::iterator it = itName->second.second;
+    // Remove from indexes
+    map<string, map<unsigned long, WorkloadList::iterator> >::iterator itServerHost = _byServerHost.find(it->serverHost);
+    itServerHost->second.erase(sequence);
+    if (itServerHost->second.empty()) {
+        _byServerHost.erase(itServerHost);
+    }
+    updateUsage(_serverVMUsage, HostVM(it->serverHost, it->serverVM), false);
+    updateUsage(_clientVMUsage, HostVM(it->clientHost, it->clientVM), false);
+    updateUsage(_clientHostUsage, it->clientHost, false);
+    _byName.erase(itName);
+    _workloads.erase(it);
+    return true;
+}
+
+const WorkloadInfo* WorkloadRegistry::find(const string& name) const
+{
+    multimap<string, pair<unsigned long, WorkloadList::iterator> >::const_iterator it = _byName.lower_bound(name);
+    return ((it == _byName.end()) || (it->first != name)) ? NULL : &(*it->second.second);
+}
+
+vector<const WorkloadInfo*> WorkloadRegistry::getServerHostWorkloads(const string& serverHost) const
+{
+    vector<const WorkloadInfo*> workloads;
+    map<string, map<unsigned long, WorkloadList::iterator> >::const_iterator it = _byServerHost.find(serverHost);
+    if (it != _byServerHost.end()) {
+        for (map<unsigned long, WorkloadList::iterator>::const_iterator it2 = it->second.begin(); it2 != it->second.end(); it2++) {
+            workloads.push_back(&(*it2->second));
+        }
+    }
+    return workloads;
+}
+
+bool WorkloadRegistry::serverVMInUse(const string& serverHost, const string& serverVM) const
+{
+    return _serverVMUsage.find(HostVM(serverHost, serverVM)) != _serverVMUsage.end();
+}
+
+bool WorkloadRegistry::clientVMInUse(const string& clientHost, const string& clientVM) const
+{
+    return _clientVMUsage.find(HostVM(clientHost, clientVM)) != _clientVMUsage.end();
+}
+
+bool WorkloadRegistry::clientHostInUse(const string& clientHost) const
+{
+    return _clientHostUsage.find(clientHost) != _clientHostUsage.end();
+}
@@ -0,0 +1,89 @@
+// WorkloadRegistry.hpp - Registry of the workloads placed by PlacementController.
+// Workloads are indexed by name, by server host, and by the client and server VMs they use, along with the number of workloads using each client host,
+// so that the lookups of placements and of the RPCs that add and delete VMs do not scan all workloads.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _WORKLOAD_REGISTRY_HPP
+#define _WORKLOAD_REGISTRY_HPP
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <utility>
+#include <json/json.h>
+
+using namespace std;
+
+// Resources used by a workload's flows at a queue
+struct QueueDemand {
+    string queueName;
+    double rate; // sum of the long-term rates of the flows' arrival curves
+    double burst; // sum of the bursts of the flows' arrival curves when rate limited at the queue's bandwidth
+};
+
+struct WorkloadInfo {
+    string name;
+    string clientHost;
+    string clientVM;
+    string serverHost;
+    string serverVM;
+    double SLO;
+    vector<QueueDemand> demands;
+    Json::Value clientInfo; // workload as given to AddClients, before it is converted using NC-ConfigGen
+    string addrPrefix;
+};
+
+class WorkloadRegistry
+{
+private:
+    typedef list<WorkloadInfo> WorkloadList;
+    typedef pair<string, string> HostVM;
+
+    WorkloadList _workloads; // in the order they were added
+    unsigned long _nextSequence; // sequence number of the next added workload
+    multimap<string, pair<unsigned long, WorkloadList::iterator> > _byName; // sequence number and workload by name, in the order they were added
+    map<string, map<unsigned long, WorkloadList::iterator> > _byServerHost; // by serverHost, then by sequence number
+    map<HostVM, unsigned int> _serverVMUsage; // number of workloads by serverHost/serverVM
+    map<HostVM, unsigned int> _clientVMUsage; // number of workloads by clientHost/clientVM
+    map<string, unsigned int> _clientHostUsage; // number of workloads by clientHost
+
+    // Increment or decrement a usage counter, erasing counters that drop to 0
+    template <class Key>
+    static void updateUsage(map<Key, unsigned int>& usage, const Key& key, bool add);
+
+public:
+    typedef WorkloadList::const_iterator const_iterator;
+
+    WorkloadRegistry()
+        : _nextSequence(0)
+    {}
+
+    // Workloads in the order they were added
+    const_iterator begin() const { return _workloads.begin(); }
+    const_iterator end() const { return _workloads.end(); }
+    bool empty() const { return _workloads.empty(); }
+    // Most recently added workload
+    const WorkloadInfo& back() const { return _workloads.back(); }
+
+    // Add a workload; returns the added workload
+    const WorkloadInfo& add(const WorkloadInfo& workloadInfo);
+    // Remove the earliest added workload with the name; returns false if there is no workload with the name
+    bool remove(const string& name);
+    // Get the earliest added workload with the name, or NULL if there is no workload with the name
+    const WorkloadInfo* find(const string& name) const;
+
+    // Get the workloads using a server host in the order they were added
+    vector<const WorkloadInfo*> getServerHostWorkloads(const string& serverHost) const;
+    // Check if a server VM is used by a workload
+    bool serverVMInUse(const string& serverHost, const string& serverVM) const;
+    // Check if a client VM is used by a workload
+    bool clientVMInUse(const string& clientHost, const string& clientVM) const;
+    // Check if a client host is used by a workload
+    bool clientHostInUse(const string& clientHost) const;
+};
+
+#endif // _WORKLOAD_REGISTRY_HPP
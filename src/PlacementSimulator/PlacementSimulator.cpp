@@ -0,0 +1,495 @@
+// PlacementSimulator.cpp - simulates the placement of workloads onto a cluster in a single process for measuring placement performance at scale.
+// PlacementController's placement logic (see PlacementModel) and AdmissionController's admission checks (see AdmissionChecks) are linked directly
+// into the simulator, which replays a PlacementClient topology and events file without PlacementController, AdmissionController, or RPCs.
+// Each workload's candidate servers are tested one by one in the policy's order until it fits, as a PlacementController with a single
+// AdmissionController connection would, and the placements and output file are the same as those of PlacementClient (see examples/output-example*.txt).
+// The hosts of the topology file can be replaced with synthetic client and server hosts, and its workloads can be replicated, to model large clusters.
+// Once the events are replayed, the placement throughput, number of candidates tested (i.e., probes) per placement, number of LPs solved,
+// and number of servers used are reported as JSON.
+//
+// Command line parameters:
+// -t topoFilename (required) - topology file that specifies the workloads and system configuration; see README for file format
+// -o outputFilename (required) - output file to store the results of the workload placement, as with PlacementClient
+// -e eventFilename (optional) - events file in PlacementClient's format; consolidate events are not simulated and are skipped; if not specified, by default each workload in the topology file will be added to the system
+// -w numWorkloads (optional) - replicates the workloads of the topology file into numWorkloads workloads, which are named after the workload they copy (e.g., C0, C1, ..., and then C0_1, C1_1, ...)
+// -C numClientHosts (optional) - replaces the topology file's client VMs with numClientHosts synthetic client hosts (client000, client001, ...), each having clientVMsPerHost client VMs
+// -c clientVMsPerHost (optional) - number of client VMs of each synthetic client host; defaults to 15
+// -S numServerHosts (optional) - replaces the topology file's server VMs with numServerHosts synthetic server hosts (server000, server001, ...), each having serverVMsPerHost server VMs
+// -v serverVMsPerHost (optional) - number of server VMs of each synthetic server host; defaults to 1
+// -f (optional) - enables the fast-first-fit computation optimization (see AdmissionController)
+// -n (optional) - disables the prefilter of AdmissionController's admission checks (see AdmissionController's -p option)
+// -p policy (optional) - order in which servers are tested: firstfit, bestfit, worstfit, or likely (see PlacementController's -o option); defaults to firstfit
+// -s glpk|native (optional) - solver backend for optimizing rate limit parameters; defaults to glpk
+// -r statsFilename (optional) - file for the JSON statistics; defaults to stdout
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <set>
+#include <map>
+#include <string>
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <json/json.h>
+#include "../common/time.hpp"
+#include "../common/common.hpp"
+#include "../DNC-Library/WorkloadCompactor.hpp"
+#include "../DNC-Library/NCConfig.hpp"
+#include "../PlacementController/PlacementModel.hpp"
+#include "../AdmissionController/AdmissionChecks.hpp"
+
+using namespace std;
+
+enum EventType {
+    EVENT_ADD_CLIENT,
+    EVENT_DEL_CLIENT,
+    EVENT_CONSOLIDATE
+};
+
+struct EventInfo {
+    unsigned int clientInfoIndex;
+    EventType type;
+};
+
+// Counters of the simulation
+struct SimulationStats {
+    SimulationStats()
+        : numPlaced(0),
+          numRejected(0),
+          numDeleted(0),
+          numProbes(0),
+          numPrefilterRejections(0),
+          placementTime(0)
+    {}
+    unsigned long numPlaced;
+    unsigned long numRejected;
+    unsigned long numDeleted;
+    unsigned long numProbes; // candidates tested by admission control
+    unsigned long numPrefilterRejections; // candidates rejected by the prefilter or fast-first-fit checks without optimizing rate limit parameters
+    uint64_t placementTime; // time spent placing workloads, including the admission checks
+};
+
+PlacementModel g_model; // model of the cluster, as PlacementController's
+bool g_fastFirstFit = false; // enable fast-first-fit computation optimization
+bool g_prefilter = true; // check necessary conditions of WorkloadCompactor's LP before optimizing rate limit parameters
+
+// Convert a number to a string
+string numberToString(long value)
+{
+    ostringstream oss;
+    oss << value;
+    return oss.str();
+}
+
+// Name of the synthetic host of the given type (e.g., client000)
+string getSyntheticHostName(string type, unsigned int index)
+{
+    ostringstream oss;
+    oss << type << setfill('0') << setw(3) << index;
+    return oss.str();
+}
+
+// Latency check of speculatively added clients; arg is the smallest slack of the checked clients (see checkLatency)
+bool checkLatencyCallback(NC* nc, const set<ClientId>& clientIds, void* arg)
+{
+    return checkLatency(nc, clientIds, static_cast<double*>(arg));
+}
+
+// Add a client VM to the system, as PlacementController's AddClientVM RPC
+void addClientVM(WorkloadCompactor& wc, string clientHost, string clientVM)
+{
+    if (g_model.clients.find(clientHost) == g_model.clients.end()) {
+        // Add network queues
+        Json::Value queueInInfo;
+        configGenNetworkInQueue(queueInInfo, clientHost);
+        Json::Value queueOutInfo;
+        configGenNetworkOutQueue(queueOutInfo, clientHost);
+        wc.addQueue(queueInInfo);
+        wc.addQueue(queueOutInfo);
+        g_model.addQueueHeadroom(queueInInfo);
+        g_model.addQueueHeadroom(queueOutInfo);
+    }
+    g_model.clients[clientHost].insert(clientVM);
+}
+
+// Add a server VM to the system, as PlacementController's AddServerVM RPC
+void addServerVM(WorkloadCompactor& wc, string serverHost, string serverVM)
+{
+    if (g_model.servers.find(serverHost) == g_model.servers.end()) {
+        // Add network queues
+        Json::Value queueInInfo;
+        configGenNetworkInQueue(queueInInfo, serverHost);
+        Json::Value queueOutInfo;
+        configGenNetworkOutQueue(queueOutInfo, serverHost);
+        wc.addQueue(queueInInfo);
+        wc.addQueue(queueOutInfo);
+        g_model.addQueueHeadroom(queueInInfo);
+        g_model.addQueueHeadroom(queueOutInfo);
+    }
+    set<string>& serverVMs = g_model.servers[serverHost];
+    if (serverVMs.find(serverVM) == serverVMs.end()) {
+        // Add storage queue
+        Json::Value queueStorageInfo;
+        configGenStorageQueue(queueStorageInfo, getServerName(serverHost, serverVM));
+        wc.addQueue(queueStorageInfo);
+        g_model.addQueueHeadroom(queueStorageInfo);
+        serverVMs.insert(serverVM);
+    }
+}
+
+// Place a workload by testing its candidate servers in the policy's order until it fits, as PlacementController's AddClients RPC.
+// If placed, the placement is filled into clientInfo as PlacementClient does; returns whether the workload was admitted.
+bool placeClient(WorkloadCompactor& wc, Json::Value& clientInfo, string addrPrefix, SimulationStats& stats)
+{
+    string clientName = clientInfo["name"].asString();
+    double SLO = clientInfo["SLO"].asDouble();
+    vector<TemplateFlow> flows = getTemplateFlows(clientInfo, addrPrefix);
+    // Get candidate servers, or the workload's server if admitted already
+    vector<PlacementCandidate> candidates;
+    bool admitOverride = clientInfo.isMember("admitted") && clientInfo["admitted"].asBool();
+    if (admitOverride) {
+        PlacementCandidate candidate;
+        candidate.server = pair<string, string>(clientInfo["serverHost"].asString(), clientInfo["serverVM"].asString());
+        candidate.client = g_model.clientServerPlacement(candidate.server.first);
+        candidates.push_back(candidate);
+    } else {
+        candidates = g_model.getCandidates(flows, SLO);
+    }
+    // Generate the workload's flows and arrival curves once, so only the fields that depend on the placement are updated for each candidate
+    Json::Value clientInfos(Json::arrayValue);
+    clientInfos.append(clientInfo);
+    ClientConfigTemplate config;
+    configGenClientTemplate(clientInfos[0u], clientName, addrPrefix, false, config);
+    // Test candidates in order until the workload fits
+    unsigned int bestIndex = candidates.size();
+    double bestSlack = numeric_limits<double>::infinity();
+    for (unsigned int i = 0; i < candidates.size(); i++) {
+        const PlacementCandidate& candidate = candidates[i];
+        configGenClientPlacement(clientInfos[0u], config, candidate.client.first, candidate.client.second, candidate.server.first, candidate.server.second);
+        if (admitOverride) {
+            bestIndex = i;
+            break;
+        }
+        stats.numProbes++;
+        PrefilterCheck prefilterCheck;
+        if (!prefilterClients(&wc, clientInfos, g_fastFirstFit, g_prefilter, prefilterCheck)) {
+            stats.numPrefilterRejections++;
+            continue;
+        }
+        // Check latency of speculatively added clients
+        double slack = numeric_limits<double>::infinity();
+        if (wc.tryAddClients(clientInfos, checkLatencyCallback, &slack)) {
+            bestIndex = i;
+            bestSlack = slack;
+            break;
+        }
+    }
+    // Record rejections in the headroom index
+    for (unsigned int i = 0; (i < bestIndex) && (i < candidates.size()); i++) {
+        g_model.serverHeadroom[candidates[i].server].rejections++;
+    }
+    if (bestIndex >= candidates.size()) {
+        return false;
+    }
+    // Add workload, whose config was already placed at the fit
+    const PlacementCandidate& candidate = candidates[bestIndex];
+    Json::Value& placedInfo = clientInfos[0u];
+    placedInfo["admitted"] = Json::Value(true);
+    wc.addClient(placedInfo);
+    WorkloadInfo workloadInfo;
+    workloadInfo.name = clientName;
+    workloadInfo.clientHost = candidate.client.first;
+    workloadInfo.clientVM = candidate.client.second;
+    workloadInfo.serverHost = candidate.server.first;
+    workloadInfo.serverVM = candidate.server.second;
+    workloadInfo.SLO = SLO;
+    workloadInfo.demands = g_model.getDemands(flows, getPlacementQueues(candidate.client.first, candidate.server.first, candidate.server.second));
+    workloadInfo.clientInfo = clientInfo;
+    workloadInfo.addrPrefix = addrPrefix;
+    g_model.addWorkload(workloadInfo, bestSlack);
+    // Fill in placement
+    clientInfo["clientHost"] = Json::Value(candidate.client.first);
+    clientInfo["clientVM"] = Json::Value(candidate.client.second);
+    clientInfo["serverHost"] = Json::Value(candidate.server.first);
+    clientInfo["serverVM"] = Json::Value(candidate.server.second);
+    return true;
+}
+
+// Remove a workload from the system, as PlacementController's DelClient RPC
+void removeClient(WorkloadCompactor& wc, string clientName)
+{
+    if (g_model.removeWorkload(clientName)) {
+        wc.delClient(wc.getClientIdByName(clientName));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int opt = 0;
+    char* topoFilename = NULL;
+    char* outputFilename = NULL;
+    char* eventFilename = NULL;
+    char* statsFilename = NULL;
+    long numWorkloads = 0;
+    long numClientHosts = 0;
+    long clientVMsPerHost = 15;
+    long numServerHosts = 0;
+    long serverVMsPerHost = 1;
+    ShaperSolverType solverType = SHAPER_SOLVER_GLPK;
+    bool validArgs = true;
+    do {
+        opt = getopt(argc, argv, "t:o:e:w:C:c:S:v:fnp:s:r:");
+        switch (opt) {
+            case 't':
+                topoFilename = optarg;
+                break;
+
+            case 'o':
+                outputFilename = optarg;
+                break;
+
+            case 'e':
+                eventFilename = optarg;
+                break;
+
+            case 'w':
+                numWorkloads = atol(optarg);
+                validArgs = validArgs && (numWorkloads > 0);
+                break;
+
+            case 'C':
+                numClientHosts = atol(optarg);
+                validArgs = validArgs && (numClientHosts > 0);
+                break;
+
+            case 'c':
+                clientVMsPerHost = atol(optarg);
+                validArgs = validArgs && (clientVMsPerHost > 0);
+                break;
+
+            case 'S':
+                numServerHosts = atol(optarg);
+                validArgs = validArgs && (numServerHosts > 0);
+                break;
+
+            case 'v':
+                serverVMsPerHost = atol(optarg);
+                validArgs = validArgs && (serverVMsPerHost > 0);
+                break;
+
+            case 'f':
+                g_fastFirstFit = true;
+                break;
+
+            case 'n':
+                g_prefilter = false;
+                break;
+
+            case 'p':
+                if (string(optarg) == "firstfit") {
+                    g_model.policy = PLACEMENT_FIRST_FIT;
+                } else if (string(optarg) == "bestfit") {
+                    g_model.policy = PLACEMENT_BEST_FIT;
+                } else if (string(optarg) == "worstfit") {
+                    g_model.policy = PLACEMENT_WORST_FIT;
+                } else if (string(optarg) == "likely") {
+                    g_model.policy = PLACEMENT_LIKELY_FIT;
+                } else {
+                    validArgs = false;
+                }
+                break;
+
+            case 's':
+                if (string(optarg) == "glpk") {
+                    solverType = SHAPER_SOLVER_GLPK;
+                } else if (string(optarg) == "native") {
+                    solverType = SHAPER_SOLVER_NATIVE;
+                } else {
+                    validArgs = false;
+                }
+                break;
+
+            case 'r':
+                statsFilename = optarg;
+                break;
+
+            case -1:
+                break;
+
+            default:
+                validArgs = false;
+                break;
+        }
+    } while (opt != -1);
+
+    if (!validArgs || (topoFilename == NULL) || (outputFilename == NULL)) {
+        cout << "Usage: " << argv[0] << " -t topoFilename -o outputFilename [-e eventFilename] [-w numWorkloads] [-C numClientHosts] [-c clientVMsPerHost]"
+             << " [-S numServerHosts] [-v serverVMsPerHost] [-f] [-n] [-p firstfit|bestfit|worstfit|likely] [-s glpk|native] [-r statsFilename]" << endl;
+        return -1;
+    }
+
+    // Read config
+    Json::Value rootConfig;
+    if (!readJson(topoFilename, rootConfig)) {
+        return -1;
+    }
+    // Replace hosts with synthetic hosts
+    if (numClientHosts > 0) {
+        Json::Value& clientVMs = rootConfig["clientVMs"];
+        clientVMs = Json::arrayValue;
+        for (long host = 0; host < numClientHosts; host++) {
+            for (long vm = 0; vm < clientVMsPerHost; vm++) {
+                Json::Value clientVM;
+                clientVM["clientHost"] = Json::Value(getSyntheticHostName("client", host));
+                clientVM["clientVM"] = Json::Value(numberToString(vm));
+                clientVMs.append(clientVM);
+            }
+        }
+    }
+    if (numServerHosts > 0) {
+        Json::Value& serverVMs = rootConfig["serverVMs"];
+        serverVMs = Json::arrayValue;
+        for (long host = 0; host < numServerHosts; host++) {
+            for (long vm = 1; vm <= serverVMsPerHost; vm++) {
+                Json::Value serverVM;
+                serverVM["serverHost"] = Json::Value(getSyntheticHostName("server", host));
+                serverVM["serverVM"] = Json::Value(numberToString(vm));
+                serverVMs.append(serverVM);
+            }
+        }
+    }
+    // Replicate workloads
+    Json::Value& clientInfos = rootConfig["clients"];
+    unsigned int numTopoClients = clientInfos.size();
+    if ((numWorkloads > 0) && (numTopoClients > 0)) {
+        Json::Value topoClientInfos = clientInfos;
+        clientInfos = Json::arrayValue;
+        for (long i = 0; i < numWorkloads; i++) {
+            Json::Value clientInfo = topoClientInfos[(unsigned int)(i % numTopoClients)];
+            if (i >= numTopoClients) {
+                clientInfo["name"] = Json::Value(clientInfo["name"].asString() + "_" + numberToString(i / numTopoClients));
+            }
+            clientInfos.append(clientInfo);
+        }
+    }
+    // Create model
+    WorkloadCompactor wc;
+    wc.setSolverType(solverType);
+    Json::Value& clientVMs = rootConfig["clientVMs"];
+    for (unsigned int clientVMIndex = 0; clientVMIndex < clientVMs.size(); clientVMIndex++) {
+        Json::Value& clientVM = clientVMs[clientVMIndex];
+        addClientVM(wc, clientVM["clientHost"].asString(), clientVM["clientVM"].asString());
+    }
+    Json::Value& serverVMs = rootConfig["serverVMs"];
+    for (unsigned int serverVMIndex = 0; serverVMIndex < serverVMs.size(); serverVMIndex++) {
+        Json::Value& serverVM = serverVMs[serverVMIndex];
+        addServerVM(wc, serverVM["serverHost"].asString(), serverVM["serverVM"].asString());
+    }
+    // Process events file, or by default add one of every client in order in topology file
+    vector<EventInfo> events;
+    if (eventFilename) {
+        ifstream file(eventFilename);
+        if (!file.is_open()) {
+            cerr << "Failed to open events file " << eventFilename << endl;
+            return -1;
+        }
+        string line;
+        EventInfo event;
+        char type[32];
+        while (getline(file, line)) {
+            // Parse line
+            if (sscanf(line.c_str(), "%u,%31[^,]", &event.clientInfoIndex, type) == 2) {
+                if (strcmp(type, "addClient") == 0) {
+                    event.type = EVENT_ADD_CLIENT;
+                } else if (strcmp(type, "consolidate") == 0) {
+                    event.type = EVENT_CONSOLIDATE;
+                } else {
+                    event.type = EVENT_DEL_CLIENT;
+                }
+                if ((event.type != EVENT_CONSOLIDATE) && (event.clientInfoIndex >= clientInfos.size())) {
+                    cerr << "Invalid workload index " << event.clientInfoIndex << " in events file" << endl;
+                    return -1;
+                }
+                events.push_back(event);
+            }
+        }
+    } else {
+        EventInfo event;
+        event.type = EVENT_ADD_CLIENT;
+        for (event.clientInfoIndex = 0; event.clientInfoIndex < clientInfos.size(); event.clientInfoIndex++) {
+            events.push_back(event);
+        }
+    }
+    // Add/remove clients according to events
+    string addrPrefix = rootConfig["addrPrefix"].asString();
+    SimulationStats stats;
+    unsigned long numLPSolves = wc.getNumLPSolves();
+    for (unsigned int eventIndex = 0; eventIndex < events.size(); eventIndex++) {
+        const EventInfo& event = events[eventIndex];
+        if (event.type == EVENT_CONSOLIDATE) {
+            cerr << "Skipping consolidate event " << eventIndex << ", which is not simulated" << endl;
+            continue;
+        }
+        Json::Value& clientInfo = clientInfos[event.clientInfoIndex];
+        if (event.type == EVENT_ADD_CLIENT) {
+            uint64_t startTime = GetTime();
+            bool admitted = placeClient(wc, clientInfo, addrPrefix, stats);
+            stats.placementTime += GetTime() - startTime;
+            if (admitted) {
+                stats.numPlaced++;
+                cout << "Placed " << clientInfo["name"].asString() << " (" << clientInfo["clientHost"].asString() << ", " << clientInfo["clientVM"].asString() << ") -> (" << clientInfo["serverHost"].asString() << ", " << clientInfo["serverVM"].asString() << ")" << endl;
+            } else {
+                stats.numRejected++;
+                cout << "Rejected " << clientInfo["name"].asString() << endl;
+            }
+        } else {
+            removeClient(wc, clientInfo["name"].asString());
+            stats.numDeleted++;
+        }
+    }
+    numLPSolves = wc.getNumLPSolves() - numLPSolves;
+    // Write config
+    if (!writeJson(outputFilename, rootConfig)) {
+        return -1;
+    }
+    // Count servers in use
+    unsigned int numServerHostsUsed = 0;
+    for (map<string, set<string> >::const_iterator it = g_model.servers.begin(); it != g_model.servers.end(); it++) {
+        if (!g_model.workloads.getServerHostWorkloads(it->first).empty()) {
+            numServerHostsUsed++;
+        }
+    }
+    // Write stats
+    unsigned long numPlacements = stats.numPlaced + stats.numRejected;
+    double placementSeconds = ConvertTimeToSeconds(stats.placementTime);
+    Json::Value statsInfo;
+    statsInfo["placed"] = Json::Value((Json::UInt64)stats.numPlaced);
+    statsInfo["rejected"] = Json::Value((Json::UInt64)stats.numRejected);
+    statsInfo["deleted"] = Json::Value((Json::UInt64)stats.numDeleted);
+    statsInfo["placementSeconds"] = Json::Value(placementSeconds);
+    statsInfo["placementsPerSecond"] = Json::Value((placementSeconds > 0) ? numPlacements / placementSeconds : 0.0);
+    statsInfo["probes"] = Json::Value((Json::UInt64)stats.numProbes);
+    statsInfo["probesPerPlacement"] = Json::Value((numPlacements > 0) ? (double)stats.numProbes / numPlacements : 0.0);
+    statsInfo["prefilterRejections"] = Json::Value((Json::UInt64)stats.numPrefilterRejections);
+    statsInfo["lpSolves"] = Json::Value((Json::UInt64)numLPSolves);
+    statsInfo["serverHosts"] = Json::Value((unsigned int)g_model.servers.size());
+    statsInfo["serverHostsUsed"] = Json::Value(numServerHostsUsed);
+    if (statsFilename) {
+        if (!writeJson(statsFilename, statsInfo)) {
+            return -1;
+        }
+    } else {
+        Json::StyledWriter writer;
+        cout << writer.write(statsInfo);
+    }
+    return 0;
+}
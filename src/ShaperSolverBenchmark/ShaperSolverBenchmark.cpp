@@ -0,0 +1,223 @@
+// ShaperSolverBenchmark.cpp - compares the GLPK and native solvers for WorkloadCompactor's rate limit parameter LP.
+// The workloads of each topology file are placed one by one onto the topology's server VMs in a first-fit fashion, as with PlacementController,
+// using the GLPK solver. The same sequence of admission checks is then replayed with the native solver, following GLPK's admission decisions
+// so that both solvers see the same LPs. For each solver, the time spent in admission control and the LP objective (i.e., the sum of the flows'
+// rate limits normalized by the bandwidth of their first queue) of the final placement are reported, along with the number of admission
+// decisions where the native solver disagrees. Since the LP's optimal solution is not always unique, a few decisions may differ even when
+// the objectives agree, as the rate limit parameters of equally optimal solutions lead to different latencies.
+// Should be run from the same directory as PlacementController so that the arrivalCurves directory and profileSSD.txt file are found.
+//
+// Command line parameters:
+// -t topoFilename (required) - topology file whose workloads are placed; see README for file format; this command line option can be used multiple times
+// -j numThreads (optional) - number of threads for solving the LPs of independent client groups; defaults to WORKLOAD_COMPACTOR_SOLVER_THREADS
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <set>
+#include <map>
+#include <string>
+#include <cstdlib>
+#include <unistd.h>
+#include <json/json.h>
+#include "../common/common.hpp"
+#include "../common/time.hpp"
+#include "../DNC-Library/NCConfig.hpp"
+#include "../DNC-Library/WorkloadCompactor.hpp"
+
+using namespace std;
+
+// Results of placing a topology's workloads with a solver
+struct PlacementResult {
+    unsigned int numAdmitted;
+    unsigned int numDisagreements; // number of admission decisions that differ from the replayed decisions
+    double objective;
+    double duration; // time spent in admission control in seconds
+};
+
+// AdmissionCheck that checks the SLOs of all workloads, since the speculatively added workloads may affect any workload they share a queue with
+static bool checkAllLatency(NC* nc, const set<ClientId>& clientIds, void* arg)
+{
+    for (ClientIterator it = nc->clientsBegin(); it != nc->clientsEnd(); it++) {
+        if (nc->calcClientLatency(it->first) > it->second->SLO) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Choose a client VM for a workload on a server host; workloads that share a server are grouped onto the same client machine as in PlacementController
+static pair<string, string> clientServerPlacement(const map<string, set<string> >& clients, const map<string, string>& serverClientGrouping, string serverHost)
+{
+    map<string, string>::const_iterator it = serverClientGrouping.find(serverHost);
+    if (it != serverClientGrouping.end()) {
+        const set<string>& clientVMs = clients.find(it->second)->second;
+        if (!clientVMs.empty()) {
+            return pair<string, string>(it->second, *(clientVMs.begin()));
+        }
+    }
+    string clientHost;
+    unsigned int maxAvailableClients = 0;
+    for (map<string, set<string> >::const_iterator it2 = clients.begin(); it2 != clients.end(); it2++) {
+        if (it2->second.size() > maxAvailableClients) {
+            maxAvailableClients = it2->second.size();
+            clientHost = it2->first;
+        }
+    }
+    if (maxAvailableClients == 0) {
+        return pair<string, string>("", "");
+    }
+    return pair<string, string>(clientHost, *(clients.find(clientHost)->second.begin()));
+}
+
+// Place the workloads of a topology in first-fit order using a solver.
+// Admission decisions are recorded in decisions, or if replay is set, the recorded decisions are followed instead.
+static PlacementResult placeTopology(const Json::Value& rootConfig, ShaperSolverType solverType, unsigned int numThreads, vector<bool>& decisions, bool replay)
+{
+    PlacementResult result = {0, 0, 0, 0};
+    WorkloadCompactor wc(numThreads);
+    wc.setSolverType(solverType);
+    string addrPrefix = rootConfig["addrPrefix"].asString();
+    // Setup client VMs, server VMs, and queues
+    map<string, set<string> > clients;
+    vector<pair<string, string> > servers;
+    set<string> hosts;
+    const Json::Value& clientVMs = rootConfig["clientVMs"];
+    for (unsigned int i = 0; i < clientVMs.size(); i++) {
+        clients[clientVMs[i]["clientHost"].asString()].insert(clientVMs[i]["clientVM"].asString());
+        hosts.insert(clientVMs[i]["clientHost"].asString());
+    }
+    const Json::Value& serverVMs = rootConfig["serverVMs"];
+    for (unsigned int i = 0; i < serverVMs.size(); i++) {
+        string serverHost = serverVMs[i]["serverHost"].asString();
+        string serverVM = serverVMs[i]["serverVM"].asString();
+        servers.push_back(pair<string, string>(serverHost, serverVM));
+        hosts.insert(serverHost);
+        Json::Value queueStorageInfo;
+        configGenStorageQueue(queueStorageInfo, getServerName(serverHost, serverVM));
+        wc.addQueue(queueStorageInfo);
+    }
+    for (set<string>::const_iterator it = hosts.begin(); it != hosts.end(); it++) {
+        Json::Value queueInInfo;
+        configGenNetworkInQueue(queueInInfo, *it);
+        wc.addQueue(queueInInfo);
+        Json::Value queueOutInfo;
+        configGenNetworkOutQueue(queueOutInfo, *it);
+        wc.addQueue(queueOutInfo);
+    }
+    // Place workloads
+    map<string, string> serverClientGrouping;
+    unsigned int numChecks = 0;
+    const Json::Value& workloads = rootConfig["clients"];
+    for (unsigned int i = 0; i < workloads.size(); i++) {
+        for (vector<pair<string, string> >::const_iterator it = servers.begin(); it != servers.end(); it++) {
+            pair<string, string> client = clientServerPlacement(clients, serverClientGrouping, it->first);
+            if (client.first.empty()) {
+                break;
+            }
+            Json::Value clientInfo = workloads[i];
+            clientInfo["clientHost"] = Json::Value(client.first);
+            clientInfo["clientVM"] = Json::Value(client.second);
+            clientInfo["serverHost"] = Json::Value(it->first);
+            clientInfo["serverVM"] = Json::Value(it->second);
+            configGenClient(clientInfo, clientInfo["name"].asString(), addrPrefix, false);
+            Json::Value clientInfos(Json::arrayValue);
+            clientInfos.append(clientInfo);
+            uint64_t startTime = GetTime();
+            bool admitted = wc.tryAddClients(clientInfos, checkAllLatency, NULL);
+            if (replay) {
+                if (admitted != decisions[numChecks]) {
+                    result.numDisagreements++;
+                }
+                admitted = decisions[numChecks];
+            } else {
+                decisions.push_back(admitted);
+            }
+            numChecks++;
+            if (admitted) {
+                wc.addClient(clientInfo);
+            }
+            result.duration += ConvertTimeToSeconds(GetTime() - startTime);
+            if (admitted) {
+                result.numAdmitted++;
+                serverClientGrouping[it->first] = client.first;
+                clients[client.first].erase(client.second);
+                break;
+            }
+        }
+    }
+    // Calculate objective of final placement
+    uint64_t startTime = GetTime();
+    wc.calcAllLatency();
+    result.duration += ConvertTimeToSeconds(GetTime() - startTime);
+    for (FlowIterator it = wc.flowsBegin(); it != wc.flowsEnd(); it++) {
+        const Flow* f = it->second;
+        result.objective += wc.getShaperCurve(f->flowId).r / wc.getQueue(f->queueIds.front())->bandwidth;
+    }
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    int opt = 0;
+    vector<string> topoFilenames;
+    long numThreads = WORKLOAD_COMPACTOR_SOLVER_THREADS;
+    do {
+        opt = getopt(argc, argv, "t:j:");
+        switch (opt) {
+            case 't':
+                topoFilenames.push_back(string(optarg));
+                break;
+
+            case 'j':
+                numThreads = atol(optarg);
+                break;
+
+            case -1:
+                break;
+
+            default:
+                break;
+        }
+    } while (opt != -1);
+
+    if (topoFilenames.empty() || (numThreads <= 0)) {
+        cout << "Usage: " << argv[0] << " -t topoFilename [-t topoFilename ...] [-j numThreads]" << endl;
+        return -1;
+    }
+
+    bool agree = true;
+    for (vector<string>::const_iterator it = topoFilenames.begin(); it != topoFilenames.end(); it++) {
+        Json::Value rootConfig;
+        if (!readJson(*it, rootConfig)) {
+            return -1;
+        }
+        // Load arrival curves ahead of time so they are not part of the timing
+        for (unsigned int i = 0; i < rootConfig["clients"].size(); i++) {
+            Json::Value clientInfo = rootConfig["clients"][i];
+            clientInfo["clientHost"] = rootConfig["clientVMs"][0u]["clientHost"];
+            clientInfo["clientVM"] = rootConfig["clientVMs"][0u]["clientVM"];
+            clientInfo["serverHost"] = rootConfig["serverVMs"][0u]["serverHost"];
+            clientInfo["serverVM"] = rootConfig["serverVMs"][0u]["serverVM"];
+            configGenClient(clientInfo, clientInfo["name"].asString(), rootConfig["addrPrefix"].asString(), false);
+        }
+        vector<bool> decisions;
+        PlacementResult glpk = placeTopology(rootConfig, SHAPER_SOLVER_GLPK, numThreads, decisions, false);
+        PlacementResult native = placeTopology(rootConfig, SHAPER_SOLVER_NATIVE, numThreads, decisions, true);
+        double objectiveDifference = fabs(glpk.objective - native.objective);
+        cout << *it << ": admitted " << glpk.numAdmitted << "/" << rootConfig["clients"].size() << " workloads with " << decisions.size() << " admission checks" << endl;
+        cout << fixed << setprecision(3);
+        cout << "  glpk:   " << glpk.duration << " s, objective " << setprecision(6) << glpk.objective << setprecision(3) << endl;
+        cout << "  native: " << native.duration << " s, objective " << setprecision(6) << native.objective << setprecision(3) << ", " << native.numDisagreements << " differing admission decisions" << endl;
+        cout << "  speedup " << ((native.duration > 0) ? (glpk.duration / native.duration) : 0) << "x, objective difference " << scientific << setprecision(2) << objectiveDifference << fixed << endl;
+        if (objectiveDifference > 1e-6 * max(1.0, glpk.objective)) {
+            agree = false;
+        }
+    }
+    return agree ? 0 : 1;
+}
@@ -0,0 +1,215 @@
+// BinaryTraceReader.cpp - Code for reading binary trace files.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "TraceReader.hpp"
+#include "BinaryTraceReader.hpp"
+
+using namespace std;
+
+// Read a little-endian integer of a given number of bytes.
+static uint64_t readLittleEndian(const unsigned char* buf, unsigned int numBytes)
+{
+    uint64_t value = 0;
+    for (unsigned int i = 0; i < numBytes; i++) {
+        value |= static_cast<uint64_t>(buf[i]) << (8 * i);
+    }
+    return value;
+}
+
+// Write a little-endian integer of a given number of bytes.
+static void writeLittleEndian(unsigned char* buf, uint64_t value, unsigned int numBytes)
+{
+    for (unsigned int i = 0; i < numBytes; i++) {
+        buf[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+// Decode an unsigned LEB128 varint starting at offset. Returns false if the varint extends past size.
+static inline bool readVarint(const unsigned char* buf, size_t size, size_t& offset, uint64_t& value)
+{
+    value = 0;
+    for (unsigned int shift = 0; (offset < size) && (shift < 64); shift += 7) {
+        unsigned char byte = buf[offset++];
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Encode an unsigned LEB128 varint into buf. Returns the number of bytes used.
+static unsigned int writeVarint(unsigned char* buf, uint64_t value)
+{
+    unsigned int numBytes = 0;
+    do {
+        unsigned char byte = value & 0x7f;
+        value >>= 7;
+        if (value != 0) {
+            byte |= 0x80;
+        }
+        buf[numBytes++] = byte;
+    } while (value != 0);
+    return numBytes;
+}
+
+// Build the header of a binary trace file.
+static void writeHeader(unsigned char* header, uint64_t numEntries)
+{
+    memset(header, 0, BINARY_TRACE_HEADER_SIZE);
+    memcpy(header, BINARY_TRACE_MAGIC, sizeof(BINARY_TRACE_MAGIC));
+    writeLittleEndian(header + 8, BINARY_TRACE_VERSION, 4);
+    writeLittleEndian(header + 16, numEntries, 8);
+}
+
+BinaryTraceReader::BinaryTraceReader(string filename)
+    : _filename(filename),
+      _map(NULL),
+      _mapSize(0),
+      _numEntries(0)
+{
+    mapFile();
+    reset();
+}
+
+BinaryTraceReader::BinaryTraceReader(const BinaryTraceReader& other)
+    : TraceReader(),
+      _filename(other._filename),
+      _map(NULL),
+      _mapSize(0),
+      _numEntries(0)
+{
+    mapFile();
+    reset();
+}
+
+BinaryTraceReader::~BinaryTraceReader()
+{
+    unmapFile();
+}
+
+void BinaryTraceReader::mapFile()
+{
+    int fd = open(_filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "Unable to open " << _filename << endl;
+        return;
+    }
+    struct stat st;
+    if ((fstat(fd, &st) == 0) && (st.st_size >= BINARY_TRACE_HEADER_SIZE)) {
+        void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            _map = static_cast<const unsigned char*>(addr);
+            _mapSize = st.st_size;
+            // Entries are read sequentially
+            madvise(addr, _mapSize, MADV_SEQUENTIAL);
+        }
+    }
+    close(fd);
+    if ((_map == NULL) || (memcmp(_map, BINARY_TRACE_MAGIC, sizeof(BINARY_TRACE_MAGIC)) != 0) || (readLittleEndian(_map + 8, 4) != BINARY_TRACE_VERSION)) {
+        cerr << "Invalid binary trace file " << _filename << endl;
+        unmapFile();
+        return;
+    }
+    _numEntries = readLittleEndian(_map + 16, 8);
+}
+
+void BinaryTraceReader::unmapFile()
+{
+    if (_map != NULL) {
+        munmap(const_cast<unsigned char*>(_map), _mapSize);
+    }
+    _map = NULL;
+    _mapSize = 0;
+    _numEntries = 0;
+}
+
+bool BinaryTraceReader::isBinaryTrace(string filename)
+{
+    char magic[sizeof(BINARY_TRACE_MAGIC)];
+    ifstream file(filename.c_str(), ifstream::binary);
+    if (!file.read(magic, sizeof(magic))) {
+        return false;
+    }
+    return (memcmp(magic, BINARY_TRACE_MAGIC, sizeof(BINARY_TRACE_MAGIC)) == 0);
+}
+
+bool BinaryTraceReader::write(TraceReader& traceReader, string filename)
+{
+    ofstream file(filename.c_str(), ofstream::out | ofstream::trunc | ofstream::binary);
+    if (!file.is_open()) {
+        cerr << "Unable to open " << filename << endl;
+        return false;
+    }
+    // Write placeholder header, which is rewritten once the number of entries is known
+    unsigned char header[BINARY_TRACE_HEADER_SIZE];
+    writeHeader(header, 0);
+    file.write(reinterpret_cast<char*>(header), BINARY_TRACE_HEADER_SIZE);
+    // Write entries
+    uint64_t numEntries = 0;
+    uint64_t prevArrivalTime = 0;
+    TraceEntry entry;
+    while (traceReader.nextEntry(entry)) {
+        unsigned char buf[20];
+        int64_t delta = static_cast<int64_t>(entry.arrivalTime - prevArrivalTime);
+        uint64_t zigzagDelta = (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63);
+        unsigned int numBytes = writeVarint(buf, zigzagDelta);
+        numBytes += writeVarint(buf + numBytes, (static_cast<uint64_t>(entry.requestSize) << 1) | (entry.isRead ? 1 : 0));
+        file.write(reinterpret_cast<char*>(buf), numBytes);
+        prevArrivalTime = entry.arrivalTime;
+        numEntries++;
+    }
+    writeHeader(header, numEntries);
+    file.seekp(0);
+    file.write(reinterpret_cast<char*>(header), BINARY_TRACE_HEADER_SIZE);
+    file.close();
+    if (file.fail()) {
+        cerr << "Error writing " << filename << endl;
+        return false;
+    }
+    return true;
+}
+
+bool BinaryTraceReader::nextEntry(TraceEntry& entry)
+{
+    if (_curEntry >= _numEntries) {
+        return false;
+    }
+    uint64_t zigzagDelta;
+    uint64_t sizeAndType;
+    if (!readVarint(_map, _mapSize, _curOffset, zigzagDelta) || !readVarint(_map, _mapSize, _curOffset, sizeAndType)) {
+        cerr << "Truncated binary trace file " << _filename << endl;
+        _curEntry = _numEntries;
+        return false;
+    }
+    int64_t delta = static_cast<int64_t>(zigzagDelta >> 1) ^ -static_cast<int64_t>(zigzagDelta & 1);
+    _prevArrivalTime += delta;
+    entry.arrivalTime = _prevArrivalTime;
+    entry.requestSize = sizeAndType >> 1;
+    entry.isRead = ((sizeAndType & 1) != 0);
+    _curEntry++;
+    return true;
+}
+
+void BinaryTraceReader::reset()
+{
+    _curOffset = BINARY_TRACE_HEADER_SIZE;
+    _curEntry = 0;
+    _prevArrivalTime = 0;
+}
+
+TraceReader* BinaryTraceReader::clone() const
+{
+    return new BinaryTraceReader(*this);
+}
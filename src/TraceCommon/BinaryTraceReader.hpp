@@ -0,0 +1,68 @@
+// BinaryTraceReader.hpp - Class definitions for reading binary trace files.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _BINARY_TRACE_READER_HPP
+#define _BINARY_TRACE_READER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "TraceReader.hpp"
+
+using namespace std;
+
+// Binary trace files are a compact alternative to CSV trace files that can be read without parsing.
+// A binary trace file consists of a fixed 24 byte header followed by packed entries.
+// Header (little-endian):
+// 1) 8 byte magic "WCTRACE\0"
+// 2) 4 byte format version (currently 1)
+// 3) 4 byte reserved field (0)
+// 4) 8 byte number of entries
+// Each entry consists of two unsigned LEB128 varints:
+// 1) zigzag encoded difference between the entry's arrival time and the previous entry's arrival time (0 for the first entry) in nanoseconds
+// 2) (requestSize << 1) | isRead
+#define BINARY_TRACE_MAGIC "WCTRACE"
+#define BINARY_TRACE_VERSION 1
+#define BINARY_TRACE_HEADER_SIZE 24
+
+// Reads requests from a binary trace file by memory mapping the file and decoding entries in place.
+// BinaryTraceReader is not thread-safe.
+class BinaryTraceReader : public TraceReader
+{
+private:
+    string _filename;
+    const unsigned char* _map;
+    size_t _mapSize;
+    uint64_t _numEntries;
+    // Iteration state
+    size_t _curOffset;
+    uint64_t _curEntry;
+    uint64_t _prevArrivalTime;
+
+    void mapFile();
+    void unmapFile();
+
+    BinaryTraceReader& operator=(const BinaryTraceReader& other); // not implemented
+
+public:
+    BinaryTraceReader(string filename);
+    BinaryTraceReader(const BinaryTraceReader& other);
+    virtual ~BinaryTraceReader();
+
+    // Returns true if filename is a binary trace file.
+    static bool isBinaryTrace(string filename);
+    // Writes all the remaining requests from traceReader to a binary trace file. Returns false on error.
+    static bool write(TraceReader& traceReader, string filename);
+
+    // Fills entry with the next request from the trace. Returns false if end of trace.
+    virtual bool nextEntry(TraceEntry& entry);
+    // Resets trace reader back to beginning of trace.
+    virtual void reset();
+    // Returns a copy of this trace reader, reset to the beginning of the trace.
+    virtual TraceReader* clone() const;
+};
+
+#endif // _BINARY_TRACE_READER_HPP
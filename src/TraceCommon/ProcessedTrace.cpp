@@ -11,21 +11,28 @@
 
 using namespace std;
 
-ProcessedTrace::ProcessedTrace(string filename, Estimator* pEst)
-    : _traceReader(filename),
+ProcessedTrace::ProcessedTrace(string filename, Estimator* pEst, bool streaming)
+    : _pTraceReader(TraceReader::create(filename, streaming)),
+      _pEst(pEst)
+{
+}
+
+ProcessedTrace::ProcessedTrace(const TraceReader& traceReader, Estimator* pEst)
+    : _pTraceReader(traceReader.clone()),
       _pEst(pEst)
 {
 }
 
 ProcessedTrace::~ProcessedTrace()
 {
+    delete _pTraceReader;
     delete _pEst;
 }
 
 bool ProcessedTrace::nextEntry(ProcessedTraceEntry& entry)
 {
     TraceEntry traceEntry;
-    if (_traceReader.nextEntry(traceEntry)) {
+    if (_pTraceReader->nextEntry(traceEntry)) {
         entry.arrivalTime = traceEntry.arrivalTime;
         entry.work = _pEst->estimateWork(traceEntry.requestSize, traceEntry.isRead);
         entry.isRead = traceEntry.isRead;
@@ -36,6 +43,6 @@ bool ProcessedTrace::nextEntry(ProcessedTraceEntry& entry)
 
 void ProcessedTrace::reset()
 {
-    _traceReader.reset();
+    _pTraceReader->reset();
     _pEst->reset();
 }
@@ -22,15 +22,22 @@ struct ProcessedTraceEntry {
 };
 
 // Reads requests from trace file with TraceReader and converts each request's request size into work using the given estimator.
+// The trace file format (CSV or binary) is detected automatically.
 // ProcessedTrace is not thread-safe.
 class ProcessedTrace
 {
 private:
-    TraceReader _traceReader;
+    TraceReader* _pTraceReader;
     Estimator* _pEst;
 
+    ProcessedTrace(const ProcessedTrace& other); // not implemented
+    ProcessedTrace& operator=(const ProcessedTrace& other); // not implemented
+
 public:
-    ProcessedTrace(string filename, Estimator* pEst);
+    // If streaming is true, CSV traces are read with bounded memory (see StreamingTraceReader.hpp).
+    ProcessedTrace(string filename, Estimator* pEst, bool streaming = false);
+    // Uses a copy of an already parsed trace to avoid reparsing the trace file.
+    ProcessedTrace(const TraceReader& traceReader, Estimator* pEst);
     virtual ~ProcessedTrace();
 
     // Fills entry with the next request from the trace. Returns false if end of trace.
@@ -0,0 +1,124 @@
+// StreamingTraceReader.cpp - Code for reading large CSV trace files with bounded memory.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include "TraceReader.hpp"
+#include "StreamingTraceReader.hpp"
+
+using namespace std;
+
+StreamingTraceReader::StreamingTraceReader(string filename, size_t chunkSize)
+    : _filename(filename),
+      _file(NULL),
+      _chunkSize(chunkSize)
+{
+    openFile();
+}
+
+StreamingTraceReader::StreamingTraceReader(const StreamingTraceReader& other)
+    : TraceReader(),
+      _filename(other._filename),
+      _file(NULL),
+      _chunkSize(other._chunkSize)
+{
+    openFile();
+}
+
+StreamingTraceReader::~StreamingTraceReader()
+{
+    if (_file != NULL) {
+        fclose(_file);
+    }
+}
+
+void StreamingTraceReader::openFile()
+{
+    _file = fopen(_filename.c_str(), "r");
+    if (_file == NULL) {
+        cerr << "Unable to open " << _filename << endl;
+    } else {
+        // Disable stdio buffering since we read whole chunks
+        setvbuf(_file, NULL, _IONBF, 0);
+        posix_fadvise(fileno(_file), 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    reset();
+}
+
+bool StreamingTraceReader::readChunk()
+{
+    if ((_file == NULL) || _eof) {
+        return false;
+    }
+    // Move partial line to front of buffer
+    size_t remaining = _bufferEnd - _bufferStart;
+    if (remaining > 0) {
+        memmove(&_buffer[0], &_buffer[_bufferStart], remaining);
+    }
+    _bufferStart = 0;
+    _bufferEnd = remaining;
+    // Grow buffer if a single line is larger than a chunk; leave room for a null terminator
+    if (_buffer.size() < _bufferEnd + _chunkSize + 1) {
+        _buffer.resize(_bufferEnd + _chunkSize + 1);
+    }
+    size_t bytesRead = fread(&_buffer[_bufferEnd], 1, _chunkSize, _file);
+    _bufferEnd += bytesRead;
+    _fileOffset += bytesRead;
+    if (bytesRead < _chunkSize) {
+        _eof = true;
+    } else {
+        // Prefetch next chunk while the current one is parsed
+        posix_fadvise(fileno(_file), _fileOffset, _chunkSize, POSIX_FADV_WILLNEED);
+    }
+    return (bytesRead > 0);
+}
+
+bool StreamingTraceReader::nextEntry(TraceEntry& entry)
+{
+    while (true) {
+        // Find end of next line
+        char* lineStart = &_buffer[_bufferStart];
+        char* lineEnd = static_cast<char*>(memchr(lineStart, '\n', _bufferEnd - _bufferStart));
+        if (lineEnd == NULL) {
+            if (readChunk()) {
+                continue;
+            }
+            // Parse last line without a trailing newline
+            if (_bufferStart == _bufferEnd) {
+                return false;
+            }
+            lineEnd = &_buffer[_bufferEnd];
+        }
+        *lineEnd = '\0';
+        _bufferStart = lineEnd - &_buffer[0];
+        if (_bufferStart < _bufferEnd) {
+            _bufferStart++;
+        }
+        if (parseLine(lineStart, entry)) {
+            return true;
+        }
+    }
+}
+
+void StreamingTraceReader::reset()
+{
+    _buffer.assign(1, '\0');
+    _bufferStart = 0;
+    _bufferEnd = 0;
+    _fileOffset = 0;
+    _eof = false;
+    if (_file != NULL) {
+        rewind(_file);
+    }
+}
+
+TraceReader* StreamingTraceReader::clone() const
+{
+    return new StreamingTraceReader(*this);
+}
@@ -0,0 +1,57 @@
+// StreamingTraceReader.hpp - Class definitions for reading large CSV trace files with bounded memory.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _STREAMING_TRACE_READER_HPP
+#define _STREAMING_TRACE_READER_HPP
+
+#include <cstdio>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "TraceReader.hpp"
+
+using namespace std;
+
+// CSV trace files larger than this many bytes are streamed by TraceReader::create.
+#define STREAMING_TRACE_THRESHOLD (256 * 1024 * 1024)
+// Default number of bytes read from the trace file at a time.
+#define STREAMING_TRACE_CHUNK_SIZE (1024 * 1024)
+
+// Reads requests from a CSV trace file (see TraceReader.hpp for the format) one chunk at a time
+// rather than storing the entire trace in memory. The next chunk is prefetched while the current chunk is parsed.
+// StreamingTraceReader is not thread-safe.
+class StreamingTraceReader : public TraceReader
+{
+private:
+    string _filename;
+    FILE* _file;
+    size_t _chunkSize;
+    vector<char> _buffer;
+    size_t _bufferStart; // offset in _buffer of the next line to parse
+    size_t _bufferEnd; // offset in _buffer after the last byte read
+    size_t _fileOffset; // offset in file after the last byte read
+    bool _eof;
+
+    void openFile();
+    // Reads the next chunk into the buffer, keeping any unparsed partial line. Returns false if no data was read.
+    bool readChunk();
+
+    StreamingTraceReader& operator=(const StreamingTraceReader& other); // not implemented
+
+public:
+    StreamingTraceReader(string filename, size_t chunkSize = STREAMING_TRACE_CHUNK_SIZE);
+    StreamingTraceReader(const StreamingTraceReader& other);
+    virtual ~StreamingTraceReader();
+
+    // Fills entry with the next request from the trace. Returns false if end of trace.
+    virtual bool nextEntry(TraceEntry& entry);
+    // Resets trace reader back to beginning of trace.
+    virtual void reset();
+    // Returns a copy of this trace reader, reset to the beginning of the trace.
+    virtual TraceReader* clone() const;
+};
+
+#endif // _STREAMING_TRACE_READER_HPP
@@ -9,27 +9,28 @@
 #include <string>
 #include <cstdio>
 #include <cstring>
+#include <sys/stat.h>
 #include "TraceReader.hpp"
+#include "BinaryTraceReader.hpp"
+#include "StreamingTraceReader.hpp"
 
 using namespace std;
 
+TraceReader::TraceReader()
+    : _curIndex(0)
+{
+}
+
 TraceReader::TraceReader(string filename)
     : _curIndex(0)
 {
-    unsigned long long timestamp; // in nanoseconds
-    unsigned long requestSize; // in bytes
-    char isRead[32];
     ifstream file(filename.c_str());
     if (file.is_open()) {
         string line;
         while (getline(file, line)) {
-            // Parse line
-            if (sscanf(line.c_str(), "%llu,%lx,%s", &timestamp, &requestSize, isRead) == 3) {
-                // Store results
-                TraceEntry entry;
-                entry.arrivalTime = timestamp;
-                entry.requestSize = requestSize;
-                entry.isRead = (strcmp(isRead, "DiskRead") == 0);
+            // Parse line and store results
+            TraceEntry entry;
+            if (parseLine(line.c_str(), entry)) {
                 _trace.push_back(entry);
             }
         }
@@ -43,6 +44,39 @@ TraceReader::~TraceReader()
 {
 }
 
+bool TraceReader::parseLine(const char* line, TraceEntry& entry)
+{
+    unsigned long long timestamp; // in nanoseconds
+    unsigned long requestSize; // in bytes
+    char isRead[32];
+    if (sscanf(line, "%llu,%lx,%31s", &timestamp, &requestSize, isRead) == 3) {
+        entry.arrivalTime = timestamp;
+        entry.requestSize = requestSize;
+        entry.isRead = (strcmp(isRead, "DiskRead") == 0);
+        return true;
+    }
+    return false;
+}
+
+TraceReader* TraceReader::create(string filename, bool streaming)
+{
+    if (BinaryTraceReader::isBinaryTrace(filename)) {
+        return new BinaryTraceReader(filename);
+    }
+    struct stat st;
+    if (streaming || ((stat(filename.c_str(), &st) == 0) && (st.st_size > STREAMING_TRACE_THRESHOLD))) {
+        return new StreamingTraceReader(filename);
+    }
+    return new TraceReader(filename);
+}
+
+TraceReader* TraceReader::clone() const
+{
+    TraceReader* pTraceReader = new TraceReader(*this);
+    pTraceReader->reset();
+    return pTraceReader;
+}
+
 bool TraceReader::nextEntry(TraceEntry& entry)
 {
     if (_curIndex < _trace.size()) {
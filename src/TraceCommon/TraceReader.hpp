@@ -31,10 +31,24 @@ private:
     vector<TraceEntry> _trace;
     unsigned int _curIndex;
 
+protected:
+    // Used by subclasses that implement other trace formats.
+    TraceReader();
+
+    // Parses a CSV line into entry. Returns false if the line is not a request.
+    static bool parseLine(const char* line, TraceEntry& entry);
+
 public:
     TraceReader(string filename);
     virtual ~TraceReader();
 
+    // Factory for creating a TraceReader for a trace file.
+    // Binary trace files (see BinaryTraceReader.hpp) are detected by their magic; other files are parsed as CSV.
+    // CSV files are streamed with bounded memory (see StreamingTraceReader.hpp) if streaming is true or if the file is larger than STREAMING_TRACE_THRESHOLD bytes.
+    static TraceReader* create(string filename, bool streaming = false);
+    // Returns a copy of this trace reader, reset to the beginning of the trace.
+    virtual TraceReader* clone() const;
+
     // Fills entry with the next request from the trace. Returns false if end of trace.
     virtual bool nextEntry(TraceEntry& entry);
     // Resets trace reader back to beginning of trace.
@@ -0,0 +1,53 @@
+// TraceConvert.cpp - converts CSV trace files into the binary trace format.
+// Binary traces are smaller and are memory mapped instead of parsed; see src/TraceCommon/BinaryTraceReader.hpp for the format.
+//
+// Command line parameters:
+// -i inputFilename (required) - CSV trace file to convert; see README for file format
+// -o outputFilename (required) - binary trace file to create
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include "../TraceCommon/TraceReader.hpp"
+#include "../TraceCommon/BinaryTraceReader.hpp"
+
+using namespace std;
+
+int main(int argc, char** argv)
+{
+    int opt = 0;
+    string inputFilename = "";
+    string outputFilename = "";
+    do {
+        opt = getopt(argc, argv, "i:o:");
+        switch (opt) {
+            case 'i':
+                inputFilename.assign(optarg);
+                break;
+
+            case 'o':
+                outputFilename.assign(optarg);
+                break;
+
+            case -1:
+                break;
+
+            default:
+                break;
+        }
+    } while (opt != -1);
+
+    if ((inputFilename == "") || (outputFilename == "")) {
+        cout << "Usage: " << argv[0] << " -i inputFilename -o outputFilename" << endl;
+        return -1;
+    }
+
+    TraceReader* pTraceReader = TraceReader::create(inputFilename);
+    bool success = BinaryTraceReader::write(*pTraceReader, outputFilename);
+    delete pTraceReader;
+    return success ? 0 : -1;
+}
@@ -14,6 +14,7 @@
 #include <netdb.h>
 #include <netinet/in.h>
 #include <json/json.h>
+#include "metrics.hpp"
 
 using namespace std;
 
@@ -77,6 +78,8 @@ inline string jsonToString(const Json::Value& json)
 // Convert string to json
 inline bool stringToJson(string str, Json::Value& json)
 {
+    static MetricHistogram parseTime("string_to_json_seconds", "Time spent parsing JSON strings");
+    ScopedTimer timer(parseTime);
     Json::Reader reader;
     return reader.parse(str, json);
 }
@@ -0,0 +1,117 @@
+// metrics.cpp - Code for serving metrics over HTTP.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/time.h>
+#include "metrics.hpp"
+
+using namespace std;
+
+// Serve the text format to HTTP clients on a listening socket; thread whose arg is the socket
+static void* metricsServerThread(void* arg)
+{
+    int listenFd = (int)(intptr_t)arg;
+    while (true) {
+        int fd = accept(listenFd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        // The endpoint serves one scraper at a time, so slow scrapers are cut off
+        struct timeval timeout;
+        timeout.tv_sec = METRICS_SOCKET_TIMEOUT_SECONDS;
+        timeout.tv_usec = 0;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        // Any request gets the metrics, so only the start of the request is read
+        char request[1024];
+        if (recv(fd, request, sizeof(request), 0) > 0) {
+            string body = MetricsRegistry::get().toText();
+            ostringstream response;
+            response << "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " << body.size() << "\r\nConnection: close\r\n\r\n" << body;
+            string str = response.str();
+            const char* data = str.c_str();
+            size_t remaining = str.size();
+            while (remaining > 0) {
+                ssize_t sent = send(fd, data, remaining, MSG_NOSIGNAL);
+                if (sent <= 0) {
+                    break;
+                }
+                data += sent;
+                remaining -= sent;
+            }
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+// Parse a metrics endpoint given as [addr:]port; the address defaults to loopback. Returns false if it is invalid.
+static bool parseMetricsAddress(const string& address, struct sockaddr_in& addr)
+{
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    size_t colon = address.rfind(':');
+    string portStr = address;
+    if (colon != string::npos) {
+        if (inet_pton(AF_INET, address.substr(0, colon).c_str(), &addr.sin_addr) != 1) {
+            return false;
+        }
+        portStr = address.substr(colon + 1);
+    }
+    char* end;
+    long port = strtol(portStr.c_str(), &end, 10);
+    if (portStr.empty() || (*end != '\0') || (port <= 0) || (port > 65535)) {
+        return false;
+    }
+    addr.sin_port = htons(port);
+    return true;
+}
+
+bool validMetricsAddress(const string& address)
+{
+    struct sockaddr_in addr;
+    return parseMetricsAddress(address, addr);
+}
+
+bool startMetricsServer(const string& address)
+{
+    struct sockaddr_in addr;
+    if (!parseMetricsAddress(address, addr)) {
+        cerr << "Invalid metrics address " << address << endl;
+        return false;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        cerr << "Failed to create metrics socket" << endl;
+        return false;
+    }
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if ((bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) || (listen(fd, 16) != 0)) {
+        cerr << "Failed to listen for metrics on " << address << endl;
+        close(fd);
+        return false;
+    }
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, metricsServerThread, (void*)(intptr_t)fd) != 0) {
+        cerr << "Failed to create metrics thread" << endl;
+        close(fd);
+        return false;
+    }
+    pthread_detach(thread);
+    return true;
+}
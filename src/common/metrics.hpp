@@ -0,0 +1,318 @@
+// metrics.hpp - Lightweight counters, latency histograms, and scoped timers for instrumenting hot paths.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _METRICS_HPP
+#define _METRICS_HPP
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include <cstring>
+#include <stdint.h>
+#include <pthread.h>
+#include <json/json.h>
+#include "time.hpp"
+
+using namespace std;
+
+// Histogram bucket i counts durations of at most 2^i microseconds; the last bucket counts the rest
+#define METRICS_NUM_BUCKETS 24
+// Number of slow spans that are kept
+#define METRICS_NUM_SLOW_SPANS 64
+// Scoped timers that take longer than this are kept as slow spans
+#define METRICS_SLOW_SPAN_SECONDS 0.1
+// Time the metrics endpoint waits for a scraper's request, and for each send of the response
+#define METRICS_SOCKET_TIMEOUT_SECONDS 5
+
+class Metric;
+
+// Step that took longer than METRICS_SLOW_SPAN_SECONDS
+struct SlowSpan {
+    uint64_t traceId; // trace the thread was working on, or 0 if none
+    const char* name; // name of the timer's histogram
+    uint64_t endTime; // GetTime when the span ended
+    uint64_t duration;
+};
+
+// Registry of the metrics of a process, which can be sampled as JSON (e.g., by the components' GetMetrics RPCs) or in the Prometheus text format (see startMetricsServer).
+// Metrics are registered at construction (e.g., as globals or function statics) and never unregistered, so they must live until the process exits.
+class MetricsRegistry
+{
+private:
+    pthread_mutex_t _mutex; // protects _metrics and _slowSpans, which are only changed on registration and on slow spans
+    vector<const Metric*> _metrics;
+    vector<SlowSpan> _slowSpans; // ring of the most recent slow spans
+    unsigned int _nextSlowSpan; // index in _slowSpans of the next slow span
+
+    MetricsRegistry()
+        : _nextSlowSpan(0)
+    {
+        pthread_mutex_init(&_mutex, NULL);
+    }
+    MetricsRegistry(const MetricsRegistry&); // not implemented
+    MetricsRegistry& operator=(const MetricsRegistry&); // not implemented
+
+public:
+    // Registry of the process, which is created on first use so that metrics can be registered during static initialization
+    static MetricsRegistry& get()
+    {
+        static MetricsRegistry registry;
+        return registry;
+    }
+
+    void add(const Metric* metric)
+    {
+        pthread_mutex_lock(&_mutex);
+        _metrics.push_back(metric);
+        pthread_mutex_unlock(&_mutex);
+    }
+    void addSlowSpan(const SlowSpan& span)
+    {
+        pthread_mutex_lock(&_mutex);
+        if (_slowSpans.size() < METRICS_NUM_SLOW_SPANS) {
+            _slowSpans.push_back(span);
+        } else {
+            _slowSpans[_nextSlowSpan] = span;
+        }
+        _nextSlowSpan = (_nextSlowSpan + 1) % METRICS_NUM_SLOW_SPANS;
+        pthread_mutex_unlock(&_mutex);
+    }
+
+    // Sample the metrics as JSON, with the slow spans from the most recent
+    inline void toJson(Json::Value& metrics);
+    // Sample the metrics in the Prometheus text format
+    inline string toText();
+};
+
+// Base class of metrics, which are updated with atomic builtins only, so they are cheap enough to leave on in production
+class Metric
+{
+protected:
+    const char* _name;
+    const char* _help;
+
+    Metric(const char* name, const char* help)
+        : _name(name),
+          _help(help)
+    {
+        MetricsRegistry::get().add(this);
+    }
+    virtual ~Metric() {}
+
+public:
+    const char* getName() const { return _name; }
+    virtual void toJson(Json::Value& metrics) const = 0;
+    virtual void toText(ostream& out) const = 0;
+};
+
+// Counter of events, e.g., probes or RPCs
+class MetricCounter : public Metric
+{
+private:
+    volatile uint64_t _value;
+
+    MetricCounter(const MetricCounter&); // not implemented
+    MetricCounter& operator=(const MetricCounter&); // not implemented
+
+public:
+    MetricCounter(const char* name, const char* help)
+        : Metric(name, help),
+          _value(0)
+    {}
+
+    void add(uint64_t value = 1) { __sync_fetch_and_add(&_value, value); }
+    uint64_t getValue() const { return _value; }
+
+    virtual void toJson(Json::Value& metrics) const
+    {
+        metrics["counters"][_name] = Json::Value((Json::UInt64)_value);
+    }
+    virtual void toText(ostream& out) const
+    {
+        out << "# HELP " << _name << " " << _help << "\n";
+        out << "# TYPE " << _name << " counter\n";
+        out << _name << " " << _value << "\n";
+    }
+};
+
+// Histogram of durations with fixed power of two buckets from 1 microsecond to METRICS_NUM_BUCKETS - 2 doublings of it
+class MetricHistogram : public Metric
+{
+private:
+    volatile uint64_t _buckets[METRICS_NUM_BUCKETS];
+    volatile uint64_t _count;
+    volatile uint64_t _sum; // in nanoseconds
+
+    MetricHistogram(const MetricHistogram&); // not implemented
+    MetricHistogram& operator=(const MetricHistogram&); // not implemented
+
+    // Upper bound in seconds of a bucket other than the last
+    static double getBucketBound(unsigned int bucket) { return (double)(1ull << bucket) / 1e6; }
+
+public:
+    MetricHistogram(const char* name, const char* help)
+        : Metric(name, help),
+          _count(0),
+          _sum(0)
+    {
+        memset((void*)_buckets, 0, sizeof(_buckets));
+    }
+
+    // Record a duration in nanoseconds
+    void observe(uint64_t duration)
+    {
+        uint64_t usec = (duration + 999) / 1000;
+        unsigned int bucket = 0;
+        while ((bucket < METRICS_NUM_BUCKETS - 1) && (usec > (1ull << bucket))) {
+            bucket++;
+        }
+        __sync_fetch_and_add(&_buckets[bucket], 1);
+        __sync_fetch_and_add(&_count, 1);
+        __sync_fetch_and_add(&_sum, duration);
+    }
+
+    // Counts are sampled one at a time, so a sample taken while durations are recorded may be off by the durations being recorded
+    virtual void toJson(Json::Value& metrics) const
+    {
+        Json::Value& histogram = metrics["histograms"][_name];
+        histogram["count"] = Json::Value((Json::UInt64)_count);
+        histogram["sum"] = Json::Value(ConvertTimeToSeconds(_sum));
+        histogram["bucketBounds"] = Json::Value(Json::arrayValue);
+        histogram["bucketCounts"] = Json::Value(Json::arrayValue);
+        for (unsigned int i = 0; i < METRICS_NUM_BUCKETS - 1; i++) {
+            histogram["bucketBounds"].append(Json::Value(getBucketBound(i)));
+        }
+        for (unsigned int i = 0; i < METRICS_NUM_BUCKETS; i++) {
+            histogram["bucketCounts"].append(Json::Value((Json::UInt64)_buckets[i]));
+        }
+    }
+    // Buckets are cumulative in the text format
+    virtual void toText(ostream& out) const
+    {
+        out << "# HELP " << _name << " " << _help << "\n";
+        out << "# TYPE " << _name << " histogram\n";
+        uint64_t cumulative = 0;
+        for (unsigned int i = 0; i < METRICS_NUM_BUCKETS - 1; i++) {
+            cumulative += _buckets[i];
+            out << _name << "_bucket{le=\"" << getBucketBound(i) << "\"} " << cumulative << "\n";
+        }
+        cumulative += _buckets[METRICS_NUM_BUCKETS - 1];
+        out << _name << "_bucket{le=\"+Inf\"} " << cumulative << "\n";
+        out << _name << "_sum " << ConvertTimeToSeconds(_sum) << "\n";
+        out << _name << "_count " << cumulative << "\n";
+    }
+};
+
+// Trace ID of the placement the calling thread is working on, or 0 if none
+inline uint64_t& currentTraceId()
+{
+    static __thread uint64_t traceId = 0;
+    return traceId;
+}
+
+// Set the calling thread's trace ID for the lifetime of the object, e.g., while handling an RPC carrying a trace ID
+class ScopedTraceId
+{
+private:
+    uint64_t _previous;
+
+    ScopedTraceId(const ScopedTraceId&); // not implemented
+    ScopedTraceId& operator=(const ScopedTraceId&); // not implemented
+
+public:
+    ScopedTraceId(uint64_t traceId)
+        : _previous(currentTraceId())
+    {
+        currentTraceId() = traceId;
+    }
+    ~ScopedTraceId()
+    {
+        currentTraceId() = _previous;
+    }
+};
+
+// Record the time since startTime (see GetTime) in a histogram, keeping it as a slow span if it exceeds METRICS_SLOW_SPAN_SECONDS,
+// e.g., for spans that do not match a scope
+inline void recordSpan(MetricHistogram& histogram, uint64_t startTime)
+{
+    uint64_t endTime = GetTime();
+    uint64_t duration = endTime - startTime;
+    histogram.observe(duration);
+    if (duration > ConvertSecondsToTime(METRICS_SLOW_SPAN_SECONDS)) {
+        SlowSpan span;
+        span.traceId = currentTraceId();
+        span.name = histogram.getName();
+        span.endTime = endTime;
+        span.duration = duration;
+        MetricsRegistry::get().addSlowSpan(span);
+    }
+}
+
+// Record the time spent in a scope with recordSpan
+class ScopedTimer
+{
+private:
+    MetricHistogram& _histogram;
+    uint64_t _startTime;
+
+    ScopedTimer(const ScopedTimer&); // not implemented
+    ScopedTimer& operator=(const ScopedTimer&); // not implemented
+
+public:
+    ScopedTimer(MetricHistogram& histogram)
+        : _histogram(histogram),
+          _startTime(GetTime())
+    {}
+    ~ScopedTimer()
+    {
+        recordSpan(_histogram, _startTime);
+    }
+};
+
+inline void MetricsRegistry::toJson(Json::Value& metrics)
+{
+    metrics = Json::Value(Json::objectValue);
+    metrics["counters"] = Json::Value(Json::objectValue);
+    metrics["histograms"] = Json::Value(Json::objectValue);
+    metrics["slowSpans"] = Json::Value(Json::arrayValue);
+    uint64_t now = GetTime();
+    pthread_mutex_lock(&_mutex);
+    for (vector<const Metric*>::const_iterator it = _metrics.begin(); it != _metrics.end(); it++) {
+        (*it)->toJson(metrics);
+    }
+    for (unsigned int i = 0; i < _slowSpans.size(); i++) {
+        const SlowSpan& span = _slowSpans[(_nextSlowSpan + _slowSpans.size() - 1 - i) % _slowSpans.size()];
+        Json::Value spanInfo;
+        spanInfo["traceId"] = Json::Value((Json::UInt64)span.traceId);
+        spanInfo["name"] = Json::Value(span.name);
+        spanInfo["seconds"] = Json::Value(ConvertTimeToSeconds(span.duration));
+        spanInfo["age"] = Json::Value(ConvertTimeToSeconds(now - span.endTime));
+        metrics["slowSpans"].append(spanInfo);
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+inline string MetricsRegistry::toText()
+{
+    ostringstream out;
+    pthread_mutex_lock(&_mutex);
+    for (vector<const Metric*>::const_iterator it = _metrics.begin(); it != _metrics.end(); it++) {
+        (*it)->toText(out);
+    }
+    pthread_mutex_unlock(&_mutex);
+    return out.str();
+}
+
+// Check a metrics endpoint given as [addr:]port, e.g., when parsing command line options (see startMetricsServer).
+bool validMetricsAddress(const string& address);
+// Start serving the metrics in the Prometheus text format over HTTP on a TCP endpoint given as [addr:]port (e.g., the components' -M option),
+// for Prometheus to scrape; returns false on failure.
+// The endpoint binds to loopback unless an address is given (e.g., 0.0.0.0 for all interfaces), since the metrics are served without authentication.
+// Scrapers that do not send their request or read the response within METRICS_SOCKET_TIMEOUT_SECONDS are disconnected, so they cannot stall the endpoint.
+bool startMetricsServer(const string& address);
+
+#endif // _METRICS_HPP
@@ -7,18 +7,26 @@
 #include <iostream>
 #include <cstdlib>
 #include <string>
+#include <vector>
 #include <json/json.h>
 #include <rpc/rpc.h>
 #include "AdmissionController_prot.h"
+#include "AdmissionController_conv.hpp"
 #include "../common/common.hpp"
+#include "../common/metrics.hpp"
 #include "AdmissionController_clnt.hpp"
 
 using namespace std;
 
 AdmissionController_clnt::AdmissionController_clnt(string serverAddr, time_t timeoutSec)
 {
-    // Connect to AdmissionController server
-    _cl = clnt_create(serverAddr.c_str(), ADMISSION_CONTROLLER_PROGRAM, ADMISSION_CONTROLLER_V1, "tcp");
+    // Connect to AdmissionController server, using version 1 if the server does not support binary clients
+    _version = ADMISSION_CONTROLLER_V2;
+    _cl = clnt_create(serverAddr.c_str(), ADMISSION_CONTROLLER_PROGRAM, ADMISSION_CONTROLLER_V2, "tcp");
+    if (_cl == NULL) {
+        _version = ADMISSION_CONTROLLER_V1;
+        _cl = clnt_create(serverAddr.c_str(), ADMISSION_CONTROLLER_PROGRAM, ADMISSION_CONTROLLER_V1, "tcp");
+    }
     if (_cl == NULL) {
         clnt_pcreateerror(serverAddr.c_str());
         exit(-1);
@@ -44,7 +52,8 @@ void AdmissionController_clnt::addQueue(const Json::Value& queueInfo)
     args.queueInfo = new char[queueInfoStr.length() + 1];
     strcpy(args.queueInfo, queueInfoStr.c_str());
     AdmissionAddQueueRes result;
-    enum clnt_stat status = admission_controller_add_queue_1(args, &result, _cl);
+    enum clnt_stat status = (_version == ADMISSION_CONTROLLER_V2) ? admission_controller_add_queue_v2_2(args, &result, _cl)
+                                                                : admission_controller_add_queue_1(args, &result, _cl);
     if (status != RPC_SUCCESS) {
         clnt_perror(_cl, "Failed AdmissionController RPC");
     } else if (result.status != ADMISSION_SUCCESS) {
@@ -69,7 +78,8 @@ void AdmissionController_clnt::delQueue(string name)
     args.name = new char[name.length() + 1];
     strcpy(args.name, name.c_str());
     AdmissionDelQueueRes result;
-    enum clnt_stat status = admission_controller_del_queue_1(args, &result, _cl);
+    enum clnt_stat status = (_version == ADMISSION_CONTROLLER_V2) ? admission_controller_del_queue_v2_2(args, &result, _cl)
+                                                                : admission_controller_del_queue_1(args, &result, _cl);
     if (status != RPC_SUCCESS) {
         clnt_perror(_cl, "Failed AdmissionController RPC");
     } else if (result.status != ADMISSION_SUCCESS) {
@@ -89,24 +99,178 @@ bool AdmissionController_clnt::addClient(const Json::Value& clientInfo, bool fas
 // Try to admit a new set of clients
 bool AdmissionController_clnt::addClients(const Json::Value& clientInfos, bool fastFirstFit)
 {
-    bool admitted = false;
-    // Build RPC parameters
-    AdmissionAddClientsArgs args;
-    string clientInfosStr = jsonToString(clientInfos);
-    args.clientInfos = new char[clientInfosStr.length() + 1];
-    strcpy(args.clientInfos, clientInfosStr.c_str());
-    args.fastFirstFit = fastFirstFit;
     AdmissionAddClientsRes result;
-    enum clnt_stat status = admission_controller_add_clients_1(args, &result, _cl);
+    enum clnt_stat status;
+    if (_version == ADMISSION_CONTROLLER_V2) {
+        // Build RPC parameters
+        AdmissionAddClientsArgsV2 args;
+        if (!encodeClientInfos(clientInfos, args.clientInfos.clientInfos_val, args.clientInfos.clientInfos_len)) {
+            cerr << "AddClients failed with status " << ADMISSION_ERR_INVALID_ARGUMENT << endl;
+            return false;
+        }
+        args.fastFirstFit = fastFirstFit;
+        args.traceId = currentTraceId();
+        status = admission_controller_add_clients_v2_2(args, &result, _cl);
+        freeClientInfos(args.clientInfos.clientInfos_val, args.clientInfos.clientInfos_len);
+    } else {
+        // Build RPC parameters
+        AdmissionAddClientsArgs args;
+        string clientInfosStr = jsonToString(clientInfos);
+        args.clientInfos = new char[clientInfosStr.length() + 1];
+        strcpy(args.clientInfos, clientInfosStr.c_str());
+        args.fastFirstFit = fastFirstFit;
+        args.traceId = currentTraceId();
+        status = admission_controller_add_clients_1(args, &result, _cl);
+        delete[] args.clientInfos;
+    }
     if (status != RPC_SUCCESS) {
         clnt_perror(_cl, "Failed AdmissionController RPC");
     } else if (result.status != ADMISSION_SUCCESS) {
         cerr << "AddClients failed with status " << result.status << endl;
     } else {
-        admitted = result.admitted;
+        return result.admitted;
+    }
+    return false;
+}
+
+// Check if a new client would be admitted, without adding it
+bool AdmissionController_clnt::tryAddClient(const Json::Value& clientInfo, bool fastFirstFit)
+{
+    Json::Value singleClientInfos = Json::arrayValue;
+    singleClientInfos.append(clientInfo);
+    return tryAddClients(singleClientInfos, fastFirstFit);
+}
+
+// Check if a new set of clients would be admitted, without adding them
+bool AdmissionController_clnt::tryAddClients(const Json::Value& clientInfos, bool fastFirstFit)
+{
+    AdmissionAddClientsRes result;
+    enum clnt_stat status;
+    if (_version == ADMISSION_CONTROLLER_V2) {
+        // Build RPC parameters
+        AdmissionAddClientsArgsV2 args;
+        if (!encodeClientInfos(clientInfos, args.clientInfos.clientInfos_val, args.clientInfos.clientInfos_len)) {
+            cerr << "TryAddClients failed with status " << ADMISSION_ERR_INVALID_ARGUMENT << endl;
+            return false;
+        }
+        args.fastFirstFit = fastFirstFit;
+        args.traceId = currentTraceId();
+        status = admission_controller_try_add_clients_v2_2(args, &result, _cl);
+        freeClientInfos(args.clientInfos.clientInfos_val, args.clientInfos.clientInfos_len);
+    } else {
+        // Build RPC parameters
+        AdmissionAddClientsArgs args;
+        string clientInfosStr = jsonToString(clientInfos);
+        args.clientInfos = new char[clientInfosStr.length() + 1];
+        strcpy(args.clientInfos, clientInfosStr.c_str());
+        args.fastFirstFit = fastFirstFit;
+        args.traceId = currentTraceId();
+        status = admission_controller_try_add_clients_1(args, &result, _cl);
+        delete[] args.clientInfos;
+    }
+    if (status != RPC_SUCCESS) {
+        clnt_perror(_cl, "Failed AdmissionController RPC");
+    } else if (result.status != ADMISSION_SUCCESS) {
+        cerr << "TryAddClients failed with status " << result.status << endl;
+    } else {
+        return result.admitted;
+    }
+    return false;
+}
+
+// Check if a new client would be admitted at each candidate placement
+vector<PlacementEvaluation> AdmissionController_clnt::evaluatePlacements(const Json::Value& clientInfo, string addrPrefix, const Json::Value& placements, bool fastFirstFit, bool stopOnFit,
+                                                                     uint64_t evaluationId)
+{
+    vector<PlacementEvaluation> evaluations;
+    // Build RPC parameters
+    AdmissionEvaluatePlacementsArgs args;
+    AdmissionEvaluatePlacementsArgsV2 argsV2;
+    if (_version == ADMISSION_CONTROLLER_V2) {
+        if (!encodeClientInfo(clientInfo, argsV2.clientInfo)) {
+            cerr << "EvaluatePlacements failed with status " << ADMISSION_ERR_INVALID_ARGUMENT << endl;
+            return evaluations;
+        }
+        args.clientInfo = NULL;
+    } else {
+        string clientInfoStr = jsonToString(clientInfo);
+        args.clientInfo = new char[clientInfoStr.length() + 1];
+        strcpy(args.clientInfo, clientInfoStr.c_str());
+    }
+    args.addrPrefix = new char[addrPrefix.length() + 1];
+    strcpy(args.addrPrefix, addrPrefix.c_str());
+    args.placements.placements_len = placements.size();
+    args.placements.placements_val = new AdmissionPlacement[placements.size()];
+    vector<string> fields; // keep strings alive for the RPC
+    for (unsigned int i = 0; i < placements.size(); i++) {
+        fields.push_back(placements[i]["clientHost"].asString());
+        fields.push_back(placements[i]["clientVM"].asString());
+        fields.push_back(placements[i]["serverHost"].asString());
+        fields.push_back(placements[i]["serverVM"].asString());
+    }
+    for (unsigned int i = 0; i < placements.size(); i++) {
+        AdmissionPlacement& placement = args.placements.placements_val[i];
+        placement.clientHost = const_cast<char*>(fields[4 * i].c_str());
+        placement.clientVM = const_cast<char*>(fields[4 * i + 1].c_str());
+        placement.serverHost = const_cast<char*>(fields[4 * i + 2].c_str());
+        placement.serverVM = const_cast<char*>(fields[4 * i + 3].c_str());
+    }
+    args.fastFirstFit = fastFirstFit;
+    args.stopOnFit = stopOnFit;
+    args.evaluationId = evaluationId;
+    args.traceId = currentTraceId();
+    AdmissionEvaluatePlacementsRes result;
+    memset(&result, 0, sizeof(result));
+    enum clnt_stat status;
+    if (_version == ADMISSION_CONTROLLER_V2) {
+        argsV2.addrPrefix = args.addrPrefix;
+        argsV2.placements.placements_len = args.placements.placements_len;
+        argsV2.placements.placements_val = args.placements.placements_val;
+        argsV2.fastFirstFit = fastFirstFit;
+        argsV2.stopOnFit = stopOnFit;
+        argsV2.evaluationId = evaluationId;
+        argsV2.traceId = args.traceId;
+        status = admission_controller_evaluate_placements_v2_2(argsV2, &result, _cl);
+        freeClientInfo(argsV2.clientInfo);
+    } else {
+        status = admission_controller_evaluate_placements_1(args, &result, _cl);
+    }
+    if (status != RPC_SUCCESS) {
+        clnt_perror(_cl, "Failed AdmissionController RPC");
+    } else {
+        if (result.status != ADMISSION_SUCCESS) {
+            cerr << "EvaluatePlacements failed with status " << result.status << endl;
+        } else {
+            for (unsigned int i = 0; i < result.results.results_len; i++) {
+                PlacementEvaluation evaluation;
+                evaluation.admitted = result.results.results_val[i].admitted;
+                evaluation.slack = result.results.results_val[i].slack;
+                evaluations.push_back(evaluation);
+            }
+        }
+        // Free result
+        xdr_free((xdrproc_t)xdr_AdmissionEvaluatePlacementsRes, (caddr_t)&result);
+    }
+    delete[] args.clientInfo;
+    delete[] args.addrPrefix;
+    delete[] args.placements.placements_val;
+    return evaluations;
+}
+
+// Stop evaluating the candidates of an EvaluatePlacements RPC from numPlacements on
+void AdmissionController_clnt::cancelEvaluation(uint64_t evaluationId, unsigned int numPlacements)
+{
+    AdmissionCancelEvaluationArgs args;
+    args.evaluationId = evaluationId;
+    args.numPlacements = numPlacements;
+    AdmissionCancelEvaluationRes result;
+    enum clnt_stat status = (_version == ADMISSION_CONTROLLER_V2) ? admission_controller_cancel_evaluation_v2_2(args, &result, _cl)
+                                                                : admission_controller_cancel_evaluation_1(args, &result, _cl);
+    if (status != RPC_SUCCESS) {
+        clnt_perror(_cl, "Failed AdmissionController RPC");
+    } else if (result.status != ADMISSION_SUCCESS) {
+        cerr << "CancelEvaluation failed with status " << result.status << endl;
     }
-    delete[] args.clientInfos;
-    return admitted;
 }
 
 // Delete a client from AdmissionController
@@ -116,7 +280,8 @@ void AdmissionController_clnt::delClient(string name)
     args.name = new char[name.length() + 1];
     strcpy(args.name, name.c_str());
     AdmissionDelClientRes result;
-    enum clnt_stat status = admission_controller_del_client_1(args, &result, _cl);
+    enum clnt_stat status = (_version == ADMISSION_CONTROLLER_V2) ? admission_controller_del_client_v2_2(args, &result, _cl)
+                                                                : admission_controller_del_client_1(args, &result, _cl);
     if (status != RPC_SUCCESS) {
         clnt_perror(_cl, "Failed AdmissionController RPC");
     } else if (result.status != ADMISSION_SUCCESS) {
@@ -124,3 +289,19 @@ void AdmissionController_clnt::delClient(string name)
     }
     delete[] args.name;
 }
+
+// Get the hot path metrics of AdmissionController
+bool AdmissionController_clnt::getMetrics(Json::Value& metrics)
+{
+    AdmissionGetMetricsRes result;
+    memset(&result, 0, sizeof(result));
+    enum clnt_stat status = (_version == ADMISSION_CONTROLLER_V2) ? admission_controller_get_metrics_v2_2(&result, _cl)
+                                                                : admission_controller_get_metrics_1(&result, _cl);
+    if (status != RPC_SUCCESS) {
+        clnt_perror(_cl, "Failed AdmissionController RPC");
+        return false;
+    }
+    bool success = stringToJson(result.metrics, metrics);
+    xdr_free((xdrproc_t)xdr_AdmissionGetMetricsRes, (caddr_t)&result);
+    return success;
+}
@@ -8,16 +8,26 @@
 #define _ADMISSION_CONTROLLER_CLNT_HPP
 
 #include <string>
+#include <vector>
+#include <stdint.h>
 #include <json/json.h>
 #include <rpc/rpc.h>
 #include "AdmissionController_prot.h"
 
 using namespace std;
 
+// Result of evaluating a candidate placement (see AdmissionController_prot.x)
+struct PlacementEvaluation {
+    bool admitted;
+    double slack; // smallest SLO minus worst-case latency among the client and the clients it affects
+};
+
+// RPCs that add or evaluate clients carry the calling thread's trace ID (see common/metrics.hpp)
 class AdmissionController_clnt
 {
 private:
     CLIENT* _cl;
+    unsigned long _version; // ADMISSION_CONTROLLER_V2 with binary clients, or ADMISSION_CONTROLLER_V1 if the server does not support it
 
 public:
     AdmissionController_clnt(string serverAddr, time_t timeoutSec = 36000);
@@ -33,8 +43,23 @@ public:
     bool addClient(const Json::Value& clientInfo, bool fastFirstFit);
     // Try to admit a new set of clients
     bool addClients(const Json::Value& clientInfos, bool fastFirstFit);
+    // Check if a new client would be admitted, without adding it
+    bool tryAddClient(const Json::Value& clientInfo, bool fastFirstFit);
+    // Check if a new set of clients would be admitted, without adding them
+    bool tryAddClients(const Json::Value& clientInfos, bool fastFirstFit);
+    // Check if a new client would be admitted at each candidate placement, given as a JSON list of objects with clientHost, clientVM, serverHost, and serverVM.
+    // The client's placement is filled in with configGenClient (see DNC-Library/NCConfig.hpp) for each candidate.
+    // Evaluations are returned for the candidates in order, stopping after the first admitted candidate if stopOnFit is set.
+    // A non-zero evaluationId lets another connection cancel the remaining candidates with cancelEvaluation, in which case fewer evaluations are returned.
+    vector<PlacementEvaluation> evaluatePlacements(const Json::Value& clientInfo, string addrPrefix, const Json::Value& placements, bool fastFirstFit, bool stopOnFit,
+                                                   uint64_t evaluationId = 0);
+    // Stop evaluating the candidates of an EvaluatePlacements RPC from numPlacements on, including a candidate being evaluated;
+    // the call may arrive before the evaluation, which then skips the canceled candidates
+    void cancelEvaluation(uint64_t evaluationId, unsigned int numPlacements);
     // Delete a client from AdmissionController
     void delClient(string name);
+    // Get the hot path metrics of AdmissionController (see common/metrics.hpp); returns false if the RPC fails
+    bool getMetrics(Json::Value& metrics);
 };
 
 #endif // _ADMISSION_CONTROLLER_CLNT_HPP
@@ -0,0 +1,227 @@
+// AdmissionController_conv.cpp - conversions between JSON clients and the binary clients of version 2 of the AdmissionController_prot RPC interface.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cstring>
+#include <string>
+#include <json/json.h>
+#include "AdmissionController_prot.h"
+#include "../common/common.hpp"
+#include "AdmissionController_conv.hpp"
+
+using namespace std;
+
+// Copy a string into memory allocated with new[]
+static char* copyString(const string& str)
+{
+    char* c_str = new char[str.length() + 1];
+    strcpy(c_str, str.c_str());
+    return c_str;
+}
+
+// Encode the fields of a JSON object other than the given ones; empty if there are none
+static char* encodeOtherFields(const Json::Value& json, const char* const* fields, unsigned int numFields)
+{
+    Json::Value otherFields(Json::objectValue);
+    Json::Value::Members members = json.getMemberNames();
+    for (Json::Value::Members::const_iterator it = members.begin(); it != members.end(); it++) {
+        bool encoded = false;
+        for (unsigned int i = 0; i < numFields; i++) {
+            if (*it == fields[i]) {
+                encoded = true;
+                break;
+            }
+        }
+        if (!encoded) {
+            otherFields[*it] = json[*it];
+        }
+    }
+    if (otherFields.empty()) {
+        return copyString("");
+    }
+    Json::FastWriter writer;
+    return copyString(writer.write(otherFields));
+}
+
+// Decode the other fields of a JSON object
+static bool decodeOtherFields(const char* otherFields, Json::Value& json)
+{
+    if (otherFields[0] == '\0') {
+        json = Json::Value(Json::objectValue);
+        return true;
+    }
+    return stringToJson(otherFields, json) && json.isObject();
+}
+
+// Check if an arrivalInfo is a DNC arrival curve, which is encoded natively
+static bool isArrivalCurve(const Json::Value& arrivalInfo)
+{
+    if (!arrivalInfo.isArray()) {
+        return false;
+    }
+    for (unsigned int i = 0; i < arrivalInfo.size(); i++) {
+        const Json::Value& point = arrivalInfo[i];
+        if (!point.isObject() || (point.size() != 3) || !point["x"].isNumeric() || !point["y"].isNumeric() || !point["slope"].isNumeric()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Check if a flow has the name, queues, and arrival curve that are encoded natively
+static bool isEncodableFlow(const Json::Value& flowInfo)
+{
+    if (!flowInfo.isObject() || !flowInfo["name"].isString() || !flowInfo["queues"].isArray() || !isArrivalCurve(flowInfo["arrivalInfo"])) {
+        return false;
+    }
+    const Json::Value& flowQueues = flowInfo["queues"];
+    for (unsigned int index = 0; index < flowQueues.size(); index++) {
+        if (!flowQueues[index].isString()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool encodeClientInfo(const Json::Value& clientInfo, AdmissionClientInfo& encoded)
+{
+    memset(&encoded, 0, sizeof(encoded));
+    if (!clientInfo.isObject() || !clientInfo["name"].isString() || !clientInfo["SLO"].isNumeric()) {
+        return false;
+    }
+    encoded.name = copyString(clientInfo["name"].asString());
+    encoded.SLO = clientInfo["SLO"].asDouble();
+    // Flows are encoded natively if they all have the native fields; an empty list of flows is kept in the other fields
+    const Json::Value& clientFlows = clientInfo["flows"];
+    bool encodeFlows = clientFlows.isArray() && !clientFlows.empty();
+    for (unsigned int flowIndex = 0; encodeFlows && (flowIndex < clientFlows.size()); flowIndex++) {
+        encodeFlows = isEncodableFlow(clientFlows[flowIndex]);
+    }
+    if (encodeFlows) {
+        encoded.flows.flows_len = clientFlows.size();
+        encoded.flows.flows_val = new AdmissionFlowInfo[clientFlows.size()];
+        for (unsigned int flowIndex = 0; flowIndex < clientFlows.size(); flowIndex++) {
+            const Json::Value& flowInfo = clientFlows[flowIndex];
+            AdmissionFlowInfo& encodedFlow = encoded.flows.flows_val[flowIndex];
+            encodedFlow.name = copyString(flowInfo["name"].asString());
+            const Json::Value& flowQueues = flowInfo["queues"];
+            encodedFlow.queues.queues_len = flowQueues.size();
+            encodedFlow.queues.queues_val = new AdmissionString[flowQueues.size()];
+            for (unsigned int index = 0; index < flowQueues.size(); index++) {
+                encodedFlow.queues.queues_val[index] = copyString(flowQueues[index].asString());
+            }
+            const Json::Value& arrivalInfo = flowInfo["arrivalInfo"];
+            encodedFlow.arrivalCurve.arrivalCurve_len = arrivalInfo.size();
+            encodedFlow.arrivalCurve.arrivalCurve_val = new AdmissionPointSlope[arrivalInfo.size()];
+            for (unsigned int i = 0; i < arrivalInfo.size(); i++) {
+                AdmissionPointSlope& point = encodedFlow.arrivalCurve.arrivalCurve_val[i];
+                point.x = arrivalInfo[i]["x"].asDouble();
+                point.y = arrivalInfo[i]["y"].asDouble();
+                point.slope = arrivalInfo[i]["slope"].asDouble();
+            }
+            const char* flowFields[] = {"name", "queues", "arrivalInfo"};
+            encodedFlow.otherFields = encodeOtherFields(flowInfo, flowFields, 3);
+        }
+        const char* clientFields[] = {"name", "SLO", "flows"};
+        encoded.otherFields = encodeOtherFields(clientInfo, clientFields, 3);
+    } else {
+        const char* clientFields[] = {"name", "SLO"};
+        encoded.otherFields = encodeOtherFields(clientInfo, clientFields, 2);
+    }
+    return true;
+}
+
+void freeClientInfo(AdmissionClientInfo& encoded)
+{
+    delete[] encoded.name;
+    for (unsigned int flowIndex = 0; flowIndex < encoded.flows.flows_len; flowIndex++) {
+        AdmissionFlowInfo& encodedFlow = encoded.flows.flows_val[flowIndex];
+        delete[] encodedFlow.name;
+        for (unsigned int index = 0; index < encodedFlow.queues.queues_len; index++) {
+            delete[] encodedFlow.queues.queues_val[index];
+        }
+        delete[] encodedFlow.queues.queues_val;
+        delete[] encodedFlow.arrivalCurve.arrivalCurve_val;
+        delete[] encodedFlow.otherFields;
+    }
+    delete[] encoded.flows.flows_val;
+    delete[] encoded.otherFields;
+    memset(&encoded, 0, sizeof(encoded));
+}
+
+bool decodeClientInfo(const AdmissionClientInfo& encoded, Json::Value& clientInfo)
+{
+    if (!decodeOtherFields(encoded.otherFields, clientInfo)) {
+        return false;
+    }
+    clientInfo["name"] = Json::Value(encoded.name);
+    clientInfo["SLO"] = Json::Value(encoded.SLO);
+    if (encoded.flows.flows_len > 0) {
+        Json::Value& clientFlows = clientInfo["flows"];
+        clientFlows = Json::Value(Json::arrayValue);
+        for (unsigned int flowIndex = 0; flowIndex < encoded.flows.flows_len; flowIndex++) {
+            const AdmissionFlowInfo& encodedFlow = encoded.flows.flows_val[flowIndex];
+            Json::Value& flowInfo = clientFlows[flowIndex];
+            if (!decodeOtherFields(encodedFlow.otherFields, flowInfo)) {
+                return false;
+            }
+            flowInfo["name"] = Json::Value(encodedFlow.name);
+            Json::Value& flowQueues = flowInfo["queues"];
+            flowQueues = Json::Value(Json::arrayValue);
+            for (unsigned int index = 0; index < encodedFlow.queues.queues_len; index++) {
+                flowQueues.append(Json::Value(encodedFlow.queues.queues_val[index]));
+            }
+            Json::Value& arrivalInfo = flowInfo["arrivalInfo"];
+            arrivalInfo = Json::Value(Json::arrayValue);
+            for (unsigned int i = 0; i < encodedFlow.arrivalCurve.arrivalCurve_len; i++) {
+                const AdmissionPointSlope& point = encodedFlow.arrivalCurve.arrivalCurve_val[i];
+                Json::Value& pointInfo = arrivalInfo[i];
+                pointInfo["x"] = Json::Value(point.x);
+                pointInfo["y"] = Json::Value(point.y);
+                pointInfo["slope"] = Json::Value(point.slope);
+            }
+        }
+    }
+    return true;
+}
+
+bool encodeClientInfos(const Json::Value& clientInfos, AdmissionClientInfo*& encoded, unsigned int& numClients)
+{
+    encoded = NULL;
+    numClients = 0;
+    if (!clientInfos.isArray()) {
+        return false;
+    }
+    encoded = new AdmissionClientInfo[clientInfos.size()];
+    for (unsigned int i = 0; i < clientInfos.size(); i++) {
+        if (!encodeClientInfo(clientInfos[i], encoded[i])) {
+            freeClientInfos(encoded, numClients);
+            encoded = NULL;
+            numClients = 0;
+            return false;
+        }
+        numClients++;
+    }
+    return true;
+}
+
+void freeClientInfos(AdmissionClientInfo* encoded, unsigned int numClients)
+{
+    for (unsigned int i = 0; i < numClients; i++) {
+        freeClientInfo(encoded[i]);
+    }
+    delete[] encoded;
+}
+
+bool decodeClientInfos(const AdmissionClientInfo* encoded, unsigned int numClients, Json::Value& clientInfos)
+{
+    clientInfos = Json::Value(Json::arrayValue);
+    for (unsigned int i = 0; i < numClients; i++) {
+        if (!decodeClientInfo(encoded[i], clientInfos[i])) {
+            return false;
+        }
+    }
+    return true;
+}
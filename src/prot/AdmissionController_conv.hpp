@@ -0,0 +1,34 @@
+// AdmissionController_conv.hpp - conversions between JSON clients and the binary clients of version 2 of the AdmissionController_prot RPC interface.
+// The name, SLO, and flows (name, queues, and arrival curve) of a client are encoded natively, so that the bulk of a client, its arrival curves,
+// is sent as doubles rather than decimal text and does not need to be parsed. Any other fields are kept as a JSON string, which is empty for
+// the clients on PlacementController's placement path.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _ADMISSION_CONTROLLER_CONV_HPP
+#define _ADMISSION_CONTROLLER_CONV_HPP
+
+#include <json/json.h>
+#include "AdmissionController_prot.h"
+
+using namespace std;
+
+// Encode a client in binary; returns false if the client is not an object with a string name and numeric SLO, which AdmissionController rejects.
+// The encoded client must be freed with freeClientInfo.
+bool encodeClientInfo(const Json::Value& clientInfo, AdmissionClientInfo& encoded);
+// Free the memory allocated by encodeClientInfo.
+void freeClientInfo(AdmissionClientInfo& encoded);
+// Decode a binary client into JSON; returns false if its other fields are not a valid JSON object.
+bool decodeClientInfo(const AdmissionClientInfo& encoded, Json::Value& clientInfo);
+
+// Encode a JSON list of clientInfo in binary; returns false if clientInfos is not an array or a client cannot be encoded.
+// The encoded clients must be freed with freeClientInfos.
+bool encodeClientInfos(const Json::Value& clientInfos, AdmissionClientInfo*& encoded, unsigned int& numClients);
+// Free the memory allocated by encodeClientInfos.
+void freeClientInfos(AdmissionClientInfo* encoded, unsigned int numClients);
+// Decode binary clients into a JSON list of clientInfo; returns false if a client cannot be decoded.
+bool decodeClientInfos(const AdmissionClientInfo* encoded, unsigned int numClients, Json::Value& clientInfos);
+
+#endif // _ADMISSION_CONTROLLER_CONV_HPP
@@ -19,18 +19,206 @@ enum AdmissionStatus {
     ADMISSION_ERR_QUEUE_HAS_ACTIVE_FLOWS
 };
 
+/* Necessary condition that rejected clients before their rate limit parameters were optimized (see DNC-Library/WorkloadCompactor.hpp) */
+enum AdmissionPrefilterCheck {
+    ADMISSION_PREFILTER_PASSED,
+    ADMISSION_PREFILTER_BOUNDS,
+    ADMISSION_PREFILTER_RATE,
+    ADMISSION_PREFILTER_BURST
+};
+
 /* Arguments for AddClients RPC */
 struct AdmissionAddClientsArgs {
     /* string encoded JSON of list of clients (see DNC-Library/NC.hpp) */
     string clientInfos<>;
     /* return quickly if client is unlikely to fit */
     bool fastFirstFit;
+    /* placement being worked on, which is recorded in slow spans (see common/metrics.hpp); 0 if none */
+    unsigned hyper traceId;
 };
 
 /* Results for AddClients RPC */
 struct AdmissionAddClientsRes {
     AdmissionStatus status;
     bool admitted;
+    /* check that rejected the clients, if rejected by the prefilter */
+    AdmissionPrefilterCheck prefilterCheck;
+};
+
+/* Candidate placement of a client */
+struct AdmissionPlacement {
+    string clientHost<>;
+    string clientVM<>;
+    string serverHost<>;
+    string serverVM<>;
+};
+
+/* Arguments for EvaluatePlacements RPC */
+struct AdmissionEvaluatePlacementsArgs {
+    /* string encoded JSON of a client whose placement is filled in for each candidate (see DNC-Library/NCConfig.hpp's configGenClient) */
+    string clientInfo<>;
+    string addrPrefix<>;
+    /* candidate placements in the order they are evaluated */
+    AdmissionPlacement placements<>;
+    /* return quickly if client is unlikely to fit */
+    bool fastFirstFit;
+    /* stop after the first candidate where the client is admitted */
+    bool stopOnFit;
+    /* identifies the evaluation for CancelEvaluation; 0 if the evaluation is not canceled */
+    unsigned hyper evaluationId;
+    /* placement being worked on, which is recorded in slow spans (see common/metrics.hpp); 0 if none */
+    unsigned hyper traceId;
+};
+
+/* Results of evaluating a candidate placement */
+struct AdmissionPlacementRes {
+    bool admitted;
+    /* check that rejected the client, if rejected by the prefilter */
+    AdmissionPrefilterCheck prefilterCheck;
+    /* smallest SLO minus worst-case latency among the client and the clients it affects; 0 if latencies were not calculated */
+    double slack;
+};
+
+/* Results for EvaluatePlacements RPC */
+struct AdmissionEvaluatePlacementsRes {
+    AdmissionStatus status;
+    /* results of the evaluated candidates, which are a prefix of the candidates if stopOnFit is set or the evaluation is canceled */
+    AdmissionPlacementRes results<>;
+};
+
+/* Arguments for CancelEvaluation RPC */
+struct AdmissionCancelEvaluationArgs {
+    /* evaluationId of the EvaluatePlacements RPC, which may be in progress or not yet received */
+    unsigned hyper evaluationId;
+    /* candidates before this index are still evaluated */
+    unsigned int numPlacements;
+};
+
+/* Results for CancelEvaluation RPC */
+struct AdmissionCancelEvaluationRes {
+    AdmissionStatus status;
+};
+
+/*
+ * Binary encoding of clients for version 2 of the interface.
+ * The fields used for admission control are encoded natively, and any other fields (e.g., enforcer settings) are kept as JSON.
+ */
+
+typedef string AdmissionString<>;
+
+/* Point and slope of a piecewise linear arrival curve (see DNC-Library/DNC.hpp) */
+struct AdmissionPointSlope {
+    double x;
+    double y;
+    double slope;
+};
+
+/* Flow of a client (see DNC-Library/NC.hpp) */
+struct AdmissionFlowInfo {
+    string name<>;
+    AdmissionString queues<>;
+    /* arrivalInfo of a DNC flow */
+    AdmissionPointSlope arrivalCurve<>;
+    /* string encoded JSON object of the flow's other fields, or empty if none */
+    string otherFields<>;
+};
+
+/* Client (see DNC-Library/NC.hpp) */
+struct AdmissionClientInfo {
+    string name<>;
+    double SLO;
+    AdmissionFlowInfo flows<>;
+    /* string encoded JSON object of the client's other fields, or empty if none */
+    string otherFields<>;
+};
+
+/* Arguments for AddClients RPC (version 2) */
+struct AdmissionAddClientsArgsV2 {
+    AdmissionClientInfo clientInfos<>;
+    /* return quickly if client is unlikely to fit */
+    bool fastFirstFit;
+    /* placement being worked on, which is recorded in slow spans (see common/metrics.hpp); 0 if none */
+    unsigned hyper traceId;
+};
+
+/* Arguments for EvaluatePlacements RPC (version 2) */
+struct AdmissionEvaluatePlacementsArgsV2 {
+    /* client whose placement is filled in for each candidate (see DNC-Library/NCConfig.hpp's configGenClient) */
+    AdmissionClientInfo clientInfo;
+    string addrPrefix<>;
+    /* candidate placements in the order they are evaluated */
+    AdmissionPlacement placements<>;
+    /* return quickly if client is unlikely to fit */
+    bool fastFirstFit;
+    /* stop after the first candidate where the client is admitted */
+    bool stopOnFit;
+    /* identifies the evaluation for CancelEvaluation; 0 if the evaluation is not canceled */
+    unsigned hyper evaluationId;
+    /* placement being worked on, which is recorded in slow spans (see common/metrics.hpp); 0 if none */
+    unsigned hyper traceId;
+};
+
+/*
+ * Snapshot of AdmissionController's model and log of the modifications after the snapshot, which are saved to files for fast restarts
+ * (see AdmissionController/AdmissionSnapshot.hpp). Clients are encoded as in version 2 of the interface.
+ */
+
+/* Queue (see DNC-Library/NC.hpp) */
+struct AdmissionSnapshotQueue {
+    string name<>;
+    double bandwidth;
+};
+
+/* Optimized rate limit parameters, priority, and latency of a flow (see DNC-Library/WorkloadCompactor.hpp's FlowSnapshot) */
+struct AdmissionSnapshotFlow {
+    double r;
+    double b;
+    double peakRates<>;
+    double peakBursts<>;
+    unsigned int priority;
+    double latency;
+};
+
+/* Admitted client along with the optimized state of its flows, in flow order */
+struct AdmissionSnapshotClient {
+    AdmissionClientInfo clientInfo;
+    double latency;
+    AdmissionSnapshotFlow flows<>;
+};
+
+/* Snapshot of the model; log entries with a sequence number below logSequence are part of the snapshot */
+struct AdmissionSnapshot {
+    unsigned hyper logSequence;
+    AdmissionSnapshotQueue queues<>;
+    AdmissionSnapshotClient clients<>;
+};
+
+/* Modifications of the model */
+enum AdmissionLogType {
+    ADMISSION_LOG_ADD_QUEUE,
+    ADMISSION_LOG_DEL_QUEUE,
+    ADMISSION_LOG_ADD_CLIENTS,
+    ADMISSION_LOG_DEL_CLIENT
+};
+
+union AdmissionLogOp switch (AdmissionLogType type) {
+    case ADMISSION_LOG_ADD_QUEUE:
+        AdmissionSnapshotQueue queue;
+    case ADMISSION_LOG_DEL_QUEUE:
+        /* name of deleted queue */
+        string queueName<>;
+    case ADMISSION_LOG_ADD_CLIENTS:
+        /* admitted clients */
+        AdmissionClientInfo clientInfos<>;
+    case ADMISSION_LOG_DEL_CLIENT:
+        /* name of deleted client */
+        string clientName<>;
+};
+
+/* Entry of the log of modifications after a snapshot */
+struct AdmissionLogEntry {
+    unsigned hyper sequence;
+    AdmissionLogOp op;
 };
 
 /* Arguments for DelClient RPC */
@@ -66,6 +254,12 @@ struct AdmissionDelQueueRes {
     AdmissionStatus status;
 };
 
+/* Results for GetMetrics RPC */
+struct AdmissionGetMetricsRes {
+    /* string encoded JSON of the metrics (see common/metrics.hpp) */
+    string metrics<>;
+};
+
 /* AdmissionController RPC interface */
 program ADMISSION_CONTROLLER_PROGRAM {
     version ADMISSION_CONTROLLER_V1 {
@@ -87,5 +281,51 @@ program ADMISSION_CONTROLLER_PROGRAM {
         /* Delete a queue */
         AdmissionDelQueueRes
         ADMISSION_CONTROLLER_DEL_QUEUE(AdmissionDelQueueArgs) = 4;
+
+        /* Determine admission control for a set of clients without adding them */
+        AdmissionAddClientsRes
+        ADMISSION_CONTROLLER_TRY_ADD_CLIENTS(AdmissionAddClientsArgs) = 5;
+
+        /* Determine admission control for a client at each of a list of candidate placements without adding it */
+        AdmissionEvaluatePlacementsRes
+        ADMISSION_CONTROLLER_EVALUATE_PLACEMENTS(AdmissionEvaluatePlacementsArgs) = 6;
+
+        /* Stop evaluating the candidate placements of an EvaluatePlacements RPC after the given index */
+        AdmissionCancelEvaluationRes
+        ADMISSION_CONTROLLER_CANCEL_EVALUATION(AdmissionCancelEvaluationArgs) = 7;
+
+        /* Get the hot path metrics */
+        AdmissionGetMetricsRes
+        ADMISSION_CONTROLLER_GET_METRICS(void) = 8;
     } = 1;
+
+    /* Same procedures as version 1, with clients encoded in binary instead of JSON */
+    version ADMISSION_CONTROLLER_V2 {
+        void
+        ADMISSION_CONTROLLER_NULL_V2(void) = 0;
+
+        AdmissionAddClientsRes
+        ADMISSION_CONTROLLER_ADD_CLIENTS_V2(AdmissionAddClientsArgsV2) = 1;
+
+        AdmissionDelClientRes
+        ADMISSION_CONTROLLER_DEL_CLIENT_V2(AdmissionDelClientArgs) = 2;
+
+        AdmissionAddQueueRes
+        ADMISSION_CONTROLLER_ADD_QUEUE_V2(AdmissionAddQueueArgs) = 3;
+
+        AdmissionDelQueueRes
+        ADMISSION_CONTROLLER_DEL_QUEUE_V2(AdmissionDelQueueArgs) = 4;
+
+        AdmissionAddClientsRes
+        ADMISSION_CONTROLLER_TRY_ADD_CLIENTS_V2(AdmissionAddClientsArgsV2) = 5;
+
+        AdmissionEvaluatePlacementsRes
+        ADMISSION_CONTROLLER_EVALUATE_PLACEMENTS_V2(AdmissionEvaluatePlacementsArgsV2) = 6;
+
+        AdmissionCancelEvaluationRes
+        ADMISSION_CONTROLLER_CANCEL_EVALUATION_V2(AdmissionCancelEvaluationArgs) = 7;
+
+        AdmissionGetMetricsRes
+        ADMISSION_CONTROLLER_GET_METRICS_V2(void) = 8;
+    } = 2;
 } = 8003;
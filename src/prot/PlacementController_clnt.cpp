@@ -201,3 +201,56 @@ void PlacementController_clnt::delClients(const vector<string>& names)
     }
     delete[] args.names.names_val;
 }
+
+// Plan the moves of workloads that would empty up to maxServerHosts server hosts (0 for no limit); returns false if the RPC failed
+bool PlacementController_clnt::planConsolidation(unsigned int maxServerHosts, vector<ConsolidationMove>& moves, vector<string>& serverHosts)
+{
+    bool success = false;
+    moves.clear();
+    serverHosts.clear();
+    PlacementPlanConsolidationArgs args;
+    args.maxServerHosts = maxServerHosts;
+    PlacementPlanConsolidationRes result;
+    memset(&result, 0, sizeof(result));
+    enum clnt_stat status = placement_controller_plan_consolidation_1(args, &result, _cl);
+    if (status != RPC_SUCCESS) {
+        clnt_perror(_cl, "Failed PlacementController RPC");
+    } else {
+        if (result.status != PLACEMENT_SUCCESS) {
+            cerr << "PlanConsolidation failed with status " << result.status << endl;
+        } else {
+            success = true;
+            for (unsigned int i = 0; i < result.serverHosts.serverHosts_len; i++) {
+                serverHosts.push_back(string(result.serverHosts.serverHosts_val[i]));
+            }
+            for (unsigned int i = 0; i < result.moves.moves_len; i++) {
+                const PlacementMove& placementMove = result.moves.moves_val[i];
+                ConsolidationMove move;
+                move.name = placementMove.name;
+                move.clientHost = placementMove.clientHost;
+                move.clientVM = placementMove.clientVM;
+                move.serverHost = placementMove.serverHost;
+                move.serverVM = placementMove.serverVM;
+                moves.push_back(move);
+            }
+        }
+        // Free result
+        xdr_free((xdrproc_t)xdr_PlacementPlanConsolidationRes, (caddr_t)&result);
+    }
+    return success;
+}
+
+// Get the hot path metrics of PlacementController
+bool PlacementController_clnt::getMetrics(Json::Value& metrics)
+{
+    PlacementGetMetricsRes result;
+    memset(&result, 0, sizeof(result));
+    enum clnt_stat status = placement_controller_get_metrics_1(&result, _cl);
+    if (status != RPC_SUCCESS) {
+        clnt_perror(_cl, "Failed PlacementController RPC");
+        return false;
+    }
+    bool success = stringToJson(result.metrics, metrics);
+    xdr_free((xdrproc_t)xdr_PlacementGetMetricsRes, (caddr_t)&result);
+    return success;
+}
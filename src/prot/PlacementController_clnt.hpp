@@ -15,6 +15,15 @@
 
 using namespace std;
 
+// Move of a workload to a new placement in a consolidation plan
+struct ConsolidationMove {
+    string name;
+    string clientHost;
+    string clientVM;
+    string serverHost;
+    string serverVM;
+};
+
 class PlacementController_clnt
 {
 private:
@@ -40,6 +49,10 @@ public:
     void delClient(string name);
     // Delete a vector of clients from PlacementController
     void delClients(const vector<string>& names);
+    // Plan the moves of workloads that would empty up to maxServerHosts server hosts (0 for no limit); returns false if the RPC failed
+    bool planConsolidation(unsigned int maxServerHosts, vector<ConsolidationMove>& moves, vector<string>& serverHosts);
+    // Get the hot path metrics of PlacementController (see common/metrics.hpp); returns false if the RPC fails
+    bool getMetrics(Json::Value& metrics);
 };
 
 #endif // _PLACEMENT_CONTROLLER_CLNT_HPP
@@ -92,6 +92,36 @@ struct PlacementDelServerVMRes {
     PlacementStatus status;
 };
 
+/* Arguments for PlanConsolidation RPC */
+struct PlacementPlanConsolidationArgs {
+    /* maximum number of server hosts to empty, or 0 for no limit */
+    unsigned int maxServerHosts;
+};
+
+/* Move of a workload to a new placement */
+struct PlacementMove {
+    str name;
+    str clientHost;
+    str clientVM;
+    str serverHost;
+    str serverVM;
+};
+
+/* Results for PlanConsolidation RPC */
+struct PlacementPlanConsolidationRes {
+    PlacementStatus status;
+    /* server hosts emptied by the moves */
+    str serverHosts<>;
+    /* moves in the order they should be applied */
+    PlacementMove moves<>;
+};
+
+/* Results for GetMetrics RPC */
+struct PlacementGetMetricsRes {
+    /* string encoded JSON of the metrics (see common/metrics.hpp) */
+    str metrics;
+};
+
 /* PlacementController RPC interface */
 program PLACEMENT_CONTROLLER_PROGRAM {
     version PLACEMENT_CONTROLLER_V1 {
@@ -121,5 +151,13 @@ program PLACEMENT_CONTROLLER_PROGRAM {
         /* Delete a server VM */
         PlacementDelServerVMRes
         PLACEMENT_CONTROLLER_DEL_SERVER_VM(PlacementDelServerVMArgs) = 6;
+
+        /* Plan the moves of workloads that would empty the least loaded server hosts without changing the placement */
+        PlacementPlanConsolidationRes
+        PLACEMENT_CONTROLLER_PLAN_CONSOLIDATION(PlacementPlanConsolidationArgs) = 7;
+
+        /* Get the hot path metrics */
+        PlacementGetMetricsRes
+        PLACEMENT_CONTROLLER_GET_METRICS(void) = 8;
     } = 1;
 } = 8004;
@@ -6,7 +6,9 @@
 
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
 #include <string>
+#include <vector>
 #include <json/json.h>
 #include <rpc/rpc.h>
 #include "net_prot.h"
@@ -15,13 +17,16 @@
 
 using namespace std;
 
-net_clnt::net_clnt(string serverAddr, time_t timeoutSec)
+net_clnt::net_clnt(string serverAddr, time_t timeoutSec, bool exitOnFailure)
 {
     // Connect to NetEnforcer server
     _cl = clnt_create(serverAddr.c_str(), NET_ENFORCER_PROGRAM, NET_ENFORCER_V1, "tcp");
     if (_cl == NULL) {
         clnt_pcreateerror(serverAddr.c_str());
-        exit(-1);
+        if (exitOnFailure) {
+            exit(-1);
+        }
+        return;
     }
     // Set nearly infinite RPC timeout
     struct timeval timeout;
@@ -33,54 +38,81 @@ net_clnt::net_clnt(string serverAddr, time_t timeoutSec)
 net_clnt::~net_clnt()
 {
     // Destroy client
-    clnt_destroy(_cl);
+    if (_cl != NULL) {
+        clnt_destroy(_cl);
+    }
 }
 
 // Update network QoS parameters for a client
 void net_clnt::updateClient(const Json::Value& flowInfo)
 {
-    NetClientUpdate arg;
-    arg.client.s_dstAddr = addrInfo(flowInfo["dstAddr"].asString());
-    arg.client.s_srcAddr = addrInfo(flowInfo["srcAddr"].asString());
-    arg.priority = flowInfo["priority"].asUInt();
-    if (flowInfo.isMember("rateLimiters")) {
-        const Json::Value& rateLimiters = flowInfo["rateLimiters"];
-        arg.rateLimitRates.rateLimitRates_len = rateLimiters.size();
-        arg.rateLimitRates.rateLimitRates_val = new double[arg.rateLimitRates.rateLimitRates_len];
-        arg.rateLimitBursts.rateLimitBursts_len = arg.rateLimitRates.rateLimitRates_len;
-        arg.rateLimitBursts.rateLimitBursts_val = new double[arg.rateLimitBursts.rateLimitBursts_len];
-        for (unsigned int i = 0; i < rateLimiters.size(); i++) {
-            const Json::Value& rateLimit = rateLimiters[i];
-            arg.rateLimitRates.rateLimitRates_val[i] = rateLimit["rate"].asDouble();
-            arg.rateLimitBursts.rateLimitBursts_val[i] = rateLimit["burst"].asDouble();
+    updateClients(vector<Json::Value>(1, flowInfo));
+}
+
+// Update network QoS parameters for multiple clients in one RPC
+bool net_clnt::updateClients(const vector<Json::Value>& flowInfos)
+{
+    NetClientUpdate* updates = new NetClientUpdate[flowInfos.size()];
+    for (unsigned int index = 0; index < flowInfos.size(); index++) {
+        const Json::Value& flowInfo = flowInfos[index];
+        NetClientUpdate& arg = updates[index];
+        arg.client.s_dstAddr = addrInfo(flowInfo["dstAddr"].asString());
+        arg.client.s_srcAddr = addrInfo(flowInfo["srcAddr"].asString());
+        arg.priority = flowInfo["priority"].asUInt();
+        if (flowInfo.isMember("rateLimiters")) {
+            const Json::Value& rateLimiters = flowInfo["rateLimiters"];
+            arg.rateLimitRates.rateLimitRates_len = rateLimiters.size();
+            arg.rateLimitRates.rateLimitRates_val = new double[arg.rateLimitRates.rateLimitRates_len];
+            arg.rateLimitBursts.rateLimitBursts_len = arg.rateLimitRates.rateLimitRates_len;
+            arg.rateLimitBursts.rateLimitBursts_val = new double[arg.rateLimitBursts.rateLimitBursts_len];
+            for (unsigned int i = 0; i < rateLimiters.size(); i++) {
+                const Json::Value& rateLimit = rateLimiters[i];
+                arg.rateLimitRates.rateLimitRates_val[i] = rateLimit["rate"].asDouble();
+                arg.rateLimitBursts.rateLimitBursts_val[i] = rateLimit["burst"].asDouble();
+            }
+        } else {
+            arg.rateLimitRates.rateLimitRates_len = 0;
+            arg.rateLimitRates.rateLimitRates_val = NULL;
+            arg.rateLimitBursts.rateLimitBursts_len = 0;
+            arg.rateLimitBursts.rateLimitBursts_val = NULL;
         }
-    } else {
-        arg.rateLimitRates.rateLimitRates_len = 0;
-        arg.rateLimitRates.rateLimitRates_val = NULL;
-        arg.rateLimitBursts.rateLimitBursts_len = 0;
-        arg.rateLimitBursts.rateLimitBursts_val = NULL;
     }
-    NetUpdateClientsArgs args = {1, &arg};
+    NetUpdateClientsArgs args = {static_cast<u_int>(flowInfos.size()), updates};
     enum clnt_stat status = net_enforcer_update_clients_1(args, NULL, _cl);
     if (status != RPC_SUCCESS) {
         clnt_perror(_cl, "Failed network RPC");
     }
     // Free memory
-    delete[] arg.rateLimitRates.rateLimitRates_val;
-    delete[] arg.rateLimitBursts.rateLimitBursts_val;
+    for (unsigned int index = 0; index < flowInfos.size(); index++) {
+        delete[] updates[index].rateLimitRates.rateLimitRates_val;
+        delete[] updates[index].rateLimitBursts.rateLimitBursts_val;
+    }
+    delete[] updates;
+    return (status == RPC_SUCCESS);
 }
 
 // Remove a client and revert its network QoS settings to defaults
 void net_clnt::removeClient(const Json::Value& flowInfo)
 {
-    NetClient arg;
-    arg.s_dstAddr = addrInfo(flowInfo["dstAddr"].asString());
-    arg.s_srcAddr = addrInfo(flowInfo["srcAddr"].asString());
-    NetRemoveClientsArgs args = {1, &arg};
+    removeClients(vector<Json::Value>(1, flowInfo));
+}
+
+// Remove multiple clients in one RPC
+bool net_clnt::removeClients(const vector<Json::Value>& flowInfos)
+{
+    NetClient* clients = new NetClient[flowInfos.size()];
+    for (unsigned int index = 0; index < flowInfos.size(); index++) {
+        clients[index].s_dstAddr = addrInfo(flowInfos[index]["dstAddr"].asString());
+        clients[index].s_srcAddr = addrInfo(flowInfos[index]["srcAddr"].asString());
+    }
+    NetRemoveClientsArgs args = {static_cast<u_int>(flowInfos.size()), clients};
     enum clnt_stat status = net_enforcer_remove_clients_1(args, NULL, _cl);
     if (status != RPC_SUCCESS) {
         clnt_perror(_cl, "Failed network RPC");
     }
+    // Free memory
+    delete[] clients;
+    return (status == RPC_SUCCESS);
 }
 
 // Get occupancy of a client
@@ -98,3 +130,37 @@ double net_clnt::getOccupancy(unsigned long dstAddr, unsigned long srcAddr)
         return result.occupancy;
     }
 }
+
+// Get occupancy of all clients
+bool net_clnt::getAllOccupancy(map<pair<unsigned long, unsigned long>, double>& occupancies)
+{
+    NetGetAllOccupancyRes result;
+    memset(&result, 0, sizeof(result));
+    enum clnt_stat status = net_enforcer_get_all_occupancy_1(&result, _cl);
+    if (status != RPC_SUCCESS) {
+        clnt_perror(_cl, "Failed network RPC");
+        return false;
+    }
+    occupancies.clear();
+    for (unsigned int i = 0; i < result.NetGetAllOccupancyRes_len; i++) {
+        const NetClientOccupancy& clientOccupancy = result.NetGetAllOccupancyRes_val[i];
+        occupancies[make_pair(clientOccupancy.client.s_dstAddr, clientOccupancy.client.s_srcAddr)] = clientOccupancy.occupancy;
+    }
+    clnt_freeres(_cl, (xdrproc_t)xdr_NetGetAllOccupancyRes, (caddr_t)&result);
+    return true;
+}
+
+// Get the hot path metrics of the NetEnforcer
+bool net_clnt::getMetrics(Json::Value& metrics)
+{
+    NetGetMetricsRes result;
+    memset(&result, 0, sizeof(result));
+    enum clnt_stat status = net_enforcer_get_metrics_1(&result, _cl);
+    if (status != RPC_SUCCESS) {
+        clnt_perror(_cl, "Failed network RPC");
+        return false;
+    }
+    bool success = stringToJson(result.metrics, metrics);
+    clnt_freeres(_cl, (xdrproc_t)xdr_NetGetMetricsRes, (caddr_t)&result);
+    return success;
+}
@@ -8,6 +8,9 @@
 #define _NET_CLNT_HPP
 
 #include <string>
+#include <vector>
+#include <map>
+#include <utility>
 #include <json/json.h>
 #include <rpc/rpc.h>
 #include "net_prot.h"
@@ -20,15 +23,27 @@ private:
     CLIENT* _cl;
 
 public:
-    net_clnt(string serverAddr, time_t timeoutSec = 5);
+    // Connect to the NetEnforcer at serverAddr; exits on failure unless exitOnFailure is false, in which case connected() returns false
+    net_clnt(string serverAddr, time_t timeoutSec = 5, bool exitOnFailure = true);
     ~net_clnt();
 
+    // Check if the connection to the NetEnforcer was established
+    bool connected() const { return _cl != NULL; }
+
     // Update network QoS parameters for a client
     void updateClient(const Json::Value& flowInfo);
+    // Update network QoS parameters for multiple clients in one RPC; returns false if the RPC fails
+    bool updateClients(const vector<Json::Value>& flowInfos);
     // Remove a client and revert its network QoS settings to defaults
     void removeClient(const Json::Value& flowInfo);
+    // Remove multiple clients in one RPC; returns false if the RPC fails
+    bool removeClients(const vector<Json::Value>& flowInfos);
     // Get occupancy of a client
     double getOccupancy(unsigned long dstAddr, unsigned long srcAddr);
+    // Get occupancy of all clients by (dstAddr, srcAddr) in one RPC; returns false if the RPC fails
+    bool getAllOccupancy(map<pair<unsigned long, unsigned long>, double>& occupancies);
+    // Get the hot path metrics of the NetEnforcer (see common/metrics.hpp); returns false if the RPC fails
+    bool getMetrics(Json::Value& metrics);
 };
 
 #endif // _NET_CLNT_HPP
@@ -32,6 +32,18 @@ struct NetGetOccupancyRes {
     double occupancy;
 };
 
+struct NetClientOccupancy {
+    NetClient client;
+    double occupancy;
+};
+
+typedef NetClientOccupancy NetGetAllOccupancyRes<>;
+
+/* string encoded JSON of the hot path metrics (see common/metrics.hpp) */
+struct NetGetMetricsRes {
+    string metrics<>;
+};
+
 /* NetEnforcer RPC interface */
 program NET_ENFORCER_PROGRAM {
     version NET_ENFORCER_V1 {
@@ -49,5 +61,13 @@ program NET_ENFORCER_PROGRAM {
         /* Get occupancy statistics */
         NetGetOccupancyRes
         NET_ENFORCER_GET_OCCUPANCY(NetGetOccupancyArgs) = 3;
+
+        /* Get occupancy statistics of all clients */
+        NetGetAllOccupancyRes
+        NET_ENFORCER_GET_ALL_OCCUPANCY(void) = 4;
+
+        /* Get the hot path metrics */
+        NetGetMetricsRes
+        NET_ENFORCER_GET_METRICS(void) = 5;
     } = 1;
 } = 8001;
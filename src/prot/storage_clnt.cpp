@@ -6,7 +6,9 @@
 
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
 #include <string>
+#include <vector>
 #include <json/json.h>
 #include <rpc/rpc.h>
 #include "storage_prot.h"
@@ -15,13 +17,16 @@
 
 using namespace std;
 
-storage_clnt::storage_clnt(string serverAddr, time_t timeoutSec)
+storage_clnt::storage_clnt(string serverAddr, time_t timeoutSec, bool exitOnFailure)
 {
     // Connect to NFSEnforcer server
     _cl = clnt_create(serverAddr.c_str(), STORAGE_ENFORCER_PROGRAM, STORAGE_ENFORCER_V1, "tcp");
     if (_cl == NULL) {
         clnt_pcreateerror(serverAddr.c_str());
-        exit(-1);
+        if (exitOnFailure) {
+            exit(-1);
+        }
+        return;
     }
     // Set nearly infinite RPC timeout
     struct timeval timeout;
@@ -33,40 +38,56 @@ storage_clnt::storage_clnt(string serverAddr, time_t timeoutSec)
 storage_clnt::~storage_clnt()
 {
     // Destroy client
-    clnt_destroy(_cl);
+    if (_cl != NULL) {
+        clnt_destroy(_cl);
+    }
 }
 
 // Update storage QoS parameters for a client
 void storage_clnt::updateClient(const Json::Value& flowInfo)
 {
-    StorageClient arg;
-    arg.s_addr = addrInfo(flowInfo["clientAddr"].asString());
-    arg.priority = flowInfo["priority"].asUInt();
-    if (flowInfo.isMember("rateLimiters")) {
-        const Json::Value& rateLimiters = flowInfo["rateLimiters"];
-        arg.rateLimitRates.rateLimitRates_len = rateLimiters.size();
-        arg.rateLimitRates.rateLimitRates_val = new double[arg.rateLimitRates.rateLimitRates_len];
-        arg.rateLimitBursts.rateLimitBursts_len = arg.rateLimitRates.rateLimitRates_len;
-        arg.rateLimitBursts.rateLimitBursts_val = new double[arg.rateLimitBursts.rateLimitBursts_len];
-        for (unsigned int i = 0; i < rateLimiters.size(); i++) {
-            const Json::Value& rateLimit = rateLimiters[i];
-            arg.rateLimitRates.rateLimitRates_val[i] = rateLimit["rate"].asDouble();
-            arg.rateLimitBursts.rateLimitBursts_val[i] = rateLimit["burst"].asDouble();
+    updateClients(vector<Json::Value>(1, flowInfo));
+}
+
+// Update storage QoS parameters for multiple clients in one RPC
+bool storage_clnt::updateClients(const vector<Json::Value>& flowInfos)
+{
+    StorageClient* clients = new StorageClient[flowInfos.size()];
+    for (unsigned int index = 0; index < flowInfos.size(); index++) {
+        const Json::Value& flowInfo = flowInfos[index];
+        StorageClient& arg = clients[index];
+        arg.s_addr = addrInfo(flowInfo["clientAddr"].asString());
+        arg.priority = flowInfo["priority"].asUInt();
+        if (flowInfo.isMember("rateLimiters")) {
+            const Json::Value& rateLimiters = flowInfo["rateLimiters"];
+            arg.rateLimitRates.rateLimitRates_len = rateLimiters.size();
+            arg.rateLimitRates.rateLimitRates_val = new double[arg.rateLimitRates.rateLimitRates_len];
+            arg.rateLimitBursts.rateLimitBursts_len = arg.rateLimitRates.rateLimitRates_len;
+            arg.rateLimitBursts.rateLimitBursts_val = new double[arg.rateLimitBursts.rateLimitBursts_len];
+            for (unsigned int i = 0; i < rateLimiters.size(); i++) {
+                const Json::Value& rateLimit = rateLimiters[i];
+                arg.rateLimitRates.rateLimitRates_val[i] = rateLimit["rate"].asDouble();
+                arg.rateLimitBursts.rateLimitBursts_val[i] = rateLimit["burst"].asDouble();
+            }
+        } else {
+            arg.rateLimitRates.rateLimitRates_len = 0;
+            arg.rateLimitRates.rateLimitRates_val = NULL;
+            arg.rateLimitBursts.rateLimitBursts_len = 0;
+            arg.rateLimitBursts.rateLimitBursts_val = NULL;
         }
-    } else {
-        arg.rateLimitRates.rateLimitRates_len = 0;
-        arg.rateLimitRates.rateLimitRates_val = NULL;
-        arg.rateLimitBursts.rateLimitBursts_len = 0;
-        arg.rateLimitBursts.rateLimitBursts_val = NULL;
     }
-    StorageUpdateArgs args = {1, &arg};
+    StorageUpdateArgs args = {static_cast<u_int>(flowInfos.size()), clients};
     enum clnt_stat status = storage_enforcer_update_1(args, NULL, _cl);
     if (status != RPC_SUCCESS) {
         clnt_perror(_cl, "Failed storage RPC");
     }
     // Free memory
-    delete[] arg.rateLimitRates.rateLimitRates_val;
-    delete[] arg.rateLimitBursts.rateLimitBursts_val;
+    for (unsigned int index = 0; index < flowInfos.size(); index++) {
+        delete[] clients[index].rateLimitRates.rateLimitRates_val;
+        delete[] clients[index].rateLimitBursts.rateLimitBursts_val;
+    }
+    delete[] clients;
+    return (status == RPC_SUCCESS);
 }
 
 // Get occupancy of a client
@@ -83,3 +104,98 @@ double storage_clnt::getOccupancy(unsigned long clientAddr)
         return result.occupancy;
     }
 }
+
+// Get r-b curve of a client's recent requests; rates are decreasing
+bool storage_clnt::getRbCurve(unsigned long clientAddr, vector<double>& rates, vector<double>& bursts)
+{
+    StorageGetRbCurveArgs arg;
+    arg.s_addr = clientAddr;
+    StorageGetRbCurveRes result;
+    memset(&result, 0, sizeof(result));
+    enum clnt_stat status = storage_enforcer_get_rb_curve_1(arg, &result, _cl);
+    if (status != RPC_SUCCESS) {
+        clnt_perror(_cl, "Failed storage RPC");
+        return false;
+    }
+    rates.assign(result.rates.rates_val, result.rates.rates_val + result.rates.rates_len);
+    bursts.assign(result.bursts.bursts_val, result.bursts.bursts_val + result.bursts.bursts_len);
+    clnt_freeres(_cl, (xdrproc_t)xdr_StorageGetRbCurveRes, (caddr_t)&result);
+    return true;
+}
+
+// Convert a latency histogram to JSON
+static Json::Value convertLatencyHistogram(const StorageLatencyHistogram& histogram)
+{
+    Json::Value value;
+    value["count"] = Json::UInt64(histogram.count);
+    value["sum"] = histogram.sum;
+    value["max"] = histogram.max;
+    value["bucketLatencies"] = Json::Value(Json::arrayValue);
+    value["bucketCounts"] = Json::Value(Json::arrayValue);
+    for (unsigned int i = 0; i < histogram.bucketLatencies.bucketLatencies_len; i++) {
+        value["bucketLatencies"].append(histogram.bucketLatencies.bucketLatencies_val[i]);
+        value["bucketCounts"].append(Json::UInt64(histogram.bucketCounts.bucketCounts_val[i]));
+    }
+    return value;
+}
+
+// Get latency histograms (in seconds) and dispatch counters of a client's READ/WRITE requests since the last reset
+bool storage_clnt::getStats(unsigned long clientAddr, bool reset, Json::Value& stats)
+{
+    StorageGetStatsArgs arg;
+    arg.s_addr = clientAddr;
+    arg.reset = reset;
+    StorageGetStatsRes result;
+    memset(&result, 0, sizeof(result));
+    enum clnt_stat status = storage_enforcer_get_stats_1(arg, &result, _cl);
+    if (status != RPC_SUCCESS) {
+        clnt_perror(_cl, "Failed storage RPC");
+        return false;
+    }
+    stats = Json::Value(Json::objectValue);
+    stats["interval"] = result.interval;
+    stats["readQueueTime"] = convertLatencyHistogram(result.readQueueTime);
+    stats["readServiceTime"] = convertLatencyHistogram(result.readServiceTime);
+    stats["readTotalTime"] = convertLatencyHistogram(result.readTotalTime);
+    stats["writeQueueTime"] = convertLatencyHistogram(result.writeQueueTime);
+    stats["writeServiceTime"] = convertLatencyHistogram(result.writeServiceTime);
+    stats["writeTotalTime"] = convertLatencyHistogram(result.writeTotalTime);
+    stats["rateLimitExceededJobs"] = Json::UInt64(result.rateLimitExceededJobs);
+    stats["immediateJobs"] = Json::UInt64(result.immediateJobs);
+    clnt_freeres(_cl, (xdrproc_t)xdr_StorageGetStatsRes, (caddr_t)&result);
+    return true;
+}
+
+// Get the current MPLs and bytes limits at the storage device
+bool storage_clnt::getConcurrency(Json::Value& concurrency)
+{
+    StorageGetConcurrencyRes result;
+    memset(&result, 0, sizeof(result));
+    enum clnt_stat status = storage_enforcer_get_concurrency_1(&result, _cl);
+    if (status != RPC_SUCCESS) {
+        clnt_perror(_cl, "Failed storage RPC");
+        return false;
+    }
+    concurrency = Json::Value(Json::objectValue);
+    concurrency["adaptive"] = (bool)result.adaptive;
+    concurrency["readMPL"] = result.readMPL;
+    concurrency["writeMPL"] = result.writeMPL;
+    concurrency["maxOutstandingReadBytes"] = result.maxOutstandingReadBytes;
+    concurrency["maxOutstandingWriteBytes"] = result.maxOutstandingWriteBytes;
+    return true;
+}
+
+// Get the hot path metrics of the NFSEnforcer
+bool storage_clnt::getMetrics(Json::Value& metrics)
+{
+    StorageGetMetricsRes result;
+    memset(&result, 0, sizeof(result));
+    enum clnt_stat status = storage_enforcer_get_metrics_1(&result, _cl);
+    if (status != RPC_SUCCESS) {
+        clnt_perror(_cl, "Failed storage RPC");
+        return false;
+    }
+    bool success = stringToJson(result.metrics, metrics);
+    clnt_freeres(_cl, (xdrproc_t)xdr_StorageGetMetricsRes, (caddr_t)&result);
+    return success;
+}
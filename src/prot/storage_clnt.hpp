@@ -8,6 +8,7 @@
 #define _STORAGE_CLNT_HPP
 
 #include <string>
+#include <vector>
 #include <json/json.h>
 #include <rpc/rpc.h>
 #include "storage_prot.h"
@@ -20,13 +21,27 @@ private:
     CLIENT* _cl;
 
 public:
-    storage_clnt(string serverAddr, time_t timeoutSec = 5);
+    // Connect to the NFSEnforcer at serverAddr; exits on failure unless exitOnFailure is false, in which case connected() returns false
+    storage_clnt(string serverAddr, time_t timeoutSec = 5, bool exitOnFailure = true);
     ~storage_clnt();
 
+    // Check if the connection to the NFSEnforcer was established
+    bool connected() const { return _cl != NULL; }
+
     // Update storage QoS parameters for a client
     void updateClient(const Json::Value& flowInfo);
+    // Update storage QoS parameters for multiple clients in one RPC; returns false if the RPC fails
+    bool updateClients(const vector<Json::Value>& flowInfos);
     // Get occupancy of a client
     double getOccupancy(unsigned long clientAddr);
+    // Get r-b curve of a client's recent requests; rates are decreasing
+    bool getRbCurve(unsigned long clientAddr, vector<double>& rates, vector<double>& bursts);
+    // Get latency histograms (in seconds) and dispatch counters of a client's READ/WRITE requests since the last reset, optionally resetting them
+    bool getStats(unsigned long clientAddr, bool reset, Json::Value& stats);
+    // Get the current MPLs and bytes limits at the storage device; returns false if the RPC fails
+    bool getConcurrency(Json::Value& concurrency);
+    // Get the hot path metrics of the NFSEnforcer (see common/metrics.hpp); returns false if the RPC fails
+    bool getMetrics(Json::Value& metrics);
 };
 
 #endif // _STORAGE_CLNT_HPP
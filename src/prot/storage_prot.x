@@ -24,6 +24,57 @@ struct StorageGetOccupancyRes {
     double occupancy;
 };
 
+struct StorageGetRbCurveArgs {
+    unsigned long s_addr;
+};
+
+/* r-b curve of a client's recent requests; rates are decreasing */
+struct StorageGetRbCurveRes {
+    double rates<>;
+    double bursts<>;
+};
+
+struct StorageGetStatsArgs {
+    unsigned long s_addr;
+    bool reset; /* reset the statistics after sampling them */
+};
+
+/* Latency histogram in seconds; buckets are given by their lower bounds, and empty buckets are omitted */
+struct StorageLatencyHistogram {
+    unsigned hyper count;
+    double sum;
+    double max;
+    double bucketLatencies<>;
+    unsigned hyper bucketCounts<>;
+};
+
+/* Statistics of a client's READ/WRITE requests since the last reset */
+struct StorageGetStatsRes {
+    double interval; /* seconds since the last reset, or 0 if the client is unknown */
+    StorageLatencyHistogram readQueueTime;
+    StorageLatencyHistogram readServiceTime;
+    StorageLatencyHistogram readTotalTime;
+    StorageLatencyHistogram writeQueueTime;
+    StorageLatencyHistogram writeServiceTime;
+    StorageLatencyHistogram writeTotalTime;
+    unsigned hyper rateLimitExceededJobs;
+    unsigned hyper immediateJobs;
+};
+
+/* Current limits on concurrent jobs at the storage device */
+struct StorageGetConcurrencyRes {
+    bool adaptive; /* limits are adjusted online */
+    int readMPL;
+    int writeMPL;
+    int maxOutstandingReadBytes;
+    int maxOutstandingWriteBytes;
+};
+
+/* string encoded JSON of the hot path metrics (see common/metrics.hpp) */
+struct StorageGetMetricsRes {
+    string metrics<>;
+};
+
 program STORAGE_ENFORCER_PROGRAM {
     version STORAGE_ENFORCER_V1 {
         void
@@ -36,5 +87,21 @@ program STORAGE_ENFORCER_PROGRAM {
         /* Get occupancy statistics */
         StorageGetOccupancyRes
         STORAGE_ENFORCER_GET_OCCUPANCY(StorageGetOccupancyArgs) = 2;
+
+        /* Get r-b curve of recent requests */
+        StorageGetRbCurveRes
+        STORAGE_ENFORCER_GET_RB_CURVE(StorageGetRbCurveArgs) = 3;
+
+        /* Get latency histograms and dispatch counters, optionally resetting them */
+        StorageGetStatsRes
+        STORAGE_ENFORCER_GET_STATS(StorageGetStatsArgs) = 4;
+
+        /* Get current MPLs and bytes limits */
+        StorageGetConcurrencyRes
+        STORAGE_ENFORCER_GET_CONCURRENCY(void) = 5;
+
+        /* Get the hot path metrics */
+        StorageGetMetricsRes
+        STORAGE_ENFORCER_GET_METRICS(void) = 6;
     } = 1;
 } = 8002;